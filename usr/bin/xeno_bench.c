@@ -0,0 +1,446 @@
+/* xeno_bench.c - micro benchmarks for the wrapper's device-level modules
+ *
+ * Runs through the Vulkan loader, so the installed wrapper ICD is what gets measured. Each
+ * benchmark creates its own device once per configuration; configurations are selected through
+ * the same XCLIPSE_* variables the wrapper reads at vkCreateDevice.
+ *
+ *   xeno_bench memory [--count N] [--rounds R] [--max-kb K]
+ *                     allocation churn on the device-local type, suballocated vs passthrough
+ *   xeno_bench staging [--mb N] [--frames F] [--kb K]
+ *                     upload throughput: a fresh host-visible allocation per upload, vkCmdUpdateBuffer
+ *                     passed through, and vkCmdUpdateBuffer redirected through the staging ring
+ *   xeno_bench objects [--count N] [--threads T]
+ *                     small object create/destroy throughput, driver allocator vs XCLIPSE_HOST_ALLOC
+ *   xeno_bench state [--draws N] [--frames F]
+ *                     recording cost of a draw loop re-setting unchanged state, passed through vs
+ *                     XCLIPSE_STATE_FILTER; no pipeline is bound, so only the state calls are timed
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <vulkan/vulkan.h>
+
+static uint64_t now_ns(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t rng_next(uint64_t* s) { *s ^= *s << 13; *s ^= *s >> 7; *s ^= *s << 17; return *s; }
+
+typedef struct { VkInstance instance; VkPhysicalDevice gpu; VkDevice device; VkPhysicalDeviceMemoryProperties mem; } bench_ctx_t;
+
+static int ctx_instance(bench_ctx_t* c) {
+    VkApplicationInfo app = { .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO, .pApplicationName = "xeno_bench", .apiVersion = VK_API_VERSION_1_1 };
+    VkInstanceCreateInfo ici = { .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO, .pApplicationInfo = &app };
+    if (vkCreateInstance(&ici, NULL, &c->instance) != VK_SUCCESS) { fprintf(stderr, "vkCreateInstance failed\n"); return 1; }
+    uint32_t n = 1;
+    VkResult r = vkEnumeratePhysicalDevices(c->instance, &n, &c->gpu);
+    if ((r != VK_SUCCESS && r != VK_INCOMPLETE) || n == 0) { fprintf(stderr, "no physical device\n"); vkDestroyInstance(c->instance, NULL); return 1; }
+    vkGetPhysicalDeviceMemoryProperties(c->gpu, &c->mem);
+    return 0;
+}
+
+static int ctx_device(bench_ctx_t* c) {
+    float prio = 1.0f;
+    VkDeviceQueueCreateInfo q = { .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO, .queueFamilyIndex = 0, .queueCount = 1, .pQueuePriorities = &prio };
+    VkDeviceCreateInfo dci = { .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO, .queueCreateInfoCount = 1, .pQueueCreateInfos = &q };
+    if (vkCreateDevice(c->gpu, &dci, NULL, &c->device) != VK_SUCCESS) { fprintf(stderr, "vkCreateDevice failed\n"); return 1; }
+    return 0;
+}
+
+static uint32_t find_type(const bench_ctx_t* c, VkMemoryPropertyFlags want) {
+    for (uint32_t i = 0; i < c->mem.memoryTypeCount; ++i)
+        if ((c->mem.memoryTypes[i].propertyFlags & want) == want) return i;
+    return 0;
+}
+
+/* ---- memory ---- */
+
+typedef struct { uint64_t alloc_ns, free_ns, allocs, frees, failed; } mem_result_t;
+
+/* fill count slots, then each round flips a random half of them: live ones are freed, empty ones get a new size */
+static int mem_run(bench_ctx_t* c, uint32_t type, uint32_t count, uint32_t rounds, uint64_t max_bytes, mem_result_t* out) {
+    VkDeviceMemory* slots = calloc(count, sizeof(*slots));
+    if (!slots) return 1;
+    memset(out, 0, sizeof(*out));
+    uint64_t seed = 0x9e3779b97f4a7c15ull;
+    for (uint32_t round = 0; round <= rounds; ++round) {
+        for (uint32_t i = 0; i < count; ++i) {
+            if (round && (rng_next(&seed) & 1)) continue;
+            if (slots[i]) {
+                uint64_t t0 = now_ns();
+                vkFreeMemory(c->device, slots[i], NULL);
+                out->free_ns += now_ns() - t0; out->frees++; slots[i] = VK_NULL_HANDLE;
+                continue;
+            }
+            VkMemoryAllocateInfo ai = { .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                                        .allocationSize = 4096 + (rng_next(&seed) % max_bytes) / 256 * 256, .memoryTypeIndex = type };
+            uint64_t t0 = now_ns();
+            VkResult r = vkAllocateMemory(c->device, &ai, NULL, &slots[i]);
+            uint64_t dt = now_ns() - t0;
+            if (r != VK_SUCCESS) { out->failed++; slots[i] = VK_NULL_HANDLE; continue; }
+            out->alloc_ns += dt; out->allocs++;
+        }
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!slots[i]) continue;
+        uint64_t t0 = now_ns();
+        vkFreeMemory(c->device, slots[i], NULL);
+        out->free_ns += now_ns() - t0; out->frees++;
+    }
+    free(slots);
+    return 0;
+}
+
+static void mem_print(const char* name, const mem_result_t* r) {
+    printf("%-12s allocs=%" PRIu64 " failed=%" PRIu64 " alloc_ns=%.0f free_ns=%.0f\n", name, r->allocs, r->failed,
+           r->allocs ? (double)r->alloc_ns / r->allocs : 0.0, r->frees ? (double)r->free_ns / r->frees : 0.0);
+}
+
+static int cmd_memory(int argc, char** argv) {
+    uint32_t count = 1024, rounds = 16; uint64_t max_kb = 256;
+    for (int i = 0; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--count") == 0) count = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--rounds") == 0) rounds = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--max-kb") == 0) max_kb = strtoull(argv[i + 1], NULL, 10);
+        else return 2;
+    }
+    if (!count || !max_kb) return 2;
+    bench_ctx_t c = {0};
+    if (ctx_instance(&c) != 0) return 1;
+    uint32_t type = find_type(&c, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    printf("memory type %u, %u live allocations, %u rounds, sizes 4 KB .. %" PRIu64 " KB\n", type, count, rounds, max_kb + 4);
+    static const struct { const char* name; const char* suballoc; } modes[] = { { "passthrough", "0" }, { "suballoc", "1" } };
+    mem_result_t res[2];
+    int rc = 0;
+    for (int m = 0; m < 2 && rc == 0; ++m) {
+        setenv("XCLIPSE_SUBALLOC", modes[m].suballoc, 1);
+        if ((rc = ctx_device(&c)) != 0) break;
+        rc = mem_run(&c, type, count, rounds, max_kb * 1024, &res[m]);
+        vkDestroyDevice(c.device, NULL);
+        if (rc == 0) mem_print(modes[m].name, &res[m]);
+    }
+    if (rc == 0 && res[0].allocs && res[1].allocs) {
+        double pass = (double)(res[0].alloc_ns + res[0].free_ns) / res[0].allocs;
+        double sub = (double)(res[1].alloc_ns + res[1].free_ns) / res[1].allocs;
+        printf("speedup (alloc+free): %.2fx\n", sub > 0 ? pass / sub : 0.0);
+    }
+    vkDestroyInstance(c.instance, NULL);
+    return rc;
+}
+
+/* ---- staging ---- */
+
+enum { UPLOAD_NAIVE, UPLOAD_UPDATE };
+
+typedef struct {
+    VkQueue queue; VkCommandPool pool; VkCommandBuffer cb; VkFence fence;
+    VkBuffer dst; VkDeviceMemory dst_mem;
+    uint32_t host_type;
+} upload_ctx_t;
+
+static int upload_setup(bench_ctx_t* c, upload_ctx_t* u, VkDeviceSize dst_size) {
+    vkGetDeviceQueue(c->device, 0, 0, &u->queue);
+    VkCommandPoolCreateInfo pi = { .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT };
+    VkCommandBufferAllocateInfo ai = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, .commandBufferCount = 1 };
+    VkFenceCreateInfo fi = { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    VkBufferCreateInfo bi = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = dst_size, .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT };
+    if (vkCreateCommandPool(c->device, &pi, NULL, &u->pool) != VK_SUCCESS) return 1;
+    ai.commandPool = u->pool;
+    if (vkAllocateCommandBuffers(c->device, &ai, &u->cb) != VK_SUCCESS || vkCreateFence(c->device, &fi, NULL, &u->fence) != VK_SUCCESS) return 1;
+    if (vkCreateBuffer(c->device, &bi, NULL, &u->dst) != VK_SUCCESS) return 1;
+    VkMemoryRequirements req; vkGetBufferMemoryRequirements(c->device, u->dst, &req);
+    VkMemoryAllocateInfo mi = { .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, .allocationSize = req.size,
+                                .memoryTypeIndex = find_type(c, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) };
+    if (vkAllocateMemory(c->device, &mi, NULL, &u->dst_mem) != VK_SUCCESS || vkBindBufferMemory(c->device, u->dst, u->dst_mem, 0) != VK_SUCCESS) return 1;
+    u->host_type = find_type(c, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    return 0;
+}
+
+static void upload_teardown(bench_ctx_t* c, upload_ctx_t* u) {
+    vkDeviceWaitIdle(c->device);
+    if (u->dst) vkDestroyBuffer(c->device, u->dst, NULL);
+    if (u->dst_mem) vkFreeMemory(c->device, u->dst_mem, NULL);
+    if (u->fence) vkDestroyFence(c->device, u->fence, NULL);
+    if (u->pool) vkDestroyCommandPool(c->device, u->pool, NULL);
+}
+
+/* one one-time-submit command buffer per frame holding every upload of the frame, waited for at its end */
+static int upload_run(bench_ctx_t* c, upload_ctx_t* u, int mode, const unsigned char* data, uint32_t frames, uint32_t per_frame, uint32_t bytes, uint64_t* ns) {
+    VkBuffer* staging = calloc(per_frame, sizeof(*staging)); VkDeviceMemory* mems = calloc(per_frame, sizeof(*mems));
+    int rc = staging && mems ? 0 : 1;
+    uint64_t t0 = now_ns();
+    for (uint32_t f = 0; f < frames && rc == 0; ++f) {
+        VkCommandBufferBeginInfo bi = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT };
+        vkBeginCommandBuffer(u->cb, &bi);
+        for (uint32_t i = 0; i < per_frame && rc == 0; ++i) {
+            VkDeviceSize dst_offset = (VkDeviceSize)i * bytes;
+            if (mode == UPLOAD_UPDATE) { vkCmdUpdateBuffer(u->cb, u->dst, dst_offset, bytes, data); continue; }
+            VkBufferCreateInfo sbi = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = bytes, .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT };
+            VkMemoryAllocateInfo mi = { .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, .memoryTypeIndex = u->host_type };
+            VkMemoryRequirements req; void* p;
+            if (vkCreateBuffer(c->device, &sbi, NULL, &staging[i]) != VK_SUCCESS) { rc = 1; break; }
+            vkGetBufferMemoryRequirements(c->device, staging[i], &req); mi.allocationSize = req.size;
+            if (vkAllocateMemory(c->device, &mi, NULL, &mems[i]) != VK_SUCCESS || vkBindBufferMemory(c->device, staging[i], mems[i], 0) != VK_SUCCESS ||
+                vkMapMemory(c->device, mems[i], 0, VK_WHOLE_SIZE, 0, &p) != VK_SUCCESS) { rc = 1; break; }
+            memcpy(p, data, bytes);
+            vkUnmapMemory(c->device, mems[i]);
+            VkBufferCopy region = { 0, dst_offset, bytes };
+            vkCmdCopyBuffer(u->cb, staging[i], u->dst, 1, &region);
+        }
+        vkEndCommandBuffer(u->cb);
+        VkSubmitInfo si = { .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO, .commandBufferCount = 1, .pCommandBuffers = &u->cb };
+        if (rc == 0 && (vkQueueSubmit(u->queue, 1, &si, u->fence) != VK_SUCCESS || vkWaitForFences(c->device, 1, &u->fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS)) rc = 1;
+        vkResetFences(c->device, 1, &u->fence);
+        for (uint32_t i = 0; i < per_frame; ++i) {
+            if (staging[i]) vkDestroyBuffer(c->device, staging[i], NULL);
+            if (mems[i]) vkFreeMemory(c->device, mems[i], NULL);
+            staging[i] = VK_NULL_HANDLE; mems[i] = VK_NULL_HANDLE;
+        }
+    }
+    *ns = now_ns() - t0;
+    free(staging); free(mems);
+    return rc;
+}
+
+static int cmd_staging(int argc, char** argv) {
+    uint32_t mb = 8, frames = 64, kb = 64;
+    for (int i = 0; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--mb") == 0) mb = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--frames") == 0) frames = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--kb") == 0) kb = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        else return 2;
+    }
+    /* vkCmdUpdateBuffer takes at most 64 KB */
+    if (!mb || !frames || !kb || kb > 64) return 2;
+    uint32_t bytes = kb * 1024, per_frame = (mb << 20) / bytes ? (mb << 20) / bytes : 1;
+    unsigned char* data = malloc(bytes);
+    if (!data) return 1;
+    for (uint32_t i = 0; i < bytes; ++i) data[i] = (unsigned char)i;
+    bench_ctx_t c = {0};
+    if (ctx_instance(&c) != 0) { free(data); return 1; }
+    printf("%u frames of %u uploads x %u KB\n", frames, per_frame, kb);
+    static const struct { const char* name; int mode; const char* redirect; } modes[] = {
+        { "naive", UPLOAD_NAIVE, "0" }, { "update", UPLOAD_UPDATE, "0" }, { "ring", UPLOAD_UPDATE, "1" } };
+    double mbps[3] = {0};
+    int rc = 0;
+    for (int m = 0; m < 3 && rc == 0; ++m) {
+        setenv("XCLIPSE_STAGING_REDIRECT", modes[m].redirect, 1);
+        if ((rc = ctx_device(&c)) != 0) break;
+        upload_ctx_t u = {0}; uint64_t ns = 0;
+        rc = upload_setup(&c, &u, (VkDeviceSize)per_frame * bytes);
+        if (rc == 0) rc = upload_run(&c, &u, modes[m].mode, data, frames, per_frame, bytes, &ns);
+        upload_teardown(&c, &u);
+        vkDestroyDevice(c.device, NULL);
+        if (rc == 0) {
+            mbps[m] = ns ? (double)frames * per_frame * bytes / (1 << 20) / ((double)ns / 1e9) : 0.0;
+            printf("%-12s %.1f MB/s\n", modes[m].name, mbps[m]);
+        }
+    }
+    if (rc == 0 && mbps[0] > 0) printf("ring vs naive: %.2fx\n", mbps[2] / mbps[0]);
+    vkDestroyInstance(c.instance, NULL);
+    free(data);
+    return rc;
+}
+
+/* ---- objects ---- */
+
+#define OBJECT_KINDS 6
+
+typedef struct { VkDevice device; uint32_t count; int failed; } objects_job_t;
+
+/* each iteration creates and destroys one object of every kind */
+static void* objects_thread(void* arg) {
+    objects_job_t* j = arg;
+    VkDevice d = j->device;
+    VkSamplerCreateInfo si = { .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO, .magFilter = VK_FILTER_LINEAR, .minFilter = VK_FILTER_LINEAR, .maxLod = 1.0f };
+    VkFenceCreateInfo fi = { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    VkSemaphoreCreateInfo semi = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+    VkCommandPoolCreateInfo ci = { .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT };
+    VkDescriptorPoolSize ps = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 4 };
+    VkDescriptorPoolCreateInfo pi = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, .maxSets = 4, .poolSizeCount = 1, .pPoolSizes = &ps };
+    VkDescriptorSetLayoutBinding b = { .binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_ALL };
+    VkDescriptorSetLayoutCreateInfo li = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .bindingCount = 1, .pBindings = &b };
+    for (uint32_t i = 0; i < j->count && !j->failed; ++i) {
+        VkSampler s; VkFence f; VkSemaphore sem; VkCommandPool cp; VkDescriptorPool dp; VkDescriptorSetLayout dl;
+        if (vkCreateSampler(d, &si, NULL, &s) != VK_SUCCESS) { j->failed = 1; break; }
+        vkDestroySampler(d, s, NULL);
+        if (vkCreateFence(d, &fi, NULL, &f) != VK_SUCCESS) { j->failed = 1; break; }
+        vkDestroyFence(d, f, NULL);
+        if (vkCreateSemaphore(d, &semi, NULL, &sem) != VK_SUCCESS) { j->failed = 1; break; }
+        vkDestroySemaphore(d, sem, NULL);
+        if (vkCreateCommandPool(d, &ci, NULL, &cp) != VK_SUCCESS) { j->failed = 1; break; }
+        vkDestroyCommandPool(d, cp, NULL);
+        if (vkCreateDescriptorPool(d, &pi, NULL, &dp) != VK_SUCCESS) { j->failed = 1; break; }
+        vkDestroyDescriptorPool(d, dp, NULL);
+        if (vkCreateDescriptorSetLayout(d, &li, NULL, &dl) != VK_SUCCESS) { j->failed = 1; break; }
+        vkDestroyDescriptorSetLayout(d, dl, NULL);
+    }
+    return NULL;
+}
+
+static int cmd_objects(int argc, char** argv) {
+    uint32_t count = 20000, threads = 4;
+    for (int i = 0; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--count") == 0) count = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--threads") == 0) threads = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        else return 2;
+    }
+    if (!count || !threads || threads > 64) return 2;
+    bench_ctx_t c = {0};
+    if (ctx_instance(&c) != 0) return 1;
+    printf("%u threads x %u rounds of %d object kinds\n", threads, count, OBJECT_KINDS);
+    static const struct { const char* name; const char* host_alloc; } modes[] = { { "driver", "0" }, { "hostalloc", "1" } };
+    double rate[2] = {0};
+    int rc = 0;
+    for (int m = 0; m < 2 && rc == 0; ++m) {
+        setenv("XCLIPSE_HOST_ALLOC", modes[m].host_alloc, 1);
+        if ((rc = ctx_device(&c)) != 0) break;
+        objects_job_t jobs[64]; pthread_t tids[64]; uint32_t started = 0;
+        uint64_t t0 = now_ns();
+        for (; started < threads; ++started) {
+            jobs[started] = (objects_job_t){ c.device, count, 0 };
+            if (pthread_create(&tids[started], NULL, objects_thread, &jobs[started]) != 0) { rc = 1; break; }
+        }
+        for (uint32_t t = 0; t < started; ++t) { pthread_join(tids[t], NULL); if (jobs[t].failed) rc = 1; }
+        uint64_t ns = now_ns() - t0;
+        vkDestroyDevice(c.device, NULL);
+        if (rc != 0) { fprintf(stderr, "%s: object creation failed\n", modes[m].name); break; }
+        rate[m] = ns ? (double)threads * count * OBJECT_KINDS / ((double)ns / 1e9) : 0.0;
+        printf("%-12s %.0f create+destroy/s\n", modes[m].name, rate[m]);
+    }
+    if (rc == 0 && rate[0] > 0) printf("hostalloc vs driver: %.2fx\n", rate[1] / rate[0]);
+    vkDestroyInstance(c.instance, NULL);
+    return rc;
+}
+
+/* ---- state ---- */
+
+#define STATE_CALLS_PER_DRAW 11
+
+typedef struct {
+    VkCommandPool pool; VkCommandBuffer cb;
+    VkBuffer buf; VkDeviceMemory mem;
+    VkDescriptorSetLayout set_layout; VkPipelineLayout layout; VkDescriptorPool dpool; VkDescriptorSet set;
+} state_ctx_t;
+
+static int state_setup(bench_ctx_t* c, state_ctx_t* s) {
+    VkCommandPoolCreateInfo pi = { .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT };
+    VkCommandBufferAllocateInfo ai = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, .commandBufferCount = 1 };
+    VkBufferCreateInfo bi = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .size = 65536,
+                              .usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT };
+    VkDescriptorSetLayoutBinding b = { .binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = 1, .stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS };
+    VkDescriptorSetLayoutCreateInfo li = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .bindingCount = 1, .pBindings = &b };
+    VkPushConstantRange range = { VK_SHADER_STAGE_VERTEX_BIT, 0, 64 };
+    VkPipelineLayoutCreateInfo pli = { .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, .setLayoutCount = 1, .pushConstantRangeCount = 1, .pPushConstantRanges = &range };
+    VkDescriptorPoolSize ps = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 };
+    VkDescriptorPoolCreateInfo dpi = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO, .maxSets = 1, .poolSizeCount = 1, .pPoolSizes = &ps };
+    if (vkCreateCommandPool(c->device, &pi, NULL, &s->pool) != VK_SUCCESS) return 1;
+    ai.commandPool = s->pool;
+    if (vkAllocateCommandBuffers(c->device, &ai, &s->cb) != VK_SUCCESS || vkCreateBuffer(c->device, &bi, NULL, &s->buf) != VK_SUCCESS) return 1;
+    VkMemoryRequirements req; vkGetBufferMemoryRequirements(c->device, s->buf, &req);
+    VkMemoryAllocateInfo mi = { .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, .allocationSize = req.size,
+                                .memoryTypeIndex = find_type(c, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) };
+    if (vkAllocateMemory(c->device, &mi, NULL, &s->mem) != VK_SUCCESS || vkBindBufferMemory(c->device, s->buf, s->mem, 0) != VK_SUCCESS) return 1;
+    if (vkCreateDescriptorSetLayout(c->device, &li, NULL, &s->set_layout) != VK_SUCCESS) return 1;
+    pli.pSetLayouts = &s->set_layout;
+    if (vkCreatePipelineLayout(c->device, &pli, NULL, &s->layout) != VK_SUCCESS || vkCreateDescriptorPool(c->device, &dpi, NULL, &s->dpool) != VK_SUCCESS) return 1;
+    VkDescriptorSetAllocateInfo si = { .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, .descriptorPool = s->dpool, .descriptorSetCount = 1, .pSetLayouts = &s->set_layout };
+    if (vkAllocateDescriptorSets(c->device, &si, &s->set) != VK_SUCCESS) return 1;
+    VkDescriptorBufferInfo dbi = { s->buf, 0, 256 };
+    VkWriteDescriptorSet w = { .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, .dstSet = s->set, .descriptorCount = 1,
+                               .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .pBufferInfo = &dbi };
+    vkUpdateDescriptorSets(c->device, 1, &w, 0, NULL);
+    return 0;
+}
+
+static void state_teardown(bench_ctx_t* c, state_ctx_t* s) {
+    if (s->dpool) vkDestroyDescriptorPool(c->device, s->dpool, NULL);
+    if (s->layout) vkDestroyPipelineLayout(c->device, s->layout, NULL);
+    if (s->set_layout) vkDestroyDescriptorSetLayout(c->device, s->set_layout, NULL);
+    if (s->buf) vkDestroyBuffer(c->device, s->buf, NULL);
+    if (s->mem) vkFreeMemory(c->device, s->mem, NULL);
+    if (s->pool) vkDestroyCommandPool(c->device, s->pool, NULL);
+}
+
+/* what an engine without state tracking records per draw: everything again, the per-draw constants in four pieces */
+static void state_record(state_ctx_t* s, uint32_t draws) {
+    VkViewport vp = { 0.0f, 0.0f, 1920.0f, 1080.0f, 0.0f, 1.0f };
+    VkRect2D sc = { { 0, 0 }, { 1920, 1080 } };
+    VkDeviceSize vb_offset = 0;
+    float constants[16] = {0};
+    for (uint32_t d = 0; d < draws; ++d) {
+        constants[0] = (float)d;
+        vkCmdSetViewport(s->cb, 0, 1, &vp);
+        vkCmdSetScissor(s->cb, 0, 1, &sc);
+        vkCmdSetLineWidth(s->cb, 1.0f);
+        vkCmdSetStencilReference(s->cb, VK_STENCIL_FACE_FRONT_AND_BACK, 0);
+        vkCmdBindDescriptorSets(s->cb, VK_PIPELINE_BIND_POINT_GRAPHICS, s->layout, 0, 1, &s->set, 0, NULL);
+        vkCmdBindVertexBuffers(s->cb, 0, 1, &s->buf, &vb_offset);
+        vkCmdBindIndexBuffer(s->cb, s->buf, 32768, VK_INDEX_TYPE_UINT16);
+        for (uint32_t i = 0; i < 4; ++i) vkCmdPushConstants(s->cb, s->layout, VK_SHADER_STAGE_VERTEX_BIT, i * 16, 16, constants + i * 4);
+    }
+}
+
+static int cmd_state(int argc, char** argv) {
+    uint32_t draws = 2000, frames = 200;
+    for (int i = 0; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--draws") == 0) draws = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--frames") == 0) frames = (uint32_t)strtoul(argv[i + 1], NULL, 10);
+        else return 2;
+    }
+    if (!draws || !frames) return 2;
+    bench_ctx_t c = {0};
+    if (ctx_instance(&c) != 0) return 1;
+    printf("%u frames of %u draws x %d state calls\n", frames, draws, STATE_CALLS_PER_DRAW);
+    static const struct { const char* name; const char* filter; } modes[] = { { "passthrough", "0" }, { "filtered", "1" } };
+    double call_ns[2] = {0};
+    int rc = 0;
+    for (int m = 0; m < 2 && rc == 0; ++m) {
+        setenv("XCLIPSE_STATE_FILTER", modes[m].filter, 1);
+        if ((rc = ctx_device(&c)) != 0) break;
+        state_ctx_t s = {0};
+        rc = state_setup(&c, &s);
+        uint64_t ns = 0;
+        for (uint32_t f = 0; f < frames && rc == 0; ++f) {
+            VkCommandBufferBeginInfo bi = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT };
+            uint64_t t0 = now_ns();
+            if (vkBeginCommandBuffer(s.cb, &bi) != VK_SUCCESS) { rc = 1; break; }
+            state_record(&s, draws);
+            if (vkEndCommandBuffer(s.cb) != VK_SUCCESS) rc = 1;
+            ns += now_ns() - t0;
+            vkResetCommandBuffer(s.cb, 0);
+        }
+        state_teardown(&c, &s);
+        vkDestroyDevice(c.device, NULL);
+        if (rc != 0) { fprintf(stderr, "%s: recording failed\n", modes[m].name); break; }
+        call_ns[m] = (double)ns / ((double)frames * draws * STATE_CALLS_PER_DRAW);
+        printf("%-12s %.1f ns/call, %.2f ms/frame\n", modes[m].name, call_ns[m], (double)ns / frames / 1e6);
+    }
+    if (rc == 0 && call_ns[1] > 0) printf("filtered vs passthrough: %.2fx\n", call_ns[0] / call_ns[1]);
+    vkDestroyInstance(c.instance, NULL);
+    return rc;
+}
+
+static int usage(void) {
+    fprintf(stderr, "usage: xeno_bench memory [--count N] [--rounds R] [--max-kb K]\n"
+                    "       xeno_bench staging [--mb N] [--frames F] [--kb K]\n"
+                    "       xeno_bench objects [--count N] [--threads T]\n"
+                    "       xeno_bench state [--draws N] [--frames F]\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) return usage();
+    const char* cmd = argv[1]; int r = 2;
+    if (strcmp(cmd, "memory") == 0) r = cmd_memory(argc - 2, argv + 2);
+    else if (strcmp(cmd, "staging") == 0) r = cmd_staging(argc - 2, argv + 2);
+    else if (strcmp(cmd, "objects") == 0) r = cmd_objects(argc - 2, argv + 2);
+    else if (strcmp(cmd, "state") == 0) r = cmd_state(argc - 2, argv + 2);
+    return r == 2 ? usage() : r;
+}
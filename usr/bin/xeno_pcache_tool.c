@@ -0,0 +1,177 @@
+/* xeno_pcache_tool.c - inspect, merge and prune the wrapper's on-disk pipeline caches
+ *
+ * A cache is named by its base path (<dir>/<vendor>_<device>_<uuid>) or by either of its files
+ * (.xpc pack, .xpi index).
+ *
+ *   xeno_pcache_tool info <cache>...                       header, entry count, live/dead bytes
+ *   xeno_pcache_tool list <cache>                          one line per entry, oldest first
+ *   xeno_pcache_tool verify <cache>                        read back every record and check its checksum
+ *   xeno_pcache_tool prune <cache> [--budget-mb N] [--max-age-days D]
+ *                                                          evict LRU / stale entries, then compact
+ *   xeno_pcache_tool compact <cache>                       drop dead records from the pack
+ *   xeno_pcache_tool merge <out> <in>...                   merge caches of the same driver build into out
+ *                                                          (created from the first input when missing)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+#include "../lib/xeno_internal.h"
+
+static void cache_base(const char* arg, char* out, size_t n) {
+    snprintf(out, n, "%s", arg);
+    size_t len = strlen(out);
+    if (len > 4 && (strcmp(out + len - 4, ".xpc") == 0 || strcmp(out + len - 4, ".xpi") == 0)) out[len - 4] = 0;
+}
+
+static int open_cache(xeno_pcache_store_t* s, const char* arg, int flags) {
+    char base[512]; cache_base(arg, base, sizeof(base));
+    int r = xeno_pcache_open(s, base, NULL, flags);
+    if (r != 0) { fprintf(stderr, "%s: cannot open cache (%s)\n", base, r == -2 ? "not a pipeline cache" : "I/O error"); xeno_pcache_close(s); }
+    return r;
+}
+
+static void print_id(const xeno_pcache_id_t* id) {
+    printf("driver: vendor=0x%04x device=0x%04x uuid=", id->vendor, id->device);
+    for (int i = 0; i < VK_UUID_SIZE; ++i) printf("%02x", id->uuid[i]);
+    printf("\n");
+}
+
+static void print_stamp(uint64_t t) {
+    char buf[32]; time_t tt = (time_t)t; struct tm tm; gmtime_r(&tt, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &tm); printf("%s", buf);
+}
+
+static int cmd_info(int argc, char** argv) {
+    int rc = 0;
+    for (int i = 0; i < argc; ++i) {
+        xeno_pcache_store_t s;
+        if (open_cache(&s, argv[i], XENO_PCACHE_READONLY) != 0) { rc = 1; continue; }
+        uint64_t oldest = UINT64_MAX, newest = 0;
+        for (uint32_t e = 0; e < s.count; ++e) {
+            if (s.entries[e].last_use < oldest) oldest = s.entries[e].last_use;
+            if (s.entries[e].last_use > newest) newest = s.entries[e].last_use;
+        }
+        printf("%s\n", s.base); print_id(&s.id);
+        printf("entries: %u\nlive_bytes: %" PRIu64 "\ndead_bytes: %" PRIu64 "\npack_bytes: %" PRIu64 "\n",
+               s.count, s.live_bytes, xeno_pcache_dead_bytes(&s), s.pack_size);
+        if (s.recovered) printf("unindexed_records: %" PRIu64 "\n", s.recovered);
+        if (s.count) { printf("last_use: "); print_stamp(oldest); printf(" .. "); print_stamp(newest); printf("\n"); }
+        xeno_pcache_close(&s);
+    }
+    return rc;
+}
+
+static int cmp_entry_use(const void* a, const void* b) {
+    const xeno_pcache_entry_t* x = a; const xeno_pcache_entry_t* y = b;
+    return x->last_use < y->last_use ? -1 : x->last_use > y->last_use;
+}
+
+static int cmd_list(const char* arg) {
+    xeno_pcache_store_t s;
+    if (open_cache(&s, arg, XENO_PCACHE_READONLY) != 0) return 1;
+    qsort(s.entries, s.count, sizeof(*s.entries), cmp_entry_use); /* the table is not used afterwards */
+    for (uint32_t i = 0; i < s.count; ++i) {
+        const xeno_pcache_entry_t* e = &s.entries[i];
+        printf("%016" PRIx64 "%016" PRIx64 " %10u ", e->h1, e->h2, e->size); print_stamp(e->last_use); printf("\n");
+    }
+    xeno_pcache_close(&s);
+    return 0;
+}
+
+static int cmd_verify(const char* arg) {
+    xeno_pcache_store_t s;
+    if (open_cache(&s, arg, XENO_PCACHE_READONLY) != 0) return 1;
+    uint32_t bad = 0, total = s.count;
+    xeno_pcache_entry_t* keys = malloc((total ? total : 1) * sizeof(*keys));
+    if (!keys) { xeno_pcache_close(&s); return 1; }
+    memcpy(keys, s.entries, total * sizeof(*keys)); /* get() drops bad entries, which reorders the array */
+    for (uint32_t i = 0; i < total; ++i) {
+        void* data; uint32_t size;
+        if (xeno_pcache_get(&s, keys[i].h1, keys[i].h2, &data, &size) != 0) { bad++; printf("bad %016" PRIx64 "%016" PRIx64 "\n", keys[i].h1, keys[i].h2); }
+        else free(data);
+    }
+    printf("%u/%u entries ok\n", total - bad, total);
+    free(keys);
+    xeno_pcache_close(&s);
+    return bad ? 1 : 0;
+}
+
+static int finish(xeno_pcache_store_t* s, int compact) {
+    int r = 0;
+    if (compact && xeno_pcache_compact(s) != 0) { fprintf(stderr, "%s: compaction failed\n", s->base); r = 1; }
+    if (xeno_pcache_save(s) != 0) { fprintf(stderr, "%s: saving the index failed\n", s->base); r = 1; }
+    printf("%s: entries=%u live_bytes=%" PRIu64 " pack_bytes=%" PRIu64 "\n", s->base, s->count, s->live_bytes, s->pack_size);
+    xeno_pcache_close(s);
+    return r;
+}
+
+static int cmd_prune(int argc, char** argv) {
+    if (argc < 1) return 2;
+    uint64_t budget = 0, older_than = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--budget-mb") == 0 && i + 1 < argc) budget = strtoull(argv[++i], NULL, 0) << 20;
+        else if (strcmp(argv[i], "--max-age-days") == 0 && i + 1 < argc) older_than = (uint64_t)time(NULL) - strtoull(argv[++i], NULL, 0) * 86400ull;
+        else { fprintf(stderr, "unknown option %s\n", argv[i]); return 2; }
+    }
+    xeno_pcache_store_t s;
+    if (open_cache(&s, argv[0], 0) != 0) return 1;
+    printf("evicted %u entries\n", xeno_pcache_evict(&s, budget, older_than));
+    return finish(&s, 1);
+}
+
+static int cmd_compact(const char* arg) {
+    xeno_pcache_store_t s;
+    if (open_cache(&s, arg, 0) != 0) return 1;
+    printf("reclaiming %" PRIu64 " dead bytes\n", xeno_pcache_dead_bytes(&s));
+    return finish(&s, 1);
+}
+
+static int cmd_merge(int argc, char** argv) {
+    if (argc < 2) return 2;
+    xeno_pcache_store_t out; int opened = 0, rc = 0;
+    char base[512]; cache_base(argv[0], base, sizeof(base));
+    for (int i = 1; i < argc; ++i) {
+        xeno_pcache_store_t in;
+        if (open_cache(&in, argv[i], XENO_PCACHE_READONLY) != 0) { rc = 1; continue; }
+        if (!opened) {
+            /* open without CREATE first: an existing output of another driver build must not be reset */
+            int r = xeno_pcache_open(&out, base, &in.id, 0);
+            if (r == -1) { xeno_pcache_close(&out); r = xeno_pcache_open(&out, base, &in.id, XENO_PCACHE_CREATE); }
+            if (r != 0) {
+                fprintf(stderr, "%s: %s\n", base, r == -2 ? "output belongs to another driver build" : "cannot open output");
+                xeno_pcache_close(&out); xeno_pcache_close(&in); return 1;
+            }
+            opened = 1;
+        }
+        int n = xeno_pcache_merge(&out, &in);
+        if (n < 0) { fprintf(stderr, "%s: different driver build than %s, skipped\n", in.base, out.base); rc = 1; }
+        else printf("%s: merged %d of %u entries\n", in.base, n, in.count);
+        xeno_pcache_close(&in);
+    }
+    if (!opened) return 1;
+    return finish(&out, xeno_pcache_dead_bytes(&out) > out.live_bytes) | rc;
+}
+
+static int usage(void) {
+    fprintf(stderr, "usage: xeno_pcache_tool info <cache>...\n"
+                    "       xeno_pcache_tool list|verify|compact <cache>\n"
+                    "       xeno_pcache_tool prune <cache> [--budget-mb N] [--max-age-days D]\n"
+                    "       xeno_pcache_tool merge <out> <in>...\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) return usage();
+    const char* cmd = argv[1]; int r = 2;
+    if (strcmp(cmd, "info") == 0) r = cmd_info(argc - 2, argv + 2);
+    else if (strcmp(cmd, "list") == 0) r = cmd_list(argv[2]);
+    else if (strcmp(cmd, "verify") == 0) r = cmd_verify(argv[2]);
+    else if (strcmp(cmd, "prune") == 0) r = cmd_prune(argc - 2, argv + 2);
+    else if (strcmp(cmd, "compact") == 0) r = cmd_compact(argv[2]);
+    else if (strcmp(cmd, "merge") == 0) r = cmd_merge(argc - 2, argv + 2);
+    return r == 2 ? usage() : r;
+}
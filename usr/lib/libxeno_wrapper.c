@@ -28,6 +28,7 @@
 #include <signal.h>
 #include <inttypes.h>
 #include <vulkan/vulkan.h>
+#include "xeno_internal.h"
 
 /* Paths */
 #define MANIFEST_PATH "/etc/exynostools/profiles/vendor/xilinx_xc/manifest.json"
@@ -72,7 +73,7 @@ static void side_log_write(const char* entry) {
     write(fd, entry, strlen(entry)); write(fd, "\n", 1); fsync(fd); close(fd);
     pthread_mutex_unlock(&log_lock);
 }
-static void xlog(const char* fmt, ...) {
+void xlog(const char* fmt, ...) {
     char buf[2048], ts[64]; now_str(ts,sizeof(ts));
     va_list ap; va_start(ap, fmt);
     int n = snprintf(buf, sizeof(buf), "[%s] xeno: ", ts);
@@ -126,6 +127,12 @@ static int env_bool_default(const char* name, int def) {
     if (strcmp(v,"0")==0 || strcasecmp(v,"false")==0) return 0;
     return def;
 }
+int xeno_env_bool(const char* name, int def) { return env_bool_default(name, def); }
+long xeno_env_long(const char* name, long def) {
+    const char* v = getenv(name); if (!v || !v[0]) return def;
+    char* end = NULL; long r = strtol(v, &end, 0);
+    return (end && *end == 0) ? r : def;
+}
 static int probe_hw_bc_presence(void) {
     if (env_has("XCLIPSE_FORCE_HW_BC")) return env_bool_default("XCLIPSE_FORCE_HW_BC",1);
     DIR* d = opendir("/sys/class/drm");
@@ -142,7 +149,7 @@ int xeno_hw_supports_bc_format(const char* vk_format_name) {
 void xeno_set_force_hw_bc(int enable) { if (enable) setenv("XCLIPSE_FORCE_HW_BC","1",1); else setenv("XCLIPSE_FORCE_HW_BC","0",1); }
 
 /* Feature dump writer */
-static void write_feature_dump(const char* outpath) {
+static void write_feature_dump(const char* outpath, xeno_device_t* dev) {
     ensure_parent_dir(outpath);
     FILE* f = fopen(outpath, "w"); if (!f) { xlog("failed to open %s", outpath); return; }
     fprintf(f, "{\n");
@@ -153,7 +160,30 @@ static void write_feature_dump(const char* outpath) {
     fprintf(f, "    \"mesh_shading\": true,\n");
     fprintf(f, "    \"descriptor_indexing\": true,\n");
     fprintf(f, "    \"buffer_device_address\": true\n");
-    fprintf(f, "  }\n");
+    fprintf(f, "  }%s\n", dev ? "," : "");
+    if (dev) {
+        xeno_shader_object_report(f, dev); fprintf(f, ",\n");
+        xeno_dyn_emu_report(f, dev); fprintf(f, ",\n");
+        xeno_pcache_report(f, dev); fprintf(f, ",\n");
+        xeno_split_report(f, dev); fprintf(f, ",\n");
+        xeno_dedup_report(f, dev); fprintf(f, ",\n");
+        xeno_deferred_report(f, dev); fprintf(f, ",\n");
+        xeno_suballoc_report(f, dev); fprintf(f, ",\n");
+        xeno_budget_report(f, dev); fprintf(f, ",\n");
+        xeno_staging_report(f, dev); fprintf(f, ",\n");
+        xeno_hostalloc_report(f, dev); fprintf(f, ",\n");
+        xeno_transient_report(f, dev); fprintf(f, ",\n");
+        xeno_submit_report(f, dev); fprintf(f, ",\n");
+        xeno_fence_report(f, dev); fprintf(f, ",\n");
+        xeno_reactor_report(f, dev); fprintf(f, ",\n");
+        xeno_pacing_report(f, dev); fprintf(f, ",\n");
+        xeno_state_filter_report(f, dev); fprintf(f, ",\n");
+        xeno_barrier_report(f, dev); fprintf(f, ",\n");
+        xeno_mtrecord_report(f, dev); fprintf(f, ",\n");
+        xeno_loadstore_report(f, dev); fprintf(f, ",\n");
+        xeno_passmerge_report(f, dev); fprintf(f, ",\n");
+        xeno_vqueue_report(f, dev); fprintf(f, "\n");
+    }
     fprintf(f, "}\n");
     fflush(f); fsync(fileno(f)); fclose(f);
     xlog("feature dump written to %s", outpath);
@@ -224,28 +254,42 @@ VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice physic
     pProperties->limits.maxComputeWorkGroupInvocations = 2048;
     pProperties->limits.maxColorAttachments = 8;
 }
+static PFN_vkGetPhysicalDeviceMemoryProperties real_vkGetPhysicalDeviceMemoryProperties = NULL;
+static PFN_vkGetPhysicalDeviceMemoryProperties2 real_vkGetPhysicalDeviceMemoryProperties2 = NULL;
 VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice physicalDevice, VkPhysicalDeviceMemoryProperties* pMemProps) {
     if (!pMemProps) return;
+    if (physicalDevice != (VkPhysicalDevice)synthetic_physical && real_vkGetPhysicalDeviceMemoryProperties) {
+        real_vkGetPhysicalDeviceMemoryProperties(physicalDevice, pMemProps);
+        xeno_budget_heaps(physicalDevice, pMemProps);
+        return;
+    }
+    /* unified memory: both heaps share what the system can still hand out */
+    uint64_t avail = env_bool_default("XCLIPSE_MEMORY_BUDGET", 1) ? xeno_budget_system_bytes() & ~((1ull << 20) - 1) : 0;
     memset(pMemProps,0,sizeof(*pMemProps));
     pMemProps->memoryHeapCount = 2;
-    pMemProps->memoryHeaps[0].size = 512ull * 1024 * 1024;
+    pMemProps->memoryHeaps[0].size = avail ? avail / 4 * 3 : 512ull * 1024 * 1024;
     pMemProps->memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
-    pMemProps->memoryHeaps[1].size = 2048ull * 1024 * 1024;
+    pMemProps->memoryHeaps[1].size = avail ? avail / 4 : 2048ull * 1024 * 1024;
     pMemProps->memoryTypeCount = 2;
     pMemProps->memoryTypes[0].heapIndex = 0; pMemProps->memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
     pMemProps->memoryTypes[1].heapIndex = 1; pMemProps->memoryTypes[1].propertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
 }
-VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceQueueFamilyProperties(VkPhysicalDevice physicalDevice, uint32_t* pCount, VkQueueFamilyProperties* props) {
-    if (!pCount) return; if (!props) { *pCount = 3; return; }
-    uint32_t count = (*pCount < 3) ? *pCount : 3;
-    for (uint32_t i=0;i<count;i++) {
-        VkQueueFamilyProperties p; memset(&p,0,sizeof(p));
-        if (i==0) { p.queueFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT; p.queueCount = 8; }
-        else if (i==1) { p.queueFlags = VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT; p.queueCount = 4; }
-        else { p.queueFlags = VK_QUEUE_TRANSFER_BIT; p.queueCount = 2; }
-        props[i]=p;
+static VKAPI_ATTR void VKAPI_CALL xeno_vkGetPhysicalDeviceMemoryProperties2(VkPhysicalDevice physicalDevice, VkPhysicalDeviceMemoryProperties2* pMemProps) {
+    if (!pMemProps) return;
+    if (physicalDevice == (VkPhysicalDevice)synthetic_physical || !real_vkGetPhysicalDeviceMemoryProperties2) {
+        /* the synthetic handle never reaches the driver: the MemAvailable-based heaps above */
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &pMemProps->memoryProperties);
+        return;
     }
-    *pCount = 3;
+    real_vkGetPhysicalDeviceMemoryProperties2(physicalDevice, pMemProps);
+    xeno_budget_heaps(physicalDevice, &pMemProps->memoryProperties);
+}
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceQueueFamilyProperties(VkPhysicalDevice physicalDevice, uint32_t* pCount, VkQueueFamilyProperties* props) {
+    if (!pCount) return; if (!props) { *pCount = XENO_QUEUE_FAMILY_COUNT; return; }
+    /* whatever the hardware has: xeno_vqueue.c maps these onto its queues */
+    uint32_t count = (*pCount < XENO_QUEUE_FAMILY_COUNT) ? *pCount : XENO_QUEUE_FAMILY_COUNT;
+    for (uint32_t i=0;i<count;i++) props[i] = xeno_queue_families[i];
+    *pCount = XENO_QUEUE_FAMILY_COUNT;
 }
 VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceFormatProperties(VkPhysicalDevice physicalDevice, VkFormat format, VkFormatProperties* pFormatProperties) {
     if (!pFormatProperties) return; memset(pFormatProperties,0,sizeof(*pFormatProperties));
@@ -261,6 +305,397 @@ VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceFormatProperties(VkPhysicalDevice
     }
 }
 
+/* --- device registry ---
+ * Every device created through the wrapper gets an xeno_device_t with the real driver's entrypoints.
+ * Extensions in emulated_exts are advertised even when the driver lacks them: if vkCreateDevice
+ * fails with VK_ERROR_EXTENSION_NOT_PRESENT we retry without them and enable the matching module. */
+static xeno_map_t devices;
+static xeno_map_t queues;           /* VkQueue -> xeno_device_t */
+static pthread_once_t devices_once = PTHREAD_ONCE_INIT;
+static void devices_init(void) { xeno_map_init(&devices, 64); xeno_map_init(&queues, 64); }
+static PFN_vkCreateDevice real_vkCreateDevice = NULL;
+/* the real physical device queries (memory properties are declared with their intercepts),
+ * resolved from the instance that hands out vkCreateDevice or the memory property queries */
+static PFN_vkGetPhysicalDeviceProperties real_vkGetPhysicalDeviceProperties = NULL;
+static PFN_vkEnumerateDeviceExtensionProperties real_vkEnumerateDeviceExtensionProperties = NULL;
+static PFN_vkGetPhysicalDeviceQueueFamilyProperties real_vkGetPhysicalDeviceQueueFamilyProperties = NULL;
+static PFN_vkGetPhysicalDeviceExternalFenceProperties real_vkGetPhysicalDeviceExternalFenceProperties = NULL;
+
+static void resolve_physical_fns(VkInstance instance) {
+    real_vkGetPhysicalDeviceProperties = (PFN_vkGetPhysicalDeviceProperties)real_vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties");
+    real_vkGetPhysicalDeviceMemoryProperties = (PFN_vkGetPhysicalDeviceMemoryProperties)real_vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties");
+    real_vkGetPhysicalDeviceMemoryProperties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2)real_vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2");
+    if (!real_vkGetPhysicalDeviceMemoryProperties2)
+        real_vkGetPhysicalDeviceMemoryProperties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2)real_vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR");
+    real_vkEnumerateDeviceExtensionProperties = (PFN_vkEnumerateDeviceExtensionProperties)real_vkGetInstanceProcAddr(instance, "vkEnumerateDeviceExtensionProperties");
+    real_vkGetPhysicalDeviceQueueFamilyProperties = (PFN_vkGetPhysicalDeviceQueueFamilyProperties)real_vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceQueueFamilyProperties");
+    real_vkGetPhysicalDeviceExternalFenceProperties = (PFN_vkGetPhysicalDeviceExternalFenceProperties)real_vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceExternalFenceProperties");
+    if (!real_vkGetPhysicalDeviceExternalFenceProperties)
+        real_vkGetPhysicalDeviceExternalFenceProperties = (PFN_vkGetPhysicalDeviceExternalFenceProperties)real_vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceExternalFencePropertiesKHR");
+}
+
+/* VK_EXT_memory_budget support per physical device, looked up once */
+static int driver_has_extension(VkPhysicalDevice physical, const char* name) {
+    uint32_t n = 0; int found = 0;
+    if (real_vkEnumerateDeviceExtensionProperties && real_vkEnumerateDeviceExtensionProperties(physical, NULL, &n, NULL) == VK_SUCCESS && n) {
+        VkExtensionProperties* props = calloc(n, sizeof(*props));
+        if (props && real_vkEnumerateDeviceExtensionProperties(physical, NULL, &n, props) >= 0)
+            for (uint32_t i = 0; i < n && !found; ++i) found = strcmp(props[i].extensionName, name) == 0;
+        free(props);
+    }
+    return found;
+}
+
+/* fences of the physical device can be exported as sync_files and imported back (xeno_reactor.c) */
+static int sync_fd_fences(VkPhysicalDevice physical) {
+    if (!real_vkGetPhysicalDeviceExternalFenceProperties || !driver_has_extension(physical, VK_KHR_EXTERNAL_FENCE_FD_EXTENSION_NAME)) return 0;
+    VkPhysicalDeviceExternalFenceInfo info = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_FENCE_INFO, .handleType = VK_EXTERNAL_FENCE_HANDLE_TYPE_SYNC_FD_BIT };
+    VkExternalFenceProperties props = { .sType = VK_STRUCTURE_TYPE_EXTERNAL_FENCE_PROPERTIES };
+    real_vkGetPhysicalDeviceExternalFenceProperties(physical, &info, &props);
+    VkExternalFenceFeatureFlags need = VK_EXTERNAL_FENCE_FEATURE_EXPORTABLE_BIT | VK_EXTERNAL_FENCE_FEATURE_IMPORTABLE_BIT;
+    return (props.externalFenceFeatures & need) == need;
+}
+
+static int extension_enabled(const VkDeviceCreateInfo* ci, const char* name) {
+    for (uint32_t i = 0; i < ci->enabledExtensionCount; ++i)
+        if (strcmp(ci->ppEnabledExtensionNames[i], name) == 0) return 1;
+    return 0;
+}
+
+static struct { VkPhysicalDevice physical; int supported; } budget_support[8];
+static uint32_t budget_support_count;
+static pthread_mutex_t budget_support_lock = PTHREAD_MUTEX_INITIALIZER;
+static int memory_budget_supported(VkPhysicalDevice physical) {
+    int supported = -1;
+    pthread_mutex_lock(&budget_support_lock);
+    for (uint32_t i = 0; i < budget_support_count; ++i) if (budget_support[i].physical == physical) supported = budget_support[i].supported;
+    pthread_mutex_unlock(&budget_support_lock);
+    if (supported >= 0) return supported;
+    supported = driver_has_extension(physical, "VK_EXT_memory_budget");
+    pthread_mutex_lock(&budget_support_lock);
+    if (budget_support_count < sizeof(budget_support) / sizeof(budget_support[0])) {
+        budget_support[budget_support_count].physical = physical; budget_support[budget_support_count].supported = supported; budget_support_count++;
+    }
+    pthread_mutex_unlock(&budget_support_lock);
+    return supported;
+}
+
+int xeno_query_memory_budget(VkPhysicalDevice physical, VkDeviceSize* budget, VkDeviceSize* usage) {
+    if (physical == (VkPhysicalDevice)synthetic_physical || !real_vkGetPhysicalDeviceMemoryProperties2 || !memory_budget_supported(physical)) return -1;
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT b = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT };
+    VkPhysicalDeviceMemoryProperties2 p = { .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2, .pNext = &b };
+    real_vkGetPhysicalDeviceMemoryProperties2(physical, &p);
+    memcpy(budget, b.heapBudget, sizeof(b.heapBudget)); memcpy(usage, b.heapUsage, sizeof(b.heapUsage));
+    return 0;
+}
+
+static const struct { const char* name; uint32_t bit; VkStructureType feature; const char* env; } emulated_exts[] = {
+    { "VK_EXT_shader_object", XENO_EMULATE_SHADER_OBJECT, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT, "XCLIPSE_SHADER_OBJECT_EMULATION" },
+    { "VK_EXT_extended_dynamic_state3", XENO_EMULATE_EXTENDED_DYNAMIC_STATE3, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT, "XCLIPSE_EDS3_EMULATION" },
+    { "VK_EXT_vertex_input_dynamic_state", XENO_EMULATE_VERTEX_INPUT_DYNAMIC_STATE, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VERTEX_INPUT_DYNAMIC_STATE_FEATURES_EXT, "XCLIPSE_VERTEX_INPUT_EMULATION" },
+    /* no feature struct to unlink */
+    { "VK_KHR_deferred_host_operations", XENO_EMULATE_DEFERRED_HOST_OPERATIONS, VK_STRUCTURE_TYPE_MAX_ENUM, "XCLIPSE_DEFERRED_OPS_EMULATION" },
+};
+#define EMULATED_EXT_COUNT (sizeof(emulated_exts)/sizeof(emulated_exts[0]))
+
+xeno_device_t* xeno_device_get(VkDevice device) {
+    pthread_once(&devices_once, devices_init);
+    return xeno_map_get(&devices, XENO_HANDLE_KEY(device));
+}
+
+xeno_device_t* xeno_queue_device(VkQueue queue) {
+    pthread_once(&devices_once, devices_init);
+    return xeno_map_get(&queues, XENO_HANDLE_KEY(queue));
+}
+
+void xeno_queue_register(VkQueue queue, xeno_device_t* dev) {
+    pthread_once(&devices_once, devices_init);
+    xeno_map_put(&queues, XENO_HANDLE_KEY(queue), dev);
+}
+
+static int drop_device_queue(uint64_t key, void* val, void* ctx) { return val == ctx; }
+
+static const char* tune_report_path(void) {
+    const char* p = getenv(TUNE_REPORT_ENV);
+    return p ? p : DEFAULT_TUNE_REPORT;
+}
+
+/* Promoted entrypoints may only be exposed under their extension name on older drivers */
+static PFN_vkVoidFunction resolve_device_fn(VkDevice device, const char* name) {
+    PFN_vkVoidFunction fn = real_vkGetDeviceProcAddr(device, name);
+    static const char* suffixes[] = { "KHR", "EXT" };
+    for (size_t i = 0; !fn && i < sizeof(suffixes)/sizeof(suffixes[0]); ++i) {
+        size_t n = strlen(name);
+        if (n > 3 && (strcmp(name + n - 3, "KHR") == 0 || strcmp(name + n - 3, "EXT") == 0)) break;
+        char alias[128]; snprintf(alias, sizeof(alias), "%s%s", name, suffixes[i]);
+        fn = real_vkGetDeviceProcAddr(device, alias);
+    }
+    return fn;
+}
+
+/* With XCLIPSE_HOST_ALLOC the wrapper's host allocator stands in for a NULL pAllocator; instances
+ * created that way are remembered so vkDestroyInstance passes the same callbacks */
+static xeno_map_t alloc_instances;  /* VkInstance -> callbacks it was created with */
+static pthread_once_t alloc_instances_once = PTHREAD_ONCE_INIT;
+static void alloc_instances_init(void) { xeno_map_init(&alloc_instances, 8); }
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkCreateInstance(const VkInstanceCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkInstance* pInstance) {
+    PFN_vkCreateInstance fn = (PFN_vkCreateInstance)real_vkGetInstanceProcAddr(NULL, "vkCreateInstance");
+    if (!fn) return VK_ERROR_INITIALIZATION_FAILED;
+    const VkAllocationCallbacks* host_alloc = !pAllocator && xeno_hostalloc_enabled() ? xeno_hostalloc_callbacks() : NULL;
+    VkResult r = fn(pCreateInfo, host_alloc ? host_alloc : pAllocator, pInstance);
+    if (r == VK_SUCCESS && host_alloc) {
+        pthread_once(&alloc_instances_once, alloc_instances_init);
+        xeno_map_put(&alloc_instances, XENO_HANDLE_KEY(*pInstance), (void*)host_alloc);
+    }
+    return r;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_vkDestroyInstance(VkInstance instance, const VkAllocationCallbacks* pAllocator) {
+    if (!instance) return;
+    PFN_vkDestroyInstance fn = (PFN_vkDestroyInstance)real_vkGetInstanceProcAddr(instance, "vkDestroyInstance");
+    pthread_once(&alloc_instances_once, alloc_instances_init);
+    const VkAllocationCallbacks* host_alloc = xeno_map_remove(&alloc_instances, XENO_HANDLE_KEY(instance));
+    if (fn) fn(instance, pAllocator ? pAllocator : host_alloc);
+}
+
+static PFN_vkVoidFunction device_proc(xeno_device_t* dev, const char* pName);
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkCreateDevice(VkPhysicalDevice physicalDevice, const VkDeviceCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDevice* pDevice) {
+    if (!real_vkCreateDevice || !real_vkGetDeviceProcAddr) return VK_ERROR_INITIALIZATION_FAILED;
+    const VkAllocationCallbacks* host_alloc = !pAllocator && xeno_hostalloc_enabled() ? xeno_hostalloc_callbacks() : NULL;
+    if (host_alloc) pAllocator = host_alloc;
+    /* fence payloads the app exports, imports or has signalled by display events never pass through the fence
+     * module; scanned on the app's own list, before the wrapper adds extensions it uses itself */
+    static const char* fence_exts[] = { "VK_KHR_external_fence_fd", "VK_KHR_external_fence_win32", "VK_EXT_display_control", "VK_EXT_swapchain_maintenance1" };
+    int fence_external = 0;
+    for (uint32_t i = 0; i < pCreateInfo->enabledExtensionCount; ++i)
+        for (size_t k = 0; k < sizeof(fence_exts) / sizeof(fence_exts[0]); ++k)
+            if (strcmp(pCreateInfo->ppEnabledExtensionNames[i], fence_exts[k]) == 0) fence_external = 1;
+    /* extensions the modules need when asked to: the staging ring imports huge-page host memory,
+     * the reactor exports fences as sync_files */
+    const char* wanted[2]; uint32_t nwanted = 0;
+    if (!extension_enabled(pCreateInfo, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME) && xeno_env_bool("XCLIPSE_STAGING", 1) &&
+        xeno_env_bool("XCLIPSE_STAGING_HUGEPAGES", 0) && driver_has_extension(physicalDevice, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME))
+        wanted[nwanted++] = VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME;
+    int sync_fd = xeno_env_bool("XCLIPSE_REACTOR", 0) && sync_fd_fences(physicalDevice);
+    if (sync_fd && !extension_enabled(pCreateInfo, VK_KHR_EXTERNAL_FENCE_FD_EXTENSION_NAME)) wanted[nwanted++] = VK_KHR_EXTERNAL_FENCE_FD_EXTENSION_NAME;
+    VkDeviceCreateInfo ext_ci; const char** ext_names = NULL;
+    if (nwanted && (ext_names = malloc((pCreateInfo->enabledExtensionCount + nwanted) * sizeof(char*)))) {
+        if (pCreateInfo->enabledExtensionCount) memcpy(ext_names, pCreateInfo->ppEnabledExtensionNames, pCreateInfo->enabledExtensionCount * sizeof(char*));
+        memcpy(ext_names + pCreateInfo->enabledExtensionCount, wanted, nwanted * sizeof(char*));
+        ext_ci = *pCreateInfo; ext_ci.enabledExtensionCount += nwanted; ext_ci.ppEnabledExtensionNames = ext_names;
+        pCreateInfo = &ext_ci;
+    }
+    int host_import = extension_enabled(pCreateInfo, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+    sync_fd = sync_fd && extension_enabled(pCreateInfo, VK_KHR_EXTERNAL_FENCE_FD_EXTENSION_NAME);
+    /* queue requests the driver's families cannot hold are served by virtual queues */
+    VkDeviceCreateInfo vq_ci; struct xeno_vqueue_plan* vq_plan = NULL;
+    if (xeno_env_bool("XCLIPSE_VQUEUE", 1) && real_vkGetPhysicalDeviceQueueFamilyProperties) {
+        VkQueueFamilyProperties families[16]; uint32_t nfamilies = 16;
+        real_vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &nfamilies, families);
+        if ((vq_plan = xeno_vqueue_plan(families, nfamilies, pCreateInfo, &vq_ci))) pCreateInfo = &vq_ci;
+    }
+    VkResult r = real_vkCreateDevice(physicalDevice, pCreateInfo, pAllocator, pDevice);
+    uint32_t emulate = 0;
+    if (r == VK_ERROR_EXTENSION_NOT_PRESENT) {
+        /* retry with the emulatable extensions (and their feature structs) removed */
+        const char** names = malloc((pCreateInfo->enabledExtensionCount + 1) * sizeof(char*));
+        if (!names) { free(ext_names); xeno_vqueue_plan_free(vq_plan); return VK_ERROR_OUT_OF_HOST_MEMORY; }
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < pCreateInfo->enabledExtensionCount; ++i) {
+            const char* e = pCreateInfo->ppEnabledExtensionNames[i]; int strip = 0;
+            for (size_t k = 0; k < EMULATED_EXT_COUNT; ++k)
+                if (strcmp(e, emulated_exts[k].name) == 0 && env_bool_default(emulated_exts[k].env, 1)) { strip = 1; emulate |= emulated_exts[k].bit; }
+            if (!strip) names[kept++] = e;
+        }
+        if (emulate) {
+            VkDeviceCreateInfo ci = *pCreateInfo;
+            ci.enabledExtensionCount = kept; ci.ppEnabledExtensionNames = names;
+            /* unlink the feature structs for the duration of the call; the chain is restored after */
+            VkBaseOutStructure* unlinked[EMULATED_EXT_COUNT]; VkBaseOutStructure* prev_of[EMULATED_EXT_COUNT]; size_t nunlinked = 0;
+            VkBaseOutStructure* prev = (VkBaseOutStructure*)&ci;
+            for (VkBaseOutStructure* s = (VkBaseOutStructure*)ci.pNext; s; s = s->pNext) {
+                int drop = 0;
+                for (size_t k = 0; k < EMULATED_EXT_COUNT; ++k) if ((emulate & emulated_exts[k].bit) && s->sType == emulated_exts[k].feature) drop = 1;
+                if (drop && nunlinked < EMULATED_EXT_COUNT) { prev->pNext = s->pNext; unlinked[nunlinked] = s; prev_of[nunlinked++] = prev; }
+                else prev = s;
+            }
+            r = real_vkCreateDevice(physicalDevice, &ci, pAllocator, pDevice);
+            while (nunlinked--) if (prev_of[nunlinked] != (VkBaseOutStructure*)&ci) prev_of[nunlinked]->pNext = unlinked[nunlinked];
+            xlog("vkCreateDevice retried without emulated extensions mask=0x%x result=%d", emulate, (int)r);
+        }
+        free(names);
+    }
+    free(ext_names);
+    if (r != VK_SUCCESS) { xeno_vqueue_plan_free(vq_plan); return r; }
+
+    xeno_device_t* dev = calloc(1, sizeof(*dev));
+    if (!dev) { xeno_vqueue_plan_free(vq_plan); return VK_SUCCESS; } /* device still usable, just without wrapper modules */
+    dev->handle = *pDevice; dev->physical = physicalDevice; dev->emulate = emulate; dev->host_import = host_import; dev->sync_fd = sync_fd; dev->host_alloc = host_alloc;
+    dev->fence_external = fence_external;
+    for (const VkBaseInStructure* s = pCreateInfo->pNext; s; s = s->pNext) {
+        if (s->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES && ((const VkPhysicalDeviceSynchronization2Features*)s)->synchronization2) dev->sync2 = 1;
+        if (s->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES && ((const VkPhysicalDeviceVulkan13Features*)s)->synchronization2) dev->sync2 = 1;
+        if (s->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES && ((const VkPhysicalDeviceTimelineSemaphoreFeatures*)s)->timelineSemaphore) dev->timeline = 1;
+        if (s->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES && ((const VkPhysicalDeviceVulkan12Features*)s)->timelineSemaphore) dev->timeline = 1;
+        if (s->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES && ((const VkPhysicalDeviceBufferDeviceAddressFeatures*)s)->bufferDeviceAddressCaptureReplay) dev->capture_replay = 1;
+        if (s->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES && ((const VkPhysicalDeviceVulkan12Features*)s)->bufferDeviceAddressCaptureReplay) dev->capture_replay = 1;
+    }
+    if (real_vkGetPhysicalDeviceProperties && real_vkGetPhysicalDeviceMemoryProperties) {
+        VkPhysicalDeviceProperties props; real_vkGetPhysicalDeviceProperties(physicalDevice, &props);
+        dev->limits = props.limits;
+        real_vkGetPhysicalDeviceMemoryProperties(physicalDevice, &dev->memory);
+    }
+#define XENO_RESOLVE(fn) dev->vk.fn = (PFN_##fn)resolve_device_fn(*pDevice, #fn);
+    XENO_DEVICE_FUNCS(XENO_RESOLVE)
+#undef XENO_RESOLVE
+    dev->dyn_native = xeno_dyn_native_mask(&dev->vk);
+    /* first: interposes the dispatch entries below every other module */
+    if (xeno_hostalloc_init(dev) != 0) xlog("hostalloc: init failed, device objects use the driver's allocator");
+    if (xeno_transient_init(dev) != 0) xlog("transient: init failed, attachments keep the memory the app binds");
+    if (xeno_fence_init(dev) != 0) xlog("fence: init failed, fences are the driver's"); /* below submit batching: its flushes carry the app's fences */
+    if (xeno_reactor_init(dev) != 0) xlog("reactor: init failed, fences are polled");
+    if (xeno_submit_init(dev) != 0) xlog("submit: init failed, submits reach the driver one by one");
+    if (xeno_pcache_device_init(dev) != 0) xlog("pcache: init failed, pipelines are not cached on disk");
+    if (xeno_split_init(dev) != 0) xlog("split: init failed, pipeline batches compile on the calling thread");
+    xeno_cmdbuf_device_init(dev);
+    if (xeno_shader_object_init(dev) != 0) xlog("shader_object: init failed, emulation unavailable");
+    if (xeno_dyn_emu_init(dev) != 0) xlog("dyn_emu: init failed, emulation unavailable");
+    if (xeno_deferred_init(dev) != 0) xlog("deferred: init failed, emulation unavailable");
+    if (xeno_suballoc_init(dev) != 0) xlog("suballoc: init failed, memory is allocated per request");
+    if (xeno_staging_init(dev) != 0) xlog("staging: init failed, uploads use their fallback path");
+    if (xeno_barrier_init(dev) != 0) xlog("barrier: init failed, barriers reach the driver as recorded"); /* before everything resolving through it */
+    if (xeno_mtrecord_init(dev) != 0) xlog("mtrecord: init failed, render passes are recorded on the app's thread");
+    if (xeno_loadstore_init(dev) != 0) xlog("loadstore: init failed, render passes keep their load and store ops");
+    if (xeno_passmerge_init(dev) != 0) xlog("passmerge: init failed, render pass instances are not merged");
+    if (xeno_budget_init(dev) != 0) xlog("budget: init failed, memory use is not tracked against the budget");
+    if (xeno_pacing_init(dev) != 0) xlog("pacing: init failed, frames are not throttled");
+    if (xeno_state_filter_init(dev) != 0) xlog("state_filter: init failed, redundant state reaches the driver");
+    if (xeno_dedup_init(dev) != 0) xlog("dedup: init failed, identical pipelines are not shared"); /* resolves the modules above */
+    if (vq_plan && xeno_vqueue_init(dev, vq_plan) != 0) xlog("vqueue: init failed, only the driver's own queues can be retrieved"); /* last: submits through everything */
+    dev->present = (PFN_vkQueuePresentKHR)device_proc(dev, "vkQueuePresentKHR");
+    pthread_once(&devices_once, devices_init);
+    xeno_map_put(&devices, XENO_HANDLE_KEY(*pDevice), dev);
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_vkDestroyDevice(VkDevice device, const VkAllocationCallbacks* pAllocator) {
+    if (!device) return;
+    pthread_once(&devices_once, devices_init);
+    xeno_device_t* dev = xeno_map_remove(&devices, XENO_HANDLE_KEY(device));
+    if (!dev) { PFN_vkDestroyDevice fn = (PFN_vkDestroyDevice)real_vkGetDeviceProcAddr(device, "vkDestroyDevice"); if (fn) fn(device, pAllocator); return; }
+    write_feature_dump(tune_report_path(), dev);
+    xeno_vqueue_destroy(dev); /* drains the rings while the queues below are still registered */
+    xeno_map_foreach(&queues, drop_device_queue, dev);
+    xeno_submit_destroy(dev); /* first: held batches reach the driver before anything is torn down */
+    xeno_reactor_destroy(dev); /* delivers the last completions while the modules watching are still there */
+    xeno_pacing_destroy(dev);
+    xeno_state_filter_destroy(dev); /* frees the command buffers the app left allocated */
+    xeno_resource_destroy(dev); /* the module state on leaked images and passes goes while its modules are still there */
+    xeno_passmerge_destroy(dev);
+    xeno_loadstore_destroy(dev);
+    xeno_mtrecord_destroy(dev);
+    xeno_barrier_destroy(dev);
+    xeno_budget_destroy(dev); /* waits for its pressure hooks, which trim the modules below */
+    xeno_split_destroy(dev); /* first, then the pcache: they restore the dispatch entries they interposed */
+    xeno_pcache_device_destroy(dev);
+    xeno_shader_object_destroy(dev);
+    xeno_cmdbuf_device_destroy(dev);
+    xeno_dyn_emu_destroy(dev);
+    xeno_deferred_destroy(dev);
+    xeno_dedup_destroy(dev);
+    xeno_staging_destroy(dev);
+    xeno_suballoc_destroy(dev); /* after every module that could still free app memory */
+    xeno_fence_destroy(dev); /* after every module that could still hold one of its fences */
+    xeno_transient_destroy(dev);
+    xeno_hostalloc_destroy(dev); /* last: the modules above destroy their objects through it */
+    dev->vk.vkDestroyDevice(device, pAllocator ? pAllocator : dev->host_alloc);
+    free(dev);
+}
+
+/* Queues are registered as they are retrieved so queue-level intercepts can find their device */
+static VKAPI_ATTR void VKAPI_CALL xeno_vkGetDeviceQueue(VkDevice device, uint32_t queueFamilyIndex, uint32_t queueIndex, VkQueue* pQueue) {
+    xeno_device_t* dev = xeno_device_get(device);
+    if (xeno_vqueue_get(dev, queueFamilyIndex, queueIndex, pQueue)) return;
+    dev->vk.vkGetDeviceQueue(device, queueFamilyIndex, queueIndex, pQueue);
+    if (*pQueue) xeno_map_put(&queues, XENO_HANDLE_KEY(*pQueue), dev);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkGetDeviceQueue2(VkDevice device, const VkDeviceQueueInfo2* pQueueInfo, VkQueue* pQueue) {
+    xeno_device_t* dev = xeno_device_get(device);
+    if (!pQueueInfo->flags && xeno_vqueue_get(dev, pQueueInfo->queueFamilyIndex, pQueueInfo->queueIndex, pQueue)) return;
+    dev->vk.vkGetDeviceQueue2(device, pQueueInfo, pQueue);
+    if (*pQueue) xeno_map_put(&queues, XENO_HANDLE_KEY(*pQueue), dev);
+}
+
+/* Presents are counted ahead of every layer: the per-frame figures of the reports divide by it */
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkQueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* pPresentInfo) {
+    xeno_device_t* dev = xeno_queue_device(queue);
+    atomic_fetch_add_explicit(&dev->frames, 1, memory_order_relaxed);
+    return dev->present(queue, pPresentInfo);
+}
+
+/* Module intercepts below the app-facing layers, then the driver */
+static PFN_vkVoidFunction module_proc(xeno_device_t* dev, const char* pName) {
+    PFN_vkVoidFunction fn;
+    if ((fn = xeno_shader_object_proc(dev, pName))) return fn;
+    if ((fn = xeno_dyn_emu_proc(dev, pName))) return fn;
+    if ((fn = xeno_cmdbuf_proc(dev, pName))) return fn;
+    if ((fn = xeno_deferred_proc(dev, pName))) return fn;
+    if ((fn = xeno_suballoc_proc(dev, pName))) return fn;
+    if ((fn = xeno_resource_proc(dev, pName))) return fn;
+    if ((fn = xeno_staging_proc(dev, pName))) return fn;
+    if ((fn = xeno_split_proc(dev, pName))) return fn;
+    if ((fn = xeno_pcache_proc(dev, pName))) return fn;
+    if ((fn = xeno_pacing_proc(dev, pName))) return fn;
+    if ((fn = xeno_submit_proc(dev, pName))) return fn;
+    if ((fn = xeno_fence_proc(dev, pName))) return fn;
+    if ((fn = xeno_reactor_proc(dev, pName))) return fn;
+    if ((fn = xeno_transient_proc(dev, pName))) return fn;
+    return xeno_hostalloc_proc(dev, pName);
+}
+PFN_vkVoidFunction xeno_device_module_proc(xeno_device_t* dev, const char* name) {
+    PFN_vkVoidFunction fn = module_proc(dev, name);
+    return fn ? fn : real_vkGetDeviceProcAddr(dev->handle, name);
+}
+/* The barrier layer sees the command stream of every layer above, ahead of the modules */
+PFN_vkVoidFunction xeno_device_barrier_proc(xeno_device_t* dev, const char* name) {
+    PFN_vkVoidFunction fn = xeno_barrier_proc(dev, name);
+    return fn ? fn : xeno_device_module_proc(dev, name);
+}
+/* The multithreaded recording layer moves large render passes into secondaries ahead of the barrier layer */
+PFN_vkVoidFunction xeno_device_mtrecord_proc(xeno_device_t* dev, const char* name) {
+    PFN_vkVoidFunction fn = xeno_mtrecord_proc(dev, name);
+    return fn ? fn : xeno_device_barrier_proc(dev, name);
+}
+/* The load/store layer holds render pass begins ahead of the multithreaded recording layer */
+PFN_vkVoidFunction xeno_device_loadstore_proc(xeno_device_t* dev, const char* name) {
+    PFN_vkVoidFunction fn = xeno_loadstore_proc(dev, name);
+    return fn ? fn : xeno_device_mtrecord_proc(dev, name);
+}
+/* The pass merging layer joins render pass instances before the load/store layer picks their ops */
+PFN_vkVoidFunction xeno_device_next_proc(xeno_device_t* dev, const char* name) {
+    PFN_vkVoidFunction fn = xeno_passmerge_proc(dev, name);
+    return fn ? fn : xeno_device_loadstore_proc(dev, name);
+}
+
+/* The app-facing layers behind the virtual queues: queue families are the driver's */
+PFN_vkVoidFunction xeno_device_app_proc(xeno_device_t* dev, const char* name) {
+    PFN_vkVoidFunction fn;
+    if ((fn = xeno_dedup_proc(dev, name))) return fn;
+    if ((fn = xeno_budget_proc(dev, name))) return fn;
+    if ((fn = xeno_state_filter_proc(dev, name))) return fn;
+    return xeno_device_next_proc(dev, name);
+}
+
+/* The app-facing layers, the modules, then the driver */
+static PFN_vkVoidFunction device_proc(xeno_device_t* dev, const char* pName) {
+    PFN_vkVoidFunction fn;
+    if ((fn = xeno_vqueue_proc(dev, pName))) return fn;
+    if (xeno_vqueue_hidden(dev, pName)) return NULL; /* the driver cannot take a virtual queue */
+    return xeno_device_app_proc(dev, pName);
+}
+
 /* vkGetInstanceProcAddr/vkGetDeviceProcAddr forwarding with interception */
 VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vkGetInstanceProcAddr(VkInstance instance, const char* pName) {
     pthread_once(&loader_once, ensure_real_loader);
@@ -270,11 +705,38 @@ VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vkGetInstanceProcAddr(VkInstance instan
     if (strcmp(pName, "vkGetPhysicalDeviceFeatures2")==0) return (PFN_vkVoidFunction) vkGetPhysicalDeviceFeatures2;
     if (strcmp(pName, "vkEnumerateDeviceExtensionProperties")==0) return (PFN_vkVoidFunction) vkEnumerateDeviceExtensionProperties;
     if (strcmp(pName, "vkGetInstanceProcAddr")==0) return (PFN_vkVoidFunction) vkGetInstanceProcAddr;
+    if (strcmp(pName, "vkGetDeviceProcAddr")==0) return (PFN_vkVoidFunction) vkGetDeviceProcAddr;
+    if (strcmp(pName, "vkCreateInstance")==0 && real_vkGetInstanceProcAddr) return (PFN_vkVoidFunction) xeno_vkCreateInstance;
+    if (strcmp(pName, "vkDestroyInstance")==0 && real_vkGetInstanceProcAddr) return (PFN_vkVoidFunction) xeno_vkDestroyInstance;
+    if (strcmp(pName, "vkCreateDevice")==0 && real_vkGetInstanceProcAddr) {
+        PFN_vkCreateDevice fn = (PFN_vkCreateDevice)real_vkGetInstanceProcAddr(instance, pName);
+        if (!fn) return NULL;
+        real_vkCreateDevice = fn;
+        resolve_physical_fns(instance);
+        return (PFN_vkVoidFunction) xeno_vkCreateDevice;
+    }
+    if (strncmp(pName, "vkGetPhysicalDeviceMemoryProperties", 35)==0 && real_vkGetInstanceProcAddr && instance) {
+        /* heap sizes reflect the budget */
+        resolve_physical_fns(instance);
+        if (strcmp(pName, "vkGetPhysicalDeviceMemoryProperties")==0 && real_vkGetPhysicalDeviceMemoryProperties) return (PFN_vkVoidFunction) vkGetPhysicalDeviceMemoryProperties;
+        if ((strcmp(pName, "vkGetPhysicalDeviceMemoryProperties2")==0 || strcmp(pName, "vkGetPhysicalDeviceMemoryProperties2KHR")==0) && real_vkGetPhysicalDeviceMemoryProperties2)
+            return (PFN_vkVoidFunction) xeno_vkGetPhysicalDeviceMemoryProperties2;
+    }
     if (real_vkGetInstanceProcAddr) return real_vkGetInstanceProcAddr(instance, pName);
     return NULL;
 }
 VKAPI_ATTR PFN_vkVoidFunction VKAPI_CALL vkGetDeviceProcAddr(VkDevice device, const char* pName) {
     pthread_once(&loader_once, ensure_real_loader);
+    if (!pName) return NULL;
+    xeno_device_t* dev = device ? xeno_device_get(device) : NULL;
+    if (dev) {
+        if (strcmp(pName, "vkGetDeviceProcAddr")==0) return (PFN_vkVoidFunction) vkGetDeviceProcAddr;
+        if (strcmp(pName, "vkDestroyDevice")==0) return (PFN_vkVoidFunction) xeno_vkDestroyDevice;
+        if (strcmp(pName, "vkGetDeviceQueue")==0 && dev->vk.vkGetDeviceQueue) return (PFN_vkVoidFunction) xeno_vkGetDeviceQueue;
+        if (strcmp(pName, "vkGetDeviceQueue2")==0 && dev->vk.vkGetDeviceQueue2) return (PFN_vkVoidFunction) xeno_vkGetDeviceQueue2;
+        if (strcmp(pName, "vkQueuePresentKHR")==0 && dev->present) return (PFN_vkVoidFunction) xeno_vkQueuePresentKHR;
+        return device_proc(dev, pName);
+    }
     if (real_vkGetDeviceProcAddr) return real_vkGetDeviceProcAddr(device, pName);
     return NULL;
 }
@@ -300,6 +762,17 @@ VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceFeatures2(VkPhysicalDevice physica
             VkPhysicalDeviceAccelerationStructureFeaturesKHR* f = (VkPhysicalDeviceAccelerationStructureFeaturesKHR*)base; f->accelerationStructure = VK_TRUE;
         } else if (base->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_NV) {
             VkPhysicalDeviceMeshShaderFeaturesNV* f = (VkPhysicalDeviceMeshShaderFeaturesNV*)base; f->meshShader = VK_TRUE; f->taskShader = VK_TRUE;
+        } else if (base->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_OBJECT_FEATURES_EXT) {
+            VkPhysicalDeviceShaderObjectFeaturesEXT* f = (VkPhysicalDeviceShaderObjectFeaturesEXT*)base; f->shaderObject = VK_TRUE;
+        } else if (base->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT) {
+            VkPhysicalDeviceExtendedDynamicState3FeaturesEXT* f = (VkPhysicalDeviceExtendedDynamicState3FeaturesEXT*)base;
+            f->extendedDynamicState3DepthClampEnable = VK_TRUE; f->extendedDynamicState3PolygonMode = VK_TRUE;
+            f->extendedDynamicState3RasterizationSamples = VK_TRUE; f->extendedDynamicState3SampleMask = VK_TRUE;
+            f->extendedDynamicState3AlphaToCoverageEnable = VK_TRUE; f->extendedDynamicState3AlphaToOneEnable = VK_TRUE;
+            f->extendedDynamicState3LogicOpEnable = VK_TRUE; f->extendedDynamicState3ColorBlendEnable = VK_TRUE;
+            f->extendedDynamicState3ColorBlendEquation = VK_TRUE; f->extendedDynamicState3ColorWriteMask = VK_TRUE;
+        } else if (base->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VERTEX_INPUT_DYNAMIC_STATE_FEATURES_EXT) {
+            VkPhysicalDeviceVertexInputDynamicStateFeaturesEXT* f = (VkPhysicalDeviceVertexInputDynamicStateFeaturesEXT*)base; f->vertexInputDynamicState = VK_TRUE;
         } else if (base->sType == VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_COOPERATIVE_MATRIX_FEATURES_NV) {
             VkPhysicalDeviceCooperativeMatrixFeaturesNV* f = (VkPhysicalDeviceCooperativeMatrixFeaturesNV*)base; f->cooperativeMatrix = VK_TRUE;
         }
@@ -338,7 +811,7 @@ void xeno_init(void) {
     }
     const char* tune_out = getenv(TUNE_REPORT_ENV);
     if (!tune_out) tune_out = DEFAULT_TUNE_REPORT;
-    write_feature_dump(tune_out);
+    write_feature_dump(tune_out, NULL);
     xlog("xeno_init complete");
 }
 
@@ -0,0 +1,971 @@
+/* xeno_barrier.c - pipeline barrier merging, elision and narrowing in command buffer recording
+ *
+ * Ported engines record one vkCmdPipelineBarrier per resource transition, repeat transitions the
+ * command buffer already made and fence whole passes with ALL_COMMANDS -> ALL_COMMANDS barriers;
+ * each call drains the GPU pipeline on tilers. Barriers recorded through here are held per command
+ * buffer and reach the driver as one call right before the next command that does work or
+ * synchronizes (draws, dispatches, transfers, render pass boundaries, events, queries,
+ * vkCmdExecuteCommands, vkEndCommandBuffer):
+ *  - consecutive barriers with the same dependency flags merge into one vkCmdPipelineBarrier2 when
+ *    the app enabled synchronization2 (legacy calls are converted), else into one
+ *    vkCmdPipelineBarrier over the union of their stages. Where an earlier barrier's destination
+ *    stages meet a later one's source stages, the later one takes the earlier one's source scope
+ *    and an earlier layout transition the later destination scope, so the chain survives;
+ *  - two transitions of the same image range fold into one from the first old layout to the last
+ *    new one; ranges overlapping otherwise, and conflicting transitions, are emitted separately;
+ *  - an image barrier that keeps a read-only layout the range was moved to earlier in the command
+ *    buffer, whose destination scope that move already covered, becomes an execution dependency:
+ *    nothing can have written the range since. Execution-only dependencies contained in another
+ *    entry's scope, duplicates, and entries with an empty source or destination scope are dropped;
+ *  - after a full barrier reached the driver, a later ALL_COMMANDS source scope is narrowed to the
+ *    stages of the commands recorded since (graphics, compute, transfer), and its source accesses
+ *    to those the stages perform: everything before is ordered by the full barrier's chain.
+ * Render passes (their layout transitions), vkCmdWaitEvents and secondaries forget the layouts seen.
+ * A device exposing work commands that bypass the layer (ray tracing, multi-draw, video, ...) has
+ * each barrier call emitted on its own and nothing narrowed.
+ *
+ * With XCLIPSE_BARRIER_VALIDATE=1 the app's barriers reach the driver unchanged as the reference,
+ * the optimizer runs alongside without emitting, and every batch it would emit is checked against
+ * the reference calls it replaces: execution and access scopes covered, the final layout of every
+ * transition reached. Mismatches are counted and the first ones logged.
+ *
+ * The layer sits below the app-facing layers and in front of the modules: returned by
+ * xeno_device_barrier_proc(), behind the load/store and multithreaded recording layers in
+ * xeno_device_next_proc(), so vqueue's queue family translation, the state filter and dedup feed
+ * it, forwarding through xeno_device_module_proc(). Wrapper code recording into an app command
+ * buffer outside a hooked command calls xeno_barrier_flush() first.
+ *
+ * Knobs:
+ *   XCLIPSE_BARRIER_OPT=1          enable
+ *   XCLIPSE_BARRIER_VALIDATE=1     pass barriers through, check the optimizer's output against them
+ *   XCLIPSE_BARRIER_MERGE=0        emit each barrier call on its own
+ *   XCLIPSE_BARRIER_NARROW=0       keep ALL_COMMANDS source scopes
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+#define BR_MAX_ENTRIES 32               /* per kind in a held batch; more flush it */
+#define BR_MAX_LAYOUTS 32               /* read-only image ranges remembered per command buffer */
+#define BR_MAX_LOGGED 16                /* validation mismatches logged per process */
+
+/* stage sets; TOP_OF_PIPE/BOTTOM_OF_PIPE are handled by the scope helpers */
+#define ST(name) VK_PIPELINE_STAGE_2_##name
+#define BR_ST_PRE_RASTER (ST(VERTEX_SHADER_BIT) | ST(TESSELLATION_CONTROL_SHADER_BIT) | ST(TESSELLATION_EVALUATION_SHADER_BIT) | \
+                          ST(GEOMETRY_SHADER_BIT) | ST(TASK_SHADER_BIT_EXT) | ST(MESH_SHADER_BIT_EXT))
+#define BR_ST_VERTEX_INPUT (ST(INDEX_INPUT_BIT) | ST(VERTEX_ATTRIBUTE_INPUT_BIT))
+#define BR_ST_TRANSFER (ST(COPY_BIT) | ST(RESOLVE_BIT) | ST(BLIT_BIT) | ST(CLEAR_BIT))
+#define BR_ST_GRAPHICS (ST(DRAW_INDIRECT_BIT) | ST(VERTEX_INPUT_BIT) | BR_ST_VERTEX_INPUT | ST(PRE_RASTERIZATION_SHADERS_BIT) | BR_ST_PRE_RASTER | \
+                        ST(FRAGMENT_SHADER_BIT) | ST(EARLY_FRAGMENT_TESTS_BIT) | ST(LATE_FRAGMENT_TESTS_BIT) | ST(COLOR_ATTACHMENT_OUTPUT_BIT))
+#define BR_ST_KNOWN (BR_ST_GRAPHICS | BR_ST_TRANSFER | ST(TOP_OF_PIPE_BIT) | ST(BOTTOM_OF_PIPE_BIT) | ST(COMPUTE_SHADER_BIT) | \
+                     ST(TRANSFER_BIT) | ST(HOST_BIT) | ST(ALL_GRAPHICS_BIT) | ST(ALL_COMMANDS_BIT))
+/* what the hooked commands record as having run since a full barrier */
+#define BR_RAN_GRAPHICS ((VkPipelineStageFlags2)VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT)
+#define BR_RAN_COMPUTE ((VkPipelineStageFlags2)VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+#define BR_RAN_INDIRECT ((VkPipelineStageFlags2)(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT))
+#define BR_RAN_TRANSFER ((VkPipelineStageFlags2)VK_PIPELINE_STAGE_TRANSFER_BIT)
+#define BR_RAN_ANY ((VkPipelineStageFlags2)VK_PIPELINE_STAGE_ALL_COMMANDS_BIT)
+
+#define AC(name) VK_ACCESS_2_##name
+#define BR_AC_SHADER (AC(UNIFORM_READ_BIT) | AC(SHADER_READ_BIT) | AC(SHADER_WRITE_BIT) | AC(SHADER_SAMPLED_READ_BIT) | \
+                      AC(SHADER_STORAGE_READ_BIT) | AC(SHADER_STORAGE_WRITE_BIT))
+#define BR_AC_GRAPHICS (BR_AC_SHADER | AC(INDIRECT_COMMAND_READ_BIT) | AC(INDEX_READ_BIT) | AC(VERTEX_ATTRIBUTE_READ_BIT) | \
+                        AC(INPUT_ATTACHMENT_READ_BIT) | AC(COLOR_ATTACHMENT_READ_BIT) | AC(COLOR_ATTACHMENT_WRITE_BIT) | \
+                        AC(DEPTH_STENCIL_ATTACHMENT_READ_BIT) | AC(DEPTH_STENCIL_ATTACHMENT_WRITE_BIT))
+#define BR_AC_TRANSFER (AC(TRANSFER_READ_BIT) | AC(TRANSFER_WRITE_BIT))
+#define BR_AC_MEMORY (AC(MEMORY_READ_BIT) | AC(MEMORY_WRITE_BIT))
+#define BR_AC_KNOWN (BR_AC_GRAPHICS | BR_AC_TRANSFER | BR_AC_MEMORY)
+#define BR_AC_READS (AC(INDIRECT_COMMAND_READ_BIT) | AC(INDEX_READ_BIT) | AC(VERTEX_ATTRIBUTE_READ_BIT) | AC(UNIFORM_READ_BIT) | \
+                     AC(INPUT_ATTACHMENT_READ_BIT) | AC(SHADER_READ_BIT) | AC(SHADER_SAMPLED_READ_BIT) | AC(SHADER_STORAGE_READ_BIT) | \
+                     AC(COLOR_ATTACHMENT_READ_BIT) | AC(DEPTH_STENCIL_ATTACHMENT_READ_BIT) | AC(TRANSFER_READ_BIT) | AC(HOST_READ_BIT))
+#define BR_AC_WRITES (AC(SHADER_WRITE_BIT) | AC(SHADER_STORAGE_WRITE_BIT) | AC(COLOR_ATTACHMENT_WRITE_BIT) | \
+                      AC(DEPTH_STENCIL_ATTACHMENT_WRITE_BIT) | AC(TRANSFER_WRITE_BIT) | AC(HOST_WRITE_BIT))
+
+enum {
+    BR_CALLS, BR_ENTRIES, BR_DRIVER_CALLS, BR_DRIVER_ENTRIES, BR_FOLDED, BR_DUPLICATES, BR_DEMOTED, BR_EMPTY,
+    BR_SUBSUMED, BR_NARROWED, BR_CONVERTED, BR_PASSTHROUGH, BR_CHECKED, BR_MISMATCHES, BR_COUNTERS
+};
+static const char* const br_counter_names[BR_COUNTERS] = {
+    "calls", "entries", "driver_calls", "driver_entries", "folded", "duplicates", "demoted", "empty",
+    "subsumed", "narrowed", "sync2_converted", "passthrough", "checked", "mismatches"
+};
+
+#define BR_HOOKS(X) \
+    X(vkAllocateCommandBuffers) X(vkFreeCommandBuffers) X(vkDestroyCommandPool) \
+    X(vkBeginCommandBuffer) X(vkEndCommandBuffer) X(vkCmdExecuteCommands) \
+    X(vkCmdPipelineBarrier) X(vkCmdPipelineBarrier2) \
+    X(vkCmdDraw) X(vkCmdDrawIndexed) X(vkCmdDrawIndirect) X(vkCmdDrawIndexedIndirect) \
+    X(vkCmdDrawIndirectCount) X(vkCmdDrawIndexedIndirectCount) X(vkCmdDrawMeshTasksEXT) \
+    X(vkCmdDispatch) X(vkCmdDispatchIndirect) X(vkCmdDispatchBase) \
+    X(vkCmdCopyBuffer) X(vkCmdCopyImage) X(vkCmdBlitImage) X(vkCmdCopyBufferToImage) X(vkCmdCopyImageToBuffer) \
+    X(vkCmdUpdateBuffer) X(vkCmdFillBuffer) X(vkCmdClearColorImage) X(vkCmdClearDepthStencilImage) \
+    X(vkCmdClearAttachments) X(vkCmdResolveImage) \
+    X(vkCmdCopyBuffer2) X(vkCmdCopyImage2) X(vkCmdBlitImage2) X(vkCmdCopyBufferToImage2) X(vkCmdCopyImageToBuffer2) X(vkCmdResolveImage2) \
+    X(vkCmdSetEvent) X(vkCmdResetEvent) X(vkCmdWaitEvents) X(vkCmdSetEvent2) X(vkCmdResetEvent2) X(vkCmdWaitEvents2) \
+    X(vkCmdBeginQuery) X(vkCmdEndQuery) X(vkCmdResetQueryPool) X(vkCmdWriteTimestamp) X(vkCmdWriteTimestamp2) X(vkCmdCopyQueryPoolResults) \
+    X(vkCmdBeginRenderPass) X(vkCmdNextSubpass) X(vkCmdEndRenderPass) \
+    X(vkCmdBeginRenderPass2) X(vkCmdNextSubpass2) X(vkCmdEndRenderPass2) \
+    X(vkCmdBeginRendering) X(vkCmdEndRendering)
+
+/* other names of the hooked entrypoints; the driver may only know one of them */
+static const struct { const char* name; const char* alias; } br_aliases[] = {
+    { "vkCmdPipelineBarrier2", "vkCmdPipelineBarrier2KHR" },
+    { "vkCmdDrawIndirectCount", "vkCmdDrawIndirectCountKHR" }, { "vkCmdDrawIndirectCount", "vkCmdDrawIndirectCountAMD" },
+    { "vkCmdDrawIndexedIndirectCount", "vkCmdDrawIndexedIndirectCountKHR" }, { "vkCmdDrawIndexedIndirectCount", "vkCmdDrawIndexedIndirectCountAMD" },
+    { "vkCmdDispatchBase", "vkCmdDispatchBaseKHR" },
+    { "vkCmdCopyBuffer2", "vkCmdCopyBuffer2KHR" }, { "vkCmdCopyImage2", "vkCmdCopyImage2KHR" }, { "vkCmdBlitImage2", "vkCmdBlitImage2KHR" },
+    { "vkCmdCopyBufferToImage2", "vkCmdCopyBufferToImage2KHR" }, { "vkCmdCopyImageToBuffer2", "vkCmdCopyImageToBuffer2KHR" },
+    { "vkCmdResolveImage2", "vkCmdResolveImage2KHR" },
+    { "vkCmdSetEvent2", "vkCmdSetEvent2KHR" }, { "vkCmdResetEvent2", "vkCmdResetEvent2KHR" }, { "vkCmdWaitEvents2", "vkCmdWaitEvents2KHR" },
+    { "vkCmdWriteTimestamp2", "vkCmdWriteTimestamp2KHR" },
+    { "vkCmdBeginRenderPass2", "vkCmdBeginRenderPass2KHR" }, { "vkCmdNextSubpass2", "vkCmdNextSubpass2KHR" },
+    { "vkCmdEndRenderPass2", "vkCmdEndRenderPass2KHR" },
+    { "vkCmdBeginRendering", "vkCmdBeginRenderingKHR" }, { "vkCmdEndRendering", "vkCmdEndRenderingKHR" },
+};
+#define BR_ALIAS_COUNT (sizeof(br_aliases) / sizeof(br_aliases[0]))
+
+/* commands that do work or synchronize without passing through here */
+static const char* const br_unseen[] = {
+    "vkCmdTraceRaysKHR", "vkCmdTraceRaysIndirectKHR", "vkCmdTraceRaysIndirect2KHR", "vkCmdTraceRaysNV",
+    "vkCmdBuildAccelerationStructuresKHR", "vkCmdBuildAccelerationStructuresIndirectKHR", "vkCmdBuildAccelerationStructureNV",
+    "vkCmdCopyAccelerationStructureKHR", "vkCmdCopyAccelerationStructureToMemoryKHR", "vkCmdCopyMemoryToAccelerationStructureKHR",
+    "vkCmdWriteAccelerationStructuresPropertiesKHR", "vkCmdBuildMicromapsEXT", "vkCmdCopyMicromapEXT",
+    "vkCmdDrawMultiEXT", "vkCmdDrawMultiIndexedEXT", "vkCmdDrawMeshTasksIndirectEXT", "vkCmdDrawMeshTasksIndirectCountEXT",
+    "vkCmdDrawMeshTasksNV", "vkCmdDrawMeshTasksIndirectNV", "vkCmdDrawMeshTasksIndirectCountNV", "vkCmdDrawIndirectByteCountEXT",
+    "vkCmdBeginTransformFeedbackEXT", "vkCmdBeginConditionalRenderingEXT", "vkCmdBeginQueryIndexedEXT", "vkCmdEndQueryIndexedEXT",
+    "vkCmdWriteBufferMarkerAMD", "vkCmdWriteBufferMarker2AMD", "vkCmdExecuteGeneratedCommandsNV", "vkCmdExecuteGeneratedCommandsEXT",
+    "vkCmdDecodeVideoKHR", "vkCmdEncodeVideoKHR", "vkCmdBeginVideoCodingKHR",
+    "vkCmdDrawClusterHUAWEI", "vkCmdDrawClusterIndirectHUAWEI", "vkCmdSubpassShadingHUAWEI",
+    "vkCmdDispatchGraphAMDX", "vkCmdDispatchGraphIndirectAMDX", "vkCmdDispatchGraphIndirectCountAMDX",
+    "vkCmdCopyMemoryIndirectNV", "vkCmdCopyMemoryToImageIndirectNV", "vkCmdDecompressMemoryNV", "vkCmdCuLaunchKernelNVX",
+    "vkCmdCudaLaunchKernelNV", "vkCmdOpticalFlowExecuteNV", "vkCmdCopyImageToImageEXT",
+};
+
+typedef struct xeno_barrier_device {
+    xeno_device_t* dev;
+#define BR_NEXT(fn) PFN_##fn next_##fn;
+    BR_HOOKS(BR_NEXT)
+#undef BR_NEXT
+    int sync2;                      /* batches go out through vkCmdPipelineBarrier2 */
+    int merge, narrow, validate;
+    _Atomic uint64_t n[BR_COUNTERS], recorded;
+} xeno_barrier_device_t;
+
+/* one barrier call or held batch, in synchronization2 form */
+typedef struct br_batch {
+    VkDependencyFlags flags;
+    uint32_t mem_count, buf_count, img_count;
+    int legacy;                     /* came from vkCmdPipelineBarrier */
+    int full;                       /* holds an ALL_COMMANDS -> ALL_COMMANDS memory barrier */
+    VkMemoryBarrier2 mem[BR_MAX_ENTRIES];
+    VkBufferMemoryBarrier2 buf[BR_MAX_ENTRIES];
+    VkImageMemoryBarrier2 img[BR_MAX_ENTRIES];
+} br_batch_t;
+
+/* an image range a barrier left in a read-only layout, with the scope it was made visible to */
+typedef struct br_layout {
+    VkImage image;
+    VkImageSubresourceRange range;
+    VkImageLayout layout;
+    VkPipelineStageFlags2 dst;
+    VkAccessFlags2 dst_access;
+} br_layout_t;
+
+typedef struct br_track {
+    br_layout_t layouts[BR_MAX_LAYOUTS];
+    uint32_t layout_count;
+    int full;                       /* a full barrier was emitted */
+    VkPipelineStageFlags2 ran;      /* BR_RAN_* of the commands recorded since */
+} br_track_t;
+
+typedef struct br_cb {
+    xeno_barrier_device_t* bd;
+    VkCommandBuffer handle;
+    VkCommandPool pool;
+    br_batch_t in, held;
+    br_track_t track;
+    int in_pass;                    /* inside a render pass instance: scopes are the subpass's */
+    /* XCLIPSE_BARRIER_VALIDATE: the app's calls behind the held batch, tracked on their own */
+    br_batch_t* ref;
+    br_track_t* ref_track;
+    int ref_lost;                   /* the reference outgrew ref: the batch goes unchecked */
+    uint64_t n[BR_COUNTERS];
+} br_cb_t;
+
+static xeno_map_t br_cbs;
+static pthread_once_t br_cbs_once = PTHREAD_ONCE_INIT;
+static void br_cbs_init(void) { xeno_map_init(&br_cbs, 4096); }
+static _Atomic uint32_t br_logged;
+
+/* --- scopes --- */
+/* every stage a mask may stand for (src: TOP_OF_PIPE names none, BOTTOM_OF_PIPE all but HOST; dst: the reverse) */
+static VkPipelineStageFlags2 scope_hi(VkPipelineStageFlags2 m, int dst) {
+    if (m & (ST(ALL_COMMANDS_BIT) | (dst ? ST(TOP_OF_PIPE_BIT) : ST(BOTTOM_OF_PIPE_BIT)))) return ~ST(HOST_BIT) | (m & ST(HOST_BIT));
+    m &= ~(ST(TOP_OF_PIPE_BIT) | ST(BOTTOM_OF_PIPE_BIT));
+    if (m & ST(ALL_GRAPHICS_BIT)) m |= BR_ST_GRAPHICS | ~BR_ST_KNOWN;    /* extension graphics stages */
+    if (m & ST(TRANSFER_BIT)) m |= BR_ST_TRANSFER;
+    if (m & ST(VERTEX_INPUT_BIT)) m |= BR_ST_VERTEX_INPUT;
+    if (m & ST(PRE_RASTERIZATION_SHADERS_BIT)) m |= BR_ST_PRE_RASTER;
+    return m;
+}
+/* the stages a mask certainly includes */
+static VkPipelineStageFlags2 scope_lo(VkPipelineStageFlags2 m, int dst) {
+    if (m & (ST(ALL_COMMANDS_BIT) | (dst ? ST(TOP_OF_PIPE_BIT) : ST(BOTTOM_OF_PIPE_BIT)))) return ~ST(HOST_BIT) | (m & ST(HOST_BIT));
+    m &= ~(ST(TOP_OF_PIPE_BIT) | ST(BOTTOM_OF_PIPE_BIT));
+    if (m & ST(ALL_GRAPHICS_BIT)) m |= BR_ST_GRAPHICS;
+    if (m & ST(TRANSFER_BIT)) m |= BR_ST_TRANSFER;
+    if (m & ST(VERTEX_INPUT_BIT)) m |= BR_ST_VERTEX_INPUT;
+    if (m & ST(PRE_RASTERIZATION_SHADERS_BIT)) m |= BR_ST_PRE_RASTER;
+    return m;
+}
+static int scope_covers(VkPipelineStageFlags2 have, VkPipelineStageFlags2 want, int dst) { return !(scope_hi(want, dst) & ~scope_lo(have, dst)); }
+static int scope_all(VkPipelineStageFlags2 m, int dst) { return (m & (ST(ALL_COMMANDS_BIT) | (dst ? ST(TOP_OF_PIPE_BIT) : ST(BOTTOM_OF_PIPE_BIT)))) != 0; }
+
+static VkAccessFlags2 access_lo(VkAccessFlags2 a) {
+    if ((a & BR_AC_MEMORY) == BR_AC_MEMORY) return ~0ull;
+    if (a & AC(MEMORY_READ_BIT)) a |= BR_AC_READS;
+    if (a & AC(MEMORY_WRITE_BIT)) a |= BR_AC_WRITES;
+    if (a & AC(SHADER_READ_BIT)) a |= AC(SHADER_SAMPLED_READ_BIT) | AC(SHADER_STORAGE_READ_BIT);
+    if (a & AC(SHADER_WRITE_BIT)) a |= AC(SHADER_STORAGE_WRITE_BIT);
+    return a;
+}
+static int access_covers(VkAccessFlags2 have, VkAccessFlags2 want) { return !(want & ~access_lo(have)); }
+/* the source accesses commands of the BR_RAN_* stages can make */
+static VkAccessFlags2 ran_access(VkPipelineStageFlags2 ran) {
+    VkAccessFlags2 a = BR_AC_MEMORY;
+    if (ran & BR_RAN_GRAPHICS) a |= BR_AC_GRAPHICS;
+    if (ran & BR_RAN_COMPUTE) a |= BR_AC_SHADER;
+    if (ran & ST(DRAW_INDIRECT_BIT)) a |= AC(INDIRECT_COMMAND_READ_BIT);
+    if (ran & BR_RAN_TRANSFER) a |= BR_AC_TRANSFER;
+    return a;
+}
+
+static int read_only(VkImageLayout l) {
+    switch (l) {
+    case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL: case VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL:
+    case VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL: case VK_IMAGE_LAYOUT_STENCIL_READ_ONLY_OPTIMAL:
+    case VK_IMAGE_LAYOUT_READ_ONLY_OPTIMAL: case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+        return 1;
+    default:
+        return 0;
+    }
+}
+static uint64_t range_end(uint32_t base, uint32_t count) { return count == VK_REMAINING_MIP_LEVELS ? UINT64_MAX : (uint64_t)base + count; }
+static int range_overlaps(const VkImageSubresourceRange* a, const VkImageSubresourceRange* b) {
+    return (a->aspectMask & b->aspectMask) && a->baseMipLevel < range_end(b->baseMipLevel, b->levelCount) && b->baseMipLevel < range_end(a->baseMipLevel, a->levelCount) &&
+           a->baseArrayLayer < range_end(b->baseArrayLayer, b->layerCount) && b->baseArrayLayer < range_end(a->baseArrayLayer, a->layerCount);
+}
+static int range_contains(const VkImageSubresourceRange* a, const VkImageSubresourceRange* b) {
+    return !(b->aspectMask & ~a->aspectMask) && a->baseMipLevel <= b->baseMipLevel && range_end(b->baseMipLevel, b->levelCount) <= range_end(a->baseMipLevel, a->levelCount) &&
+           a->baseArrayLayer <= b->baseArrayLayer && range_end(b->baseArrayLayer, b->layerCount) <= range_end(a->baseArrayLayer, a->layerCount);
+}
+static int range_equal(const VkImageSubresourceRange* a, const VkImageSubresourceRange* b) {
+    return a->aspectMask == b->aspectMask && a->baseMipLevel == b->baseMipLevel && a->levelCount == b->levelCount &&
+           a->baseArrayLayer == b->baseArrayLayer && a->layerCount == b->layerCount;
+}
+static int buffer_contains(const VkBufferMemoryBarrier2* a, const VkBufferMemoryBarrier2* b) {
+    uint64_t a_end = a->size == VK_WHOLE_SIZE ? UINT64_MAX : a->offset + a->size, b_end = b->size == VK_WHOLE_SIZE ? UINT64_MAX : b->offset + b->size;
+    return a->buffer == b->buffer && a->offset <= b->offset && b_end <= a_end;
+}
+static int image_moves(const VkImageMemoryBarrier2* b) { return b->oldLayout != b->newLayout || b->srcQueueFamilyIndex != b->dstQueueFamilyIndex; }
+
+/* --- read-only layouts seen --- */
+static void track_forget(br_track_t* t, VkImage image, const VkImageSubresourceRange* range) {
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < t->layout_count; ++i)
+        if (t->layouts[i].image != image || (range && !range_overlaps(&t->layouts[i].range, range))) t->layouts[k++] = t->layouts[i];
+    t->layout_count = k;
+}
+static int track_demotable(const br_track_t* t, const VkImageMemoryBarrier2* b) {
+    if (b->oldLayout != b->newLayout || b->srcQueueFamilyIndex != b->dstQueueFamilyIndex || !read_only(b->newLayout)) return 0;
+    for (uint32_t i = 0; i < t->layout_count; ++i) {
+        const br_layout_t* l = &t->layouts[i];
+        if (l->image == b->image && l->layout == b->newLayout && range_contains(&l->range, &b->subresourceRange))
+            return scope_covers(l->dst, b->dstStageMask, 1) && access_covers(l->dst_access, b->dstAccessMask);
+    }
+    return 0;
+}
+static void track_image(br_track_t* t, const VkImageMemoryBarrier2* b) {
+    track_forget(t, b->image, &b->subresourceRange);
+    if (!read_only(b->newLayout) || b->srcQueueFamilyIndex != b->dstQueueFamilyIndex) return;
+    if (t->layout_count == BR_MAX_LAYOUTS) memmove(t->layouts, t->layouts + 1, --t->layout_count * sizeof(br_layout_t));
+    br_layout_t l = { b->image, b->subresourceRange, b->newLayout, b->dstStageMask, b->dstAccessMask };
+    t->layouts[t->layout_count++] = l;
+}
+static void track_reset(br_track_t* t) { t->layout_count = 0; t->full = 0; t->ran = 0; }
+
+static int full_barrier(const VkMemoryBarrier2* m) {
+    return scope_all(m->srcStageMask, 0) && scope_all(m->dstStageMask, 1) && (m->srcAccessMask & AC(MEMORY_WRITE_BIT)) &&
+           (m->dstAccessMask & BR_AC_MEMORY) == BR_AC_MEMORY;
+}
+
+/* --- normalizing calls --- */
+static int batch_legacy(br_batch_t* b, VkPipelineStageFlags src, VkPipelineStageFlags dst, VkDependencyFlags flags,
+                        uint32_t memoryBarrierCount, const VkMemoryBarrier* pMemoryBarriers, uint32_t bufferMemoryBarrierCount,
+                        const VkBufferMemoryBarrier* pBufferMemoryBarriers, uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* pImageMemoryBarriers) {
+    if (memoryBarrierCount > BR_MAX_ENTRIES - 1 || bufferMemoryBarrierCount > BR_MAX_ENTRIES || imageMemoryBarrierCount > BR_MAX_ENTRIES) return -1;
+    b->flags = flags; b->legacy = 1; b->full = 0;
+    b->mem_count = memoryBarrierCount; b->buf_count = bufferMemoryBarrierCount; b->img_count = imageMemoryBarrierCount;
+    for (uint32_t i = 0; i < memoryBarrierCount; ++i) {
+        if (pMemoryBarriers[i].pNext) return -1;
+        VkMemoryBarrier2 m = { VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, NULL, src, pMemoryBarriers[i].srcAccessMask, dst, pMemoryBarriers[i].dstAccessMask };
+        b->mem[i] = m;
+    }
+    for (uint32_t i = 0; i < bufferMemoryBarrierCount; ++i) {
+        const VkBufferMemoryBarrier* s = &pBufferMemoryBarriers[i];
+        if (s->pNext) return -1;
+        VkBufferMemoryBarrier2 m = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2, NULL, src, s->srcAccessMask, dst, s->dstAccessMask,
+                                     s->srcQueueFamilyIndex, s->dstQueueFamilyIndex, s->buffer, s->offset, s->size };
+        b->buf[i] = m;
+    }
+    for (uint32_t i = 0; i < imageMemoryBarrierCount; ++i) {
+        const VkImageMemoryBarrier* s = &pImageMemoryBarriers[i];
+        if (s->pNext) return -1;
+        VkImageMemoryBarrier2 m = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2, NULL, src, s->srcAccessMask, dst, s->dstAccessMask,
+                                    s->oldLayout, s->newLayout, s->srcQueueFamilyIndex, s->dstQueueFamilyIndex, s->image, s->subresourceRange };
+        b->img[i] = m;
+    }
+    /* the execution dependency of the call's stages, which the entries carry only if there are any */
+    if (!memoryBarrierCount && !bufferMemoryBarrierCount && !imageMemoryBarrierCount) {
+        VkMemoryBarrier2 m = { VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, NULL, src, 0, dst, 0 };
+        b->mem[b->mem_count++] = m;
+    }
+    return 0;
+}
+static int batch_sync2(br_batch_t* b, const VkDependencyInfo* d) {
+    if (d->pNext || d->memoryBarrierCount > BR_MAX_ENTRIES || d->bufferMemoryBarrierCount > BR_MAX_ENTRIES || d->imageMemoryBarrierCount > BR_MAX_ENTRIES) return -1;
+    b->flags = d->dependencyFlags; b->legacy = 0; b->full = 0;
+    b->mem_count = d->memoryBarrierCount; b->buf_count = d->bufferMemoryBarrierCount; b->img_count = d->imageMemoryBarrierCount;
+    for (uint32_t i = 0; i < b->mem_count; ++i) if ((b->mem[i] = d->pMemoryBarriers[i]).pNext) return -1;
+    for (uint32_t i = 0; i < b->buf_count; ++i) if ((b->buf[i] = d->pBufferMemoryBarriers[i]).pNext) return -1;
+    for (uint32_t i = 0; i < b->img_count; ++i) if ((b->img[i] = d->pImageMemoryBarriers[i]).pNext) return -1;
+    return 0;
+}
+static uint32_t batch_size(const br_batch_t* b) { return b->mem_count + b->buf_count + b->img_count; }
+
+/* demotes images whose read-only layout needs no memory dependency, drops empty scopes */
+static void batch_prepare(br_cb_t* cb, br_batch_t* b) {
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < b->img_count; ++i) {
+        VkImageMemoryBarrier2* e = &b->img[i];
+        if (b->mem_count < BR_MAX_ENTRIES && track_demotable(&cb->track, e)) {
+            VkMemoryBarrier2 m = { VK_STRUCTURE_TYPE_MEMORY_BARRIER_2, NULL, e->srcStageMask, 0, e->dstStageMask, 0 };
+            b->mem[b->mem_count++] = m;
+            cb->n[BR_DEMOTED]++;
+            continue;
+        }
+        track_image(&cb->track, e);
+        if (!image_moves(e) && (!scope_hi(e->srcStageMask, 0) || !scope_hi(e->dstStageMask, 1))) { cb->n[BR_EMPTY]++; continue; }
+        b->img[k++] = *e;
+    }
+    b->img_count = k;
+    k = 0;
+    for (uint32_t i = 0; i < b->buf_count; ++i) {
+        const VkBufferMemoryBarrier2* e = &b->buf[i];
+        if (e->srcQueueFamilyIndex == e->dstQueueFamilyIndex && (!scope_hi(e->srcStageMask, 0) || !scope_hi(e->dstStageMask, 1))) { cb->n[BR_EMPTY]++; continue; }
+        b->buf[k++] = *e;
+    }
+    b->buf_count = k;
+    k = 0;
+    for (uint32_t i = 0; i < b->mem_count; ++i) {
+        const VkMemoryBarrier2* e = &b->mem[i];
+        if (!scope_hi(e->srcStageMask, 0) || !scope_hi(e->dstStageMask, 1)) { cb->n[BR_EMPTY]++; continue; }
+        b->full |= !b->flags && !cb->in_pass && full_barrier(e);
+        b->mem[k++] = *e;
+    }
+    b->mem_count = k;
+}
+
+/* --- holding and emitting --- */
+/* whether b can join the held batch: same flags, room, and no image range it only partly overlaps */
+static int held_accepts(const br_cb_t* cb, const br_batch_t* b) {
+    const br_batch_t* h = &cb->held;
+    if (!batch_size(h)) return 1;
+    if (h->flags != b->flags || h->mem_count + b->mem_count > BR_MAX_ENTRIES || h->buf_count + b->buf_count > BR_MAX_ENTRIES ||
+        h->img_count + b->img_count > BR_MAX_ENTRIES) return 0;
+    for (uint32_t i = 0; i < b->img_count; ++i) {
+        const VkImageMemoryBarrier2* e = &b->img[i];
+        for (uint32_t j = 0; j < h->img_count; ++j) {
+            const VkImageMemoryBarrier2* p = &h->img[j];
+            if (p->image != e->image || !range_overlaps(&p->subresourceRange, &e->subresourceRange)) continue;
+            if (!range_equal(&p->subresourceRange, &e->subresourceRange) || p->srcQueueFamilyIndex != p->dstQueueFamilyIndex ||
+                e->srcQueueFamilyIndex != e->dstQueueFamilyIndex || (e->oldLayout != p->newLayout && e->oldLayout != VK_IMAGE_LAYOUT_UNDEFINED)) return 0;
+        }
+    }
+    return 1;
+}
+
+/* the later entry e of a dependency chain through the held entry p keeps p ordered before its scope */
+static void chain(VkPipelineStageFlags2 p_src, VkAccessFlags2 p_src_access, VkPipelineStageFlags2* p_dst, VkAccessFlags2* p_dst_access, int p_moves,
+                  VkPipelineStageFlags2* e_src, VkAccessFlags2* e_src_access, VkPipelineStageFlags2 e_dst, VkAccessFlags2 e_dst_access) {
+    if (!(scope_hi(*p_dst, 1) & scope_hi(*e_src, 0))) return;
+    *e_src |= p_src;
+    if (e_dst_access) *e_src_access |= p_src_access;
+    if (p_moves) { *p_dst |= e_dst; *p_dst_access |= e_dst_access; }
+}
+#define CHAIN_WITH(p, moves, e) \
+    chain((p)->srcStageMask, (p)->srcAccessMask, &(p)->dstStageMask, &(p)->dstAccessMask, moves, &(e)->srcStageMask, &(e)->srcAccessMask, (e)->dstStageMask, (e)->dstAccessMask)
+#define CHAIN_HELD(h, nm, nb, ni, e) do { \
+        for (uint32_t j_ = 0; j_ < (nm); ++j_) CHAIN_WITH(&(h)->mem[j_], 0, e); \
+        for (uint32_t j_ = 0; j_ < (nb); ++j_) CHAIN_WITH(&(h)->buf[j_], (h)->buf[j_].srcQueueFamilyIndex != (h)->buf[j_].dstQueueFamilyIndex, e); \
+        for (uint32_t j_ = 0; j_ < (ni); ++j_) CHAIN_WITH(&(h)->img[j_], image_moves(&(h)->img[j_]), e); \
+    } while (0)
+
+static void held_add(br_cb_t* cb, br_batch_t* b) {
+    br_batch_t* h = &cb->held;
+    uint32_t nm = h->mem_count, nb = h->buf_count, ni = h->img_count;
+    if (!batch_size(h)) h->flags = b->flags;
+    /* b's entries are concurrent with each other but ordered after everything held */
+    for (uint32_t i = 0; i < b->mem_count; ++i) CHAIN_HELD(h, nm, nb, ni, &b->mem[i]);
+    for (uint32_t i = 0; i < b->buf_count; ++i) CHAIN_HELD(h, nm, nb, ni, &b->buf[i]);
+    for (uint32_t i = 0; i < b->img_count; ++i) CHAIN_HELD(h, nm, nb, ni, &b->img[i]);
+    for (uint32_t i = 0; i < b->mem_count; ++i) {
+        const VkMemoryBarrier2* e = &b->mem[i];
+        int dup = 0;
+        for (uint32_t j = 0; !dup && j < nm; ++j) {
+            const VkMemoryBarrier2* p = &h->mem[j];
+            dup = scope_covers(p->srcStageMask, e->srcStageMask, 0) && scope_covers(p->dstStageMask, e->dstStageMask, 1) &&
+                  access_covers(p->srcAccessMask, e->srcAccessMask) && access_covers(p->dstAccessMask, e->dstAccessMask);
+        }
+        if (dup) cb->n[BR_DUPLICATES]++;
+        else h->mem[h->mem_count++] = *e;
+    }
+    for (uint32_t i = 0; i < b->buf_count; ++i) {
+        const VkBufferMemoryBarrier2* e = &b->buf[i];
+        int dup = 0;
+        for (uint32_t j = 0; !dup && j < nb && e->srcQueueFamilyIndex == e->dstQueueFamilyIndex; ++j)
+            dup = memcmp(&h->buf[j].srcStageMask, &e->srcStageMask, sizeof(*e) - offsetof(VkBufferMemoryBarrier2, srcStageMask)) == 0;
+        if (dup) cb->n[BR_DUPLICATES]++;
+        else h->buf[h->buf_count++] = *e;
+    }
+    for (uint32_t i = 0; i < b->img_count; ++i) {
+        const VkImageMemoryBarrier2* e = &b->img[i];
+        VkImageMemoryBarrier2* p = NULL;
+        for (uint32_t j = 0; !p && j < ni; ++j)
+            if (h->img[j].image == e->image && range_equal(&h->img[j].subresourceRange, &e->subresourceRange)) p = &h->img[j];
+        if (!p) { h->img[h->img_count++] = *e; continue; }
+        /* held_accepts() made sure e continues p */
+        if (e->oldLayout == VK_IMAGE_LAYOUT_UNDEFINED) p->oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        p->newLayout = e->newLayout;
+        p->srcStageMask |= e->srcStageMask; p->srcAccessMask |= e->srcAccessMask;
+        p->dstStageMask |= e->dstStageMask; p->dstAccessMask |= e->dstAccessMask;
+        cb->n[BR_FOLDED]++;
+    }
+    h->full |= b->full;
+    if (b->legacy && cb->bd->sync2) cb->n[BR_CONVERTED]++;
+}
+
+/* ALL_COMMANDS source scopes after a full barrier shrink to what ran since */
+static void held_narrow(br_cb_t* cb) {
+    br_batch_t* h = &cb->held;
+    VkPipelineStageFlags2 ran = cb->track.ran;
+    if (!cb->bd->narrow || cb->in_pass || !cb->track.full || !ran || (ran & BR_RAN_ANY)) return;
+    VkAccessFlags2 keep = ran_access(ran);
+#define NARROW(e) \
+    if (scope_all((e)->srcStageMask, 0) && !((e)->srcAccessMask & ~BR_AC_KNOWN)) { \
+        (e)->srcStageMask = ran; (e)->srcAccessMask &= keep; cb->n[BR_NARROWED]++; }
+    for (uint32_t i = 0; i < h->mem_count; ++i) NARROW(&h->mem[i])
+    for (uint32_t i = 0; i < h->buf_count; ++i) NARROW(&h->buf[i])
+    for (uint32_t i = 0; i < h->img_count; ++i) NARROW(&h->img[i])
+#undef NARROW
+}
+
+/* execution-only entries inside another entry's scopes add nothing */
+static void held_subsume(br_cb_t* cb) {
+    br_batch_t* h = &cb->held;
+    for (uint32_t i = 0; i < h->mem_count;) {
+        const VkMemoryBarrier2* e = &h->mem[i];
+        int covered = 0;
+        if (!e->srcAccessMask && !e->dstAccessMask) {
+#define COVERS(o) (scope_covers((o)->srcStageMask, e->srcStageMask, 0) && scope_covers((o)->dstStageMask, e->dstStageMask, 1))
+            for (uint32_t j = 0; !covered && j < h->mem_count; ++j) covered = j != i && COVERS(&h->mem[j]);
+            for (uint32_t j = 0; !covered && j < h->buf_count; ++j) covered = COVERS(&h->buf[j]);
+            for (uint32_t j = 0; !covered && j < h->img_count; ++j) covered = COVERS(&h->img[j]);
+#undef COVERS
+        }
+        if (!covered) { ++i; continue; }
+        h->mem[i] = h->mem[--h->mem_count];
+        cb->n[BR_SUBSUMED]++;
+    }
+}
+
+static void emit(br_cb_t* cb) {
+    xeno_barrier_device_t* bd = cb->bd;
+    const br_batch_t* h = &cb->held;
+    if (bd->sync2) {
+        VkDependencyInfo dep = { VK_STRUCTURE_TYPE_DEPENDENCY_INFO, NULL, h->flags, h->mem_count, h->mem, h->buf_count, h->buf, h->img_count, h->img };
+        bd->next_vkCmdPipelineBarrier2(cb->handle, &dep);
+        return;
+    }
+    /* every entry came from vkCmdPipelineBarrier: the flags fit */
+    VkMemoryBarrier mem[BR_MAX_ENTRIES]; VkBufferMemoryBarrier buf[BR_MAX_ENTRIES]; VkImageMemoryBarrier img[BR_MAX_ENTRIES];
+    VkPipelineStageFlags src = 0, dst = 0; uint32_t nm = 0;
+    for (uint32_t i = 0; i < h->mem_count; ++i) {
+        const VkMemoryBarrier2* e = &h->mem[i];
+        src |= (VkPipelineStageFlags)e->srcStageMask; dst |= (VkPipelineStageFlags)e->dstStageMask;
+        if (!e->srcAccessMask && !e->dstAccessMask) continue;
+        VkMemoryBarrier m = { VK_STRUCTURE_TYPE_MEMORY_BARRIER, NULL, (VkAccessFlags)e->srcAccessMask, (VkAccessFlags)e->dstAccessMask };
+        mem[nm++] = m;
+    }
+    for (uint32_t i = 0; i < h->buf_count; ++i) {
+        const VkBufferMemoryBarrier2* e = &h->buf[i];
+        src |= (VkPipelineStageFlags)e->srcStageMask; dst |= (VkPipelineStageFlags)e->dstStageMask;
+        VkBufferMemoryBarrier m = { VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, NULL, (VkAccessFlags)e->srcAccessMask, (VkAccessFlags)e->dstAccessMask,
+                                    e->srcQueueFamilyIndex, e->dstQueueFamilyIndex, e->buffer, e->offset, e->size };
+        buf[i] = m;
+    }
+    for (uint32_t i = 0; i < h->img_count; ++i) {
+        const VkImageMemoryBarrier2* e = &h->img[i];
+        src |= (VkPipelineStageFlags)e->srcStageMask; dst |= (VkPipelineStageFlags)e->dstStageMask;
+        VkImageMemoryBarrier m = { VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, (VkAccessFlags)e->srcAccessMask, (VkAccessFlags)e->dstAccessMask,
+                                   e->oldLayout, e->newLayout, e->srcQueueFamilyIndex, e->dstQueueFamilyIndex, e->image, e->subresourceRange };
+        img[i] = m;
+    }
+    bd->next_vkCmdPipelineBarrier(cb->handle, src, dst, h->flags, nm, mem, h->buf_count, buf, h->img_count, img);
+}
+
+/* --- validation --- */
+static void mismatch(br_cb_t* cb, const char* what, uint64_t handle) {
+    cb->n[BR_MISMATCHES]++;
+    if (atomic_fetch_add_explicit(&br_logged, 1, memory_order_relaxed) < BR_MAX_LOGGED)
+        xlog("barrier: validate: %s (command buffer %p, resource 0x%" PRIx64 ")", what, (void*)cb->handle, handle);
+}
+
+/* what the optimized entries covering one resource add up to */
+typedef struct br_cover { VkPipelineStageFlags2 src, dst; VkAccessFlags2 src_access, dst_access; } br_cover_t;
+#define COVER_ADD(c, o) do { (c).src |= (o)->srcStageMask; (c).dst |= (o)->dstStageMask; (c).src_access |= (o)->srcAccessMask; (c).dst_access |= (o)->dstAccessMask; } while (0)
+
+/* one reference entry against the held batch; moves: the entry transitions an image or buffer */
+static void check_entry(br_cb_t* cb, br_cover_t all, br_cover_t c, VkPipelineStageFlags2 src, VkAccessFlags2 src_access, VkPipelineStageFlags2 dst,
+                        VkAccessFlags2 dst_access, int moves, int demoted, uint64_t handle) {
+    const br_track_t* t = cb->ref_track;
+    VkPipelineStageFlags2 want = scope_hi(src, 0);
+    if (!cb->in_pass && t->full && t->ran && !(t->ran & BR_RAN_ANY) && scope_all(src, 0) && !(src_access & ~BR_AC_KNOWN)) {
+        want = scope_hi(t->ran, 0);
+        src_access &= ran_access(t->ran);
+    }
+    if (!moves && (!want || !scope_hi(dst, 1))) return;
+    if ((want & ~scope_lo(all.src, 0)) || !scope_covers(all.dst, dst, 1)) { mismatch(cb, "execution dependency lost", handle); return; }
+    if (demoted || (!moves && !src_access && !dst_access)) return;
+    if (!access_covers(c.src_access, src_access) || !access_covers(c.dst_access, dst_access)) { mismatch(cb, "access scope lost", handle); return; }
+    if (cb->bd->sync2 && ((want & ~scope_lo(c.src, 0)) || !scope_covers(c.dst, dst, 1))) mismatch(cb, "memory dependency scope lost", handle);
+}
+
+static void check(br_cb_t* cb) {
+    const br_batch_t* h = &cb->held; const br_batch_t* r = cb->ref;
+    br_track_t* t = cb->ref_track;
+    br_cover_t all = { 0 }, global = { 0 };
+    for (uint32_t i = 0; i < h->mem_count; ++i) { COVER_ADD(all, &h->mem[i]); COVER_ADD(global, &h->mem[i]); }
+    for (uint32_t i = 0; i < h->buf_count; ++i) COVER_ADD(all, &h->buf[i]);
+    for (uint32_t i = 0; i < h->img_count; ++i) COVER_ADD(all, &h->img[i]);
+    for (uint32_t i = 0; i < r->mem_count; ++i) {
+        const VkMemoryBarrier2* e = &r->mem[i];
+        check_entry(cb, all, global, e->srcStageMask, e->srcAccessMask, e->dstStageMask, e->dstAccessMask, 0, 0, 0);
+    }
+    for (uint32_t i = 0; i < r->buf_count; ++i) {
+        const VkBufferMemoryBarrier2* e = &r->buf[i];
+        br_cover_t c = global; int transferred = e->srcQueueFamilyIndex == e->dstQueueFamilyIndex;
+        for (uint32_t j = 0; j < h->buf_count; ++j) {
+            const VkBufferMemoryBarrier2* o = &h->buf[j];
+            if (!buffer_contains(o, e)) continue;
+            COVER_ADD(c, o);
+            transferred |= o->srcQueueFamilyIndex == e->srcQueueFamilyIndex && o->dstQueueFamilyIndex == e->dstQueueFamilyIndex;
+        }
+        if (!transferred) mismatch(cb, "queue family transfer lost", XENO_HANDLE_KEY(e->buffer));
+        check_entry(cb, all, c, e->srcStageMask, e->srcAccessMask, e->dstStageMask, e->dstAccessMask,
+                    e->srcQueueFamilyIndex != e->dstQueueFamilyIndex, 0, XENO_HANDLE_KEY(e->buffer));
+    }
+    for (uint32_t i = 0; i < r->img_count; ++i) {
+        const VkImageMemoryBarrier2* e = &r->img[i];
+        int demoted = track_demotable(t, e), first = 1;
+        if (!demoted) track_image(t, e);
+        VkImageLayout last = e->newLayout;
+        for (uint32_t j = 0; j < r->img_count; ++j) {
+            if (r->img[j].image != e->image || !range_equal(&r->img[j].subresourceRange, &e->subresourceRange)) continue;
+            if (j < i) first = 0;
+            else last = r->img[j].newLayout;
+        }
+        br_cover_t c = global; const VkImageMemoryBarrier2* same = NULL;
+        for (uint32_t j = 0; j < h->img_count; ++j) {
+            const VkImageMemoryBarrier2* o = &h->img[j];
+            if (o->image != e->image || !range_contains(&o->subresourceRange, &e->subresourceRange)) continue;
+            COVER_ADD(c, o);
+            if (range_equal(&o->subresourceRange, &e->subresourceRange)) same = o;
+        }
+        if (image_moves(e)) {
+            if (!same || same->newLayout != last || (first && same->oldLayout != e->oldLayout && same->oldLayout != VK_IMAGE_LAYOUT_UNDEFINED) ||
+                same->srcQueueFamilyIndex != e->srcQueueFamilyIndex || same->dstQueueFamilyIndex != e->dstQueueFamilyIndex) {
+                mismatch(cb, "layout transition lost", XENO_HANDLE_KEY(e->image));
+                continue;
+            }
+            c.src = same->srcStageMask; c.dst = same->dstStageMask;     /* the transition happens in its own entry's scopes */
+        }
+        check_entry(cb, all, c, e->srcStageMask, e->srcAccessMask, e->dstStageMask, e->dstAccessMask, image_moves(e), demoted, XENO_HANDLE_KEY(e->image));
+    }
+    if (r->full) { t->full = 1; t->ran = 0; }
+    cb->n[BR_CHECKED]++;
+}
+#undef COVER_ADD
+
+/* the held batch goes out (or, validating, is checked against the calls it replaces) */
+static void flush(br_cb_t* cb) {
+    br_batch_t* h = &cb->held;
+    uint32_t size = batch_size(h);
+    if (!size && !(cb->ref && batch_size(cb->ref))) return;
+    if (size) {
+        held_narrow(cb);
+        if (cb->bd->sync2) held_subsume(cb);
+        cb->n[BR_DRIVER_CALLS]++; cb->n[BR_DRIVER_ENTRIES] += batch_size(h);
+    }
+    if (cb->ref) {
+        if (!cb->ref_lost) check(cb);
+        cb->ref_lost = 0;
+        cb->ref->mem_count = cb->ref->buf_count = cb->ref->img_count = 0; cb->ref->full = 0;
+    } else if (size) {
+        emit(cb);
+    }
+    if (h->full) { cb->track.full = 1; cb->track.ran = 0; }
+    h->mem_count = h->buf_count = h->img_count = 0; h->full = 0;
+}
+
+/* the reference call joins the calls behind the held batch */
+static void ref_add(br_cb_t* cb, const br_batch_t* b) {
+    br_batch_t* r = cb->ref;
+    if (r->mem_count + b->mem_count > BR_MAX_ENTRIES || r->buf_count + b->buf_count > BR_MAX_ENTRIES || r->img_count + b->img_count > BR_MAX_ENTRIES) { cb->ref_lost = 1; return; }
+    memcpy(r->mem + r->mem_count, b->mem, b->mem_count * sizeof(*b->mem)); r->mem_count += b->mem_count;
+    memcpy(r->buf + r->buf_count, b->buf, b->buf_count * sizeof(*b->buf)); r->buf_count += b->buf_count;
+    memcpy(r->img + r->img_count, b->img, b->img_count * sizeof(*b->img)); r->img_count += b->img_count;
+    for (uint32_t i = 0; i < b->mem_count; ++i) r->full |= !b->flags && !cb->in_pass && full_barrier(&b->mem[i]);
+}
+
+/* a barrier call in cb->in */
+static void barrier(br_cb_t* cb) {
+    br_batch_t* b = &cb->in;
+    cb->n[BR_CALLS]++; cb->n[BR_ENTRIES] += batch_size(b);
+    if (!cb->ref) {
+        batch_prepare(cb, b);
+        if (!cb->bd->merge || !held_accepts(cb, b)) flush(cb);
+        held_add(cb, b);
+    } else {
+        /* the reference calls behind a checked batch are the ones it replaces */
+        br_batch_t call = *b;
+        batch_prepare(cb, b);
+        if (!cb->bd->merge || !held_accepts(cb, b)) flush(cb);
+        held_add(cb, b);
+        ref_add(cb, &call);
+    }
+    if (!cb->bd->merge) flush(cb);
+}
+
+static inline br_cb_t* br_cb(VkCommandBuffer commandBuffer) { return xeno_map_get(&br_cbs, XENO_HANDLE_KEY(commandBuffer)); }
+/* every command doing work or synchronizing comes after the held barriers */
+static inline br_cb_t* br_action(VkCommandBuffer commandBuffer, VkPipelineStageFlags2 ran) {
+    br_cb_t* cb = br_cb(commandBuffer);
+    flush(cb);
+    cb->track.ran |= ran;
+    if (cb->ref_track) cb->ref_track->ran |= ran;
+    return cb;
+}
+static void forget_layouts(br_cb_t* cb, VkImage image) {
+    if (image) track_forget(&cb->track, image, NULL);
+    else cb->track.layout_count = 0;
+    if (cb->ref_track) {
+        if (image) track_forget(cb->ref_track, image, NULL);
+        else cb->ref_track->layout_count = 0;
+    }
+}
+
+/* --- barrier hooks --- */
+static VKAPI_ATTR void VKAPI_CALL br_vkCmdPipelineBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask,
+                                                         VkDependencyFlags dependencyFlags, uint32_t memoryBarrierCount, const VkMemoryBarrier* pMemoryBarriers,
+                                                         uint32_t bufferMemoryBarrierCount, const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+                                                         uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* pImageMemoryBarriers) {
+    br_cb_t* cb = br_cb(commandBuffer);
+    int ok = batch_legacy(&cb->in, srcStageMask, dstStageMask, dependencyFlags, memoryBarrierCount, pMemoryBarriers,
+                          bufferMemoryBarrierCount, pBufferMemoryBarriers, imageMemoryBarrierCount, pImageMemoryBarriers) == 0;
+    if (!ok || cb->ref) {
+        if (!ok) { flush(cb); cb->n[BR_PASSTHROUGH]++; }
+        cb->bd->next_vkCmdPipelineBarrier(commandBuffer, srcStageMask, dstStageMask, dependencyFlags, memoryBarrierCount, pMemoryBarriers,
+                                          bufferMemoryBarrierCount, pBufferMemoryBarriers, imageMemoryBarrierCount, pImageMemoryBarriers);
+        if (!ok) { for (uint32_t i = 0; i < imageMemoryBarrierCount; ++i) forget_layouts(cb, pImageMemoryBarriers[i].image); return; }
+    }
+    barrier(cb);
+}
+static VKAPI_ATTR void VKAPI_CALL br_vkCmdPipelineBarrier2(VkCommandBuffer commandBuffer, const VkDependencyInfo* pDependencyInfo) {
+    br_cb_t* cb = br_cb(commandBuffer);
+    int ok = cb->bd->sync2 && batch_sync2(&cb->in, pDependencyInfo) == 0;
+    if (!ok || cb->ref) {
+        if (!ok) { flush(cb); cb->n[BR_PASSTHROUGH]++; }
+        cb->bd->next_vkCmdPipelineBarrier2(commandBuffer, pDependencyInfo);
+        if (!ok) { for (uint32_t i = 0; i < pDependencyInfo->imageMemoryBarrierCount; ++i) forget_layouts(cb, pDependencyInfo->pImageMemoryBarriers[i].image); return; }
+    }
+    barrier(cb);
+}
+
+/* --- command buffer lifetime --- */
+static void cb_free(br_cb_t* cb) { free(cb->ref); free(cb->ref_track); free(cb); }
+
+static VKAPI_ATTR VkResult VKAPI_CALL br_vkAllocateCommandBuffers(VkDevice device, const VkCommandBufferAllocateInfo* pAllocateInfo, VkCommandBuffer* pCommandBuffers) {
+    xeno_barrier_device_t* bd = xeno_device_get(device)->barrier;
+    VkResult r = bd->next_vkAllocateCommandBuffers(device, pAllocateInfo, pCommandBuffers);
+    if (r != VK_SUCCESS) return r;
+    for (uint32_t i = 0; i < pAllocateInfo->commandBufferCount; ++i) {
+        br_cb_t* cb = calloc(1, sizeof(*cb));
+        if (cb && bd->validate && (!(cb->ref = calloc(1, sizeof(*cb->ref))) || !(cb->ref_track = calloc(1, sizeof(*cb->ref_track))))) { cb_free(cb); cb = NULL; }
+        if (!cb) {
+            while (i--) cb_free(xeno_map_remove(&br_cbs, XENO_HANDLE_KEY(pCommandBuffers[i])));
+            bd->next_vkFreeCommandBuffers(device, pAllocateInfo->commandPool, pAllocateInfo->commandBufferCount, pCommandBuffers);
+            for (uint32_t k = 0; k < pAllocateInfo->commandBufferCount; ++k) pCommandBuffers[k] = VK_NULL_HANDLE;
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        cb->bd = bd; cb->handle = pCommandBuffers[i]; cb->pool = pAllocateInfo->commandPool;
+        xeno_map_put(&br_cbs, XENO_HANDLE_KEY(cb->handle), cb);
+    }
+    return r;
+}
+static VKAPI_ATTR void VKAPI_CALL br_vkFreeCommandBuffers(VkDevice device, VkCommandPool commandPool, uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers) {
+    xeno_barrier_device_t* bd = xeno_device_get(device)->barrier;
+    for (uint32_t i = 0; i < commandBufferCount; ++i) {
+        if (!pCommandBuffers[i]) continue;
+        br_cb_t* cb = xeno_map_remove(&br_cbs, XENO_HANDLE_KEY(pCommandBuffers[i]));
+        if (cb) cb_free(cb);
+    }
+    bd->next_vkFreeCommandBuffers(device, commandPool, commandBufferCount, pCommandBuffers);
+}
+typedef struct br_walk { xeno_barrier_device_t* bd; VkCommandPool pool; } br_walk_t;
+static int free_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; br_cb_t* cb = val; br_walk_t* w = ctx;
+    if (cb->bd != w->bd || (w->pool && cb->pool != w->pool)) return 0;
+    cb_free(cb); return 1;
+}
+static VKAPI_ATTR void VKAPI_CALL br_vkDestroyCommandPool(VkDevice device, VkCommandPool commandPool, const VkAllocationCallbacks* pAllocator) {
+    xeno_barrier_device_t* bd = xeno_device_get(device)->barrier;
+    if (commandPool) { br_walk_t w = { bd, commandPool }; xeno_map_foreach(&br_cbs, free_walk_fn, &w); }
+    bd->next_vkDestroyCommandPool(device, commandPool, pAllocator);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL br_vkBeginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeginInfo* pBeginInfo) {
+    br_cb_t* cb = br_cb(commandBuffer);
+    /* a recording abandoned by a reset leaves nothing behind */
+    cb->held.mem_count = cb->held.buf_count = cb->held.img_count = 0; cb->held.full = 0;
+    track_reset(&cb->track);
+    cb->in_pass = pBeginInfo && (pBeginInfo->flags & VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+    if (cb->ref) { cb->ref->mem_count = cb->ref->buf_count = cb->ref->img_count = 0; cb->ref->full = 0; cb->ref_lost = 0; track_reset(cb->ref_track); }
+    memset(cb->n, 0, sizeof(cb->n));
+    return cb->bd->next_vkBeginCommandBuffer(commandBuffer, pBeginInfo);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL br_vkEndCommandBuffer(VkCommandBuffer commandBuffer) {
+    br_cb_t* cb = br_cb(commandBuffer);
+    xeno_barrier_device_t* bd = cb->bd;
+    flush(cb);
+    for (int k = 0; k < BR_COUNTERS; ++k)
+        if (cb->n[k]) atomic_fetch_add_explicit(&bd->n[k], cb->n[k], memory_order_relaxed);
+    memset(cb->n, 0, sizeof(cb->n));
+    atomic_fetch_add_explicit(&bd->recorded, 1, memory_order_relaxed);
+    return bd->next_vkEndCommandBuffer(commandBuffer);
+}
+static VKAPI_ATTR void VKAPI_CALL br_vkCmdExecuteCommands(VkCommandBuffer commandBuffer, uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers) {
+    br_cb_t* cb = br_action(commandBuffer, BR_RAN_ANY);
+    cb->bd->next_vkCmdExecuteCommands(commandBuffer, commandBufferCount, pCommandBuffers);
+    forget_layouts(cb, VK_NULL_HANDLE);   /* the secondaries may have moved any image */
+}
+
+/* --- commands the held barriers go out before --- */
+#define BR_ACTION(fn, ran, params, args) \
+    static VKAPI_ATTR void VKAPI_CALL br_##fn params { br_action(commandBuffer, ran)->bd->next_##fn args; }
+BR_ACTION(vkCmdDraw, BR_RAN_GRAPHICS, (VkCommandBuffer commandBuffer, uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance),
+          (commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance))
+BR_ACTION(vkCmdDrawIndexed, BR_RAN_GRAPHICS, (VkCommandBuffer commandBuffer, uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance),
+          (commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance))
+BR_ACTION(vkCmdDrawIndirect, BR_RAN_GRAPHICS, (VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride),
+          (commandBuffer, buffer, offset, drawCount, stride))
+BR_ACTION(vkCmdDrawIndexedIndirect, BR_RAN_GRAPHICS, (VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride),
+          (commandBuffer, buffer, offset, drawCount, stride))
+BR_ACTION(vkCmdDrawIndirectCount, BR_RAN_GRAPHICS, (VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride),
+          (commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride))
+BR_ACTION(vkCmdDrawIndexedIndirectCount, BR_RAN_GRAPHICS, (VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride),
+          (commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride))
+BR_ACTION(vkCmdDrawMeshTasksEXT, BR_RAN_GRAPHICS, (VkCommandBuffer commandBuffer, uint32_t x, uint32_t y, uint32_t z), (commandBuffer, x, y, z))
+BR_ACTION(vkCmdDispatch, BR_RAN_COMPUTE, (VkCommandBuffer commandBuffer, uint32_t x, uint32_t y, uint32_t z), (commandBuffer, x, y, z))
+BR_ACTION(vkCmdDispatchIndirect, BR_RAN_INDIRECT, (VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset), (commandBuffer, buffer, offset))
+BR_ACTION(vkCmdDispatchBase, BR_RAN_COMPUTE, (VkCommandBuffer commandBuffer, uint32_t baseX, uint32_t baseY, uint32_t baseZ, uint32_t x, uint32_t y, uint32_t z),
+          (commandBuffer, baseX, baseY, baseZ, x, y, z))
+BR_ACTION(vkCmdCopyBuffer, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, uint32_t regionCount, const VkBufferCopy* pRegions),
+          (commandBuffer, srcBuffer, dstBuffer, regionCount, pRegions))
+BR_ACTION(vkCmdCopyImage, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcImageLayout, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkImageCopy* pRegions),
+          (commandBuffer, srcImage, srcImageLayout, dstImage, dstImageLayout, regionCount, pRegions))
+BR_ACTION(vkCmdBlitImage, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcImageLayout, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkImageBlit* pRegions, VkFilter filter),
+          (commandBuffer, srcImage, srcImageLayout, dstImage, dstImageLayout, regionCount, pRegions, filter))
+BR_ACTION(vkCmdCopyBufferToImage, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkBufferImageCopy* pRegions),
+          (commandBuffer, srcBuffer, dstImage, dstImageLayout, regionCount, pRegions))
+BR_ACTION(vkCmdCopyImageToBuffer, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcImageLayout, VkBuffer dstBuffer, uint32_t regionCount, const VkBufferImageCopy* pRegions),
+          (commandBuffer, srcImage, srcImageLayout, dstBuffer, regionCount, pRegions))
+BR_ACTION(vkCmdUpdateBuffer, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize dataSize, const void* pData),
+          (commandBuffer, dstBuffer, dstOffset, dataSize, pData))
+BR_ACTION(vkCmdFillBuffer, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size, uint32_t data),
+          (commandBuffer, dstBuffer, dstOffset, size, data))
+BR_ACTION(vkCmdClearColorImage, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, VkImage image, VkImageLayout imageLayout, const VkClearColorValue* pColor, uint32_t rangeCount, const VkImageSubresourceRange* pRanges),
+          (commandBuffer, image, imageLayout, pColor, rangeCount, pRanges))
+BR_ACTION(vkCmdClearDepthStencilImage, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, VkImage image, VkImageLayout imageLayout, const VkClearDepthStencilValue* pDepthStencil, uint32_t rangeCount, const VkImageSubresourceRange* pRanges),
+          (commandBuffer, image, imageLayout, pDepthStencil, rangeCount, pRanges))
+BR_ACTION(vkCmdClearAttachments, BR_RAN_GRAPHICS, (VkCommandBuffer commandBuffer, uint32_t attachmentCount, const VkClearAttachment* pAttachments, uint32_t rectCount, const VkClearRect* pRects),
+          (commandBuffer, attachmentCount, pAttachments, rectCount, pRects))
+BR_ACTION(vkCmdResolveImage, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcImageLayout, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkImageResolve* pRegions),
+          (commandBuffer, srcImage, srcImageLayout, dstImage, dstImageLayout, regionCount, pRegions))
+BR_ACTION(vkCmdCopyBuffer2, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, const VkCopyBufferInfo2* pInfo), (commandBuffer, pInfo))
+BR_ACTION(vkCmdCopyImage2, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, const VkCopyImageInfo2* pInfo), (commandBuffer, pInfo))
+BR_ACTION(vkCmdBlitImage2, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, const VkBlitImageInfo2* pInfo), (commandBuffer, pInfo))
+BR_ACTION(vkCmdCopyBufferToImage2, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, const VkCopyBufferToImageInfo2* pInfo), (commandBuffer, pInfo))
+BR_ACTION(vkCmdCopyImageToBuffer2, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, const VkCopyImageToBufferInfo2* pInfo), (commandBuffer, pInfo))
+BR_ACTION(vkCmdResolveImage2, BR_RAN_TRANSFER, (VkCommandBuffer commandBuffer, const VkResolveImageInfo2* pInfo), (commandBuffer, pInfo))
+BR_ACTION(vkCmdSetEvent, BR_RAN_ANY, (VkCommandBuffer commandBuffer, VkEvent event, VkPipelineStageFlags stageMask), (commandBuffer, event, stageMask))
+BR_ACTION(vkCmdResetEvent, BR_RAN_ANY, (VkCommandBuffer commandBuffer, VkEvent event, VkPipelineStageFlags stageMask), (commandBuffer, event, stageMask))
+BR_ACTION(vkCmdResetEvent2, BR_RAN_ANY, (VkCommandBuffer commandBuffer, VkEvent event, VkPipelineStageFlags2 stageMask), (commandBuffer, event, stageMask))
+BR_ACTION(vkCmdBeginQuery, BR_RAN_ANY, (VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t query, VkQueryControlFlags flags), (commandBuffer, queryPool, query, flags))
+BR_ACTION(vkCmdEndQuery, BR_RAN_ANY, (VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t query), (commandBuffer, queryPool, query))
+BR_ACTION(vkCmdResetQueryPool, BR_RAN_ANY, (VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t firstQuery, uint32_t queryCount), (commandBuffer, queryPool, firstQuery, queryCount))
+BR_ACTION(vkCmdWriteTimestamp, BR_RAN_ANY, (VkCommandBuffer commandBuffer, VkPipelineStageFlagBits pipelineStage, VkQueryPool queryPool, uint32_t query),
+          (commandBuffer, pipelineStage, queryPool, query))
+BR_ACTION(vkCmdWriteTimestamp2, BR_RAN_ANY, (VkCommandBuffer commandBuffer, VkPipelineStageFlags2 stage, VkQueryPool queryPool, uint32_t query), (commandBuffer, stage, queryPool, query))
+BR_ACTION(vkCmdCopyQueryPoolResults, BR_RAN_ANY, (VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t firstQuery, uint32_t queryCount, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize stride, VkQueryResultFlags flags),
+          (commandBuffer, queryPool, firstQuery, queryCount, dstBuffer, dstOffset, stride, flags))
+#undef BR_ACTION
+
+/* render pass instances bound where barriers apply to a subpass; render pass objects also move
+ * their attachments between layouts (in_pass: 1 entering, 0 leaving, -1 staying) */
+#define BR_PASS(fn, layouts, pass, params, args) \
+    static VKAPI_ATTR void VKAPI_CALL br_##fn params { \
+        br_cb_t* cb = br_action(commandBuffer, BR_RAN_GRAPHICS); \
+        if (layouts) forget_layouts(cb, VK_NULL_HANDLE); \
+        if ((pass) >= 0) cb->in_pass = (pass); \
+        cb->bd->next_##fn args; }
+BR_PASS(vkCmdBeginRenderPass, 1, 1, (VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo* pRenderPassBegin, VkSubpassContents contents), (commandBuffer, pRenderPassBegin, contents))
+BR_PASS(vkCmdNextSubpass, 1, -1, (VkCommandBuffer commandBuffer, VkSubpassContents contents), (commandBuffer, contents))
+BR_PASS(vkCmdEndRenderPass, 1, 0, (VkCommandBuffer commandBuffer), (commandBuffer))
+BR_PASS(vkCmdBeginRenderPass2, 1, 1, (VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo* pRenderPassBegin, const VkSubpassBeginInfo* pSubpassBeginInfo),
+        (commandBuffer, pRenderPassBegin, pSubpassBeginInfo))
+BR_PASS(vkCmdNextSubpass2, 1, -1, (VkCommandBuffer commandBuffer, const VkSubpassBeginInfo* pSubpassBeginInfo, const VkSubpassEndInfo* pSubpassEndInfo),
+        (commandBuffer, pSubpassBeginInfo, pSubpassEndInfo))
+BR_PASS(vkCmdEndRenderPass2, 1, 0, (VkCommandBuffer commandBuffer, const VkSubpassEndInfo* pSubpassEndInfo), (commandBuffer, pSubpassEndInfo))
+BR_PASS(vkCmdBeginRendering, 0, 1, (VkCommandBuffer commandBuffer, const VkRenderingInfo* pRenderingInfo), (commandBuffer, pRenderingInfo))
+BR_PASS(vkCmdEndRendering, 0, 0, (VkCommandBuffer commandBuffer), (commandBuffer))
+#undef BR_PASS
+
+/* events carry dependencies of their own, with layout transitions on the wait side */
+static void forget_dependency(br_cb_t* cb, const VkDependencyInfo* d) {
+    for (uint32_t i = 0; i < d->imageMemoryBarrierCount; ++i) forget_layouts(cb, d->pImageMemoryBarriers[i].image);
+}
+static VKAPI_ATTR void VKAPI_CALL br_vkCmdSetEvent2(VkCommandBuffer commandBuffer, VkEvent event, const VkDependencyInfo* pDependencyInfo) {
+    br_cb_t* cb = br_action(commandBuffer, BR_RAN_ANY);
+    forget_dependency(cb, pDependencyInfo);
+    cb->bd->next_vkCmdSetEvent2(commandBuffer, event, pDependencyInfo);
+}
+static VKAPI_ATTR void VKAPI_CALL br_vkCmdWaitEvents(VkCommandBuffer commandBuffer, uint32_t eventCount, const VkEvent* pEvents, VkPipelineStageFlags srcStageMask,
+                                                    VkPipelineStageFlags dstStageMask, uint32_t memoryBarrierCount, const VkMemoryBarrier* pMemoryBarriers,
+                                                    uint32_t bufferMemoryBarrierCount, const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+                                                    uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* pImageMemoryBarriers) {
+    br_cb_t* cb = br_action(commandBuffer, BR_RAN_ANY);
+    for (uint32_t i = 0; i < imageMemoryBarrierCount; ++i) forget_layouts(cb, pImageMemoryBarriers[i].image);
+    cb->bd->next_vkCmdWaitEvents(commandBuffer, eventCount, pEvents, srcStageMask, dstStageMask, memoryBarrierCount, pMemoryBarriers,
+                                 bufferMemoryBarrierCount, pBufferMemoryBarriers, imageMemoryBarrierCount, pImageMemoryBarriers);
+}
+static VKAPI_ATTR void VKAPI_CALL br_vkCmdWaitEvents2(VkCommandBuffer commandBuffer, uint32_t eventCount, const VkEvent* pEvents, const VkDependencyInfo* pDependencyInfos) {
+    br_cb_t* cb = br_action(commandBuffer, BR_RAN_ANY);
+    for (uint32_t i = 0; i < eventCount; ++i) forget_dependency(cb, &pDependencyInfos[i]);
+    cb->bd->next_vkCmdWaitEvents2(commandBuffer, eventCount, pEvents, pDependencyInfos);
+}
+
+void xeno_barrier_flush(xeno_device_t* dev, VkCommandBuffer commandBuffer) {
+    br_cb_t* cb;
+    if (!dev->barrier || !(cb = br_cb(commandBuffer))) return;
+    flush(cb);
+    cb->track.ran |= BR_RAN_ANY;
+    if (cb->ref_track) cb->ref_track->ran |= BR_RAN_ANY;
+}
+
+/* --- device lifetime / routing --- */
+static PFN_vkVoidFunction resolve(xeno_device_t* dev, const char* name) {
+    PFN_vkVoidFunction fn = xeno_device_module_proc(dev, name);
+    for (size_t i = 0; !fn && i < BR_ALIAS_COUNT; ++i)
+        if (strcmp(br_aliases[i].name, name) == 0) fn = xeno_device_module_proc(dev, br_aliases[i].alias);
+    return fn;
+}
+
+int xeno_barrier_init(xeno_device_t* dev) {
+    if (!xeno_env_bool("XCLIPSE_BARRIER_OPT", 0)) return 0;
+    pthread_once(&br_cbs_once, br_cbs_init);
+    xeno_barrier_device_t* bd = calloc(1, sizeof(*bd)); if (!bd) return -1;
+    bd->dev = dev;
+#define BR_RESOLVE(fn) bd->next_##fn = (PFN_##fn)resolve(dev, #fn);
+    BR_HOOKS(BR_RESOLVE)
+#undef BR_RESOLVE
+    if (!bd->next_vkAllocateCommandBuffers || !bd->next_vkFreeCommandBuffers || !bd->next_vkDestroyCommandPool || !bd->next_vkBeginCommandBuffer ||
+        !bd->next_vkEndCommandBuffer || !bd->next_vkCmdExecuteCommands || !bd->next_vkCmdPipelineBarrier) { free(bd); return -1; }
+    bd->sync2 = dev->sync2 && bd->next_vkCmdPipelineBarrier2;
+    bd->validate = xeno_env_bool("XCLIPSE_BARRIER_VALIDATE", 0);
+    bd->merge = xeno_env_bool("XCLIPSE_BARRIER_MERGE", 1);
+    bd->narrow = xeno_env_bool("XCLIPSE_BARRIER_NARROW", 1);
+    for (size_t i = 0; i < sizeof(br_unseen) / sizeof(br_unseen[0]); ++i) {
+        if (!xeno_device_module_proc(dev, br_unseen[i])) continue;
+        if (bd->merge || bd->narrow) xlog("barrier: %s bypasses the layer, barriers are neither merged nor narrowed", br_unseen[i]);
+        bd->merge = bd->narrow = 0;
+    }
+    dev->barrier = bd;
+    xlog("barrier: %s%s barriers%s through %s", bd->validate ? "validating " : "", bd->merge ? "merging" : "eliding",
+         bd->narrow ? ", narrowing source scopes" : "", bd->sync2 ? "vkCmdPipelineBarrier2" : "vkCmdPipelineBarrier");
+    return 0;
+}
+
+static int device_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; br_cb_t* cb = val;
+    if (cb->bd != ctx) return 0;
+    cb_free(cb); return 1;
+}
+
+void xeno_barrier_destroy(xeno_device_t* dev) {
+    xeno_barrier_device_t* bd = dev->barrier;
+    if (!bd) return;
+    xeno_map_foreach(&br_cbs, device_walk_fn, bd);   /* command buffers of pools the app leaked */
+    dev->barrier = NULL;
+    free(bd);
+}
+
+PFN_vkVoidFunction xeno_barrier_proc(xeno_device_t* dev, const char* name) {
+    xeno_barrier_device_t* bd = dev->barrier;
+    if (!bd || strncmp(name, "vkCmd", 5) != 0) {
+        if (!bd || strncmp(name, "vk", 2) != 0) return NULL;
+#define BR_PROC(fn) if (strcmp(name, #fn) == 0) return (PFN_vkVoidFunction)br_##fn;
+        BR_PROC(vkAllocateCommandBuffers) BR_PROC(vkFreeCommandBuffers) BR_PROC(vkDestroyCommandPool)
+        BR_PROC(vkBeginCommandBuffer) BR_PROC(vkEndCommandBuffer)
+#undef BR_PROC
+        return NULL;
+    }
+    for (size_t i = 0; i < BR_ALIAS_COUNT; ++i)
+        if (strcmp(name, br_aliases[i].alias) == 0) { name = br_aliases[i].name; break; }
+#define BR_PROC(fn) if (bd->next_##fn && strcmp(name, #fn) == 0) return (PFN_vkVoidFunction)br_##fn;
+    BR_HOOKS(BR_PROC)
+#undef BR_PROC
+    return NULL;
+}
+
+void xeno_barrier_report(FILE* f, xeno_device_t* dev) {
+    xeno_barrier_device_t* bd = dev->barrier;
+    fprintf(f, "  \"barrier\": {\"enabled\": %s", bd ? "true" : "false");
+    if (bd) {
+        uint64_t n[BR_COUNTERS], frames = atomic_load(&dev->frames);
+        fprintf(f, ", \"mode\": \"%s\", \"merge\": %s, \"narrow\": %s, \"sync2\": %s", bd->validate ? "validate" : "optimize",
+                bd->merge ? "true" : "false", bd->narrow ? "true" : "false", bd->sync2 ? "true" : "false");
+        for (int k = 0; k < BR_COUNTERS; ++k) {
+            n[k] = atomic_load(&bd->n[k]);
+            fprintf(f, ", \"%s\": %" PRIu64, br_counter_names[k], n[k]);
+        }
+        fprintf(f, ", \"command_buffers\": %" PRIu64 ", \"frames\": %" PRIu64 ", \"calls_per_frame\": %.1f, \"driver_calls_per_frame\": %.1f, \"driver_calls_pct\": %.1f",
+                atomic_load(&bd->recorded), frames, frames ? (double)n[BR_CALLS] / (double)frames : 0.0,
+                frames ? (double)n[BR_DRIVER_CALLS] / (double)frames : 0.0, n[BR_CALLS] ? 100.0 * (double)n[BR_DRIVER_CALLS] / (double)n[BR_CALLS] : 0.0);
+    }
+    fprintf(f, "}");
+}
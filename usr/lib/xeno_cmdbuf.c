@@ -0,0 +1,359 @@
+/* xeno_cmdbuf.c - per-command-buffer state tracking for the wrapper's vkCmd* intercepts
+ *
+ * Every intercepted command buffer gets an xeno_cb_t holding a shadow copy of the dynamic state,
+ * the current dynamic-rendering formats and the pipeline / shader objects bound by the app.
+ * Dynamic state setters the driver lacks are recorded but not forwarded; emulation modules bake
+ * them into pipeline variants at draw time.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "xeno_internal.h"
+
+static xeno_map_t cbs;
+static pthread_once_t cbs_once = PTHREAD_ONCE_INIT;
+static void cbs_init(void) { xeno_map_init(&cbs, 4096); }
+
+xeno_cb_t* xeno_cb_get(VkCommandBuffer cb) { return xeno_map_get(&cbs, XENO_HANDLE_KEY(cb)); }
+
+void xeno_cb_own_pipeline(xeno_cb_t* cb, VkPipeline pipeline) {
+    if (cb->owned_count == cb->owned_cap) {
+        uint32_t cap = cb->owned_cap ? cb->owned_cap * 2 : 8;
+        VkPipeline* p = realloc(cb->owned, cap * sizeof(VkPipeline));
+        if (!p) { xlog("cmdbuf: cannot track owned pipeline, leaking it"); return; }
+        cb->owned = p; cb->owned_cap = cap;
+    }
+    cb->owned[cb->owned_count++] = pipeline;
+}
+
+static void cb_reset_state(xeno_cb_t* cb) {
+    for (uint32_t i = 0; i < cb->owned_count; ++i) cb->dev->vk.vkDestroyPipeline(cb->dev->handle, cb->owned[i], NULL);
+    cb->owned_count = 0;
+    memset(&cb->dyn, 0, sizeof(cb->dyn)); cb->dyn_set = 0; cb->dyn_dirty = 0;
+    memset(&cb->rf, 0, sizeof(cb->rf)); cb->in_rendering = 0;
+    cb->app_pipeline[0] = cb->app_pipeline[1] = VK_NULL_HANDLE; cb->state_clobbered = 0;
+    memset(cb->so_stage, 0, sizeof(cb->so_stage)); cb->so_active = 0; cb->so_dirty = 1; cb->so_pipeline = VK_NULL_HANDLE;
+    cb->emu = NULL; cb->emu_pipeline = VK_NULL_HANDLE;
+    cb->epoch = 0;
+}
+static void cb_free(xeno_cb_t* cb) { cb_reset_state(cb); free(cb->owned); free(cb); }
+
+/* --- lifetime --- */
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkAllocateCommandBuffers(VkDevice device, const VkCommandBufferAllocateInfo* pAllocateInfo, VkCommandBuffer* pCommandBuffers) {
+    xeno_device_t* dev = xeno_device_get(device);
+    VkResult r = dev->vk.vkAllocateCommandBuffers(device, pAllocateInfo, pCommandBuffers);
+    if (r != VK_SUCCESS) return r;
+    for (uint32_t i = 0; i < pAllocateInfo->commandBufferCount; ++i) {
+        xeno_cb_t* cb = calloc(1, sizeof(*cb)); if (!cb) continue;
+        cb->handle = pCommandBuffers[i]; cb->dev = dev; cb->pool = pAllocateInfo->commandPool; cb->level = pAllocateInfo->level;
+        cb->so_dirty = 1;
+        xeno_map_put(&cbs, XENO_HANDLE_KEY(cb->handle), cb);
+    }
+    return r;
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkFreeCommandBuffers(VkDevice device, VkCommandPool commandPool, uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers) {
+    xeno_device_t* dev = xeno_device_get(device);
+    for (uint32_t i = 0; i < commandBufferCount; ++i) {
+        if (!pCommandBuffers[i]) continue;
+        xeno_cb_t* cb = xeno_map_remove(&cbs, XENO_HANDLE_KEY(pCommandBuffers[i]));
+        if (cb) cb_free(cb);
+    }
+    dev->vk.vkFreeCommandBuffers(device, commandPool, commandBufferCount, pCommandBuffers);
+}
+typedef struct pool_walk { VkCommandPool pool; xeno_device_t* dev; int destroy; } pool_walk_t;
+static int pool_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; xeno_cb_t* cb = val; pool_walk_t* w = ctx;
+    if (cb->dev != w->dev || (w->pool && cb->pool != w->pool)) return 0;
+    if (w->destroy) { cb_free(cb); return 1; }
+    cb_reset_state(cb); return 0;
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkDestroyCommandPool(VkDevice device, VkCommandPool commandPool, const VkAllocationCallbacks* pAllocator) {
+    xeno_device_t* dev = xeno_device_get(device);
+    if (commandPool) { pool_walk_t w = { commandPool, dev, 1 }; xeno_map_foreach(&cbs, pool_walk_fn, &w); }
+    dev->vk.vkDestroyCommandPool(device, commandPool, pAllocator);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkResetCommandPool(VkDevice device, VkCommandPool commandPool, VkCommandPoolResetFlags flags) {
+    xeno_device_t* dev = xeno_device_get(device);
+    VkResult r = dev->vk.vkResetCommandPool(device, commandPool, flags);
+    if (r == VK_SUCCESS) { pool_walk_t w = { commandPool, dev, 0 }; xeno_map_foreach(&cbs, pool_walk_fn, &w); }
+    return r;
+}
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkBeginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeginInfo* pBeginInfo) {
+    xeno_cb_t* cb = xeno_cb_get(commandBuffer);
+    if (!cb) return VK_ERROR_INITIALIZATION_FAILED;
+    cb_reset_state(cb);
+    cb->epoch = atomic_fetch_add(&cb->dev->cb_epoch, 1) + 1;
+    if (cb->level == VK_COMMAND_BUFFER_LEVEL_SECONDARY && pBeginInfo->pInheritanceInfo &&
+        (pBeginInfo->flags & VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT)) {
+        for (const VkBaseInStructure* s = pBeginInfo->pInheritanceInfo->pNext; s; s = s->pNext) {
+            if (s->sType != VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO) continue;
+            const VkCommandBufferInheritanceRenderingInfo* ri = (const VkCommandBufferInheritanceRenderingInfo*)s;
+            cb->rf.view_mask = ri->viewMask;
+            cb->rf.color_count = ri->colorAttachmentCount < XENO_MAX_COLOR_ATTACHMENTS ? ri->colorAttachmentCount : XENO_MAX_COLOR_ATTACHMENTS;
+            for (uint32_t i = 0; i < cb->rf.color_count; ++i) cb->rf.color[i] = ri->pColorAttachmentFormats[i];
+            cb->rf.depth = ri->depthAttachmentFormat; cb->rf.stencil = ri->stencilAttachmentFormat;
+            cb->in_rendering = 1;
+        }
+    }
+    return cb->dev->vk.vkBeginCommandBuffer(commandBuffer, pBeginInfo);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkResetCommandBuffer(VkCommandBuffer commandBuffer, VkCommandBufferResetFlags flags) {
+    xeno_cb_t* cb = xeno_cb_get(commandBuffer);
+    if (!cb) return VK_ERROR_INITIALIZATION_FAILED;
+    VkResult r = cb->dev->vk.vkResetCommandBuffer(commandBuffer, flags);
+    if (r == VK_SUCCESS) cb_reset_state(cb);
+    return r;
+}
+
+/* --- binds / rendering --- */
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdBindPipeline(VkCommandBuffer commandBuffer, VkPipelineBindPoint pipelineBindPoint, VkPipeline pipeline) {
+    xeno_cb_t* cb = xeno_cb_get(commandBuffer);
+    if (pipelineBindPoint == VK_PIPELINE_BIND_POINT_GRAPHICS) {
+        cb->app_pipeline[0] = pipeline; cb->state_clobbered = 1;
+        /* a bound pipeline replaces every bound graphics shader object */
+        memset(cb->so_stage, 0, sizeof(cb->so_stage)); cb->so_active = 0; cb->so_pipeline = VK_NULL_HANDLE;
+        cb->emu = cb->dev->dyn_emu ? xeno_dyn_emu_lookup(cb->dev, pipeline) : NULL;
+        cb->emu_pipeline = pipeline;
+        if (cb->emu) cb->dyn_dirty |= cb->dev->dyn_emulated; /* earlier state applies to the new pipeline */
+    } else if (pipelineBindPoint == VK_PIPELINE_BIND_POINT_COMPUTE) {
+        cb->app_pipeline[1] = pipeline;
+    }
+    cb->dev->vk.vkCmdBindPipeline(commandBuffer, pipelineBindPoint, pipeline);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdBeginRendering(VkCommandBuffer commandBuffer, const VkRenderingInfo* pRenderingInfo) {
+    xeno_cb_t* cb = xeno_cb_get(commandBuffer);
+    xeno_render_formats_t rf; memset(&rf, 0, sizeof(rf));
+    rf.view_mask = pRenderingInfo->viewMask;
+    rf.color_count = pRenderingInfo->colorAttachmentCount < XENO_MAX_COLOR_ATTACHMENTS ? pRenderingInfo->colorAttachmentCount : XENO_MAX_COLOR_ATTACHMENTS;
+    for (uint32_t i = 0; i < rf.color_count; ++i) {
+        xeno_view_t* v = pRenderingInfo->pColorAttachments[i].imageView ? xeno_view_get(pRenderingInfo->pColorAttachments[i].imageView) : NULL;
+        rf.color[i] = v ? v->format : VK_FORMAT_UNDEFINED;
+    }
+    if (pRenderingInfo->pDepthAttachment && pRenderingInfo->pDepthAttachment->imageView) {
+        xeno_view_t* v = xeno_view_get(pRenderingInfo->pDepthAttachment->imageView); rf.depth = v ? v->format : VK_FORMAT_UNDEFINED;
+    }
+    if (pRenderingInfo->pStencilAttachment && pRenderingInfo->pStencilAttachment->imageView) {
+        xeno_view_t* v = xeno_view_get(pRenderingInfo->pStencilAttachment->imageView); rf.stencil = v ? v->format : VK_FORMAT_UNDEFINED;
+    }
+    if (memcmp(&rf, &cb->rf, sizeof(rf)) != 0) { cb->rf = rf; cb->so_dirty = 1; }
+    cb->in_rendering = 1;
+    cb->dev->vk.vkCmdBeginRendering(commandBuffer, pRenderingInfo);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdEndRendering(VkCommandBuffer commandBuffer) {
+    xeno_cb_t* cb = xeno_cb_get(commandBuffer);
+    cb->in_rendering = 0;
+    cb->dev->vk.vkCmdEndRendering(commandBuffer);
+}
+
+/* one past the last of count entries from first, clamped to max */
+static uint32_t dyn_end(uint32_t first, uint32_t count, uint32_t max) {
+    return first < max && count <= max - first ? first + count : max;
+}
+
+/* --- dynamic state setters: record, then forward when the driver has the entrypoint --- */
+#define DYN_BEGIN(name) \
+    xeno_cb_t* cb = xeno_cb_get(commandBuffer); xeno_dyn_state_t* s = &cb->dyn; \
+    const xeno_dispatch_t* vk = &cb->dev->vk; (void)s; (void)vk; \
+    cb->dyn_set |= XENO_DYN_BIT(name); cb->dyn_dirty |= XENO_DYN_BIT(name);
+
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetViewport(VkCommandBuffer commandBuffer, uint32_t firstViewport, uint32_t viewportCount, const VkViewport* pViewports) {
+    DYN_BEGIN(VIEWPORT)
+    for (uint32_t i = 0; i < viewportCount && firstViewport + i < XENO_MAX_VIEWPORTS; ++i) s->viewports[firstViewport + i] = pViewports[i];
+    uint32_t end = dyn_end(firstViewport, viewportCount, XENO_MAX_VIEWPORTS);
+    if (end > s->viewport_count) s->viewport_count = end;
+    vk->vkCmdSetViewport(commandBuffer, firstViewport, viewportCount, pViewports);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetScissor(VkCommandBuffer commandBuffer, uint32_t firstScissor, uint32_t scissorCount, const VkRect2D* pScissors) {
+    DYN_BEGIN(SCISSOR)
+    for (uint32_t i = 0; i < scissorCount && firstScissor + i < XENO_MAX_VIEWPORTS; ++i) s->scissors[firstScissor + i] = pScissors[i];
+    uint32_t end = dyn_end(firstScissor, scissorCount, XENO_MAX_VIEWPORTS);
+    if (end > s->scissor_count) s->scissor_count = end;
+    vk->vkCmdSetScissor(commandBuffer, firstScissor, scissorCount, pScissors);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetLineWidth(VkCommandBuffer commandBuffer, float lineWidth) {
+    DYN_BEGIN(LINE_WIDTH) s->line_width = lineWidth; vk->vkCmdSetLineWidth(commandBuffer, lineWidth);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetDepthBias(VkCommandBuffer commandBuffer, float c, float clamp, float slope) {
+    DYN_BEGIN(DEPTH_BIAS) s->depth_bias[0] = c; s->depth_bias[1] = clamp; s->depth_bias[2] = slope; vk->vkCmdSetDepthBias(commandBuffer, c, clamp, slope);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetBlendConstants(VkCommandBuffer commandBuffer, const float blendConstants[4]) {
+    DYN_BEGIN(BLEND_CONSTANTS) memcpy(s->blend_constants, blendConstants, sizeof(s->blend_constants)); vk->vkCmdSetBlendConstants(commandBuffer, blendConstants);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetDepthBounds(VkCommandBuffer commandBuffer, float minDepthBounds, float maxDepthBounds) {
+    DYN_BEGIN(DEPTH_BOUNDS) s->depth_bounds[0] = minDepthBounds; s->depth_bounds[1] = maxDepthBounds; vk->vkCmdSetDepthBounds(commandBuffer, minDepthBounds, maxDepthBounds);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetStencilCompareMask(VkCommandBuffer commandBuffer, VkStencilFaceFlags faceMask, uint32_t v) {
+    DYN_BEGIN(STENCIL_COMPARE_MASK)
+    if (faceMask & VK_STENCIL_FACE_FRONT_BIT) s->stencil_compare[0] = v;
+    if (faceMask & VK_STENCIL_FACE_BACK_BIT) s->stencil_compare[1] = v;
+    vk->vkCmdSetStencilCompareMask(commandBuffer, faceMask, v);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetStencilWriteMask(VkCommandBuffer commandBuffer, VkStencilFaceFlags faceMask, uint32_t v) {
+    DYN_BEGIN(STENCIL_WRITE_MASK)
+    if (faceMask & VK_STENCIL_FACE_FRONT_BIT) s->stencil_write[0] = v;
+    if (faceMask & VK_STENCIL_FACE_BACK_BIT) s->stencil_write[1] = v;
+    vk->vkCmdSetStencilWriteMask(commandBuffer, faceMask, v);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetStencilReference(VkCommandBuffer commandBuffer, VkStencilFaceFlags faceMask, uint32_t v) {
+    DYN_BEGIN(STENCIL_REFERENCE)
+    if (faceMask & VK_STENCIL_FACE_FRONT_BIT) s->stencil_ref[0] = v;
+    if (faceMask & VK_STENCIL_FACE_BACK_BIT) s->stencil_ref[1] = v;
+    vk->vkCmdSetStencilReference(commandBuffer, faceMask, v);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetViewportWithCount(VkCommandBuffer commandBuffer, uint32_t viewportCount, const VkViewport* pViewports) {
+    DYN_BEGIN(VIEWPORT_WITH_COUNT)
+    s->viewport_count = viewportCount < XENO_MAX_VIEWPORTS ? viewportCount : XENO_MAX_VIEWPORTS;
+    memcpy(s->viewports, pViewports, s->viewport_count * sizeof(VkViewport));
+    if (vk->vkCmdSetViewportWithCount) vk->vkCmdSetViewportWithCount(commandBuffer, viewportCount, pViewports);
+    else { cb->dyn_set |= XENO_DYN_BIT(VIEWPORT); vk->vkCmdSetViewport(commandBuffer, 0, viewportCount, pViewports); }
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetScissorWithCount(VkCommandBuffer commandBuffer, uint32_t scissorCount, const VkRect2D* pScissors) {
+    DYN_BEGIN(SCISSOR_WITH_COUNT)
+    s->scissor_count = scissorCount < XENO_MAX_VIEWPORTS ? scissorCount : XENO_MAX_VIEWPORTS;
+    memcpy(s->scissors, pScissors, s->scissor_count * sizeof(VkRect2D));
+    if (vk->vkCmdSetScissorWithCount) vk->vkCmdSetScissorWithCount(commandBuffer, scissorCount, pScissors);
+    else { cb->dyn_set |= XENO_DYN_BIT(SCISSOR); vk->vkCmdSetScissor(commandBuffer, 0, scissorCount, pScissors); }
+}
+#define DYN_SCALAR(fn, name, type, field) \
+    static VKAPI_ATTR void VKAPI_CALL xeno_##fn(VkCommandBuffer commandBuffer, type value) { \
+        DYN_BEGIN(name) s->field = (uint32_t)value; if (vk->fn) vk->fn(commandBuffer, value); }
+DYN_SCALAR(vkCmdSetCullMode, CULL_MODE, VkCullModeFlags, cull_mode)
+DYN_SCALAR(vkCmdSetFrontFace, FRONT_FACE, VkFrontFace, front_face)
+DYN_SCALAR(vkCmdSetPrimitiveTopology, PRIMITIVE_TOPOLOGY, VkPrimitiveTopology, topology)
+DYN_SCALAR(vkCmdSetDepthTestEnable, DEPTH_TEST_ENABLE, VkBool32, depth_test)
+DYN_SCALAR(vkCmdSetDepthWriteEnable, DEPTH_WRITE_ENABLE, VkBool32, depth_write)
+DYN_SCALAR(vkCmdSetDepthCompareOp, DEPTH_COMPARE_OP, VkCompareOp, depth_compare)
+DYN_SCALAR(vkCmdSetDepthBoundsTestEnable, DEPTH_BOUNDS_TEST_ENABLE, VkBool32, depth_bounds_test)
+DYN_SCALAR(vkCmdSetStencilTestEnable, STENCIL_TEST_ENABLE, VkBool32, stencil_test)
+DYN_SCALAR(vkCmdSetRasterizerDiscardEnable, RASTERIZER_DISCARD_ENABLE, VkBool32, rasterizer_discard)
+DYN_SCALAR(vkCmdSetDepthBiasEnable, DEPTH_BIAS_ENABLE, VkBool32, depth_bias_enable)
+DYN_SCALAR(vkCmdSetPrimitiveRestartEnable, PRIMITIVE_RESTART_ENABLE, VkBool32, primitive_restart)
+DYN_SCALAR(vkCmdSetPatchControlPointsEXT, PATCH_CONTROL_POINTS, uint32_t, patch_control_points)
+DYN_SCALAR(vkCmdSetLogicOpEXT, LOGIC_OP, VkLogicOp, logic_op)
+DYN_SCALAR(vkCmdSetDepthClampEnableEXT, DEPTH_CLAMP_ENABLE, VkBool32, depth_clamp)
+DYN_SCALAR(vkCmdSetPolygonModeEXT, POLYGON_MODE, VkPolygonMode, polygon_mode)
+DYN_SCALAR(vkCmdSetRasterizationSamplesEXT, RASTERIZATION_SAMPLES, VkSampleCountFlagBits, rasterization_samples)
+DYN_SCALAR(vkCmdSetAlphaToCoverageEnableEXT, ALPHA_TO_COVERAGE_ENABLE, VkBool32, alpha_to_coverage)
+DYN_SCALAR(vkCmdSetAlphaToOneEnableEXT, ALPHA_TO_ONE_ENABLE, VkBool32, alpha_to_one)
+DYN_SCALAR(vkCmdSetLogicOpEnableEXT, LOGIC_OP_ENABLE, VkBool32, logic_op_enable)
+#undef DYN_SCALAR
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetStencilOp(VkCommandBuffer commandBuffer, VkStencilFaceFlags faceMask, VkStencilOp failOp, VkStencilOp passOp, VkStencilOp depthFailOp, VkCompareOp compareOp) {
+    DYN_BEGIN(STENCIL_OP)
+    xeno_stencil_ops_t o = { failOp, passOp, depthFailOp, compareOp };
+    if (faceMask & VK_STENCIL_FACE_FRONT_BIT) s->stencil_op[0] = o;
+    if (faceMask & VK_STENCIL_FACE_BACK_BIT) s->stencil_op[1] = o;
+    if (vk->vkCmdSetStencilOp) vk->vkCmdSetStencilOp(commandBuffer, faceMask, failOp, passOp, depthFailOp, compareOp);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetSampleMaskEXT(VkCommandBuffer commandBuffer, VkSampleCountFlagBits samples, const VkSampleMask* pSampleMask) {
+    DYN_BEGIN(SAMPLE_MASK)
+    s->sample_mask = pSampleMask ? pSampleMask[0] : ~0u; s->sample_mask_samples = samples;
+    if (vk->vkCmdSetSampleMaskEXT) vk->vkCmdSetSampleMaskEXT(commandBuffer, samples, pSampleMask);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetColorBlendEnableEXT(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count, const VkBool32* pEnables) {
+    DYN_BEGIN(COLOR_BLEND_ENABLE)
+    for (uint32_t i = 0; i < count && first + i < XENO_MAX_COLOR_ATTACHMENTS; ++i) s->blend_enable[first + i] = pEnables[i];
+    uint32_t end = dyn_end(first, count, XENO_MAX_COLOR_ATTACHMENTS);
+    if (end > s->blend_enable_count) s->blend_enable_count = end;
+    if (vk->vkCmdSetColorBlendEnableEXT) vk->vkCmdSetColorBlendEnableEXT(commandBuffer, first, count, pEnables);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetColorBlendEquationEXT(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count, const VkColorBlendEquationEXT* pEquations) {
+    DYN_BEGIN(COLOR_BLEND_EQUATION)
+    for (uint32_t i = 0; i < count && first + i < XENO_MAX_COLOR_ATTACHMENTS; ++i) s->blend_eq[first + i] = pEquations[i];
+    uint32_t end = dyn_end(first, count, XENO_MAX_COLOR_ATTACHMENTS);
+    if (end > s->blend_eq_count) s->blend_eq_count = end;
+    if (vk->vkCmdSetColorBlendEquationEXT) vk->vkCmdSetColorBlendEquationEXT(commandBuffer, first, count, pEquations);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetColorWriteMaskEXT(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count, const VkColorComponentFlags* pMasks) {
+    DYN_BEGIN(COLOR_WRITE_MASK)
+    for (uint32_t i = 0; i < count && first + i < XENO_MAX_COLOR_ATTACHMENTS; ++i) s->write_mask[first + i] = pMasks[i];
+    uint32_t end = dyn_end(first, count, XENO_MAX_COLOR_ATTACHMENTS);
+    if (end > s->write_mask_count) s->write_mask_count = end;
+    if (vk->vkCmdSetColorWriteMaskEXT) vk->vkCmdSetColorWriteMaskEXT(commandBuffer, first, count, pMasks);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdSetVertexInputEXT(VkCommandBuffer commandBuffer, uint32_t bindingCount, const VkVertexInputBindingDescription2EXT* pBindings,
+                                                             uint32_t attributeCount, const VkVertexInputAttributeDescription2EXT* pAttributes) {
+    DYN_BEGIN(VERTEX_INPUT)
+    s->vertex_binding_count = bindingCount < XENO_MAX_VERTEX_BINDINGS ? bindingCount : XENO_MAX_VERTEX_BINDINGS;
+    s->vertex_attribute_count = attributeCount < XENO_MAX_VERTEX_ATTRIBUTES ? attributeCount : XENO_MAX_VERTEX_ATTRIBUTES;
+    for (uint32_t i = 0; i < s->vertex_binding_count; ++i) {
+        xeno_vertex_binding_t b = { pBindings[i].binding, pBindings[i].stride, pBindings[i].inputRate, pBindings[i].divisor };
+        s->vertex_bindings[i] = b;
+    }
+    for (uint32_t i = 0; i < s->vertex_attribute_count; ++i) {
+        xeno_vertex_attribute_t a = { pAttributes[i].location, pAttributes[i].binding, pAttributes[i].format, pAttributes[i].offset };
+        s->vertex_attributes[i] = a;
+    }
+    if (vk->vkCmdSetVertexInputEXT) vk->vkCmdSetVertexInputEXT(commandBuffer, bindingCount, pBindings, attributeCount, pAttributes);
+}
+#undef DYN_BEGIN
+
+/* --- draws: resolve emulated state into a concrete pipeline first --- */
+static inline xeno_cb_t* before_draw(VkCommandBuffer commandBuffer) {
+    xeno_cb_t* cb = xeno_cb_get(commandBuffer);
+    if (cb->so_active) xeno_shader_object_prepare_draw(cb);
+    else if (cb->emu) xeno_dyn_emu_prepare_draw(cb);
+    return cb;
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdDraw(VkCommandBuffer commandBuffer, uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) {
+    before_draw(commandBuffer)->dev->vk.vkCmdDraw(commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdDrawIndexed(VkCommandBuffer commandBuffer, uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance) {
+    before_draw(commandBuffer)->dev->vk.vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdDrawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride) {
+    before_draw(commandBuffer)->dev->vk.vkCmdDrawIndirect(commandBuffer, buffer, offset, drawCount, stride);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdDrawIndexedIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride) {
+    before_draw(commandBuffer)->dev->vk.vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset, drawCount, stride);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdDrawIndirectCount(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride) {
+    before_draw(commandBuffer)->dev->vk.vkCmdDrawIndirectCount(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdDrawIndexedIndirectCount(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride) {
+    before_draw(commandBuffer)->dev->vk.vkCmdDrawIndexedIndirectCount(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdDrawMeshTasksEXT(VkCommandBuffer commandBuffer, uint32_t x, uint32_t y, uint32_t z) {
+    before_draw(commandBuffer)->dev->vk.vkCmdDrawMeshTasksEXT(commandBuffer, x, y, z);
+}
+
+int xeno_cmdbuf_device_init(xeno_device_t* dev) { (void)dev; pthread_once(&cbs_once, cbs_init); return 0; }
+
+static int device_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; xeno_cb_t* cb = val;
+    if (cb->dev != ctx) return 0;
+    cb_free(cb); return 1;
+}
+void xeno_cmdbuf_device_destroy(xeno_device_t* dev) { xeno_map_foreach(&cbs, device_walk_fn, dev); }
+
+typedef struct epoch_walk { xeno_device_t* dev; uint64_t min; } epoch_walk_t;
+static int epoch_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; xeno_cb_t* cb = val; epoch_walk_t* w = ctx;
+    if (cb->dev == w->dev && cb->epoch && cb->epoch < w->min) w->min = cb->epoch;
+    return 0;
+}
+uint64_t xeno_cmdbuf_min_epoch(xeno_device_t* dev) {
+    epoch_walk_t w = { dev, UINT64_MAX };
+    xeno_map_foreach(&cbs, epoch_walk_fn, &w);
+    return w.min;
+}
+
+PFN_vkVoidFunction xeno_cmdbuf_proc(xeno_device_t* dev, const char* name) {
+    if (!dev->so && !dev->dyn_emu) return NULL;
+    if (strncmp(name, "vk", 2) != 0) return NULL;
+#define HOOK(fn) if (strcmp(name, #fn) == 0) return (PFN_vkVoidFunction)xeno_##fn;
+    HOOK(vkAllocateCommandBuffers) HOOK(vkFreeCommandBuffers) HOOK(vkDestroyCommandPool) HOOK(vkResetCommandPool)
+    HOOK(vkBeginCommandBuffer) HOOK(vkResetCommandBuffer)
+    HOOK(vkCmdBindPipeline) HOOK(vkCmdBeginRendering) HOOK(vkCmdEndRendering)
+    HOOK(vkCmdDraw) HOOK(vkCmdDrawIndexed) HOOK(vkCmdDrawIndirect) HOOK(vkCmdDrawIndexedIndirect)
+    HOOK(vkCmdDrawIndirectCount) HOOK(vkCmdDrawIndexedIndirectCount)
+    if (dev->vk.vkCmdDrawMeshTasksEXT) HOOK(vkCmdDrawMeshTasksEXT)
+#define HOOK_DYN(n, state, fn) HOOK(fn)
+    XENO_DYN_STATES(HOOK_DYN)
+#undef HOOK_DYN
+#undef HOOK
+    /* KHR aliases of the promoted entrypoints */
+    if (strcmp(name, "vkCmdBeginRenderingKHR") == 0) return (PFN_vkVoidFunction)xeno_vkCmdBeginRendering;
+    if (strcmp(name, "vkCmdEndRenderingKHR") == 0) return (PFN_vkVoidFunction)xeno_vkCmdEndRendering;
+    return NULL;
+}
@@ -0,0 +1,318 @@
+/* xeno_deferred.c - VK_KHR_deferred_host_operations emulation with cooperative joins
+ *
+ * Active when the driver rejects VK_KHR_deferred_host_operations (dev->emulate). The wrapper then
+ * owns every VkDeferredOperationKHR and the commands that take one (ray tracing pipeline creation,
+ * host acceleration structure builds and copies) return VK_OPERATION_DEFERRED_KHR after recording a
+ * task list: one task per pipeline create info or build info, one for a copy. The driver itself only
+ * ever sees VK_NULL_HANDLE, so each task is a plain synchronous driver call.
+ *
+ * Any number of app threads may vkDeferredOperationJoinKHR the same operation; each claims tasks
+ * one at a time until none is left. A thread that finds no claimable task returns
+ *   VK_SUCCESS           the operation is complete
+ *   VK_THREAD_IDLE_KHR   remaining tasks wait on ones still running (derivatives of a base pipeline
+ *                        in the same batch, or a pipeline cache that may not be used concurrently)
+ *   VK_THREAD_DONE_KHR   every remaining task is running on another thread
+ * and vkGetDeferredOperationMaxConcurrencyKHR reports the running plus the claimable tasks.
+ *
+ * Ray tracing batches follow the batch rules of vkCreate*Pipelines: per element results, errors over
+ * VK_PIPELINE_COMPILE_REQUIRED, and once an element with EARLY_RETURN_ON_FAILURE fails, later
+ * elements are skipped or their pipelines destroyed. An externally synchronized pipeline cache (or
+ * any cache while the split module is off and cannot tell) chains the batch into one task at a time.
+ *
+ * Knobs:
+ *   XCLIPSE_DEFERRED_OPS_EMULATION=0   do not emulate (the extension is then stripped and unavailable)
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+enum { OP_NONE = 0, OP_RT_PIPELINES, OP_AS_BUILD, OP_AS_COPY, OP_AS_COPY_TO_MEMORY, OP_MEMORY_TO_AS };
+enum { TASK_PENDING = 0, TASK_RUNNING, TASK_DONE };
+
+typedef struct xeno_deferred_device {
+    _Atomic uint64_t operations, deferred, tasks, skipped;
+    _Atomic uint64_t rt_pipelines, as_builds, as_copies;
+    _Atomic uint64_t joins, thread_done, thread_idle;
+    _Atomic uint32_t peak_joiners;  /* most threads seen running tasks of one operation at once */
+} xeno_deferred_device_t;
+
+typedef struct defer_task { int32_t dep; uint8_t state; } defer_task_t; /* dep: task that must finish first, -1 none */
+
+typedef struct xeno_deferred_op {
+    xeno_device_t* dev;
+    pthread_mutex_t lock;
+    int kind;                       /* OP_NONE until a command is deferred on it */
+    int complete;
+    VkResult result;
+    defer_task_t* tasks;
+    uint32_t count, next, running, done;  /* next: lowest task not yet claimed */
+    uint32_t stop;                  /* first element that failed with early return; count when none */
+    union {
+        struct { VkPipelineCache cache; const VkRayTracingPipelineCreateInfoKHR* infos; const VkAllocationCallbacks* allocator; VkPipeline* out; } rt;
+        struct { const VkAccelerationStructureBuildGeometryInfoKHR* infos; const VkAccelerationStructureBuildRangeInfoKHR* const* ranges; } build;
+        const VkCopyAccelerationStructureInfoKHR* copy;
+        const VkCopyAccelerationStructureToMemoryInfoKHR* copy_to_memory;
+        const VkCopyMemoryToAccelerationStructureInfoKHR* copy_from_memory;
+    } cmd;
+} xeno_deferred_op_t;
+
+#define OP_FROM_HANDLE(h) ((xeno_deferred_op_t*)(uintptr_t)(h))
+
+static VkResult merge_result(VkResult total, VkResult r) {
+    if (r == VK_SUCCESS || total < 0) return total;
+    if (r < 0 || total == VK_SUCCESS) return r;
+    return total;
+}
+
+/* --- task execution --- */
+static VkResult run_task(xeno_deferred_op_t* op, uint32_t i) {
+    xeno_device_t* dev = op->dev;
+    switch (op->kind) {
+        case OP_RT_PIPELINES: {
+            VkRayTracingPipelineCreateInfoKHR ci = op->cmd.rt.infos[i];
+            if ((ci.flags & VK_PIPELINE_CREATE_DERIVATIVE_BIT) && ci.basePipelineIndex >= 0) {
+                /* the base finished before this task could be claimed */
+                ci.basePipelineHandle = op->cmd.rt.out[ci.basePipelineIndex]; ci.basePipelineIndex = -1;
+                if (!ci.basePipelineHandle) ci.flags &= ~(VkPipelineCreateFlags)VK_PIPELINE_CREATE_DERIVATIVE_BIT;
+            }
+            return dev->vk.vkCreateRayTracingPipelinesKHR(dev->handle, VK_NULL_HANDLE, op->cmd.rt.cache, 1, &ci, op->cmd.rt.allocator, &op->cmd.rt.out[i]);
+        }
+        case OP_AS_BUILD: return dev->vk.vkBuildAccelerationStructuresKHR(dev->handle, VK_NULL_HANDLE, 1, &op->cmd.build.infos[i], &op->cmd.build.ranges[i]);
+        case OP_AS_COPY: return dev->vk.vkCopyAccelerationStructureKHR(dev->handle, VK_NULL_HANDLE, op->cmd.copy);
+        case OP_AS_COPY_TO_MEMORY: return dev->vk.vkCopyAccelerationStructureToMemoryKHR(dev->handle, VK_NULL_HANDLE, op->cmd.copy_to_memory);
+        case OP_MEMORY_TO_AS: return dev->vk.vkCopyMemoryToAccelerationStructureKHR(dev->handle, VK_NULL_HANDLE, op->cmd.copy_from_memory);
+        default: return VK_SUCCESS;
+    }
+}
+
+/* op->lock held; the last task to finish completes the operation */
+static void task_finished(xeno_deferred_op_t* op, uint32_t i, VkResult r) {
+    op->tasks[i].state = TASK_DONE; op->done++;
+    op->result = merge_result(op->result, r);
+    if (op->kind == OP_RT_PIPELINES && !op->cmd.rt.out[i] && i < op->stop &&
+        (op->cmd.rt.infos[i].flags & VK_PIPELINE_CREATE_EARLY_RETURN_ON_FAILURE_BIT)) op->stop = i;
+    if (op->done < op->count) return;
+    if (op->kind == OP_RT_PIPELINES) {
+        for (uint32_t j = op->stop + 1; j < op->count; ++j) {
+            if (!op->cmd.rt.out[j]) continue;
+            op->dev->vk.vkDestroyPipeline(op->dev->handle, op->cmd.rt.out[j], op->cmd.rt.allocator);
+            op->cmd.rt.out[j] = VK_NULL_HANDLE;
+        }
+    }
+    op->complete = 1;
+}
+
+static int task_ready(const xeno_deferred_op_t* op, uint32_t i) {
+    return op->tasks[i].state == TASK_PENDING && (op->tasks[i].dep < 0 || op->tasks[op->tasks[i].dep].state == TASK_DONE);
+}
+
+/* op->lock held; returns a claimed task or -1. Tasks behind an early-return failure finish unrun. */
+static int64_t claim_task(xeno_deferred_op_t* op) {
+    xeno_deferred_device_t* dd = op->dev->deferred;
+    for (uint32_t i = op->next; i < op->count && !op->complete; ++i) {
+        if (op->tasks[i].state != TASK_PENDING) { if (i == op->next) op->next++; continue; }
+        if (i > op->stop) {
+            if (op->kind == OP_RT_PIPELINES) op->cmd.rt.out[i] = VK_NULL_HANDLE;
+            atomic_fetch_add(&dd->skipped, 1);
+            task_finished(op, i, VK_SUCCESS);
+            if (i == op->next) op->next++;
+            continue;
+        }
+        if (!task_ready(op, i)) continue;
+        op->tasks[i].state = TASK_RUNNING;
+        if (i == op->next) op->next++;
+        return i;
+    }
+    return -1;
+}
+
+/* op->lock held */
+static uint32_t claimable(const xeno_deferred_op_t* op) {
+    uint32_t n = 0;
+    for (uint32_t i = op->next; i < op->count && i <= op->stop; ++i) n += task_ready(op, i);
+    return n;
+}
+
+/* --- deferred operation objects --- */
+static VKAPI_ATTR VkResult VKAPI_CALL deferred_vkCreateDeferredOperationKHR(VkDevice device, const VkAllocationCallbacks* pAllocator, VkDeferredOperationKHR* pDeferredOperation) {
+    xeno_device_t* dev = xeno_device_get(device);
+    xeno_deferred_op_t* op = calloc(1, sizeof(*op));
+    if (!op) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    op->dev = dev;
+    pthread_mutex_init(&op->lock, NULL);
+    atomic_fetch_add(&dev->deferred->operations, 1);
+    *pDeferredOperation = (VkDeferredOperationKHR)(uintptr_t)op;
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL deferred_vkDestroyDeferredOperationKHR(VkDevice device, VkDeferredOperationKHR operation, const VkAllocationCallbacks* pAllocator) {
+    xeno_deferred_op_t* op = OP_FROM_HANDLE(operation);
+    if (!op) return;
+    pthread_mutex_destroy(&op->lock);
+    free(op->tasks); free(op);
+}
+
+static VKAPI_ATTR uint32_t VKAPI_CALL deferred_vkGetDeferredOperationMaxConcurrencyKHR(VkDevice device, VkDeferredOperationKHR operation) {
+    xeno_deferred_op_t* op = OP_FROM_HANDLE(operation);
+    pthread_mutex_lock(&op->lock);
+    uint32_t n = 0;
+    if (op->kind != OP_NONE && !op->complete) {
+        n = op->running + claimable(op);
+        if (n == 0) n = 1;          /* the skipped tail still needs one join to finish */
+    }
+    pthread_mutex_unlock(&op->lock);
+    return n;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL deferred_vkGetDeferredOperationResultKHR(VkDevice device, VkDeferredOperationKHR operation) {
+    xeno_deferred_op_t* op = OP_FROM_HANDLE(operation);
+    pthread_mutex_lock(&op->lock);
+    VkResult r = op->kind == OP_NONE ? VK_SUCCESS : op->complete ? op->result : VK_NOT_READY;
+    pthread_mutex_unlock(&op->lock);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL deferred_vkDeferredOperationJoinKHR(VkDevice device, VkDeferredOperationKHR operation) {
+    xeno_deferred_op_t* op = OP_FROM_HANDLE(operation);
+    xeno_deferred_device_t* dd = op->dev->deferred;
+    atomic_fetch_add(&dd->joins, 1);
+    pthread_mutex_lock(&op->lock);
+    int64_t t;
+    while ((t = claim_task(op)) >= 0) {
+        op->running++;
+        uint32_t peak = atomic_load(&dd->peak_joiners);
+        while (op->running > peak && !atomic_compare_exchange_weak(&dd->peak_joiners, &peak, op->running)) {}
+        pthread_mutex_unlock(&op->lock);
+        VkResult r = run_task(op, (uint32_t)t);
+        pthread_mutex_lock(&op->lock);
+        op->running--;
+        task_finished(op, (uint32_t)t, r);
+    }
+    VkResult r = VK_SUCCESS;
+    if (op->kind != OP_NONE && !op->complete) {
+        /* tasks still pending here are blocked on running ones and become claimable later */
+        int blocked = 0;
+        for (uint32_t i = op->next; i < op->count && !blocked; ++i) blocked = op->tasks[i].state == TASK_PENDING;
+        r = blocked ? VK_THREAD_IDLE_KHR : VK_THREAD_DONE_KHR;
+        atomic_fetch_add(blocked ? &dd->thread_idle : &dd->thread_done, 1);
+    }
+    pthread_mutex_unlock(&op->lock);
+    return r;
+}
+
+/* associates a command of count independent tasks with op; callers add dependencies */
+static VkResult defer(xeno_deferred_op_t* op, int kind, uint32_t count) {
+    defer_task_t* tasks = calloc(count ? count : 1, sizeof(*tasks));
+    if (!tasks) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    for (uint32_t i = 0; i < count; ++i) tasks[i].dep = -1;
+    pthread_mutex_lock(&op->lock);
+    free(op->tasks);                /* an operation may be reused once complete */
+    op->tasks = tasks; op->kind = kind; op->complete = 0; op->result = VK_SUCCESS;
+    op->count = count; op->next = op->running = op->done = 0; op->stop = count;
+    pthread_mutex_unlock(&op->lock);
+    xeno_deferred_device_t* dd = op->dev->deferred;
+    atomic_fetch_add(&dd->deferred, 1); atomic_fetch_add(&dd->tasks, count);
+    return VK_SUCCESS;
+}
+
+/* --- commands that take a deferred operation --- */
+static VKAPI_ATTR VkResult VKAPI_CALL deferred_vkCreateRayTracingPipelinesKHR(VkDevice device, VkDeferredOperationKHR deferredOperation, VkPipelineCache pipelineCache, uint32_t createInfoCount,
+                                                                            const VkRayTracingPipelineCreateInfoKHR* pCreateInfos, const VkAllocationCallbacks* pAllocator, VkPipeline* pPipelines) {
+    xeno_device_t* dev = xeno_device_get(device);
+    xeno_deferred_op_t* op = OP_FROM_HANDLE(deferredOperation);
+    if (!op || createInfoCount == 0) {
+        VkResult r = dev->vk.vkCreateRayTracingPipelinesKHR(device, VK_NULL_HANDLE, pipelineCache, createInfoCount, pCreateInfos, pAllocator, pPipelines);
+        return op && r == VK_SUCCESS ? VK_OPERATION_NOT_DEFERRED_KHR : r;
+    }
+    /* the tasks are set up before any join can see the operation: the app joins only after we return */
+    VkResult r = defer(op, OP_RT_PIPELINES, createInfoCount);
+    if (r != VK_SUCCESS) return r;
+    op->cmd.rt.cache = pipelineCache; op->cmd.rt.infos = pCreateInfos; op->cmd.rt.allocator = pAllocator; op->cmd.rt.out = pPipelines;
+    int serial = pipelineCache && xeno_split_cache_exclusive(dev, pipelineCache);
+    for (uint32_t i = 0; i < createInfoCount; ++i) {
+        pPipelines[i] = VK_NULL_HANDLE;
+        if (serial) op->tasks[i].dep = (int32_t)i - 1;
+        else if ((pCreateInfos[i].flags & VK_PIPELINE_CREATE_DERIVATIVE_BIT) && pCreateInfos[i].basePipelineIndex >= 0)
+            op->tasks[i].dep = pCreateInfos[i].basePipelineIndex;
+    }
+    atomic_fetch_add(&dev->deferred->rt_pipelines, createInfoCount);
+    return VK_OPERATION_DEFERRED_KHR;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL deferred_vkBuildAccelerationStructuresKHR(VkDevice device, VkDeferredOperationKHR deferredOperation, uint32_t infoCount,
+                                                                              const VkAccelerationStructureBuildGeometryInfoKHR* pInfos, const VkAccelerationStructureBuildRangeInfoKHR* const* ppBuildRangeInfos) {
+    xeno_device_t* dev = xeno_device_get(device);
+    xeno_deferred_op_t* op = OP_FROM_HANDLE(deferredOperation);
+    if (!op || infoCount == 0) {
+        VkResult r = dev->vk.vkBuildAccelerationStructuresKHR(device, VK_NULL_HANDLE, infoCount, pInfos, ppBuildRangeInfos);
+        return op && r == VK_SUCCESS ? VK_OPERATION_NOT_DEFERRED_KHR : r;
+    }
+    /* the infos of one call may not alias each other's destinations or scratch, so each builds on its own */
+    VkResult r = defer(op, OP_AS_BUILD, infoCount);
+    if (r != VK_SUCCESS) return r;
+    op->cmd.build.infos = pInfos; op->cmd.build.ranges = ppBuildRangeInfos;
+    atomic_fetch_add(&dev->deferred->as_builds, infoCount);
+    return VK_OPERATION_DEFERRED_KHR;
+}
+
+#define DEFER_COPY(name, info_type, kind, member) \
+static VKAPI_ATTR VkResult VKAPI_CALL deferred_##name(VkDevice device, VkDeferredOperationKHR deferredOperation, const info_type* pInfo) { \
+    xeno_device_t* dev = xeno_device_get(device); \
+    xeno_deferred_op_t* op = OP_FROM_HANDLE(deferredOperation); \
+    if (!op) return dev->vk.name(device, VK_NULL_HANDLE, pInfo); \
+    VkResult r = defer(op, kind, 1); \
+    if (r != VK_SUCCESS) return r; \
+    op->cmd.member = pInfo; \
+    atomic_fetch_add(&dev->deferred->as_copies, 1); \
+    return VK_OPERATION_DEFERRED_KHR; \
+}
+DEFER_COPY(vkCopyAccelerationStructureKHR, VkCopyAccelerationStructureInfoKHR, OP_AS_COPY, copy)
+DEFER_COPY(vkCopyAccelerationStructureToMemoryKHR, VkCopyAccelerationStructureToMemoryInfoKHR, OP_AS_COPY_TO_MEMORY, copy_to_memory)
+DEFER_COPY(vkCopyMemoryToAccelerationStructureKHR, VkCopyMemoryToAccelerationStructureInfoKHR, OP_MEMORY_TO_AS, copy_from_memory)
+#undef DEFER_COPY
+
+/* --- device lifetime / routing --- */
+int xeno_deferred_init(xeno_device_t* dev) {
+    if (!(dev->emulate & XENO_EMULATE_DEFERRED_HOST_OPERATIONS)) return 0;
+    xeno_deferred_device_t* dd = calloc(1, sizeof(*dd)); if (!dd) return -1;
+    dev->deferred = dd;
+    return 0;
+}
+
+void xeno_deferred_destroy(xeno_device_t* dev) {
+    free(dev->deferred);
+    dev->deferred = NULL;
+}
+
+PFN_vkVoidFunction xeno_deferred_proc(xeno_device_t* dev, const char* name) {
+    if (!dev->deferred) return NULL;
+#define DEFERRED_FN(fn) if (strcmp(name, #fn) == 0) return (PFN_vkVoidFunction)deferred_##fn;
+    DEFERRED_FN(vkCreateDeferredOperationKHR) DEFERRED_FN(vkDestroyDeferredOperationKHR)
+    DEFERRED_FN(vkGetDeferredOperationMaxConcurrencyKHR) DEFERRED_FN(vkGetDeferredOperationResultKHR)
+    DEFERRED_FN(vkDeferredOperationJoinKHR)
+#undef DEFERRED_FN
+    /* commands taking an operation are claimed only when the driver has them */
+#define DEFERRED_CMD(fn) if (strcmp(name, #fn) == 0) return dev->vk.fn ? (PFN_vkVoidFunction)deferred_##fn : NULL;
+    DEFERRED_CMD(vkCreateRayTracingPipelinesKHR) DEFERRED_CMD(vkBuildAccelerationStructuresKHR)
+    DEFERRED_CMD(vkCopyAccelerationStructureKHR) DEFERRED_CMD(vkCopyAccelerationStructureToMemoryKHR)
+    DEFERRED_CMD(vkCopyMemoryToAccelerationStructureKHR)
+#undef DEFERRED_CMD
+    return NULL;
+}
+
+void xeno_deferred_report(FILE* f, xeno_device_t* dev) {
+    xeno_deferred_device_t* dd = dev->deferred;
+    fprintf(f, "  \"deferred_ops\": {\"emulated\": %s", dd ? "true" : "false");
+    if (dd) {
+        fprintf(f, ", \"operations\": %" PRIu64 ", \"deferred\": %" PRIu64 ", \"tasks\": %" PRIu64 ", \"skipped\": %" PRIu64,
+                atomic_load(&dd->operations), atomic_load(&dd->deferred), atomic_load(&dd->tasks), atomic_load(&dd->skipped));
+        fprintf(f, ", \"rt_pipelines\": %" PRIu64 ", \"as_builds\": %" PRIu64 ", \"as_copies\": %" PRIu64,
+                atomic_load(&dd->rt_pipelines), atomic_load(&dd->as_builds), atomic_load(&dd->as_copies));
+        fprintf(f, ", \"joins\": %" PRIu64 ", \"thread_done\": %" PRIu64 ", \"thread_idle\": %" PRIu64 ", \"peak_joiners\": %u",
+                atomic_load(&dd->joins), atomic_load(&dd->thread_done), atomic_load(&dd->thread_idle), atomic_load(&dd->peak_joiners));
+    }
+    fprintf(f, "}");
+}
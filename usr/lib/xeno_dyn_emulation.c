@@ -0,0 +1,632 @@
+/* xeno_dyn_emulation.c - VK_EXT_extended_dynamic_state3 / VK_EXT_vertex_input_dynamic_state emulation
+ *
+ * Used when the downstream driver rejects those extensions at vkCreateDevice. A graphics pipeline
+ * that declares emulated states dynamic is created with them static (values from its create info)
+ * and keeps a normalized copy of its create info as a template. At draw time the states recorded
+ * in the command buffer are packed into a compact key (template id + emulated state words); when
+ * they differ from the template's own values the matching variant is looked up in the bounded LRU
+ * variant cache, compiled inline on a miss, and bound in place of the app pipeline.
+ *
+ * Shader modules, pipeline layouts and render passes referenced by a template may be destroyed by
+ * the app right after pipeline creation; their destruction is deferred until the last template
+ * using them goes away.
+ *
+ * A template carries the pNext structs it knows how to copy. A pipeline with any other struct in
+ * its chains, or one that is or links a pipeline library, gets no template: its emulated states
+ * stay at their static values and the reason is logged, since a variant without that struct
+ * would be a different pipeline.
+ *
+ * Knobs:
+ *   XCLIPSE_EDS3_EMULATION=0 / XCLIPSE_VERTEX_INPUT_EMULATION=0   pass the extension through untouched
+ *   XCLIPSE_DYN_<STATE>=0       do not emulate one state (e.g. XCLIPSE_DYN_POLYGON_MODE=0); pipelines
+ *                               then keep the static value from their create info
+ *   XCLIPSE_DYN_VARIANT_CAPACITY=N   variant cache size (default 2048)
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+#define EMU_KEY_WORDS (XENO_DYN_MAX_WORDS + 2)
+#define MS_DYNAMIC_ALL (XENO_DYN_BIT(RASTERIZATION_SAMPLES) | XENO_DYN_BIT(SAMPLE_MASK) | XENO_DYN_BIT(ALPHA_TO_COVERAGE_ENABLE) | XENO_DYN_BIT(ALPHA_TO_ONE_ENABLE))
+#define BLEND_DYNAMIC_ALL (XENO_DYN_BIT(COLOR_BLEND_ENABLE) | XENO_DYN_BIT(COLOR_BLEND_EQUATION) | XENO_DYN_BIT(COLOR_WRITE_MASK))
+
+enum { RETAIN_MODULE, RETAIN_LAYOUT, RETAIN_RENDER_PASS };
+typedef struct retained { uint64_t handle; int type; uint32_t refs; int destroy_pending; } retained_t;
+
+typedef struct xeno_dyn_template {
+    uint64_t id;
+    VkPipeline base;
+    uint64_t emu_mask;              /* XENO_DYN_* bits this pipeline wants dynamic but the driver cannot do */
+    xeno_variant_key_t base_key;    /* key of the static values the base pipeline was built with */
+    VkPipelineCreateFlags flags;
+    uint32_t stage_count;
+    VkPipelineShaderStageCreateInfo stages[XENO_SO_STAGES];
+    VkSpecializationInfo spec[XENO_SO_STAGES];
+    char* names[XENO_SO_STAGES];
+    int owned_module[XENO_SO_STAGES];
+    VkPipelineVertexInputStateCreateInfo vi;
+    VkVertexInputBindingDescription vi_bindings[XENO_MAX_VERTEX_BINDINGS];
+    VkVertexInputAttributeDescription vi_attributes[XENO_MAX_VERTEX_ATTRIBUTES];
+    VkPipelineInputAssemblyStateCreateInfo ia;
+    VkPipelineTessellationStateCreateInfo ts;
+    VkPipelineViewportStateCreateInfo vp;
+    VkViewport viewports[XENO_MAX_VIEWPORTS];
+    VkRect2D scissors[XENO_MAX_VIEWPORTS];
+    VkPipelineRasterizationStateCreateInfo rs;
+    VkPipelineMultisampleStateCreateInfo ms;
+    VkSampleMask sample_mask[2];
+    VkPipelineDepthStencilStateCreateInfo ds;
+    VkPipelineColorBlendStateCreateInfo cb;
+    VkPipelineColorBlendAttachmentState attachments[XENO_MAX_COLOR_ATTACHMENTS];
+    VkPipelineDynamicStateCreateInfo dyn;
+    VkDynamicState* dyn_list;
+    VkPipelineRenderingCreateInfo rendering;
+    VkFormat color_formats[XENO_MAX_COLOR_ATTACHMENTS];
+    int has_ia, has_ts, has_ds, has_rendering;
+    const void* next;               /* copied top-level pNext chain, behind rendering when present */
+    VkStructureType foreign;        /* first pNext struct that could not be copied, 0: none */
+    int library;
+    VkPipelineLayout layout;
+    VkRenderPass render_pass;
+    uint32_t subpass;
+    xeno_dyn_state_t statics;
+} xeno_dyn_template_t;
+
+typedef struct xeno_dyn_emu_device {
+    xeno_variant_cache_t cache;
+    xeno_map_t templates;           /* base VkPipeline -> template */
+    pthread_mutex_t retain_lock;
+    xeno_map_t retained;            /* handle -> retained_t */
+    _Atomic uint64_t next_id;
+    _Atomic uint64_t pipelines, stripped, untemplated, base_hits, variant_binds;
+} xeno_dyn_emu_device_t;
+
+static const VkDynamicState dyn_vk_state[XENO_DYN_COUNT] = {
+#define XENO_DYN_VK(name, vk, fn) vk,
+    XENO_DYN_STATES(XENO_DYN_VK)
+#undef XENO_DYN_VK
+};
+static int dyn_index(VkDynamicState s) {
+    for (int i = 0; i < XENO_DYN_COUNT; ++i) if (dyn_vk_state[i] == s) return i;
+    return -1;
+}
+
+/* --- deferred destruction of handles templates still reference --- */
+static void retain(xeno_dyn_emu_device_t* emu, int type, uint64_t handle) {
+    if (!handle) return;
+    pthread_mutex_lock(&emu->retain_lock);
+    retained_t* r = xeno_map_get(&emu->retained, handle);
+    if (!r && (r = calloc(1, sizeof(*r)))) { r->handle = handle; r->type = type; xeno_map_put(&emu->retained, handle, r); }
+    if (r) r->refs++;
+    pthread_mutex_unlock(&emu->retain_lock);
+}
+static void destroy_handle(xeno_device_t* dev, int type, uint64_t handle) {
+    switch (type) {
+        case RETAIN_MODULE: dev->vk.vkDestroyShaderModule(dev->handle, (VkShaderModule)(uintptr_t)handle, NULL); break;
+        case RETAIN_LAYOUT: dev->vk.vkDestroyPipelineLayout(dev->handle, (VkPipelineLayout)(uintptr_t)handle, NULL); break;
+        case RETAIN_RENDER_PASS: dev->vk.vkDestroyRenderPass(dev->handle, (VkRenderPass)(uintptr_t)handle, NULL); break;
+    }
+}
+static void release(xeno_device_t* dev, uint64_t handle) {
+    if (!handle) return;
+    xeno_dyn_emu_device_t* emu = dev->dyn_emu;
+    pthread_mutex_lock(&emu->retain_lock);
+    retained_t* r = xeno_map_get(&emu->retained, handle);
+    int destroy = 0, type = 0;
+    if (r && --r->refs == 0) {
+        xeno_map_remove(&emu->retained, handle);
+        destroy = r->destroy_pending; type = r->type;
+        free(r);
+    }
+    pthread_mutex_unlock(&emu->retain_lock);
+    if (destroy) destroy_handle(dev, type, handle);
+}
+/* returns 1 when the destroy was deferred */
+static int defer_destroy(xeno_device_t* dev, uint64_t handle) {
+    if (!handle) return 0;
+    xeno_dyn_emu_device_t* emu = dev->dyn_emu;
+    pthread_mutex_lock(&emu->retain_lock);
+    retained_t* r = xeno_map_get(&emu->retained, handle);
+    if (r) r->destroy_pending = 1;
+    pthread_mutex_unlock(&emu->retain_lock);
+    return r != NULL;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_vkDestroyShaderModule(VkDevice device, VkShaderModule module, const VkAllocationCallbacks* pAllocator) {
+    xeno_device_t* dev = xeno_device_get(device);
+    if (!defer_destroy(dev, XENO_HANDLE_KEY(module))) dev->vk.vkDestroyShaderModule(device, module, pAllocator);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkDestroyPipelineLayout(VkDevice device, VkPipelineLayout layout, const VkAllocationCallbacks* pAllocator) {
+    xeno_device_t* dev = xeno_device_get(device);
+    if (!defer_destroy(dev, XENO_HANDLE_KEY(layout))) dev->vk.vkDestroyPipelineLayout(device, layout, pAllocator);
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkDestroyRenderPass(VkDevice device, VkRenderPass renderPass, const VkAllocationCallbacks* pAllocator) {
+    xeno_device_t* dev = xeno_device_get(device);
+    if (!defer_destroy(dev, XENO_HANDLE_KEY(renderPass))) dev->vk.vkDestroyRenderPass(device, renderPass, pAllocator);
+}
+
+/* --- pNext chains of templates ---
+ * structs made of scalars only, copied whole; the table of each position lists what may appear there */
+typedef struct emu_flat { VkStructureType sType; size_t size; } emu_flat_t;
+#define EMU_FLAT(st, T) { st, sizeof(T) }
+static const emu_flat_t flat_stage[] = {
+    EMU_FLAT(VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO, VkPipelineShaderStageRequiredSubgroupSizeCreateInfo),
+    EMU_FLAT(VK_STRUCTURE_TYPE_PIPELINE_ROBUSTNESS_CREATE_INFO_EXT, VkPipelineRobustnessCreateInfoEXT),
+};
+static const emu_flat_t flat_viewport[] = {
+    EMU_FLAT(VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_DEPTH_CLIP_CONTROL_CREATE_INFO_EXT, VkPipelineViewportDepthClipControlCreateInfoEXT),
+};
+static const emu_flat_t flat_raster[] = {
+    EMU_FLAT(VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_DEPTH_CLIP_STATE_CREATE_INFO_EXT, VkPipelineRasterizationDepthClipStateCreateInfoEXT),
+    EMU_FLAT(VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_PROVOKING_VERTEX_STATE_CREATE_INFO_EXT, VkPipelineRasterizationProvokingVertexStateCreateInfoEXT),
+    EMU_FLAT(VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_LINE_STATE_CREATE_INFO_EXT, VkPipelineRasterizationLineStateCreateInfoEXT),
+    EMU_FLAT(VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_CONSERVATIVE_STATE_CREATE_INFO_EXT, VkPipelineRasterizationConservativeStateCreateInfoEXT),
+    EMU_FLAT(VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_STREAM_CREATE_INFO_EXT, VkPipelineRasterizationStateStreamCreateInfoEXT),
+};
+static const emu_flat_t flat_pipeline[] = {
+    EMU_FLAT(VK_STRUCTURE_TYPE_PIPELINE_CREATE_FLAGS_2_CREATE_INFO_KHR, VkPipelineCreateFlags2CreateInfoKHR),
+    EMU_FLAT(VK_STRUCTURE_TYPE_PIPELINE_ROBUSTNESS_CREATE_INFO_EXT, VkPipelineRobustnessCreateInfoEXT),
+};
+#define EMU_COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+/* handled by template_build itself, or (creation feedback) only describing how the app's pipeline was made */
+static int chain_skipped(VkStructureType sType) {
+    return sType == VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO || sType == VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO ||
+           sType == VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+}
+
+/* copy src into an owned chain at *dst; structs not in the table are recorded in t->foreign */
+static VkResult template_chain(xeno_dyn_template_t* t, const void** dst, const void* src, const emu_flat_t* table, size_t n) {
+    const void** link = dst;
+    *dst = NULL;
+    for (const VkBaseInStructure* p = src; p; p = p->pNext) {
+        if (chain_skipped(p->sType)) continue;
+        const emu_flat_t* f = NULL;
+        for (size_t i = 0; i < n && !f; ++i) if (table[i].sType == p->sType) f = &table[i];
+        if (!f) { if (!t->foreign) t->foreign = p->sType; continue; }
+        VkBaseOutStructure* c = malloc(f->size);
+        if (!c) return VK_ERROR_OUT_OF_HOST_MEMORY;
+        memcpy(c, p, f->size); c->pNext = NULL;
+        *link = c; link = (const void**)&c->pNext;
+    }
+    return VK_SUCCESS;
+}
+static void chain_free(const void* chain) {
+    while (chain) { const void* next = ((const VkBaseInStructure*)chain)->pNext; free((void*)chain); chain = next; }
+}
+
+/* --- templates --- */
+static void template_free(xeno_device_t* dev, xeno_dyn_template_t* t) {
+    for (uint32_t i = 0; i < t->stage_count; ++i) {
+        if (t->owned_module[i]) dev->vk.vkDestroyShaderModule(dev->handle, t->stages[i].module, NULL);
+        else release(dev, XENO_HANDLE_KEY(t->stages[i].module));
+        free(t->names[i]); free((void*)t->spec[i].pMapEntries); free((void*)t->spec[i].pData);
+        chain_free(t->stages[i].pNext);
+    }
+    chain_free(t->vi.pNext); chain_free(t->ia.pNext); chain_free(t->ts.pNext); chain_free(t->vp.pNext);
+    chain_free(t->rs.pNext); chain_free(t->ms.pNext); chain_free(t->ds.pNext); chain_free(t->cb.pNext); chain_free(t->next);
+    release(dev, XENO_HANDLE_KEY(t->layout));
+    release(dev, XENO_HANDLE_KEY(t->render_pass));
+    free(t->dyn_list); free(t);
+}
+
+static uint32_t template_color_count(const xeno_dyn_template_t* t) {
+    return t->cb.attachmentCount < XENO_MAX_COLOR_ATTACHMENTS ? t->cb.attachmentCount : XENO_MAX_COLOR_ATTACHMENTS;
+}
+
+/* copy the values of the emulatable states in `mask` from src into dst */
+static void dyn_overlay(xeno_dyn_state_t* dst, const xeno_dyn_state_t* src, uint64_t mask) {
+#define O(name) (mask & XENO_DYN_BIT(name))
+    if (O(DEPTH_CLAMP_ENABLE)) dst->depth_clamp = src->depth_clamp;
+    if (O(POLYGON_MODE)) dst->polygon_mode = src->polygon_mode;
+    if (O(RASTERIZATION_SAMPLES)) dst->rasterization_samples = src->rasterization_samples;
+    if (O(SAMPLE_MASK)) { dst->sample_mask = src->sample_mask; dst->sample_mask_samples = src->sample_mask_samples; }
+    if (O(ALPHA_TO_COVERAGE_ENABLE)) dst->alpha_to_coverage = src->alpha_to_coverage;
+    if (O(ALPHA_TO_ONE_ENABLE)) dst->alpha_to_one = src->alpha_to_one;
+    if (O(LOGIC_OP_ENABLE)) dst->logic_op_enable = src->logic_op_enable;
+    if (O(COLOR_BLEND_ENABLE)) { memcpy(dst->blend_enable, src->blend_enable, sizeof(dst->blend_enable)); dst->blend_enable_count = src->blend_enable_count; }
+    if (O(COLOR_BLEND_EQUATION)) { memcpy(dst->blend_eq, src->blend_eq, sizeof(dst->blend_eq)); dst->blend_eq_count = src->blend_eq_count; }
+    if (O(COLOR_WRITE_MASK)) { memcpy(dst->write_mask, src->write_mask, sizeof(dst->write_mask)); dst->write_mask_count = src->write_mask_count; }
+    if (O(VERTEX_INPUT)) {
+        dst->vertex_binding_count = src->vertex_binding_count; dst->vertex_attribute_count = src->vertex_attribute_count;
+        memcpy(dst->vertex_bindings, src->vertex_bindings, sizeof(dst->vertex_bindings));
+        memcpy(dst->vertex_attributes, src->vertex_attributes, sizeof(dst->vertex_attributes));
+    }
+#undef O
+}
+
+static xeno_variant_key_t template_key(const xeno_dyn_template_t* t, const xeno_dyn_state_t* s) {
+    uint32_t key[EMU_KEY_WORDS];
+    key[0] = (uint32_t)t->id; key[1] = (uint32_t)(t->id >> 32);
+    uint32_t n = 2 + xeno_dyn_pack(s, t->emu_mask, template_color_count(t), &key[2]);
+    return xeno_variant_key(key, n);
+}
+
+/* Normalize ci into t: every state struct the variants need exists and owns its arrays */
+static VkResult template_build(xeno_device_t* dev, xeno_dyn_template_t* t, const VkGraphicsPipelineCreateInfo* ci, uint64_t strip) {
+    xeno_dyn_emu_device_t* emu = dev->dyn_emu;
+    t->flags = ci->flags & ~(VkPipelineCreateFlags)(VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT | VK_PIPELINE_CREATE_DERIVATIVE_BIT);
+    t->library = (ci->flags & VK_PIPELINE_CREATE_LIBRARY_BIT_KHR) != 0;
+    for (const VkBaseInStructure* p = ci->pNext; p; p = p->pNext)
+        if (p->sType == VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR || p->sType == VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT) t->library = 1;
+    VkResult r = template_chain(t, &t->next, ci->pNext, flat_pipeline, EMU_COUNT(flat_pipeline));
+    if (r != VK_SUCCESS) return r;
+    for (const VkBaseInStructure* p = t->next; p; p = p->pNext) {
+        if (p->sType != VK_STRUCTURE_TYPE_PIPELINE_CREATE_FLAGS_2_CREATE_INFO_KHR) continue;
+        VkPipelineCreateFlags2CreateInfoKHR* f2 = (VkPipelineCreateFlags2CreateInfoKHR*)p;
+        f2->flags &= ~(VkPipelineCreateFlags2KHR)(VK_PIPELINE_CREATE_ALLOW_DERIVATIVES_BIT | VK_PIPELINE_CREATE_DERIVATIVE_BIT);
+        if (f2->flags & VK_PIPELINE_CREATE_LIBRARY_BIT_KHR) t->library = 1;
+    }
+    t->stage_count = ci->stageCount < XENO_SO_STAGES ? ci->stageCount : XENO_SO_STAGES;
+    int mesh = 0;
+    for (uint32_t i = 0; i < t->stage_count; ++i) {
+        const VkPipelineShaderStageCreateInfo* src = &ci->pStages[i];
+        VkPipelineShaderStageCreateInfo* st = &t->stages[i];
+        *st = *src; st->pNext = NULL; st->pSpecializationInfo = NULL;
+        if (src->stage & VK_SHADER_STAGE_MESH_BIT_EXT) mesh = 1;
+        t->names[i] = strdup(src->pName ? src->pName : "main"); st->pName = t->names[i];
+        if (!t->names[i]) return VK_ERROR_OUT_OF_HOST_MEMORY;
+        if (!src->module) {
+            /* maintenance5: module code inlined in the stage */
+            for (const VkBaseInStructure* p = src->pNext; p; p = p->pNext) {
+                if (p->sType != VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO) continue;
+                VkShaderModuleCreateInfo mi = *(const VkShaderModuleCreateInfo*)p; mi.pNext = NULL;
+                r = dev->vk.vkCreateShaderModule(dev->handle, &mi, NULL, &st->module);
+                if (r != VK_SUCCESS) return r;
+                t->owned_module[i] = 1;
+            }
+        } else {
+            retain(emu, RETAIN_MODULE, XENO_HANDLE_KEY(src->module));
+        }
+        if (src->pSpecializationInfo && src->pSpecializationInfo->mapEntryCount) {
+            const VkSpecializationInfo* si = src->pSpecializationInfo;
+            VkSpecializationMapEntry* e = malloc(si->mapEntryCount * sizeof(*e)); void* d = malloc(si->dataSize ? si->dataSize : 1);
+            if (!e || !d) { free(e); free(d); return VK_ERROR_OUT_OF_HOST_MEMORY; }
+            memcpy(e, si->pMapEntries, si->mapEntryCount * sizeof(*e)); memcpy(d, si->pData, si->dataSize);
+            t->spec[i] = *si; t->spec[i].pMapEntries = e; t->spec[i].pData = d;
+            st->pSpecializationInfo = &t->spec[i];
+        }
+        if ((r = template_chain(t, &st->pNext, src->pNext, flat_stage, EMU_COUNT(flat_stage))) != VK_SUCCESS) return r;
+    }
+
+    /* state structs the app may leave dangling when everything in them is dynamic */
+    int vi_dynamic = (strip & XENO_DYN_BIT(VERTEX_INPUT)) != 0;
+    int ms_dynamic = (strip & MS_DYNAMIC_ALL) == MS_DYNAMIC_ALL;
+    int blend_dynamic = (strip & BLEND_DYNAMIC_ALL) == BLEND_DYNAMIC_ALL;
+
+    t->vi.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    if (ci->pVertexInputState && !vi_dynamic) {
+        const VkPipelineVertexInputStateCreateInfo* v = ci->pVertexInputState;
+        t->vi.vertexBindingDescriptionCount = v->vertexBindingDescriptionCount < XENO_MAX_VERTEX_BINDINGS ? v->vertexBindingDescriptionCount : XENO_MAX_VERTEX_BINDINGS;
+        t->vi.vertexAttributeDescriptionCount = v->vertexAttributeDescriptionCount < XENO_MAX_VERTEX_ATTRIBUTES ? v->vertexAttributeDescriptionCount : XENO_MAX_VERTEX_ATTRIBUTES;
+        if (t->vi.vertexBindingDescriptionCount) memcpy(t->vi_bindings, v->pVertexBindingDescriptions, t->vi.vertexBindingDescriptionCount * sizeof(VkVertexInputBindingDescription));
+        if (t->vi.vertexAttributeDescriptionCount) memcpy(t->vi_attributes, v->pVertexAttributeDescriptions, t->vi.vertexAttributeDescriptionCount * sizeof(VkVertexInputAttributeDescription));
+        if ((r = template_chain(t, &t->vi.pNext, v->pNext, NULL, 0)) != VK_SUCCESS) return r;
+    }
+    t->vi.pVertexBindingDescriptions = t->vi_bindings; t->vi.pVertexAttributeDescriptions = t->vi_attributes;
+    t->ia.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO; t->ia.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    if (ci->pInputAssemblyState) {
+        t->ia = *ci->pInputAssemblyState;
+        if ((r = template_chain(t, &t->ia.pNext, ci->pInputAssemblyState->pNext, NULL, 0)) != VK_SUCCESS) return r;
+    }
+    t->has_ia = !mesh;
+    if (ci->pTessellationState) {
+        t->ts = *ci->pTessellationState; t->has_ts = 1;
+        if ((r = template_chain(t, &t->ts.pNext, ci->pTessellationState->pNext, NULL, 0)) != VK_SUCCESS) return r;
+    }
+
+    t->vp.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO; t->vp.viewportCount = t->vp.scissorCount = 1;
+    if (ci->pViewportState) {
+        const VkPipelineViewportStateCreateInfo* v = ci->pViewportState;
+        t->vp = *v;
+        if ((r = template_chain(t, &t->vp.pNext, v->pNext, flat_viewport, EMU_COUNT(flat_viewport))) != VK_SUCCESS) return r;
+        if (t->vp.viewportCount > XENO_MAX_VIEWPORTS) t->vp.viewportCount = XENO_MAX_VIEWPORTS;
+        if (t->vp.scissorCount > XENO_MAX_VIEWPORTS) t->vp.scissorCount = XENO_MAX_VIEWPORTS;
+        if (v->pViewports) { memcpy(t->viewports, v->pViewports, t->vp.viewportCount * sizeof(VkViewport)); t->vp.pViewports = t->viewports; }
+        if (v->pScissors) { memcpy(t->scissors, v->pScissors, t->vp.scissorCount * sizeof(VkRect2D)); t->vp.pScissors = t->scissors; }
+    }
+    t->rs.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO; t->rs.lineWidth = 1.0f;
+    if (ci->pRasterizationState) {
+        t->rs = *ci->pRasterizationState;
+        if ((r = template_chain(t, &t->rs.pNext, ci->pRasterizationState->pNext, flat_raster, EMU_COUNT(flat_raster))) != VK_SUCCESS) return r;
+    }
+    t->ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO; t->ms.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    t->sample_mask[0] = t->sample_mask[1] = ~0u;
+    if (ci->pMultisampleState && !ms_dynamic) {
+        t->ms = *ci->pMultisampleState;
+        if ((r = template_chain(t, &t->ms.pNext, ci->pMultisampleState->pNext, NULL, 0)) != VK_SUCCESS) return r;
+        if (ci->pMultisampleState->pSampleMask) {
+            t->sample_mask[0] = ci->pMultisampleState->pSampleMask[0];
+            if (t->ms.rasterizationSamples > VK_SAMPLE_COUNT_32_BIT) t->sample_mask[1] = ci->pMultisampleState->pSampleMask[1];
+            t->ms.pSampleMask = t->sample_mask;
+        }
+    }
+    if (ci->pDepthStencilState) {
+        t->ds = *ci->pDepthStencilState; t->has_ds = 1;
+        if ((r = template_chain(t, &t->ds.pNext, ci->pDepthStencilState->pNext, NULL, 0)) != VK_SUCCESS) return r;
+    }
+
+    for (const VkBaseInStructure* p = ci->pNext; p; p = p->pNext) {
+        if (p->sType != VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO) continue;
+        t->rendering = *(const VkPipelineRenderingCreateInfo*)p; t->rendering.pNext = t->next;
+        if (t->rendering.colorAttachmentCount > XENO_MAX_COLOR_ATTACHMENTS) t->rendering.colorAttachmentCount = XENO_MAX_COLOR_ATTACHMENTS;
+        if (t->rendering.colorAttachmentCount) memcpy(t->color_formats, t->rendering.pColorAttachmentFormats, t->rendering.colorAttachmentCount * sizeof(VkFormat));
+        t->rendering.pColorAttachmentFormats = t->color_formats;
+        t->has_rendering = 1;
+    }
+    t->cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    if (ci->pColorBlendState) {
+        t->cb = *ci->pColorBlendState;
+        if ((r = template_chain(t, &t->cb.pNext, ci->pColorBlendState->pNext, NULL, 0)) != VK_SUCCESS) return r;
+    } else if (t->has_rendering) t->cb.attachmentCount = t->rendering.colorAttachmentCount;
+    if (t->cb.attachmentCount > XENO_MAX_COLOR_ATTACHMENTS) t->cb.attachmentCount = XENO_MAX_COLOR_ATTACHMENTS;
+    for (uint32_t i = 0; i < t->cb.attachmentCount; ++i) {
+        if (ci->pColorBlendState && ci->pColorBlendState->pAttachments && !blend_dynamic) t->attachments[i] = ci->pColorBlendState->pAttachments[i];
+        else t->attachments[i].colorWriteMask = 0xF; /* all blend state dynamic: pAttachments may be NULL */
+    }
+    t->cb.pAttachments = t->attachments;
+
+    /* dynamic state list without the states we bake */
+    uint32_t n = ci->pDynamicState ? ci->pDynamicState->dynamicStateCount : 0;
+    t->dyn_list = malloc((n ? n : 1) * sizeof(VkDynamicState));
+    if (!t->dyn_list) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    t->dyn.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    for (uint32_t i = 0; i < n; ++i) {
+        VkDynamicState ds = ci->pDynamicState->pDynamicStates[i]; int idx = dyn_index(ds);
+        if (idx >= 0 && (strip & (1ull << idx))) continue;
+        t->dyn_list[t->dyn.dynamicStateCount++] = ds;
+    }
+    t->dyn.pDynamicStates = t->dyn_list;
+
+    t->layout = ci->layout; retain(emu, RETAIN_LAYOUT, XENO_HANDLE_KEY(ci->layout));
+    t->render_pass = ci->renderPass; t->subpass = ci->subpass; retain(emu, RETAIN_RENDER_PASS, XENO_HANDLE_KEY(ci->renderPass));
+
+    /* static values of the emulated states */
+    xeno_dyn_state_t* s = &t->statics;
+    s->depth_clamp = t->rs.depthClampEnable; s->polygon_mode = t->rs.polygonMode;
+    s->rasterization_samples = t->ms.rasterizationSamples; s->sample_mask = t->sample_mask[0]; s->sample_mask_samples = t->ms.rasterizationSamples;
+    s->alpha_to_coverage = t->ms.alphaToCoverageEnable; s->alpha_to_one = t->ms.alphaToOneEnable;
+    s->logic_op_enable = t->cb.logicOpEnable;
+    s->blend_enable_count = s->blend_eq_count = s->write_mask_count = template_color_count(t);
+    for (uint32_t i = 0; i < t->cb.attachmentCount; ++i) {
+        const VkPipelineColorBlendAttachmentState* a = &t->attachments[i];
+        s->blend_enable[i] = a->blendEnable; s->write_mask[i] = a->colorWriteMask;
+        s->blend_eq[i].srcColorBlendFactor = a->srcColorBlendFactor; s->blend_eq[i].dstColorBlendFactor = a->dstColorBlendFactor;
+        s->blend_eq[i].colorBlendOp = a->colorBlendOp; s->blend_eq[i].srcAlphaBlendFactor = a->srcAlphaBlendFactor;
+        s->blend_eq[i].dstAlphaBlendFactor = a->dstAlphaBlendFactor; s->blend_eq[i].alphaBlendOp = a->alphaBlendOp;
+    }
+    s->vertex_binding_count = t->vi.vertexBindingDescriptionCount; s->vertex_attribute_count = t->vi.vertexAttributeDescriptionCount;
+    for (uint32_t i = 0; i < s->vertex_binding_count; ++i) {
+        xeno_vertex_binding_t b = { t->vi_bindings[i].binding, t->vi_bindings[i].stride, t->vi_bindings[i].inputRate, 1 };
+        s->vertex_bindings[i] = b;
+    }
+    for (uint32_t i = 0; i < s->vertex_attribute_count; ++i) {
+        xeno_vertex_attribute_t a = { t->vi_attributes[i].location, t->vi_attributes[i].binding, t->vi_attributes[i].format, t->vi_attributes[i].offset };
+        s->vertex_attributes[i] = a;
+    }
+    return VK_SUCCESS;
+}
+
+typedef struct emu_compile_ctx { xeno_device_t* dev; const xeno_dyn_template_t* t; const xeno_dyn_state_t* s; } emu_compile_ctx_t;
+
+static VkPipeline template_compile(void* ctx) {
+    emu_compile_ctx_t* c = ctx; const xeno_dyn_template_t* t = c->t; const xeno_dyn_state_t* s = c->s;
+    VkPipelineVertexInputStateCreateInfo vi = t->vi;
+    VkVertexInputBindingDescription vb[XENO_MAX_VERTEX_BINDINGS]; VkVertexInputAttributeDescription va[XENO_MAX_VERTEX_ATTRIBUTES];
+    VkPipelineRasterizationStateCreateInfo rs = t->rs;
+    VkPipelineMultisampleStateCreateInfo ms = t->ms; VkSampleMask sm[2] = { t->sample_mask[0], t->sample_mask[1] };
+    VkPipelineColorBlendStateCreateInfo cb = t->cb; VkPipelineColorBlendAttachmentState att[XENO_MAX_COLOR_ATTACHMENTS];
+    memcpy(att, t->attachments, sizeof(att)); cb.pAttachments = att;
+#define E(name) (t->emu_mask & XENO_DYN_BIT(name))
+    if (E(VERTEX_INPUT)) {
+        vi.vertexBindingDescriptionCount = s->vertex_binding_count; vi.vertexAttributeDescriptionCount = s->vertex_attribute_count;
+        for (uint32_t i = 0; i < s->vertex_binding_count; ++i) {
+            vb[i].binding = s->vertex_bindings[i].binding; vb[i].stride = s->vertex_bindings[i].stride; vb[i].inputRate = (VkVertexInputRate)s->vertex_bindings[i].rate;
+        }
+        for (uint32_t i = 0; i < s->vertex_attribute_count; ++i) {
+            va[i].location = s->vertex_attributes[i].location; va[i].binding = s->vertex_attributes[i].binding;
+            va[i].format = (VkFormat)s->vertex_attributes[i].format; va[i].offset = s->vertex_attributes[i].offset;
+        }
+        vi.pVertexBindingDescriptions = vb; vi.pVertexAttributeDescriptions = va;
+    }
+    if (E(DEPTH_CLAMP_ENABLE)) rs.depthClampEnable = s->depth_clamp;
+    if (E(POLYGON_MODE)) rs.polygonMode = (VkPolygonMode)s->polygon_mode;
+    if (E(RASTERIZATION_SAMPLES) && s->rasterization_samples) ms.rasterizationSamples = (VkSampleCountFlagBits)s->rasterization_samples;
+    if (E(SAMPLE_MASK)) { sm[0] = sm[1] = s->sample_mask; ms.pSampleMask = sm; }
+    else if (ms.pSampleMask) ms.pSampleMask = sm;
+    if (E(ALPHA_TO_COVERAGE_ENABLE)) ms.alphaToCoverageEnable = s->alpha_to_coverage;
+    if (E(ALPHA_TO_ONE_ENABLE)) ms.alphaToOneEnable = s->alpha_to_one;
+    if (E(LOGIC_OP_ENABLE)) cb.logicOpEnable = s->logic_op_enable;
+    for (uint32_t i = 0; i < cb.attachmentCount; ++i) {
+        if (E(COLOR_BLEND_ENABLE)) att[i].blendEnable = s->blend_enable[i];
+        if (E(COLOR_WRITE_MASK)) att[i].colorWriteMask = s->write_mask[i];
+        if (E(COLOR_BLEND_EQUATION)) {
+            const VkColorBlendEquationEXT* e = &s->blend_eq[i];
+            att[i].srcColorBlendFactor = e->srcColorBlendFactor; att[i].dstColorBlendFactor = e->dstColorBlendFactor; att[i].colorBlendOp = e->colorBlendOp;
+            att[i].srcAlphaBlendFactor = e->srcAlphaBlendFactor; att[i].dstAlphaBlendFactor = e->dstAlphaBlendFactor; att[i].alphaBlendOp = e->alphaBlendOp;
+        }
+    }
+#undef E
+    VkGraphicsPipelineCreateInfo ci; memset(&ci, 0, sizeof(ci));
+    ci.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    ci.pNext = t->has_rendering ? (const void*)&t->rendering : t->next;
+    ci.flags = t->flags; ci.stageCount = t->stage_count; ci.pStages = t->stages;
+    ci.pVertexInputState = t->has_ia ? &vi : NULL; ci.pInputAssemblyState = t->has_ia ? &t->ia : NULL;
+    ci.pTessellationState = t->has_ts ? &t->ts : NULL; ci.pViewportState = &t->vp;
+    ci.pRasterizationState = &rs; ci.pMultisampleState = &ms; ci.pDepthStencilState = t->has_ds ? &t->ds : NULL;
+    ci.pColorBlendState = &cb; ci.pDynamicState = &t->dyn;
+    ci.layout = t->layout; ci.renderPass = t->render_pass; ci.subpass = t->subpass; ci.basePipelineIndex = -1;
+    VkPipeline p = VK_NULL_HANDLE;
+    VkResult r = c->dev->vk.vkCreateGraphicsPipelines(c->dev->handle, VK_NULL_HANDLE, 1, &ci, NULL, &p);
+    if (r != VK_SUCCESS) { xlog("dyn_emu: variant compile failed result=%d mask=0x%" PRIx64, (int)r, t->emu_mask); p = VK_NULL_HANDLE; }
+    return p;
+}
+
+static uint64_t requested_dynamic(const VkGraphicsPipelineCreateInfo* ci) {
+    uint64_t m = 0;
+    if (!ci->pDynamicState) return 0;
+    for (uint32_t i = 0; i < ci->pDynamicState->dynamicStateCount; ++i) {
+        int idx = dyn_index(ci->pDynamicState->pDynamicStates[i]);
+        if (idx >= 0) m |= 1ull << idx;
+    }
+    return m;
+}
+
+static VkResult create_one(xeno_device_t* dev, VkPipelineCache cache, const VkGraphicsPipelineCreateInfo* ci, const VkAllocationCallbacks* pAllocator, VkPipeline* out) {
+    xeno_dyn_emu_device_t* emu = dev->dyn_emu;
+    uint64_t strip = requested_dynamic(ci) & ~dev->dyn_native;
+    if (!strip) return dev->vk.vkCreateGraphicsPipelines(dev->handle, cache, 1, ci, pAllocator, out);
+    xeno_dyn_template_t* t = calloc(1, sizeof(*t));
+    if (!t) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    VkResult r = template_build(dev, t, ci, strip);
+    if (r != VK_SUCCESS) { template_free(dev, t); return r; }
+    /* base pipeline: the app's create info with the stripped states static and defaults filled in */
+    VkGraphicsPipelineCreateInfo base = *ci;
+    base.pDynamicState = &t->dyn;
+    if (t->has_ia && (!base.pVertexInputState || (strip & XENO_DYN_BIT(VERTEX_INPUT)))) base.pVertexInputState = &t->vi;
+    if (!base.pMultisampleState || (strip & MS_DYNAMIC_ALL) == MS_DYNAMIC_ALL) base.pMultisampleState = &t->ms;
+    if (!base.pColorBlendState || !base.pColorBlendState->pAttachments || (strip & BLEND_DYNAMIC_ALL) == BLEND_DYNAMIC_ALL) base.pColorBlendState = &t->cb;
+    r = dev->vk.vkCreateGraphicsPipelines(dev->handle, cache, 1, &base, pAllocator, out);
+    if (r != VK_SUCCESS) { template_free(dev, t); return r; }
+    t->base = *out;
+    t->emu_mask = strip & dev->dyn_emulated;
+    if (strip & ~dev->dyn_emulated) atomic_fetch_add(&emu->stripped, 1);
+    if (t->emu_mask && (t->library || t->foreign)) {
+        if (t->library) xlog("dyn_emu: pipeline library or linked pipeline, emulated states stay static mask=0x%" PRIx64, t->emu_mask);
+        else xlog("dyn_emu: pNext sType %d cannot be carried into variants, emulated states stay static mask=0x%" PRIx64, (int)t->foreign, t->emu_mask);
+        atomic_fetch_add(&emu->untemplated, 1);
+        t->emu_mask = 0;
+    }
+    if (!t->emu_mask) { template_free(dev, t); return VK_SUCCESS; }
+    t->id = atomic_fetch_add(&emu->next_id, 1) + 1;
+    t->base_key = template_key(t, &t->statics);
+    xeno_map_put(&emu->templates, XENO_HANDLE_KEY(*out), t);
+    atomic_fetch_add(&emu->pipelines, 1);
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkCreateGraphicsPipelines(VkDevice device, VkPipelineCache pipelineCache, uint32_t createInfoCount,
+                                                                     const VkGraphicsPipelineCreateInfo* pCreateInfos, const VkAllocationCallbacks* pAllocator, VkPipeline* pPipelines) {
+    xeno_device_t* dev = xeno_device_get(device);
+    int any = 0;
+    for (uint32_t i = 0; i < createInfoCount && !any; ++i) any = (requested_dynamic(&pCreateInfos[i]) & ~dev->dyn_native) != 0;
+    if (!any) return dev->vk.vkCreateGraphicsPipelines(device, pipelineCache, createInfoCount, pCreateInfos, pAllocator, pPipelines);
+    VkResult result = VK_SUCCESS;
+    for (uint32_t i = 0; i < createInfoCount; ++i) {
+        VkResult r = create_one(dev, pipelineCache, &pCreateInfos[i], pAllocator, &pPipelines[i]);
+        if (r != VK_SUCCESS) {
+            pPipelines[i] = VK_NULL_HANDLE;
+            if (result == VK_SUCCESS) result = r;
+            if (pCreateInfos[i].flags & VK_PIPELINE_CREATE_EARLY_RETURN_ON_FAILURE_BIT) {
+                for (uint32_t j = i + 1; j < createInfoCount; ++j) pPipelines[j] = VK_NULL_HANDLE;
+                break;
+            }
+        }
+    }
+    return result;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_vkDestroyPipeline(VkDevice device, VkPipeline pipeline, const VkAllocationCallbacks* pAllocator) {
+    xeno_device_t* dev = xeno_device_get(device);
+    xeno_dyn_template_t* t = pipeline ? xeno_map_remove(&dev->dyn_emu->templates, XENO_HANDLE_KEY(pipeline)) : NULL;
+    if (t) template_free(dev, t); /* its variants stay cached and age out through LRU */
+    dev->vk.vkDestroyPipeline(device, pipeline, pAllocator);
+}
+
+struct xeno_dyn_template* xeno_dyn_emu_lookup(xeno_device_t* dev, VkPipeline pipeline) {
+    return xeno_map_get(&dev->dyn_emu->templates, XENO_HANDLE_KEY(pipeline));
+}
+
+void xeno_dyn_emu_prepare_draw(xeno_cb_t* cb) {
+    xeno_device_t* dev = cb->dev; xeno_dyn_emu_device_t* emu = dev->dyn_emu;
+    xeno_dyn_template_t* t = cb->emu;
+    if (!(cb->dyn_dirty & t->emu_mask) && cb->emu_pipeline) return;
+    xeno_dyn_state_t s = t->statics;
+    dyn_overlay(&s, &cb->dyn, t->emu_mask & cb->dyn_set);
+    cb->dyn_dirty &= ~t->emu_mask;
+    xeno_variant_key_t k = template_key(t, &s);
+    VkPipeline pipeline;
+    if (k.h1 == t->base_key.h1 && k.h2 == t->base_key.h2) {
+        pipeline = t->base; atomic_fetch_add(&emu->base_hits, 1);
+    } else {
+        emu_compile_ctx_t ctx = { dev, t, &s };
+        int uncached = 0;
+        pipeline = xeno_variant_get(&emu->cache, &k, template_compile, &ctx, &uncached);
+        if (pipeline && uncached) xeno_cb_own_pipeline(cb, pipeline);
+        if (!pipeline) pipeline = t->base; /* keep drawing with the static values rather than nothing */
+    }
+    if (pipeline != cb->emu_pipeline) {
+        dev->vk.vkCmdBindPipeline(cb->handle, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        cb->emu_pipeline = pipeline;
+        atomic_fetch_add(&emu->variant_binds, 1);
+    }
+}
+
+/* --- device lifetime / routing --- */
+int xeno_dyn_emu_init(xeno_device_t* dev) {
+    uint64_t m = 0;
+    if (dev->emulate & XENO_EMULATE_EXTENDED_DYNAMIC_STATE3) m |= XENO_DYN_EDS3_MASK;
+    if (dev->emulate & XENO_EMULATE_VERTEX_INPUT_DYNAMIC_STATE) m |= XENO_DYN_BIT(VERTEX_INPUT);
+    m &= ~dev->dyn_native;
+    if (!m) return 0;
+#define XENO_DYN_SWITCH(name, state, fn) \
+    if ((m & XENO_DYN_BIT(name)) && !xeno_env_bool("XCLIPSE_DYN_" #name, 1)) { m &= ~XENO_DYN_BIT(name); xlog("dyn_emu: " #name " emulation disabled"); }
+    XENO_DYN_STATES(XENO_DYN_SWITCH)
+#undef XENO_DYN_SWITCH
+    xeno_dyn_emu_device_t* emu = calloc(1, sizeof(*emu)); if (!emu) return -1;
+    long cap = xeno_env_long("XCLIPSE_DYN_VARIANT_CAPACITY", 2048);
+    if (cap < 64) cap = 64;
+    if (cap > (1l << 20)) cap = 1l << 20;
+    if (xeno_variant_cache_init(&emu->cache, dev, (uint32_t)cap) != 0) { free(emu); return -1; }
+    xeno_map_init(&emu->templates, 1024); xeno_map_init(&emu->retained, 1024);
+    pthread_mutex_init(&emu->retain_lock, NULL);
+    dev->dyn_emulated = m; dev->dyn_emu = emu;
+    xlog("dyn_emu: emulating dynamic state mask=0x%" PRIx64 " capacity=%u", m, emu->cache.capacity);
+    return 0;
+}
+
+static int template_free_fn(uint64_t key, void* val, void* ctx) { (void)key; template_free(ctx, val); return 1; }
+static int retained_free_fn(uint64_t key, void* val, void* ctx) {
+    retained_t* r = val;
+    if (r->destroy_pending) destroy_handle(ctx, r->type, key);
+    free(r); return 1;
+}
+
+void xeno_dyn_emu_destroy(xeno_device_t* dev) {
+    xeno_dyn_emu_device_t* emu = dev->dyn_emu;
+    if (!emu) return;
+    xeno_map_foreach(&emu->templates, template_free_fn, dev);
+    xeno_map_foreach(&emu->retained, retained_free_fn, dev);
+    xeno_variant_cache_destroy(&emu->cache);
+    xeno_map_destroy(&emu->templates); xeno_map_destroy(&emu->retained);
+    pthread_mutex_destroy(&emu->retain_lock);
+    free(emu); dev->dyn_emu = NULL;
+}
+
+uint32_t xeno_dyn_emu_trim(xeno_device_t* dev) {
+    return dev->dyn_emu ? xeno_variant_trim(&dev->dyn_emu->cache, dev->dyn_emu->cache.capacity / 4) : 0;
+}
+
+PFN_vkVoidFunction xeno_dyn_emu_proc(xeno_device_t* dev, const char* name) {
+    if (!dev->dyn_emu) return NULL;
+    if (strcmp(name, "vkCreateGraphicsPipelines") == 0) return (PFN_vkVoidFunction)xeno_vkCreateGraphicsPipelines;
+    if (strcmp(name, "vkDestroyPipeline") == 0) return (PFN_vkVoidFunction)xeno_vkDestroyPipeline;
+    if (strcmp(name, "vkDestroyShaderModule") == 0) return (PFN_vkVoidFunction)xeno_vkDestroyShaderModule;
+    if (strcmp(name, "vkDestroyPipelineLayout") == 0) return (PFN_vkVoidFunction)xeno_vkDestroyPipelineLayout;
+    if (strcmp(name, "vkDestroyRenderPass") == 0) return (PFN_vkVoidFunction)xeno_vkDestroyRenderPass;
+    return NULL;
+}
+
+void xeno_dyn_emu_report(FILE* f, xeno_device_t* dev) {
+    xeno_dyn_emu_device_t* emu = dev->dyn_emu;
+    fprintf(f, "  \"dynamic_state_emulation\": {\"emulated_mask\": \"0x%" PRIx64 "\"", dev->dyn_emulated);
+    if (emu) {
+        fprintf(f, ", \"pipelines\": %" PRIu64 ", \"stripped_only\": %" PRIu64 ", \"untemplated\": %" PRIu64 ", \"base_hits\": %" PRIu64 ", \"variant_binds\": %" PRIu64 ", ",
+                atomic_load(&emu->pipelines), atomic_load(&emu->stripped), atomic_load(&emu->untemplated), atomic_load(&emu->base_hits), atomic_load(&emu->variant_binds));
+        xeno_variant_report(f, &emu->cache);
+    }
+    fprintf(f, "}");
+}
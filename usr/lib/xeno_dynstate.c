@@ -0,0 +1,229 @@
+/* xeno_dynstate.c - dynamic state bookkeeping shared by the pipeline-variant emulations
+ *
+ * Provides:
+ * - detection of which dynamic states the downstream driver can set itself
+ * - compact packing of the states the wrapper has to bake into a pipeline (variant keys)
+ * - filling fixed-function create info from tracked state
+ * - replaying natively dynamic state after an app pipeline clobbered it
+ */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include "xeno_internal.h"
+
+static const VkDynamicState dyn_vk_state[XENO_DYN_COUNT] = {
+#define XENO_DYN_VK(name, vk, fn) vk,
+    XENO_DYN_STATES(XENO_DYN_VK)
+#undef XENO_DYN_VK
+};
+
+uint64_t xeno_dyn_native_mask(const xeno_dispatch_t* vk) {
+    uint64_t m = 0;
+#define XENO_DYN_NATIVE(name, state, fn) if (vk->fn) m |= XENO_DYN_BIT(name);
+    XENO_DYN_STATES(XENO_DYN_NATIVE)
+#undef XENO_DYN_NATIVE
+    return m | XENO_DYN_CORE_MASK;
+}
+
+uint32_t xeno_dyn_pack(const xeno_dyn_state_t* s, uint64_t baked, uint32_t color_count, uint32_t* out) {
+    uint32_t n = 0;
+    if (color_count > XENO_MAX_COLOR_ATTACHMENTS) color_count = XENO_MAX_COLOR_ATTACHMENTS;
+    baked &= ~XENO_DYN_CORE_MASK;
+    out[n++] = (uint32_t)baked; out[n++] = (uint32_t)(baked >> 32);
+#define B(name) (baked & XENO_DYN_BIT(name))
+    if (B(VIEWPORT_WITH_COUNT)) out[n++] = s->viewport_count;
+    if (B(SCISSOR_WITH_COUNT)) out[n++] = s->scissor_count;
+    if (B(CULL_MODE)) out[n++] = s->cull_mode;
+    if (B(FRONT_FACE)) out[n++] = s->front_face;
+    if (B(PRIMITIVE_TOPOLOGY)) out[n++] = s->topology;
+    if (B(DEPTH_TEST_ENABLE)) out[n++] = s->depth_test;
+    if (B(DEPTH_WRITE_ENABLE)) out[n++] = s->depth_write;
+    if (B(DEPTH_COMPARE_OP)) out[n++] = s->depth_compare;
+    if (B(DEPTH_BOUNDS_TEST_ENABLE)) out[n++] = s->depth_bounds_test;
+    if (B(STENCIL_TEST_ENABLE)) out[n++] = s->stencil_test;
+    if (B(STENCIL_OP)) for (int f = 0; f < 2; ++f) {
+        out[n++] = s->stencil_op[f].fail; out[n++] = s->stencil_op[f].pass;
+        out[n++] = s->stencil_op[f].depth_fail; out[n++] = s->stencil_op[f].compare;
+    }
+    if (B(RASTERIZER_DISCARD_ENABLE)) out[n++] = s->rasterizer_discard;
+    if (B(DEPTH_BIAS_ENABLE)) out[n++] = s->depth_bias_enable;
+    if (B(PRIMITIVE_RESTART_ENABLE)) out[n++] = s->primitive_restart;
+    if (B(PATCH_CONTROL_POINTS)) out[n++] = s->patch_control_points;
+    if (B(LOGIC_OP)) out[n++] = s->logic_op;
+    if (B(DEPTH_CLAMP_ENABLE)) out[n++] = s->depth_clamp;
+    if (B(POLYGON_MODE)) out[n++] = s->polygon_mode;
+    if (B(RASTERIZATION_SAMPLES)) out[n++] = s->rasterization_samples;
+    if (B(SAMPLE_MASK)) out[n++] = s->sample_mask;
+    if (B(ALPHA_TO_COVERAGE_ENABLE)) out[n++] = s->alpha_to_coverage;
+    if (B(ALPHA_TO_ONE_ENABLE)) out[n++] = s->alpha_to_one;
+    if (B(LOGIC_OP_ENABLE)) out[n++] = s->logic_op_enable;
+    if (B(COLOR_BLEND_ENABLE)) for (uint32_t i = 0; i < color_count; ++i) out[n++] = s->blend_enable[i];
+    if (B(COLOR_BLEND_EQUATION)) for (uint32_t i = 0; i < color_count; ++i) {
+        const VkColorBlendEquationEXT* e = &s->blend_eq[i];
+        out[n++] = e->srcColorBlendFactor; out[n++] = e->dstColorBlendFactor; out[n++] = e->colorBlendOp;
+        out[n++] = e->srcAlphaBlendFactor; out[n++] = e->dstAlphaBlendFactor; out[n++] = e->alphaBlendOp;
+    }
+    if (B(COLOR_WRITE_MASK)) for (uint32_t i = 0; i < color_count; ++i) out[n++] = s->write_mask[i];
+    if (B(VERTEX_INPUT)) {
+        out[n++] = s->vertex_binding_count; out[n++] = s->vertex_attribute_count;
+        memcpy(&out[n], s->vertex_bindings, s->vertex_binding_count * sizeof(xeno_vertex_binding_t)); n += s->vertex_binding_count * 4;
+        memcpy(&out[n], s->vertex_attributes, s->vertex_attribute_count * sizeof(xeno_vertex_attribute_t)); n += s->vertex_attribute_count * 4;
+    }
+#undef B
+    return n;
+}
+
+static void fill_stencil(VkStencilOpState* o, const xeno_dyn_state_t* s, int face) {
+    o->failOp = (VkStencilOp)s->stencil_op[face].fail; o->passOp = (VkStencilOp)s->stencil_op[face].pass;
+    o->depthFailOp = (VkStencilOp)s->stencil_op[face].depth_fail; o->compareOp = (VkCompareOp)s->stencil_op[face].compare;
+    o->compareMask = s->stencil_compare[face]; o->writeMask = s->stencil_write[face]; o->reference = s->stencil_ref[face];
+}
+
+void xeno_dyn_fill_pipeline(xeno_dyn_pipeline_t* p, const xeno_dyn_state_t* s, uint64_t native, VkShaderStageFlags stages,
+                            const xeno_render_formats_t* rf, VkGraphicsPipelineCreateInfo* ci) {
+    memset(p, 0, sizeof(*p));
+    int mesh = (stages & VK_SHADER_STAGE_MESH_BIT_EXT) != 0;
+    int tess = (stages & VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT) != 0;
+    uint64_t dyn = native | XENO_DYN_CORE_MASK;
+    /* WITH_COUNT and the plain variants are mutually exclusive in one pipeline */
+    if (dyn & XENO_DYN_BIT(VIEWPORT_WITH_COUNT)) dyn &= ~XENO_DYN_BIT(VIEWPORT);
+    if (dyn & XENO_DYN_BIT(SCISSOR_WITH_COUNT)) dyn &= ~XENO_DYN_BIT(SCISSOR);
+    if (mesh) dyn &= ~(XENO_DYN_BIT(VERTEX_INPUT) | XENO_DYN_BIT(PRIMITIVE_TOPOLOGY) | XENO_DYN_BIT(PRIMITIVE_RESTART_ENABLE));
+    if (!tess) dyn &= ~XENO_DYN_BIT(PATCH_CONTROL_POINTS);
+
+    p->vi.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    p->vi.vertexBindingDescriptionCount = s->vertex_binding_count;
+    p->vi.vertexAttributeDescriptionCount = s->vertex_attribute_count;
+    for (uint32_t i = 0; i < s->vertex_binding_count; ++i) {
+        p->vi_bindings[i].binding = s->vertex_bindings[i].binding; p->vi_bindings[i].stride = s->vertex_bindings[i].stride;
+        p->vi_bindings[i].inputRate = (VkVertexInputRate)s->vertex_bindings[i].rate;
+    }
+    for (uint32_t i = 0; i < s->vertex_attribute_count; ++i) {
+        p->vi_attributes[i].location = s->vertex_attributes[i].location; p->vi_attributes[i].binding = s->vertex_attributes[i].binding;
+        p->vi_attributes[i].format = (VkFormat)s->vertex_attributes[i].format; p->vi_attributes[i].offset = s->vertex_attributes[i].offset;
+    }
+    p->vi.pVertexBindingDescriptions = p->vi_bindings; p->vi.pVertexAttributeDescriptions = p->vi_attributes;
+
+    p->ia.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    p->ia.topology = (VkPrimitiveTopology)s->topology; p->ia.primitiveRestartEnable = s->primitive_restart;
+    p->ts.sType = VK_STRUCTURE_TYPE_PIPELINE_TESSELLATION_STATE_CREATE_INFO;
+    p->ts.patchControlPoints = s->patch_control_points ? s->patch_control_points : 1;
+
+    p->vp.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    p->vp.viewportCount = (dyn & XENO_DYN_BIT(VIEWPORT_WITH_COUNT)) ? 0 : (s->viewport_count ? s->viewport_count : 1);
+    p->vp.scissorCount = (dyn & XENO_DYN_BIT(SCISSOR_WITH_COUNT)) ? 0 : (s->scissor_count ? s->scissor_count : 1);
+
+    p->rs.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    p->rs.depthClampEnable = s->depth_clamp; p->rs.rasterizerDiscardEnable = s->rasterizer_discard;
+    p->rs.polygonMode = (VkPolygonMode)s->polygon_mode; p->rs.cullMode = s->cull_mode; p->rs.frontFace = (VkFrontFace)s->front_face;
+    p->rs.depthBiasEnable = s->depth_bias_enable; p->rs.lineWidth = 1.0f;
+
+    p->ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    p->ms.rasterizationSamples = s->rasterization_samples ? (VkSampleCountFlagBits)s->rasterization_samples : VK_SAMPLE_COUNT_1_BIT;
+    p->sample_mask[0] = p->sample_mask[1] = s->sample_mask;
+    if (!(dyn & XENO_DYN_BIT(SAMPLE_MASK))) p->ms.pSampleMask = p->sample_mask;
+    p->ms.alphaToCoverageEnable = s->alpha_to_coverage; p->ms.alphaToOneEnable = s->alpha_to_one;
+
+    p->ds.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    p->ds.depthTestEnable = s->depth_test; p->ds.depthWriteEnable = s->depth_write; p->ds.depthCompareOp = (VkCompareOp)s->depth_compare;
+    p->ds.depthBoundsTestEnable = s->depth_bounds_test; p->ds.stencilTestEnable = s->stencil_test;
+    fill_stencil(&p->ds.front, s, 0); fill_stencil(&p->ds.back, s, 1);
+    p->ds.minDepthBounds = s->depth_bounds[0]; p->ds.maxDepthBounds = s->depth_bounds[1];
+
+    uint32_t colors = rf ? rf->color_count : 0;
+    if (colors > XENO_MAX_COLOR_ATTACHMENTS) colors = XENO_MAX_COLOR_ATTACHMENTS;
+    p->cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    p->cb.logicOpEnable = s->logic_op_enable; p->cb.logicOp = (VkLogicOp)s->logic_op;
+    p->cb.attachmentCount = colors; p->cb.pAttachments = p->attachments;
+    for (uint32_t i = 0; i < colors; ++i) {
+        VkPipelineColorBlendAttachmentState* a = &p->attachments[i]; const VkColorBlendEquationEXT* e = &s->blend_eq[i];
+        a->blendEnable = s->blend_enable[i];
+        a->srcColorBlendFactor = e->srcColorBlendFactor; a->dstColorBlendFactor = e->dstColorBlendFactor; a->colorBlendOp = e->colorBlendOp;
+        a->srcAlphaBlendFactor = e->srcAlphaBlendFactor; a->dstAlphaBlendFactor = e->dstAlphaBlendFactor; a->alphaBlendOp = e->alphaBlendOp;
+        a->colorWriteMask = s->write_mask[i];
+    }
+    memcpy(p->cb.blendConstants, s->blend_constants, sizeof(p->cb.blendConstants));
+
+    p->dyn.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    for (int i = 0; i < XENO_DYN_COUNT; ++i) if (dyn & (1ull << i)) p->dyn_list[p->dyn.dynamicStateCount++] = dyn_vk_state[i];
+    p->dyn.pDynamicStates = p->dyn_list;
+
+    p->rendering.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
+    if (rf) {
+        p->rendering.viewMask = rf->view_mask; p->rendering.colorAttachmentCount = colors;
+        p->rendering.pColorAttachmentFormats = rf->color;
+        p->rendering.depthAttachmentFormat = rf->depth; p->rendering.stencilAttachmentFormat = rf->stencil;
+    }
+
+    ci->sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    ci->pNext = &p->rendering;
+    ci->pVertexInputState = mesh ? NULL : &p->vi;
+    ci->pInputAssemblyState = mesh ? NULL : &p->ia;
+    ci->pTessellationState = tess ? &p->ts : NULL;
+    ci->pViewportState = &p->vp; ci->pRasterizationState = &p->rs; ci->pMultisampleState = &p->ms;
+    ci->pDepthStencilState = &p->ds; ci->pColorBlendState = &p->cb; ci->pDynamicState = &p->dyn;
+    ci->renderPass = VK_NULL_HANDLE; ci->subpass = 0;
+}
+
+void xeno_dyn_replay(xeno_device_t* dev, VkCommandBuffer cb, const xeno_dyn_state_t* s, uint64_t set_mask) {
+    const xeno_dispatch_t* vk = &dev->vk;
+    uint64_t m = set_mask & dev->dyn_native;
+#define R(name) (m & XENO_DYN_BIT(name))
+    if (R(VIEWPORT_WITH_COUNT)) vk->vkCmdSetViewportWithCount(cb, s->viewport_count, s->viewports);
+    else if (R(VIEWPORT) && s->viewport_count) vk->vkCmdSetViewport(cb, 0, s->viewport_count, s->viewports);
+    if (R(SCISSOR_WITH_COUNT)) vk->vkCmdSetScissorWithCount(cb, s->scissor_count, s->scissors);
+    else if (R(SCISSOR) && s->scissor_count) vk->vkCmdSetScissor(cb, 0, s->scissor_count, s->scissors);
+    if (R(LINE_WIDTH)) vk->vkCmdSetLineWidth(cb, s->line_width);
+    if (R(DEPTH_BIAS)) vk->vkCmdSetDepthBias(cb, s->depth_bias[0], s->depth_bias[1], s->depth_bias[2]);
+    if (R(BLEND_CONSTANTS)) vk->vkCmdSetBlendConstants(cb, s->blend_constants);
+    if (R(DEPTH_BOUNDS)) vk->vkCmdSetDepthBounds(cb, s->depth_bounds[0], s->depth_bounds[1]);
+    for (int f = 0; f < 2; ++f) {
+        VkStencilFaceFlags face = f ? VK_STENCIL_FACE_BACK_BIT : VK_STENCIL_FACE_FRONT_BIT;
+        if (R(STENCIL_COMPARE_MASK)) vk->vkCmdSetStencilCompareMask(cb, face, s->stencil_compare[f]);
+        if (R(STENCIL_WRITE_MASK)) vk->vkCmdSetStencilWriteMask(cb, face, s->stencil_write[f]);
+        if (R(STENCIL_REFERENCE)) vk->vkCmdSetStencilReference(cb, face, s->stencil_ref[f]);
+        if (R(STENCIL_OP)) vk->vkCmdSetStencilOp(cb, face, (VkStencilOp)s->stencil_op[f].fail, (VkStencilOp)s->stencil_op[f].pass,
+                                                 (VkStencilOp)s->stencil_op[f].depth_fail, (VkCompareOp)s->stencil_op[f].compare);
+    }
+    if (R(CULL_MODE)) vk->vkCmdSetCullMode(cb, s->cull_mode);
+    if (R(FRONT_FACE)) vk->vkCmdSetFrontFace(cb, (VkFrontFace)s->front_face);
+    if (R(PRIMITIVE_TOPOLOGY)) vk->vkCmdSetPrimitiveTopology(cb, (VkPrimitiveTopology)s->topology);
+    if (R(DEPTH_TEST_ENABLE)) vk->vkCmdSetDepthTestEnable(cb, s->depth_test);
+    if (R(DEPTH_WRITE_ENABLE)) vk->vkCmdSetDepthWriteEnable(cb, s->depth_write);
+    if (R(DEPTH_COMPARE_OP)) vk->vkCmdSetDepthCompareOp(cb, (VkCompareOp)s->depth_compare);
+    if (R(DEPTH_BOUNDS_TEST_ENABLE)) vk->vkCmdSetDepthBoundsTestEnable(cb, s->depth_bounds_test);
+    if (R(STENCIL_TEST_ENABLE)) vk->vkCmdSetStencilTestEnable(cb, s->stencil_test);
+    if (R(RASTERIZER_DISCARD_ENABLE)) vk->vkCmdSetRasterizerDiscardEnable(cb, s->rasterizer_discard);
+    if (R(DEPTH_BIAS_ENABLE)) vk->vkCmdSetDepthBiasEnable(cb, s->depth_bias_enable);
+    if (R(PRIMITIVE_RESTART_ENABLE)) vk->vkCmdSetPrimitiveRestartEnable(cb, s->primitive_restart);
+    if (R(PATCH_CONTROL_POINTS)) vk->vkCmdSetPatchControlPointsEXT(cb, s->patch_control_points);
+    if (R(LOGIC_OP)) vk->vkCmdSetLogicOpEXT(cb, (VkLogicOp)s->logic_op);
+    if (R(DEPTH_CLAMP_ENABLE)) vk->vkCmdSetDepthClampEnableEXT(cb, s->depth_clamp);
+    if (R(POLYGON_MODE)) vk->vkCmdSetPolygonModeEXT(cb, (VkPolygonMode)s->polygon_mode);
+    if (R(RASTERIZATION_SAMPLES)) vk->vkCmdSetRasterizationSamplesEXT(cb, (VkSampleCountFlagBits)s->rasterization_samples);
+    /* the mask's length follows the sample count: nothing to replay before one is known */
+    uint32_t samples = s->rasterization_samples ? s->rasterization_samples : s->sample_mask_samples;
+    if (R(SAMPLE_MASK) && samples) vk->vkCmdSetSampleMaskEXT(cb, (VkSampleCountFlagBits)samples, &s->sample_mask);
+    if (R(ALPHA_TO_COVERAGE_ENABLE)) vk->vkCmdSetAlphaToCoverageEnableEXT(cb, s->alpha_to_coverage);
+    if (R(ALPHA_TO_ONE_ENABLE)) vk->vkCmdSetAlphaToOneEnableEXT(cb, s->alpha_to_one);
+    if (R(LOGIC_OP_ENABLE)) vk->vkCmdSetLogicOpEnableEXT(cb, s->logic_op_enable);
+    /* only the attachments the app set: the others hold no value of its own */
+    if (R(COLOR_BLEND_ENABLE) && s->blend_enable_count) vk->vkCmdSetColorBlendEnableEXT(cb, 0, s->blend_enable_count, s->blend_enable);
+    if (R(COLOR_BLEND_EQUATION) && s->blend_eq_count) vk->vkCmdSetColorBlendEquationEXT(cb, 0, s->blend_eq_count, s->blend_eq);
+    if (R(COLOR_WRITE_MASK) && s->write_mask_count) vk->vkCmdSetColorWriteMaskEXT(cb, 0, s->write_mask_count, s->write_mask);
+    if (R(VERTEX_INPUT)) {
+        VkVertexInputBindingDescription2EXT b[XENO_MAX_VERTEX_BINDINGS]; VkVertexInputAttributeDescription2EXT a[XENO_MAX_VERTEX_ATTRIBUTES];
+        for (uint32_t i = 0; i < s->vertex_binding_count; ++i) {
+            memset(&b[i], 0, sizeof(b[i])); b[i].sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT;
+            b[i].binding = s->vertex_bindings[i].binding; b[i].stride = s->vertex_bindings[i].stride;
+            b[i].inputRate = (VkVertexInputRate)s->vertex_bindings[i].rate; b[i].divisor = s->vertex_bindings[i].divisor;
+        }
+        for (uint32_t i = 0; i < s->vertex_attribute_count; ++i) {
+            memset(&a[i], 0, sizeof(a[i])); a[i].sType = VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT;
+            a[i].location = s->vertex_attributes[i].location; a[i].binding = s->vertex_attributes[i].binding;
+            a[i].format = (VkFormat)s->vertex_attributes[i].format; a[i].offset = s->vertex_attributes[i].offset;
+        }
+        vk->vkCmdSetVertexInputEXT(cb, s->vertex_binding_count, b, s->vertex_attribute_count, a);
+    }
+#undef R
+}
@@ -0,0 +1,775 @@
+/* xeno_fence.c - fence pooling and fences carried by per-queue timeline semaphores
+ *
+ * Titles create and destroy fences every frame and poll them with vkGetFenceStatus, a kernel round
+ * trip each. With XCLIPSE_FENCE_VIRTUAL=1 the app's VkFence handles are the wrapper's: creating,
+ * destroying and resetting one does not reach the driver, and the driver fences behind them are
+ * recycled through a pool.
+ *
+ * When the app enabled timelineSemaphore, a submit's fence becomes one more signal operation in its
+ * last batch, of the next value of a timeline semaphore the module keeps per queue; signal
+ * operations wait for everything earlier on the queue, so the value is reached exactly when the
+ * fence would have signalled. The highest value each timeline was seen at is cached: a status check
+ * of a fence seen signalled, never submitted or at a value the cache covers costs no driver call,
+ * and vkWaitForFences on any number of such fences is one vkWaitSemaphores. Fences the driver must
+ * signal itself (vkQueueBindSparse, vkAcquireNextImageKHR, submits with pNext chains the module
+ * does not extend, devices without timelines) are backed by a pooled driver fence, reset lazily
+ * before it is submitted again.
+ *
+ * A fence waited for before it was submitted (virtual queues submit on their dispatcher) waits for
+ * the submission first. Debug utils names and tags of fences are dropped: the driver does not know
+ * the handles. The module stays off when an enabled extension hands fences to the driver elsewhere
+ * (external fences, display events, swapchain present fences).
+ *
+ * Waits spin before they block. Each queue keeps how long its work takes from submit to signal
+ * (learned from waits on a single fence that ended spinning; one that blocked includes the driver's
+ * wakeup and only lowers it) and a spin budget: a wait whose fences are expected to signal within
+ * the budget polls with a zero timeout, pausing the core in between, and blocks in the driver only
+ * once the budget is spent. A spin that ends with the fences signalled grows the
+ * queue's budget, one that runs out halves it; a budget halved to nothing is tried again every
+ * XF_SPIN_PROBE waits. The app's vkWaitSemaphores has no queue to predict from and spins on a
+ * device-wide budget learned the same way. Wait times are reported as log2 histograms, separately
+ * for waits that ended spinning and waits that blocked.
+ *
+ * Knobs (XCLIPSE_FENCE_SPIN_US can be set per title by appending _<PROCESS_NAME>):
+ *   XCLIPSE_FENCE_VIRTUAL=1      wrapper fences: pooled, status answered from the cache
+ *   XCLIPSE_FENCE_TIMELINE=0     back every fence with a driver fence even when timelines are enabled
+ *   XCLIPSE_FENCE_POOL=N         idle driver fences kept for reuse (default 64)
+ *   XCLIPSE_FENCE_SPIN_US=N      longest a wait spins before it blocks (default 200, 0 = always block)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+#define XF_STACK_BYTES 1024
+#define XF_STACK_FENCES 16
+#define XF_POLL_NS 1000000ull       /* waits for any fence among unsubmitted ones look again this often */
+#define XF_SPIN_MIN_NS 1000ull      /* budgets below are spent */
+#define XF_SPIN_PROBE 64            /* a spent budget is tried again once in this many waits */
+#define XF_SPIN_PAUSES 32           /* pauses between two polls */
+#define XF_SPIN_YIELD_AFTER 16      /* polls before the spinning thread also yields the core */
+#define XF_HIST 16                  /* wait time buckets: [2^(i-1), 2^i) us, the last one open */
+
+#if defined(__aarch64__) || defined(__arm__)
+#define XF_PAUSE() __asm__ __volatile__("yield")
+#elif defined(__x86_64__) || defined(__i386__)
+#define XF_PAUSE() __builtin_ia32_pause()
+#else
+#define XF_PAUSE() ((void)0)
+#endif
+
+enum { XF_UNSIGNALED, XF_SIGNALED, XF_TIMELINE, XF_REAL };
+enum { XF_CALL_CREATE, XF_CALL_DESTROY, XF_CALL_RESET, XF_CALL_STATUS, XF_CALL_WAIT, XF_CALLS };
+static const char* call_names[XF_CALLS] = { "create", "destroy", "reset", "status", "wait" };
+enum { XF_ENDED_SPINNING, XF_ENDED_BLOCKED, XF_ENDINGS };
+
+typedef struct xf_spin {
+    _Atomic uint64_t ns;            /* learned budget, at most the device's cap */
+    _Atomic uint32_t skipped;       /* waits that found the budget spent */
+} xf_spin_t;
+
+typedef struct xf_queue {
+    VkQueue queue;
+    struct xf_queue* next;
+    VkSemaphore semaphore;          /* the queue's timeline, VK_NULL_HANDLE without timelines */
+    _Atomic uint64_t issued;        /* last value a submit on the queue signals */
+    _Atomic uint64_t reached;       /* highest value the semaphore was seen at */
+    _Atomic uint64_t busy_ns;       /* average time from submit to signal, 0 until a wait measured it */
+    xf_spin_t spin;
+} xf_queue_t;
+
+typedef struct xf_fence {
+    _Atomic int state;
+    xf_queue_t* queue; uint64_t value;    /* the queue submitted to, and the value of XF_TIMELINE; written before the state */
+    uint64_t submitted_ns;
+    VkFence real;                   /* driver fence, from its first use until the pool is full */
+    int dirty;                      /* real may be signalled: reset before it is submitted again */
+    struct xf_fence* next_free;
+    struct xf_fence* next_all;
+} xf_fence_t;
+
+#define XF_HOOKS(X) \
+    X(vkCreateFence) X(vkDestroyFence) X(vkResetFences) X(vkGetFenceStatus) X(vkWaitForFences) \
+    X(vkQueueSubmit) X(vkQueueSubmit2) X(vkQueueBindSparse) X(vkAcquireNextImageKHR) X(vkAcquireNextImage2KHR) \
+    X(vkQueueWaitIdle) X(vkDeviceWaitIdle) X(vkQueuePresentKHR) X(vkWaitSemaphores) X(vkSetDebugUtilsObjectNameEXT) X(vkSetDebugUtilsObjectTagEXT)
+
+typedef struct xeno_fence_device {
+    xeno_device_t* dev;
+#define XF_NEXT(fn) PFN_##fn next_##fn;
+    XF_HOOKS(XF_NEXT)
+#undef XF_NEXT
+    int timeline;
+    uint32_t pool_cap;
+    uint64_t spin_cap;              /* ns, 0 = waits block right away */
+    char title[96];
+    pthread_mutex_t lock;           /* pool, fence list, queue inserts, submission wakeups */
+    pthread_cond_t submitted;
+    _Atomic int waiters;            /* threads waiting for a fence to be submitted */
+    xf_fence_t* free; uint32_t pooled;   /* pooled: free fences holding a driver fence */
+    xf_fence_t* all;
+    _Atomic(xf_queue_t*) queues;
+    _Atomic uint64_t app_calls[XF_CALLS], driver_calls[XF_CALLS];
+    _Atomic uint64_t frames, timeline_fences, driver_fences, merged_waits;
+    xf_spin_t semaphore_spin;       /* the app's vkWaitSemaphores */
+    _Atomic uint64_t spin_hits, spin_misses, spin_ns, wait_hist[XF_ENDINGS][XF_HIST];
+} xeno_fence_device_t;
+
+static xf_fence_t* xf(VkFence fence) { return (xf_fence_t*)(uintptr_t)fence; }
+
+static void count(_Atomic uint64_t* c, uint64_t n) { atomic_fetch_add_explicit(c, n, memory_order_relaxed); }
+
+static void note_reached(xf_queue_t* t, uint64_t value) {
+    uint64_t cur = atomic_load(&t->reached);
+    while (value > cur && !atomic_compare_exchange_weak(&t->reached, &cur, value)) {}
+}
+
+static uint64_t deadline_of(uint64_t timeout) {
+    uint64_t now = xeno_now_ns();
+    return timeout >= UINT64_MAX - now ? UINT64_MAX : now + timeout;
+}
+
+static uint64_t remaining(uint64_t deadline) {
+    if (deadline == UINT64_MAX) return UINT64_MAX;
+    uint64_t now = xeno_now_ns();
+    return now >= deadline ? 0 : deadline - now;
+}
+
+/* --- per-queue state --- */
+static xf_queue_t* queue_find(xeno_fence_device_t* fd, VkQueue queue) {
+    for (xf_queue_t* t = atomic_load_explicit(&fd->queues, memory_order_acquire); t; t = t->next) if (t->queue == queue) return t;
+    return NULL;
+}
+
+static xf_queue_t* queue_get(xeno_fence_device_t* fd, VkQueue queue) {
+    xf_queue_t* t = queue_find(fd, queue);
+    if (t) return t;
+    xeno_device_t* dev = fd->dev;
+    pthread_mutex_lock(&fd->lock);
+    if (!(t = queue_find(fd, queue)) && (t = calloc(1, sizeof(*t)))) {
+        VkSemaphoreTypeCreateInfo type = { VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO, NULL, VK_SEMAPHORE_TYPE_TIMELINE, 0 };
+        VkSemaphoreCreateInfo ci = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, &type, 0 };
+        if (fd->timeline && dev->vk.vkCreateSemaphore(dev->handle, &ci, NULL, &t->semaphore) != VK_SUCCESS) {
+            xlog("fence: no timeline semaphore for queue %p, its fences use driver fences", (void*)queue);
+            t->semaphore = VK_NULL_HANDLE;
+        }
+        t->queue = queue;
+        atomic_init(&t->spin.ns, fd->spin_cap);
+        t->next = atomic_load(&fd->queues);
+        atomic_store_explicit(&fd->queues, t, memory_order_release);
+    }
+    pthread_mutex_unlock(&fd->lock);
+    return t;
+}
+
+/* --- fence states --- */
+static void publish(xeno_fence_device_t* fd, xf_fence_t* f, int state) {
+    atomic_store(&f->state, state);
+    if (!atomic_load(&fd->waiters)) return;
+    pthread_mutex_lock(&fd->lock);
+    pthread_cond_broadcast(&fd->submitted);
+    pthread_mutex_unlock(&fd->lock);
+}
+
+/* the driver fence of f, unsignalled, for an operation the driver signals it with */
+static VkFence real_fence(xeno_fence_device_t* fd, xf_fence_t* f) {
+    xeno_device_t* dev = fd->dev;
+    if (!f->real) {
+        VkFenceCreateInfo ci = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, NULL, 0 };
+        VkFence real;
+        count(&fd->driver_calls[XF_CALL_CREATE], 1);
+        if (fd->next_vkCreateFence(dev->handle, &ci, NULL, &real) != VK_SUCCESS) return VK_NULL_HANDLE;
+        f->real = real; f->dirty = 0;
+    } else if (f->dirty) {
+        count(&fd->driver_calls[XF_CALL_RESET], 1);
+        if (fd->next_vkResetFences(dev->handle, 1, &f->real) != VK_SUCCESS) return VK_NULL_HANDLE;
+        f->dirty = 0;
+    }
+    return f->real;
+}
+
+/* q: the queue the fence was submitted to, NULL for acquires */
+static void submitted_real(xeno_fence_device_t* fd, xf_fence_t* f, xf_queue_t* q) {
+    f->dirty = 1;
+    f->queue = q;
+    count(&fd->driver_fences, 1);
+    publish(fd, f, XF_REAL);
+}
+
+static void submitted_timeline(xeno_fence_device_t* fd, xf_fence_t* f, xf_queue_t* t, uint64_t value) {
+    atomic_store(&t->issued, value);
+    f->queue = t; f->value = value;
+    count(&fd->timeline_fences, 1);
+    publish(fd, f, XF_TIMELINE);
+}
+
+/* VK_SUCCESS, VK_NOT_READY or the driver's error; *calls counts the driver calls made */
+static VkResult fence_status(xeno_fence_device_t* fd, xf_fence_t* f, uint64_t* calls) {
+    xeno_device_t* dev = fd->dev;
+    int state = atomic_load(&f->state);
+    if (state == XF_SIGNALED) return VK_SUCCESS;
+    if (state == XF_UNSIGNALED) return VK_NOT_READY;
+    if (state == XF_TIMELINE) {
+        xf_queue_t* t = f->queue;
+        if (atomic_load(&t->reached) < f->value) {
+            uint64_t v;
+            ++*calls;
+            VkResult r = dev->vk.vkGetSemaphoreCounterValue(dev->handle, t->semaphore, &v);
+            if (r != VK_SUCCESS) return r;
+            note_reached(t, v);
+            if (v < f->value) return VK_NOT_READY;
+        }
+    } else {
+        ++*calls;
+        VkResult r = fd->next_vkGetFenceStatus(dev->handle, f->real);
+        if (r != VK_SUCCESS) return r;
+    }
+    /* a concurrent reset wins */
+    atomic_compare_exchange_strong(&f->state, &state, XF_SIGNALED);
+    return VK_SUCCESS;
+}
+
+/* --- fence objects --- */
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkCreateFence(VkDevice device, const VkFenceCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkFence* pFence) {
+    xeno_fence_device_t* fd = xeno_device_get(device)->fence;
+    count(&fd->app_calls[XF_CALL_CREATE], 1);
+    pthread_mutex_lock(&fd->lock);
+    xf_fence_t* f = fd->free;
+    if (f) { fd->free = f->next_free; if (f->real) fd->pooled--; }
+    else if ((f = calloc(1, sizeof(*f)))) { f->next_all = fd->all; fd->all = f; }
+    pthread_mutex_unlock(&fd->lock);
+    if (!f) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    atomic_store(&f->state, pCreateInfo->flags & VK_FENCE_CREATE_SIGNALED_BIT ? XF_SIGNALED : XF_UNSIGNALED);
+    *pFence = (VkFence)(uintptr_t)f;
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xf_vkDestroyFence(VkDevice device, VkFence fence, const VkAllocationCallbacks* pAllocator) {
+    xf_fence_t* f = xf(fence);
+    if (!f) return;
+    xeno_fence_device_t* fd = xeno_device_get(device)->fence;
+    count(&fd->app_calls[XF_CALL_DESTROY], 1);
+    VkFence drop = VK_NULL_HANDLE;
+    pthread_mutex_lock(&fd->lock);
+    if (f->real && fd->pooled >= fd->pool_cap) { drop = f->real; f->real = VK_NULL_HANDLE; }
+    else if (f->real) fd->pooled++;
+    atomic_store(&f->state, XF_UNSIGNALED);
+    f->next_free = fd->free; fd->free = f;
+    pthread_mutex_unlock(&fd->lock);
+    if (drop) { count(&fd->driver_calls[XF_CALL_DESTROY], 1); fd->next_vkDestroyFence(device, drop, NULL); }
+}
+
+/* a reset fence is not pending: its driver fence, if signalled, is reset when next submitted */
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkResetFences(VkDevice device, uint32_t fenceCount, const VkFence* pFences) {
+    xeno_fence_device_t* fd = xeno_device_get(device)->fence;
+    count(&fd->app_calls[XF_CALL_RESET], 1);
+    for (uint32_t i = 0; i < fenceCount; ++i) atomic_store(&xf(pFences[i])->state, XF_UNSIGNALED);
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkGetFenceStatus(VkDevice device, VkFence fence) {
+    xeno_fence_device_t* fd = xeno_device_get(device)->fence;
+    uint64_t calls = 0;
+    VkResult r = fence_status(fd, xf(fence), &calls);
+    count(&fd->app_calls[XF_CALL_STATUS], 1);
+    count(&fd->driver_calls[XF_CALL_STATUS], calls);
+    return r;
+}
+
+/* --- waits --- */
+static uint32_t unsubmitted(uint32_t fenceCount, const VkFence* pFences) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < fenceCount; ++i) n += atomic_load(&xf(pFences[i])->state) == XF_UNSIGNALED;
+    return n;
+}
+
+/* until one of the unsubmitted fences is submitted, or the deadline */
+static void wait_submission(xeno_fence_device_t* fd, uint32_t fenceCount, const VkFence* pFences, uint64_t deadline) {
+    pthread_mutex_lock(&fd->lock);
+    atomic_fetch_add(&fd->waiters, 1);
+    uint32_t before = unsubmitted(fenceCount, pFences);
+    uint64_t left;
+    while (unsubmitted(fenceCount, pFences) >= before && (left = remaining(deadline))) {
+        if (left == UINT64_MAX) { pthread_cond_wait(&fd->submitted, &fd->lock); continue; }
+        struct timespec ts; clock_gettime(CLOCK_REALTIME, &ts);
+        uint64_t ns = (uint64_t)ts.tv_nsec + (left < 1000000000ull ? left : 1000000000ull);
+        ts.tv_sec += (time_t)(ns / 1000000000ull); ts.tv_nsec = (long)(ns % 1000000000ull);
+        pthread_cond_timedwait(&fd->submitted, &fd->lock, &ts);
+    }
+    atomic_fetch_sub(&fd->waiters, 1);
+    pthread_mutex_unlock(&fd->lock);
+}
+
+/* --- spinning --- */
+/* how long a wait expected to end in expect_ns spins, 0 = it blocks right away */
+static uint64_t spin_budget(xeno_fence_device_t* fd, xf_spin_t* s, uint64_t expect_ns) {
+    uint64_t ns = atomic_load_explicit(&s->ns, memory_order_relaxed);
+    if (ns >= XF_SPIN_MIN_NS && expect_ns <= ns) return ns;
+    /* the budget is spent or the work takes longer: either may have changed since */
+    if (fd->spin_cap && atomic_fetch_add_explicit(&s->skipped, 1, memory_order_relaxed) % XF_SPIN_PROBE == XF_SPIN_PROBE - 1)
+        return ns >= XF_SPIN_MIN_NS ? ns : fd->spin_cap / 8;
+    return 0;
+}
+
+/* a hit needed spun_ns: the budget keeps room for that, a miss halves it */
+static void spin_learn(xeno_fence_device_t* fd, xf_spin_t* s, int hit, uint64_t spun_ns) {
+    uint64_t ns = atomic_load_explicit(&s->ns, memory_order_relaxed);
+    if (hit) { ns += ns / 8 + XF_SPIN_MIN_NS; if (ns < 2 * spun_ns) ns = 2 * spun_ns; }
+    else ns /= 2;
+    atomic_store_explicit(&s->ns, ns < fd->spin_cap ? ns : fd->spin_cap, memory_order_relaxed);
+    count(hit ? &fd->spin_hits : &fd->spin_misses, 1);
+    count(&fd->spin_ns, spun_ns);
+}
+
+/* exact: seen signalled while spinning; a blocked wait also measured the driver waking it up and
+ * can only tell that the average is too high */
+static void busy_learn(xf_queue_t* q, uint64_t ns, int exact) {
+    uint64_t avg = atomic_load_explicit(&q->busy_ns, memory_order_relaxed);
+    if (!exact && (!avg || ns >= avg)) return;
+    /* shorter work is followed quickly: it decides whether waits spin at all */
+    atomic_store_explicit(&q->busy_ns, !avg ? ns : ns < avg ? (avg + ns) / 2 : avg - avg / 8 + ns / 8, memory_order_relaxed);
+}
+
+static void wait_record(xeno_fence_device_t* fd, int ending, uint64_t ns) {
+    uint64_t us = ns / 1000;
+    int b = us ? 64 - __builtin_clzll(us) : 0;
+    count(&fd->wait_hist[ending][b < XF_HIST ? b : XF_HIST - 1], 1);
+}
+
+typedef VkResult (*xf_poll_fn)(xeno_fence_device_t* fd, const void* ctx, uint64_t* calls);
+
+/* polls until the wait is satisfied, fails or spin_ns passed (VK_TIMEOUT) */
+static VkResult spin(xeno_fence_device_t* fd, xf_poll_fn poll, const void* ctx, uint64_t spin_ns, uint64_t* calls) {
+    uint64_t end = xeno_now_ns() + spin_ns;
+    for (uint32_t i = 0;; ++i) {
+        VkResult r = poll(fd, ctx, calls);
+        if (r != VK_TIMEOUT || xeno_now_ns() >= end) return r;
+        for (int k = 0; k < XF_SPIN_PAUSES; ++k) XF_PAUSE();
+        if (i >= XF_SPIN_YIELD_AFTER) sched_yield();
+    }
+}
+
+/* --- waits --- */
+typedef struct xf_wait {
+    VkSemaphore* semaphores; uint64_t* values; xf_queue_t** queues; uint32_t sem_count;
+    VkFence* reals; uint32_t real_count;
+    VkBool32 all;
+} xf_wait_t;
+
+static void wait_add(xf_wait_t* w, xf_queue_t* t, uint64_t value) {
+    for (uint32_t k = 0; k < w->sem_count; ++k)
+        if (w->queues[k] == t) {
+            /* every fence: the latest value of the queue; any fence: the earliest */
+            if (w->all ? value > w->values[k] : value < w->values[k]) w->values[k] = value;
+            return;
+        }
+    w->semaphores[w->sem_count] = t->semaphore; w->values[w->sem_count] = value; w->queues[w->sem_count++] = t;
+}
+
+static VkResult poll_fences(xeno_fence_device_t* fd, const void* ctx, uint64_t* calls) {
+    const xf_wait_t* w = ctx;
+    VkResult r = VK_TIMEOUT;
+    if (w->sem_count) {
+        VkSemaphoreWaitInfo wi = { VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, NULL, w->all ? 0 : VK_SEMAPHORE_WAIT_ANY_BIT, w->sem_count, w->semaphores, w->values };
+        ++*calls;
+        r = fd->next_vkWaitSemaphores(fd->dev->handle, &wi, 0);
+        if (r == VK_SUCCESS && w->all) for (uint32_t k = 0; k < w->sem_count; ++k) note_reached(w->queues[k], w->values[k]);
+        /* every fence needs the driver fences too, any fence does with a timeline that has not signalled */
+        if (r != (w->all ? VK_SUCCESS : VK_TIMEOUT)) return r;
+    }
+    if (!w->real_count) return r;
+    ++*calls;
+    return fd->next_vkWaitForFences(fd->dev->handle, w->real_count, w->reals, w->all, 0);
+}
+
+static VkResult poll_semaphores(xeno_fence_device_t* fd, const void* ctx, uint64_t* calls) {
+    ++*calls;
+    return fd->next_vkWaitSemaphores(fd->dev->handle, ctx, 0);
+}
+
+/* *spun: the wait ended while spinning */
+static VkResult wait_fences(xeno_fence_device_t* fd, uint32_t fenceCount, const VkFence* pFences, uint64_t deadline, xf_wait_t* w, uint64_t* calls, int* spun) {
+    xeno_device_t* dev = fd->dev;
+    int tried_spin = 0;
+    for (;;) {
+        uint32_t done = 0, pending = 0;
+        /* when the fences waited for are expected to signal, the latest for every fence and the earliest
+         * for any; a queue without history may signal any moment */
+        uint64_t expect = 0; xf_queue_t* expect_q = NULL;
+        w->sem_count = w->real_count = 0;
+        for (uint32_t i = 0; i < fenceCount; ++i) {
+            xf_fence_t* f = xf(pFences[i]);
+            int state = atomic_load(&f->state);
+            if (state == XF_SIGNALED) { done++; continue; }
+            if (state == XF_UNSIGNALED) { pending++; continue; }
+            if (state == XF_TIMELINE && atomic_load(&f->queue->reached) >= f->value) {
+                atomic_compare_exchange_strong(&f->state, &state, XF_SIGNALED);
+                done++;
+                continue;
+            }
+            if (state == XF_TIMELINE) wait_add(w, f->queue, f->value);
+            else w->reals[w->real_count++] = f->real;
+            if (!f->queue) continue;        /* acquires: the presentation engine, nothing to predict */
+            uint64_t at = f->submitted_ns + atomic_load_explicit(&f->queue->busy_ns, memory_order_relaxed);
+            if (!expect_q || (w->all ? at > expect : at < expect)) { expect = at; expect_q = f->queue; }
+        }
+        if (w->all ? done == fenceCount : done > 0) return VK_SUCCESS;
+        uint64_t left = remaining(deadline);
+        if (pending && (w->all || (!w->sem_count && !w->real_count))) {
+            if (!left) return VK_TIMEOUT;
+            wait_submission(fd, fenceCount, pFences, deadline);
+            continue;
+        }
+        /* any of timeline and driver fences, or of fences not all submitted yet: look at each in turn */
+        int poll = !w->all && (pending || (w->sem_count && w->real_count));
+        uint64_t budget = poll && left > XF_POLL_NS ? XF_POLL_NS : left;
+        VkResult r;
+        if (!poll && left && !tried_spin && expect_q) {
+            tried_spin = 1;
+            uint64_t now = xeno_now_ns(), in = expect > now ? expect - now : 0;
+            uint64_t spin_ns = spin_budget(fd, &expect_q->spin, in);
+            if (spin_ns) {
+                r = spin(fd, poll_fences, w, spin_ns < left ? spin_ns : left, calls);
+                spin_learn(fd, &expect_q->spin, r == VK_SUCCESS, xeno_now_ns() - now);
+                if (r == VK_SUCCESS) *spun = 1;
+                if (r != VK_TIMEOUT) return r;
+                if (!(budget = remaining(deadline))) return VK_TIMEOUT;
+            }
+        }
+        if (w->sem_count) {
+            VkSemaphoreWaitInfo wi = { VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, NULL, w->all ? 0 : VK_SEMAPHORE_WAIT_ANY_BIT, w->sem_count, w->semaphores, w->values };
+            ++*calls;
+            r = fd->next_vkWaitSemaphores(dev->handle, &wi, budget);
+            if (r == VK_SUCCESS && !w->all) return VK_SUCCESS;
+            if (r == VK_SUCCESS) {
+                for (uint32_t k = 0; k < w->sem_count; ++k) note_reached(w->queues[k], w->values[k]);
+                continue;           /* the driver fences, if any, next */
+            }
+            if (r != VK_TIMEOUT || !poll) return r;
+            budget = 0;
+        }
+        if (w->real_count) {
+            ++*calls;
+            r = fd->next_vkWaitForFences(dev->handle, w->real_count, w->reals, w->all, budget);
+            if (r != VK_TIMEOUT || !poll) return r;
+        }
+        if (!remaining(deadline)) return VK_TIMEOUT;
+    }
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkWaitForFences(VkDevice device, uint32_t fenceCount, const VkFence* pFences, VkBool32 waitAll, uint64_t timeout) {
+    xeno_fence_device_t* fd = xeno_device_get(device)->fence;
+    VkSemaphore semaphores[XF_STACK_FENCES]; uint64_t values[XF_STACK_FENCES]; xf_queue_t* queues[XF_STACK_FENCES]; VkFence reals[XF_STACK_FENCES];
+    xf_wait_t w = { semaphores, values, queues, 0, reals, 0, waitAll };
+    void* heap = NULL;
+    if (fenceCount > XF_STACK_FENCES) {
+        heap = malloc(fenceCount * (sizeof(VkSemaphore) + sizeof(uint64_t) + sizeof(xf_queue_t*) + sizeof(VkFence)));
+        if (!heap) return VK_ERROR_OUT_OF_HOST_MEMORY;
+        w.values = heap; w.queues = (xf_queue_t**)(w.values + fenceCount);
+        w.semaphores = (VkSemaphore*)(w.queues + fenceCount); w.reals = (VkFence*)(w.semaphores + fenceCount);
+    }
+    uint64_t calls = 0, start = xeno_now_ns();
+    int spun = 0;
+    VkResult r = wait_fences(fd, fenceCount, pFences, deadline_of(timeout), &w, &calls, &spun);
+    free(heap);
+    count(&fd->app_calls[XF_CALL_WAIT], 1);
+    count(&fd->driver_calls[XF_CALL_WAIT], calls);
+    if (fenceCount > 1 && calls == 1) count(&fd->merged_waits, 1);
+    if (calls && timeout) {
+        uint64_t now = xeno_now_ns();
+        wait_record(fd, spun ? XF_ENDED_SPINNING : XF_ENDED_BLOCKED, now - start);
+        /* a single fence waited for from before it signalled: how long its queue takes */
+        xf_fence_t* f = fenceCount == 1 ? xf(pFences[0]) : NULL;
+        if (r == VK_SUCCESS && f && f->queue) busy_learn(f->queue, now - f->submitted_ns, spun);
+    }
+    return r;
+}
+
+/* timeline semaphores of the app: no queue to predict from, the device-wide budget decides */
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkWaitSemaphores(VkDevice device, const VkSemaphoreWaitInfo* pWaitInfo, uint64_t timeout) {
+    xeno_fence_device_t* fd = xeno_device_get(device)->fence;
+    if (!timeout) return fd->next_vkWaitSemaphores(device, pWaitInfo, 0);
+    uint64_t start = xeno_now_ns(), calls = 0, spin_ns = spin_budget(fd, &fd->semaphore_spin, 0);
+    VkResult r = VK_TIMEOUT;
+    if (spin_ns) {
+        r = spin(fd, poll_semaphores, pWaitInfo, spin_ns < timeout ? spin_ns : timeout, &calls);
+        spin_learn(fd, &fd->semaphore_spin, r == VK_SUCCESS, xeno_now_ns() - start);
+        if (r != VK_TIMEOUT) { wait_record(fd, XF_ENDED_SPINNING, xeno_now_ns() - start); return r; }
+    }
+    uint64_t spent = xeno_now_ns() - start;
+    if (spent >= timeout) return VK_TIMEOUT;
+    r = fd->next_vkWaitSemaphores(device, pWaitInfo, timeout == UINT64_MAX ? UINT64_MAX : timeout - spent);
+    wait_record(fd, XF_ENDED_BLOCKED, xeno_now_ns() - start);
+    return r;
+}
+
+/* --- submissions --- */
+static int legacy_extendable(const VkSubmitInfo* s) {
+    for (const VkBaseInStructure* e = s->pNext; e; e = e->pNext)
+        if (e->sType != VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO && e->sType != VK_STRUCTURE_TYPE_PROTECTED_SUBMIT_INFO) return 0;
+    return 1;
+}
+
+/* the submit with the timeline's next value signalled by its last batch (an empty batch when none) */
+static VkResult submit_timeline(xeno_fence_device_t* fd, VkQueue queue, xf_queue_t* t, uint64_t value, uint32_t submitCount, const VkSubmitInfo* pSubmits) {
+    uint32_t n = submitCount ? submitCount : 1;
+    const VkSubmitInfo* last = submitCount ? &pSubmits[submitCount - 1] : NULL;
+    uint32_t signals = (last ? last->signalSemaphoreCount : 0) + 1;
+    size_t size = n * sizeof(VkSubmitInfo) + signals * (sizeof(VkSemaphore) + sizeof(uint64_t));
+    uint64_t stack[XF_STACK_BYTES / sizeof(uint64_t)];
+    void* mem = size <= sizeof(stack) ? stack : malloc(size);
+    if (!mem) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    VkSubmitInfo* infos = mem;
+    uint64_t* vals = (uint64_t*)(infos + n);
+    VkSemaphore* sems = (VkSemaphore*)(vals + signals);
+    if (submitCount) memcpy(infos, pSubmits, submitCount * sizeof(*infos));
+    else infos[0] = (VkSubmitInfo){ .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO };
+    VkSubmitInfo* d = &infos[n - 1];
+    const VkTimelineSemaphoreSubmitInfo* tl = NULL; VkProtectedSubmitInfo prot; int protect = 0;
+    for (const VkBaseInStructure* e = d->pNext; e; e = e->pNext) {
+        if (e->sType == VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO) tl = (const VkTimelineSemaphoreSubmitInfo*)e;
+        else { prot = *(const VkProtectedSubmitInfo*)e; prot.pNext = NULL; protect = 1; }
+    }
+    if (signals > 1) memcpy(sems, d->pSignalSemaphores, (signals - 1) * sizeof(*sems));
+    if (tl && tl->signalSemaphoreValueCount) memcpy(vals, tl->pSignalSemaphoreValues, (signals - 1) * sizeof(*vals));
+    else memset(vals, 0, (signals - 1) * sizeof(*vals));     /* binary semaphores: ignored */
+    sems[signals - 1] = t->semaphore; vals[signals - 1] = value;
+    VkTimelineSemaphoreSubmitInfo ti = { VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO, protect ? &prot : NULL,
+        tl ? tl->waitSemaphoreValueCount : 0, tl ? tl->pWaitSemaphoreValues : NULL, signals, vals };
+    d->pNext = &ti; d->signalSemaphoreCount = signals; d->pSignalSemaphores = sems;
+    VkResult r = fd->next_vkQueueSubmit(queue, n, infos, VK_NULL_HANDLE);
+    if (mem != stack) free(mem);
+    return r;
+}
+
+static VkResult submit2_timeline(xeno_fence_device_t* fd, VkQueue queue, xf_queue_t* t, uint64_t value, uint32_t submitCount, const VkSubmitInfo2* pSubmits) {
+    uint32_t n = submitCount ? submitCount : 1;
+    const VkSubmitInfo2* last = submitCount ? &pSubmits[submitCount - 1] : NULL;
+    uint32_t signals = (last ? last->signalSemaphoreInfoCount : 0) + 1;
+    size_t size = n * sizeof(VkSubmitInfo2) + signals * sizeof(VkSemaphoreSubmitInfo);
+    uint64_t stack[XF_STACK_BYTES / sizeof(uint64_t)];
+    void* mem = size <= sizeof(stack) ? stack : malloc(size);
+    if (!mem) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    VkSubmitInfo2* infos = mem;
+    VkSemaphoreSubmitInfo* sems = (VkSemaphoreSubmitInfo*)(infos + n);
+    if (submitCount) memcpy(infos, pSubmits, submitCount * sizeof(*infos));
+    else infos[0] = (VkSubmitInfo2){ .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2 };
+    VkSubmitInfo2* d = &infos[n - 1];
+    if (signals > 1) memcpy(sems, d->pSignalSemaphoreInfos, (signals - 1) * sizeof(*sems));
+    sems[signals - 1] = (VkSemaphoreSubmitInfo){ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, NULL, t->semaphore, value, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, 0 };
+    d->signalSemaphoreInfoCount = signals; d->pSignalSemaphoreInfos = sems;
+    VkResult r = fd->next_vkQueueSubmit2(queue, n, infos, VK_NULL_HANDLE);
+    if (mem != stack) free(mem);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkQueueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo* pSubmits, VkFence fence) {
+    xeno_fence_device_t* fd = xeno_queue_device(queue)->fence;
+    xf_fence_t* f = xf(fence);
+    if (!f) return fd->next_vkQueueSubmit(queue, submitCount, pSubmits, VK_NULL_HANDLE);
+    f->submitted_ns = xeno_now_ns();        /* the queue may start on it before the call returns */
+    xf_queue_t* t = queue_get(fd, queue);
+    if (t && t->semaphore && (!submitCount || legacy_extendable(&pSubmits[submitCount - 1]))) {
+        uint64_t value = atomic_load(&t->issued) + 1;       /* the app serializes submits to a queue */
+        VkResult r = submit_timeline(fd, queue, t, value, submitCount, pSubmits);
+        if (r == VK_SUCCESS) submitted_timeline(fd, f, t, value);
+        return r;
+    }
+    VkFence real = real_fence(fd, f);
+    if (!real) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    VkResult r = fd->next_vkQueueSubmit(queue, submitCount, pSubmits, real);
+    if (r == VK_SUCCESS) submitted_real(fd, f, t);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkQueueSubmit2(VkQueue queue, uint32_t submitCount, const VkSubmitInfo2* pSubmits, VkFence fence) {
+    xeno_fence_device_t* fd = xeno_queue_device(queue)->fence;
+    xf_fence_t* f = xf(fence);
+    if (!f) return fd->next_vkQueueSubmit2(queue, submitCount, pSubmits, VK_NULL_HANDLE);
+    f->submitted_ns = xeno_now_ns();
+    xf_queue_t* t = queue_get(fd, queue);
+    if (t && t->semaphore) {
+        uint64_t value = atomic_load(&t->issued) + 1;
+        VkResult r = submit2_timeline(fd, queue, t, value, submitCount, pSubmits);
+        if (r == VK_SUCCESS) submitted_timeline(fd, f, t, value);
+        return r;
+    }
+    VkFence real = real_fence(fd, f);
+    if (!real) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    VkResult r = fd->next_vkQueueSubmit2(queue, submitCount, pSubmits, real);
+    if (r == VK_SUCCESS) submitted_real(fd, f, t);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkQueueBindSparse(VkQueue queue, uint32_t bindInfoCount, const VkBindSparseInfo* pBindInfo, VkFence fence) {
+    xeno_fence_device_t* fd = xeno_queue_device(queue)->fence;
+    xf_fence_t* f = xf(fence);
+    VkFence real = f ? real_fence(fd, f) : VK_NULL_HANDLE;
+    if (f && !real) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    if (f) f->submitted_ns = xeno_now_ns();
+    VkResult r = fd->next_vkQueueBindSparse(queue, bindInfoCount, pBindInfo, real);
+    if (f && r == VK_SUCCESS) submitted_real(fd, f, queue_get(fd, queue));
+    return r;
+}
+
+/* the presentation engine signals acquire fences: always a driver fence */
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkAcquireNextImageKHR(VkDevice device, VkSwapchainKHR swapchain, uint64_t timeout, VkSemaphore semaphore, VkFence fence, uint32_t* pImageIndex) {
+    xeno_fence_device_t* fd = xeno_device_get(device)->fence;
+    xf_fence_t* f = xf(fence);
+    VkFence real = f ? real_fence(fd, f) : VK_NULL_HANDLE;
+    if (f && !real) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    VkResult r = fd->next_vkAcquireNextImageKHR(device, swapchain, timeout, semaphore, real, pImageIndex);
+    if (f && (r == VK_SUCCESS || r == VK_SUBOPTIMAL_KHR)) submitted_real(fd, f, NULL);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkAcquireNextImage2KHR(VkDevice device, const VkAcquireNextImageInfoKHR* pAcquireInfo, uint32_t* pImageIndex) {
+    xeno_fence_device_t* fd = xeno_device_get(device)->fence;
+    xf_fence_t* f = xf(pAcquireInfo->fence);
+    VkAcquireNextImageInfoKHR info = *pAcquireInfo;
+    info.fence = f ? real_fence(fd, f) : VK_NULL_HANDLE;
+    if (f && !info.fence) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    VkResult r = fd->next_vkAcquireNextImage2KHR(device, &info, pImageIndex);
+    if (f && (r == VK_SUCCESS || r == VK_SUBOPTIMAL_KHR)) submitted_real(fd, f, NULL);
+    return r;
+}
+
+/* idle queues have reached every value they were given */
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkQueueWaitIdle(VkQueue queue) {
+    xeno_fence_device_t* fd = xeno_queue_device(queue)->fence;
+    xf_queue_t* t = queue_find(fd, queue);
+    uint64_t issued = t ? atomic_load(&t->issued) : 0;
+    VkResult r = fd->next_vkQueueWaitIdle(queue);
+    if (r == VK_SUCCESS && t) note_reached(t, issued);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkDeviceWaitIdle(VkDevice device) {
+    xeno_fence_device_t* fd = xeno_device_get(device)->fence;
+    VkResult r = fd->next_vkDeviceWaitIdle(device);
+    if (r == VK_SUCCESS)
+        for (xf_queue_t* t = atomic_load(&fd->queues); t; t = t->next) note_reached(t, atomic_load(&t->issued));
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkQueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* pPresentInfo) {
+    xeno_fence_device_t* fd = xeno_queue_device(queue)->fence;
+    count(&fd->frames, 1);
+    return fd->next_vkQueuePresentKHR(queue, pPresentInfo);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkSetDebugUtilsObjectNameEXT(VkDevice device, const VkDebugUtilsObjectNameInfoEXT* pNameInfo) {
+    if (pNameInfo->objectType == VK_OBJECT_TYPE_FENCE) return VK_SUCCESS;
+    return xeno_device_get(device)->fence->next_vkSetDebugUtilsObjectNameEXT(device, pNameInfo);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xf_vkSetDebugUtilsObjectTagEXT(VkDevice device, const VkDebugUtilsObjectTagInfoEXT* pTagInfo) {
+    if (pTagInfo->objectType == VK_OBJECT_TYPE_FENCE) return VK_SUCCESS;
+    return xeno_device_get(device)->fence->next_vkSetDebugUtilsObjectTagEXT(device, pTagInfo);
+}
+
+/* --- per-title knobs --- */
+/* the title-specific variable when it is set, the global one otherwise */
+static const char* title_knob(const xeno_fence_device_t* fd, const char* name, char* key, size_t n) {
+    snprintf(key, n, "%s_%s", name, fd->title);
+    return fd->title[0] && getenv(key) ? key : name;
+}
+
+/* --- device lifetime / routing --- */
+int xeno_fence_init(xeno_device_t* dev) {
+    if (!xeno_env_bool("XCLIPSE_FENCE_VIRTUAL", 0)) return 0;
+    if (dev->fence_external) { xlog("fence: an enabled extension hands fences to the driver directly, fences stay the driver's"); return 0; }
+    if (!dev->vk.vkCreateFence || !dev->vk.vkDestroyFence || !dev->vk.vkResetFences || !dev->vk.vkGetFenceStatus ||
+        !dev->vk.vkWaitForFences || !dev->vk.vkQueueSubmit) return -1;
+    xeno_fence_device_t* fd = calloc(1, sizeof(*fd)); if (!fd) return -1;
+    fd->dev = dev;
+    fd->timeline = dev->timeline && xeno_env_bool("XCLIPSE_FENCE_TIMELINE", 1) && dev->vk.vkCreateSemaphore && dev->vk.vkDestroySemaphore &&
+                   dev->vk.vkWaitSemaphores && dev->vk.vkGetSemaphoreCounterValue;
+    long cap = xeno_env_long("XCLIPSE_FENCE_POOL", 64);
+    fd->pool_cap = cap < 0 ? 0 : cap > 4096 ? 4096 : (uint32_t)cap;
+    xeno_process_title(fd->title, sizeof(fd->title));
+    char key[192];
+    long spin_us = xeno_env_long(title_knob(fd, "XCLIPSE_FENCE_SPIN_US", key, sizeof(key)), 200);
+    fd->spin_cap = (uint64_t)(spin_us < 0 ? 0 : spin_us > 100000 ? 100000 : spin_us) * 1000;
+    atomic_init(&fd->semaphore_spin.ns, fd->spin_cap);
+    pthread_mutex_init(&fd->lock, NULL); pthread_cond_init(&fd->submitted, NULL);
+    atomic_init(&fd->queues, NULL);
+    /* interposed: the modules' own fences and submits are the wrapper's too */
+#define XF_INSTALL(fn) if (dev->vk.fn) { fd->next_##fn = dev->vk.fn; dev->vk.fn = xf_##fn; }
+    XF_HOOKS(XF_INSTALL)
+#undef XF_INSTALL
+    dev->fence = fd;
+    xlog("fence: wrapper fences, %u idle driver fences pooled%s, waits spin up to %" PRIu64 " us", fd->pool_cap,
+         fd->timeline ? ", submits signal per-queue timelines" : "", fd->spin_cap / 1000);
+    return 0;
+}
+
+void xeno_fence_destroy(xeno_device_t* dev) {
+    xeno_fence_device_t* fd = dev->fence;
+    if (!fd) return;
+#define XF_RESTORE(fn) if (fd->next_##fn) dev->vk.fn = fd->next_##fn;
+    XF_HOOKS(XF_RESTORE)
+#undef XF_RESTORE
+    /* the device is idle: every fence has signalled or never will */
+    for (xf_fence_t* f = fd->all, *next; f; f = next) {
+        next = f->next_all;
+        if (f->real) fd->next_vkDestroyFence(dev->handle, f->real, NULL);
+        free(f);
+    }
+    for (xf_queue_t* t = atomic_load(&fd->queues), *next; t; t = next) {
+        next = t->next;
+        if (t->semaphore) dev->vk.vkDestroySemaphore(dev->handle, t->semaphore, NULL);
+        free(t);
+    }
+    pthread_mutex_destroy(&fd->lock); pthread_cond_destroy(&fd->submitted);
+    dev->fence = NULL;
+    free(fd);
+}
+
+/* entrypoints no module intercepts would otherwise reach the driver directly */
+PFN_vkVoidFunction xeno_fence_proc(xeno_device_t* dev, const char* name) {
+    xeno_fence_device_t* fd = dev->fence;
+    if (!fd || strncmp(name, "vk", 2) != 0) return NULL;
+#define XF_PROC(fn) if (fd->next_##fn && strcmp(name, #fn) == 0) return (PFN_vkVoidFunction)xf_##fn;
+    XF_HOOKS(XF_PROC)
+#undef XF_PROC
+    if (fd->next_vkQueueSubmit2 && strcmp(name, "vkQueueSubmit2KHR") == 0) return (PFN_vkVoidFunction)xf_vkQueueSubmit2;
+    if (fd->next_vkWaitSemaphores && strcmp(name, "vkWaitSemaphoresKHR") == 0) return (PFN_vkVoidFunction)xf_vkWaitSemaphores;
+    return NULL;
+}
+
+void xeno_fence_report(FILE* f, xeno_device_t* dev) {
+    xeno_fence_device_t* fd = dev->fence;
+    fprintf(f, "  \"fence\": {\"enabled\": %s", fd ? "true" : "false");
+    if (fd) {
+        uint64_t app = 0, driver = 0, frames = atomic_load(&fd->frames);
+        for (int i = 0; i < XF_CALLS; ++i) { app += atomic_load(&fd->app_calls[i]); driver += atomic_load(&fd->driver_calls[i]); }
+        double saved = (double)app - (double)driver;
+        fprintf(f, ", \"timeline\": %s, \"pool\": %u, \"frames\": %" PRIu64 ", \"timeline_fences\": %" PRIu64 ", \"driver_fences\": %" PRIu64
+                   ", \"merged_waits\": %" PRIu64 ", \"app_calls\": %" PRIu64 ", \"driver_calls\": %" PRIu64 ", \"saved_calls\": %.0f, \"saved_calls_per_frame\": %.2f, \"calls\": {",
+                fd->timeline ? "true" : "false", fd->pool_cap, frames, atomic_load(&fd->timeline_fences), atomic_load(&fd->driver_fences),
+                atomic_load(&fd->merged_waits), app, driver, saved, frames ? saved / (double)frames : 0.0);
+        for (int i = 0; i < XF_CALLS; ++i)
+            fprintf(f, "%s\"%s\": {\"app\": %" PRIu64 ", \"driver\": %" PRIu64 "}", i ? ", " : "", call_names[i],
+                    atomic_load(&fd->app_calls[i]), atomic_load(&fd->driver_calls[i]));
+        fprintf(f, "}, \"spin\": {\"cap_us\": %" PRIu64 ", \"hits\": %" PRIu64 ", \"misses\": %" PRIu64 ", \"spun_us\": %" PRIu64 ", \"semaphore_budget_us\": %" PRIu64 ", \"queues\": [",
+                fd->spin_cap / 1000, atomic_load(&fd->spin_hits), atomic_load(&fd->spin_misses), atomic_load(&fd->spin_ns) / 1000,
+                atomic_load(&fd->semaphore_spin.ns) / 1000);
+        int n = 0;
+        for (xf_queue_t* t = atomic_load(&fd->queues); t; t = t->next)
+            fprintf(f, "%s{\"busy_us\": %" PRIu64 ", \"budget_us\": %" PRIu64 "}", n++ ? ", " : "", atomic_load(&t->busy_ns) / 1000, atomic_load(&t->spin.ns) / 1000);
+        static const char* endings[XF_ENDINGS] = { "spinning", "blocked" };
+        fprintf(f, "]}, \"wait_us_log2\": {");
+        for (int e = 0; e < XF_ENDINGS; ++e) {
+            fprintf(f, "%s\"%s\": [", e ? ", " : "", endings[e]);
+            for (int b = 0; b < XF_HIST; ++b) fprintf(f, "%s%" PRIu64, b ? ", " : "", atomic_load(&fd->wait_hist[e][b]));
+            fprintf(f, "]");
+        }
+        fprintf(f, "}");
+    }
+    fprintf(f, "}");
+}
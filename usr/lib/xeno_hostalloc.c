@@ -0,0 +1,388 @@
+/* xeno_hostalloc.c - slab and arena VkAllocationCallbacks for driver host allocations
+ *
+ * Apps rarely pass allocation callbacks, so the driver's host memory for small objects comes from
+ * the C heap, shared by every thread creating objects. With XCLIPSE_HOST_ALLOC=1 the wrapper
+ * substitutes its own callbacks wherever the app passed none: vkCreateInstance, vkCreateDevice and
+ * the create/destroy pairs of the small device objects below. Both ends of a pair go through the
+ * same substitution, so an object is always freed with the callbacks it was created with.
+ *
+ * The allocator behind them:
+ *  - requests up to the largest size class come from per-thread free lists, refilled from 64 KB
+ *    slabs and balanced against a global depot in batches; slab memory is kept for reuse, never
+ *    returned to the system;
+ *  - VK_SYSTEM_ALLOCATION_SCOPE_COMMAND requests (freed before the command returns) are bumped out
+ *    of a per-thread arena chunk that rewinds whenever all of its allocations are gone;
+ *  - larger or over-aligned requests go to the C heap.
+ * Every block carries a 16-byte header naming where it came from, so any thread may free it.
+ *
+ * The callbacks and their memory are process-wide and outlive every device; statistics are kept
+ * per thread and per allocation scope and summed for the tune report.
+ *
+ * Knobs:
+ *   XCLIPSE_HOST_ALLOC=1               substitute the wrapper's callbacks for a NULL pAllocator
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+#define HDR 16
+#define SLAB_BYTES (64u * 1024)
+#define ARENA_BYTES (64u * 1024)
+#define ARENA_BASE 64               /* arena chunk header, keeps blocks 16-byte aligned */
+#define ARENA_MAX (ARENA_BYTES / 4) /* larger command-scope requests use the size classes */
+#define CLASS_COUNT 16
+#define SCOPE_COUNT 5
+
+/* block sizes including the header */
+static const uint32_t class_bytes[CLASS_COUNT] = { 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096, 6144 };
+
+enum { KIND_LARGE = 0x100, KIND_ARENA = 0x200 };
+
+typedef struct ha_hdr {
+    uint16_t kind;                  /* size class, KIND_LARGE or KIND_ARENA */
+    uint8_t scope;
+    uint8_t pad;
+    uint32_t base_off;              /* large: bytes from the malloc'd base to the block */
+    uint64_t size;                  /* requested bytes */
+} ha_hdr_t;
+
+typedef struct ha_free { struct ha_free* next; } ha_free_t;  /* overlays a free block's header */
+
+typedef struct ha_arena {           /* at the start of an ARENA_BYTES-aligned chunk */
+    _Atomic uint32_t live;          /* blocks handed out, +1 while it is a thread's current chunk */
+    uint32_t used;                  /* bump offset, touched by the owning thread only */
+} ha_arena_t;
+
+typedef struct ha_scope_stats {     /* written by the owning thread only, read by the report */
+    _Atomic uint64_t allocs, frees;
+    _Atomic int64_t live_bytes;     /* may go negative per thread when blocks migrate */
+} ha_scope_stats_t;
+
+typedef struct ha_cache {
+    struct ha_cache* next;          /* registry of live thread caches */
+    ha_free_t* free[CLASS_COUNT];
+    uint32_t count[CLASS_COUNT];
+    ha_arena_t* arena;
+    ha_scope_stats_t scope[SCOPE_COUNT];
+    _Atomic uint64_t arena_resets, large;
+} ha_cache_t;
+
+static struct {
+    pthread_mutex_t lock;           /* guards the depot, the registry and the retired totals */
+    ha_free_t* depot[CLASS_COUNT];
+    uint32_t depot_count[CLASS_COUNT];
+    ha_cache_t* caches;
+    uint64_t retired_allocs[SCOPE_COUNT], retired_frees[SCOPE_COUNT];
+    int64_t retired_live[SCOPE_COUNT];
+    uint64_t retired_resets, retired_large;
+    _Atomic uint64_t slab_bytes, arena_chunks;
+    _Atomic uint64_t internal_allocs[SCOPE_COUNT];
+    _Atomic int64_t internal_live[SCOPE_COUNT];
+    pthread_key_t key;
+} ha = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static pthread_once_t ha_once = PTHREAD_ONCE_INIT;
+static _Thread_local ha_cache_t* tls_cache;
+
+#define BUMP(field, v) atomic_store_explicit(&(field), atomic_load_explicit(&(field), memory_order_relaxed) + (v), memory_order_relaxed)
+
+static uint32_t batch_of(int c) { uint32_t n = (16u * 1024) / class_bytes[c]; return n < 8 ? 8 : n; }
+
+static void arena_release(ha_arena_t* a) {
+    if (atomic_fetch_sub(&a->live, 1) == 1) { free(a); atomic_fetch_sub(&ha.arena_chunks, 1); }
+}
+
+/* thread exit: blocks go to the depot, counters to the retired totals */
+static void cache_retire(void* p) {
+    ha_cache_t* tc = p;
+    pthread_mutex_lock(&ha.lock);
+    for (int c = 0; c < CLASS_COUNT; ++c) {
+        while (tc->free[c]) { ha_free_t* b = tc->free[c]; tc->free[c] = b->next; b->next = ha.depot[c]; ha.depot[c] = b; ha.depot_count[c]++; }
+    }
+    for (int s = 0; s < SCOPE_COUNT; ++s) {
+        ha.retired_allocs[s] += atomic_load(&tc->scope[s].allocs);
+        ha.retired_frees[s] += atomic_load(&tc->scope[s].frees);
+        ha.retired_live[s] += atomic_load(&tc->scope[s].live_bytes);
+    }
+    ha.retired_resets += atomic_load(&tc->arena_resets); ha.retired_large += atomic_load(&tc->large);
+    for (ha_cache_t** pp = &ha.caches; *pp; pp = &(*pp)->next) if (*pp == tc) { *pp = tc->next; break; }
+    pthread_mutex_unlock(&ha.lock);
+    if (tc->arena) arena_release(tc->arena);
+    if (tls_cache == tc) tls_cache = NULL;
+    free(tc);
+}
+
+static void ha_init(void) { pthread_key_create(&ha.key, cache_retire); }
+
+static ha_cache_t* cache_get(void) {
+    ha_cache_t* tc = tls_cache;
+    if (tc) return tc;
+    pthread_once(&ha_once, ha_init);
+    if (!(tc = calloc(1, sizeof(*tc)))) return NULL;
+    pthread_mutex_lock(&ha.lock);
+    tc->next = ha.caches; ha.caches = tc;
+    pthread_mutex_unlock(&ha.lock);
+    pthread_setspecific(ha.key, tc);
+    return tls_cache = tc;
+}
+
+static int class_of(size_t bytes) {
+    for (int c = 0; c < CLASS_COUNT; ++c) if (bytes <= class_bytes[c]) return c;
+    return -1;
+}
+
+static int refill(ha_cache_t* tc, int c) {
+    uint32_t want = batch_of(c);
+    pthread_mutex_lock(&ha.lock);
+    while (want && ha.depot[c]) {
+        ha_free_t* b = ha.depot[c]; ha.depot[c] = b->next; ha.depot_count[c]--;
+        b->next = tc->free[c]; tc->free[c] = b; tc->count[c]++; want--;
+    }
+    pthread_mutex_unlock(&ha.lock);
+    if (tc->free[c]) return 0;
+    unsigned char* slab = malloc(SLAB_BYTES);
+    if (!slab) return -1;
+    atomic_fetch_add(&ha.slab_bytes, SLAB_BYTES);
+    for (uint32_t off = 0; off + class_bytes[c] <= SLAB_BYTES; off += class_bytes[c]) {
+        ha_free_t* b = (ha_free_t*)(slab + off);
+        b->next = tc->free[c]; tc->free[c] = b; tc->count[c]++;
+    }
+    return 0;
+}
+
+/* keeps a thread that frees more than it allocates from hoarding blocks */
+static void drain(ha_cache_t* tc, int c) {
+    uint32_t n = batch_of(c);
+    pthread_mutex_lock(&ha.lock);
+    while (n-- && tc->free[c]) {
+        ha_free_t* b = tc->free[c]; tc->free[c] = b->next; tc->count[c]--;
+        b->next = ha.depot[c]; ha.depot[c] = b; ha.depot_count[c]++;
+    }
+    pthread_mutex_unlock(&ha.lock);
+}
+
+static void* arena_alloc(ha_cache_t* tc, size_t size, ha_hdr_t** out) {
+    ha_arena_t* a = tc->arena;
+    uint32_t need = (uint32_t)((HDR + size + 15) & ~(size_t)15);
+    /* only the owner's reference left: every block was freed, start over */
+    if (a && a->used != ARENA_BASE && atomic_load(&a->live) == 1) { a->used = ARENA_BASE; BUMP(tc->arena_resets, 1); }
+    if (!a || a->used + need > ARENA_BYTES) {
+        ha_arena_t* n = aligned_alloc(ARENA_BYTES, ARENA_BYTES);
+        if (!n) return NULL;
+        atomic_init(&n->live, 1); n->used = ARENA_BASE;
+        atomic_fetch_add(&ha.arena_chunks, 1);
+        if (a) arena_release(a);
+        tc->arena = a = n;
+    }
+    ha_hdr_t* h = (ha_hdr_t*)((unsigned char*)a + a->used);
+    a->used += need;
+    atomic_fetch_add(&a->live, 1);
+    h->kind = KIND_ARENA;
+    *out = h;
+    return h + 1;
+}
+
+static void* large_alloc(ha_cache_t* tc, size_t size, size_t align, ha_hdr_t** out) {
+    if (align < HDR) align = HDR;
+    if (size > SIZE_MAX - HDR - align) return NULL;
+    unsigned char* base = malloc(HDR + size + align - 1);
+    if (!base) return NULL;
+    unsigned char* p = (unsigned char*)(((uintptr_t)base + HDR + align - 1) & ~(uintptr_t)(align - 1));
+    ha_hdr_t* h = (ha_hdr_t*)p - 1;
+    h->kind = KIND_LARGE; h->base_off = (uint32_t)(p - base);
+    BUMP(tc->large, 1);
+    *out = h;
+    return p;
+}
+
+static void* VKAPI_CALL ha_alloc(void* user, size_t size, size_t align, VkSystemAllocationScope scope) {
+    (void)user;
+    ha_cache_t* tc = cache_get();
+    if (!tc || !size) return NULL;
+    uint32_t s = (uint32_t)scope < SCOPE_COUNT ? (uint32_t)scope : VK_SYSTEM_ALLOCATION_SCOPE_OBJECT;
+    ha_hdr_t* h = NULL; void* p = NULL; int c;
+    if (align <= HDR && scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND && size <= ARENA_MAX) p = arena_alloc(tc, size, &h);
+    if (!p && align <= HDR && size <= SIZE_MAX - HDR && (c = class_of(HDR + size)) >= 0) {
+        if (!tc->free[c] && refill(tc, c) != 0) return NULL;
+        ha_free_t* b = tc->free[c]; tc->free[c] = b->next; tc->count[c]--;
+        h = (ha_hdr_t*)b; h->kind = (uint16_t)c;
+        p = h + 1;
+    }
+    if (!p && !(p = large_alloc(tc, size, align, &h))) return NULL;
+    h->scope = (uint8_t)s; h->size = size;
+    BUMP(tc->scope[s].allocs, 1); BUMP(tc->scope[s].live_bytes, (int64_t)size);
+    return p;
+}
+
+static void VKAPI_CALL ha_free(void* user, void* p) {
+    (void)user;
+    if (!p) return;
+    ha_hdr_t* h = (ha_hdr_t*)p - 1;
+    ha_cache_t* tc = cache_get();
+    if (tc) { BUMP(tc->scope[h->scope].frees, 1); BUMP(tc->scope[h->scope].live_bytes, -(int64_t)h->size); }
+    if (h->kind == KIND_ARENA) { arena_release((ha_arena_t*)((uintptr_t)h & ~(uintptr_t)(ARENA_BYTES - 1))); return; }
+    if (h->kind == KIND_LARGE) { free((unsigned char*)p - h->base_off); return; }
+    int c = h->kind;
+    ha_free_t* b = (ha_free_t*)h;
+    if (!tc) {
+        /* no cache to return it to (out of memory): straight back to the depot */
+        pthread_mutex_lock(&ha.lock);
+        b->next = ha.depot[c]; ha.depot[c] = b; ha.depot_count[c]++;
+        pthread_mutex_unlock(&ha.lock);
+        return;
+    }
+    b->next = tc->free[c]; tc->free[c] = b;
+    if (++tc->count[c] > 2 * batch_of(c)) drain(tc, c);
+}
+
+static void* VKAPI_CALL ha_realloc(void* user, void* orig, size_t size, size_t align, VkSystemAllocationScope scope) {
+    if (!orig) return ha_alloc(user, size, align, scope);
+    if (!size) { ha_free(user, orig); return NULL; }
+    ha_hdr_t* h = (ha_hdr_t*)orig - 1;
+    /* still fits its size class: keep the block */
+    if (h->kind < CLASS_COUNT && align <= HDR && HDR + size <= class_bytes[h->kind]) {
+        ha_cache_t* tc = cache_get();
+        if (tc) BUMP(tc->scope[h->scope].live_bytes, (int64_t)size - (int64_t)h->size);
+        h->size = size;
+        return orig;
+    }
+    void* p = ha_alloc(user, size, align, scope);
+    if (!p) return NULL;
+    memcpy(p, orig, h->size < size ? h->size : size);
+    ha_free(user, orig);
+    return p;
+}
+
+static void VKAPI_CALL ha_internal_alloc(void* user, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+    (void)user; (void)type;
+    if ((uint32_t)scope >= SCOPE_COUNT) return;
+    atomic_fetch_add(&ha.internal_allocs[scope], 1); atomic_fetch_add(&ha.internal_live[scope], (int64_t)size);
+}
+
+static void VKAPI_CALL ha_internal_free(void* user, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope) {
+    (void)user; (void)type;
+    if ((uint32_t)scope >= SCOPE_COUNT) return;
+    atomic_fetch_sub(&ha.internal_live[scope], (int64_t)size);
+}
+
+static const VkAllocationCallbacks ha_callbacks = {
+    .pfnAllocation = ha_alloc, .pfnReallocation = ha_realloc, .pfnFree = ha_free,
+    .pfnInternalAllocation = ha_internal_alloc, .pfnInternalFree = ha_internal_free,
+};
+
+int xeno_hostalloc_enabled(void) { return xeno_env_bool("XCLIPSE_HOST_ALLOC", 0); }
+
+const VkAllocationCallbacks* xeno_hostalloc_callbacks(void) { return &ha_callbacks; }
+
+/* ---- device object create/destroy pairs ---- */
+
+#define HA_OBJECTS(X) \
+    X(Sampler, VkSamplerCreateInfo, VkSampler) \
+    X(Fence, VkFenceCreateInfo, VkFence) \
+    X(Semaphore, VkSemaphoreCreateInfo, VkSemaphore) \
+    X(ImageView, VkImageViewCreateInfo, VkImageView) \
+    X(CommandPool, VkCommandPoolCreateInfo, VkCommandPool) \
+    X(DescriptorPool, VkDescriptorPoolCreateInfo, VkDescriptorPool) \
+    X(DescriptorSetLayout, VkDescriptorSetLayoutCreateInfo, VkDescriptorSetLayout) \
+    X(PipelineLayout, VkPipelineLayoutCreateInfo, VkPipelineLayout) \
+    X(QueryPool, VkQueryPoolCreateInfo, VkQueryPool) \
+    X(ShaderModule, VkShaderModuleCreateInfo, VkShaderModule)
+
+typedef struct xeno_hostalloc_device {
+#define HA_NEXT(name, info, handle) PFN_vkCreate##name next_create_##name; PFN_vkDestroy##name next_destroy_##name;
+    HA_OBJECTS(HA_NEXT)
+#undef HA_NEXT
+} xeno_hostalloc_device_t;
+
+/* looked up apart from the device registry: modules still destroy their objects through the
+ * dispatch table after vkDestroyDevice has unregistered the device */
+static xeno_map_t ha_devices;       /* VkDevice -> xeno_hostalloc_device_t */
+static pthread_once_t ha_devices_once = PTHREAD_ONCE_INIT;
+static void ha_devices_init(void) { xeno_map_init(&ha_devices, 8); }
+
+#define HA_INTERCEPT(name, info, handle) \
+static VKAPI_ATTR VkResult VKAPI_CALL ha_vkCreate##name(VkDevice device, const info* pCreateInfo, const VkAllocationCallbacks* pAllocator, handle* pOut) { \
+    xeno_hostalloc_device_t* hd = xeno_map_get(&ha_devices, XENO_HANDLE_KEY(device)); \
+    return hd->next_create_##name(device, pCreateInfo, pAllocator ? pAllocator : &ha_callbacks, pOut); \
+} \
+static VKAPI_ATTR void VKAPI_CALL ha_vkDestroy##name(VkDevice device, handle object, const VkAllocationCallbacks* pAllocator) { \
+    xeno_hostalloc_device_t* hd = xeno_map_get(&ha_devices, XENO_HANDLE_KEY(device)); \
+    hd->next_destroy_##name(device, object, pAllocator ? pAllocator : &ha_callbacks); \
+}
+HA_OBJECTS(HA_INTERCEPT)
+#undef HA_INTERCEPT
+
+/* Interposed on the dispatch table before any other module, so every path to the driver, the
+ * modules' own objects included, passes the substitution on its way down. */
+int xeno_hostalloc_init(xeno_device_t* dev) {
+    if (dev->host_alloc != &ha_callbacks) return 0;
+    xeno_hostalloc_device_t* hd = calloc(1, sizeof(*hd));
+    if (!hd) return -1;
+#define HA_INSTALL(name, info, handle) \
+    if (dev->vk.vkCreate##name && dev->vk.vkDestroy##name) { \
+        hd->next_create_##name = dev->vk.vkCreate##name; dev->vk.vkCreate##name = ha_vkCreate##name; \
+        hd->next_destroy_##name = dev->vk.vkDestroy##name; dev->vk.vkDestroy##name = ha_vkDestroy##name; \
+    }
+    HA_OBJECTS(HA_INSTALL)
+#undef HA_INSTALL
+    pthread_once(&ha_devices_once, ha_devices_init);
+    xeno_map_put(&ha_devices, XENO_HANDLE_KEY(dev->handle), hd);
+    dev->hostalloc = hd;
+    xlog("hostalloc: device %p uses slab/arena host allocation callbacks", (void*)dev->handle);
+    return 0;
+}
+
+void xeno_hostalloc_destroy(xeno_device_t* dev) {
+    xeno_hostalloc_device_t* hd = dev->hostalloc;
+    if (!hd) return;
+#define HA_RESTORE(name, info, handle) \
+    if (hd->next_create_##name) { dev->vk.vkCreate##name = hd->next_create_##name; dev->vk.vkDestroy##name = hd->next_destroy_##name; }
+    HA_OBJECTS(HA_RESTORE)
+#undef HA_RESTORE
+    xeno_map_remove(&ha_devices, XENO_HANDLE_KEY(dev->handle));
+    dev->hostalloc = NULL;
+    free(hd);
+}
+
+/* objects no module intercepts would otherwise reach the driver entrypoint directly */
+PFN_vkVoidFunction xeno_hostalloc_proc(xeno_device_t* dev, const char* name) {
+    if (!dev->hostalloc || strncmp(name, "vk", 2) != 0) return NULL;
+#define HA_PROC(n, info, handle) \
+    if (dev->hostalloc->next_create_##n) { \
+        if (strcmp(name, "vkCreate" #n) == 0) return (PFN_vkVoidFunction)ha_vkCreate##n; \
+        if (strcmp(name, "vkDestroy" #n) == 0) return (PFN_vkVoidFunction)ha_vkDestroy##n; \
+    }
+    HA_OBJECTS(HA_PROC)
+#undef HA_PROC
+    return NULL;
+}
+
+void xeno_hostalloc_report(FILE* f, xeno_device_t* dev) {
+    static const char* names[SCOPE_COUNT] = { "command", "object", "cache", "device", "instance" };
+    fprintf(f, "  \"host_alloc\": {\"enabled\": %s", dev->hostalloc ? "true" : "false");
+    if (dev->hostalloc) {
+        uint64_t allocs[SCOPE_COUNT], frees[SCOPE_COUNT]; int64_t live[SCOPE_COUNT];
+        pthread_mutex_lock(&ha.lock);
+        uint64_t resets = ha.retired_resets, large = ha.retired_large;
+        for (int s = 0; s < SCOPE_COUNT; ++s) { allocs[s] = ha.retired_allocs[s]; frees[s] = ha.retired_frees[s]; live[s] = ha.retired_live[s]; }
+        for (ha_cache_t* tc = ha.caches; tc; tc = tc->next) {
+            for (int s = 0; s < SCOPE_COUNT; ++s) {
+                allocs[s] += atomic_load_explicit(&tc->scope[s].allocs, memory_order_relaxed);
+                frees[s] += atomic_load_explicit(&tc->scope[s].frees, memory_order_relaxed);
+                live[s] += atomic_load_explicit(&tc->scope[s].live_bytes, memory_order_relaxed);
+            }
+            resets += atomic_load_explicit(&tc->arena_resets, memory_order_relaxed);
+            large += atomic_load_explicit(&tc->large, memory_order_relaxed);
+        }
+        pthread_mutex_unlock(&ha.lock);
+        fprintf(f, ", \"slab_bytes\": %" PRIu64 ", \"arena_chunks\": %" PRIu64 ", \"arena_resets\": %" PRIu64 ", \"large\": %" PRIu64 ", \"scopes\": {",
+                atomic_load(&ha.slab_bytes), atomic_load(&ha.arena_chunks), resets, large);
+        for (int s = 0; s < SCOPE_COUNT; ++s)
+            fprintf(f, "%s\"%s\": {\"allocs\": %" PRIu64 ", \"frees\": %" PRIu64 ", \"live_bytes\": %" PRId64 ", \"internal_allocs\": %" PRIu64 ", \"internal_live_bytes\": %" PRId64 "}",
+                    s ? ", " : "", names[s], allocs[s], frees[s], live[s], atomic_load(&ha.internal_allocs[s]), atomic_load(&ha.internal_live[s]));
+        fprintf(f, "}");
+    }
+    fprintf(f, "}");
+}
@@ -0,0 +1,677 @@
+/* xeno_internal.h - shared declarations for the wrapper's device-level modules
+ *
+ * libxeno_wrapper.c owns the loader, logging, the device registry and vkGetDeviceProcAddr routing.
+ * Feature modules (command buffer tracking, shader object emulation, ...) reach the real driver
+ * through the per-device dispatch table below and expose their intercepts via *_proc() lookups.
+ */
+
+#ifndef XENO_INTERNAL_H
+#define XENO_INTERNAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <vulkan/vulkan.h>
+
+/* --- logging / env / time (libxeno_wrapper.c, xeno_util.c) --- */
+void xlog(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+int xeno_env_bool(const char* name, int def);
+long xeno_env_long(const char* name, long def);
+uint64_t xeno_now_ns(void);
+/* executable name upper-cased, other characters as '_' (e.g. COM_STUDIO_GAME) */
+void xeno_process_title(char* out, size_t n);
+/* bytes per sample of the formats render targets use; others count as 4 */
+uint32_t xeno_format_texel_bytes(VkFormat format);
+
+/* --- hashing / handle maps (xeno_util.c) --- */
+uint64_t xeno_hash64(const void* data, size_t len, uint64_t seed);
+#define XENO_MAP_STRIPES 64
+typedef struct xeno_map_node { uint64_t key; void* val; struct xeno_map_node* next; } xeno_map_node_t;
+typedef struct xeno_map {
+    xeno_map_node_t** buckets; uint32_t mask;
+    pthread_mutex_t locks[XENO_MAP_STRIPES];
+    _Atomic uint32_t count;
+} xeno_map_t;
+void xeno_map_init(xeno_map_t* m, uint32_t buckets);
+void xeno_map_destroy(xeno_map_t* m);
+void* xeno_map_get(xeno_map_t* m, uint64_t key);
+void xeno_map_put(xeno_map_t* m, uint64_t key, void* val);
+void* xeno_map_remove(xeno_map_t* m, uint64_t key);
+/* calls fn for every entry; entries may be removed from inside fn by returning nonzero */
+void xeno_map_foreach(xeno_map_t* m, int (*fn)(uint64_t key, void* val, void* ctx), void* ctx);
+#define XENO_HANDLE_KEY(h) ((uint64_t)(uintptr_t)(h))
+
+/* --- worker pool (xeno_workers.c) --- */
+typedef void (*xeno_job_fn)(void* ctx);
+int xeno_workers_count(void);
+int xeno_workers_submit(xeno_job_fn fn, void* ctx);
+/* runs fn(ctx, i) for every i < n on the pool and the calling thread, returning when all are done;
+ * returns the number of threads that took part */
+typedef void (*xeno_range_fn)(void* ctx, uint32_t i);
+uint32_t xeno_workers_parallel(uint32_t n, xeno_range_fn fn, void* ctx);
+
+/* --- TLSF allocator over an offset range, metadata kept outside it (xeno_tlsf.c) --- */
+typedef struct xeno_tlsf xeno_tlsf_t;
+typedef struct xeno_tlsf_range xeno_tlsf_range_t;
+xeno_tlsf_t* xeno_tlsf_create(uint64_t size);
+void xeno_tlsf_destroy(xeno_tlsf_t* t);
+/* NULL when no free range fits; align need not be a power of two */
+xeno_tlsf_range_t* xeno_tlsf_alloc(xeno_tlsf_t* t, uint64_t size, uint64_t align, uint64_t* offset);
+void xeno_tlsf_free(xeno_tlsf_t* t, xeno_tlsf_range_t* r);
+uint64_t xeno_tlsf_used(const xeno_tlsf_t* t);
+uint32_t xeno_tlsf_ranges(const xeno_tlsf_t* t);
+uint64_t xeno_tlsf_largest_free(const xeno_tlsf_t* t);
+
+/* --- real driver entrypoints, resolved once per device ---
+ * Extension entrypoints are NULL when the downstream driver does not expose them. */
+#define XENO_DEVICE_FUNCS(X) \
+    X(vkDestroyDevice) X(vkGetDeviceQueue) X(vkGetDeviceQueue2) X(vkDeviceWaitIdle) \
+    X(vkCreateShaderModule) X(vkDestroyShaderModule) \
+    X(vkCreatePipelineLayout) X(vkDestroyPipelineLayout) \
+    X(vkCreateGraphicsPipelines) X(vkCreateComputePipelines) X(vkDestroyPipeline) X(vkDestroyRenderPass) \
+    X(vkCreatePipelineCache) X(vkDestroyPipelineCache) X(vkGetPipelineCacheData) X(vkMergePipelineCaches) \
+    X(vkCreateImage) X(vkDestroyImage) X(vkCreateImageView) X(vkDestroyImageView) \
+    X(vkDestroyCommandPool) X(vkResetCommandPool) X(vkAllocateCommandBuffers) X(vkFreeCommandBuffers) \
+    X(vkBeginCommandBuffer) X(vkEndCommandBuffer) X(vkResetCommandBuffer) \
+    X(vkCmdBindPipeline) X(vkCmdBeginRendering) X(vkCmdEndRendering) \
+    X(vkCmdDraw) X(vkCmdDrawIndexed) X(vkCmdDrawIndirect) X(vkCmdDrawIndexedIndirect) \
+    X(vkCmdDrawIndirectCount) X(vkCmdDrawIndexedIndirectCount) X(vkCmdDrawMeshTasksEXT) \
+    X(vkCmdSetViewport) X(vkCmdSetScissor) X(vkCmdSetLineWidth) X(vkCmdSetDepthBias) X(vkCmdSetBlendConstants) \
+    X(vkCmdSetDepthBounds) X(vkCmdSetStencilCompareMask) X(vkCmdSetStencilWriteMask) X(vkCmdSetStencilReference) \
+    X(vkCmdSetViewportWithCount) X(vkCmdSetScissorWithCount) X(vkCmdSetCullMode) X(vkCmdSetFrontFace) \
+    X(vkCmdSetPrimitiveTopology) X(vkCmdSetDepthTestEnable) X(vkCmdSetDepthWriteEnable) X(vkCmdSetDepthCompareOp) \
+    X(vkCmdSetDepthBoundsTestEnable) X(vkCmdSetStencilTestEnable) X(vkCmdSetStencilOp) \
+    X(vkCmdSetRasterizerDiscardEnable) X(vkCmdSetDepthBiasEnable) X(vkCmdSetPrimitiveRestartEnable) \
+    X(vkCmdSetPatchControlPointsEXT) X(vkCmdSetLogicOpEXT) X(vkCmdSetDepthClampEnableEXT) X(vkCmdSetPolygonModeEXT) \
+    X(vkCmdSetRasterizationSamplesEXT) X(vkCmdSetSampleMaskEXT) X(vkCmdSetAlphaToCoverageEnableEXT) \
+    X(vkCmdSetAlphaToOneEnableEXT) X(vkCmdSetLogicOpEnableEXT) X(vkCmdSetColorBlendEnableEXT) \
+    X(vkCmdSetColorBlendEquationEXT) X(vkCmdSetColorWriteMaskEXT) X(vkCmdSetVertexInputEXT) \
+    X(vkCreateShadersEXT) X(vkDestroyShaderEXT) X(vkGetShaderBinaryDataEXT) X(vkCmdBindShadersEXT) \
+    X(vkCreateRayTracingPipelinesKHR) X(vkBuildAccelerationStructuresKHR) X(vkCopyAccelerationStructureKHR) \
+    X(vkCopyAccelerationStructureToMemoryKHR) X(vkCopyMemoryToAccelerationStructureKHR) \
+    X(vkAllocateMemory) X(vkFreeMemory) X(vkMapMemory) X(vkUnmapMemory) X(vkMapMemory2) X(vkUnmapMemory2) \
+    X(vkFlushMappedMemoryRanges) X(vkInvalidateMappedMemoryRanges) X(vkGetDeviceMemoryCommitment) \
+    X(vkBindBufferMemory) X(vkBindImageMemory) X(vkBindBufferMemory2) X(vkBindImageMemory2) \
+    X(vkGetBufferMemoryRequirements) X(vkGetImageMemoryRequirements) \
+    X(vkGetBufferMemoryRequirements2) X(vkGetImageMemoryRequirements2) X(vkQueueBindSparse) X(vkCreateSampler) \
+    X(vkGetDeviceMemoryOpaqueCaptureAddress) X(vkSetDeviceMemoryPriorityEXT) X(vkBindVideoSessionMemoryKHR) X(vkBindAccelerationStructureMemoryNV) \
+    X(vkCreateBuffer) X(vkDestroyBuffer) X(vkCmdCopyBuffer) X(vkCmdCopyBufferToImage) X(vkCmdUpdateBuffer) \
+    X(vkQueueSubmit) X(vkQueueSubmit2) X(vkQueueWaitIdle) \
+    X(vkQueueBeginDebugUtilsLabelEXT) X(vkQueueEndDebugUtilsLabelEXT) X(vkQueueInsertDebugUtilsLabelEXT) \
+    X(vkQueueSetPerformanceConfigurationINTEL) X(vkQueueNotifyOutOfBandNV) \
+    X(vkCreateFence) X(vkDestroyFence) X(vkResetFences) X(vkGetFenceStatus) X(vkWaitForFences) \
+    X(vkGetMemoryHostPointerPropertiesEXT) \
+    X(vkDestroySampler) X(vkCreateSemaphore) X(vkDestroySemaphore) X(vkCreateCommandPool) \
+    X(vkCreateDescriptorPool) X(vkDestroyDescriptorPool) X(vkCreateDescriptorSetLayout) X(vkDestroyDescriptorSetLayout) \
+    X(vkCreateQueryPool) X(vkDestroyQueryPool) X(vkQueuePresentKHR) X(vkAcquireNextImageKHR) X(vkAcquireNextImage2KHR) \
+    X(vkSetDebugUtilsObjectNameEXT) X(vkSetDebugUtilsObjectTagEXT) \
+    X(vkCreateRenderPass) X(vkCreateRenderPass2) X(vkCreateFramebuffer) X(vkDestroyFramebuffer) \
+    X(vkCmdBeginRenderPass) X(vkCmdBeginRenderPass2) \
+    X(vkWaitSemaphores) X(vkGetSemaphoreCounterValue) X(vkGetSemaphoreFdKHR) X(vkGetEventStatus) X(vkGetQueryPoolResults) \
+    X(vkGetFenceFdKHR) X(vkImportFenceFdKHR)
+
+typedef struct xeno_dispatch {
+#define XENO_DISPATCH_MEMBER(fn) PFN_##fn fn;
+    XENO_DEVICE_FUNCS(XENO_DISPATCH_MEMBER)
+#undef XENO_DISPATCH_MEMBER
+} xeno_dispatch_t;
+
+/* Extensions the wrapper advertises and can emulate when the driver rejects them */
+#define XENO_EMULATE_SHADER_OBJECT (1u << 0)
+#define XENO_EMULATE_EXTENDED_DYNAMIC_STATE3 (1u << 1)
+#define XENO_EMULATE_VERTEX_INPUT_DYNAMIC_STATE (1u << 2)
+#define XENO_EMULATE_DEFERRED_HOST_OPERATIONS (1u << 3)
+
+struct xeno_so_device;
+struct xeno_dyn_emu_device;
+struct xeno_pcache_device;
+struct xeno_dedup_device;
+struct xeno_split_device;
+struct xeno_deferred_device;
+struct xeno_suballoc_device;
+struct xeno_budget_device;
+struct xeno_staging_device;
+struct xeno_hostalloc_device;
+struct xeno_transient_device;
+struct xeno_submit_device;
+struct xeno_fence_device;
+struct xeno_vqueue_device;
+struct xeno_reactor_device;
+struct xeno_pacing_device;
+struct xeno_state_filter_device;
+struct xeno_barrier_device;
+struct xeno_loadstore_device;
+struct xeno_passmerge_device;
+struct xeno_mtrecord_device;
+typedef struct xeno_device {
+    VkDevice handle;
+    VkPhysicalDevice physical;
+    xeno_dispatch_t vk;
+    uint32_t emulate;               /* XENO_EMULATE_* stripped from the real vkCreateDevice */
+    int host_import;                /* VK_EXT_external_memory_host is enabled on the real device */
+    int sync2;                      /* the app enabled synchronization2: vkQueueSubmit2 may be called */
+    int timeline;                   /* the app enabled timelineSemaphore */
+    int capture_replay;             /* the app enabled bufferDeviceAddressCaptureReplay */
+    int fence_external;             /* an enabled extension hands fences to the driver past xeno_fence.c */
+    int sync_fd;                    /* XCLIPSE_REACTOR: fences can be exported and imported as sync_files */
+    const VkAllocationCallbacks* host_alloc; /* substituted for the app's NULL pAllocator at vkCreateDevice */
+    VkPhysicalDeviceLimits limits;  /* of the real physical device; zeroed when it could not be queried */
+    VkPhysicalDeviceMemoryProperties memory;
+    uint64_t dyn_native;            /* XENO_DYN_* bits the driver can set dynamically */
+    uint64_t dyn_emulated;          /* XENO_DYN_* bits emulated for app pipelines via variants */
+    _Atomic uint64_t cb_epoch;      /* bumped at every vkBeginCommandBuffer */
+    _Atomic uint64_t frames;        /* vkQueuePresentKHR calls of the app */
+    PFN_vkQueuePresentKHR present;  /* where the app's vkQueuePresentKHR goes once counted */
+    struct xeno_so_device* so;      /* xeno_shader_object.c */
+    struct xeno_dyn_emu_device* dyn_emu; /* xeno_dyn_emulation.c */
+    struct xeno_pcache_device* pcache;   /* xeno_pcache.c */
+    struct xeno_dedup_device* dedup;     /* xeno_pipeline_dedup.c */
+    struct xeno_split_device* split;     /* xeno_pipeline_split.c */
+    struct xeno_deferred_device* deferred; /* xeno_deferred.c */
+    struct xeno_suballoc_device* suballoc; /* xeno_suballoc.c */
+    struct xeno_budget_device* budget;     /* xeno_membudget.c */
+    struct xeno_staging_device* staging;   /* xeno_staging.c */
+    struct xeno_hostalloc_device* hostalloc; /* xeno_hostalloc.c */
+    struct xeno_transient_device* transient; /* xeno_transient.c */
+    struct xeno_submit_device* submit;       /* xeno_submit.c */
+    struct xeno_fence_device* fence;         /* xeno_fence.c */
+    struct xeno_vqueue_device* vqueue;       /* xeno_vqueue.c */
+    struct xeno_reactor_device* reactor;     /* xeno_reactor.c */
+    struct xeno_pacing_device* pacing;       /* xeno_pacing.c */
+    struct xeno_state_filter_device* state_filter; /* xeno_state_filter.c */
+    struct xeno_barrier_device* barrier;     /* xeno_barrier.c */
+    struct xeno_loadstore_device* loadstore; /* xeno_loadstore.c */
+    struct xeno_passmerge_device* passmerge; /* xeno_passmerge.c */
+    struct xeno_mtrecord_device* mtrecord;   /* xeno_mtrecord.c */
+} xeno_device_t;
+
+xeno_device_t* xeno_device_get(VkDevice device);
+/* device of a queue retrieved through vkGetDeviceQueue/vkGetDeviceQueue2 */
+xeno_device_t* xeno_queue_device(VkQueue queue);
+/* queues the wrapper hands out or submits to without the app retrieving them */
+void xeno_queue_register(VkQueue queue, xeno_device_t* dev);
+/* what vkGetDeviceProcAddr returns for name without the virtual queues: command buffers a module
+ * allocates and records through these are seen by every layer, on the driver's queue families */
+PFN_vkVoidFunction xeno_device_app_proc(xeno_device_t* dev, const char* name);
+/* what vkGetDeviceProcAddr returns for name when the layers routed ahead of the module intercepts
+ * (pipeline dedup) are skipped: the pass merging layer, the load/store layer, the multithreaded
+ * recording layer, the barrier layer, a module intercept or the driver entrypoint */
+PFN_vkVoidFunction xeno_device_next_proc(xeno_device_t* dev, const char* name);
+/* the same without the pass merging layer: the load/store layer, the multithreaded recording layer, the barrier layer, a
+ * module intercept or the driver entrypoint */
+PFN_vkVoidFunction xeno_device_loadstore_proc(xeno_device_t* dev, const char* name);
+/* the same without the load/store layer: the multithreaded recording layer, the barrier layer, a module intercept or the driver entrypoint */
+PFN_vkVoidFunction xeno_device_mtrecord_proc(xeno_device_t* dev, const char* name);
+/* the same without the multithreaded recording layer: the barrier layer, a module intercept or the driver entrypoint */
+PFN_vkVoidFunction xeno_device_barrier_proc(xeno_device_t* dev, const char* name);
+/* the same without the barrier layer: a module intercept or the driver entrypoint */
+PFN_vkVoidFunction xeno_device_module_proc(xeno_device_t* dev, const char* name);
+
+/* --- dynamic state tracking (xeno_dynstate.c) --- */
+#define XENO_DYN_STATES(X) \
+    X(VIEWPORT, VK_DYNAMIC_STATE_VIEWPORT, vkCmdSetViewport) \
+    X(SCISSOR, VK_DYNAMIC_STATE_SCISSOR, vkCmdSetScissor) \
+    X(LINE_WIDTH, VK_DYNAMIC_STATE_LINE_WIDTH, vkCmdSetLineWidth) \
+    X(DEPTH_BIAS, VK_DYNAMIC_STATE_DEPTH_BIAS, vkCmdSetDepthBias) \
+    X(BLEND_CONSTANTS, VK_DYNAMIC_STATE_BLEND_CONSTANTS, vkCmdSetBlendConstants) \
+    X(DEPTH_BOUNDS, VK_DYNAMIC_STATE_DEPTH_BOUNDS, vkCmdSetDepthBounds) \
+    X(STENCIL_COMPARE_MASK, VK_DYNAMIC_STATE_STENCIL_COMPARE_MASK, vkCmdSetStencilCompareMask) \
+    X(STENCIL_WRITE_MASK, VK_DYNAMIC_STATE_STENCIL_WRITE_MASK, vkCmdSetStencilWriteMask) \
+    X(STENCIL_REFERENCE, VK_DYNAMIC_STATE_STENCIL_REFERENCE, vkCmdSetStencilReference) \
+    X(VIEWPORT_WITH_COUNT, VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT, vkCmdSetViewportWithCount) \
+    X(SCISSOR_WITH_COUNT, VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT, vkCmdSetScissorWithCount) \
+    X(CULL_MODE, VK_DYNAMIC_STATE_CULL_MODE, vkCmdSetCullMode) \
+    X(FRONT_FACE, VK_DYNAMIC_STATE_FRONT_FACE, vkCmdSetFrontFace) \
+    X(PRIMITIVE_TOPOLOGY, VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY, vkCmdSetPrimitiveTopology) \
+    X(DEPTH_TEST_ENABLE, VK_DYNAMIC_STATE_DEPTH_TEST_ENABLE, vkCmdSetDepthTestEnable) \
+    X(DEPTH_WRITE_ENABLE, VK_DYNAMIC_STATE_DEPTH_WRITE_ENABLE, vkCmdSetDepthWriteEnable) \
+    X(DEPTH_COMPARE_OP, VK_DYNAMIC_STATE_DEPTH_COMPARE_OP, vkCmdSetDepthCompareOp) \
+    X(DEPTH_BOUNDS_TEST_ENABLE, VK_DYNAMIC_STATE_DEPTH_BOUNDS_TEST_ENABLE, vkCmdSetDepthBoundsTestEnable) \
+    X(STENCIL_TEST_ENABLE, VK_DYNAMIC_STATE_STENCIL_TEST_ENABLE, vkCmdSetStencilTestEnable) \
+    X(STENCIL_OP, VK_DYNAMIC_STATE_STENCIL_OP, vkCmdSetStencilOp) \
+    X(RASTERIZER_DISCARD_ENABLE, VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE, vkCmdSetRasterizerDiscardEnable) \
+    X(DEPTH_BIAS_ENABLE, VK_DYNAMIC_STATE_DEPTH_BIAS_ENABLE, vkCmdSetDepthBiasEnable) \
+    X(PRIMITIVE_RESTART_ENABLE, VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE, vkCmdSetPrimitiveRestartEnable) \
+    X(PATCH_CONTROL_POINTS, VK_DYNAMIC_STATE_PATCH_CONTROL_POINTS_EXT, vkCmdSetPatchControlPointsEXT) \
+    X(LOGIC_OP, VK_DYNAMIC_STATE_LOGIC_OP_EXT, vkCmdSetLogicOpEXT) \
+    X(DEPTH_CLAMP_ENABLE, VK_DYNAMIC_STATE_DEPTH_CLAMP_ENABLE_EXT, vkCmdSetDepthClampEnableEXT) \
+    X(POLYGON_MODE, VK_DYNAMIC_STATE_POLYGON_MODE_EXT, vkCmdSetPolygonModeEXT) \
+    X(RASTERIZATION_SAMPLES, VK_DYNAMIC_STATE_RASTERIZATION_SAMPLES_EXT, vkCmdSetRasterizationSamplesEXT) \
+    X(SAMPLE_MASK, VK_DYNAMIC_STATE_SAMPLE_MASK_EXT, vkCmdSetSampleMaskEXT) \
+    X(ALPHA_TO_COVERAGE_ENABLE, VK_DYNAMIC_STATE_ALPHA_TO_COVERAGE_ENABLE_EXT, vkCmdSetAlphaToCoverageEnableEXT) \
+    X(ALPHA_TO_ONE_ENABLE, VK_DYNAMIC_STATE_ALPHA_TO_ONE_ENABLE_EXT, vkCmdSetAlphaToOneEnableEXT) \
+    X(LOGIC_OP_ENABLE, VK_DYNAMIC_STATE_LOGIC_OP_ENABLE_EXT, vkCmdSetLogicOpEnableEXT) \
+    X(COLOR_BLEND_ENABLE, VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT, vkCmdSetColorBlendEnableEXT) \
+    X(COLOR_BLEND_EQUATION, VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT, vkCmdSetColorBlendEquationEXT) \
+    X(COLOR_WRITE_MASK, VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT, vkCmdSetColorWriteMaskEXT) \
+    X(VERTEX_INPUT, VK_DYNAMIC_STATE_VERTEX_INPUT_EXT, vkCmdSetVertexInputEXT)
+
+enum {
+#define XENO_DYN_ENUM(name, vk, fn) XENO_DYN_##name,
+    XENO_DYN_STATES(XENO_DYN_ENUM)
+#undef XENO_DYN_ENUM
+    XENO_DYN_COUNT
+};
+#define XENO_DYN_BIT(name) (1ull << XENO_DYN_##name)
+/* states every Vulkan 1.0 driver can set dynamically */
+#define XENO_DYN_CORE_MASK (XENO_DYN_BIT(VIEWPORT) | XENO_DYN_BIT(SCISSOR) | XENO_DYN_BIT(LINE_WIDTH) | XENO_DYN_BIT(DEPTH_BIAS) | \
+    XENO_DYN_BIT(BLEND_CONSTANTS) | XENO_DYN_BIT(DEPTH_BOUNDS) | XENO_DYN_BIT(STENCIL_COMPARE_MASK) | \
+    XENO_DYN_BIT(STENCIL_WRITE_MASK) | XENO_DYN_BIT(STENCIL_REFERENCE))
+/* the VK_EXT_extended_dynamic_state3 subset the wrapper can bake into pipeline variants */
+#define XENO_DYN_EDS3_MASK (XENO_DYN_BIT(DEPTH_CLAMP_ENABLE) | XENO_DYN_BIT(POLYGON_MODE) | XENO_DYN_BIT(RASTERIZATION_SAMPLES) | \
+    XENO_DYN_BIT(SAMPLE_MASK) | XENO_DYN_BIT(ALPHA_TO_COVERAGE_ENABLE) | XENO_DYN_BIT(ALPHA_TO_ONE_ENABLE) | \
+    XENO_DYN_BIT(LOGIC_OP_ENABLE) | XENO_DYN_BIT(COLOR_BLEND_ENABLE) | XENO_DYN_BIT(COLOR_BLEND_EQUATION) | XENO_DYN_BIT(COLOR_WRITE_MASK))
+
+#define XENO_MAX_VIEWPORTS 16
+#define XENO_MAX_COLOR_ATTACHMENTS 8
+#define XENO_MAX_VERTEX_BINDINGS 16
+#define XENO_MAX_VERTEX_ATTRIBUTES 16
+
+typedef struct xeno_stencil_ops { uint32_t fail, pass, depth_fail, compare; } xeno_stencil_ops_t;
+typedef struct xeno_vertex_binding { uint32_t binding, stride, rate, divisor; } xeno_vertex_binding_t;
+typedef struct xeno_vertex_attribute { uint32_t location, binding, format, offset; } xeno_vertex_attribute_t;
+
+typedef struct xeno_dyn_state {
+    uint32_t viewport_count, scissor_count;
+    VkViewport viewports[XENO_MAX_VIEWPORTS];
+    VkRect2D scissors[XENO_MAX_VIEWPORTS];
+    float line_width, depth_bias[3], blend_constants[4], depth_bounds[2];
+    uint32_t stencil_compare[2], stencil_write[2], stencil_ref[2];
+    uint32_t cull_mode, front_face, topology, depth_test, depth_write, depth_compare, depth_bounds_test, stencil_test;
+    xeno_stencil_ops_t stencil_op[2];
+    uint32_t rasterizer_discard, depth_bias_enable, primitive_restart, patch_control_points, logic_op;
+    uint32_t depth_clamp, polygon_mode, rasterization_samples, sample_mask, alpha_to_coverage, alpha_to_one, logic_op_enable;
+    uint32_t sample_mask_samples;   /* sample count passed with the mask */
+    uint32_t blend_enable[XENO_MAX_COLOR_ATTACHMENTS], write_mask[XENO_MAX_COLOR_ATTACHMENTS];
+    VkColorBlendEquationEXT blend_eq[XENO_MAX_COLOR_ATTACHMENTS];
+    uint32_t blend_enable_count, blend_eq_count, write_mask_count;  /* one past the highest attachment set */
+    uint32_t vertex_binding_count, vertex_attribute_count;
+    xeno_vertex_binding_t vertex_bindings[XENO_MAX_VERTEX_BINDINGS];
+    xeno_vertex_attribute_t vertex_attributes[XENO_MAX_VERTEX_ATTRIBUTES];
+} xeno_dyn_state_t;
+
+typedef struct xeno_render_formats {
+    uint32_t view_mask, color_count;
+    VkFormat color[XENO_MAX_COLOR_ATTACHMENTS];
+    VkFormat depth, stencil;
+} xeno_render_formats_t;
+
+/* Fixed-function create-info storage for pipelines derived from tracked dynamic state */
+typedef struct xeno_dyn_pipeline {
+    VkPipelineVertexInputStateCreateInfo vi;
+    VkVertexInputBindingDescription vi_bindings[XENO_MAX_VERTEX_BINDINGS];
+    VkVertexInputAttributeDescription vi_attributes[XENO_MAX_VERTEX_ATTRIBUTES];
+    VkPipelineInputAssemblyStateCreateInfo ia;
+    VkPipelineTessellationStateCreateInfo ts;
+    VkPipelineViewportStateCreateInfo vp;
+    VkPipelineRasterizationStateCreateInfo rs;
+    VkPipelineMultisampleStateCreateInfo ms;
+    VkSampleMask sample_mask[2];
+    VkPipelineDepthStencilStateCreateInfo ds;
+    VkPipelineColorBlendStateCreateInfo cb;
+    VkPipelineColorBlendAttachmentState attachments[XENO_MAX_COLOR_ATTACHMENTS];
+    VkPipelineDynamicStateCreateInfo dyn;
+    VkDynamicState dyn_list[XENO_DYN_COUNT];
+    VkPipelineRenderingCreateInfo rendering;
+} xeno_dyn_pipeline_t;
+
+#define XENO_DYN_MAX_WORDS 320
+uint64_t xeno_dyn_native_mask(const xeno_dispatch_t* vk);
+uint32_t xeno_dyn_pack(const xeno_dyn_state_t* s, uint64_t baked, uint32_t color_count, uint32_t* out);
+void xeno_dyn_fill_pipeline(xeno_dyn_pipeline_t* p, const xeno_dyn_state_t* s, uint64_t native, VkShaderStageFlags stages,
+                            const xeno_render_formats_t* rf, VkGraphicsPipelineCreateInfo* ci);
+void xeno_dyn_replay(xeno_device_t* dev, VkCommandBuffer cb, const xeno_dyn_state_t* s, uint64_t set_mask);
+
+/* --- resource tracking (xeno_resource.c) --- */
+/* per-object state of a module, hung off an image or render pass record and released with it */
+enum { XENO_RESOURCE_TRANSIENT, XENO_RESOURCE_LOADSTORE, XENO_RESOURCE_PASSMERGE, XENO_RESOURCE_USERS };
+typedef struct xeno_resource_user {
+    void (*release)(struct xeno_resource_user* u);
+} xeno_resource_user_t;
+typedef struct xeno_image {
+    VkImage handle;
+    xeno_device_t* dev;
+    VkImageCreateInfo info;
+    int attachment_only;            /* contents leave only through the passes the image is attached to */
+    _Atomic(xeno_resource_user_t*) user[XENO_RESOURCE_USERS];
+} xeno_image_t;
+typedef struct xeno_view {
+    VkImageView handle;
+    xeno_device_t* dev;
+    VkImage image;
+    VkFormat format;
+    VkImageSubresourceRange range;
+} xeno_view_t;
+typedef struct xeno_render_pass {
+    VkRenderPass handle;
+    xeno_device_t* dev;
+    int v2;                         /* created through vkCreateRenderPass2 */
+    int extended;                   /* created with extension structs the copy leaves out */
+    union { void* info; VkRenderPassCreateInfo* info1; VkRenderPassCreateInfo2* info2; };
+    _Atomic(xeno_resource_user_t*) user[XENO_RESOURCE_USERS];
+} xeno_render_pass_t;
+typedef struct xeno_framebuffer {
+    VkFramebuffer handle;
+    xeno_device_t* dev;
+    uint32_t layers;
+    uint32_t count;                 /* 0 for imageless framebuffers */
+    VkImageView views[];
+} xeno_framebuffer_t;
+xeno_image_t* xeno_image_get(VkImage image);
+xeno_view_t* xeno_view_get(VkImageView view);
+xeno_image_t* xeno_view_image(VkImageView view);
+xeno_render_pass_t* xeno_render_pass_get(VkRenderPass pass);
+xeno_framebuffer_t* xeno_framebuffer_get(VkFramebuffer framebuffer);
+/* usage is attachments alone and tiling optimal */
+int xeno_attachment_usage_only(const VkImageCreateInfo* ci);
+/* installs u in an empty slot; when another thread got there first u is released and theirs returned */
+xeno_resource_user_t* xeno_resource_attach(_Atomic(xeno_resource_user_t*)* slot, xeno_resource_user_t* u);
+/* fn for the state a module keeps in slot on each live render pass of the device */
+void xeno_render_pass_foreach(xeno_device_t* dev, int slot, void (*fn)(xeno_resource_user_t* u, void* ctx), void* ctx);
+PFN_vkVoidFunction xeno_resource_proc(xeno_device_t* dev, const char* name);
+void xeno_resource_destroy(xeno_device_t* dev);
+
+/* --- command buffer tracking (xeno_cmdbuf.c) --- */
+#define XENO_SO_STAGES 7
+struct xeno_shader;
+struct xeno_dyn_template;
+typedef struct xeno_cb {
+    VkCommandBuffer handle;
+    xeno_device_t* dev;
+    VkCommandPool pool;
+    VkCommandBufferLevel level;
+    xeno_dyn_state_t dyn;
+    uint64_t dyn_set;               /* XENO_DYN_* bits recorded since begin */
+    uint64_t dyn_dirty;             /* XENO_DYN_* bits changed since the last variant resolve */
+    xeno_render_formats_t rf;
+    int in_rendering;
+    VkPipeline app_pipeline[2];     /* graphics / compute pipelines bound by the app */
+    int state_clobbered;            /* an app pipeline with static state replaced our dynamic state */
+    struct xeno_shader* so_stage[XENO_SO_STAGES];
+    int so_active, so_dirty;
+    VkPipeline so_pipeline;         /* variant currently bound for shader objects */
+    struct xeno_dyn_template* emu;  /* bound app pipeline with emulated dynamic state */
+    VkPipeline emu_pipeline;        /* variant currently bound for it */
+    uint64_t epoch;                 /* dev->cb_epoch at begin; 0 when not recorded */
+    VkPipeline* owned; uint32_t owned_count, owned_cap;
+} xeno_cb_t;
+xeno_cb_t* xeno_cb_get(VkCommandBuffer cb);
+void xeno_cb_own_pipeline(xeno_cb_t* cb, VkPipeline pipeline);
+PFN_vkVoidFunction xeno_cmdbuf_proc(xeno_device_t* dev, const char* name);
+int xeno_cmdbuf_device_init(xeno_device_t* dev);
+/* lowest epoch among command buffers that may still reference recorded pipelines */
+uint64_t xeno_cmdbuf_min_epoch(xeno_device_t* dev);
+void xeno_cmdbuf_device_destroy(xeno_device_t* dev);
+
+/* --- bounded lock-free pipeline variant cache (xeno_variant_cache.c) --- */
+enum { XENO_VARIANT_EMPTY = 0, XENO_VARIANT_CLAIMED, XENO_VARIANT_COMPILING, XENO_VARIANT_READY, XENO_VARIANT_FAILED, XENO_VARIANT_EVICTING };
+typedef struct xeno_variant_key { uint64_t h1, h2; } xeno_variant_key_t;
+typedef struct xeno_variant {
+    _Atomic uint64_t hash;          /* h1; 0 = never used, UINT64_MAX = evicted */
+    uint64_t h2;
+    _Atomic uint32_t state;
+    _Atomic uint64_t last_use;      /* cache clock at last hit */
+    VkPipeline pipeline;
+    uint64_t compile_ns;
+} xeno_variant_t;
+typedef struct xeno_variant_cache {
+    xeno_variant_t* slots;
+    uint32_t mask, capacity;
+    xeno_device_t* dev;
+    _Atomic uint32_t count;
+    _Atomic uint64_t clock;
+    pthread_mutex_t wait_lock;
+    pthread_cond_t wait_cond;
+    pthread_mutex_t evict_lock;
+    struct { VkPipeline pipeline; uint64_t epoch; }* grave; uint32_t grave_count, grave_cap;
+    _Atomic uint64_t hits, misses, waits, overflows, evictions, async_compiles, failures;
+    _Atomic uint64_t compile_ns_total, compile_ns_max;
+} xeno_variant_cache_t;
+typedef VkPipeline (*xeno_variant_compile_fn)(void* ctx);
+xeno_variant_key_t xeno_variant_key(const uint32_t* words, uint32_t count);
+int xeno_variant_cache_init(xeno_variant_cache_t* c, xeno_device_t* dev, uint32_t capacity);
+void xeno_variant_cache_destroy(xeno_variant_cache_t* c);
+/* returns the slot for k; *claimed is set when the caller now owns compiling it; NULL when full */
+xeno_variant_t* xeno_variant_acquire(xeno_variant_cache_t* c, const xeno_variant_key_t* k, int* claimed);
+void xeno_variant_publish(xeno_variant_cache_t* c, xeno_variant_t* v, VkPipeline pipeline, uint64_t compile_ns);
+/* NULL when the compile failed or the slot was evicted meanwhile */
+VkPipeline xeno_variant_wait(xeno_variant_cache_t* c, xeno_variant_t* v, const xeno_variant_key_t* k);
+/* lookup, compiling inline on a miss; *uncached is set when the cache had no room and the caller owns the pipeline */
+VkPipeline xeno_variant_get(xeno_variant_cache_t* c, const xeno_variant_key_t* k, xeno_variant_compile_fn compile, void* ctx, int* uncached);
+/* evicts least recently used variants until at most keep remain; returns the number evicted */
+uint32_t xeno_variant_trim(xeno_variant_cache_t* c, uint32_t keep);
+void xeno_variant_report(FILE* f, const xeno_variant_cache_t* c);
+
+/* --- on-disk pipeline cache store: pack + index (xeno_pcache_store.c, shared with xeno_pcache_tool);
+ * one cache may be open in several processes at once --- */
+#define XENO_PCACHE_CREATE (1 << 0)
+#define XENO_PCACHE_READONLY (1 << 1)
+#define XENO_PCACHE_ENTRY_DROP (1u << 0)
+#define XENO_PCACHE_OLD_MAPS 16
+typedef struct xeno_pcache_id { uint32_t vendor, device; uint8_t uuid[VK_UUID_SIZE]; } xeno_pcache_id_t;
+typedef struct xeno_pcache_entry {  /* also the on-disk index entry */
+    uint64_t h1, h2;
+    uint64_t offset;                /* of the record in the pack */
+    uint64_t last_use;              /* unix seconds */
+    uint64_t checksum;
+    uint32_t size, flags;
+} xeno_pcache_entry_t;
+typedef struct xeno_pcache_store {
+    char base[512];                 /* path without the .xpc/.xpi extension */
+    int fd, readonly, dirty, reset; /* reset: an existing cache for another driver was discarded */
+    xeno_pcache_id_t id;
+    uint64_t generation, pack_size, live_bytes; /* pack_size: end of the records indexed so far */
+    void* hdr;                      /* shared mapping of the pack header (committed offset, retired flag) */
+    const unsigned char* map; uint64_t map_len;
+    struct { void* addr; uint64_t len; } old_maps[XENO_PCACHE_OLD_MAPS]; uint32_t old_count;
+    xeno_pcache_entry_t* entries; uint32_t count, cap;
+    uint32_t* table; uint32_t table_mask;
+    uint64_t recovered, corrupt, evicted;
+    uint64_t refreshed, reopens;    /* records picked up from other processes; packs replaced under us */
+    pthread_mutex_t lock;
+} xeno_pcache_store_t;
+/* 0 on success, -1 on I/O error, -2 when the files belong to another driver (or id is NULL and
+ * there is nothing to open); call xeno_pcache_close either way */
+int xeno_pcache_open(xeno_pcache_store_t* s, const char* base, const xeno_pcache_id_t* id, int flags);
+void xeno_pcache_close(xeno_pcache_store_t* s);
+/* *data is malloc'd; stamps the entry's last use. A miss first picks up records other processes added */
+int xeno_pcache_get(xeno_pcache_store_t* s, uint64_t h1, uint64_t h2, void** data, uint32_t* size);
+int xeno_pcache_put(xeno_pcache_store_t* s, uint64_t h1, uint64_t h2, const void* data, uint32_t size);
+/* drops entries last used before older_than (0 = no age limit), then LRU entries while over budget (0 = none) */
+uint32_t xeno_pcache_evict(xeno_pcache_store_t* s, uint64_t budget, uint64_t older_than);
+uint64_t xeno_pcache_dead_bytes(const xeno_pcache_store_t* s);
+int xeno_pcache_save(xeno_pcache_store_t* s);
+/* rewrites the pack with only the live records into a new file; other processes switch over on their next access */
+int xeno_pcache_compact(xeno_pcache_store_t* s);
+/* copies src entries that dst lacks or has older; returns the number merged, -1 for different drivers */
+int xeno_pcache_merge(xeno_pcache_store_t* dst, xeno_pcache_store_t* src);
+
+/* --- persistent pipeline cache, interposed in the dispatch table (xeno_pcache.c) --- */
+int xeno_pcache_device_init(xeno_device_t* dev);
+void xeno_pcache_device_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_pcache_proc(xeno_device_t* dev, const char* name);
+void xeno_pcache_report(FILE* f, xeno_device_t* dev);
+
+/* --- parallel compilation of pipeline batches, interposed above the pipeline cache (xeno_pipeline_split.c) --- */
+int xeno_split_init(xeno_device_t* dev);
+void xeno_split_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_split_proc(xeno_device_t* dev, const char* name);
+void xeno_split_report(FILE* f, xeno_device_t* dev);
+int xeno_split_cache_exclusive(xeno_device_t* dev, VkPipelineCache cache);
+
+/* --- identical pipeline sharing, routed ahead of every module (xeno_pipeline_dedup.c) --- */
+int xeno_dedup_init(xeno_device_t* dev);
+void xeno_dedup_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_dedup_proc(xeno_device_t* dev, const char* name);
+void xeno_dedup_report(FILE* f, xeno_device_t* dev);
+
+/* --- VK_KHR_deferred_host_operations emulation (xeno_deferred.c) --- */
+int xeno_deferred_init(xeno_device_t* dev);
+void xeno_deferred_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_deferred_proc(xeno_device_t* dev, const char* name);
+void xeno_deferred_report(FILE* f, xeno_device_t* dev);
+
+/* --- device memory suballocation: app VkDeviceMemory -> (block, offset) (xeno_suballoc.c) --- */
+int xeno_suballoc_init(xeno_device_t* dev);
+void xeno_suballoc_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_suballoc_proc(xeno_device_t* dev, const char* name);
+void xeno_suballoc_report(FILE* f, xeno_device_t* dev);
+/* frees blocks that hold no suballocation, including the one an empty pool keeps; returns the bytes released */
+uint64_t xeno_suballoc_trim(xeno_device_t* dev);
+
+/* --- memory budget tracking, steering and pressure hooks, routed ahead of every module (xeno_membudget.c) --- */
+int xeno_budget_init(xeno_device_t* dev);
+void xeno_budget_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_budget_proc(xeno_device_t* dev, const char* name);
+void xeno_budget_report(FILE* f, xeno_device_t* dev);
+/* caps heap sizes at the budget the driver reports for the process */
+void xeno_budget_heaps(VkPhysicalDevice physical, VkPhysicalDeviceMemoryProperties* props);
+/* MemAvailable of the system, 0 when unknown */
+uint64_t xeno_budget_system_bytes(void);
+/* heapBudget / heapUsage of a driver physical device; -1 without VK_EXT_memory_budget (libxeno_wrapper.c) */
+int xeno_query_memory_budget(VkPhysicalDevice physical, VkDeviceSize* budget, VkDeviceSize* usage);
+
+/* --- persistently mapped staging ring for uploads (xeno_staging.c) --- */
+typedef struct xeno_staging_span { VkBuffer buffer; VkDeviceSize offset, size; void* ptr; } xeno_staging_span_t;
+typedef struct xeno_staging_image {
+    VkImage image;
+    VkImageLayout layout;           /* TRANSFER_DST_OPTIMAL or GENERAL */
+    VkImageSubresourceLayers subresource;
+    VkOffset3D offset;
+    VkExtent3D extent;              /* texels; data is tightly packed block rows, slice after slice, layer after layer */
+    uint32_t block_bytes, block_w, block_h; /* texel block of the format, e.g. 16, 4, 4 for BC3 */
+} xeno_staging_image_t;
+int xeno_staging_init(xeno_device_t* dev);
+void xeno_staging_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_staging_proc(xeno_device_t* dev, const char* name);
+void xeno_staging_report(FILE* f, xeno_device_t* dev);
+/* reserves ring bytes read by commands recorded into cb; -1 when the ring is off or cannot make room */
+int xeno_staging_alloc(xeno_device_t* dev, VkCommandBuffer cb, VkDeviceSize size, VkDeviceSize align, xeno_staging_span_t* span);
+/* record chunked copies from *done (bytes / block rows) onwards, advancing it; -1 when the ring filled up
+ * first: submit cb and call again with the same *done in a fresh command buffer */
+int xeno_staging_upload_buffer(xeno_device_t* dev, VkCommandBuffer cb, const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dst_offset, VkDeviceSize* done);
+int xeno_staging_upload_image(xeno_device_t* dev, VkCommandBuffer cb, const void* data, const xeno_staging_image_t* dst, uint32_t* rows_done);
+/* wrapper-internal submits of command buffers holding spans report here (app submits are intercepted);
+ * cbs must be submitted once, and released if reset or freed without a submit */
+void xeno_staging_submitted(xeno_device_t* dev, VkQueue queue, const VkCommandBuffer* cbs, uint32_t count);
+void xeno_staging_release(xeno_device_t* dev, VkCommandBuffer cb);
+
+/* --- slab/arena host allocation callbacks for the driver (xeno_hostalloc.c) --- */
+/* XCLIPSE_HOST_ALLOC, read at instance and device creation */
+int xeno_hostalloc_enabled(void);
+/* process-wide callbacks; memory allocated through them stays valid for the process lifetime */
+const VkAllocationCallbacks* xeno_hostalloc_callbacks(void);
+int xeno_hostalloc_init(xeno_device_t* dev);
+void xeno_hostalloc_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_hostalloc_proc(xeno_device_t* dev, const char* name);
+void xeno_hostalloc_report(FILE* f, xeno_device_t* dev);
+
+/* --- transient attachments on lazily allocated memory, learned from load/store ops (xeno_transient.c) --- */
+int xeno_transient_init(xeno_device_t* dev);
+void xeno_transient_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_transient_proc(xeno_device_t* dev, const char* name);
+void xeno_transient_report(FILE* f, xeno_device_t* dev);
+
+/* --- queue submission: coalescing of a frame's submits (xeno_submit.c) --- */
+int xeno_submit_init(xeno_device_t* dev);
+void xeno_submit_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_submit_proc(xeno_device_t* dev, const char* name);
+void xeno_submit_report(FILE* f, xeno_device_t* dev);
+
+/* --- fence pooling, fences on per-queue timelines (xeno_fence.c) --- */
+int xeno_fence_init(xeno_device_t* dev);
+void xeno_fence_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_fence_proc(xeno_device_t* dev, const char* name);
+void xeno_fence_report(FILE* f, xeno_device_t* dev);
+
+/* --- fence completions delivered from an epoll thread over sync_files (xeno_reactor.c) --- */
+/* result is VK_SUCCESS once the fence signalled, VK_ERROR_DEVICE_LOST when it never will */
+typedef void (*xeno_reactor_fn)(void* ctx, VkResult result);
+int xeno_reactor_init(xeno_device_t* dev);
+void xeno_reactor_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_reactor_proc(xeno_device_t* dev, const char* name);
+void xeno_reactor_report(FILE* f, xeno_device_t* dev);
+/* fence's signal operation must have been submitted to the driver. 0: fn runs (on the reactor thread,
+ * or already ran on this one) and *futex_word is set to 1 and woken, either may be NULL; -1: the
+ * fence cannot be watched and the caller polls it */
+int xeno_reactor_watch(xeno_device_t* dev, VkFence fence, xeno_reactor_fn fn, void* ctx, uint32_t* futex_word);
+
+/* --- low-latency frame throttling and frame-rate cap (xeno_pacing.c) --- */
+int xeno_pacing_init(xeno_device_t* dev);
+void xeno_pacing_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_pacing_proc(xeno_device_t* dev, const char* name);
+void xeno_pacing_report(FILE* f, xeno_device_t* dev);
+
+/* --- redundant bind and dynamic state filtering, routed ahead of every module (xeno_state_filter.c) --- */
+int xeno_state_filter_init(xeno_device_t* dev);
+void xeno_state_filter_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_state_filter_proc(xeno_device_t* dev, const char* name);
+void xeno_state_filter_report(FILE* f, xeno_device_t* dev);
+
+/* --- pipeline barrier merging, elision and narrowing, in front of the modules (xeno_barrier.c) --- */
+int xeno_barrier_init(xeno_device_t* dev);
+void xeno_barrier_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_barrier_proc(xeno_device_t* dev, const char* name);
+void xeno_barrier_report(FILE* f, xeno_device_t* dev);
+/* emits the barriers held for cb: wrapper code recording into an app command buffer calls it first */
+void xeno_barrier_flush(xeno_device_t* dev, VkCommandBuffer cb);
+
+/* --- render pass load/store op rewriting, in front of the barrier layer (xeno_loadstore.c) --- */
+int xeno_loadstore_init(xeno_device_t* dev);
+void xeno_loadstore_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_loadstore_proc(xeno_device_t* dev, const char* name);
+void xeno_loadstore_report(FILE* f, xeno_device_t* dev);
+
+/* --- merging of consecutive render pass instances, in front of the load/store layer (xeno_passmerge.c) --- */
+int xeno_passmerge_init(xeno_device_t* dev);
+void xeno_passmerge_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_passmerge_proc(xeno_device_t* dev, const char* name);
+void xeno_passmerge_report(FILE* f, xeno_device_t* dev);
+
+/* --- multithreaded secondary recording of large render passes, in front of the barrier layer (xeno_mtrecord.c) --- */
+int xeno_mtrecord_init(xeno_device_t* dev);
+void xeno_mtrecord_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_mtrecord_proc(xeno_device_t* dev, const char* name);
+void xeno_mtrecord_report(FILE* f, xeno_device_t* dev);
+
+/* --- virtual queues over the hardware's queues (xeno_vqueue.c) --- */
+#define XENO_QUEUE_FAMILY_COUNT 3
+/* what vkGetPhysicalDeviceQueueFamilyProperties advertises */
+extern const VkQueueFamilyProperties xeno_queue_families[XENO_QUEUE_FAMILY_COUNT];
+struct xeno_vqueue_plan;
+/* NULL when the driver's families hold the app's queue requests; otherwise *out is ci with real requests */
+struct xeno_vqueue_plan* xeno_vqueue_plan(const VkQueueFamilyProperties* real, uint32_t real_count, const VkDeviceCreateInfo* ci, VkDeviceCreateInfo* out);
+void xeno_vqueue_plan_free(struct xeno_vqueue_plan* plan);
+int xeno_vqueue_init(xeno_device_t* dev, struct xeno_vqueue_plan* plan); /* takes the plan */
+void xeno_vqueue_destroy(xeno_device_t* dev);
+/* 1 when the device's queues are virtual, with *pQueue set (NULL for a queue that was not created) */
+int xeno_vqueue_get(xeno_device_t* dev, uint32_t family, uint32_t index, VkQueue* pQueue);
+PFN_vkVoidFunction xeno_vqueue_proc(xeno_device_t* dev, const char* name);
+/* returns once what the virtual queues had enqueued has been submitted to the driver */
+void xeno_vqueue_flush(xeno_device_t* dev);
+/* queue entrypoints that cannot be handed out while the device's queues are virtual */
+int xeno_vqueue_hidden(xeno_device_t* dev, const char* name);
+void xeno_vqueue_report(FILE* f, xeno_device_t* dev);
+
+/* --- VK_EXT_shader_object emulation (xeno_shader_object.c) --- */
+int xeno_shader_object_init(xeno_device_t* dev);
+void xeno_shader_object_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_shader_object_proc(xeno_device_t* dev, const char* name);
+/* sheds all but a quarter of the variant cache; returns the variants evicted */
+uint32_t xeno_shader_object_trim(xeno_device_t* dev);
+void xeno_shader_object_prepare_draw(xeno_cb_t* cb);
+void xeno_shader_object_report(FILE* f, xeno_device_t* dev);
+
+/* --- EDS3 / vertex input dynamic state emulation for app pipelines (xeno_dyn_emulation.c) --- */
+int xeno_dyn_emu_init(xeno_device_t* dev);
+void xeno_dyn_emu_destroy(xeno_device_t* dev);
+PFN_vkVoidFunction xeno_dyn_emu_proc(xeno_device_t* dev, const char* name);
+/* sheds all but a quarter of the variant cache; returns the variants evicted */
+uint32_t xeno_dyn_emu_trim(xeno_device_t* dev);
+struct xeno_dyn_template* xeno_dyn_emu_lookup(xeno_device_t* dev, VkPipeline pipeline);
+void xeno_dyn_emu_prepare_draw(xeno_cb_t* cb);
+void xeno_dyn_emu_report(FILE* f, xeno_device_t* dev);
+
+#endif /* XENO_INTERNAL_H */
@@ -0,0 +1,815 @@
+/* xeno_loadstore.c - render pass load/store op rewriting for tile memory
+ *
+ * On a tiler every attachment a pass loads is read from memory into tile memory before its first
+ * draw, and every attachment it stores is written back after its last one: a full-resolution read
+ * or write each. Ported engines load attachments they clear right away with vkCmdClearAttachments,
+ * load attachments whose contents are undefined, and store attachments no later pass reads. The
+ * render pass begins recorded through here have their ops rewritten where the contents are dead:
+ *  - a vkCmdClearAttachments that is the first command of a pass and covers its whole render area
+ *    and every layer becomes LOAD_OP_CLEAR, with its clear values, on the attachments it names and
+ *    is dropped. To see it, the begin is held per command buffer until the next command recorded
+ *    inside the pass (draws, clears, barriers, event waits, queries, subpass and pass ends,
+ *    vkCmdExecuteCommands); state commands recorded in between reach the driver ahead of the
+ *    begin, which changes nothing: bound and dynamic state outlive render pass boundaries;
+ *  - LOAD of a render pass attachment whose initial layout is UNDEFINED becomes DONT_CARE;
+ *  - with XCLIPSE_LOADSTORE_STORES=1, STORE of an attachment-only image (no sampled, storage or
+ *    transfer usage: its contents can only leave a pass through a later pass loading them) becomes
+ *    DONT_CARE once the image took part in XCLIPSE_LOADSTORE_PASSES passes without ever being
+ *    loaded. This is a prediction, not a proof: learning follows recording order, which can differ
+ *    from execution order across command buffers, and a pass loading the image after its stores
+ *    were dropped reads undefined contents. Such an image is ruled out for good and counted as
+ *    mispredicted, so the knob is for titles whose report shows none.
+ * Render pass objects carry their ops: a rewritten begin uses a variant of the pass created with
+ * the new ops, which stays compatible with the app's framebuffers, pipelines and secondaries since
+ * load and store ops take no part in render pass compatibility. Passes created with extension
+ * structs other than a subpass depth/stencil resolve, or with more than LS_MAX_ATTACHMENTS
+ * attachments, and suspending or resuming dynamic rendering keep their ops; begins with extension structs the module does not copy are rewritten
+ * but not held. A device exposing commands valid inside a pass that bypass the layer (multi-draw,
+ * transform feedback, conditional rendering, ...) holds no begin.
+ *
+ * Images, views, render passes and framebuffers are looked up in xeno_resource.c; what is learned
+ * about an image and the variants of a pass are kept on their records there.
+ *
+ * Every decision is counted per render pass object and per attachment set of dynamic rendering,
+ * with the memory traffic it saves estimated from the render area and the attachment formats.
+ *
+ * The layer is returned by xeno_device_loadstore_proc(), behind the pass merging layer, and
+ * forwards through xeno_device_mtrecord_proc(): the multithreaded recording layer and the barrier
+ * layer see begins where they finally go, after the barriers recorded ahead of them.
+ *
+ * Knobs:
+ *   XCLIPSE_LOADSTORE=1            enable
+ *   XCLIPSE_LOADSTORE_CLEARS=0     hold no begin, leave vkCmdClearAttachments alone
+ *   XCLIPSE_LOADSTORE_STORES=1     drop the stores of attachment-only images learned to be never loaded
+ *   XCLIPSE_LOADSTORE_PASSES=N     passes an attachment-only image takes part in unloaded before its stores are dropped (default 16)
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+#define LS_MAX_ATTACHMENTS 16           /* per pass; bigger passes keep their ops */
+#define LS_SLOTS (LS_MAX_ATTACHMENTS + 2) /* dynamic rendering: colors, depth, stencil */
+#define LS_MAX_VARIANTS 8               /* rewritten copies per render pass object */
+#define LS_MAX_RENDERINGS 256           /* dynamic rendering attachment sets counted per device */
+#define LS_MAX_REPORTED 16              /* passes listed in the report, by traffic saved */
+#define LS_MAX_LOGGED 16                /* mispredictions logged per process */
+#define LS_NONE UINT32_MAX
+#define ATTACHMENT_USAGE (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT)
+
+enum {
+    LS_BEGINS, LS_HELD, LS_PASSTHROUGH, LS_CLEARS_FOLDED, LS_CLEAR_CALLS_DROPPED, LS_LOADS_CLEARED, LS_LOADS_DROPPED,
+    LS_STORES_DROPPED, LS_COUNTERS
+};
+static const char* const ls_counter_names[LS_COUNTERS] = {
+    "begins", "held", "passthrough", "clears_folded", "clear_calls_dropped", "loads_cleared", "loads_dropped", "stores_dropped"
+};
+
+enum { LS_HELD_NONE, LS_HELD_RENDERING, LS_HELD_PASS, LS_HELD_PASS2 };
+
+#define LS_HOOKS(X) \
+    X(vkAllocateCommandBuffers) X(vkFreeCommandBuffers) X(vkDestroyCommandPool) X(vkBeginCommandBuffer) X(vkEndCommandBuffer) \
+    X(vkCmdBeginRenderPass) X(vkCmdBeginRenderPass2) X(vkCmdBeginRendering) \
+    LS_PASS_HOOKS(X)
+/* commands recorded inside a pass that a held begin goes out before */
+#define LS_PASS_HOOKS(X) \
+    X(vkCmdClearAttachments) X(vkCmdExecuteCommands) \
+    X(vkCmdDraw) X(vkCmdDrawIndexed) X(vkCmdDrawIndirect) X(vkCmdDrawIndexedIndirect) \
+    X(vkCmdDrawIndirectCount) X(vkCmdDrawIndexedIndirectCount) X(vkCmdDrawMeshTasksEXT) \
+    X(vkCmdPipelineBarrier) X(vkCmdPipelineBarrier2) X(vkCmdWaitEvents) X(vkCmdWaitEvents2) \
+    X(vkCmdBeginQuery) X(vkCmdEndQuery) X(vkCmdWriteTimestamp) X(vkCmdWriteTimestamp2) \
+    X(vkCmdNextSubpass) X(vkCmdNextSubpass2) X(vkCmdEndRenderPass) X(vkCmdEndRenderPass2) X(vkCmdEndRendering)
+
+/* other names of the hooked entrypoints; the driver may only know one of them */
+static const struct { const char* name; const char* alias; } ls_aliases[] = {
+    { "vkCmdBeginRenderPass2", "vkCmdBeginRenderPass2KHR" }, { "vkCmdNextSubpass2", "vkCmdNextSubpass2KHR" },
+    { "vkCmdEndRenderPass2", "vkCmdEndRenderPass2KHR" },
+    { "vkCmdBeginRendering", "vkCmdBeginRenderingKHR" }, { "vkCmdEndRendering", "vkCmdEndRenderingKHR" },
+    { "vkCmdDrawIndirectCount", "vkCmdDrawIndirectCountKHR" }, { "vkCmdDrawIndirectCount", "vkCmdDrawIndirectCountAMD" },
+    { "vkCmdDrawIndexedIndirectCount", "vkCmdDrawIndexedIndirectCountKHR" }, { "vkCmdDrawIndexedIndirectCount", "vkCmdDrawIndexedIndirectCountAMD" },
+    { "vkCmdPipelineBarrier2", "vkCmdPipelineBarrier2KHR" }, { "vkCmdWaitEvents2", "vkCmdWaitEvents2KHR" },
+    { "vkCmdWriteTimestamp2", "vkCmdWriteTimestamp2KHR" },
+};
+#define LS_ALIAS_COUNT (sizeof(ls_aliases) / sizeof(ls_aliases[0]))
+
+/* commands valid inside a pass that do not pass through here */
+static const char* const ls_unseen[] = {
+    "vkCmdDrawMultiEXT", "vkCmdDrawMultiIndexedEXT", "vkCmdDrawMeshTasksIndirectEXT", "vkCmdDrawMeshTasksIndirectCountEXT",
+    "vkCmdDrawMeshTasksNV", "vkCmdDrawMeshTasksIndirectNV", "vkCmdDrawMeshTasksIndirectCountNV", "vkCmdDrawIndirectByteCountEXT",
+    "vkCmdBeginTransformFeedbackEXT", "vkCmdEndTransformFeedbackEXT", "vkCmdBeginConditionalRenderingEXT", "vkCmdEndConditionalRenderingEXT",
+    "vkCmdBeginQueryIndexedEXT", "vkCmdEndQueryIndexedEXT", "vkCmdWriteBufferMarkerAMD", "vkCmdWriteBufferMarker2AMD",
+    "vkCmdSetRenderingAttachmentLocationsKHR", "vkCmdSetRenderingInputAttachmentIndicesKHR", "vkCmdEndRendering2EXT",
+    "vkCmdExecuteGeneratedCommandsNV", "vkCmdExecuteGeneratedCommandsEXT",
+    "vkCmdDrawClusterHUAWEI", "vkCmdDrawClusterIndirectHUAWEI", "vkCmdSubpassShadingHUAWEI",
+};
+
+typedef struct ls_stats {               /* one render pass object or dynamic rendering attachment set */
+    int rendering;
+    uint64_t id;                        /* VkRenderPass, or the hash of the attachment views */
+    _Atomic uint64_t begins, clears_folded, loads_cleared, loads_dropped, stores_dropped, bytes;
+} ls_stats_t;
+
+typedef struct xeno_loadstore_device {
+    xeno_device_t* dev;
+#define LS_NEXT(fn) PFN_##fn next_##fn;
+    LS_HOOKS(LS_NEXT)
+#undef LS_NEXT
+    int clears, stores;
+    uint32_t learn_passes;
+    xeno_map_t renderings;              /* attachment view hash -> ls_stats_t */
+    pthread_mutex_t rendering_lock;     /* inserts into renderings */
+    _Atomic uint64_t n[LS_COUNTERS], bytes, variants, mispredicted, recorded;
+} xeno_loadstore_device_t;
+
+typedef struct ls_image {               /* on the xeno_image_t of an image with an attachment usage */
+    xeno_resource_user_t user;
+    const xeno_image_t* image;
+    _Atomic uint32_t passes;            /* taken part in */
+    _Atomic uint32_t loaded;            /* sticky */
+    _Atomic uint32_t dropped;           /* a store of it was dropped */
+} ls_image_t;
+
+/* the ops of one attachment; dynamic rendering slots use load and store only */
+typedef struct ls_ops { VkAttachmentLoadOp load, stencil_load; VkAttachmentStoreOp store, stencil_store; } ls_ops_t;
+
+typedef struct ls_variant { uint64_t key; VkRenderPass pass; } ls_variant_t;
+
+typedef struct ls_pass {                /* on the xeno_render_pass_t */
+    xeno_resource_user_t user;
+    xeno_loadstore_device_t* ld;
+    ls_stats_t stats;
+    int v2;                             /* created through vkCreateRenderPass2 */
+    const void* info;                   /* the tracker's copy of the create info, NULL when the ops stay as created */
+    uint32_t count;                     /* attachments */
+    uint32_t color_count, colors[LS_MAX_ATTACHMENTS], depth;    /* of the first subpass */
+    uint32_t view_mask;                 /* of the first subpass */
+    VkFormat formats[LS_MAX_ATTACHMENTS];
+    VkSampleCountFlagBits samples[LS_MAX_ATTACHMENTS];
+    ls_ops_t ops[LS_MAX_ATTACHMENTS];   /* as created, stencil ops of formats without stencil DONT_CARE */
+    ls_ops_t base[LS_MAX_ATTACHMENTS];  /* with the loads of undefined contents dropped */
+    uint64_t key;                       /* of ops */
+    pthread_mutex_t lock;               /* variant creation */
+    ls_variant_t variants[LS_MAX_VARIANTS];
+    _Atomic uint32_t variant_count;
+} ls_pass_t;
+
+typedef struct ls_cb {
+    xeno_loadstore_device_t* ld;
+    VkCommandBuffer handle;
+    VkCommandPool pool;
+    int held;                           /* LS_HELD_*: a begin waiting for the first command of its pass */
+    /* the begin being rewritten: render pass attachments, or color, depth and stencil slots */
+    uint32_t slots;
+    int fixed;                          /* its ops cannot change */
+    ls_ops_t app[LS_SLOTS], ops[LS_SLOTS];
+    VkClearValue app_clears[LS_SLOTS], clears[LS_SLOTS];
+    VkImageView views[LS_SLOTS];
+    VkFormat formats[LS_SLOTS];
+    VkSampleCountFlagBits samples[LS_SLOTS];
+    VkRect2D area;
+    uint32_t layers, view_mask;
+    ls_pass_t* pass;
+    ls_stats_t* stats;
+    VkRenderingInfo rendering;
+    VkRenderingAttachmentInfo attachments[LS_SLOTS];
+    VkRenderPassBeginInfo begin;
+    VkRenderPassAttachmentBeginInfo begin_views;
+    VkSubpassBeginInfo subpass;
+    VkSubpassContents contents;
+    uint64_t n[LS_COUNTERS], bytes;
+} ls_cb_t;
+
+static xeno_map_t ls_cbs;
+static pthread_once_t ls_cbs_once = PTHREAD_ONCE_INIT;
+static void ls_cbs_init(void) { xeno_map_init(&ls_cbs, 4096); }
+static _Atomic uint32_t ls_logged;
+
+static inline ls_cb_t* ls_cb(VkCommandBuffer commandBuffer) { return xeno_map_get(&ls_cbs, XENO_HANDLE_KEY(commandBuffer)); }
+
+/* --- formats --- */
+static int has_stencil(VkFormat format) {
+    return format == VK_FORMAT_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+/* --- learning --- */
+static void image_release(xeno_resource_user_t* u) { free(u); }
+
+/* created the first time the image takes part in a pass */
+static ls_image_t* view_image(VkImageView view) {
+    xeno_image_t* image = xeno_view_image(view);
+    if (!image || !(image->info.usage & ATTACHMENT_USAGE)) return NULL;
+    ls_image_t* img = (ls_image_t*)atomic_load_explicit(&image->user[XENO_RESOURCE_LOADSTORE], memory_order_acquire);
+    if (img || !(img = calloc(1, sizeof(*img)))) return img;
+    img->user.release = image_release; img->image = image;
+    return (ls_image_t*)xeno_resource_attach(&image->user[XENO_RESOURCE_LOADSTORE], &img->user);
+}
+
+static void observe_load(xeno_loadstore_device_t* ld, ls_image_t* img) {
+    if (atomic_exchange_explicit(&img->loaded, 1, memory_order_relaxed) || !atomic_load_explicit(&img->dropped, memory_order_relaxed)) return;
+    atomic_fetch_add(&ld->mispredicted, 1);
+    if (atomic_fetch_add_explicit(&ls_logged, 1, memory_order_relaxed) < LS_MAX_LOGGED)
+        xlog("loadstore: an image whose stores were dropped is loaded, its stores are kept from now on");
+}
+
+static int store_dead(const xeno_loadstore_device_t* ld, ls_image_t* img) {
+    return img->image->attachment_only && !atomic_load_explicit(&img->loaded, memory_order_relaxed) &&
+           atomic_load_explicit(&img->passes, memory_order_relaxed) >= ld->learn_passes;
+}
+
+/* images of a begin whose ops are not looked at may be loaded by it */
+static void pin(const VkImageView* views, uint32_t count) {
+    for (uint32_t i = 0; views && i < count; ++i) {
+        ls_image_t* img = view_image(views[i]);
+        if (img) atomic_store_explicit(&img->loaded, 1, memory_order_relaxed);
+    }
+}
+
+/* LOAD_OP_NONE keeps the contents for a later pass just as LOAD does */
+static int loads(VkAttachmentLoadOp op) { return op == VK_ATTACHMENT_LOAD_OP_LOAD || op == VK_ATTACHMENT_LOAD_OP_NONE_KHR; }
+
+/* the loads of the begin teach its images, learned dead stores are dropped */
+static void decide(ls_cb_t* cb) {
+    xeno_loadstore_device_t* ld = cb->ld;
+    ls_image_t* imgs[LS_SLOTS];
+    for (uint32_t i = 0; i < cb->slots; ++i) {
+        imgs[i] = view_image(cb->views[i]);
+        if (imgs[i] && (loads(cb->ops[i].load) || loads(cb->ops[i].stencil_load))) observe_load(ld, imgs[i]);
+    }
+    for (uint32_t i = 0; i < cb->slots; ++i) {
+        ls_image_t* img = imgs[i];
+        if (!img) continue;
+        int seen = 0;
+        for (uint32_t j = 0; !seen && j < i; ++j) seen = imgs[j] == img;
+        if (!seen) atomic_fetch_add_explicit(&img->passes, 1, memory_order_relaxed);
+        if (cb->fixed || !ld->stores || !store_dead(ld, img)) continue;
+        ls_ops_t* o = &cb->ops[i];
+        if (o->store != VK_ATTACHMENT_STORE_OP_STORE && o->stencil_store != VK_ATTACHMENT_STORE_OP_STORE) continue;
+        if (o->store == VK_ATTACHMENT_STORE_OP_STORE) o->store = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        if (o->stencil_store == VK_ATTACHMENT_STORE_OP_STORE) o->stencil_store = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        atomic_store_explicit(&img->dropped, 1, memory_order_relaxed);
+    }
+}
+
+/* the decisions the begin goes out with, and the traffic they save */
+static void account(ls_cb_t* cb) {
+    uint64_t area = (uint64_t)cb->area.extent.width * cb->area.extent.height *
+                    (cb->view_mask ? (uint32_t)__builtin_popcount(cb->view_mask) : (cb->layers ? cb->layers : 1));
+    uint64_t n[LS_COUNTERS] = { 0 }, bytes = 0;
+    for (uint32_t i = 0; i < cb->slots; ++i) {
+        const ls_ops_t* a = &cb->app[i]; const ls_ops_t* o = &cb->ops[i];
+        uint64_t size = area * xeno_format_texel_bytes(cb->formats[i]) * (cb->samples[i] ? cb->samples[i] : 1);
+        if ((loads(a->load) && !loads(o->load)) || (loads(a->stencil_load) && !loads(o->stencil_load))) {
+            n[o->load == VK_ATTACHMENT_LOAD_OP_CLEAR || o->stencil_load == VK_ATTACHMENT_LOAD_OP_CLEAR ? LS_LOADS_CLEARED : LS_LOADS_DROPPED]++;
+            bytes += size;
+        }
+        if ((a->store == VK_ATTACHMENT_STORE_OP_STORE && o->store != a->store) || (a->stencil_store == VK_ATTACHMENT_STORE_OP_STORE && o->stencil_store != a->stencil_store)) {
+            n[LS_STORES_DROPPED]++;
+            bytes += size;
+        }
+    }
+    for (int k = 0; k < LS_COUNTERS; ++k) cb->n[k] += n[k];
+    cb->bytes += bytes;
+    ls_stats_t* s = cb->stats;
+    if (!s) return;
+    atomic_fetch_add_explicit(&s->begins, 1, memory_order_relaxed);
+    if (n[LS_LOADS_CLEARED]) atomic_fetch_add_explicit(&s->loads_cleared, n[LS_LOADS_CLEARED], memory_order_relaxed);
+    if (n[LS_LOADS_DROPPED]) atomic_fetch_add_explicit(&s->loads_dropped, n[LS_LOADS_DROPPED], memory_order_relaxed);
+    if (n[LS_STORES_DROPPED]) atomic_fetch_add_explicit(&s->stores_dropped, n[LS_STORES_DROPPED], memory_order_relaxed);
+    if (bytes) atomic_fetch_add_explicit(&s->bytes, bytes, memory_order_relaxed);
+}
+
+/* --- render pass variants --- */
+/* created below the resource tracker: they are the module's own */
+static VkResult variant_create(xeno_loadstore_device_t* ld, const ls_pass_t* p, const ls_ops_t* ops, VkRenderPass* out) {
+#define LS_VARIANT(Info, Desc, create) do { \
+        Info ci = *(const Info*)p->info; Desc att[LS_MAX_ATTACHMENTS]; \
+        memcpy(att, ci.pAttachments, p->count * sizeof(*att)); \
+        for (uint32_t i = 0; i < p->count; ++i) { \
+            att[i].loadOp = ops[i].load; att[i].storeOp = ops[i].store; \
+            att[i].stencilLoadOp = ops[i].stencil_load; att[i].stencilStoreOp = ops[i].stencil_store; } \
+        ci.pAttachments = att; \
+        return ld->dev->vk.create(ld->dev->handle, &ci, NULL, out); } while (0)
+    if (p->v2) LS_VARIANT(VkRenderPassCreateInfo2, VkAttachmentDescription2, vkCreateRenderPass2);
+    LS_VARIANT(VkRenderPassCreateInfo, VkAttachmentDescription, vkCreateRenderPass);
+#undef LS_VARIANT
+}
+
+/* the pass to begin for ops: the app's, a variant, or VK_NULL_HANDLE when none can be had */
+static VkRenderPass variant(xeno_loadstore_device_t* ld, ls_pass_t* p, VkRenderPass app, const ls_ops_t* ops) {
+    uint64_t key = xeno_hash64(ops, p->count * sizeof(*ops), 0x6c6f616473746f72ull);
+    if (key == p->key) return app;
+    uint32_t n = atomic_load_explicit(&p->variant_count, memory_order_acquire);
+    for (uint32_t i = 0; i < n; ++i) if (p->variants[i].key == key) return p->variants[i].pass;
+    VkRenderPass rp = VK_NULL_HANDLE;
+    pthread_mutex_lock(&p->lock);
+    n = atomic_load_explicit(&p->variant_count, memory_order_relaxed);
+    for (uint32_t i = 0; !rp && i < n; ++i) if (p->variants[i].key == key) rp = p->variants[i].pass;
+    if (!rp && n < LS_MAX_VARIANTS && variant_create(ld, p, ops, &rp) == VK_SUCCESS) {
+        p->variants[n].key = key; p->variants[n].pass = rp;
+        atomic_store_explicit(&p->variant_count, n + 1, memory_order_release);
+        atomic_fetch_add(&ld->variants, 1);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return rp;
+}
+
+/* --- render pass objects --- */
+static void pass_release(xeno_resource_user_t* u) {
+    ls_pass_t* p = (ls_pass_t*)u;
+    /* the variants retire with the pass: the same command buffers use them */
+    for (uint32_t i = 0; i < atomic_load(&p->variant_count); ++i) p->ld->dev->vk.vkDestroyRenderPass(p->ld->dev->handle, p->variants[i].pass, NULL);
+    pthread_mutex_destroy(&p->lock);
+    free(p);
+}
+
+static void pass_attachment(ls_pass_t* p, uint32_t i, VkFormat format, VkSampleCountFlagBits samples, ls_ops_t ops, VkImageLayout initial) {
+    p->formats[i] = format; p->samples[i] = samples;
+    /* ops a format has no aspect for do nothing */
+    if (!has_stencil(format)) ops.stencil_load = VK_ATTACHMENT_LOAD_OP_DONT_CARE, ops.stencil_store = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    if (format == VK_FORMAT_S8_UINT) ops.load = VK_ATTACHMENT_LOAD_OP_DONT_CARE, ops.store = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    p->ops[i] = p->base[i] = ops;
+    if (initial != VK_IMAGE_LAYOUT_UNDEFINED) return;
+    if (loads(ops.load)) p->base[i].load = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    if (loads(ops.stencil_load)) p->base[i].stencil_load = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+}
+
+static ls_pass_t* pass_new(xeno_loadstore_device_t* ld, const xeno_render_pass_t* rp) {
+    uint32_t count = rp->v2 ? rp->info2->attachmentCount : rp->info1->attachmentCount;
+    if (count > LS_MAX_ATTACHMENTS) return NULL;
+    ls_pass_t* p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    p->user.release = pass_release; p->ld = ld;
+    p->stats.id = XENO_HANDLE_KEY(rp->handle);
+    p->count = count; p->depth = LS_NONE; p->v2 = rp->v2;
+    pthread_mutex_init(&p->lock, NULL);
+    if (!rp->v2) {
+        const VkRenderPassCreateInfo* ci = rp->info1;
+        for (uint32_t i = 0; i < count; ++i) {
+            const VkAttachmentDescription* a = &ci->pAttachments[i];
+            pass_attachment(p, i, a->format, a->samples, (ls_ops_t){ a->loadOp, a->stencilLoadOp, a->storeOp, a->stencilStoreOp }, a->initialLayout);
+        }
+        const VkSubpassDescription* sp = ci->subpassCount ? &ci->pSubpasses[0] : NULL;
+        if (sp && sp->colorAttachmentCount <= LS_MAX_ATTACHMENTS) {
+            p->color_count = sp->colorAttachmentCount;
+            for (uint32_t i = 0; i < p->color_count; ++i) p->colors[i] = sp->pColorAttachments[i].attachment;
+            if (sp->pDepthStencilAttachment) p->depth = sp->pDepthStencilAttachment->attachment;
+            p->info = rp->extended ? NULL : rp->info;
+        }
+    } else {
+        const VkRenderPassCreateInfo2* ci = rp->info2;
+        for (uint32_t i = 0; i < count; ++i) {
+            const VkAttachmentDescription2* a = &ci->pAttachments[i];
+            pass_attachment(p, i, a->format, a->samples, (ls_ops_t){ a->loadOp, a->stencilLoadOp, a->storeOp, a->stencilStoreOp }, a->initialLayout);
+        }
+        const VkSubpassDescription2* sp = ci->subpassCount ? &ci->pSubpasses[0] : NULL;
+        if (sp && sp->colorAttachmentCount <= LS_MAX_ATTACHMENTS) {
+            p->color_count = sp->colorAttachmentCount;
+            for (uint32_t i = 0; i < p->color_count; ++i) p->colors[i] = sp->pColorAttachments[i].attachment;
+            if (sp->pDepthStencilAttachment) p->depth = sp->pDepthStencilAttachment->attachment;
+            p->view_mask = sp->viewMask;
+            p->info = rp->extended ? NULL : rp->info;
+        }
+    }
+    p->key = xeno_hash64(p->ops, p->count * sizeof(ls_ops_t), 0x6c6f616473746f72ull);
+    return p;
+}
+
+/* derived on the first begin and kept with the pass */
+static ls_pass_t* pass_get(xeno_loadstore_device_t* ld, VkRenderPass renderPass) {
+    xeno_render_pass_t* rp = xeno_render_pass_get(renderPass);
+    if (!rp) return NULL;
+    ls_pass_t* p = (ls_pass_t*)atomic_load_explicit(&rp->user[XENO_RESOURCE_LOADSTORE], memory_order_acquire);
+    if (p || !(p = pass_new(ld, rp))) return p;
+    return (ls_pass_t*)xeno_resource_attach(&rp->user[XENO_RESOURCE_LOADSTORE], &p->user);
+}
+
+/* --- begins --- */
+/* the held or immediate begin goes out; -1 when a rewrite it needed could not be had and the ops stayed as recorded */
+static int emit(ls_cb_t* cb) {
+    xeno_loadstore_device_t* ld = cb->ld;
+    int held = cb->held, ok = 1;
+    cb->held = LS_HELD_NONE;
+    decide(cb);
+    if (!cb->pass) {
+        for (uint32_t i = 0; i < cb->slots; ++i) {
+            VkRenderingAttachmentInfo* a = &cb->attachments[i];
+            a->loadOp = cb->ops[i].load; a->storeOp = cb->ops[i].store; a->clearValue = cb->clears[i];
+        }
+        account(cb);
+        ld->next_vkCmdBeginRendering(cb->handle, &cb->rendering);
+        return 0;
+    }
+    ls_pass_t* p = cb->pass;
+    VkRenderPass rp = cb->fixed ? cb->begin.renderPass : variant(ld, p, cb->begin.renderPass, cb->ops);
+    if (!rp) {
+        memcpy(cb->ops, cb->app, sizeof(cb->ops)); memcpy(cb->clears, cb->app_clears, sizeof(cb->clears));
+        rp = cb->begin.renderPass; ok = 0;
+    }
+    account(cb);
+    VkRenderPassBeginInfo begin = cb->begin;
+    begin.renderPass = rp; begin.clearValueCount = p->count; begin.pClearValues = cb->clears;
+    if (held == LS_HELD_PASS2 || (!held && cb->subpass.sType)) ld->next_vkCmdBeginRenderPass2(cb->handle, &begin, &cb->subpass);
+    else ld->next_vkCmdBeginRenderPass(cb->handle, &begin, cb->contents);
+    return ok ? 0 : -1;
+}
+
+static void begin_pass(ls_cb_t* cb, const VkRenderPassBeginInfo* info, VkSubpassContents contents, const VkSubpassBeginInfo* subpass) {
+    xeno_loadstore_device_t* ld = cb->ld;
+    ls_pass_t* p = pass_get(ld, info->renderPass);
+    xeno_framebuffer_t* fb = xeno_framebuffer_get(info->framebuffer);
+    cb->n[LS_BEGINS]++;
+    /* the framebuffer's views, or for imageless framebuffers the begin info's */
+    const VkImageView* views = fb ? fb->views : NULL;
+    uint32_t view_count = fb ? fb->count : 0;
+    const VkRenderPassAttachmentBeginInfo* imageless = NULL;
+    int copyable = !subpass || !subpass->pNext;
+    for (const VkBaseInStructure* s = info->pNext; s; s = s->pNext) {
+        if (s->sType != VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO) { copyable = 0; continue; }
+        imageless = (const VkRenderPassAttachmentBeginInfo*)s;
+        views = imageless->pAttachments; view_count = imageless->attachmentCount;
+    }
+    if (!p || !fb || view_count != p->count) {
+        cb->n[LS_PASSTHROUGH]++;
+        pin(views, view_count);
+        if (subpass) ld->next_vkCmdBeginRenderPass2(cb->handle, info, subpass);
+        else ld->next_vkCmdBeginRenderPass(cb->handle, info, contents);
+        return;
+    }
+    cb->slots = p->count; cb->fixed = !p->info; cb->pass = p; cb->stats = &p->stats;
+    memcpy(cb->app, p->ops, p->count * sizeof(ls_ops_t));
+    memcpy(cb->ops, p->base, p->count * sizeof(ls_ops_t));
+    memset(cb->app_clears, 0, sizeof(cb->app_clears));
+    if (info->pClearValues) memcpy(cb->app_clears, info->pClearValues, (info->clearValueCount < p->count ? info->clearValueCount : p->count) * sizeof(VkClearValue));
+    memcpy(cb->clears, cb->app_clears, sizeof(cb->clears));
+    memcpy(cb->views, views, p->count * sizeof(VkImageView));
+    memcpy(cb->formats, p->formats, p->count * sizeof(VkFormat));
+    memcpy(cb->samples, p->samples, p->count * sizeof(VkSampleCountFlagBits));
+    cb->area = info->renderArea; cb->layers = fb->layers; cb->view_mask = p->view_mask;
+    cb->begin = *info; cb->contents = contents;
+    memset(&cb->subpass, 0, sizeof(cb->subpass));
+    if (subpass) cb->subpass = *subpass;
+    if (ld->clears && copyable && !cb->fixed) {
+        /* everything the begin points at is the module's from here */
+        if (imageless) {
+            cb->begin_views = *imageless; cb->begin_views.pNext = NULL; cb->begin_views.pAttachments = cb->views;
+            cb->begin.pNext = &cb->begin_views;
+        }
+        cb->held = subpass ? LS_HELD_PASS2 : LS_HELD_PASS;
+        cb->n[LS_HELD]++;
+        return;
+    }
+    emit(cb);
+}
+
+static ls_stats_t* rendering_stats(xeno_loadstore_device_t* ld, const VkImageView* views, uint32_t count) {
+    uint64_t key = xeno_hash64(views, count * sizeof(*views), 0x72656e646572ull);
+    ls_stats_t* s = xeno_map_get(&ld->renderings, key);
+    if (s || atomic_load_explicit(&ld->renderings.count, memory_order_relaxed) >= LS_MAX_RENDERINGS) return s;
+    pthread_mutex_lock(&ld->rendering_lock);
+    if (!(s = xeno_map_get(&ld->renderings, key)) && ld->renderings.count < LS_MAX_RENDERINGS && (s = calloc(1, sizeof(*s)))) {
+        s->rendering = 1; s->id = key;
+        xeno_map_put(&ld->renderings, key, s);
+    }
+    pthread_mutex_unlock(&ld->rendering_lock);
+    return s;
+}
+
+static void begin_rendering(ls_cb_t* cb, const VkRenderingInfo* info) {
+    xeno_loadstore_device_t* ld = cb->ld;
+    uint32_t n = info->colorAttachmentCount;
+    cb->n[LS_BEGINS]++;
+    /* a resuming pass loads nothing and a suspending one stores nothing */
+    if (n > LS_MAX_ATTACHMENTS || (info->flags & (VK_RENDERING_SUSPENDING_BIT | VK_RENDERING_RESUMING_BIT))) {
+        cb->n[LS_PASSTHROUGH]++;
+        for (uint32_t i = 0; i < n; ++i) pin(&info->pColorAttachments[i].imageView, 1);
+        if (info->pDepthAttachment) pin(&info->pDepthAttachment->imageView, 1);
+        if (info->pStencilAttachment) pin(&info->pStencilAttachment->imageView, 1);
+        ld->next_vkCmdBeginRendering(cb->handle, info);
+        return;
+    }
+    int copyable = !info->pNext;
+    cb->slots = n + 2; cb->fixed = 0; cb->pass = NULL;
+    cb->rendering = *info;
+    memset(cb->attachments, 0, sizeof(cb->attachments));
+    for (uint32_t i = 0; i < n; ++i) cb->attachments[i] = info->pColorAttachments[i];
+    if (info->pDepthAttachment) cb->attachments[n] = *info->pDepthAttachment;
+    if (info->pStencilAttachment) cb->attachments[n + 1] = *info->pStencilAttachment;
+    cb->rendering.pColorAttachments = cb->attachments;
+    cb->rendering.pDepthAttachment = info->pDepthAttachment ? &cb->attachments[n] : NULL;
+    cb->rendering.pStencilAttachment = info->pStencilAttachment ? &cb->attachments[n + 1] : NULL;
+    for (uint32_t i = 0; i < cb->slots; ++i) {
+        const VkRenderingAttachmentInfo* a = &cb->attachments[i];
+        copyable &= !a->pNext;
+        ls_ops_t o = { a->loadOp, VK_ATTACHMENT_LOAD_OP_DONT_CARE, a->storeOp, VK_ATTACHMENT_STORE_OP_DONT_CARE };
+        cb->app[i] = cb->ops[i] = o;
+        cb->app_clears[i] = cb->clears[i] = a->clearValue;
+        cb->views[i] = a->imageView;
+        ls_image_t* img = view_image(a->imageView);
+        cb->formats[i] = img ? img->image->info.format : VK_FORMAT_UNDEFINED;
+        cb->samples[i] = img ? img->image->info.samples : VK_SAMPLE_COUNT_1_BIT;
+        if (img && i == n + 1) cb->formats[i] = VK_FORMAT_S8_UINT;    /* the stencil plane of a combined format */
+    }
+    cb->area = info->renderArea; cb->layers = info->layerCount; cb->view_mask = info->viewMask;
+    cb->stats = rendering_stats(ld, cb->views, cb->slots);
+    if (ld->clears && copyable) {
+        cb->held = LS_HELD_RENDERING;
+        cb->n[LS_HELD]++;
+        return;
+    }
+    emit(cb);
+}
+
+/* --- folding a clear at the start of a held pass into its load ops --- */
+static int covers(const ls_cb_t* cb, const VkClearRect* r) {
+    const VkRect2D* a = &cb->area;
+    if (r->rect.offset.x > a->offset.x || r->rect.offset.y > a->offset.y ||
+        (int64_t)r->rect.offset.x + r->rect.extent.width < (int64_t)a->offset.x + a->extent.width ||
+        (int64_t)r->rect.offset.y + r->rect.extent.height < (int64_t)a->offset.y + a->extent.height) return 0;
+    return r->baseArrayLayer == 0 && (cb->view_mask || r->layerCount >= (cb->layers ? cb->layers : 1));
+}
+
+/* the slot an aspect of a clear lands in, LS_NONE when it clears nothing */
+static uint32_t clear_slot(const ls_cb_t* cb, const VkClearAttachment* c, VkImageAspectFlags aspect) {
+    uint32_t slot;
+    if (cb->pass) {
+        const ls_pass_t* p = cb->pass;
+        slot = aspect == VK_IMAGE_ASPECT_COLOR_BIT ? (c->colorAttachment < p->color_count ? p->colors[c->colorAttachment] : LS_NONE) : p->depth;
+        return slot < p->count ? slot : LS_NONE;
+    }
+    uint32_t colors = cb->slots - 2;
+    slot = aspect == VK_IMAGE_ASPECT_COLOR_BIT ? (c->colorAttachment < colors ? c->colorAttachment : LS_NONE) :
+           aspect == VK_IMAGE_ASPECT_DEPTH_BIT ? colors : colors + 1;
+    return slot != LS_NONE && cb->views[slot] ? slot : LS_NONE;
+}
+
+/* whether the clear went entirely into the ops and clear values of the held begin */
+static int fold(ls_cb_t* cb, uint32_t count, const VkClearAttachment* pAttachments, uint32_t rectCount, const VkClearRect* pRects) {
+    int full = 0;
+    for (uint32_t r = 0; !full && r < rectCount; ++r) full = covers(cb, &pRects[r]);
+    if (!full) return 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        const VkClearAttachment* c = &pAttachments[i];
+        static const VkImageAspectFlags aspects[] = { VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, VK_IMAGE_ASPECT_STENCIL_BIT };
+        for (size_t k = 0; k < sizeof(aspects) / sizeof(aspects[0]); ++k) {
+            uint32_t slot = (c->aspectMask & aspects[k]) ? clear_slot(cb, c, aspects[k]) : LS_NONE;
+            if (slot == LS_NONE) continue;
+            ls_ops_t* o = &cb->ops[slot]; VkClearValue* v = &cb->clears[slot];
+            if (aspects[k] == VK_IMAGE_ASPECT_COLOR_BIT) { o->load = VK_ATTACHMENT_LOAD_OP_CLEAR; *v = c->clearValue; }
+            else if (aspects[k] == VK_IMAGE_ASPECT_DEPTH_BIT) { o->load = VK_ATTACHMENT_LOAD_OP_CLEAR; v->depthStencil.depth = c->clearValue.depthStencil.depth; }
+            else if (cb->pass) { o->stencil_load = VK_ATTACHMENT_LOAD_OP_CLEAR; v->depthStencil.stencil = c->clearValue.depthStencil.stencil; }
+            else { o->load = VK_ATTACHMENT_LOAD_OP_CLEAR; v->depthStencil.stencil = c->clearValue.depthStencil.stencil; }
+        }
+    }
+    return 1;
+}
+
+/* --- command buffer lifetime --- */
+static VKAPI_ATTR VkResult VKAPI_CALL ls_vkAllocateCommandBuffers(VkDevice device, const VkCommandBufferAllocateInfo* pAllocateInfo, VkCommandBuffer* pCommandBuffers) {
+    xeno_loadstore_device_t* ld = xeno_device_get(device)->loadstore;
+    VkResult r = ld->next_vkAllocateCommandBuffers(device, pAllocateInfo, pCommandBuffers);
+    if (r != VK_SUCCESS) return r;
+    for (uint32_t i = 0; i < pAllocateInfo->commandBufferCount; ++i) {
+        ls_cb_t* cb = calloc(1, sizeof(*cb));
+        if (!cb) {
+            while (i--) free(xeno_map_remove(&ls_cbs, XENO_HANDLE_KEY(pCommandBuffers[i])));
+            ld->next_vkFreeCommandBuffers(device, pAllocateInfo->commandPool, pAllocateInfo->commandBufferCount, pCommandBuffers);
+            for (uint32_t k = 0; k < pAllocateInfo->commandBufferCount; ++k) pCommandBuffers[k] = VK_NULL_HANDLE;
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        cb->ld = ld; cb->handle = pCommandBuffers[i]; cb->pool = pAllocateInfo->commandPool;
+        xeno_map_put(&ls_cbs, XENO_HANDLE_KEY(cb->handle), cb);
+    }
+    return r;
+}
+static VKAPI_ATTR void VKAPI_CALL ls_vkFreeCommandBuffers(VkDevice device, VkCommandPool commandPool, uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers) {
+    xeno_loadstore_device_t* ld = xeno_device_get(device)->loadstore;
+    for (uint32_t i = 0; i < commandBufferCount; ++i)
+        if (pCommandBuffers[i]) free(xeno_map_remove(&ls_cbs, XENO_HANDLE_KEY(pCommandBuffers[i])));
+    ld->next_vkFreeCommandBuffers(device, commandPool, commandBufferCount, pCommandBuffers);
+}
+typedef struct ls_walk { xeno_loadstore_device_t* ld; VkCommandPool pool; } ls_walk_t;
+static int free_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; ls_cb_t* cb = val; ls_walk_t* w = ctx;
+    if (cb->ld != w->ld || (w->pool && cb->pool != w->pool)) return 0;
+    free(cb); return 1;
+}
+static VKAPI_ATTR void VKAPI_CALL ls_vkDestroyCommandPool(VkDevice device, VkCommandPool commandPool, const VkAllocationCallbacks* pAllocator) {
+    xeno_loadstore_device_t* ld = xeno_device_get(device)->loadstore;
+    if (commandPool) { ls_walk_t w = { ld, commandPool }; xeno_map_foreach(&ls_cbs, free_walk_fn, &w); }
+    ld->next_vkDestroyCommandPool(device, commandPool, pAllocator);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL ls_vkBeginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeginInfo* pBeginInfo) {
+    ls_cb_t* cb = ls_cb(commandBuffer);
+    cb->held = LS_HELD_NONE;    /* a recording abandoned by a reset leaves nothing behind */
+    memset(cb->n, 0, sizeof(cb->n)); cb->bytes = 0;
+    return cb->ld->next_vkBeginCommandBuffer(commandBuffer, pBeginInfo);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL ls_vkEndCommandBuffer(VkCommandBuffer commandBuffer) {
+    ls_cb_t* cb = ls_cb(commandBuffer);
+    xeno_loadstore_device_t* ld = cb->ld;
+    if (cb->held) emit(cb);
+    for (int k = 0; k < LS_COUNTERS; ++k)
+        if (cb->n[k]) atomic_fetch_add_explicit(&ld->n[k], cb->n[k], memory_order_relaxed);
+    if (cb->bytes) atomic_fetch_add_explicit(&ld->bytes, cb->bytes, memory_order_relaxed);
+    memset(cb->n, 0, sizeof(cb->n)); cb->bytes = 0;
+    atomic_fetch_add_explicit(&ld->recorded, 1, memory_order_relaxed);
+    return ld->next_vkEndCommandBuffer(commandBuffer);
+}
+
+/* --- pass boundaries --- */
+static VKAPI_ATTR void VKAPI_CALL ls_vkCmdBeginRenderPass(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo* pRenderPassBegin, VkSubpassContents contents) {
+    ls_cb_t* cb = ls_cb(commandBuffer);
+    if (cb->held) emit(cb);
+    begin_pass(cb, pRenderPassBegin, contents, NULL);
+}
+static VKAPI_ATTR void VKAPI_CALL ls_vkCmdBeginRenderPass2(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo* pRenderPassBegin, const VkSubpassBeginInfo* pSubpassBeginInfo) {
+    ls_cb_t* cb = ls_cb(commandBuffer);
+    if (cb->held) emit(cb);
+    begin_pass(cb, pRenderPassBegin, pSubpassBeginInfo->contents, pSubpassBeginInfo);
+}
+static VKAPI_ATTR void VKAPI_CALL ls_vkCmdBeginRendering(VkCommandBuffer commandBuffer, const VkRenderingInfo* pRenderingInfo) {
+    ls_cb_t* cb = ls_cb(commandBuffer);
+    if (cb->held) emit(cb);
+    begin_rendering(cb, pRenderingInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL ls_vkCmdClearAttachments(VkCommandBuffer commandBuffer, uint32_t attachmentCount, const VkClearAttachment* pAttachments,
+                                                           uint32_t rectCount, const VkClearRect* pRects) {
+    ls_cb_t* cb = ls_cb(commandBuffer);
+    if (cb->held) {
+        int folded = fold(cb, attachmentCount, pAttachments, rectCount, pRects);
+        if (emit(cb) == 0 && folded) {
+            cb->n[LS_CLEARS_FOLDED] += attachmentCount; cb->n[LS_CLEAR_CALLS_DROPPED]++;
+            if (cb->stats) atomic_fetch_add_explicit(&cb->stats->clears_folded, attachmentCount, memory_order_relaxed);
+            return;
+        }
+    }
+    cb->ld->next_vkCmdClearAttachments(commandBuffer, attachmentCount, pAttachments, rectCount, pRects);
+}
+
+/* --- commands a held begin goes out before --- */
+static inline ls_cb_t* ls_flush(VkCommandBuffer commandBuffer) {
+    ls_cb_t* cb = ls_cb(commandBuffer);
+    if (cb->held) emit(cb);
+    return cb;
+}
+#define LS_FLUSH(fn, params, args) \
+    static VKAPI_ATTR void VKAPI_CALL ls_##fn params { ls_flush(commandBuffer)->ld->next_##fn args; }
+LS_FLUSH(vkCmdExecuteCommands, (VkCommandBuffer commandBuffer, uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers), (commandBuffer, commandBufferCount, pCommandBuffers))
+LS_FLUSH(vkCmdDraw, (VkCommandBuffer commandBuffer, uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance),
+         (commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance))
+LS_FLUSH(vkCmdDrawIndexed, (VkCommandBuffer commandBuffer, uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance),
+         (commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance))
+LS_FLUSH(vkCmdDrawIndirect, (VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride),
+         (commandBuffer, buffer, offset, drawCount, stride))
+LS_FLUSH(vkCmdDrawIndexedIndirect, (VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride),
+         (commandBuffer, buffer, offset, drawCount, stride))
+LS_FLUSH(vkCmdDrawIndirectCount, (VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride),
+         (commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride))
+LS_FLUSH(vkCmdDrawIndexedIndirectCount, (VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride),
+         (commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride))
+LS_FLUSH(vkCmdDrawMeshTasksEXT, (VkCommandBuffer commandBuffer, uint32_t x, uint32_t y, uint32_t z), (commandBuffer, x, y, z))
+LS_FLUSH(vkCmdPipelineBarrier, (VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, VkDependencyFlags dependencyFlags,
+                                uint32_t memoryBarrierCount, const VkMemoryBarrier* pMemoryBarriers, uint32_t bufferMemoryBarrierCount, const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+                                uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* pImageMemoryBarriers),
+         (commandBuffer, srcStageMask, dstStageMask, dependencyFlags, memoryBarrierCount, pMemoryBarriers, bufferMemoryBarrierCount, pBufferMemoryBarriers,
+          imageMemoryBarrierCount, pImageMemoryBarriers))
+LS_FLUSH(vkCmdPipelineBarrier2, (VkCommandBuffer commandBuffer, const VkDependencyInfo* pDependencyInfo), (commandBuffer, pDependencyInfo))
+LS_FLUSH(vkCmdWaitEvents, (VkCommandBuffer commandBuffer, uint32_t eventCount, const VkEvent* pEvents, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask,
+                           uint32_t memoryBarrierCount, const VkMemoryBarrier* pMemoryBarriers, uint32_t bufferMemoryBarrierCount, const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+                           uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* pImageMemoryBarriers),
+         (commandBuffer, eventCount, pEvents, srcStageMask, dstStageMask, memoryBarrierCount, pMemoryBarriers, bufferMemoryBarrierCount, pBufferMemoryBarriers,
+          imageMemoryBarrierCount, pImageMemoryBarriers))
+LS_FLUSH(vkCmdWaitEvents2, (VkCommandBuffer commandBuffer, uint32_t eventCount, const VkEvent* pEvents, const VkDependencyInfo* pDependencyInfos),
+         (commandBuffer, eventCount, pEvents, pDependencyInfos))
+LS_FLUSH(vkCmdBeginQuery, (VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t query, VkQueryControlFlags flags), (commandBuffer, queryPool, query, flags))
+LS_FLUSH(vkCmdEndQuery, (VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t query), (commandBuffer, queryPool, query))
+LS_FLUSH(vkCmdWriteTimestamp, (VkCommandBuffer commandBuffer, VkPipelineStageFlagBits pipelineStage, VkQueryPool queryPool, uint32_t query),
+         (commandBuffer, pipelineStage, queryPool, query))
+LS_FLUSH(vkCmdWriteTimestamp2, (VkCommandBuffer commandBuffer, VkPipelineStageFlags2 stage, VkQueryPool queryPool, uint32_t query), (commandBuffer, stage, queryPool, query))
+LS_FLUSH(vkCmdNextSubpass, (VkCommandBuffer commandBuffer, VkSubpassContents contents), (commandBuffer, contents))
+LS_FLUSH(vkCmdNextSubpass2, (VkCommandBuffer commandBuffer, const VkSubpassBeginInfo* pSubpassBeginInfo, const VkSubpassEndInfo* pSubpassEndInfo),
+         (commandBuffer, pSubpassBeginInfo, pSubpassEndInfo))
+LS_FLUSH(vkCmdEndRenderPass, (VkCommandBuffer commandBuffer), (commandBuffer))
+LS_FLUSH(vkCmdEndRenderPass2, (VkCommandBuffer commandBuffer, const VkSubpassEndInfo* pSubpassEndInfo), (commandBuffer, pSubpassEndInfo))
+LS_FLUSH(vkCmdEndRendering, (VkCommandBuffer commandBuffer), (commandBuffer))
+#undef LS_FLUSH
+
+/* --- device lifetime / routing --- */
+static PFN_vkVoidFunction resolve(xeno_device_t* dev, const char* name) {
+    PFN_vkVoidFunction fn = xeno_device_mtrecord_proc(dev, name);
+    for (size_t i = 0; !fn && i < LS_ALIAS_COUNT; ++i)
+        if (strcmp(ls_aliases[i].name, name) == 0) fn = xeno_device_mtrecord_proc(dev, ls_aliases[i].alias);
+    return fn;
+}
+
+int xeno_loadstore_init(xeno_device_t* dev) {
+    if (!xeno_env_bool("XCLIPSE_LOADSTORE", 0)) return 0;
+    pthread_once(&ls_cbs_once, ls_cbs_init);
+    xeno_loadstore_device_t* ld = calloc(1, sizeof(*ld)); if (!ld) return -1;
+    ld->dev = dev;
+#define LS_RESOLVE(fn) ld->next_##fn = (PFN_##fn)resolve(dev, #fn);
+    LS_HOOKS(LS_RESOLVE)
+#undef LS_RESOLVE
+    if (!ld->next_vkAllocateCommandBuffers || !ld->next_vkFreeCommandBuffers || !ld->next_vkDestroyCommandPool || !ld->next_vkBeginCommandBuffer ||
+        !ld->next_vkEndCommandBuffer || !ld->next_vkCmdBeginRenderPass || !ld->next_vkCmdClearAttachments || !ld->next_vkCmdExecuteCommands) { free(ld); return -1; }
+    ld->clears = xeno_env_bool("XCLIPSE_LOADSTORE_CLEARS", 1);
+    ld->stores = xeno_env_bool("XCLIPSE_LOADSTORE_STORES", 0);   /* predicted, not proven dead: opt-in */
+    long passes = xeno_env_long("XCLIPSE_LOADSTORE_PASSES", 16);
+    ld->learn_passes = passes < 1 ? 1 : passes > UINT32_MAX ? UINT32_MAX : (uint32_t)passes;
+    for (size_t i = 0; i < sizeof(ls_unseen) / sizeof(ls_unseen[0]); ++i) {
+        if (!xeno_device_mtrecord_proc(dev, ls_unseen[i])) continue;
+        if (ld->clears) xlog("loadstore: %s bypasses the layer, no begin is held for clears", ls_unseen[i]);
+        ld->clears = 0;
+    }
+    xeno_map_init(&ld->renderings, 64);
+    pthread_mutex_init(&ld->rendering_lock, NULL);
+    dev->loadstore = ld;
+    xlog("loadstore: dropping loads of undefined contents%s%s", ld->clears ? ", folding start-of-pass clears" : "",
+         ld->stores ? ", dropping stores of attachment-only images never loaded" : "");
+    if (ld->stores) xlog("loadstore: stores are dropped after %u passes", ld->learn_passes);
+    return 0;
+}
+
+static int device_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; ls_cb_t* cb = val;
+    if (cb->ld != ctx) return 0;
+    free(cb); return 1;
+}
+static int free_fn(uint64_t key, void* val, void* ctx) { (void)key; (void)ctx; free(val); return 1; }
+
+void xeno_loadstore_destroy(xeno_device_t* dev) {
+    xeno_loadstore_device_t* ld = dev->loadstore;
+    if (!ld) return;
+    xeno_map_foreach(&ls_cbs, device_walk_fn, ld);    /* command buffers of pools the app leaked */
+    xeno_map_foreach(&ld->renderings, free_fn, NULL);
+    xeno_map_destroy(&ld->renderings);
+    pthread_mutex_destroy(&ld->rendering_lock);
+    dev->loadstore = NULL;
+    free(ld);
+}
+
+PFN_vkVoidFunction xeno_loadstore_proc(xeno_device_t* dev, const char* name) {
+    xeno_loadstore_device_t* ld = dev->loadstore;
+    if (!ld || strncmp(name, "vk", 2) != 0) return NULL;
+    for (size_t i = 0; i < LS_ALIAS_COUNT; ++i)
+        if (strcmp(name, ls_aliases[i].alias) == 0) { name = ls_aliases[i].name; break; }
+#define LS_PROC(fn) if (ld->next_##fn && strcmp(name, #fn) == 0) return (PFN_vkVoidFunction)ls_##fn;
+    LS_PROC(vkAllocateCommandBuffers) LS_PROC(vkFreeCommandBuffers) LS_PROC(vkDestroyCommandPool) LS_PROC(vkBeginCommandBuffer) LS_PROC(vkEndCommandBuffer)
+    LS_PROC(vkCmdBeginRenderPass) LS_PROC(vkCmdBeginRenderPass2) LS_PROC(vkCmdBeginRendering)
+    if (ld->clears) { LS_PASS_HOOKS(LS_PROC) }    /* without held begins the rest of the pass goes straight through */
+#undef LS_PROC
+    return NULL;
+}
+
+/* --- reporting --- */
+typedef struct ls_top { uint32_t count; ls_stats_t s[LS_MAX_REPORTED]; } ls_top_t;
+static void top_add(ls_top_t* t, const ls_stats_t* s) {
+    uint64_t bytes = atomic_load_explicit(&s->bytes, memory_order_relaxed);
+    if (!atomic_load_explicit(&s->begins, memory_order_relaxed)) return;
+    uint32_t at = t->count;
+    while (at && atomic_load_explicit(&t->s[at - 1].bytes, memory_order_relaxed) < bytes) --at;
+    if (at >= LS_MAX_REPORTED) return;
+    uint32_t last = t->count < LS_MAX_REPORTED ? t->count++ : LS_MAX_REPORTED - 1;
+    for (uint32_t i = last; i > at; --i) {
+        ls_stats_t* d = &t->s[i]; const ls_stats_t* f = &t->s[i - 1];
+        d->rendering = f->rendering; d->id = f->id;
+        d->begins = f->begins; d->clears_folded = f->clears_folded; d->loads_cleared = f->loads_cleared;
+        d->loads_dropped = f->loads_dropped; d->stores_dropped = f->stores_dropped; d->bytes = f->bytes;
+    }
+    ls_stats_t* d = &t->s[at];
+    d->rendering = s->rendering; d->id = s->id;
+    d->begins = s->begins; d->clears_folded = s->clears_folded; d->loads_cleared = s->loads_cleared;
+    d->loads_dropped = s->loads_dropped; d->stores_dropped = s->stores_dropped; d->bytes = bytes;
+}
+static void pass_top_fn(xeno_resource_user_t* u, void* ctx) { top_add(ctx, &((ls_pass_t*)u)->stats); }
+static int rendering_top_fn(uint64_t key, void* val, void* ctx) { (void)key; top_add(ctx, val); return 0; }
+
+void xeno_loadstore_report(FILE* f, xeno_device_t* dev) {
+    xeno_loadstore_device_t* ld = dev->loadstore;
+    fprintf(f, "  \"loadstore\": {\"enabled\": %s", ld ? "true" : "false");
+    if (ld) {
+        uint64_t frames = atomic_load(&dev->frames), bytes = atomic_load(&ld->bytes);
+        fprintf(f, ", \"clears\": %s, \"stores\": %s, \"learn_passes\": %u", ld->clears ? "true" : "false", ld->stores ? "true" : "false", ld->learn_passes);
+        for (int k = 0; k < LS_COUNTERS; ++k) fprintf(f, ", \"%s\": %" PRIu64, ls_counter_names[k], atomic_load(&ld->n[k]));
+        fprintf(f, ", \"variants\": %" PRIu64 ", \"mispredicted\": %" PRIu64 ", \"command_buffers\": %" PRIu64 ", \"mb_saved\": %.1f, \"mb_saved_per_frame\": %.2f",
+                atomic_load(&ld->variants), atomic_load(&ld->mispredicted), atomic_load(&ld->recorded), (double)bytes / 1048576.0,
+                frames ? (double)bytes / 1048576.0 / (double)frames : 0.0);
+        ls_top_t top = { 0 };
+        xeno_render_pass_foreach(dev, XENO_RESOURCE_LOADSTORE, pass_top_fn, &top);
+        xeno_map_foreach(&ld->renderings, rendering_top_fn, &top);
+        fprintf(f, ", \"passes\": [");
+        for (uint32_t i = 0; i < top.count; ++i) {
+            const ls_stats_t* s = &top.s[i];
+            fprintf(f, "%s{\"kind\": \"%s\", \"id\": \"0x%" PRIx64 "\", \"begins\": %" PRIu64 ", \"clears_folded\": %" PRIu64 ", \"loads_cleared\": %" PRIu64
+                       ", \"loads_dropped\": %" PRIu64 ", \"stores_dropped\": %" PRIu64 ", \"mb_saved\": %.1f}",
+                    i ? ", " : "", s->rendering ? "rendering" : "render_pass", s->id, (uint64_t)s->begins, (uint64_t)s->clears_folded,
+                    (uint64_t)s->loads_cleared, (uint64_t)s->loads_dropped, (uint64_t)s->stores_dropped, (double)s->bytes / 1048576.0);
+        }
+        fprintf(f, "]");
+    }
+    fprintf(f, "}");
+}
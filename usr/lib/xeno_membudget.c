@@ -0,0 +1,394 @@
+/* xeno_membudget.c - memory budget tracking and pressure policy
+ *
+ * Titles size their working set from vkGetPhysicalDeviceMemoryProperties and keep allocating
+ * until the OS starts evicting. This module tracks every heap against what the process may
+ * actually use: heapBudget/heapUsage from VK_EXT_memory_budget (xeno_query_memory_budget),
+ * polled at most every XCLIPSE_BUDGET_TTL_MS and extrapolated in between with the bytes the app
+ * allocated and freed since the poll. Without the extension the budget is a share of the heap
+ * size and the usage is what the app allocated through the wrapper.
+ *
+ * Once a heap's estimated usage reaches XCLIPSE_BUDGET_HIGH_PCT of its budget it is under
+ * pressure (level 1; level 2 at or past the budget):
+ *  - allocations for it are steered to another memory type on a heap with headroom, as long as
+ *    every resource that could use the requested type was also reported compatible with the new
+ *    one (memoryTypeBits of vkGet*MemoryRequirements) and the host access flags are kept;
+ *  - the pressure hooks run on the worker pool: variant caches and empty suballocation blocks
+ *    are trimmed, and samplers created while under pressure get a positive mip LOD bias;
+ *  - the level change is logged and recorded as a pressure event for the tune report.
+ * A heap leaves a level only once its usage falls HYSTERESIS_PCT below the threshold.
+ *
+ * The module sits ahead of every other module (like dedup), so steering happens before the
+ * suballocator picks a pool. Instance level, vkGetPhysicalDeviceMemoryProperties(2) report each
+ * heap's budget instead of its size (xeno_budget_heaps).
+ *
+ * Knobs (the hook knobs can be set per title by appending _<PROCESS_NAME>, e.g.
+ * XCLIPSE_BUDGET_MIP_BIAS_COM_EXAMPLE_GAME=2):
+ *   XCLIPSE_MEMORY_BUDGET=0            no tracking, steering or heap size replacement
+ *   XCLIPSE_BUDGET_TTL_MS=N            budget poll interval (default 50)
+ *   XCLIPSE_BUDGET_HIGH_PCT=N          pressure threshold in percent of the budget (default 90)
+ *   XCLIPSE_BUDGET_ESTIMATE_PCT=N      budget as percent of the heap size without VK_EXT_memory_budget (default 80)
+ *   XCLIPSE_BUDGET_STEER=0             never move allocations to another memory type
+ *   XCLIPSE_BUDGET_TRIM=0              no cache trimming under pressure
+ *   XCLIPSE_BUDGET_MIP_BIAS=F          LOD bias for samplers created under pressure (default 1.0, 0 = off)
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+#define MAX_EVENTS 64
+#define HYSTERESIS_PCT 5
+
+typedef struct bg_heap {
+    _Atomic uint64_t tracked;       /* app bytes live through the wrapper */
+    _Atomic uint64_t budget, usage, tracked_at_poll; /* last poll */
+    _Atomic uint64_t peak;          /* highest estimated usage */
+    _Atomic int level;
+} bg_heap_t;
+
+typedef struct bg_alloc { uint32_t heap; uint64_t size; } bg_alloc_t;
+
+typedef struct bg_event { uint64_t ms, usage, budget; uint32_t heap; int level; } bg_event_t;
+
+typedef struct xeno_budget_device {
+    PFN_vkAllocateMemory next_alloc;
+    PFN_vkFreeMemory next_free;
+    PFN_vkGetBufferMemoryRequirements next_buffer_reqs;
+    PFN_vkGetImageMemoryRequirements next_image_reqs;
+    PFN_vkGetBufferMemoryRequirements2 next_buffer_reqs2;
+    PFN_vkGetImageMemoryRequirements2 next_image_reqs2;
+    PFN_vkCreateSampler next_create_sampler;
+    char title[96];
+    int ext, steer, trim;
+    float mip_bias;
+    uint32_t high_pct, estimate_pct;
+    uint64_t ttl_ns, start_ns;
+    bg_heap_t heaps[VK_MAX_MEMORY_HEAPS];
+    _Atomic uint32_t learned;       /* types seen in memoryTypeBits */
+    _Atomic uint32_t compat[VK_MAX_MEMORY_TYPES]; /* types allowed by every resource that allowed this one */
+    xeno_map_t allocs;              /* VkDeviceMemory -> bg_alloc_t */
+    _Atomic uint64_t polled_at;
+    pthread_mutex_t poll_lock, event_lock;
+    bg_event_t events[MAX_EVENTS]; uint32_t event_count; /* ring, event_count keeps counting */
+    _Atomic int pressure;           /* highest level over all heaps */
+    _Atomic int hook_queued;
+    _Atomic uint32_t pending;       /* hook jobs not yet finished */
+    _Atomic uint64_t polls, steered, steer_misses, oom, hooks_fired, trimmed_variants, trimmed_bytes, biased_samplers;
+} xeno_budget_device_t;
+
+/* --- budget estimate --- */
+static uint64_t estimate(const bg_heap_t* h) {
+    uint64_t usage = atomic_load(&h->usage), tracked = atomic_load(&h->tracked), at_poll = atomic_load(&h->tracked_at_poll);
+    if (tracked >= at_poll) return usage + (tracked - at_poll);
+    return usage > at_poll - tracked ? usage - (at_poll - tracked) : 0;
+}
+
+/* would size more bytes put the heap over the pressure threshold */
+static int over_high(xeno_budget_device_t* bd, uint32_t heap, uint64_t size) {
+    uint64_t budget = atomic_load(&bd->heaps[heap].budget);
+    return budget && (estimate(&bd->heaps[heap]) + size) * 100 >= budget * bd->high_pct;
+}
+
+static void hook_run(void* ctx) {
+    xeno_device_t* dev = ctx; xeno_budget_device_t* bd = dev->budget;
+    atomic_store(&bd->hook_queued, 0);
+    if (bd->trim) {
+        uint32_t variants = xeno_shader_object_trim(dev) + xeno_dyn_emu_trim(dev);
+        uint64_t bytes = xeno_suballoc_trim(dev);
+        atomic_fetch_add(&bd->trimmed_variants, variants); atomic_fetch_add(&bd->trimmed_bytes, bytes);
+        if (variants || bytes) xlog("budget: trimmed %u pipeline variants, %" PRIu64 " bytes of empty blocks", variants, bytes);
+    }
+    atomic_fetch_sub(&bd->pending, 1);
+}
+
+static void fire_hooks(xeno_device_t* dev, xeno_budget_device_t* bd) {
+    atomic_fetch_add(&bd->hooks_fired, 1);
+    if (!bd->trim) return;
+    int expected = 0;
+    if (!atomic_compare_exchange_strong(&bd->hook_queued, &expected, 1)) return; /* one run covers every heap */
+    atomic_fetch_add(&bd->pending, 1);
+    if (xeno_workers_submit(hook_run, dev) != 0) hook_run(dev);
+}
+
+static void record_event(xeno_budget_device_t* bd, uint32_t heap, int level, uint64_t usage, uint64_t budget) {
+    pthread_mutex_lock(&bd->event_lock);
+    bg_event_t* e = &bd->events[bd->event_count++ % MAX_EVENTS];
+    e->ms = (xeno_now_ns() - bd->start_ns) / 1000000; e->heap = heap; e->level = level; e->usage = usage; e->budget = budget;
+    pthread_mutex_unlock(&bd->event_lock);
+    xlog("budget: heap %u pressure level %d usage=%" PRIu64 "MB budget=%" PRIu64 "MB", heap, level, usage >> 20, budget >> 20);
+}
+
+static void update_level(xeno_device_t* dev, xeno_budget_device_t* bd, uint32_t heap) {
+    bg_heap_t* h = &bd->heaps[heap];
+    uint64_t budget = atomic_load(&h->budget), est = estimate(h);
+    uint64_t peak = atomic_load(&h->peak);
+    while (est > peak && !atomic_compare_exchange_weak(&h->peak, &peak, est)) {}
+    if (!budget) return;
+    uint64_t pct = est * 100 / budget;
+    int cur = atomic_load(&h->level), want = pct >= 100 ? 2 : pct >= bd->high_pct ? 1 : 0;
+    if (want < cur && pct + HYSTERESIS_PCT >= (cur == 2 ? 100 : bd->high_pct)) want = cur;
+    if (want == cur || !atomic_compare_exchange_strong(&h->level, &cur, want)) return;
+    record_event(bd, heap, want, est, budget);
+    int top = 0;
+    for (uint32_t i = 0; i < dev->memory.memoryHeapCount; ++i) if (atomic_load(&bd->heaps[i].level) > top) top = atomic_load(&bd->heaps[i].level);
+    atomic_store(&bd->pressure, top);
+    if (want > cur) fire_hooks(dev, bd);
+}
+
+static void poll(xeno_device_t* dev, xeno_budget_device_t* bd) {
+    uint64_t now = xeno_now_ns();
+    if (now - atomic_load_explicit(&bd->polled_at, memory_order_relaxed) < bd->ttl_ns) return;
+    if (pthread_mutex_trylock(&bd->poll_lock) != 0) return; /* another thread is polling */
+    if (now - atomic_load(&bd->polled_at) >= bd->ttl_ns) {
+        VkDeviceSize budget[VK_MAX_MEMORY_HEAPS] = {0}, usage[VK_MAX_MEMORY_HEAPS] = {0};
+        int ext = bd->ext && xeno_query_memory_budget(dev->physical, budget, usage) == 0;
+        for (uint32_t i = 0; i < dev->memory.memoryHeapCount; ++i) {
+            bg_heap_t* h = &bd->heaps[i];
+            uint64_t tracked = atomic_load(&h->tracked);
+            if (!ext) { budget[i] = dev->memory.memoryHeaps[i].size / 100 * bd->estimate_pct; usage[i] = tracked; }
+            atomic_store(&h->budget, budget[i]); atomic_store(&h->usage, usage[i]); atomic_store(&h->tracked_at_poll, tracked);
+        }
+        atomic_store(&bd->polled_at, now);
+        atomic_fetch_add(&bd->polls, 1);
+        for (uint32_t i = 0; i < dev->memory.memoryHeapCount; ++i) update_level(dev, bd, i);
+    }
+    pthread_mutex_unlock(&bd->poll_lock);
+}
+
+/* --- steering --- */
+static int steerable(const VkMemoryAllocateInfo* ai) {
+    for (const VkBaseInStructure* s = ai->pNext; s; s = s->pNext)
+        if (s->sType != VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO && s->sType != VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO &&
+            s->sType != VK_STRUCTURE_TYPE_MEMORY_PRIORITY_ALLOCATE_INFO_EXT) return 0; /* imports / exports stay where they are */
+    return 1;
+}
+
+/* -1 when no other type is known to be safe and has headroom */
+static int pick_alt(xeno_device_t* dev, xeno_budget_device_t* bd, uint32_t type, uint64_t size) {
+    if (!(atomic_load(&bd->learned) & (1u << type))) return -1;
+    const VkMemoryType* from = &dev->memory.memoryTypes[type];
+    VkMemoryPropertyFlags keep = from->propertyFlags & (VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_PROTECTED_BIT);
+    uint32_t cand = atomic_load(&bd->compat[type]) & ~(1u << type);
+    for (uint32_t t = 0; t < dev->memory.memoryTypeCount; ++t) {
+        if (!(cand & (1u << t))) continue;
+        const VkMemoryType* to = &dev->memory.memoryTypes[t];
+        if ((to->propertyFlags & keep) != keep || (to->propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) ||
+            (to->propertyFlags & VK_MEMORY_PROPERTY_PROTECTED_BIT) != (keep & VK_MEMORY_PROPERTY_PROTECTED_BIT)) continue;
+        if (to->heapIndex == from->heapIndex || over_high(bd, to->heapIndex, size)) continue;
+        return (int)t;
+    }
+    return -1;
+}
+
+static void learn(xeno_device_t* dev, const VkMemoryRequirements* req) {
+    xeno_budget_device_t* bd = dev->budget;
+    uint32_t bits = req->memoryTypeBits;
+    atomic_fetch_or(&bd->learned, bits);
+    for (uint32_t t = 0; t < dev->memory.memoryTypeCount; ++t) if (bits & (1u << t)) atomic_fetch_and(&bd->compat[t], bits);
+}
+
+/* --- intercepts --- */
+static VKAPI_ATTR VkResult VKAPI_CALL bg_vkAllocateMemory(VkDevice device, const VkMemoryAllocateInfo* pAllocateInfo, const VkAllocationCallbacks* pAllocator, VkDeviceMemory* pMemory) {
+    xeno_device_t* dev = xeno_device_get(device); xeno_budget_device_t* bd = dev->budget;
+    uint32_t type = pAllocateInfo->memoryTypeIndex;
+    if (type >= dev->memory.memoryTypeCount) return bd->next_alloc(device, pAllocateInfo, pAllocator, pMemory);
+    poll(dev, bd);
+    uint64_t size = pAllocateInfo->allocationSize;
+    int can_steer = bd->steer && steerable(pAllocateInfo), alt = -1;
+    VkMemoryAllocateInfo moved;
+    if (can_steer && over_high(bd, dev->memory.memoryTypes[type].heapIndex, size)) {
+        if ((alt = pick_alt(dev, bd, type, size)) < 0) atomic_fetch_add(&bd->steer_misses, 1);
+    }
+    VkResult r = VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    if (alt >= 0) {
+        moved = *pAllocateInfo; moved.memoryTypeIndex = (uint32_t)alt;
+        if ((r = bd->next_alloc(device, &moved, pAllocator, pMemory)) == VK_SUCCESS) { type = (uint32_t)alt; atomic_fetch_add(&bd->steered, 1); }
+    }
+    if (r != VK_SUCCESS) r = bd->next_alloc(device, pAllocateInfo, pAllocator, pMemory);
+    uint32_t heap = dev->memory.memoryTypes[type].heapIndex;
+    if (r == VK_ERROR_OUT_OF_DEVICE_MEMORY && can_steer && alt < 0 && (alt = pick_alt(dev, bd, type, size)) >= 0) {
+        /* the driver ran out before our estimate did: retry once on a heap with headroom */
+        moved = *pAllocateInfo; moved.memoryTypeIndex = (uint32_t)alt;
+        if ((r = bd->next_alloc(device, &moved, pAllocator, pMemory)) == VK_SUCCESS) { heap = dev->memory.memoryTypes[alt].heapIndex; atomic_fetch_add(&bd->steered, 1); }
+    }
+    if (r != VK_SUCCESS) {
+        if (r == VK_ERROR_OUT_OF_DEVICE_MEMORY) atomic_fetch_add(&bd->oom, 1);
+        return r;
+    }
+    bg_alloc_t* a = malloc(sizeof(*a));
+    if (a) {
+        a->heap = heap; a->size = size;
+        xeno_map_put(&bd->allocs, XENO_HANDLE_KEY(*pMemory), a);
+        atomic_fetch_add(&bd->heaps[heap].tracked, size);
+    }
+    update_level(dev, bd, heap);
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL bg_vkFreeMemory(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks* pAllocator) {
+    xeno_device_t* dev = xeno_device_get(device); xeno_budget_device_t* bd = dev->budget;
+    if (!memory) return;
+    bg_alloc_t* a = xeno_map_remove(&bd->allocs, XENO_HANDLE_KEY(memory)); /* before the handle can be reused */
+    bd->next_free(device, memory, pAllocator);
+    if (!a) return;
+    atomic_fetch_sub(&bd->heaps[a->heap].tracked, a->size);
+    if (atomic_load(&bd->heaps[a->heap].level)) update_level(dev, bd, a->heap);
+    free(a);
+}
+
+static VKAPI_ATTR void VKAPI_CALL bg_vkGetBufferMemoryRequirements(VkDevice device, VkBuffer buffer, VkMemoryRequirements* pMemoryRequirements) {
+    xeno_device_t* dev = xeno_device_get(device);
+    dev->budget->next_buffer_reqs(device, buffer, pMemoryRequirements);
+    learn(dev, pMemoryRequirements);
+}
+static VKAPI_ATTR void VKAPI_CALL bg_vkGetImageMemoryRequirements(VkDevice device, VkImage image, VkMemoryRequirements* pMemoryRequirements) {
+    xeno_device_t* dev = xeno_device_get(device);
+    dev->budget->next_image_reqs(device, image, pMemoryRequirements);
+    learn(dev, pMemoryRequirements);
+}
+static VKAPI_ATTR void VKAPI_CALL bg_vkGetBufferMemoryRequirements2(VkDevice device, const VkBufferMemoryRequirementsInfo2* pInfo, VkMemoryRequirements2* pMemoryRequirements) {
+    xeno_device_t* dev = xeno_device_get(device);
+    dev->budget->next_buffer_reqs2(device, pInfo, pMemoryRequirements);
+    learn(dev, &pMemoryRequirements->memoryRequirements);
+}
+static VKAPI_ATTR void VKAPI_CALL bg_vkGetImageMemoryRequirements2(VkDevice device, const VkImageMemoryRequirementsInfo2* pInfo, VkMemoryRequirements2* pMemoryRequirements) {
+    xeno_device_t* dev = xeno_device_get(device);
+    dev->budget->next_image_reqs2(device, pInfo, pMemoryRequirements);
+    learn(dev, &pMemoryRequirements->memoryRequirements);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL bg_vkCreateSampler(VkDevice device, const VkSamplerCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkSampler* pSampler) {
+    xeno_device_t* dev = xeno_device_get(device); xeno_budget_device_t* bd = dev->budget;
+    poll(dev, bd);
+    if (!atomic_load(&bd->pressure) || pCreateInfo->maxLod <= pCreateInfo->minLod) return bd->next_create_sampler(device, pCreateInfo, pAllocator, pSampler);
+    VkSamplerCreateInfo ci = *pCreateInfo;
+    float limit = dev->limits.maxSamplerLodBias;
+    ci.mipLodBias += bd->mip_bias;
+    if (limit > 0 && ci.mipLodBias > limit) ci.mipLodBias = limit;
+    atomic_fetch_add(&bd->biased_samplers, 1);
+    return bd->next_create_sampler(device, &ci, pAllocator, pSampler);
+}
+
+/* --- per-title knobs --- */
+/* the title-specific variable when it is set, the global one otherwise */
+static const char* title_knob(const xeno_budget_device_t* bd, const char* name, char* key, size_t n) {
+    snprintf(key, n, "%s_%s", name, bd->title);
+    return bd->title[0] && getenv(key) ? key : name;
+}
+
+/* --- device lifetime / routing --- */
+int xeno_budget_init(xeno_device_t* dev) {
+    if (!xeno_env_bool("XCLIPSE_MEMORY_BUDGET", 1)) return 0;
+    if (!dev->memory.memoryHeapCount || !dev->vk.vkAllocateMemory || !dev->vk.vkFreeMemory) return -1;
+    xeno_budget_device_t* bd = calloc(1, sizeof(*bd)); if (!bd) return -1;
+    xeno_process_title(bd->title, sizeof(bd->title));
+    char key[192];
+    long ttl = xeno_env_long("XCLIPSE_BUDGET_TTL_MS", 50), high = xeno_env_long("XCLIPSE_BUDGET_HIGH_PCT", 90);
+    long est = xeno_env_long("XCLIPSE_BUDGET_ESTIMATE_PCT", 80);
+    bd->ttl_ns = (uint64_t)(ttl > 0 ? ttl : 0) * 1000000;
+    bd->high_pct = (uint32_t)(high < 50 ? 50 : high > 100 ? 100 : high);
+    bd->estimate_pct = (uint32_t)(est < 10 ? 10 : est > 100 ? 100 : est);
+    bd->steer = xeno_env_bool("XCLIPSE_BUDGET_STEER", 1);
+    bd->trim = xeno_env_bool(title_knob(bd, "XCLIPSE_BUDGET_TRIM", key, sizeof(key)), 1);
+    const char* bias = getenv(title_knob(bd, "XCLIPSE_BUDGET_MIP_BIAS", key, sizeof(key)));
+    bd->mip_bias = bias ? strtof(bias, NULL) : 1.0f;
+    if (bd->mip_bias < 0) bd->mip_bias = 0;
+#define BG_NEXT(field, fn) bd->field = (PFN_##fn)xeno_device_next_proc(dev, #fn);
+    BG_NEXT(next_alloc, vkAllocateMemory) BG_NEXT(next_free, vkFreeMemory)
+    BG_NEXT(next_buffer_reqs, vkGetBufferMemoryRequirements) BG_NEXT(next_image_reqs, vkGetImageMemoryRequirements)
+    BG_NEXT(next_buffer_reqs2, vkGetBufferMemoryRequirements2) BG_NEXT(next_image_reqs2, vkGetImageMemoryRequirements2)
+    BG_NEXT(next_create_sampler, vkCreateSampler)
+#undef BG_NEXT
+    for (uint32_t t = 0; t < VK_MAX_MEMORY_TYPES; ++t) atomic_init(&bd->compat[t], ~0u);
+    VkDeviceSize budget[VK_MAX_MEMORY_HEAPS], usage[VK_MAX_MEMORY_HEAPS];
+    bd->ext = xeno_query_memory_budget(dev->physical, budget, usage) == 0;
+    xeno_map_init(&bd->allocs, 4096);
+    pthread_mutex_init(&bd->poll_lock, NULL); pthread_mutex_init(&bd->event_lock, NULL);
+    bd->start_ns = xeno_now_ns();
+    dev->budget = bd;
+    atomic_store(&bd->polled_at, 0);
+    poll(dev, bd);
+    xlog("budget: tracking %u heaps source=%s title=%s high=%u%% steer=%d trim=%d mip_bias=%.2f", dev->memory.memoryHeapCount,
+         bd->ext ? "VK_EXT_memory_budget" : "estimate", bd->title[0] ? bd->title : "?", bd->high_pct, bd->steer, bd->trim, bd->mip_bias);
+    return 0;
+}
+
+static int free_alloc(uint64_t key, void* val, void* ctx) { free(val); return 1; }
+
+void xeno_budget_destroy(xeno_device_t* dev) {
+    xeno_budget_device_t* bd = dev->budget;
+    if (!bd) return;
+    while (atomic_load(&bd->pending)) sched_yield();
+    xeno_map_foreach(&bd->allocs, free_alloc, NULL);
+    xeno_map_destroy(&bd->allocs);
+    pthread_mutex_destroy(&bd->poll_lock); pthread_mutex_destroy(&bd->event_lock);
+    dev->budget = NULL;
+    free(bd);
+}
+
+PFN_vkVoidFunction xeno_budget_proc(xeno_device_t* dev, const char* name) {
+    xeno_budget_device_t* bd = dev->budget;
+    if (!bd) return NULL;
+    if (strcmp(name, "vkAllocateMemory") == 0) return (PFN_vkVoidFunction)bg_vkAllocateMemory;
+    if (strcmp(name, "vkFreeMemory") == 0) return (PFN_vkVoidFunction)bg_vkFreeMemory;
+    if (bd->mip_bias > 0 && bd->next_create_sampler && strcmp(name, "vkCreateSampler") == 0) return (PFN_vkVoidFunction)bg_vkCreateSampler;
+    if (!bd->steer) return NULL;
+    if (bd->next_buffer_reqs && strcmp(name, "vkGetBufferMemoryRequirements") == 0) return (PFN_vkVoidFunction)bg_vkGetBufferMemoryRequirements;
+    if (bd->next_image_reqs && strcmp(name, "vkGetImageMemoryRequirements") == 0) return (PFN_vkVoidFunction)bg_vkGetImageMemoryRequirements;
+    if (bd->next_buffer_reqs2 && (strcmp(name, "vkGetBufferMemoryRequirements2") == 0 || strcmp(name, "vkGetBufferMemoryRequirements2KHR") == 0))
+        return (PFN_vkVoidFunction)bg_vkGetBufferMemoryRequirements2;
+    if (bd->next_image_reqs2 && (strcmp(name, "vkGetImageMemoryRequirements2") == 0 || strcmp(name, "vkGetImageMemoryRequirements2KHR") == 0))
+        return (PFN_vkVoidFunction)bg_vkGetImageMemoryRequirements2;
+    return NULL;
+}
+
+void xeno_budget_report(FILE* f, xeno_device_t* dev) {
+    xeno_budget_device_t* bd = dev->budget;
+    fprintf(f, "  \"memory_budget\": {\"enabled\": %s", bd ? "true" : "false");
+    if (bd) {
+        fprintf(f, ", \"source\": \"%s\", \"title\": \"%s\", \"polls\": %" PRIu64 ", \"heaps\": [", bd->ext ? "VK_EXT_memory_budget" : "estimate",
+                bd->title, atomic_load(&bd->polls));
+        for (uint32_t i = 0; i < dev->memory.memoryHeapCount; ++i) {
+            const bg_heap_t* h = &bd->heaps[i];
+            fprintf(f, "%s{\"size\": %" PRIu64 ", \"budget\": %" PRIu64 ", \"usage\": %" PRIu64 ", \"peak_usage\": %" PRIu64 ", \"app_bytes\": %" PRIu64 ", \"level\": %d}",
+                    i ? ", " : "", (uint64_t)dev->memory.memoryHeaps[i].size, atomic_load(&h->budget), estimate(h), atomic_load(&h->peak),
+                    atomic_load(&h->tracked), atomic_load(&h->level));
+        }
+        fprintf(f, "], \"steered\": %" PRIu64 ", \"steer_misses\": %" PRIu64 ", \"out_of_memory\": %" PRIu64,
+                atomic_load(&bd->steered), atomic_load(&bd->steer_misses), atomic_load(&bd->oom));
+        fprintf(f, ", \"hooks_fired\": %" PRIu64 ", \"trimmed_variants\": %" PRIu64 ", \"trimmed_bytes\": %" PRIu64 ", \"biased_samplers\": %" PRIu64,
+                atomic_load(&bd->hooks_fired), atomic_load(&bd->trimmed_variants), atomic_load(&bd->trimmed_bytes), atomic_load(&bd->biased_samplers));
+        pthread_mutex_lock(&bd->event_lock);
+        uint32_t n = bd->event_count < MAX_EVENTS ? bd->event_count : MAX_EVENTS;
+        fprintf(f, ", \"pressure_events\": %u, \"recent_events\": [", bd->event_count);
+        for (uint32_t k = 0; k < n; ++k) {
+            const bg_event_t* e = &bd->events[(bd->event_count - n + k) % MAX_EVENTS];
+            fprintf(f, "%s{\"ms\": %" PRIu64 ", \"heap\": %u, \"level\": %d, \"usage\": %" PRIu64 ", \"budget\": %" PRIu64 "}",
+                    k ? ", " : "", e->ms, e->heap, e->level, e->usage, e->budget);
+        }
+        pthread_mutex_unlock(&bd->event_lock);
+        fprintf(f, "]");
+    }
+    fprintf(f, "}");
+}
+
+/* --- instance level: heap sizes the process can actually use --- */
+uint64_t xeno_budget_system_bytes(void) {
+    FILE* f = fopen("/proc/meminfo", "r");
+    if (!f) return 0;
+    char line[128]; unsigned long long kb = 0;
+    while (fgets(line, sizeof(line), f)) if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1) break;
+    fclose(f);
+    return (uint64_t)kb * 1024;
+}
+
+void xeno_budget_heaps(VkPhysicalDevice physical, VkPhysicalDeviceMemoryProperties* props) {
+    if (!xeno_env_bool("XCLIPSE_MEMORY_BUDGET", 1)) return;
+    VkDeviceSize budget[VK_MAX_MEMORY_HEAPS], usage[VK_MAX_MEMORY_HEAPS];
+    if (xeno_query_memory_budget(physical, budget, usage) != 0) return;
+    for (uint32_t i = 0; i < props->memoryHeapCount; ++i)
+        if (budget[i] && budget[i] < props->memoryHeaps[i].size) props->memoryHeaps[i].size = budget[i];
+}
@@ -0,0 +1,1869 @@
+/* xeno_mtrecord.c - recording of large render passes into secondaries on the worker pool
+ *
+ * Engines ported from GL record a frame on one thread: every draw of a pass goes through the
+ * driver's command encoding on the app's thread while the other cores idle. Primary command
+ * buffers recorded through here log their binds and dynamic state as they go, and the commands of
+ * a render pass instance begun with inline contents are captured instead of forwarded. When the
+ * subpass ends, a capture with at least XCLIPSE_MTRECORD_MIN_DRAWS draws is cut into one chunk per
+ * worker (at least MR_CHUNK_DRAWS draws each), every chunk is recorded on the worker pool into a
+ * secondary that first replays the state the primary had at the chunk's start, and the primary
+ * begins the subpass with secondary contents and executes them. Since vkCmdExecuteCommands leaves
+ * the primary's state undefined, the state the pass ended with is replayed on it after the pass.
+ * A smaller capture goes out inline as it was recorded.
+ *
+ * The state a chunk starts from is kept per command buffer as the last command to write each piece
+ * of state (the pipeline of a bind point, a descriptor set number, a vertex buffer binding, a push
+ * constant range, a dynamic state or an element of one, ...); replaying those in recording order
+ * reproduces it. Only render pass objects are split, not dynamic rendering: their secondaries need
+ * nothing but the pass, subpass and framebuffer to inherit. A capture goes out inline as soon as a
+ * command that cannot move into a secondary is recorded inside it (barriers, event waits, queries,
+ * timestamps, markers, debug labels), and a capture begun or ended while a query or conditional
+ * rendering is active is not split. Commands the log cannot hold (push descriptors through update
+ * templates, extension structs on the *2 binds) stop splitting for the rest of the recording. A
+ * device exposing commands valid inside a pass that bypass the layer splits nothing.
+ *
+ * Secondaries are recorded from command pools the device keeps per queue family, each used by one
+ * worker at a time; one that is free is taken, up to MR_MAX_POOLS of them. With
+ * XCLIPSE_MTRECORD_REUSE (on by default) a chunk is hashed over the commands it replays, the
+ * inheritance, the contents versions of the descriptor sets it binds and a generation counted up by
+ * every destruction of an object a command buffer can reference; a secondary recorded for the same
+ * hash is executed again instead of being recorded. Secondaries are held by the primaries executing
+ * them until those are begun again, reset or freed, and kept cached while unused for MR_KEEP_FRAMES
+ * frames.
+ *
+ * Apps and middleware that already record a subpass with secondary contents get the pools, the
+ * workers and the reuse through an extension-like entrypoint from
+ * vkGetDeviceProcAddr(device, "vkCmdRecordParallelXCLIPSE"):
+ *   typedef void (VKAPI_PTR *PFN_vkRecordItemsXCLIPSE)(void* pUserData, VkCommandBuffer commandBuffer,
+ *                                                      uint32_t firstItem, uint32_t itemCount);
+ *   VkResult vkCmdRecordParallelXCLIPSE(VkCommandBuffer commandBuffer, const VkCommandBufferInheritanceInfo* pInheritanceInfo,
+ *                                       uint32_t itemCount, const uint64_t* pItemHashes,
+ *                                       PFN_vkRecordItemsXCLIPSE pfnRecord, void* pUserData);
+ * called on a primary where vkCmdExecuteCommands is valid, with the inheritance its secondaries
+ * need (a render pass object's, or dynamic rendering's through VkCommandBufferInheritanceRenderingInfo).
+ * The items are cut into one run per worker and the calling thread; pfnRecord records each run
+ * into a secondary begun with the inheritance and RENDER_PASS_CONTINUE, concurrently on the
+ * workers and the calling thread, and must not begin, end or keep it. Each secondary starts with
+ * undefined state. The secondaries are executed in item order as vkCmdExecuteCommands would, so
+ * the primary's state is undefined after. With reuse on, pItemHashes (may be NULL) holds one hash
+ * per item, equal only when the item records the same commands: a run whose hashes, inheritance,
+ * generation and bound descriptor sets' contents are unchanged is executed again without calling
+ * pfnRecord. VK_ERROR_FEATURE_NOT_PRESENT: the command buffer is no primary of a pool the layer
+ * can record for (protected), record it as before; another error: recording failed and nothing
+ * was executed. The secondaries come from pools made through xeno_device_app_proc(), so the
+ * layers above see what the app records into them, and are executed through it.
+ *
+ * The layer is returned by xeno_device_mtrecord_proc(), behind the load/store layer, and forwards
+ * through xeno_device_barrier_proc(): the barrier layer sees the secondaries recorded and the
+ * passes they are executed in.
+ *
+ * Knobs (per title by appending _<PROCESS_NAME>):
+ *   XCLIPSE_MTRECORD=1              record large render passes into secondaries on the worker pool
+ *   XCLIPSE_MTRECORD_MIN_DRAWS=N    draws a subpass needs to be split (default 256)
+ *   XCLIPSE_MTRECORD_REUSE=0        record every secondary anew
+ *   XCLIPSE_MTRECORD_SPLIT=0        split nothing: only vkCmdRecordParallelXCLIPSE records in parallel
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+#define MR_CHUNK_DRAWS 64               /* fewest draws worth a secondary */
+#define MR_MAX_CHUNKS 16                /* secondaries per subpass */
+#define MR_MAX_KEYS 64                  /* pieces of state one command writes; more stop splitting */
+#define MR_MAX_WRITES 32                /* descriptor writes of a push */
+#define MR_MAX_POOLS 32                 /* command pools per device, the layer's and the app's */
+#define MR_MAX_SETS 256                 /* descriptor sets a secondary the app records binds; more are not cached */
+#define MR_MAX_CACHED 4096              /* secondaries kept for reuse */
+#define MR_KEEP_FRAMES 8                /* frames an unused secondary stays cached */
+#define MR_COMPACT_BYTES (256u << 10)   /* log size past which a capture starts from the live state only */
+#define MR_NONE UINT32_MAX
+
+enum {
+    MR_SEGMENTS, MR_SPLIT, MR_INLINE_SMALL, MR_INLINE_FORCED, MR_UNTRACKED, MR_FAILED, MR_DRAWS_SPLIT, MR_CHUNKS, MR_RECORDED,
+    MR_REUSED, MR_THREADS, MR_API_CALLS, MR_API_ITEMS, MR_API_CHUNKS, MR_API_RECORDED, MR_API_REUSED, MR_API_FAILED, MR_COUNTERS
+};
+static const char* const mr_counter_names[MR_COUNTERS] = {
+    "segments", "split", "inline_small", "inline_forced", "untracked", "failed", "draws_split", "chunks", "recorded", "reused", "threads",
+    "api_calls", "api_items", "api_chunks", "api_recorded", "api_reused", "api_failed"
+};
+
+enum { MR_OUTSIDE, MR_CAPTURE, MR_INLINE, MR_OTHER };  /* where a primary is recording */
+enum { MR_REC_STATE, MR_REC_OTHER, MR_REC_DRAW, MR_REC_WORK }; /* OTHER: state of the compute and ray tracing bind points */
+enum { MR_SLOT_PIPELINE = 1, MR_SLOT_SETS, MR_SLOT_PUSH_DESC, MR_SLOT_VERTEX, MR_SLOT_STRIDE, MR_SLOT_INDEX, MR_SLOT_PUSH, MR_SLOT_DYN, MR_SLOT_SHADER };
+#define MR_KEY(slot, v) (((uint64_t)(slot) << 56) | ((uint64_t)(v) & 0x00ffffffffffffffull))
+#define MR_DYN_KEY(state, i) MR_KEY(MR_SLOT_DYN, ((uint64_t)(state) << 16) | (i))
+
+/* EDS3 setters of a single scalar outside XENO_DYN_STATES */
+#define MR_SCALARS(X) \
+    X(vkCmdSetDepthClipEnableEXT, VkBool32) X(vkCmdSetDepthClipNegativeOneToOneEXT, VkBool32) \
+    X(vkCmdSetProvokingVertexModeEXT, VkProvokingVertexModeEXT) X(vkCmdSetLineRasterizationModeEXT, VkLineRasterizationModeEXT) \
+    X(vkCmdSetLineStippleEnableEXT, VkBool32) X(vkCmdSetConservativeRasterizationModeEXT, VkConservativeRasterizationModeEXT) \
+    X(vkCmdSetExtraPrimitiveOverestimationSizeEXT, float) X(vkCmdSetTessellationDomainOriginEXT, VkTessellationDomainOrigin) \
+    X(vkCmdSetRasterizationStreamEXT, uint32_t) X(vkCmdSetAttachmentFeedbackLoopEnableEXT, VkImageAspectFlags) \
+    X(vkCmdSetSampleLocationsEnableEXT, VkBool32) X(vkCmdSetDiscardRectangleEnableEXT, VkBool32) \
+    X(vkCmdSetDiscardRectangleModeEXT, VkDiscardRectangleModeEXT)
+
+/* dynamic states beyond XENO_DYN_STATES */
+enum {
+    MR_DYN_LINE_STIPPLE = XENO_DYN_COUNT, MR_DYN_FRAGMENT_SHADING_RATE, MR_DYN_COLOR_WRITE_ENABLE,
+#define MR_DYN_ENUM(fn, type) MR_DYN_##fn,
+    MR_SCALARS(MR_DYN_ENUM)
+#undef MR_DYN_ENUM
+};
+
+#define MR_HOOKS(X) \
+    X(vkCreateCommandPool) X(vkDestroyCommandPool) X(vkResetCommandPool) X(vkAllocateCommandBuffers) X(vkFreeCommandBuffers) \
+    X(vkBeginCommandBuffer) X(vkEndCommandBuffer) X(vkResetCommandBuffer) X(vkCmdExecuteCommands) \
+    X(vkCmdBeginRenderPass) X(vkCmdBeginRenderPass2) X(vkCmdNextSubpass) X(vkCmdNextSubpass2) X(vkCmdEndRenderPass) X(vkCmdEndRenderPass2) \
+    X(vkCmdDraw) X(vkCmdDrawIndexed) X(vkCmdDrawIndirect) X(vkCmdDrawIndexedIndirect) X(vkCmdDrawIndirectCount) X(vkCmdDrawIndexedIndirectCount) \
+    X(vkCmdDrawMeshTasksEXT) X(vkCmdDrawMeshTasksIndirectEXT) X(vkCmdDrawMeshTasksIndirectCountEXT) X(vkCmdClearAttachments) \
+    X(vkCmdBindPipeline) X(vkCmdBindShadersEXT) X(vkCmdBindDescriptorSets) X(vkCmdBindDescriptorSets2) \
+    X(vkCmdPushDescriptorSetKHR) X(vkCmdPushDescriptorSetWithTemplateKHR) X(vkCmdPushDescriptorSet2) X(vkCmdPushDescriptorSetWithTemplate2) \
+    X(vkCmdPushConstants) X(vkCmdPushConstants2) X(vkCmdBindVertexBuffers) X(vkCmdBindVertexBuffers2) \
+    X(vkCmdBindIndexBuffer) X(vkCmdBindIndexBuffer2) \
+    X(vkCmdSetDepthBias2EXT) X(vkCmdSetLineStipple) X(vkCmdSetFragmentShadingRateKHR) X(vkCmdSetColorWriteEnableEXT) \
+    X(vkCmdBeginQuery) X(vkCmdEndQuery) X(vkCmdBeginQueryIndexedEXT) X(vkCmdEndQueryIndexedEXT) \
+    X(vkCmdBeginConditionalRenderingEXT) X(vkCmdEndConditionalRenderingEXT) \
+    MR_INLINE_HOOKS(X)
+/* commands valid inside a pass that cannot move into a secondary: a capture goes out inline first */
+#define MR_INLINE_HOOKS(X) \
+    X(vkCmdPipelineBarrier) X(vkCmdPipelineBarrier2) X(vkCmdWaitEvents) X(vkCmdWaitEvents2) \
+    X(vkCmdWriteTimestamp) X(vkCmdWriteTimestamp2) X(vkCmdWriteBufferMarkerAMD) X(vkCmdWriteBufferMarker2AMD) \
+    X(vkCmdBeginDebugUtilsLabelEXT) X(vkCmdEndDebugUtilsLabelEXT) X(vkCmdInsertDebugUtilsLabelEXT) \
+    X(vkCmdDebugMarkerBeginEXT) X(vkCmdDebugMarkerEndEXT) X(vkCmdDebugMarkerInsertEXT) X(vkCmdSetDeviceMask)
+/* hooked with reuse on: destructions and descriptor set updates that invalidate recorded secondaries */
+#define MR_REUSE_HOOKS(X) \
+    X(vkDestroyPipeline) X(vkDestroyPipelineLayout) X(vkDestroyBuffer) X(vkDestroyBufferView) X(vkDestroyImage) X(vkDestroyImageView) \
+    X(vkDestroySampler) X(vkDestroyRenderPass) X(vkDestroyFramebuffer) X(vkDestroyShaderEXT) X(vkDestroyDescriptorSetLayout) \
+    X(vkAllocateDescriptorSets) X(vkFreeDescriptorSets) X(vkResetDescriptorPool) X(vkDestroyDescriptorPool) \
+    X(vkUpdateDescriptorSets) X(vkUpdateDescriptorSetWithTemplate)
+
+/* other names of the hooked entrypoints; the driver may only know one of them */
+static const struct { const char* name; const char* alias; } mr_aliases[] = {
+    { "vkCmdBeginRenderPass2", "vkCmdBeginRenderPass2KHR" }, { "vkCmdNextSubpass2", "vkCmdNextSubpass2KHR" },
+    { "vkCmdEndRenderPass2", "vkCmdEndRenderPass2KHR" },
+    { "vkCmdDrawIndirectCount", "vkCmdDrawIndirectCountKHR" }, { "vkCmdDrawIndirectCount", "vkCmdDrawIndirectCountAMD" },
+    { "vkCmdDrawIndexedIndirectCount", "vkCmdDrawIndexedIndirectCountKHR" }, { "vkCmdDrawIndexedIndirectCount", "vkCmdDrawIndexedIndirectCountAMD" },
+    { "vkCmdBindDescriptorSets2", "vkCmdBindDescriptorSets2KHR" }, { "vkCmdPushConstants2", "vkCmdPushConstants2KHR" },
+    { "vkCmdPushDescriptorSetKHR", "vkCmdPushDescriptorSet" }, { "vkCmdPushDescriptorSetWithTemplateKHR", "vkCmdPushDescriptorSetWithTemplate" },
+    { "vkCmdPushDescriptorSet2", "vkCmdPushDescriptorSet2KHR" }, { "vkCmdPushDescriptorSetWithTemplate2", "vkCmdPushDescriptorSetWithTemplate2KHR" },
+    { "vkCmdBindVertexBuffers2", "vkCmdBindVertexBuffers2EXT" }, { "vkCmdBindIndexBuffer2", "vkCmdBindIndexBuffer2KHR" },
+    { "vkCmdSetLineStipple", "vkCmdSetLineStippleKHR" }, { "vkCmdSetLineStipple", "vkCmdSetLineStippleEXT" },
+    { "vkCmdSetCullMode", "vkCmdSetCullModeEXT" }, { "vkCmdSetFrontFace", "vkCmdSetFrontFaceEXT" },
+    { "vkCmdSetPrimitiveTopology", "vkCmdSetPrimitiveTopologyEXT" },
+    { "vkCmdSetViewportWithCount", "vkCmdSetViewportWithCountEXT" }, { "vkCmdSetScissorWithCount", "vkCmdSetScissorWithCountEXT" },
+    { "vkCmdSetDepthTestEnable", "vkCmdSetDepthTestEnableEXT" }, { "vkCmdSetDepthWriteEnable", "vkCmdSetDepthWriteEnableEXT" },
+    { "vkCmdSetDepthCompareOp", "vkCmdSetDepthCompareOpEXT" }, { "vkCmdSetDepthBoundsTestEnable", "vkCmdSetDepthBoundsTestEnableEXT" },
+    { "vkCmdSetStencilTestEnable", "vkCmdSetStencilTestEnableEXT" }, { "vkCmdSetStencilOp", "vkCmdSetStencilOpEXT" },
+    { "vkCmdSetRasterizerDiscardEnable", "vkCmdSetRasterizerDiscardEnableEXT" },
+    { "vkCmdSetDepthBiasEnable", "vkCmdSetDepthBiasEnableEXT" }, { "vkCmdSetPrimitiveRestartEnable", "vkCmdSetPrimitiveRestartEnableEXT" },
+    { "vkCmdPipelineBarrier2", "vkCmdPipelineBarrier2KHR" }, { "vkCmdWaitEvents2", "vkCmdWaitEvents2KHR" },
+    { "vkCmdWriteTimestamp2", "vkCmdWriteTimestamp2KHR" },
+    { "vkUpdateDescriptorSetWithTemplate", "vkUpdateDescriptorSetWithTemplateKHR" },
+};
+#define MR_ALIAS_COUNT (sizeof(mr_aliases) / sizeof(mr_aliases[0]))
+
+/* commands valid inside a pass, or changing state a pass uses, that do not pass through here */
+static const char* const mr_unseen[] = {
+    "vkCmdDrawMultiEXT", "vkCmdDrawMultiIndexedEXT", "vkCmdDrawIndirectByteCountEXT",
+    "vkCmdDrawMeshTasksNV", "vkCmdDrawMeshTasksIndirectNV", "vkCmdDrawMeshTasksIndirectCountNV",
+    "vkCmdDrawClusterHUAWEI", "vkCmdDrawClusterIndirectHUAWEI", "vkCmdSubpassShadingHUAWEI", "vkCmdBindInvocationMaskHUAWEI",
+    "vkCmdBindTransformFeedbackBuffersEXT", "vkCmdBeginTransformFeedbackEXT", "vkCmdEndTransformFeedbackEXT",
+    "vkCmdBindDescriptorBuffersEXT", "vkCmdSetDescriptorBufferOffsetsEXT", "vkCmdSetDescriptorBufferOffsets2EXT",
+    "vkCmdBindDescriptorBufferEmbeddedSamplersEXT", "vkCmdBindDescriptorBufferEmbeddedSamplers2EXT",
+    "vkCmdSetDiscardRectangleEXT", "vkCmdSetSampleLocationsEXT", "vkCmdSetColorBlendAdvancedEXT", "vkCmdSetDepthClampRangeEXT",
+    "vkCmdSetRenderingAttachmentLocations", "vkCmdSetRenderingAttachmentLocationsKHR",
+    "vkCmdSetRenderingInputAttachmentIndices", "vkCmdSetRenderingInputAttachmentIndicesKHR",
+    "vkCmdSetViewportWScalingNV", "vkCmdSetViewportWScalingEnableNV", "vkCmdSetViewportSwizzleNV", "vkCmdSetExclusiveScissorNV",
+    "vkCmdSetExclusiveScissorEnableNV", "vkCmdSetViewportShadingRatePaletteNV", "vkCmdSetShadingRateImageEnableNV",
+    "vkCmdSetCoarseSampleOrderNV", "vkCmdBindShadingRateImageNV", "vkCmdSetFragmentShadingRateEnumNV",
+    "vkCmdSetCoverageToColorEnableNV", "vkCmdSetCoverageToColorLocationNV", "vkCmdSetCoverageModulationModeNV",
+    "vkCmdSetCoverageModulationTableEnableNV", "vkCmdSetCoverageModulationTableNV", "vkCmdSetCoverageReductionModeNV",
+    "vkCmdSetRepresentativeFragmentTestEnableNV", "vkCmdSetCheckpointNV",
+    "vkCmdBindPipelineShaderGroupNV", "vkCmdExecuteGeneratedCommandsNV", "vkCmdExecuteGeneratedCommandsEXT",
+};
+
+struct xeno_mtrecord_device;
+typedef void (*mr_replay_fn)(const struct xeno_mtrecord_device* md, VkCommandBuffer cmd, const unsigned char* p);
+
+/* a logged command: the header, the slot keys of the state it writes, then its arguments */
+typedef struct mr_rec { mr_replay_fn replay; uint32_t size; uint16_t nkeys, kind; } mr_rec_t;
+#define MR_ALIGN(n) (((n) + 7) & ~(size_t)7)
+#define MR_HEAD MR_ALIGN(sizeof(mr_rec_t))
+
+typedef struct mr_pool {
+    VkCommandPool handle;
+    uint32_t family;
+    int app;                            /* made through xeno_device_app_proc(), for vkCmdRecordParallelXCLIPSE */
+    pthread_mutex_t lock;               /* held while a worker records from the pool */
+    VkCommandBuffer* free;              /* secondaries to record again; room for all, under md->lock */
+    uint32_t nfree, count;
+} mr_pool_t;
+
+typedef struct mr_set_ref { VkDescriptorSet set; uint64_t version; } mr_set_ref_t;
+
+typedef struct mr_sec {                 /* a recorded secondary */
+    VkCommandBuffer handle;
+    mr_pool_t* pool;
+    uint64_t key;                       /* in the cache, when cached */
+    uint64_t frame;                     /* last executed */
+    uint32_t refs;                      /* primaries holding it */
+    int cached;
+    int nocache;                        /* binds sets the layer cannot check */
+    mr_set_ref_t* sets;                 /* bound by the app recording it, at their versions then */
+    uint32_t nsets, sets_cap;
+} mr_sec_t;
+
+typedef struct mr_set { VkDescriptorPool pool; _Atomic uint64_t version; } mr_set_t;
+
+typedef struct xeno_mtrecord_device {
+    xeno_device_t* dev;
+#define MR_NEXT(fn) PFN_##fn next_##fn;
+#define MR_NEXT_DYN(name, state, fn) PFN_##fn next_##fn;
+#define MR_NEXT_SCALAR(fn, type) PFN_##fn next_##fn;
+    MR_HOOKS(MR_NEXT)
+    MR_REUSE_HOOKS(MR_NEXT)
+    XENO_DYN_STATES(MR_NEXT_DYN)
+    MR_SCALARS(MR_NEXT_SCALAR)
+#undef MR_NEXT_SCALAR
+#undef MR_NEXT_DYN
+#undef MR_NEXT
+    PFN_vkCreateCommandPool app_vkCreateCommandPool;   /* through xeno_device_app_proc(), on first use */
+    PFN_vkAllocateCommandBuffers app_vkAllocateCommandBuffers;
+    PFN_vkBeginCommandBuffer app_vkBeginCommandBuffer;
+    PFN_vkEndCommandBuffer app_vkEndCommandBuffer;
+    PFN_vkCmdExecuteCommands app_vkCmdExecuteCommands;
+    char title[96];
+    uint32_t min_draws;
+    int reuse;
+    int split;                          /* inline subpasses are captured and split */
+    xeno_map_t families;                /* VkCommandPool -> queue family + 1, pools the layer records for */
+    xeno_map_t cache;                   /* chunk hash and family -> mr_sec_t */
+    xeno_map_t sets;                    /* VkDescriptorSet -> mr_set_t, with reuse */
+    pthread_mutex_t lock;               /* pools, free lists, cache entries and their refs */
+    mr_pool_t* pools[MR_MAX_POOLS];
+    uint32_t npools;
+    uint64_t swept;                     /* frame of the last cache sweep */
+    _Atomic uint64_t generation, versions;
+    _Atomic uint64_t n[MR_COUNTERS], evicted, recorded;
+} xeno_mtrecord_device_t;
+
+typedef struct mr_chunk {
+    uint32_t from, to;                  /* log range */
+    uint32_t prefix, nprefix;           /* state records replayed first, in cb->prefix */
+    uint64_t hash;
+    mr_sec_t* sec;
+    int hit;
+} mr_chunk_t;
+
+typedef struct mr_cb {
+    xeno_mtrecord_device_t* md;
+    VkCommandBuffer handle;
+    VkCommandPool pool;
+    uint32_t family;
+    int tracked;                        /* a primary of a pool secondaries can be recorded for */
+    int untracked;                      /* the recording used a command the log cannot hold */
+    int mode;                           /* MR_OUTSIDE, ... */
+    int lost;                           /* the primary's state is undefined after executing secondaries */
+    uint32_t queries;                   /* active */
+    int conditional;
+    VkCommandBufferUsageFlags usage;
+    unsigned char* log;                 /* mr_rec_t records since vkBeginCommandBuffer */
+    uint32_t len, cap;
+    uint64_t* slot_keys;                /* open addressing: piece of state -> offset of its last writer */
+    uint32_t* slot_vals;
+    uint32_t nslots, slot_cap;
+    uint32_t seg_start, seg_draws;      /* the capture */
+    /* what opens the captured subpass */
+    int next;                           /* vkCmdNextSubpass rather than the begin */
+    int v2;                             /* begun with vkCmdBeginRenderPass2 */
+    int next_v2;
+    uint32_t subpass;
+    VkRenderPassBeginInfo begin;
+    VkSubpassBeginInfo begin_subpass;
+    VkSubpassEndInfo next_end;
+    VkRenderPassAttachmentBeginInfo begin_views;
+    VkClearValue* clears; uint32_t clear_cap;
+    VkImageView* views; uint32_t view_cap;
+    /* scratch */
+    uint32_t* snap; uint32_t nsnap, snap_cap;
+    uint32_t* prefix; uint32_t nprefix, prefix_cap;
+    mr_chunk_t chunks[MR_MAX_CHUNKS];
+    mr_sec_t** held; uint32_t nheld, held_cap;   /* secondaries the primary executes */
+    mr_sec_t* sec;                      /* the secondary of an app pool being recorded by pfnRecord */
+    uint64_t n[MR_COUNTERS];
+} mr_cb_t;
+
+typedef struct mr_part { const void* p; size_t n; } mr_part_t;
+#define PART(ptr, bytes) { (ptr), (bytes) }
+
+static xeno_map_t mr_cbs;
+static pthread_once_t mr_cbs_once = PTHREAD_ONCE_INIT;
+static void mr_cbs_init(void) { xeno_map_init(&mr_cbs, 4096); }
+
+static inline mr_cb_t* mr_cb(VkCommandBuffer commandBuffer) { return xeno_map_get(&mr_cbs, XENO_HANDLE_KEY(commandBuffer)); }
+
+static inline uint64_t mix(uint64_t h, uint64_t v) { return xeno_hash64(&v, sizeof(v), h); }
+
+static int grow(void** p, uint32_t* cap, uint32_t need, size_t elem) {
+    if (need <= *cap) return 0;
+    uint32_t n = *cap ? *cap : 16;
+    while (n < need) n *= 2;
+    void* q = realloc(*p, (size_t)n * elem);
+    if (!q) return -1;
+    *p = q; *cap = n;
+    return 0;
+}
+
+/* --- the log --- */
+static inline const mr_rec_t* rec_at(const mr_cb_t* cb, uint32_t off) { return (const mr_rec_t*)(cb->log + off); }
+static inline const uint64_t* rec_keys(const mr_rec_t* r) { return (const uint64_t*)((const unsigned char*)r + MR_HEAD); }
+static inline const unsigned char* rec_args(const mr_rec_t* r) { return (const unsigned char*)r + MR_HEAD + r->nkeys * sizeof(uint64_t); }
+static inline const void* take(const unsigned char** p, size_t n) { const void* r = *p; *p += MR_ALIGN(n); return r; }
+
+/* appends a record with size argument bytes, zeroed: padding hashes the same every time */
+static unsigned char* append(mr_cb_t* cb, int kind, mr_replay_fn replay, const uint64_t* keys, uint32_t nkeys, size_t size) {
+    size_t total = MR_HEAD + nkeys * sizeof(uint64_t) + MR_ALIGN(size);
+    if (nkeys > MR_MAX_KEYS || total > UINT32_MAX - cb->len) return NULL;
+    if (cb->len + total > cb->cap) {
+        size_t n = cb->cap ? cb->cap : 4096;
+        while (n < cb->len + total) n *= 2;
+        if (n > UINT32_MAX) n = UINT32_MAX;
+        unsigned char* p = realloc(cb->log, n);
+        if (!p) return NULL;
+        cb->log = p; cb->cap = (uint32_t)n;
+    }
+    unsigned char* at = cb->log + cb->len;
+    memset(at, 0, total);
+    mr_rec_t* r = (mr_rec_t*)at;
+    r->replay = replay; r->size = (uint32_t)total; r->nkeys = (uint16_t)nkeys; r->kind = (uint16_t)kind;
+    if (nkeys) memcpy(at + MR_HEAD, keys, nkeys * sizeof(uint64_t));
+    cb->len += (uint32_t)total;
+    return at + MR_HEAD + nkeys * sizeof(uint64_t);
+}
+
+/* --- slots: the last writer of each piece of state --- */
+static void slots_clear(mr_cb_t* cb) {
+    if (cb->slot_keys) memset(cb->slot_keys, 0, cb->slot_cap * sizeof(uint64_t));
+    cb->nslots = 0;
+}
+static uint32_t* slot_find(uint64_t* keys, uint32_t* vals, uint32_t cap, uint64_t key) {
+    uint32_t i = (uint32_t)mix(0, key) & (cap - 1);
+    while (keys[i] && keys[i] != key) i = (i + 1) & (cap - 1);
+    keys[i] = key;
+    return &vals[i];
+}
+static int slots_put(mr_cb_t* cb, uint64_t key, uint32_t off) {
+    if ((cb->nslots + 1) * 2 > cb->slot_cap) {
+        uint32_t cap = cb->slot_cap ? cb->slot_cap * 2 : 256;
+        uint64_t* keys = calloc(cap, sizeof(*keys)); uint32_t* vals = malloc(cap * sizeof(*vals));
+        if (!keys || !vals) { free(keys); free(vals); return -1; }
+        for (uint32_t i = 0; i < cb->slot_cap; ++i)
+            if (cb->slot_keys[i]) *slot_find(keys, vals, cap, cb->slot_keys[i]) = cb->slot_vals[i];
+        free(cb->slot_keys); free(cb->slot_vals);
+        cb->slot_keys = keys; cb->slot_vals = vals; cb->slot_cap = cap;
+    }
+    uint32_t i = (uint32_t)mix(0, key) & (cb->slot_cap - 1);
+    while (cb->slot_keys[i] && cb->slot_keys[i] != key) i = (i + 1) & (cb->slot_cap - 1);
+    if (!cb->slot_keys[i]) { cb->slot_keys[i] = key; cb->nslots++; }
+    cb->slot_vals[i] = off;
+    return 0;
+}
+static int apply(mr_cb_t* cb, uint32_t off) {
+    const mr_rec_t* r = rec_at(cb, off);
+    const uint64_t* keys = rec_keys(r);
+    for (uint32_t i = 0; i < r->nkeys; ++i) if (slots_put(cb, keys[i], off) != 0) return -1;
+    return 0;
+}
+
+static int cmp_u32(const void* a, const void* b) { uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b; return x < y ? -1 : x > y; }
+
+/* appends the records the state is made of to *list, in recording order; graphics leaves out the
+ * other bind points' state; the count, or MR_NONE */
+static uint32_t snapshot(mr_cb_t* cb, uint32_t** list, uint32_t* n, uint32_t* cap, int graphics) {
+    uint32_t start = *n;
+    if (grow((void**)list, cap, start + cb->nslots, sizeof(uint32_t)) != 0) return MR_NONE;
+    uint32_t* l = *list + start, count = 0;
+    for (uint32_t i = 0; i < cb->slot_cap; ++i) {
+        if (!cb->slot_keys[i] || (graphics && rec_at(cb, cb->slot_vals[i])->kind == MR_REC_OTHER)) continue;
+        l[count++] = cb->slot_vals[i];
+    }
+    qsort(l, count, sizeof(uint32_t), cmp_u32);
+    uint32_t u = 0;
+    for (uint32_t i = 0; i < count; ++i) if (!u || l[u - 1] != l[i]) l[u++] = l[i];
+    *n = start + u;
+    return u;
+}
+
+static void replay_list(const mr_cb_t* cb, VkCommandBuffer cmd, const uint32_t* list, uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) { const mr_rec_t* r = rec_at(cb, list[i]); r->replay(cb->md, cmd, rec_args(r)); }
+}
+static void replay_range(const mr_cb_t* cb, VkCommandBuffer cmd, uint32_t from, uint32_t to) {
+    for (uint32_t off = from; off < to; off += rec_at(cb, off)->size) { const mr_rec_t* r = rec_at(cb, off); r->replay(cb->md, cmd, rec_args(r)); }
+}
+
+/* the state recorded so far, replayed on the primary after secondaries left it undefined */
+static void restore(mr_cb_t* cb) {
+    cb->nsnap = 0;
+    if (snapshot(cb, &cb->snap, &cb->nsnap, &cb->snap_cap, 0) == MR_NONE) cb->untracked = 1;
+    else replay_list(cb, cb->handle, cb->snap, cb->nsnap);
+    cb->lost = 0;
+}
+
+/* a long log is rewritten to the records the state is made of */
+static void compact(mr_cb_t* cb) {
+    cb->nsnap = 0;
+    if (snapshot(cb, &cb->snap, &cb->nsnap, &cb->snap_cap, 0) == MR_NONE) return;
+    cb->nprefix = 0;
+    if (grow((void**)&cb->prefix, &cb->prefix_cap, cb->nsnap, sizeof(uint32_t)) != 0) return;
+    uint32_t len = 0;
+    for (uint32_t i = 0; i < cb->nsnap; ++i) { cb->prefix[i] = len; len += rec_at(cb, cb->snap[i])->size; }
+    unsigned char* log = malloc(len > 4096 ? len * 2 : 4096);
+    if (!log) return;
+    for (uint32_t i = 0; i < cb->nsnap; ++i) memcpy(log + cb->prefix[i], rec_at(cb, cb->snap[i]), rec_at(cb, cb->snap[i])->size);
+    for (uint32_t i = 0; i < cb->slot_cap; ++i) {
+        if (!cb->slot_keys[i]) continue;
+        const uint32_t* at = bsearch(&cb->slot_vals[i], cb->snap, cb->nsnap, sizeof(uint32_t), cmp_u32);
+        cb->slot_vals[i] = cb->prefix[at - cb->snap];
+    }
+    free(cb->log);
+    cb->log = log; cb->len = len; cb->cap = len > 4096 ? len * 2 : 4096;
+}
+
+/* --- secondaries --- */
+/* a pool of the family no other thread records from, locked; app: one of the pools made through xeno_device_app_proc() */
+static mr_pool_t* pool_acquire(xeno_mtrecord_device_t* md, uint32_t family, int app) {
+    mr_pool_t* wait = NULL;
+    pthread_mutex_lock(&md->lock);
+    for (uint32_t i = 0; i < md->npools; ++i) {
+        mr_pool_t* p = md->pools[i];
+        if (p->family != family || p->app != app) continue;
+        if (pthread_mutex_trylock(&p->lock) == 0) { pthread_mutex_unlock(&md->lock); return p; }
+        if (!wait) wait = p;
+    }
+    if (md->npools < MR_MAX_POOLS) {
+        VkCommandPoolCreateInfo ci = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, NULL, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, family };
+        mr_pool_t* p = calloc(1, sizeof(*p));
+        if (p && (app ? md->app_vkCreateCommandPool : md->next_vkCreateCommandPool)(md->dev->handle, &ci, NULL, &p->handle) == VK_SUCCESS) {
+            p->family = family; p->app = app;
+            pthread_mutex_init(&p->lock, NULL);
+            pthread_mutex_lock(&p->lock);
+            md->pools[md->npools++] = p;
+            pthread_mutex_unlock(&md->lock);
+            return p;
+        }
+        free(p);
+    }
+    pthread_mutex_unlock(&md->lock);
+    if (wait) pthread_mutex_lock(&wait->lock);
+    return wait;
+}
+
+/* a secondary of the pool, which the caller holds; VK_NULL_HANDLE when none can be had */
+static VkCommandBuffer sec_take(xeno_mtrecord_device_t* md, mr_pool_t* p) {
+    VkCommandBuffer h = VK_NULL_HANDLE;
+    pthread_mutex_lock(&md->lock);
+    if (p->nfree) h = p->free[--p->nfree];
+    else {
+        /* room on the free list for every secondary of the pool: giving one back cannot fail */
+        VkCommandBuffer* l = realloc(p->free, (p->count + 1) * sizeof(*l));
+        if (l) p->free = l;
+        if (l) {
+            VkCommandBufferAllocateInfo ai = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, NULL, p->handle, VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1 };
+            if ((p->app ? md->app_vkAllocateCommandBuffers : md->next_vkAllocateCommandBuffers)(md->dev->handle, &ai, &h) == VK_SUCCESS) p->count++;
+            else h = VK_NULL_HANDLE;
+        }
+    }
+    pthread_mutex_unlock(&md->lock);
+    return h;
+}
+
+/* md->lock held: back on its pool's free list */
+static void sec_free(mr_sec_t* s) {
+    s->pool->free[s->pool->nfree++] = s->handle;
+    free(s->sets);
+    free(s);
+}
+
+/* md->lock held */
+static void sec_release(mr_sec_t* s) {
+    if (--s->refs || s->cached) return;
+    sec_free(s);
+}
+
+static void release_held(mr_cb_t* cb) {
+    if (!cb->nheld) return;
+    pthread_mutex_lock(&cb->md->lock);
+    for (uint32_t i = 0; i < cb->nheld; ++i) sec_release(cb->held[i]);
+    pthread_mutex_unlock(&cb->md->lock);
+    cb->nheld = 0;
+}
+
+/* a secondary from a pool of the primary's family, begun to continue the pass the inheritance
+ * describes; its pool stays held until sec_end(); NULL when none can be had */
+static mr_sec_t* sec_begin(mr_cb_t* cb, const VkCommandBufferInheritanceInfo* inherit, int app) {
+    xeno_mtrecord_device_t* md = cb->md;
+    mr_pool_t* p = pool_acquire(md, cb->family, app);
+    if (!p) return NULL;
+    VkCommandBuffer h = sec_take(md, p);
+    mr_sec_t* s = h ? calloc(1, sizeof(*s)) : NULL;
+    if (s) {
+        VkCommandBufferBeginInfo bi = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, NULL, VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT, inherit };
+        if (md->reuse || (cb->usage & VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT)) bi.flags |= VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+        s->handle = h; s->pool = p; s->refs = 1;
+        if ((app ? md->app_vkBeginCommandBuffer : md->next_vkBeginCommandBuffer)(h, &bi) == VK_SUCCESS) return s;
+        free(s);
+    }
+    if (h) { pthread_mutex_lock(&md->lock); p->free[p->nfree++] = h; pthread_mutex_unlock(&md->lock); }
+    pthread_mutex_unlock(&p->lock);
+    return NULL;
+}
+
+/* the recording ended and the pool given back; NULL when ending it failed */
+static mr_sec_t* sec_end(xeno_mtrecord_device_t* md, mr_sec_t* s, VkResult* result) {
+    mr_pool_t* p = s->pool;
+    VkResult r = (p->app ? md->app_vkEndCommandBuffer : md->next_vkEndCommandBuffer)(s->handle);
+    if (r != VK_SUCCESS) { pthread_mutex_lock(&md->lock); sec_free(s); pthread_mutex_unlock(&md->lock); s = NULL; }
+    pthread_mutex_unlock(&p->lock);
+    if (result) *result = r;
+    return s;
+}
+
+/* --- the cache --- */
+typedef struct mr_sweep { xeno_mtrecord_device_t* md; uint64_t frame; int full; } mr_sweep_t;
+static int sweep_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; mr_sec_t* s = val; mr_sweep_t* w = ctx;
+    if (s->refs || (!w->full && w->frame - s->frame <= MR_KEEP_FRAMES)) return 0;
+    sec_free(s);
+    atomic_fetch_add_explicit(&w->md->evicted, 1, memory_order_relaxed);
+    return 1;
+}
+
+/* md->lock held: once a frame, or when full, secondaries unused for MR_KEEP_FRAMES frames are dropped */
+static void cache_sweep(xeno_mtrecord_device_t* md, uint64_t frame) {
+    if (frame == md->swept && atomic_load(&md->cache.count) < MR_MAX_CACHED) return;
+    mr_sweep_t w = { md, frame, atomic_load(&md->cache.count) >= MR_MAX_CACHED };
+    xeno_map_foreach(&md->cache, sweep_fn, &w);
+    md->swept = frame;
+}
+
+/* md->lock held: the secondary cached for the key, taken for a primary; one that binds a set
+ * updated since it was recorded is dropped */
+static mr_sec_t* cache_take(xeno_mtrecord_device_t* md, uint64_t key, uint64_t frame) {
+    mr_sec_t* s = xeno_map_get(&md->cache, key);
+    if (!s) return NULL;
+    for (uint32_t i = 0; i < s->nsets; ++i) {
+        const mr_set_t* d = xeno_map_get(&md->sets, XENO_HANDLE_KEY(s->sets[i].set));
+        if (d && atomic_load_explicit(&d->version, memory_order_relaxed) == s->sets[i].version) continue;
+        xeno_map_remove(&md->cache, key);
+        s->cached = 0;
+        if (!s->refs) sec_free(s);
+        atomic_fetch_add_explicit(&md->evicted, 1, memory_order_relaxed);
+        return NULL;
+    }
+    s->refs++; s->frame = frame;
+    return s;
+}
+
+/* md->lock held: a secondary just recorded, kept for the key while there is room */
+static void cache_put(xeno_mtrecord_device_t* md, mr_sec_t* s, uint64_t key, uint64_t frame) {
+    s->frame = frame;
+    if (!md->reuse || s->nocache || md->cache.count >= MR_MAX_CACHED || xeno_map_get(&md->cache, key)) return;
+    s->cached = 1; s->key = key;
+    xeno_map_put(&md->cache, key, s);
+}
+
+typedef struct mr_job { mr_cb_t* cb; uint32_t miss[MR_MAX_CHUNKS]; } mr_job_t;
+
+/* records one chunk into a secondary; on a worker */
+static void record_fn(void* ctx, uint32_t i) {
+    mr_job_t* job = ctx;
+    mr_cb_t* cb = job->cb;
+    mr_chunk_t* c = &cb->chunks[job->miss[i]];
+    VkCommandBufferInheritanceInfo inherit = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO, NULL, cb->begin.renderPass, cb->subpass,
+                                               cb->begin.framebuffer, VK_FALSE, 0, 0 };
+    mr_sec_t* s = sec_begin(cb, &inherit, 0);
+    if (!s) return;
+    replay_list(cb, s->handle, cb->prefix + c->prefix, c->nprefix);
+    replay_range(cb, s->handle, c->from, c->to);
+    c->sec = sec_end(cb->md, s, NULL);
+}
+
+/* --- subpasses --- */
+static void untrack(mr_cb_t* cb);
+
+static void emit_opener(mr_cb_t* cb, VkSubpassContents contents) {
+    xeno_mtrecord_device_t* md = cb->md;
+    if (cb->next && cb->next_v2) {
+        VkSubpassBeginInfo sb = { VK_STRUCTURE_TYPE_SUBPASS_BEGIN_INFO, NULL, contents };
+        md->next_vkCmdNextSubpass2(cb->handle, &sb, &cb->next_end);
+    } else if (cb->next) md->next_vkCmdNextSubpass(cb->handle, contents);
+    else if (cb->v2) {
+        VkSubpassBeginInfo sb = cb->begin_subpass;
+        sb.contents = contents;
+        md->next_vkCmdBeginRenderPass2(cb->handle, &cb->begin, &sb);
+    } else md->next_vkCmdBeginRenderPass(cb->handle, &cb->begin, contents);
+}
+
+/* the capture goes out as recorded; applied: its state is in the slots already, restored from cb->snap */
+static void emit_inline(mr_cb_t* cb, int applied) {
+    emit_opener(cb, VK_SUBPASS_CONTENTS_INLINE);
+    if (cb->lost && applied) { replay_list(cb, cb->handle, cb->snap, cb->nsnap); cb->lost = 0; }
+    else if (cb->lost) restore(cb);
+    for (uint32_t off = cb->seg_start; off < cb->len; off += rec_at(cb, off)->size) {
+        const mr_rec_t* r = rec_at(cb, off);
+        r->replay(cb->md, cb->handle, rec_args(r));
+        if (!applied && r->nkeys && apply(cb, off) != 0) cb->untracked = 1;
+    }
+    cb->mode = MR_INLINE;
+}
+
+static void fail_split(mr_cb_t* cb) {
+    pthread_mutex_lock(&cb->md->lock);
+    for (uint32_t i = 0; i < MR_MAX_CHUNKS; ++i) if (cb->chunks[i].sec) sec_release(cb->chunks[i].sec);
+    pthread_mutex_unlock(&cb->md->lock);
+    cb->n[MR_FAILED]++;
+    emit_inline(cb, 1);
+}
+
+/* the capture is cut into chunks recorded into secondaries on the worker pool and executed */
+static void split(mr_cb_t* cb) {
+    xeno_mtrecord_device_t* md = cb->md;
+    uint32_t draws = cb->seg_draws, n = (uint32_t)xeno_workers_count() + 1;
+    if (n > MR_MAX_CHUNKS) n = MR_MAX_CHUNKS;
+    if (n > draws / MR_CHUNK_DRAWS) n = draws / MR_CHUNK_DRAWS;
+    if (n < 2 || grow((void**)&cb->held, &cb->held_cap, cb->nheld + n, sizeof(*cb->held)) != 0) { cb->n[MR_INLINE_SMALL]++; emit_inline(cb, 0); return; }
+    uint32_t per = (draws + n - 1) / n;
+    memset(cb->chunks, 0, sizeof(cb->chunks));
+    cb->nsnap = 0; cb->nprefix = 0;
+    /* the state the primary needs back if this goes out inline after all */
+    if (cb->lost && snapshot(cb, &cb->snap, &cb->nsnap, &cb->snap_cap, 0) == MR_NONE) { untrack(cb); return; }
+    int ok = 1;
+    /* plan: every chunk starts with the state the draws before it left */
+    uint32_t k = 0, in_chunk = 0;
+    mr_chunk_t* c = &cb->chunks[0];
+    c->from = cb->seg_start;
+    if (ok && (c->nprefix = snapshot(cb, &cb->prefix, &cb->nprefix, &cb->prefix_cap, 1)) == MR_NONE) ok = 0;
+    for (uint32_t off = cb->seg_start; ok && off < cb->len; off += rec_at(cb, off)->size) {
+        const mr_rec_t* r = rec_at(cb, off);
+        if (r->kind == MR_REC_DRAW) {
+            if (in_chunk == per && k + 1 < n) {
+                cb->chunks[k].to = off;
+                c = &cb->chunks[++k];
+                c->from = off; c->prefix = cb->nprefix;
+                if ((c->nprefix = snapshot(cb, &cb->prefix, &cb->nprefix, &cb->prefix_cap, 1)) == MR_NONE) ok = 0;
+                in_chunk = 0;
+            }
+            in_chunk++;
+        } else if (r->nkeys && apply(cb, off) != 0) ok = 0;
+    }
+    if (!ok) { cb->untracked = 1; cb->n[MR_UNTRACKED]++; fail_split(cb); return; }
+    cb->chunks[k].to = cb->len;
+    n = k + 1;
+    uint64_t frame = atomic_load(&md->dev->frames);
+    mr_job_t job = { cb, { 0 } };
+    uint32_t misses = 0, hits = 0;
+    if (md->reuse) {
+        uint64_t seed = mix(mix(mix(mix(0x6d747265636f7264ull, XENO_HANDLE_KEY(cb->begin.renderPass)), cb->subpass), XENO_HANDLE_KEY(cb->begin.framebuffer)),
+                            atomic_load_explicit(&md->generation, memory_order_relaxed));
+        for (uint32_t i = 0; i < n; ++i) {
+            c = &cb->chunks[i];
+            uint64_t h = seed;
+            for (uint32_t j = 0; j < c->nprefix; ++j) { const mr_rec_t* r = rec_at(cb, cb->prefix[c->prefix + j]); h = xeno_hash64(r, r->size, h); }
+            c->hash = mix(xeno_hash64(cb->log + c->from, c->to - c->from, h), cb->family);
+        }
+    }
+    pthread_mutex_lock(&md->lock);
+    if (md->reuse) cache_sweep(md, frame);
+    for (uint32_t i = 0; i < n; ++i) {
+        c = &cb->chunks[i];
+        if (md->reuse && (c->sec = cache_take(md, c->hash, frame)) != NULL) { c->hit = 1; hits++; }
+        else job.miss[misses++] = i;
+    }
+    pthread_mutex_unlock(&md->lock);
+    uint32_t threads = misses ? xeno_workers_parallel(misses, record_fn, &job) : 0;
+    for (uint32_t i = 0; i < n; ++i) if (!cb->chunks[i].sec) { fail_split(cb); return; }
+    VkCommandBuffer handles[MR_MAX_CHUNKS];
+    pthread_mutex_lock(&md->lock);
+    for (uint32_t i = 0; i < n; ++i) {
+        c = &cb->chunks[i];
+        if (!c->hit) cache_put(md, c->sec, c->hash, frame);
+        cb->held[cb->nheld++] = c->sec;
+        handles[i] = c->sec->handle;
+    }
+    pthread_mutex_unlock(&md->lock);
+    emit_opener(cb, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    md->next_vkCmdExecuteCommands(cb->handle, n, handles);
+    cb->lost = 1;
+    cb->mode = MR_INLINE;
+    cb->n[MR_SPLIT]++; cb->n[MR_DRAWS_SPLIT] += draws; cb->n[MR_CHUNKS] += n;
+    cb->n[MR_RECORDED] += misses; cb->n[MR_REUSED] += hits; cb->n[MR_THREADS] += threads;
+}
+
+static void close_segment(mr_cb_t* cb) {
+    if (cb->seg_draws < cb->md->min_draws) { cb->n[MR_INLINE_SMALL]++; emit_inline(cb, 0); }
+    else if (cb->queries || cb->conditional) { cb->n[MR_INLINE_FORCED]++; emit_inline(cb, 0); }
+    else split(cb);
+}
+
+static void start_capture(mr_cb_t* cb) {
+    if (cb->len > MR_COMPACT_BYTES) compact(cb);
+    cb->seg_start = cb->len; cb->seg_draws = 0;
+    cb->mode = MR_CAPTURE;
+    cb->n[MR_SEGMENTS]++;
+}
+
+/* a command the log cannot hold: a capture goes out inline, nothing is split for the rest of the recording
+ * and the state is forwarded as it is set from here on */
+static void untrack(mr_cb_t* cb) {
+    if (cb->mode == MR_CAPTURE) emit_inline(cb, 0);
+    else if (cb->lost) restore(cb);
+    cb->untracked = 1;
+    cb->n[MR_UNTRACKED]++;
+}
+
+static inline int tracking(const mr_cb_t* cb) { return cb->tracked && !cb->untracked && cb->md->split; }
+
+/* 1 when the state command was captured; else it is in the slots (or the log cannot hold it) and the caller forwards it */
+static int log_state(mr_cb_t* cb, int kind, mr_replay_fn replay, const uint64_t* keys, uint32_t nkeys, const mr_part_t* parts, int n) {
+    if (!tracking(cb) || (!nkeys && cb->mode != MR_CAPTURE)) return 0;
+    size_t size = 0;
+    for (int i = 0; i < n; ++i) size += MR_ALIGN(parts[i].n);
+    uint32_t off = cb->len;
+    unsigned char* p = append(cb, kind, replay, keys, nkeys, size);
+    if (!p) { untrack(cb); return 0; }
+    for (int i = 0; i < n; ++i) { if (parts[i].n) memcpy(p, parts[i].p, parts[i].n); p += MR_ALIGN(parts[i].n); }
+    if (cb->mode == MR_CAPTURE) return 1;
+    if (apply(cb, off) != 0) untrack(cb);
+    return 0;
+}
+#define MR_STATE(cb, kind, replay, keys, nkeys, ...) \
+    log_state(cb, kind, replay, keys, nkeys, (const mr_part_t[]){ __VA_ARGS__ }, (int)(sizeof((const mr_part_t[]){ __VA_ARGS__ }) / sizeof(mr_part_t)))
+
+/* 1 when the draw or clear was captured */
+static int log_work(mr_cb_t* cb, int kind, mr_replay_fn replay, const mr_part_t* parts, int n) {
+    if (cb->mode != MR_CAPTURE) return 0;
+    size_t size = 0;
+    for (int i = 0; i < n; ++i) size += MR_ALIGN(parts[i].n);
+    unsigned char* p = append(cb, kind, replay, NULL, 0, size);
+    if (!p) { untrack(cb); return 0; }
+    for (int i = 0; i < n; ++i) { if (parts[i].n) memcpy(p, parts[i].p, parts[i].n); p += MR_ALIGN(parts[i].n); }
+    if (kind == MR_REC_DRAW) cb->seg_draws++;
+    return 1;
+}
+#define MR_WORK(cb, kind, replay, ...) \
+    log_work(cb, kind, replay, (const mr_part_t[]){ __VA_ARGS__ }, (int)(sizeof((const mr_part_t[]){ __VA_ARGS__ }) / sizeof(mr_part_t)))
+
+static inline int bind_kind(VkPipelineBindPoint bp) { return bp == VK_PIPELINE_BIND_POINT_GRAPHICS ? MR_REC_STATE : MR_REC_OTHER; }
+static inline int stages_kind(VkShaderStageFlags stages) {
+    return stages & (VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT) ? MR_REC_STATE : MR_REC_OTHER;
+}
+
+/* --- binds --- */
+static void rp_vkCmdBindPipeline(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* bp = take(&p, sizeof(uint32_t)); const VkPipeline* pipeline = take(&p, sizeof(VkPipeline));
+    md->next_vkCmdBindPipeline(cmd, (VkPipelineBindPoint)*bp, *pipeline);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdBindPipeline(VkCommandBuffer commandBuffer, VkPipelineBindPoint pipelineBindPoint, VkPipeline pipeline) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t key = MR_KEY(MR_SLOT_PIPELINE, pipelineBindPoint);
+    if (!MR_STATE(cb, bind_kind(pipelineBindPoint), rp_vkCmdBindPipeline, &key, 1, PART(&pipelineBindPoint, sizeof(uint32_t)), PART(&pipeline, sizeof(pipeline))))
+        cb->md->next_vkCmdBindPipeline(commandBuffer, pipelineBindPoint, pipeline);
+}
+
+static void rp_vkCmdBindShadersEXT(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* n = take(&p, sizeof(uint32_t)); const VkShaderStageFlagBits* stages = take(&p, *n * sizeof(*stages));
+    md->next_vkCmdBindShadersEXT(cmd, *n, stages, take(&p, *n * sizeof(VkShaderEXT)));
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdBindShadersEXT(VkCommandBuffer commandBuffer, uint32_t stageCount, const VkShaderStageFlagBits* pStages, const VkShaderEXT* pShaders) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t keys[MR_MAX_KEYS];
+    VkShaderStageFlags all = 0;
+    for (uint32_t i = 0; i < stageCount && i < MR_MAX_KEYS; ++i) { keys[i] = MR_KEY(MR_SLOT_SHADER, pStages[i]); all |= pStages[i]; }
+    if (stageCount > MR_MAX_KEYS || !pShaders) { if (tracking(cb)) untrack(cb); }
+    else if (MR_STATE(cb, stages_kind(all), rp_vkCmdBindShadersEXT, keys, stageCount, PART(&stageCount, sizeof(stageCount)),
+                      PART(pStages, stageCount * sizeof(*pStages)), PART(pShaders, stageCount * sizeof(*pShaders)))) return;
+    cb->md->next_vkCmdBindShadersEXT(commandBuffer, stageCount, pStages, pShaders);
+}
+
+static void rp_vkCmdBindDescriptorSets(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* h = take(&p, 4 * sizeof(uint32_t)); const VkPipelineLayout* layout = take(&p, sizeof(*layout));
+    const VkDescriptorSet* sets = take(&p, h[2] * sizeof(*sets));
+    md->next_vkCmdBindDescriptorSets(cmd, (VkPipelineBindPoint)h[0], *layout, h[1], h[2], sets, h[3], take(&p, h[3] * sizeof(uint32_t)));
+}
+/* a secondary the app records keeps the versions of the sets it binds: cache_take() drops it once one is updated */
+static void note_sets(mr_cb_t* cb, const VkDescriptorSet* sets, uint32_t count) {
+    mr_sec_t* s = cb->sec;
+    if (!cb->md->reuse || s->nocache) return;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (!sets[i]) continue;
+        uint32_t k = s->nsets;
+        while (k && s->sets[k - 1].set != sets[i]) k--;
+        if (k) continue;
+        const mr_set_t* d = xeno_map_get(&cb->md->sets, XENO_HANDLE_KEY(sets[i]));
+        if (!d || s->nsets == MR_MAX_SETS || grow((void**)&s->sets, &s->sets_cap, s->nsets + 1, sizeof(*s->sets)) != 0) { s->nocache = 1; return; }
+        s->sets[s->nsets].set = sets[i];
+        s->sets[s->nsets++].version = atomic_load_explicit(&d->version, memory_order_relaxed);
+    }
+}
+
+/* the contents versions of the sets go last: a secondary binding a set updated since is recorded anew */
+static int log_sets(mr_cb_t* cb, VkPipelineBindPoint bp, VkPipelineLayout layout, uint32_t first, uint32_t count, const VkDescriptorSet* sets,
+                    uint32_t dynamicOffsetCount, const uint32_t* pDynamicOffsets) {
+    if (!tracking(cb)) return 0;
+    if (count > MR_MAX_KEYS) { untrack(cb); return 0; }
+    uint64_t keys[MR_MAX_KEYS], versions[MR_MAX_KEYS];
+    for (uint32_t i = 0; i < count; ++i) {
+        keys[i] = MR_KEY(MR_SLOT_SETS, ((uint64_t)bp << 8) | (first + i));
+        if (!cb->md->reuse || !sets[i]) { versions[i] = 0; continue; }
+        const mr_set_t* s = xeno_map_get(&cb->md->sets, XENO_HANDLE_KEY(sets[i]));
+        /* a set not known here never hashes the same twice */
+        versions[i] = s ? atomic_load_explicit(&s->version, memory_order_relaxed) : atomic_fetch_add_explicit(&cb->md->versions, 1, memory_order_relaxed) + 1;
+    }
+    uint32_t h[4] = { bp, first, count, dynamicOffsetCount };
+    return MR_STATE(cb, bind_kind(bp), rp_vkCmdBindDescriptorSets, keys, count, PART(h, sizeof(h)), PART(&layout, sizeof(layout)),
+                    PART(sets, count * sizeof(*sets)), PART(pDynamicOffsets, dynamicOffsetCount * sizeof(uint32_t)),
+                    PART(versions, cb->md->reuse ? count * sizeof(uint64_t) : 0));
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdBindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint pipelineBindPoint, VkPipelineLayout layout, uint32_t firstSet,
+                                                            uint32_t descriptorSetCount, const VkDescriptorSet* pDescriptorSets, uint32_t dynamicOffsetCount, const uint32_t* pDynamicOffsets) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    if (cb->sec) note_sets(cb, pDescriptorSets, descriptorSetCount);
+    if (!log_sets(cb, pipelineBindPoint, layout, firstSet, descriptorSetCount, pDescriptorSets, dynamicOffsetCount, pDynamicOffsets))
+        cb->md->next_vkCmdBindDescriptorSets(commandBuffer, pipelineBindPoint, layout, firstSet, descriptorSetCount, pDescriptorSets, dynamicOffsetCount, pDynamicOffsets);
+}
+/* logged as one vkCmdBindDescriptorSets per bind point the stages belong to */
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdBindDescriptorSets2(VkCommandBuffer commandBuffer, const VkBindDescriptorSetsInfo* pInfo) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    if (cb->sec) note_sets(cb, pInfo->pDescriptorSets, pInfo->descriptorSetCount);
+    if (tracking(cb) && pInfo->pNext) untrack(cb);
+    if (tracking(cb)) {
+        static const struct { VkShaderStageFlags stages; VkPipelineBindPoint bp; } points[] = {
+            { VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT, VK_PIPELINE_BIND_POINT_GRAPHICS },
+            { VK_SHADER_STAGE_COMPUTE_BIT, VK_PIPELINE_BIND_POINT_COMPUTE },
+            { 0x3f00 /* ray tracing stages */, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR },
+        };
+        int captured = 0;
+        for (size_t i = 0; i < sizeof(points) / sizeof(points[0]); ++i)
+            if (pInfo->stageFlags & points[i].stages)
+                captured = log_sets(cb, points[i].bp, pInfo->layout, pInfo->firstSet, pInfo->descriptorSetCount, pInfo->pDescriptorSets,
+                                    pInfo->dynamicOffsetCount, pInfo->pDynamicOffsets);
+        if (captured) return;
+    }
+    cb->md->next_vkCmdBindDescriptorSets2(commandBuffer, pInfo);
+}
+
+/* push descriptors: the writes normalized to their binding, elements, type and infos */
+enum { MR_PUSH_IMAGE, MR_PUSH_TEXEL, MR_PUSH_BUFFER };
+static int push_class(VkDescriptorType type, size_t* elem) {
+    switch (type) {
+    case VK_DESCRIPTOR_TYPE_SAMPLER: case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER: case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+    case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+        *elem = sizeof(VkDescriptorImageInfo); return MR_PUSH_IMAGE;
+    case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER: case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+        *elem = sizeof(VkBufferView); return MR_PUSH_TEXEL;
+    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER: case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+    case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC: case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+        *elem = sizeof(VkDescriptorBufferInfo); return MR_PUSH_BUFFER;
+    default: return -1;   /* inline uniform blocks, acceleration structures, ... */
+    }
+}
+static void rp_vkCmdPushDescriptorSetKHR(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* h = take(&p, 4 * sizeof(uint32_t)); const VkPipelineLayout* layout = take(&p, sizeof(*layout));
+    VkWriteDescriptorSet writes[MR_MAX_WRITES];
+    for (uint32_t i = 0; i < h[2]; ++i) {
+        const uint32_t* w = take(&p, 4 * sizeof(uint32_t));
+        size_t elem = 0;
+        int kind = push_class((VkDescriptorType)w[3], &elem);
+        const void* info = take(&p, w[2] * elem);
+        VkWriteDescriptorSet v = { VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, VK_NULL_HANDLE, w[0], w[1], w[2], (VkDescriptorType)w[3],
+                                   kind == MR_PUSH_IMAGE ? info : NULL, kind == MR_PUSH_BUFFER ? info : NULL, kind == MR_PUSH_TEXEL ? info : NULL };
+        writes[i] = v;
+    }
+    md->next_vkCmdPushDescriptorSetKHR(cmd, (VkPipelineBindPoint)h[0], *layout, h[1], h[2], writes);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdPushDescriptorSetKHR(VkCommandBuffer commandBuffer, VkPipelineBindPoint pipelineBindPoint, VkPipelineLayout layout, uint32_t set,
+                                                              uint32_t descriptorWriteCount, const VkWriteDescriptorSet* pDescriptorWrites) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    if (!tracking(cb)) { cb->md->next_vkCmdPushDescriptorSetKHR(commandBuffer, pipelineBindPoint, layout, set, descriptorWriteCount, pDescriptorWrites); return; }
+    /* the writes a push replaces are keyed by the bindings it names */
+    uint64_t key = mix(mix(mix(0, pipelineBindPoint), XENO_HANDLE_KEY(layout)), set);
+    size_t size = 4 * sizeof(uint32_t) + MR_ALIGN(sizeof(layout)), elem = 0;
+    int ok = descriptorWriteCount <= MR_MAX_WRITES;
+    for (uint32_t i = 0; ok && i < descriptorWriteCount; ++i) {
+        const VkWriteDescriptorSet* w = &pDescriptorWrites[i];
+        int kind = push_class(w->descriptorType, &elem);
+        const void* info = kind == MR_PUSH_IMAGE ? (const void*)w->pImageInfo : kind == MR_PUSH_BUFFER ? (const void*)w->pBufferInfo : (const void*)w->pTexelBufferView;
+        ok = kind >= 0 && !w->pNext && (info || !w->descriptorCount);
+        key = mix(mix(mix(key, w->dstBinding), w->dstArrayElement), w->descriptorCount);
+        size += 4 * sizeof(uint32_t) + MR_ALIGN(w->descriptorCount * elem);
+    }
+    key = MR_KEY(MR_SLOT_PUSH_DESC, key);
+    uint32_t off = cb->len;
+    unsigned char* p = ok ? append(cb, bind_kind(pipelineBindPoint), rp_vkCmdPushDescriptorSetKHR, &key, 1, size) : NULL;
+    if (!p) untrack(cb);
+    else {
+        uint32_t h[4] = { pipelineBindPoint, set, descriptorWriteCount, 0 };
+        memcpy(p, h, sizeof(h)); p += sizeof(h);
+        memcpy(p, &layout, sizeof(layout)); p += MR_ALIGN(sizeof(layout));
+        for (uint32_t i = 0; i < descriptorWriteCount; ++i) {
+            const VkWriteDescriptorSet* w = &pDescriptorWrites[i];
+            uint32_t v[4] = { w->dstBinding, w->dstArrayElement, w->descriptorCount, w->descriptorType };
+            memcpy(p, v, sizeof(v)); p += sizeof(v);
+            int kind = push_class(w->descriptorType, &elem);
+            /* field by field: the padding of an image info stays zeroed for the hash */
+            for (uint32_t k = 0; k < w->descriptorCount; ++k) {
+                if (kind == MR_PUSH_IMAGE) {
+                    VkDescriptorImageInfo* d = (VkDescriptorImageInfo*)p + k;
+                    d->sampler = w->pImageInfo[k].sampler; d->imageView = w->pImageInfo[k].imageView; d->imageLayout = w->pImageInfo[k].imageLayout;
+                } else if (kind == MR_PUSH_BUFFER) ((VkDescriptorBufferInfo*)p)[k] = w->pBufferInfo[k];
+                else ((VkBufferView*)p)[k] = w->pTexelBufferView[k];
+            }
+            p += MR_ALIGN(w->descriptorCount * elem);
+        }
+        if (cb->mode == MR_CAPTURE) return;
+        if (apply(cb, off) != 0) untrack(cb);
+    }
+    cb->md->next_vkCmdPushDescriptorSetKHR(commandBuffer, pipelineBindPoint, layout, set, descriptorWriteCount, pDescriptorWrites);
+}
+/* update templates read app memory laid out by the template: not logged */
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdPushDescriptorSetWithTemplateKHR(VkCommandBuffer commandBuffer, VkDescriptorUpdateTemplate descriptorUpdateTemplate,
+                                                                          VkPipelineLayout layout, uint32_t set, const void* pData) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    if (tracking(cb)) untrack(cb);
+    cb->md->next_vkCmdPushDescriptorSetWithTemplateKHR(commandBuffer, descriptorUpdateTemplate, layout, set, pData);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdPushDescriptorSetWithTemplate2(VkCommandBuffer commandBuffer, const VkPushDescriptorSetWithTemplateInfo* pInfo) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    if (tracking(cb)) untrack(cb);
+    cb->md->next_vkCmdPushDescriptorSetWithTemplate2(commandBuffer, pInfo);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdPushDescriptorSet2(VkCommandBuffer commandBuffer, const VkPushDescriptorSetInfo* pInfo) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    if (tracking(cb)) untrack(cb);
+    cb->md->next_vkCmdPushDescriptorSet2(commandBuffer, pInfo);
+}
+
+static void rp_vkCmdPushConstants(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* h = take(&p, 4 * sizeof(uint32_t)); const VkPipelineLayout* layout = take(&p, sizeof(*layout));
+    md->next_vkCmdPushConstants(cmd, *layout, h[0], h[1], h[2], p);
+}
+static int log_push(mr_cb_t* cb, VkPipelineLayout layout, VkShaderStageFlags stages, uint32_t offset, uint32_t size, const void* values) {
+    uint64_t key = MR_KEY(MR_SLOT_PUSH, mix(mix(mix(mix(0, XENO_HANDLE_KEY(layout)), stages), offset), size));
+    uint32_t h[4] = { stages, offset, size, 0 };
+    return MR_STATE(cb, stages_kind(stages), rp_vkCmdPushConstants, &key, 1, PART(h, sizeof(h)), PART(&layout, sizeof(layout)), PART(values, size));
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdPushConstants(VkCommandBuffer commandBuffer, VkPipelineLayout layout, VkShaderStageFlags stageFlags, uint32_t offset, uint32_t size, const void* pValues) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    if (!log_push(cb, layout, stageFlags, offset, size, pValues)) cb->md->next_vkCmdPushConstants(commandBuffer, layout, stageFlags, offset, size, pValues);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdPushConstants2(VkCommandBuffer commandBuffer, const VkPushConstantsInfo* pInfo) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    if (tracking(cb) && pInfo->pNext) untrack(cb);
+    if (!log_push(cb, pInfo->layout, pInfo->stageFlags, pInfo->offset, pInfo->size, pInfo->pValues)) cb->md->next_vkCmdPushConstants2(commandBuffer, pInfo);
+}
+
+static void rp_vkCmdBindVertexBuffers(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* h = take(&p, 2 * sizeof(uint32_t)); const VkBuffer* buffers = take(&p, h[1] * sizeof(VkBuffer));
+    md->next_vkCmdBindVertexBuffers(cmd, h[0], h[1], buffers, take(&p, h[1] * sizeof(VkDeviceSize)));
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdBindVertexBuffers(VkCommandBuffer commandBuffer, uint32_t firstBinding, uint32_t bindingCount, const VkBuffer* pBuffers, const VkDeviceSize* pOffsets) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t keys[MR_MAX_KEYS];
+    for (uint32_t i = 0; i < bindingCount && i < MR_MAX_KEYS; ++i) keys[i] = MR_KEY(MR_SLOT_VERTEX, firstBinding + i);
+    uint32_t h[2] = { firstBinding, bindingCount };
+    if (!MR_STATE(cb, MR_REC_STATE, rp_vkCmdBindVertexBuffers, keys, bindingCount, PART(h, sizeof(h)), PART(pBuffers, bindingCount * sizeof(*pBuffers)),
+                  PART(pOffsets, bindingCount * sizeof(*pOffsets))))
+        cb->md->next_vkCmdBindVertexBuffers(commandBuffer, firstBinding, bindingCount, pBuffers, pOffsets);
+}
+static void rp_vkCmdBindVertexBuffers2(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* h = take(&p, 4 * sizeof(uint32_t)); const VkBuffer* buffers = take(&p, h[1] * sizeof(VkBuffer));
+    const VkDeviceSize* offsets = take(&p, h[1] * sizeof(VkDeviceSize));
+    const VkDeviceSize* sizes = h[2] ? take(&p, h[1] * sizeof(VkDeviceSize)) : NULL;
+    md->next_vkCmdBindVertexBuffers2(cmd, h[0], h[1], buffers, offsets, sizes, h[3] ? take(&p, h[1] * sizeof(VkDeviceSize)) : NULL);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdBindVertexBuffers2(VkCommandBuffer commandBuffer, uint32_t firstBinding, uint32_t bindingCount, const VkBuffer* pBuffers,
+                                                            const VkDeviceSize* pOffsets, const VkDeviceSize* pSizes, const VkDeviceSize* pStrides) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t keys[MR_MAX_KEYS];
+    uint32_t nkeys = 0;
+    for (uint32_t i = 0; i < bindingCount && nkeys + 2 <= MR_MAX_KEYS; ++i) {
+        keys[nkeys++] = MR_KEY(MR_SLOT_VERTEX, firstBinding + i);
+        if (pStrides) keys[nkeys++] = MR_KEY(MR_SLOT_STRIDE, firstBinding + i);
+    }
+    if (nkeys < bindingCount * (pStrides ? 2u : 1u)) nkeys = MR_MAX_KEYS + 1;   /* too many for the log */
+    size_t n = bindingCount * sizeof(VkDeviceSize);
+    uint32_t h[4] = { firstBinding, bindingCount, pSizes != NULL, pStrides != NULL };
+    if (!MR_STATE(cb, MR_REC_STATE, rp_vkCmdBindVertexBuffers2, keys, nkeys, PART(h, sizeof(h)), PART(pBuffers, bindingCount * sizeof(*pBuffers)),
+                  PART(pOffsets, n), PART(pSizes, pSizes ? n : 0), PART(pStrides, pStrides ? n : 0)))
+        cb->md->next_vkCmdBindVertexBuffers2(commandBuffer, firstBinding, bindingCount, pBuffers, pOffsets, pSizes, pStrides);
+}
+static void rp_vkCmdBindIndexBuffer(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const VkBuffer* buffer = take(&p, sizeof(VkBuffer)); const VkDeviceSize* offset = take(&p, sizeof(VkDeviceSize));
+    md->next_vkCmdBindIndexBuffer(cmd, *buffer, *offset, *(const VkIndexType*)take(&p, sizeof(uint32_t)));
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdBindIndexBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t key = MR_KEY(MR_SLOT_INDEX, 0);
+    if (!MR_STATE(cb, MR_REC_STATE, rp_vkCmdBindIndexBuffer, &key, 1, PART(&buffer, sizeof(buffer)), PART(&offset, sizeof(offset)), PART(&indexType, sizeof(uint32_t))))
+        cb->md->next_vkCmdBindIndexBuffer(commandBuffer, buffer, offset, indexType);
+}
+static void rp_vkCmdBindIndexBuffer2(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const VkBuffer* buffer = take(&p, sizeof(VkBuffer)); const VkDeviceSize* v = take(&p, 2 * sizeof(VkDeviceSize));
+    md->next_vkCmdBindIndexBuffer2(cmd, *buffer, v[0], v[1], *(const VkIndexType*)take(&p, sizeof(uint32_t)));
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdBindIndexBuffer2(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkIndexType indexType) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t key = MR_KEY(MR_SLOT_INDEX, 0);
+    VkDeviceSize v[2] = { offset, size };
+    if (!MR_STATE(cb, MR_REC_STATE, rp_vkCmdBindIndexBuffer2, &key, 1, PART(&buffer, sizeof(buffer)), PART(v, sizeof(v)), PART(&indexType, sizeof(uint32_t))))
+        cb->md->next_vkCmdBindIndexBuffer2(commandBuffer, buffer, offset, size, indexType);
+}
+
+/* --- dynamic state setters: keyed per state, and per element or face where a call sets a part of it --- */
+static uint32_t range_keys(uint64_t* keys, int state, uint32_t first, uint32_t count) {
+    if (count > MR_MAX_KEYS) return MR_MAX_KEYS + 1;   /* too many for the log */
+    for (uint32_t i = 0; i < count; ++i) keys[i] = MR_DYN_KEY(state, first + i);
+    return count;
+}
+static uint32_t face_keys(uint64_t* keys, int state, VkStencilFaceFlags faceMask) {
+    uint32_t n = 0;
+    if (faceMask & VK_STENCIL_FACE_FRONT_BIT) keys[n++] = MR_DYN_KEY(state, 1);
+    if (faceMask & VK_STENCIL_FACE_BACK_BIT) keys[n++] = MR_DYN_KEY(state, 2);
+    return n;
+}
+
+#define MR_RANGE(fn, name, type) \
+    static void rp_##fn(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) { \
+        const uint32_t* h = take(&p, 2 * sizeof(uint32_t)); md->next_##fn(cmd, h[0], h[1], (const type*)p); } \
+    static VKAPI_ATTR void VKAPI_CALL mr_##fn(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count, const type* pValues) { \
+        mr_cb_t* cb = mr_cb(commandBuffer); uint64_t keys[MR_MAX_KEYS]; uint32_t h[2] = { first, count }; \
+        if (!MR_STATE(cb, MR_REC_STATE, rp_##fn, keys, range_keys(keys, XENO_DYN_##name, first, count), PART(h, sizeof(h)), PART(pValues, count * sizeof(type)))) \
+            cb->md->next_##fn(commandBuffer, first, count, pValues); }
+MR_RANGE(vkCmdSetViewport, VIEWPORT, VkViewport)
+MR_RANGE(vkCmdSetScissor, SCISSOR, VkRect2D)
+MR_RANGE(vkCmdSetColorBlendEnableEXT, COLOR_BLEND_ENABLE, VkBool32)
+MR_RANGE(vkCmdSetColorBlendEquationEXT, COLOR_BLEND_EQUATION, VkColorBlendEquationEXT)
+MR_RANGE(vkCmdSetColorWriteMaskEXT, COLOR_WRITE_MASK, VkColorComponentFlags)
+#undef MR_RANGE
+/* the count, and every element below it */
+#define MR_WITH_COUNT(fn, name, element, type) \
+    static void rp_##fn(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) { \
+        const uint32_t* n = take(&p, sizeof(uint32_t)); md->next_##fn(cmd, *n, (const type*)p); } \
+    static VKAPI_ATTR void VKAPI_CALL mr_##fn(VkCommandBuffer commandBuffer, uint32_t count, const type* pValues) { \
+        mr_cb_t* cb = mr_cb(commandBuffer); uint64_t keys[MR_MAX_KEYS + 1]; \
+        uint32_t nkeys = range_keys(keys + 1, XENO_DYN_##element, 0, count) + 1; keys[0] = MR_DYN_KEY(XENO_DYN_##name, 0); \
+        if (!MR_STATE(cb, MR_REC_STATE, rp_##fn, keys, nkeys, PART(&count, sizeof(count)), PART(pValues, count * sizeof(type)))) \
+            cb->md->next_##fn(commandBuffer, count, pValues); }
+MR_WITH_COUNT(vkCmdSetViewportWithCount, VIEWPORT_WITH_COUNT, VIEWPORT, VkViewport)
+MR_WITH_COUNT(vkCmdSetScissorWithCount, SCISSOR_WITH_COUNT, SCISSOR, VkRect2D)
+#undef MR_WITH_COUNT
+
+static void rp_vkCmdSetDepthBias(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const float* v = (const float*)p; md->next_vkCmdSetDepthBias(cmd, v[0], v[1], v[2]);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdSetDepthBias(VkCommandBuffer commandBuffer, float c, float clamp, float slope) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t key = MR_DYN_KEY(XENO_DYN_DEPTH_BIAS, 0);
+    float v[3] = { c, clamp, slope };
+    if (!MR_STATE(cb, MR_REC_STATE, rp_vkCmdSetDepthBias, &key, 1, PART(v, sizeof(v)))) cb->md->next_vkCmdSetDepthBias(commandBuffer, c, clamp, slope);
+}
+/* logged as vkCmdSetDepthBias when nothing is chained */
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdSetDepthBias2EXT(VkCommandBuffer commandBuffer, const VkDepthBiasInfoEXT* pDepthBiasInfo) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t key = MR_DYN_KEY(XENO_DYN_DEPTH_BIAS, 0);
+    float v[3] = { pDepthBiasInfo->depthBiasConstantFactor, pDepthBiasInfo->depthBiasClamp, pDepthBiasInfo->depthBiasSlopeFactor };
+    if (tracking(cb) && pDepthBiasInfo->pNext) untrack(cb);
+    if (!MR_STATE(cb, MR_REC_STATE, rp_vkCmdSetDepthBias, &key, 1, PART(v, sizeof(v)))) cb->md->next_vkCmdSetDepthBias2EXT(commandBuffer, pDepthBiasInfo);
+}
+static void rp_vkCmdSetBlendConstants(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    md->next_vkCmdSetBlendConstants(cmd, (const float*)p);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdSetBlendConstants(VkCommandBuffer commandBuffer, const float blendConstants[4]) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t key = MR_DYN_KEY(XENO_DYN_BLEND_CONSTANTS, 0);
+    if (!MR_STATE(cb, MR_REC_STATE, rp_vkCmdSetBlendConstants, &key, 1, PART(blendConstants, 4 * sizeof(float)))) cb->md->next_vkCmdSetBlendConstants(commandBuffer, blendConstants);
+}
+static void rp_vkCmdSetDepthBounds(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const float* v = (const float*)p; md->next_vkCmdSetDepthBounds(cmd, v[0], v[1]);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdSetDepthBounds(VkCommandBuffer commandBuffer, float minDepthBounds, float maxDepthBounds) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t key = MR_DYN_KEY(XENO_DYN_DEPTH_BOUNDS, 0);
+    float v[2] = { minDepthBounds, maxDepthBounds };
+    if (!MR_STATE(cb, MR_REC_STATE, rp_vkCmdSetDepthBounds, &key, 1, PART(v, sizeof(v)))) cb->md->next_vkCmdSetDepthBounds(commandBuffer, minDepthBounds, maxDepthBounds);
+}
+#define MR_STENCIL(fn, name) \
+    static void rp_##fn(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) { \
+        const uint32_t* v = (const uint32_t*)p; md->next_##fn(cmd, v[0], v[1]); } \
+    static VKAPI_ATTR void VKAPI_CALL mr_##fn(VkCommandBuffer commandBuffer, VkStencilFaceFlags faceMask, uint32_t value) { \
+        mr_cb_t* cb = mr_cb(commandBuffer); uint64_t keys[2]; uint32_t v[2] = { faceMask, value }; \
+        if (!MR_STATE(cb, MR_REC_STATE, rp_##fn, keys, face_keys(keys, XENO_DYN_##name, faceMask), PART(v, sizeof(v)))) cb->md->next_##fn(commandBuffer, faceMask, value); }
+MR_STENCIL(vkCmdSetStencilCompareMask, STENCIL_COMPARE_MASK)
+MR_STENCIL(vkCmdSetStencilWriteMask, STENCIL_WRITE_MASK)
+MR_STENCIL(vkCmdSetStencilReference, STENCIL_REFERENCE)
+#undef MR_STENCIL
+static void rp_vkCmdSetStencilOp(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* v = (const uint32_t*)p;
+    md->next_vkCmdSetStencilOp(cmd, v[0], (VkStencilOp)v[1], (VkStencilOp)v[2], (VkStencilOp)v[3], (VkCompareOp)v[4]);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdSetStencilOp(VkCommandBuffer commandBuffer, VkStencilFaceFlags faceMask, VkStencilOp failOp, VkStencilOp passOp, VkStencilOp depthFailOp, VkCompareOp compareOp) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t keys[2];
+    uint32_t v[5] = { faceMask, failOp, passOp, depthFailOp, compareOp };
+    if (!MR_STATE(cb, MR_REC_STATE, rp_vkCmdSetStencilOp, keys, face_keys(keys, XENO_DYN_STENCIL_OP, faceMask), PART(v, sizeof(v))))
+        cb->md->next_vkCmdSetStencilOp(commandBuffer, faceMask, failOp, passOp, depthFailOp, compareOp);
+}
+#define MR_SCALAR(fn, state, type) \
+    static void rp_##fn(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) { md->next_##fn(cmd, *(const type*)p); } \
+    static VKAPI_ATTR void VKAPI_CALL mr_##fn(VkCommandBuffer commandBuffer, type value) { \
+        mr_cb_t* cb = mr_cb(commandBuffer); uint64_t key = MR_DYN_KEY(state, 0); \
+        if (!MR_STATE(cb, MR_REC_STATE, rp_##fn, &key, 1, PART(&value, sizeof(value)))) cb->md->next_##fn(commandBuffer, value); }
+MR_SCALAR(vkCmdSetLineWidth, XENO_DYN_LINE_WIDTH, float)
+MR_SCALAR(vkCmdSetCullMode, XENO_DYN_CULL_MODE, VkCullModeFlags)
+MR_SCALAR(vkCmdSetFrontFace, XENO_DYN_FRONT_FACE, VkFrontFace)
+MR_SCALAR(vkCmdSetPrimitiveTopology, XENO_DYN_PRIMITIVE_TOPOLOGY, VkPrimitiveTopology)
+MR_SCALAR(vkCmdSetDepthTestEnable, XENO_DYN_DEPTH_TEST_ENABLE, VkBool32)
+MR_SCALAR(vkCmdSetDepthWriteEnable, XENO_DYN_DEPTH_WRITE_ENABLE, VkBool32)
+MR_SCALAR(vkCmdSetDepthCompareOp, XENO_DYN_DEPTH_COMPARE_OP, VkCompareOp)
+MR_SCALAR(vkCmdSetDepthBoundsTestEnable, XENO_DYN_DEPTH_BOUNDS_TEST_ENABLE, VkBool32)
+MR_SCALAR(vkCmdSetStencilTestEnable, XENO_DYN_STENCIL_TEST_ENABLE, VkBool32)
+MR_SCALAR(vkCmdSetRasterizerDiscardEnable, XENO_DYN_RASTERIZER_DISCARD_ENABLE, VkBool32)
+MR_SCALAR(vkCmdSetDepthBiasEnable, XENO_DYN_DEPTH_BIAS_ENABLE, VkBool32)
+MR_SCALAR(vkCmdSetPrimitiveRestartEnable, XENO_DYN_PRIMITIVE_RESTART_ENABLE, VkBool32)
+MR_SCALAR(vkCmdSetPatchControlPointsEXT, XENO_DYN_PATCH_CONTROL_POINTS, uint32_t)
+MR_SCALAR(vkCmdSetLogicOpEXT, XENO_DYN_LOGIC_OP, VkLogicOp)
+MR_SCALAR(vkCmdSetDepthClampEnableEXT, XENO_DYN_DEPTH_CLAMP_ENABLE, VkBool32)
+MR_SCALAR(vkCmdSetPolygonModeEXT, XENO_DYN_POLYGON_MODE, VkPolygonMode)
+MR_SCALAR(vkCmdSetRasterizationSamplesEXT, XENO_DYN_RASTERIZATION_SAMPLES, VkSampleCountFlagBits)
+MR_SCALAR(vkCmdSetAlphaToCoverageEnableEXT, XENO_DYN_ALPHA_TO_COVERAGE_ENABLE, VkBool32)
+MR_SCALAR(vkCmdSetAlphaToOneEnableEXT, XENO_DYN_ALPHA_TO_ONE_ENABLE, VkBool32)
+MR_SCALAR(vkCmdSetLogicOpEnableEXT, XENO_DYN_LOGIC_OP_ENABLE, VkBool32)
+#define MR_EXTRA_SCALAR(fn, type) MR_SCALAR(fn, MR_DYN_##fn, type)
+MR_SCALARS(MR_EXTRA_SCALAR)
+#undef MR_EXTRA_SCALAR
+#undef MR_SCALAR
+static void rp_vkCmdSetSampleMaskEXT(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* h = take(&p, 2 * sizeof(uint32_t));
+    md->next_vkCmdSetSampleMaskEXT(cmd, (VkSampleCountFlagBits)h[0], h[1] ? (const VkSampleMask*)p : NULL);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdSetSampleMaskEXT(VkCommandBuffer commandBuffer, VkSampleCountFlagBits samples, const VkSampleMask* pSampleMask) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t key = MR_DYN_KEY(XENO_DYN_SAMPLE_MASK, 0);
+    uint32_t h[2] = { samples, pSampleMask != NULL };
+    if (!MR_STATE(cb, MR_REC_STATE, rp_vkCmdSetSampleMaskEXT, &key, 1, PART(h, sizeof(h)), PART(pSampleMask, pSampleMask ? ((uint32_t)samples + 31) / 32 * sizeof(VkSampleMask) : 0)))
+        cb->md->next_vkCmdSetSampleMaskEXT(commandBuffer, samples, pSampleMask);
+}
+/* normalized as the state filter compares it: the descriptions carry pNext pointers */
+static void rp_vkCmdSetVertexInputEXT(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* h = take(&p, 2 * sizeof(uint32_t));
+    const xeno_vertex_binding_t* b = take(&p, h[0] * sizeof(*b)); const xeno_vertex_attribute_t* a = take(&p, h[1] * sizeof(*a));
+    VkVertexInputBindingDescription2EXT bindings[XENO_MAX_VERTEX_BINDINGS]; VkVertexInputAttributeDescription2EXT attributes[XENO_MAX_VERTEX_ATTRIBUTES];
+    for (uint32_t i = 0; i < h[0]; ++i) {
+        VkVertexInputBindingDescription2EXT v = { VK_STRUCTURE_TYPE_VERTEX_INPUT_BINDING_DESCRIPTION_2_EXT, NULL, b[i].binding, b[i].stride, (VkVertexInputRate)b[i].rate, b[i].divisor };
+        bindings[i] = v;
+    }
+    for (uint32_t i = 0; i < h[1]; ++i) {
+        VkVertexInputAttributeDescription2EXT v = { VK_STRUCTURE_TYPE_VERTEX_INPUT_ATTRIBUTE_DESCRIPTION_2_EXT, NULL, a[i].location, a[i].binding, (VkFormat)a[i].format, a[i].offset };
+        attributes[i] = v;
+    }
+    md->next_vkCmdSetVertexInputEXT(cmd, h[0], bindings, h[1], attributes);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdSetVertexInputEXT(VkCommandBuffer commandBuffer, uint32_t bindingCount, const VkVertexInputBindingDescription2EXT* pBindings,
+                                                           uint32_t attributeCount, const VkVertexInputAttributeDescription2EXT* pAttributes) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    xeno_vertex_binding_t b[XENO_MAX_VERTEX_BINDINGS]; xeno_vertex_attribute_t a[XENO_MAX_VERTEX_ATTRIBUTES];
+    uint64_t keys[1 + XENO_MAX_VERTEX_BINDINGS];
+    int packed = bindingCount <= XENO_MAX_VERTEX_BINDINGS && attributeCount <= XENO_MAX_VERTEX_ATTRIBUTES;
+    keys[0] = MR_DYN_KEY(XENO_DYN_VERTEX_INPUT, 0);
+    /* the strides replace those of vkCmdBindVertexBuffers2 */
+    for (uint32_t i = 0; packed && i < bindingCount; ++i) {
+        xeno_vertex_binding_t v = { pBindings[i].binding, pBindings[i].stride, pBindings[i].inputRate, pBindings[i].divisor };
+        b[i] = v; keys[1 + i] = MR_KEY(MR_SLOT_STRIDE, v.binding); packed = !pBindings[i].pNext;
+    }
+    for (uint32_t i = 0; packed && i < attributeCount; ++i) {
+        xeno_vertex_attribute_t v = { pAttributes[i].location, pAttributes[i].binding, pAttributes[i].format, pAttributes[i].offset };
+        a[i] = v; packed = !pAttributes[i].pNext;
+    }
+    uint32_t h[2] = { bindingCount, attributeCount };
+    if (tracking(cb) && !packed) untrack(cb);
+    else if (MR_STATE(cb, MR_REC_STATE, rp_vkCmdSetVertexInputEXT, keys, 1 + bindingCount, PART(h, sizeof(h)), PART(b, bindingCount * sizeof(*b)),
+                      PART(a, attributeCount * sizeof(*a)))) return;
+    cb->md->next_vkCmdSetVertexInputEXT(commandBuffer, bindingCount, pBindings, attributeCount, pAttributes);
+}
+static void rp_vkCmdSetLineStipple(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* v = (const uint32_t*)p; md->next_vkCmdSetLineStipple(cmd, v[0], (uint16_t)v[1]);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdSetLineStipple(VkCommandBuffer commandBuffer, uint32_t lineStippleFactor, uint16_t lineStipplePattern) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t key = MR_DYN_KEY(MR_DYN_LINE_STIPPLE, 0);
+    uint32_t v[2] = { lineStippleFactor, lineStipplePattern };
+    if (!MR_STATE(cb, MR_REC_STATE, rp_vkCmdSetLineStipple, &key, 1, PART(v, sizeof(v)))) cb->md->next_vkCmdSetLineStipple(commandBuffer, lineStippleFactor, lineStipplePattern);
+}
+static void rp_vkCmdSetFragmentShadingRateKHR(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const VkExtent2D* size = take(&p, sizeof(VkExtent2D));
+    md->next_vkCmdSetFragmentShadingRateKHR(cmd, size, (const VkFragmentShadingRateCombinerOpKHR*)p);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdSetFragmentShadingRateKHR(VkCommandBuffer commandBuffer, const VkExtent2D* pFragmentSize, const VkFragmentShadingRateCombinerOpKHR combinerOps[2]) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t key = MR_DYN_KEY(MR_DYN_FRAGMENT_SHADING_RATE, 0);
+    if (!MR_STATE(cb, MR_REC_STATE, rp_vkCmdSetFragmentShadingRateKHR, &key, 1, PART(pFragmentSize, sizeof(*pFragmentSize)), PART(combinerOps, 2 * sizeof(combinerOps[0]))))
+        cb->md->next_vkCmdSetFragmentShadingRateKHR(commandBuffer, pFragmentSize, combinerOps);
+}
+static void rp_vkCmdSetColorWriteEnableEXT(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* n = take(&p, sizeof(uint32_t)); md->next_vkCmdSetColorWriteEnableEXT(cmd, *n, (const VkBool32*)p);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdSetColorWriteEnableEXT(VkCommandBuffer commandBuffer, uint32_t attachmentCount, const VkBool32* pColorWriteEnables) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint64_t keys[MR_MAX_KEYS];
+    if (!MR_STATE(cb, MR_REC_STATE, rp_vkCmdSetColorWriteEnableEXT, keys, range_keys(keys, MR_DYN_COLOR_WRITE_ENABLE, 0, attachmentCount),
+                  PART(&attachmentCount, sizeof(attachmentCount)), PART(pColorWriteEnables, attachmentCount * sizeof(VkBool32))))
+        cb->md->next_vkCmdSetColorWriteEnableEXT(commandBuffer, attachmentCount, pColorWriteEnables);
+}
+
+/* --- draws --- */
+static void rp_vkCmdDraw(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* v = (const uint32_t*)p; md->next_vkCmdDraw(cmd, v[0], v[1], v[2], v[3]);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdDraw(VkCommandBuffer commandBuffer, uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint32_t v[4] = { vertexCount, instanceCount, firstVertex, firstInstance };
+    if (!MR_WORK(cb, MR_REC_DRAW, rp_vkCmdDraw, PART(v, sizeof(v)))) cb->md->next_vkCmdDraw(commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
+}
+static void rp_vkCmdDrawIndexed(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* v = (const uint32_t*)p; md->next_vkCmdDrawIndexed(cmd, v[0], v[1], v[2], (int32_t)v[3], v[4]);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdDrawIndexed(VkCommandBuffer commandBuffer, uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint32_t v[5] = { indexCount, instanceCount, firstIndex, (uint32_t)vertexOffset, firstInstance };
+    if (!MR_WORK(cb, MR_REC_DRAW, rp_vkCmdDrawIndexed, PART(v, sizeof(v))))
+        cb->md->next_vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+}
+#define MR_INDIRECT(fn) \
+    static void rp_##fn(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) { \
+        const VkBuffer* buffer = take(&p, sizeof(VkBuffer)); const VkDeviceSize* offset = take(&p, sizeof(VkDeviceSize)); \
+        const uint32_t* v = (const uint32_t*)p; md->next_##fn(cmd, *buffer, *offset, v[0], v[1]); } \
+    static VKAPI_ATTR void VKAPI_CALL mr_##fn(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride) { \
+        mr_cb_t* cb = mr_cb(commandBuffer); uint32_t v[2] = { drawCount, stride }; \
+        if (!MR_WORK(cb, MR_REC_DRAW, rp_##fn, PART(&buffer, sizeof(buffer)), PART(&offset, sizeof(offset)), PART(v, sizeof(v)))) \
+            cb->md->next_##fn(commandBuffer, buffer, offset, drawCount, stride); }
+MR_INDIRECT(vkCmdDrawIndirect)
+MR_INDIRECT(vkCmdDrawIndexedIndirect)
+MR_INDIRECT(vkCmdDrawMeshTasksIndirectEXT)
+#undef MR_INDIRECT
+#define MR_INDIRECT_COUNT(fn) \
+    static void rp_##fn(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) { \
+        const VkBuffer* buffer = take(&p, sizeof(VkBuffer)); const VkDeviceSize* offset = take(&p, sizeof(VkDeviceSize)); \
+        const VkBuffer* count = take(&p, sizeof(VkBuffer)); const VkDeviceSize* count_offset = take(&p, sizeof(VkDeviceSize)); \
+        const uint32_t* v = (const uint32_t*)p; md->next_##fn(cmd, *buffer, *offset, *count, *count_offset, v[0], v[1]); } \
+    static VKAPI_ATTR void VKAPI_CALL mr_##fn(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, \
+                                             uint32_t maxDrawCount, uint32_t stride) { \
+        mr_cb_t* cb = mr_cb(commandBuffer); uint32_t v[2] = { maxDrawCount, stride }; \
+        if (!MR_WORK(cb, MR_REC_DRAW, rp_##fn, PART(&buffer, sizeof(buffer)), PART(&offset, sizeof(offset)), PART(&countBuffer, sizeof(countBuffer)), \
+                     PART(&countBufferOffset, sizeof(countBufferOffset)), PART(v, sizeof(v)))) \
+            cb->md->next_##fn(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride); }
+MR_INDIRECT_COUNT(vkCmdDrawIndirectCount)
+MR_INDIRECT_COUNT(vkCmdDrawIndexedIndirectCount)
+MR_INDIRECT_COUNT(vkCmdDrawMeshTasksIndirectCountEXT)
+#undef MR_INDIRECT_COUNT
+static void rp_vkCmdDrawMeshTasksEXT(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* v = (const uint32_t*)p; md->next_vkCmdDrawMeshTasksEXT(cmd, v[0], v[1], v[2]);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdDrawMeshTasksEXT(VkCommandBuffer commandBuffer, uint32_t x, uint32_t y, uint32_t z) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint32_t v[3] = { x, y, z };
+    if (!MR_WORK(cb, MR_REC_DRAW, rp_vkCmdDrawMeshTasksEXT, PART(v, sizeof(v)))) cb->md->next_vkCmdDrawMeshTasksEXT(commandBuffer, x, y, z);
+}
+static void rp_vkCmdClearAttachments(const xeno_mtrecord_device_t* md, VkCommandBuffer cmd, const unsigned char* p) {
+    const uint32_t* h = take(&p, 2 * sizeof(uint32_t)); const VkClearAttachment* attachments = take(&p, h[0] * sizeof(VkClearAttachment));
+    md->next_vkCmdClearAttachments(cmd, h[0], attachments, h[1], (const VkClearRect*)p);
+}
+/* a clear stays in the chunk of the draws around it but does not count as one */
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdClearAttachments(VkCommandBuffer commandBuffer, uint32_t attachmentCount, const VkClearAttachment* pAttachments,
+                                                          uint32_t rectCount, const VkClearRect* pRects) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    uint32_t h[2] = { attachmentCount, rectCount };
+    if (!MR_WORK(cb, MR_REC_WORK, rp_vkCmdClearAttachments, PART(h, sizeof(h)), PART(pAttachments, attachmentCount * sizeof(*pAttachments)),
+                 PART(pRects, rectCount * sizeof(*pRects))))
+        cb->md->next_vkCmdClearAttachments(commandBuffer, attachmentCount, pAttachments, rectCount, pRects);
+}
+
+/* --- commands that keep a capture inline --- */
+static mr_cb_t* force_inline(VkCommandBuffer commandBuffer) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    if (cb->mode == MR_CAPTURE) { cb->n[MR_INLINE_FORCED]++; emit_inline(cb, 0); }
+    return cb;
+}
+#define MR_INLINE(fn, params, args) \
+    static VKAPI_ATTR void VKAPI_CALL mr_##fn params { force_inline(commandBuffer)->md->next_##fn args; }
+MR_INLINE(vkCmdPipelineBarrier, (VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, VkDependencyFlags dependencyFlags,
+                                 uint32_t memoryBarrierCount, const VkMemoryBarrier* pMemoryBarriers, uint32_t bufferMemoryBarrierCount, const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+                                 uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* pImageMemoryBarriers),
+          (commandBuffer, srcStageMask, dstStageMask, dependencyFlags, memoryBarrierCount, pMemoryBarriers, bufferMemoryBarrierCount, pBufferMemoryBarriers,
+           imageMemoryBarrierCount, pImageMemoryBarriers))
+MR_INLINE(vkCmdPipelineBarrier2, (VkCommandBuffer commandBuffer, const VkDependencyInfo* pDependencyInfo), (commandBuffer, pDependencyInfo))
+MR_INLINE(vkCmdWaitEvents, (VkCommandBuffer commandBuffer, uint32_t eventCount, const VkEvent* pEvents, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask,
+                            uint32_t memoryBarrierCount, const VkMemoryBarrier* pMemoryBarriers, uint32_t bufferMemoryBarrierCount, const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+                            uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* pImageMemoryBarriers),
+          (commandBuffer, eventCount, pEvents, srcStageMask, dstStageMask, memoryBarrierCount, pMemoryBarriers, bufferMemoryBarrierCount, pBufferMemoryBarriers,
+           imageMemoryBarrierCount, pImageMemoryBarriers))
+MR_INLINE(vkCmdWaitEvents2, (VkCommandBuffer commandBuffer, uint32_t eventCount, const VkEvent* pEvents, const VkDependencyInfo* pDependencyInfos),
+          (commandBuffer, eventCount, pEvents, pDependencyInfos))
+MR_INLINE(vkCmdWriteTimestamp, (VkCommandBuffer commandBuffer, VkPipelineStageFlagBits pipelineStage, VkQueryPool queryPool, uint32_t query),
+          (commandBuffer, pipelineStage, queryPool, query))
+MR_INLINE(vkCmdWriteTimestamp2, (VkCommandBuffer commandBuffer, VkPipelineStageFlags2 stage, VkQueryPool queryPool, uint32_t query), (commandBuffer, stage, queryPool, query))
+MR_INLINE(vkCmdWriteBufferMarkerAMD, (VkCommandBuffer commandBuffer, VkPipelineStageFlagBits pipelineStage, VkBuffer dstBuffer, VkDeviceSize dstOffset, uint32_t marker),
+          (commandBuffer, pipelineStage, dstBuffer, dstOffset, marker))
+MR_INLINE(vkCmdWriteBufferMarker2AMD, (VkCommandBuffer commandBuffer, VkPipelineStageFlags2 stage, VkBuffer dstBuffer, VkDeviceSize dstOffset, uint32_t marker),
+          (commandBuffer, stage, dstBuffer, dstOffset, marker))
+MR_INLINE(vkCmdBeginDebugUtilsLabelEXT, (VkCommandBuffer commandBuffer, const VkDebugUtilsLabelEXT* pLabelInfo), (commandBuffer, pLabelInfo))
+MR_INLINE(vkCmdEndDebugUtilsLabelEXT, (VkCommandBuffer commandBuffer), (commandBuffer))
+MR_INLINE(vkCmdInsertDebugUtilsLabelEXT, (VkCommandBuffer commandBuffer, const VkDebugUtilsLabelEXT* pLabelInfo), (commandBuffer, pLabelInfo))
+MR_INLINE(vkCmdDebugMarkerBeginEXT, (VkCommandBuffer commandBuffer, const VkDebugMarkerMarkerInfoEXT* pMarkerInfo), (commandBuffer, pMarkerInfo))
+MR_INLINE(vkCmdDebugMarkerEndEXT, (VkCommandBuffer commandBuffer), (commandBuffer))
+MR_INLINE(vkCmdDebugMarkerInsertEXT, (VkCommandBuffer commandBuffer, const VkDebugMarkerMarkerInfoEXT* pMarkerInfo), (commandBuffer, pMarkerInfo))
+MR_INLINE(vkCmdSetDeviceMask, (VkCommandBuffer commandBuffer, uint32_t deviceMask), (commandBuffer, deviceMask))
+#undef MR_INLINE
+
+/* a query or conditional rendering active when a capture ends keeps it inline: secondaries would have to inherit it */
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdBeginQuery(VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t query, VkQueryControlFlags flags) {
+    mr_cb_t* cb = force_inline(commandBuffer);
+    cb->queries++;
+    cb->md->next_vkCmdBeginQuery(commandBuffer, queryPool, query, flags);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdEndQuery(VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t query) {
+    mr_cb_t* cb = force_inline(commandBuffer);
+    if (cb->queries) cb->queries--;
+    cb->md->next_vkCmdEndQuery(commandBuffer, queryPool, query);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdBeginQueryIndexedEXT(VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t query, VkQueryControlFlags flags, uint32_t index) {
+    mr_cb_t* cb = force_inline(commandBuffer);
+    cb->queries++;
+    cb->md->next_vkCmdBeginQueryIndexedEXT(commandBuffer, queryPool, query, flags, index);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdEndQueryIndexedEXT(VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t query, uint32_t index) {
+    mr_cb_t* cb = force_inline(commandBuffer);
+    if (cb->queries) cb->queries--;
+    cb->md->next_vkCmdEndQueryIndexedEXT(commandBuffer, queryPool, query, index);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdBeginConditionalRenderingEXT(VkCommandBuffer commandBuffer, const VkConditionalRenderingBeginInfoEXT* pConditionalRenderingBegin) {
+    mr_cb_t* cb = force_inline(commandBuffer);
+    cb->conditional = 1;
+    cb->md->next_vkCmdBeginConditionalRenderingEXT(commandBuffer, pConditionalRenderingBegin);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdEndConditionalRenderingEXT(VkCommandBuffer commandBuffer) {
+    mr_cb_t* cb = force_inline(commandBuffer);
+    cb->conditional = 0;
+    cb->md->next_vkCmdEndConditionalRenderingEXT(commandBuffer);
+}
+/* the app's secondaries leave the state undefined: nothing recorded before them is replayed */
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdExecuteCommands(VkCommandBuffer commandBuffer, uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers) {
+    mr_cb_t* cb = force_inline(commandBuffer);
+    slots_clear(cb);
+    cb->len = 0; cb->lost = 0;
+    cb->md->next_vkCmdExecuteCommands(commandBuffer, commandBufferCount, pCommandBuffers);
+}
+
+/* --- render passes --- */
+/* the begin info copied into the command buffer: it is used when the capture goes out */
+static int keep_begin(mr_cb_t* cb, const VkRenderPassBeginInfo* info) {
+    const VkRenderPassAttachmentBeginInfo* views = NULL;
+    if (info->pNext) {
+        views = info->pNext;
+        if (views->sType != VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO || views->pNext) return -1;   /* device groups, sample locations, ... */
+    }
+    if (grow((void**)&cb->clears, &cb->clear_cap, info->clearValueCount, sizeof(VkClearValue)) != 0 ||
+        (views && grow((void**)&cb->views, &cb->view_cap, views->attachmentCount, sizeof(VkImageView)) != 0)) return -1;
+    cb->begin = *info;
+    if (info->clearValueCount) memcpy(cb->clears, info->pClearValues, info->clearValueCount * sizeof(VkClearValue));
+    cb->begin.pClearValues = cb->clears;
+    if (views) {
+        cb->begin_views = *views;
+        if (views->attachmentCount) memcpy(cb->views, views->pAttachments, views->attachmentCount * sizeof(VkImageView));
+        cb->begin_views.pAttachments = cb->views;
+        cb->begin.pNext = &cb->begin_views;
+    }
+    cb->next = 0; cb->subpass = 0;
+    return 0;
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdBeginRenderPass(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo* pRenderPassBegin, VkSubpassContents contents) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    if (tracking(cb) && cb->mode == MR_OUTSIDE && contents == VK_SUBPASS_CONTENTS_INLINE && keep_begin(cb, pRenderPassBegin) == 0) {
+        cb->v2 = 0;
+        start_capture(cb);
+        return;
+    }
+    cb->mode = MR_OTHER;
+    cb->md->next_vkCmdBeginRenderPass(commandBuffer, pRenderPassBegin, contents);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdBeginRenderPass2(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo* pRenderPassBegin, const VkSubpassBeginInfo* pSubpassBeginInfo) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    if (tracking(cb) && cb->mode == MR_OUTSIDE && pSubpassBeginInfo->contents == VK_SUBPASS_CONTENTS_INLINE && !pSubpassBeginInfo->pNext &&
+        keep_begin(cb, pRenderPassBegin) == 0) {
+        cb->v2 = 1;
+        cb->begin_subpass = *pSubpassBeginInfo;
+        start_capture(cb);
+        return;
+    }
+    cb->mode = MR_OTHER;
+    cb->md->next_vkCmdBeginRenderPass2(commandBuffer, pRenderPassBegin, pSubpassBeginInfo);
+}
+
+/* a pass begun here: the next subpass is captured too when it has inline contents */
+static void next_subpass(mr_cb_t* cb, VkSubpassContents contents, const VkSubpassBeginInfo* begin, const VkSubpassEndInfo* end) {
+    xeno_mtrecord_device_t* md = cb->md;
+    int ours = cb->mode == MR_CAPTURE || cb->mode == MR_INLINE;
+    if (cb->mode == MR_CAPTURE) close_segment(cb);
+    if (ours && tracking(cb) && contents == VK_SUBPASS_CONTENTS_INLINE && (!begin || (!begin->pNext && !end->pNext))) {
+        cb->next = 1; cb->next_v2 = begin != NULL;
+        if (end) cb->next_end = *end;
+        cb->subpass++;
+        start_capture(cb);
+        return;
+    }
+    if (ours) cb->subpass++;
+    if (begin) md->next_vkCmdNextSubpass2(cb->handle, begin, end);
+    else md->next_vkCmdNextSubpass(cb->handle, contents);
+    if (cb->lost && contents == VK_SUBPASS_CONTENTS_INLINE) restore(cb);
+    if (!ours) cb->mode = MR_OTHER;
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdNextSubpass(VkCommandBuffer commandBuffer, VkSubpassContents contents) {
+    next_subpass(mr_cb(commandBuffer), contents, NULL, NULL);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdNextSubpass2(VkCommandBuffer commandBuffer, const VkSubpassBeginInfo* pSubpassBeginInfo, const VkSubpassEndInfo* pSubpassEndInfo) {
+    next_subpass(mr_cb(commandBuffer), pSubpassBeginInfo->contents, pSubpassBeginInfo, pSubpassEndInfo);
+}
+/* the state the pass ended with is replayed when secondaries left it undefined */
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdEndRenderPass(VkCommandBuffer commandBuffer) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    if (cb->mode == MR_CAPTURE) close_segment(cb);
+    cb->md->next_vkCmdEndRenderPass(commandBuffer);
+    cb->mode = MR_OUTSIDE;
+    if (cb->lost) restore(cb);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkCmdEndRenderPass2(VkCommandBuffer commandBuffer, const VkSubpassEndInfo* pSubpassEndInfo) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    if (cb->mode == MR_CAPTURE) close_segment(cb);
+    cb->md->next_vkCmdEndRenderPass2(commandBuffer, pSubpassEndInfo);
+    cb->mode = MR_OUTSIDE;
+    if (cb->lost) restore(cb);
+}
+
+/* --- vkCmdRecordParallelXCLIPSE --- */
+typedef void (VKAPI_PTR *PFN_vkRecordItemsXCLIPSE)(void* pUserData, VkCommandBuffer commandBuffer, uint32_t firstItem, uint32_t itemCount);
+
+typedef struct mr_api_job {
+    mr_cb_t* cb;
+    const VkCommandBufferInheritanceInfo* inherit;
+    PFN_vkRecordItemsXCLIPSE record;
+    void* user;
+    uint32_t miss[MR_MAX_CHUNKS];
+    VkResult result[MR_MAX_CHUNKS];
+} mr_api_job_t;
+
+/* one run of the app's items recorded by its callback; on a worker or the calling thread */
+static void api_record_fn(void* ctx, uint32_t i) {
+    mr_api_job_t* job = ctx;
+    uint32_t k = job->miss[i];
+    mr_chunk_t* c = &job->cb->chunks[k];
+    job->result[k] = VK_ERROR_OUT_OF_HOST_MEMORY;
+    mr_sec_t* s = sec_begin(job->cb, job->inherit, 1);
+    if (!s) return;
+    mr_cb_t* sc = mr_cb(s->handle);
+    sc->sec = s;
+    job->record(job->user, s->handle, c->from, c->to - c->from);
+    sc->sec = NULL;
+    c->sec = sec_end(job->cb->md, s, &job->result[k]);
+}
+
+/* what a secondary inherits, hashed; 0 when the chain holds more than the rendering info */
+static uint64_t inherit_hash(const VkCommandBufferInheritanceInfo* in) {
+    uint64_t h = mix(mix(mix(0x6d74726170690000ull, XENO_HANDLE_KEY(in->renderPass)), in->subpass), XENO_HANDLE_KEY(in->framebuffer));
+    h = mix(mix(mix(h, in->occlusionQueryEnable), in->queryFlags), in->pipelineStatistics);
+    const VkCommandBufferInheritanceRenderingInfo* r = in->pNext;
+    if (!r) return h;
+    if (r->sType != VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO || r->pNext) return 0;
+    h = mix(mix(mix(mix(mix(mix(h, r->flags), r->viewMask), r->colorAttachmentCount), r->depthAttachmentFormat), r->stencilAttachmentFormat),
+            r->rasterizationSamples);
+    return r->colorAttachmentCount ? xeno_hash64(r->pColorAttachmentFormats, r->colorAttachmentCount * sizeof(VkFormat), h) : h;
+}
+
+/* the layers above come up after this one: their entrypoints are resolved on first use */
+static int api_resolve(xeno_mtrecord_device_t* md) {
+    pthread_mutex_lock(&md->lock);
+    if (!md->app_vkCmdExecuteCommands) {
+        md->app_vkCreateCommandPool = (PFN_vkCreateCommandPool)xeno_device_app_proc(md->dev, "vkCreateCommandPool");
+        md->app_vkAllocateCommandBuffers = (PFN_vkAllocateCommandBuffers)xeno_device_app_proc(md->dev, "vkAllocateCommandBuffers");
+        md->app_vkBeginCommandBuffer = (PFN_vkBeginCommandBuffer)xeno_device_app_proc(md->dev, "vkBeginCommandBuffer");
+        md->app_vkEndCommandBuffer = (PFN_vkEndCommandBuffer)xeno_device_app_proc(md->dev, "vkEndCommandBuffer");
+        if (md->app_vkCreateCommandPool && md->app_vkAllocateCommandBuffers && md->app_vkBeginCommandBuffer && md->app_vkEndCommandBuffer)
+            md->app_vkCmdExecuteCommands = (PFN_vkCmdExecuteCommands)xeno_device_app_proc(md->dev, "vkCmdExecuteCommands");
+    }
+    int ok = md->app_vkCmdExecuteCommands != NULL;
+    pthread_mutex_unlock(&md->lock);
+    return ok;
+}
+
+/* the items cut into runs recorded into secondaries by the app's callback on the worker pool, then executed in order */
+static VKAPI_ATTR VkResult VKAPI_CALL mr_vkCmdRecordParallelXCLIPSE(VkCommandBuffer commandBuffer, const VkCommandBufferInheritanceInfo* pInheritanceInfo,
+                                                                   uint32_t itemCount, const uint64_t* pItemHashes, PFN_vkRecordItemsXCLIPSE pfnRecord, void* pUserData) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    if (!cb || !cb->tracked || !api_resolve(cb->md)) return VK_ERROR_FEATURE_NOT_PRESENT;
+    xeno_mtrecord_device_t* md = cb->md;
+    uint32_t n = (uint32_t)xeno_workers_count() + 1;
+    if (n > MR_MAX_CHUNKS) n = MR_MAX_CHUNKS;
+    if (n > itemCount) n = itemCount;
+    if (!n) return VK_SUCCESS;
+    if (grow((void**)&cb->held, &cb->held_cap, cb->nheld + n, sizeof(*cb->held)) != 0) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    uint32_t per = (itemCount + n - 1) / n;
+    n = (itemCount + per - 1) / per;
+    uint64_t frame = atomic_load(&md->dev->frames), seed = 0;
+    int reuse = md->reuse && pItemHashes && (seed = inherit_hash(pInheritanceInfo)) != 0;
+    if (reuse) seed = mix(seed, atomic_load_explicit(&md->generation, memory_order_relaxed));
+    memset(cb->chunks, 0, sizeof(cb->chunks));
+    for (uint32_t i = 0; i < n; ++i) {
+        mr_chunk_t* c = &cb->chunks[i];
+        c->from = i * per;
+        c->to = itemCount - c->from > per ? c->from + per : itemCount;
+        if (reuse) c->hash = mix(xeno_hash64(pItemHashes + c->from, (c->to - c->from) * sizeof(uint64_t), seed), cb->family);
+    }
+    mr_api_job_t job = { cb, pInheritanceInfo, pfnRecord, pUserData, { 0 }, { VK_SUCCESS } };
+    uint32_t misses = 0, hits = 0;
+    pthread_mutex_lock(&md->lock);
+    if (reuse) cache_sweep(md, frame);
+    for (uint32_t i = 0; i < n; ++i) {
+        mr_chunk_t* c = &cb->chunks[i];
+        if (reuse && (c->sec = cache_take(md, c->hash, frame)) != NULL) { c->hit = 1; hits++; }
+        else job.miss[misses++] = i;
+    }
+    pthread_mutex_unlock(&md->lock);
+    if (misses) xeno_workers_parallel(misses, api_record_fn, &job);
+    VkResult r = VK_SUCCESS;
+    for (uint32_t i = 0; i < n && r == VK_SUCCESS; ++i) if (!cb->chunks[i].sec) r = job.result[i];
+    VkCommandBuffer handles[MR_MAX_CHUNKS];
+    pthread_mutex_lock(&md->lock);
+    for (uint32_t i = 0; i < n; ++i) {
+        mr_chunk_t* c = &cb->chunks[i];
+        if (r != VK_SUCCESS) { if (c->sec) sec_release(c->sec); continue; }
+        if (!c->hit && reuse) cache_put(md, c->sec, c->hash, frame);
+        else c->sec->frame = frame;
+        cb->held[cb->nheld++] = c->sec;
+        handles[i] = c->sec->handle;
+    }
+    pthread_mutex_unlock(&md->lock);
+    if (r != VK_SUCCESS) { cb->n[MR_API_FAILED]++; return r; }
+    /* through the layers above: the ones holding the pass begin send it first */
+    md->app_vkCmdExecuteCommands(commandBuffer, n, handles);
+    cb->n[MR_API_CALLS]++; cb->n[MR_API_ITEMS] += itemCount; cb->n[MR_API_CHUNKS] += n;
+    cb->n[MR_API_RECORDED] += misses; cb->n[MR_API_REUSED] += hits;
+    return VK_SUCCESS;
+}
+
+/* --- command buffer lifetime --- */
+static VKAPI_ATTR VkResult VKAPI_CALL mr_vkCreateCommandPool(VkDevice device, const VkCommandPoolCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkCommandPool* pCommandPool) {
+    xeno_mtrecord_device_t* md = xeno_device_get(device)->mtrecord;
+    VkResult r = md->next_vkCreateCommandPool(device, pCreateInfo, pAllocator, pCommandPool);
+    /* protected command buffers cannot execute unprotected secondaries */
+    if (r == VK_SUCCESS && !(pCreateInfo->flags & VK_COMMAND_POOL_CREATE_PROTECTED_BIT))
+        xeno_map_put(&md->families, XENO_HANDLE_KEY(*pCommandPool), (void*)(uintptr_t)(pCreateInfo->queueFamilyIndex + 1ull));
+    return r;
+}
+
+static void cb_reset(mr_cb_t* cb, VkCommandBufferUsageFlags usage) {
+    release_held(cb);
+    cb->len = 0;
+    slots_clear(cb);
+    cb->mode = MR_OUTSIDE; cb->untracked = 0; cb->lost = 0; cb->queries = 0; cb->conditional = 0;
+    cb->usage = usage;
+    memset(cb->n, 0, sizeof(cb->n));
+}
+static void cb_free(mr_cb_t* cb) {
+    release_held(cb);
+    free(cb->log); free(cb->slot_keys); free(cb->slot_vals); free(cb->clears); free(cb->views);
+    free(cb->snap); free(cb->prefix); free(cb->held);
+    free(cb);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL mr_vkAllocateCommandBuffers(VkDevice device, const VkCommandBufferAllocateInfo* pAllocateInfo, VkCommandBuffer* pCommandBuffers) {
+    xeno_mtrecord_device_t* md = xeno_device_get(device)->mtrecord;
+    VkResult r = md->next_vkAllocateCommandBuffers(device, pAllocateInfo, pCommandBuffers);
+    if (r != VK_SUCCESS) return r;
+    uintptr_t family = (uintptr_t)xeno_map_get(&md->families, XENO_HANDLE_KEY(pAllocateInfo->commandPool));
+    for (uint32_t i = 0; i < pAllocateInfo->commandBufferCount; ++i) {
+        mr_cb_t* cb = calloc(1, sizeof(*cb));
+        if (!cb) {
+            while (i--) cb_free(xeno_map_remove(&mr_cbs, XENO_HANDLE_KEY(pCommandBuffers[i])));
+            md->next_vkFreeCommandBuffers(device, pAllocateInfo->commandPool, pAllocateInfo->commandBufferCount, pCommandBuffers);
+            for (uint32_t k = 0; k < pAllocateInfo->commandBufferCount; ++k) pCommandBuffers[k] = VK_NULL_HANDLE;
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        cb->md = md; cb->handle = pCommandBuffers[i]; cb->pool = pAllocateInfo->commandPool;
+        cb->tracked = pAllocateInfo->level == VK_COMMAND_BUFFER_LEVEL_PRIMARY && family;
+        cb->family = family ? (uint32_t)(family - 1) : 0;
+        xeno_map_put(&mr_cbs, XENO_HANDLE_KEY(cb->handle), cb);
+    }
+    return r;
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkFreeCommandBuffers(VkDevice device, VkCommandPool commandPool, uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers) {
+    xeno_mtrecord_device_t* md = xeno_device_get(device)->mtrecord;
+    for (uint32_t i = 0; i < commandBufferCount; ++i) {
+        mr_cb_t* cb = pCommandBuffers[i] ? xeno_map_remove(&mr_cbs, XENO_HANDLE_KEY(pCommandBuffers[i])) : NULL;
+        if (cb) cb_free(cb);
+    }
+    md->next_vkFreeCommandBuffers(device, commandPool, commandBufferCount, pCommandBuffers);
+}
+typedef struct mr_walk { xeno_mtrecord_device_t* md; VkCommandPool pool; } mr_walk_t;
+static int free_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; mr_cb_t* cb = val; mr_walk_t* w = ctx;
+    if (cb->md != w->md || cb->pool != w->pool) return 0;
+    cb_free(cb); return 1;
+}
+static int reset_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; mr_cb_t* cb = val; mr_walk_t* w = ctx;
+    if (cb->md == w->md && cb->pool == w->pool) cb_reset(cb, 0);
+    return 0;
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkDestroyCommandPool(VkDevice device, VkCommandPool commandPool, const VkAllocationCallbacks* pAllocator) {
+    xeno_mtrecord_device_t* md = xeno_device_get(device)->mtrecord;
+    if (commandPool) {
+        mr_walk_t w = { md, commandPool };
+        xeno_map_foreach(&mr_cbs, free_walk_fn, &w);
+        xeno_map_remove(&md->families, XENO_HANDLE_KEY(commandPool));
+    }
+    md->next_vkDestroyCommandPool(device, commandPool, pAllocator);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL mr_vkResetCommandPool(VkDevice device, VkCommandPool commandPool, VkCommandPoolResetFlags flags) {
+    xeno_mtrecord_device_t* md = xeno_device_get(device)->mtrecord;
+    mr_walk_t w = { md, commandPool };
+    xeno_map_foreach(&mr_cbs, reset_walk_fn, &w);
+    return md->next_vkResetCommandPool(device, commandPool, flags);
+}
+
+/* secondaries executed by the previous recording are given back */
+static VKAPI_ATTR VkResult VKAPI_CALL mr_vkBeginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeginInfo* pBeginInfo) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    cb_reset(cb, pBeginInfo->flags);
+    return cb->md->next_vkBeginCommandBuffer(commandBuffer, pBeginInfo);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL mr_vkResetCommandBuffer(VkCommandBuffer commandBuffer, VkCommandBufferResetFlags flags) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    cb_reset(cb, 0);
+    return cb->md->next_vkResetCommandBuffer(commandBuffer, flags);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL mr_vkEndCommandBuffer(VkCommandBuffer commandBuffer) {
+    mr_cb_t* cb = mr_cb(commandBuffer);
+    xeno_mtrecord_device_t* md = cb->md;
+    for (int k = 0; k < MR_COUNTERS; ++k)
+        if (cb->n[k]) atomic_fetch_add_explicit(&md->n[k], cb->n[k], memory_order_relaxed);
+    memset(cb->n, 0, sizeof(cb->n));
+    if (cb->tracked) atomic_fetch_add_explicit(&md->recorded, 1, memory_order_relaxed);
+    return md->next_vkEndCommandBuffer(commandBuffer);
+}
+
+/* --- reuse: what a recorded secondary depends on besides its commands --- */
+static inline void bump(xeno_mtrecord_device_t* md) { atomic_fetch_add_explicit(&md->generation, 1, memory_order_relaxed); }
+#define MR_DESTROY(fn, type) \
+    static VKAPI_ATTR void VKAPI_CALL mr_##fn(VkDevice device, type object, const VkAllocationCallbacks* pAllocator) { \
+        xeno_mtrecord_device_t* md = xeno_device_get(device)->mtrecord; \
+        if (object) bump(md); \
+        md->next_##fn(device, object, pAllocator); }
+MR_DESTROY(vkDestroyPipeline, VkPipeline)
+MR_DESTROY(vkDestroyPipelineLayout, VkPipelineLayout)
+MR_DESTROY(vkDestroyBuffer, VkBuffer)
+MR_DESTROY(vkDestroyBufferView, VkBufferView)
+MR_DESTROY(vkDestroyImage, VkImage)
+MR_DESTROY(vkDestroyImageView, VkImageView)
+MR_DESTROY(vkDestroySampler, VkSampler)
+MR_DESTROY(vkDestroyRenderPass, VkRenderPass)
+MR_DESTROY(vkDestroyFramebuffer, VkFramebuffer)
+MR_DESTROY(vkDestroyShaderEXT, VkShaderEXT)
+MR_DESTROY(vkDestroyDescriptorSetLayout, VkDescriptorSetLayout)
+#undef MR_DESTROY
+
+static void set_touch(xeno_mtrecord_device_t* md, VkDescriptorSet set) {
+    mr_set_t* s = set ? xeno_map_get(&md->sets, XENO_HANDLE_KEY(set)) : NULL;
+    if (s) atomic_store_explicit(&s->version, atomic_fetch_add_explicit(&md->versions, 1, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL mr_vkAllocateDescriptorSets(VkDevice device, const VkDescriptorSetAllocateInfo* pAllocateInfo, VkDescriptorSet* pDescriptorSets) {
+    xeno_mtrecord_device_t* md = xeno_device_get(device)->mtrecord;
+    VkResult r = md->next_vkAllocateDescriptorSets(device, pAllocateInfo, pDescriptorSets);
+    if (r != VK_SUCCESS) return r;
+    for (uint32_t i = 0; i < pAllocateInfo->descriptorSetCount; ++i) {
+        mr_set_t* s = xeno_map_get(&md->sets, XENO_HANDLE_KEY(pDescriptorSets[i]));
+        if (!s && (s = calloc(1, sizeof(*s))) != NULL) xeno_map_put(&md->sets, XENO_HANDLE_KEY(pDescriptorSets[i]), s);
+        if (!s) continue;
+        s->pool = pAllocateInfo->descriptorPool;
+        set_touch(md, pDescriptorSets[i]);
+    }
+    return r;
+}
+static VKAPI_ATTR VkResult VKAPI_CALL mr_vkFreeDescriptorSets(VkDevice device, VkDescriptorPool descriptorPool, uint32_t descriptorSetCount, const VkDescriptorSet* pDescriptorSets) {
+    xeno_mtrecord_device_t* md = xeno_device_get(device)->mtrecord;
+    for (uint32_t i = 0; i < descriptorSetCount; ++i)
+        if (pDescriptorSets[i]) free(xeno_map_remove(&md->sets, XENO_HANDLE_KEY(pDescriptorSets[i])));
+    return md->next_vkFreeDescriptorSets(device, descriptorPool, descriptorSetCount, pDescriptorSets);
+}
+static int set_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; mr_set_t* s = val;
+    if (s->pool != *(const VkDescriptorPool*)ctx) return 0;
+    free(s); return 1;
+}
+static VKAPI_ATTR VkResult VKAPI_CALL mr_vkResetDescriptorPool(VkDevice device, VkDescriptorPool descriptorPool, VkDescriptorPoolResetFlags flags) {
+    xeno_mtrecord_device_t* md = xeno_device_get(device)->mtrecord;
+    xeno_map_foreach(&md->sets, set_walk_fn, &descriptorPool);
+    return md->next_vkResetDescriptorPool(device, descriptorPool, flags);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkDestroyDescriptorPool(VkDevice device, VkDescriptorPool descriptorPool, const VkAllocationCallbacks* pAllocator) {
+    xeno_mtrecord_device_t* md = xeno_device_get(device)->mtrecord;
+    if (descriptorPool) xeno_map_foreach(&md->sets, set_walk_fn, &descriptorPool);
+    md->next_vkDestroyDescriptorPool(device, descriptorPool, pAllocator);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkUpdateDescriptorSets(VkDevice device, uint32_t descriptorWriteCount, const VkWriteDescriptorSet* pDescriptorWrites,
+                                                           uint32_t descriptorCopyCount, const VkCopyDescriptorSet* pDescriptorCopies) {
+    xeno_mtrecord_device_t* md = xeno_device_get(device)->mtrecord;
+    for (uint32_t i = 0; i < descriptorWriteCount; ++i) set_touch(md, pDescriptorWrites[i].dstSet);
+    for (uint32_t i = 0; i < descriptorCopyCount; ++i) set_touch(md, pDescriptorCopies[i].dstSet);
+    md->next_vkUpdateDescriptorSets(device, descriptorWriteCount, pDescriptorWrites, descriptorCopyCount, pDescriptorCopies);
+}
+static VKAPI_ATTR void VKAPI_CALL mr_vkUpdateDescriptorSetWithTemplate(VkDevice device, VkDescriptorSet descriptorSet, VkDescriptorUpdateTemplate descriptorUpdateTemplate, const void* pData) {
+    xeno_mtrecord_device_t* md = xeno_device_get(device)->mtrecord;
+    set_touch(md, descriptorSet);
+    md->next_vkUpdateDescriptorSetWithTemplate(device, descriptorSet, descriptorUpdateTemplate, pData);
+}
+
+/* --- device lifetime / routing --- */
+static PFN_vkVoidFunction resolve(xeno_device_t* dev, const char* name) {
+    PFN_vkVoidFunction fn = xeno_device_barrier_proc(dev, name);
+    for (size_t i = 0; !fn && i < MR_ALIAS_COUNT; ++i)
+        if (strcmp(mr_aliases[i].name, name) == 0) fn = xeno_device_barrier_proc(dev, mr_aliases[i].alias);
+    return fn;
+}
+
+/* --- per-title knobs --- */
+/* the title-specific variable when it is set, the global one otherwise */
+static const char* title_knob(const char* title, const char* name, char* key, size_t n) {
+    snprintf(key, n, "%s_%s", name, title);
+    return title[0] && getenv(key) ? key : name;
+}
+
+int xeno_mtrecord_init(xeno_device_t* dev) {
+    char title[96], key[160];
+    xeno_process_title(title, sizeof(title));
+    if (!xeno_env_bool(title_knob(title, "XCLIPSE_MTRECORD", key, sizeof(key)), 0)) return 0;
+    if (xeno_workers_count() == 0) {
+        xlog("mtrecord: the worker pool is disabled, render passes are recorded on the app's thread");
+        return 0;
+    }
+    int split = xeno_env_bool(title_knob(title, "XCLIPSE_MTRECORD_SPLIT", key, sizeof(key)), 1);
+    for (size_t i = 0; split && i < sizeof(mr_unseen) / sizeof(mr_unseen[0]); ++i) {
+        if (!xeno_device_barrier_proc(dev, mr_unseen[i])) continue;
+        xlog("mtrecord: %s bypasses the layer, only vkCmdRecordParallelXCLIPSE records in parallel", mr_unseen[i]);
+        split = 0;
+    }
+    pthread_once(&mr_cbs_once, mr_cbs_init);
+    xeno_mtrecord_device_t* md = calloc(1, sizeof(*md)); if (!md) return -1;
+    md->dev = dev;
+    memcpy(md->title, title, sizeof(md->title));
+    md->split = split;
+    md->reuse = xeno_env_bool(title_knob(title, "XCLIPSE_MTRECORD_REUSE", key, sizeof(key)), 1);
+#define MR_RESOLVE(fn) md->next_##fn = (PFN_##fn)resolve(dev, #fn);
+#define MR_RESOLVE_DYN(name, state, fn) MR_RESOLVE(fn)
+#define MR_RESOLVE_SCALAR(fn, type) MR_RESOLVE(fn)
+    MR_HOOKS(MR_RESOLVE)
+    XENO_DYN_STATES(MR_RESOLVE_DYN)
+    MR_SCALARS(MR_RESOLVE_SCALAR)
+    if (md->reuse) { MR_REUSE_HOOKS(MR_RESOLVE) }
+#undef MR_RESOLVE_SCALAR
+#undef MR_RESOLVE_DYN
+#undef MR_RESOLVE
+    if (!md->next_vkCreateCommandPool || !md->next_vkDestroyCommandPool || !md->next_vkResetCommandPool || !md->next_vkAllocateCommandBuffers ||
+        !md->next_vkFreeCommandBuffers || !md->next_vkBeginCommandBuffer || !md->next_vkEndCommandBuffer || !md->next_vkCmdExecuteCommands ||
+        !md->next_vkCmdBeginRenderPass || !md->next_vkCmdNextSubpass || !md->next_vkCmdEndRenderPass || !md->next_vkCmdDraw || !md->next_vkCmdDrawIndexed ||
+        !md->next_vkCmdBindPipeline || !md->next_vkCmdBindDescriptorSets || !md->next_vkCmdBindVertexBuffers || !md->next_vkCmdBindIndexBuffer ||
+        !md->next_vkCmdPushConstants || !md->next_vkCmdSetDepthBias) { free(md); return -1; }
+    long min_draws = xeno_env_long(title_knob(title, "XCLIPSE_MTRECORD_MIN_DRAWS", key, sizeof(key)), 256);
+    md->min_draws = min_draws < 2 * MR_CHUNK_DRAWS ? 2 * MR_CHUNK_DRAWS : min_draws > UINT32_MAX ? UINT32_MAX : (uint32_t)min_draws;
+    xeno_map_init(&md->families, 64);
+    xeno_map_init(&md->cache, 1024);
+    xeno_map_init(&md->sets, 4096);
+    pthread_mutex_init(&md->lock, NULL);
+    dev->mtrecord = md;
+    if (md->split)
+        xlog("mtrecord: recording render passes of %u+ draws on %d workers%s title=%s", md->min_draws, xeno_workers_count(),
+             md->reuse ? ", reusing unchanged secondaries" : "", title[0] ? title : "?");
+    else
+        xlog("mtrecord: vkCmdRecordParallelXCLIPSE recording on %d workers%s title=%s", xeno_workers_count(),
+             md->reuse ? ", reusing unchanged secondaries" : "", title[0] ? title : "?");
+    return 0;
+}
+
+static int device_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; mr_cb_t* cb = val;
+    if (cb->md != ctx) return 0;
+    cb_free(cb); return 1;
+}
+static int free_fn(uint64_t key, void* val, void* ctx) { (void)key; (void)ctx; free(val); return 1; }
+static int cache_free_fn(uint64_t key, void* val, void* ctx) { (void)key; (void)ctx; mr_sec_t* s = val; free(s->sets); free(s); return 1; }
+
+void xeno_mtrecord_destroy(xeno_device_t* dev) {
+    xeno_mtrecord_device_t* md = dev->mtrecord;
+    if (!md) return;
+    xeno_map_foreach(&mr_cbs, device_walk_fn, md);   /* command buffers of pools the app leaked */
+    xeno_map_foreach(&md->cache, cache_free_fn, NULL);
+    xeno_map_foreach(&md->sets, free_fn, NULL);
+    /* destroying the pools frees the secondaries */
+    for (uint32_t i = 0; i < md->npools; ++i) {
+        md->next_vkDestroyCommandPool(dev->handle, md->pools[i]->handle, NULL);
+        pthread_mutex_destroy(&md->pools[i]->lock);
+        free(md->pools[i]->free);
+        free(md->pools[i]);
+    }
+    xeno_map_destroy(&md->families); xeno_map_destroy(&md->cache); xeno_map_destroy(&md->sets);
+    pthread_mutex_destroy(&md->lock);
+    dev->mtrecord = NULL;
+    free(md);
+}
+
+PFN_vkVoidFunction xeno_mtrecord_proc(xeno_device_t* dev, const char* name) {
+    xeno_mtrecord_device_t* md = dev->mtrecord;
+    if (!md || strncmp(name, "vk", 2) != 0) return NULL;
+    if (strcmp(name, "vkCmdRecordParallelXCLIPSE") == 0) return (PFN_vkVoidFunction)mr_vkCmdRecordParallelXCLIPSE;
+    for (size_t i = 0; i < MR_ALIAS_COUNT; ++i)
+        if (strcmp(name, mr_aliases[i].alias) == 0) { name = mr_aliases[i].name; break; }
+#define MR_PROC(fn) if (md->next_##fn && strcmp(name, #fn) == 0) return (PFN_vkVoidFunction)mr_##fn;
+#define MR_PROC_DYN(name_, state, fn) MR_PROC(fn)
+#define MR_PROC_SCALAR(fn, type) MR_PROC(fn)
+    MR_HOOKS(MR_PROC)
+    MR_REUSE_HOOKS(MR_PROC)
+    XENO_DYN_STATES(MR_PROC_DYN)
+    MR_SCALARS(MR_PROC_SCALAR)
+#undef MR_PROC_SCALAR
+#undef MR_PROC_DYN
+#undef MR_PROC
+    return NULL;
+}
+
+/* --- reporting --- */
+void xeno_mtrecord_report(FILE* f, xeno_device_t* dev) {
+    xeno_mtrecord_device_t* md = dev->mtrecord;
+    fprintf(f, "  \"mtrecord\": {\"enabled\": %s", md ? "true" : "false");
+    if (md) {
+        uint64_t frames = atomic_load(&dev->frames), split = atomic_load(&md->n[MR_SPLIT]), chunks = atomic_load(&md->n[MR_CHUNKS]);
+        uint64_t reused = atomic_load(&md->n[MR_REUSED]), threads = atomic_load(&md->n[MR_THREADS]);
+        fprintf(f, ", \"title\": \"%s\", \"splitting\": %s, \"min_draws\": %u, \"reuse\": %s", md->title, md->split ? "true" : "false", md->min_draws,
+                md->reuse ? "true" : "false");
+        for (int k = 0; k < MR_COUNTERS; ++k) fprintf(f, ", \"%s\": %" PRIu64, mr_counter_names[k], atomic_load(&md->n[k]));
+        pthread_mutex_lock(&md->lock);
+        uint32_t pools = md->npools;
+        pthread_mutex_unlock(&md->lock);
+        fprintf(f, ", \"evicted\": %" PRIu64 ", \"cached\": %u, \"pools\": %u, \"command_buffers\": %" PRIu64 ", \"frames\": %" PRIu64
+                   ", \"split_per_frame\": %.1f, \"reuse_pct\": %.1f, \"threads_per_split\": %.2f",
+                atomic_load(&md->evicted), (unsigned)atomic_load(&md->cache.count), pools, atomic_load(&md->recorded), frames,
+                frames ? (double)split / (double)frames : 0.0, chunks ? 100.0 * (double)reused / (double)chunks : 0.0,
+                split ? (double)threads / (double)split : 0.0);
+    }
+    fprintf(f, "}");
+}
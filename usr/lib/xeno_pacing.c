@@ -0,0 +1,318 @@
+/* xeno_pacing.c - low-latency frame throttling and a frame-rate cap
+ *
+ * A title whose CPU runs frames ahead of the GPU shows input that is several frames old: each
+ * frame's commands wait in the queue behind the ones before it. Every present here also submits an
+ * empty batch with a wrapper fence to the present queue, signalled once the frame's work has
+ * completed. The completion time comes from the reactor's callback with XCLIPSE_REACTOR=1, else
+ * from a wait on the fence returning or a status check finding it signalled (a late bound, which
+ * can only lower the predictions below).
+ *
+ * Low-latency mode throttles the app in vkAcquireNextImageKHR, where titles start a frame. At most
+ * one frame is left in flight on the GPU, and the acquire is held until the frame in flight is
+ * predicted to complete (from the GPU time per frame) minus the time the app takes from acquire to
+ * present (the CPU time per frame) and a margin, or until it completes if that is earlier: the
+ * next frame's commands reach the queue as the GPU runs dry and read the freshest input.
+ *
+ * The frame-rate cap holds acquires to a cadence of absolute deadlines, N per second, so frame times
+ * stay even instead of alternating between fast and blocked frames; a frame more than one period
+ * late restarts the cadence instead of bursting to catch up. Low latency, then the cap, apply
+ * before the driver's acquire.
+ *
+ * Reported: frame latency (acquire to GPU completion), the CPU and GPU predictions, time held in
+ * acquires, and the present-to-present interval with its jitter (how much one interval differs
+ * from the next) and, when capped, the share of intervals within 1 ms of the period.
+ *
+ * Knobs (per title by appending _<PROCESS_NAME>):
+ *   XCLIPSE_LOW_LATENCY=1   hold acquires so frames are submitted just in time
+ *   XCLIPSE_FPS_CAP=N       at most N acquires per second, on an even cadence (default 0: no cap)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+#define XP_FRAMES 8                     /* presents tracked; a slot is reused XP_FRAMES presents later */
+#define XP_MARGIN_NS 1000000ull         /* the GPU gets the next frame this long before it is predicted idle */
+#define XP_HOLD_MAX_NS 100000000ull     /* longest an acquire is held for latency */
+#define XP_RETIRE_NS 1000000000ull      /* longest a reused slot's fence is waited for */
+#define XP_PACE_NS 1000000ull           /* intervals this close to the cap's period are on pace */
+#define XP_HELD_NS 50000ull             /* acquires held longer count as held */
+
+typedef struct xp_frame {
+    VkFence fence;
+    int tracked;                    /* its fence was submitted */
+    uint64_t acquired_ns, presented_ns;
+    _Atomic uint64_t done_ns;       /* 0 while pending */
+    _Atomic int exact;              /* done_ns is when it signalled, not when that was noticed */
+    _Atomic int watched;            /* a reactor watch has yet to complete */
+} xp_frame_t;
+
+typedef struct xeno_pacing_device {
+    xeno_device_t* dev;
+    PFN_vkQueuePresentKHR next_vkQueuePresentKHR;
+    PFN_vkAcquireNextImageKHR next_vkAcquireNextImageKHR;
+    PFN_vkAcquireNextImage2KHR next_vkAcquireNextImage2KHR;
+    char title[128];
+    int low_latency;
+    uint64_t period_ns;             /* frame-rate cap, 0: none */
+    pthread_mutex_t lock;
+    pthread_mutex_t present_lock;   /* presents on several queues take their slots in turn */
+    xp_frame_t frames[XP_FRAMES];
+    uint64_t presents, learned;     /* frames presented / taken into the predictions */
+    uint64_t learned_done_ns;       /* completion of the last frame taken in */
+    uint64_t acquired_ns;           /* first acquire of the frame being built, 0: none yet */
+    uint64_t deadline_ns;           /* the cap's cadence */
+    uint64_t gpu_ns, cpu_ns;        /* predictions per frame */
+    uint64_t last_present_ns, last_interval_ns;
+    uint64_t held, held_ns, held_max_ns, latency_n, latency_ns, latency_max_ns;
+    uint64_t intervals, interval_ns, jitter_ns, on_pace;  /* jitter: change from one interval to the next */
+} xeno_pacing_device_t;
+
+static xp_frame_t* frame_at(xeno_pacing_device_t* pd, uint64_t n) { return &pd->frames[n % XP_FRAMES]; }
+
+static void note_done(xp_frame_t* fr, uint64_t ns, int exact) {
+    uint64_t zero = 0;
+    if (atomic_compare_exchange_strong(&fr->done_ns, &zero, ns)) atomic_store(&fr->exact, exact);
+}
+
+/* reactor thread */
+static void frame_complete(void* ctx, VkResult result) {
+    xp_frame_t* fr = ctx;
+    note_done(fr, xeno_now_ns(), result == VK_SUCCESS);
+    atomic_store(&fr->watched, 0);
+}
+
+/* 1 once the frame's work has completed; waits up to timeout_ns */
+static int frame_wait(xeno_pacing_device_t* pd, xp_frame_t* fr, VkFence fence, uint64_t timeout_ns) {
+    if (atomic_load(&fr->done_ns)) return 1;
+    xeno_device_t* dev = pd->dev;
+    int waited = 0;
+    VkResult r = dev->vk.vkGetFenceStatus(dev->handle, fence);
+    if (r == VK_NOT_READY && timeout_ns) {
+        r = dev->vk.vkWaitForFences(dev->handle, 1, &fence, VK_TRUE, timeout_ns);
+        waited = 1;
+    }
+    if (r != VK_SUCCESS) return 0;
+    note_done(fr, xeno_now_ns(), waited);   /* only a wait that blocked saw it signal */
+    return 1;
+}
+
+/* completed frames, in order, feed the predictions (lock held) */
+static void learn(xeno_pacing_device_t* pd) {
+    for (; pd->learned < pd->presents; ++pd->learned) {
+        xp_frame_t* fr = frame_at(pd, pd->learned);
+        uint64_t done = atomic_load(&fr->done_ns);
+        if (!done) break;
+        if (!fr->tracked) continue;
+        /* the GPU could start it once it was presented and the frame before had completed */
+        uint64_t start = fr->presented_ns > pd->learned_done_ns ? fr->presented_ns : pd->learned_done_ns;
+        pd->learned_done_ns = done;
+        uint64_t gpu = done > start ? done - start : 0;
+        if (atomic_load(&fr->exact)) pd->gpu_ns = pd->gpu_ns ? pd->gpu_ns - pd->gpu_ns / 8 + gpu / 8 : gpu;
+        else if (!pd->gpu_ns || gpu < pd->gpu_ns) pd->gpu_ns = gpu;   /* seen late: a bound */
+        uint64_t latency = done > fr->acquired_ns ? done - fr->acquired_ns : 0;
+        pd->latency_n++; pd->latency_ns += latency;
+        if (latency > pd->latency_max_ns) pd->latency_max_ns = latency;
+    }
+}
+
+static void sleep_until(uint64_t ns) {
+    struct timespec ts = { (time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull) };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+}
+
+/* before the driver's acquire */
+static void throttle(xeno_pacing_device_t* pd) {
+    uint64_t t0 = xeno_now_ns();
+    pthread_mutex_lock(&pd->lock);
+    int building = pd->acquired_ns != 0;   /* another swapchain's image for the same frame */
+    uint64_t n = pd->presents;
+    pthread_mutex_unlock(&pd->lock);
+    if (building) return;
+    if (pd->low_latency && n) {
+        /* one frame in flight: the one before the last presented has completed */
+        xp_frame_t* last = frame_at(pd, n - 1), *prev = n > 1 ? frame_at(pd, n - 2) : NULL;
+        if (prev && prev->tracked) frame_wait(pd, prev, prev->fence, XP_HOLD_MAX_NS);
+        if (last->tracked && !frame_wait(pd, last, last->fence, 0)) {
+            pthread_mutex_lock(&pd->lock);
+            learn(pd);
+            uint64_t start = last->presented_ns, prev_done = prev && prev->tracked ? atomic_load(&prev->done_ns) : 0;
+            if (prev_done > start) start = prev_done;
+            uint64_t lead = pd->cpu_ns + XP_MARGIN_NS, wake = start + pd->gpu_ns > lead ? start + pd->gpu_ns - lead : 0;
+            pthread_mutex_unlock(&pd->lock);
+            uint64_t now = xeno_now_ns();
+            if (wake > now) frame_wait(pd, last, last->fence, wake - now < XP_HOLD_MAX_NS ? wake - now : XP_HOLD_MAX_NS);
+        }
+    }
+    if (pd->period_ns) {
+        uint64_t now = xeno_now_ns();
+        pthread_mutex_lock(&pd->lock);
+        uint64_t next = pd->deadline_ns + pd->period_ns;
+        if (!pd->deadline_ns || now > next + pd->period_ns) next = now;   /* too late to catch up */
+        pd->deadline_ns = next;
+        pthread_mutex_unlock(&pd->lock);
+        if (next > now) sleep_until(next);
+    }
+    uint64_t held = xeno_now_ns() - t0;
+    pthread_mutex_lock(&pd->lock);
+    if (held > XP_HELD_NS) { pd->held++; pd->held_ns += held; if (held > pd->held_max_ns) pd->held_max_ns = held; }
+    pthread_mutex_unlock(&pd->lock);
+}
+
+static void acquired(xeno_pacing_device_t* pd, VkResult r) {
+    if (r != VK_SUCCESS && r != VK_SUBOPTIMAL_KHR) return;
+    uint64_t now = xeno_now_ns();
+    pthread_mutex_lock(&pd->lock);
+    if (!pd->acquired_ns) pd->acquired_ns = now;
+    pthread_mutex_unlock(&pd->lock);
+}
+
+/* --- entrypoints --- */
+static VKAPI_ATTR VkResult VKAPI_CALL xp_vkAcquireNextImageKHR(VkDevice device, VkSwapchainKHR swapchain, uint64_t timeout, VkSemaphore semaphore, VkFence fence, uint32_t* pImageIndex) {
+    xeno_device_t* dev = xeno_device_get(device);
+    throttle(dev->pacing);
+    VkResult r = dev->pacing->next_vkAcquireNextImageKHR(device, swapchain, timeout, semaphore, fence, pImageIndex);
+    acquired(dev->pacing, r);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xp_vkAcquireNextImage2KHR(VkDevice device, const VkAcquireNextImageInfoKHR* pAcquireInfo, uint32_t* pImageIndex) {
+    xeno_device_t* dev = xeno_device_get(device);
+    throttle(dev->pacing);
+    VkResult r = dev->pacing->next_vkAcquireNextImage2KHR(device, pAcquireInfo, pImageIndex);
+    acquired(dev->pacing, r);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xp_vkQueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* pPresentInfo) {
+    xeno_device_t* dev = xeno_queue_device(queue);
+    xeno_pacing_device_t* pd = dev->pacing;
+    pthread_mutex_lock(&pd->present_lock);
+    xp_frame_t* fr = frame_at(pd, pd->presents);    /* only presents advance it */
+    int reuse = fr->tracked;
+    /* the slot's frame was presented XP_FRAMES ago: long done, but its fence is only reset once known to be */
+    if (reuse) {
+        frame_wait(pd, fr, fr->fence, XP_RETIRE_NS);
+        while (atomic_load(&fr->watched)) sched_yield();
+        dev->vk.vkResetFences(dev->handle, 1, &fr->fence);
+    }
+    pthread_mutex_lock(&pd->lock);
+    /* without the reactor nothing stamps completions as they happen: poll the frames in flight */
+    for (uint64_t i = pd->learned; !dev->reactor && i < pd->presents; ++i) {
+        xp_frame_t* p = frame_at(pd, i);
+        if (p->tracked && !frame_wait(pd, p, p->fence, 0)) break;
+    }
+    learn(pd);   /* before the slot's frame is overwritten */
+    if (pd->presents - pd->learned >= XP_FRAMES) pd->learned = pd->presents - XP_FRAMES + 1;   /* the slot's frame never completed */
+    pthread_mutex_unlock(&pd->lock);
+    VkFenceCreateInfo fi = { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    if (!fr->fence && dev->vk.vkCreateFence(dev->handle, &fi, NULL, &fr->fence) != VK_SUCCESS) fr->fence = VK_NULL_HANDLE;
+    /* signals once everything submitted to the queue so far, the frame's work, has completed */
+    int tracked = fr->fence && dev->vk.vkQueueSubmit(queue, 0, NULL, fr->fence) == VK_SUCCESS;
+    uint64_t now = xeno_now_ns();
+    pthread_mutex_lock(&pd->lock);
+    fr->tracked = tracked;
+    fr->acquired_ns = pd->acquired_ns ? pd->acquired_ns : now;
+    fr->presented_ns = now;
+    atomic_store(&fr->done_ns, tracked ? 0 : now);
+    atomic_store(&fr->exact, 0);
+    uint64_t cpu = now - fr->acquired_ns;
+    pd->cpu_ns = pd->cpu_ns ? pd->cpu_ns - pd->cpu_ns / 8 + cpu / 8 : cpu;
+    if (pd->last_present_ns) {
+        uint64_t dt = now - pd->last_present_ns;
+        pd->intervals++; pd->interval_ns += dt;
+        if (pd->last_interval_ns) pd->jitter_ns += dt > pd->last_interval_ns ? dt - pd->last_interval_ns : pd->last_interval_ns - dt;
+        if (pd->period_ns && (dt > pd->period_ns ? dt - pd->period_ns : pd->period_ns - dt) <= XP_PACE_NS) pd->on_pace++;
+        pd->last_interval_ns = dt;
+    }
+    pd->last_present_ns = now;
+    pd->acquired_ns = 0;
+    pd->presents++;
+    pthread_mutex_unlock(&pd->lock);
+    if (tracked && dev->reactor) {
+        atomic_store(&fr->watched, 1);
+        if (xeno_reactor_watch(dev, fr->fence, frame_complete, fr, NULL) != 0) atomic_store(&fr->watched, 0);
+    }
+    pthread_mutex_unlock(&pd->present_lock);
+    return pd->next_vkQueuePresentKHR(queue, pPresentInfo);
+}
+
+static const char* title_knob(const xeno_pacing_device_t* pd, const char* name, char* key, size_t n) {
+    snprintf(key, n, "%s_%s", name, pd->title);
+    return pd->title[0] && getenv(key) ? key : name;
+}
+
+/* --- device lifetime / routing --- */
+int xeno_pacing_init(xeno_device_t* dev) {
+    char title[128], key[192];
+    xeno_process_title(title, sizeof(title));
+    xeno_pacing_device_t probe = { 0 };
+    memcpy(probe.title, title, sizeof(title));
+    int low_latency = xeno_env_bool(title_knob(&probe, "XCLIPSE_LOW_LATENCY", key, sizeof(key)), 0);
+    long fps = xeno_env_long(title_knob(&probe, "XCLIPSE_FPS_CAP", key, sizeof(key)), 0);
+    if (!low_latency && fps <= 0) return 0;
+    if (!dev->vk.vkQueuePresentKHR || !dev->vk.vkAcquireNextImageKHR || !dev->vk.vkQueueSubmit || !dev->vk.vkCreateFence ||
+        !dev->vk.vkDestroyFence || !dev->vk.vkResetFences || !dev->vk.vkGetFenceStatus || !dev->vk.vkWaitForFences) return -1;
+    xeno_pacing_device_t* pd = calloc(1, sizeof(*pd)); if (!pd) return -1;
+    pd->dev = dev;
+    memcpy(pd->title, title, sizeof(title));
+    pd->low_latency = low_latency;
+    pd->period_ns = fps > 0 ? 1000000000ull / (uint64_t)(fps > 1000 ? 1000 : fps) : 0;
+    pthread_mutex_init(&pd->lock, NULL); pthread_mutex_init(&pd->present_lock, NULL);
+    /* interposed in the dispatch table too: presents of the modules routed ahead are paced as well */
+    pd->next_vkQueuePresentKHR = dev->vk.vkQueuePresentKHR; dev->vk.vkQueuePresentKHR = xp_vkQueuePresentKHR;
+    pd->next_vkAcquireNextImageKHR = dev->vk.vkAcquireNextImageKHR; dev->vk.vkAcquireNextImageKHR = xp_vkAcquireNextImageKHR;
+    if (dev->vk.vkAcquireNextImage2KHR) { pd->next_vkAcquireNextImage2KHR = dev->vk.vkAcquireNextImage2KHR; dev->vk.vkAcquireNextImage2KHR = xp_vkAcquireNextImage2KHR; }
+    dev->pacing = pd;
+    xlog("pacing: low latency %s, frame-rate cap %ld", low_latency ? "on" : "off", fps > 0 ? fps : 0);
+    return 0;
+}
+
+void xeno_pacing_destroy(xeno_device_t* dev) {
+    xeno_pacing_device_t* pd = dev->pacing;
+    if (!pd) return;
+    /* the device is idle and the reactor has delivered its last completions */
+    for (int i = 0; i < XP_FRAMES; ++i)
+        if (pd->frames[i].fence) dev->vk.vkDestroyFence(dev->handle, pd->frames[i].fence, NULL);
+    pthread_mutex_destroy(&pd->lock); pthread_mutex_destroy(&pd->present_lock);
+    dev->vk.vkQueuePresentKHR = pd->next_vkQueuePresentKHR; dev->vk.vkAcquireNextImageKHR = pd->next_vkAcquireNextImageKHR;
+    if (pd->next_vkAcquireNextImage2KHR) dev->vk.vkAcquireNextImage2KHR = pd->next_vkAcquireNextImage2KHR;
+    dev->pacing = NULL;
+    free(pd);
+}
+
+PFN_vkVoidFunction xeno_pacing_proc(xeno_device_t* dev, const char* name) {
+    if (!dev->pacing) return NULL;
+    if (strcmp(name, "vkQueuePresentKHR") == 0) return (PFN_vkVoidFunction)xp_vkQueuePresentKHR;
+    if (strcmp(name, "vkAcquireNextImageKHR") == 0) return (PFN_vkVoidFunction)xp_vkAcquireNextImageKHR;
+    if (dev->pacing->next_vkAcquireNextImage2KHR && strcmp(name, "vkAcquireNextImage2KHR") == 0) return (PFN_vkVoidFunction)xp_vkAcquireNextImage2KHR;
+    return NULL;
+}
+
+void xeno_pacing_report(FILE* f, xeno_device_t* dev) {
+    xeno_pacing_device_t* pd = dev->pacing;
+    fprintf(f, "  \"pacing\": {\"enabled\": %s", pd ? "true" : "false");
+    if (pd) {
+        pthread_mutex_lock(&pd->lock);
+        learn(pd);
+        double mean = pd->intervals ? (double)pd->interval_ns / (double)pd->intervals : 0.0;
+        double jitter = pd->intervals > 1 ? (double)pd->jitter_ns / (double)(pd->intervals - 1) : 0.0;
+        fprintf(f, ", \"low_latency\": %s, \"fps_cap\": %.1f, \"frames\": %" PRIu64 ", \"cpu_us\": %.0f, \"gpu_us\": %.0f"
+                   ", \"latency_avg_us\": %.0f, \"latency_max_us\": %.0f, \"held_frames\": %" PRIu64 ", \"held_avg_us\": %.0f, \"held_max_us\": %.0f"
+                   ", \"interval_avg_us\": %.0f, \"interval_jitter_us\": %.0f, \"fps\": %.1f",
+                pd->low_latency ? "true" : "false", pd->period_ns ? 1e9 / (double)pd->period_ns : 0.0, pd->presents,
+                (double)pd->cpu_ns / 1000.0, (double)pd->gpu_ns / 1000.0,
+                pd->latency_n ? (double)pd->latency_ns / (double)pd->latency_n / 1000.0 : 0.0, (double)pd->latency_max_ns / 1000.0,
+                pd->held, pd->held ? (double)pd->held_ns / (double)pd->held / 1000.0 : 0.0, (double)pd->held_max_ns / 1000.0,
+                mean / 1000.0, jitter / 1000.0, mean > 0 ? 1e9 / mean : 0.0);
+        if (pd->period_ns) fprintf(f, ", \"on_pace_pct\": %.1f", pd->intervals ? 100.0 * (double)pd->on_pace / (double)pd->intervals : 0.0);
+        pthread_mutex_unlock(&pd->lock);
+    }
+    fprintf(f, "}");
+}
@@ -0,0 +1,757 @@
+/* xeno_passmerge.c - merging of consecutive render pass instances
+ *
+ * Engines split their frame into more render pass instances than it needs: one per material
+ * bucket, per draw list or per effect, each ending with the attachments stored and the next one
+ * loading them again. On a tiler every such boundary flushes tile memory to memory and reads it
+ * back. When an instance ends and the next command recorded in the command buffer begins another
+ * instance on the same attachments, the two are joined: the end and the begin are dropped and the
+ * draws of the second continue in the first. Its loads become no-ops; an attachment it clears is
+ * cleared with vkCmdClearAttachments over the render area instead.
+ *
+ * The end of a mergeable instance is held per command buffer until the next command that is not
+ * state setting: a begin of a matching instance merges, anything else (work, synchronization,
+ * queries, debug labels, vkCmdExecuteCommands, the end of the command buffer) sends the end first.
+ * Two instances match when the second could have been begun as part of the first:
+ *  - render pass objects with a single subpass, created without extension structs and compatible
+ *    with each other including their final layouts and subpass dependencies, on the same
+ *    framebuffer (and for imageless framebuffers the same views), render area and subpass contents,
+ *    whose dependencies on commands outside the pass order attachment access only: the merge drops
+ *    them, and shader reads of the first instance's storage writes would race in one subpass;
+ *  - dynamic rendering on the same views in the same layouts, with the same render area, layer
+ *    count, view mask and flags, not suspending or resuming;
+ *  - without input, resolve or feedback loop attachments: nothing reads the first instance's
+ *    output other than as the attachment it is;
+ *  - where the second stores an attachment, the first stores it too: the merged instance ends with
+ *    the first instance's store ops.
+ * Instances reading the first one's attachments through samplers stay apart: at the same pixel that
+ * would need their shaders rewritten to subpass inputs or local reads.
+ *
+ * Merging is opt-in per title: XCLIPSE_PASSMERGE_<PROCESS_NAME>=1 adds a title to the allowlist,
+ * XCLIPSE_PASSMERGE=1 allows every title (and =0 after the title name takes one off again). Merges
+ * are counted per pair of render pass objects or dynamic rendering attachment sets, with the memory
+ * traffic of the stores and loads they saved estimated from the render area and the attachment
+ * formats. A device exposing commands valid outside a pass that bypass the layer merges nothing.
+ *
+ * The layer is returned first by xeno_device_next_proc() and forwards through
+ * xeno_device_loadstore_proc(): the load/store layer sees the merged instances. Render passes,
+ * framebuffers and the images behind views are looked up in xeno_resource.c; what a pass allows is
+ * derived on its first begin and kept with its record.
+ *
+ * Knobs (per title by appending _<PROCESS_NAME>):
+ *   XCLIPSE_PASSMERGE=1     merge consecutive render pass instances on the same attachments
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+#define PM_MAX_ATTACHMENTS 16           /* per pass; bigger passes are not merged */
+#define PM_SLOTS (PM_MAX_ATTACHMENTS + 2) /* dynamic rendering: colors, depth, stencil */
+#define PM_MAX_PAIRS 256                /* merged pairs counted per device */
+#define PM_MAX_REPORTED 16              /* pairs listed in the report, by traffic saved */
+#define PM_NONE UINT32_MAX
+
+enum {
+    PM_BEGINS, PM_MERGEABLE, PM_ENDS_HELD, PM_MERGED, PM_BROKEN, PM_MISMATCHED, PM_CLEARS_INSERTED, PM_LOADS_SAVED,
+    PM_STORES_SAVED, PM_COUNTERS
+};
+static const char* const pm_counter_names[PM_COUNTERS] = {
+    "begins", "mergeable", "ends_held", "merged", "broken", "mismatched", "clears_inserted", "loads_saved", "stores_saved"
+};
+
+enum { PM_OUTSIDE, PM_INSIDE, PM_OTHER, PM_ENDED };     /* where a command buffer is recording */
+enum { PM_END_PASS, PM_END_PASS2, PM_END_RENDERING };   /* how a held end goes out */
+
+#define PM_HOOKS(X) \
+    X(vkAllocateCommandBuffers) X(vkFreeCommandBuffers) X(vkDestroyCommandPool) X(vkBeginCommandBuffer) X(vkEndCommandBuffer) \
+    X(vkCmdBeginRenderPass) X(vkCmdBeginRenderPass2) X(vkCmdBeginRendering) \
+    X(vkCmdEndRenderPass) X(vkCmdEndRenderPass2) X(vkCmdEndRendering) \
+    PM_FLUSH_HOOKS(X)
+/* commands recorded outside a pass that a held end goes out before */
+#define PM_FLUSH_HOOKS(X) \
+    X(vkCmdExecuteCommands) X(vkCmdClearAttachments) X(vkCmdPipelineBarrier) X(vkCmdPipelineBarrier2) \
+    X(vkCmdDispatch) X(vkCmdDispatchIndirect) X(vkCmdDispatchBase) \
+    X(vkCmdCopyBuffer) X(vkCmdCopyImage) X(vkCmdBlitImage) X(vkCmdCopyBufferToImage) X(vkCmdCopyImageToBuffer) \
+    X(vkCmdUpdateBuffer) X(vkCmdFillBuffer) X(vkCmdClearColorImage) X(vkCmdClearDepthStencilImage) X(vkCmdResolveImage) \
+    X(vkCmdCopyBuffer2) X(vkCmdCopyImage2) X(vkCmdBlitImage2) X(vkCmdCopyBufferToImage2) X(vkCmdCopyImageToBuffer2) X(vkCmdResolveImage2) \
+    X(vkCmdSetEvent) X(vkCmdResetEvent) X(vkCmdWaitEvents) X(vkCmdSetEvent2) X(vkCmdResetEvent2) X(vkCmdWaitEvents2) \
+    X(vkCmdBeginQuery) X(vkCmdEndQuery) X(vkCmdResetQueryPool) X(vkCmdWriteTimestamp) X(vkCmdWriteTimestamp2) X(vkCmdCopyQueryPoolResults) \
+    X(vkCmdBeginQueryIndexedEXT) X(vkCmdEndQueryIndexedEXT) X(vkCmdWriteBufferMarkerAMD) X(vkCmdWriteBufferMarker2AMD) \
+    X(vkCmdBeginConditionalRenderingEXT) X(vkCmdEndConditionalRenderingEXT) \
+    X(vkCmdTraceRaysKHR) X(vkCmdTraceRaysIndirectKHR) X(vkCmdTraceRaysIndirect2KHR) \
+    X(vkCmdBuildAccelerationStructuresKHR) X(vkCmdBuildAccelerationStructuresIndirectKHR) X(vkCmdCopyAccelerationStructureKHR) \
+    X(vkCmdCopyAccelerationStructureToMemoryKHR) X(vkCmdCopyMemoryToAccelerationStructureKHR) X(vkCmdWriteAccelerationStructuresPropertiesKHR) \
+    X(vkCmdBeginDebugUtilsLabelEXT) X(vkCmdEndDebugUtilsLabelEXT) X(vkCmdInsertDebugUtilsLabelEXT) \
+    X(vkCmdDebugMarkerBeginEXT) X(vkCmdDebugMarkerEndEXT) X(vkCmdDebugMarkerInsertEXT)
+
+/* other names of the hooked entrypoints; the driver may only know one of them */
+static const struct { const char* name; const char* alias; } pm_aliases[] = {
+    { "vkCmdBeginRenderPass2", "vkCmdBeginRenderPass2KHR" }, { "vkCmdEndRenderPass2", "vkCmdEndRenderPass2KHR" },
+    { "vkCmdBeginRendering", "vkCmdBeginRenderingKHR" }, { "vkCmdEndRendering", "vkCmdEndRenderingKHR" },
+    { "vkCmdPipelineBarrier2", "vkCmdPipelineBarrier2KHR" }, { "vkCmdDispatchBase", "vkCmdDispatchBaseKHR" },
+    { "vkCmdCopyBuffer2", "vkCmdCopyBuffer2KHR" }, { "vkCmdCopyImage2", "vkCmdCopyImage2KHR" }, { "vkCmdBlitImage2", "vkCmdBlitImage2KHR" },
+    { "vkCmdCopyBufferToImage2", "vkCmdCopyBufferToImage2KHR" }, { "vkCmdCopyImageToBuffer2", "vkCmdCopyImageToBuffer2KHR" },
+    { "vkCmdResolveImage2", "vkCmdResolveImage2KHR" },
+    { "vkCmdSetEvent2", "vkCmdSetEvent2KHR" }, { "vkCmdResetEvent2", "vkCmdResetEvent2KHR" }, { "vkCmdWaitEvents2", "vkCmdWaitEvents2KHR" },
+    { "vkCmdWriteTimestamp2", "vkCmdWriteTimestamp2KHR" },
+};
+#define PM_ALIAS_COUNT (sizeof(pm_aliases) / sizeof(pm_aliases[0]))
+
+/* commands valid outside a pass that do not pass through here */
+static const char* const pm_unseen[] = {
+    "vkCmdTraceRaysNV", "vkCmdBuildAccelerationStructureNV", "vkCmdCopyAccelerationStructureNV", "vkCmdWriteAccelerationStructuresPropertiesNV",
+    "vkCmdBuildMicromapsEXT", "vkCmdCopyMicromapEXT", "vkCmdCopyMicromapToMemoryEXT", "vkCmdCopyMemoryToMicromapEXT", "vkCmdWriteMicromapsPropertiesEXT",
+    "vkCmdExecuteGeneratedCommandsNV", "vkCmdExecuteGeneratedCommandsEXT", "vkCmdPreprocessGeneratedCommandsNV", "vkCmdPreprocessGeneratedCommandsEXT",
+    "vkCmdDecodeVideoKHR", "vkCmdEncodeVideoKHR", "vkCmdBeginVideoCodingKHR",
+    "vkCmdDispatchGraphAMDX", "vkCmdDispatchGraphIndirectAMDX", "vkCmdDispatchGraphIndirectCountAMDX",
+    "vkCmdCopyMemoryIndirectNV", "vkCmdCopyMemoryToImageIndirectNV", "vkCmdDecompressMemoryNV", "vkCmdDecompressMemoryIndirectCountNV",
+    "vkCmdCuLaunchKernelNVX", "vkCmdCudaLaunchKernelNV", "vkCmdOpticalFlowExecuteNV", "vkCmdUpdatePipelineIndirectBufferNV",
+};
+
+typedef struct pm_pair {                /* one pair of instances merged */
+    uint64_t first, second;             /* VkRenderPass, or the hash of the attachment views */
+    int rendering;
+    _Atomic uint64_t merges, clears, bytes;
+} pm_pair_t;
+
+typedef struct xeno_passmerge_device {
+    xeno_device_t* dev;
+#define PM_NEXT(fn) PFN_##fn next_##fn;
+    PM_HOOKS(PM_NEXT)
+#undef PM_NEXT
+    char title[96];
+    xeno_map_t pairs;                   /* hash of both ids -> pm_pair_t */
+    pthread_mutex_t pair_lock;          /* inserts into pairs */
+    _Atomic uint64_t n[PM_COUNTERS], bytes, recorded;
+} xeno_passmerge_device_t;
+
+/* the ops of one attachment; dynamic rendering slots use load and store only */
+typedef struct pm_ops { VkAttachmentLoadOp load, stencil_load; VkAttachmentStoreOp store, stencil_store; } pm_ops_t;
+
+typedef struct pm_pass {
+    xeno_resource_user_t user;          /* kept on the render pass record */
+    int mergeable;                      /* single subpass, no extension structs, input, resolve or feedback attachments, external dependencies on attachments only */
+    uint64_t compat;                    /* everything but the ops and initial layouts */
+    uint32_t count;
+    VkFormat formats[PM_MAX_ATTACHMENTS];
+    VkSampleCountFlagBits samples[PM_MAX_ATTACHMENTS];
+    pm_ops_t ops[PM_MAX_ATTACHMENTS];   /* stencil ops of formats without stencil DONT_CARE */
+    uint32_t clear_index[PM_MAX_ATTACHMENTS];           /* colorAttachment of vkCmdClearAttachments */
+    VkImageAspectFlags load_aspect[PM_MAX_ATTACHMENTS], stencil_aspect[PM_MAX_ATTACHMENTS]; /* cleared by the load ops, 0 when unused */
+    uint32_t view_mask;
+} pm_pass_t;
+
+typedef struct pm_instance {            /* a render pass instance as a merge sees it */
+    int rendering;
+    uint64_t sig;                       /* equal for instances that can continue each other */
+    uint64_t id;
+    uint32_t slots;
+    pm_ops_t ops[PM_SLOTS];
+    VkFormat formats[PM_SLOTS];
+    VkSampleCountFlagBits samples[PM_SLOTS];
+    uint32_t clear_index[PM_SLOTS];
+    VkImageAspectFlags load_aspect[PM_SLOTS], stencil_aspect[PM_SLOTS];
+    VkClearValue clears[PM_SLOTS];
+    VkRect2D area;
+    uint32_t layers, view_mask;
+} pm_instance_t;
+
+typedef struct pm_cb {
+    xeno_passmerge_device_t* pd;
+    VkCommandBuffer handle;
+    VkCommandPool pool;
+    int state;                          /* PM_OUTSIDE, ... */
+    int end_kind;                       /* of the held end */
+    VkSubpassEndInfo end_info;
+    pm_instance_t cur;                  /* the open instance; its ops are the ones the merged instance ends with */
+    pm_instance_t last;                 /* the instance merged last, the one a merge saves the stores of */
+    pm_instance_t next;                 /* the instance being begun */
+    uint64_t n[PM_COUNTERS], bytes;
+} pm_cb_t;
+
+static xeno_map_t pm_cbs;
+static pthread_once_t pm_cbs_once = PTHREAD_ONCE_INIT;
+static void pm_cbs_init(void) { xeno_map_init(&pm_cbs, 4096); }
+
+static inline pm_cb_t* pm_cb(VkCommandBuffer commandBuffer) { return xeno_map_get(&pm_cbs, XENO_HANDLE_KEY(commandBuffer)); }
+
+static inline uint64_t mix(uint64_t h, uint64_t v) { return xeno_hash64(&v, sizeof(v), h); }
+
+static int has_stencil(VkFormat format) {
+    return format == VK_FORMAT_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+/* layouts an attachment can be read through a descriptor in while it is attached */
+static int feedback(VkImageLayout layout) { return layout == VK_IMAGE_LAYOUT_GENERAL || layout == VK_IMAGE_LAYOUT_ATTACHMENT_FEEDBACK_LOOP_OPTIMAL_EXT; }
+
+/* --- render pass objects --- */
+static void pass_attachment(pm_pass_t* p, uint32_t i, VkFormat format, VkSampleCountFlagBits samples, pm_ops_t ops) {
+    p->formats[i] = format; p->samples[i] = samples;
+    /* ops a format has no aspect for do nothing */
+    if (!has_stencil(format)) ops.stencil_load = VK_ATTACHMENT_LOAD_OP_DONT_CARE, ops.stencil_store = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    if (format == VK_FORMAT_S8_UINT) ops.load = VK_ATTACHMENT_LOAD_OP_DONT_CARE, ops.store = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    p->ops[i] = ops;
+    p->clear_index[i] = PM_NONE;
+}
+
+/* the attachment the first subpass uses as its depth/stencil attachment */
+static void pass_depth(pm_pass_t* p, uint32_t attachment) {
+    if (attachment >= p->count) return;
+    VkFormat f = p->formats[attachment];
+    p->load_aspect[attachment] = f == VK_FORMAT_S8_UINT ? 0 : VK_IMAGE_ASPECT_DEPTH_BIT;
+    p->stencil_aspect[attachment] = has_stencil(f) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0;
+}
+
+static void pass_color(pm_pass_t* p, uint32_t index, uint32_t attachment) {
+    if (attachment >= p->count) return;
+    p->clear_index[attachment] = index;
+    p->load_aspect[attachment] = VK_IMAGE_ASPECT_COLOR_BIT;
+}
+
+/* a dependency on commands outside the pass that orders nothing but attachment access: merging
+ * drops the first instance's dependency out and the second's in, and only attachment access stays
+ * ordered inside one subpass (TOP_OF_PIPE waited on and BOTTOM_OF_PIPE waiting order nothing) */
+static int dep_attachment_only(uint32_t src, uint32_t dst, VkPipelineStageFlags src_stages, VkPipelineStageFlags dst_stages,
+                               VkAccessFlags src_access, VkAccessFlags dst_access) {
+    const VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+                                        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    const VkAccessFlags access = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                 VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    if (src != VK_SUBPASS_EXTERNAL && dst != VK_SUBPASS_EXTERNAL) return 1;
+    return !(src_stages & ~(stages | VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT)) && !(dst_stages & ~(stages | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT)) &&
+           !(src_access & ~access) && !(dst_access & ~access);
+}
+
+static void pass_release(xeno_resource_user_t* u) { free(u); }
+
+static pm_pass_t* pass_v1(const VkRenderPassCreateInfo* ci, int extended) {
+    pm_pass_t* p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    p->user.release = pass_release;
+    const VkSubpassDescription* sp = ci->pSubpasses;
+    if (extended || ci->subpassCount != 1 || ci->attachmentCount > PM_MAX_ATTACHMENTS || sp->colorAttachmentCount > PM_MAX_ATTACHMENTS ||
+        sp->inputAttachmentCount) return p;
+    for (uint32_t i = 0; sp->pResolveAttachments && i < sp->colorAttachmentCount; ++i)
+        if (sp->pResolveAttachments[i].attachment != VK_ATTACHMENT_UNUSED) return p;
+    p->count = ci->attachmentCount;
+    uint64_t h = mix(1, p->count);
+    for (uint32_t i = 0; i < p->count; ++i) {
+        const VkAttachmentDescription* a = &ci->pAttachments[i];
+        pass_attachment(p, i, a->format, a->samples, (pm_ops_t){ a->loadOp, a->stencilLoadOp, a->storeOp, a->stencilStoreOp });
+        h = mix(mix(mix(mix(h, a->flags), a->format), a->samples), a->finalLayout);
+    }
+    h = mix(mix(mix(h, sp->flags), sp->pipelineBindPoint), sp->colorAttachmentCount);
+    for (uint32_t i = 0; i < sp->colorAttachmentCount; ++i) {
+        if (feedback(sp->pColorAttachments[i].layout)) return p;
+        pass_color(p, i, sp->pColorAttachments[i].attachment);
+        h = mix(mix(h, sp->pColorAttachments[i].attachment), sp->pColorAttachments[i].layout);
+    }
+    if (sp->pDepthStencilAttachment) {
+        if (feedback(sp->pDepthStencilAttachment->layout)) return p;
+        pass_depth(p, sp->pDepthStencilAttachment->attachment);
+        h = mix(mix(h, sp->pDepthStencilAttachment->attachment), sp->pDepthStencilAttachment->layout);
+    }
+    for (uint32_t i = 0; i < ci->dependencyCount; ++i) {
+        const VkSubpassDependency* d = &ci->pDependencies[i];
+        if (!dep_attachment_only(d->srcSubpass, d->dstSubpass, d->srcStageMask, d->dstStageMask, d->srcAccessMask, d->dstAccessMask)) return p;
+        h = mix(mix(mix(mix(mix(mix(mix(h, d->srcSubpass), d->dstSubpass), d->srcStageMask), d->dstStageMask), d->srcAccessMask), d->dstAccessMask), d->dependencyFlags);
+    }
+    p->compat = h;
+    p->mergeable = 1;
+    return p;
+}
+
+/* the tracker's copy keeps a depth/stencil resolve on the subpass; every other extension struct marks the pass extended */
+static pm_pass_t* pass_v2(const VkRenderPassCreateInfo2* ci, int extended) {
+    pm_pass_t* p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    p->user.release = pass_release;
+    const VkSubpassDescription2* sp = ci->pSubpasses;
+    if (extended || ci->subpassCount != 1 || ci->attachmentCount > PM_MAX_ATTACHMENTS || sp->pNext || sp->colorAttachmentCount > PM_MAX_ATTACHMENTS ||
+        sp->inputAttachmentCount) return p;
+    for (uint32_t i = 0; sp->pResolveAttachments && i < sp->colorAttachmentCount; ++i)
+        if (sp->pResolveAttachments[i].attachment != VK_ATTACHMENT_UNUSED) return p;
+    p->count = ci->attachmentCount;
+    uint64_t h = mix(2, p->count);
+    for (uint32_t i = 0; i < p->count; ++i) {
+        const VkAttachmentDescription2* a = &ci->pAttachments[i];
+        pass_attachment(p, i, a->format, a->samples, (pm_ops_t){ a->loadOp, a->stencilLoadOp, a->storeOp, a->stencilStoreOp });
+        h = mix(mix(mix(mix(h, a->flags), a->format), a->samples), a->finalLayout);
+    }
+    h = mix(mix(mix(mix(h, sp->flags), sp->pipelineBindPoint), sp->viewMask), sp->colorAttachmentCount);
+    for (uint32_t i = 0; i < sp->colorAttachmentCount; ++i) {
+        const VkAttachmentReference2* r = &sp->pColorAttachments[i];
+        if (feedback(r->layout)) return p;
+        pass_color(p, i, r->attachment);
+        h = mix(mix(mix(h, r->attachment), r->layout), r->aspectMask);
+    }
+    if (sp->pDepthStencilAttachment) {
+        const VkAttachmentReference2* r = sp->pDepthStencilAttachment;
+        if (feedback(r->layout)) return p;
+        pass_depth(p, r->attachment);
+        h = mix(mix(mix(h, r->attachment), r->layout), r->aspectMask);
+    }
+    for (uint32_t i = 0; i < ci->dependencyCount; ++i) {
+        const VkSubpassDependency2* d = &ci->pDependencies[i];
+        if (!dep_attachment_only(d->srcSubpass, d->dstSubpass, d->srcStageMask, d->dstStageMask, d->srcAccessMask, d->dstAccessMask)) return p;
+        h = mix(mix(mix(mix(mix(mix(mix(mix(h, d->srcSubpass), d->dstSubpass), d->srcStageMask), d->dstStageMask), d->srcAccessMask), d->dstAccessMask),
+                    d->dependencyFlags), (uint32_t)d->viewOffset);
+    }
+    for (uint32_t i = 0; i < ci->correlatedViewMaskCount; ++i) h = mix(h, ci->pCorrelatedViewMasks[i]);
+    p->view_mask = sp->viewMask;
+    p->compat = h;
+    p->mergeable = 1;
+    return p;
+}
+
+/* derived on the first begin and kept with the pass */
+static pm_pass_t* pass_get(VkRenderPass renderPass) {
+    xeno_render_pass_t* rp = xeno_render_pass_get(renderPass);
+    if (!rp) return NULL;
+    pm_pass_t* p = (pm_pass_t*)atomic_load_explicit(&rp->user[XENO_RESOURCE_PASSMERGE], memory_order_acquire);
+    if (p || !(p = rp->v2 ? pass_v2(rp->info2, rp->extended) : pass_v1(rp->info1, rp->extended))) return p;
+    return (pm_pass_t*)xeno_resource_attach(&rp->user[XENO_RESOURCE_PASSMERGE], &p->user);
+}
+
+/* --- describing instances --- */
+/* 0 when the begin can take part in a merge; inst is filled in then */
+static int describe_pass(const VkRenderPassBeginInfo* info, VkSubpassContents contents, const VkSubpassBeginInfo* subpass, pm_instance_t* inst) {
+    pm_pass_t* p = pass_get(info->renderPass);
+    xeno_framebuffer_t* fb = xeno_framebuffer_get(info->framebuffer);
+    if (!p || !p->mergeable || !fb || (subpass && subpass->pNext)) return -1;
+    uint64_t h = mix(mix(p->compat, XENO_HANDLE_KEY(info->framebuffer)), contents);
+    h = mix(mix(h, ((uint64_t)(uint32_t)info->renderArea.offset.x << 32) | (uint32_t)info->renderArea.offset.y),
+            ((uint64_t)info->renderArea.extent.width << 32) | info->renderArea.extent.height);
+    for (const VkBaseInStructure* s = info->pNext; s; s = s->pNext) {
+        if (s->sType != VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO) return -1;
+        const VkRenderPassAttachmentBeginInfo* views = (const VkRenderPassAttachmentBeginInfo*)s;
+        h = xeno_hash64(views->pAttachments, views->attachmentCount * sizeof(VkImageView), h);
+    }
+    inst->rendering = 0; inst->sig = h; inst->id = XENO_HANDLE_KEY(info->renderPass);
+    inst->slots = p->count;
+    memcpy(inst->ops, p->ops, p->count * sizeof(pm_ops_t));
+    memcpy(inst->formats, p->formats, p->count * sizeof(VkFormat));
+    memcpy(inst->samples, p->samples, p->count * sizeof(VkSampleCountFlagBits));
+    memcpy(inst->clear_index, p->clear_index, p->count * sizeof(uint32_t));
+    memcpy(inst->load_aspect, p->load_aspect, p->count * sizeof(VkImageAspectFlags));
+    memcpy(inst->stencil_aspect, p->stencil_aspect, p->count * sizeof(VkImageAspectFlags));
+    memset(inst->clears, 0, sizeof(inst->clears));
+    if (info->pClearValues) memcpy(inst->clears, info->pClearValues, (info->clearValueCount < p->count ? info->clearValueCount : p->count) * sizeof(VkClearValue));
+    inst->area = info->renderArea; inst->layers = fb->layers; inst->view_mask = p->view_mask;
+    return 0;
+}
+
+static int describe_rendering(const VkRenderingInfo* info, pm_instance_t* inst) {
+    uint32_t n = info->colorAttachmentCount;
+    if (info->pNext || n > PM_MAX_ATTACHMENTS || (info->flags & ~(VkRenderingFlags)VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT)) return -1;
+    uint64_t h = mix(mix(mix(mix(3, info->flags), info->layerCount), info->viewMask), n);
+    h = mix(mix(h, ((uint64_t)(uint32_t)info->renderArea.offset.x << 32) | (uint32_t)info->renderArea.offset.y),
+            ((uint64_t)info->renderArea.extent.width << 32) | info->renderArea.extent.height);
+    VkImageView views[PM_SLOTS];
+    inst->slots = n + 2;
+    for (uint32_t i = 0; i < inst->slots; ++i) {
+        const VkRenderingAttachmentInfo* a = i < n ? &info->pColorAttachments[i] : i == n ? info->pDepthAttachment : info->pStencilAttachment;
+        views[i] = a ? a->imageView : VK_NULL_HANDLE;
+        inst->clear_index[i] = i < n ? i : PM_NONE;
+        inst->load_aspect[i] = inst->stencil_aspect[i] = 0;
+        inst->ops[i] = (pm_ops_t){ VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE };
+        memset(&inst->clears[i], 0, sizeof(inst->clears[i]));
+        inst->formats[i] = VK_FORMAT_UNDEFINED; inst->samples[i] = VK_SAMPLE_COUNT_1_BIT;
+        h = mix(mix(h, XENO_HANDLE_KEY(views[i])), a ? a->imageLayout : 0);
+        if (!a || !a->imageView) continue;
+        if (a->pNext || a->resolveMode != VK_RESOLVE_MODE_NONE || feedback(a->imageLayout)) return -1;
+        inst->ops[i].load = a->loadOp; inst->ops[i].store = a->storeOp;
+        inst->clears[i] = a->clearValue;
+        inst->load_aspect[i] = i < n ? VK_IMAGE_ASPECT_COLOR_BIT : i == n ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_STENCIL_BIT;
+        const xeno_image_t* img = xeno_view_image(a->imageView);
+        if (img) { inst->formats[i] = i == n + 1 ? VK_FORMAT_S8_UINT : img->info.format; inst->samples[i] = img->info.samples; }
+    }
+    inst->rendering = 1; inst->sig = h; inst->id = xeno_hash64(views, inst->slots * sizeof(VkImageView), 0x72656e646572ull);
+    inst->area = info->renderArea; inst->layers = info->layerCount; inst->view_mask = info->viewMask;
+    return 0;
+}
+
+/* --- merging --- */
+/* the merged instance ends with cur's stores: none the next instance makes may be lost */
+static int matches(const pm_instance_t* cur, const pm_instance_t* next) {
+    if (cur->sig != next->sig || cur->slots != next->slots) return 0;
+    for (uint32_t i = 0; i < next->slots; ++i) {
+        const pm_ops_t* c = &cur->ops[i]; const pm_ops_t* o = &next->ops[i];
+        if ((o->store == VK_ATTACHMENT_STORE_OP_STORE && c->store != VK_ATTACHMENT_STORE_OP_STORE) ||
+            (o->stencil_store == VK_ATTACHMENT_STORE_OP_STORE && c->stencil_store != VK_ATTACHMENT_STORE_OP_STORE)) return 0;
+    }
+    return 1;
+}
+
+static int loads(VkAttachmentLoadOp op) { return op == VK_ATTACHMENT_LOAD_OP_LOAD || op == VK_ATTACHMENT_LOAD_OP_NONE_KHR; }
+
+static pm_pair_t* pair_stats(xeno_passmerge_device_t* pd, const pm_instance_t* first, const pm_instance_t* second) {
+    uint64_t key = mix(first->id, second->id);
+    pm_pair_t* s = xeno_map_get(&pd->pairs, key);
+    if (s || atomic_load_explicit(&pd->pairs.count, memory_order_relaxed) >= PM_MAX_PAIRS) return s;
+    pthread_mutex_lock(&pd->pair_lock);
+    if (!(s = xeno_map_get(&pd->pairs, key)) && pd->pairs.count < PM_MAX_PAIRS && (s = calloc(1, sizeof(*s)))) {
+        s->first = first->id; s->second = second->id; s->rendering = second->rendering;
+        xeno_map_put(&pd->pairs, key, s);
+    }
+    pthread_mutex_unlock(&pd->pair_lock);
+    return s;
+}
+
+/* the next instance continues the open one: its clears are recorded, the boundary's traffic counted */
+static void merge(pm_cb_t* cb) {
+    const pm_instance_t* prev = &cb->last; const pm_instance_t* next = &cb->next;
+    VkClearAttachment clears[PM_SLOTS];
+    uint32_t count = 0;
+    uint64_t area = (uint64_t)next->area.extent.width * next->area.extent.height *
+                    (next->view_mask ? (uint32_t)__builtin_popcount(next->view_mask) : (next->layers ? next->layers : 1));
+    uint64_t n_loads = 0, n_stores = 0, bytes = 0;
+    for (uint32_t i = 0; i < next->slots; ++i) {
+        const pm_ops_t* o = &next->ops[i];
+        VkImageAspectFlags aspect = (o->load == VK_ATTACHMENT_LOAD_OP_CLEAR ? next->load_aspect[i] : 0) |
+                                    (o->stencil_load == VK_ATTACHMENT_LOAD_OP_CLEAR ? next->stencil_aspect[i] : 0);
+        if (aspect) clears[count++] = (VkClearAttachment){ aspect, next->clear_index[i] == PM_NONE ? 0 : next->clear_index[i], next->clears[i] };
+        if (!next->load_aspect[i] && !next->stencil_aspect[i]) continue;    /* not used: neither loaded nor stored */
+        uint64_t size = area * xeno_format_texel_bytes(next->formats[i]) * (next->samples[i] ? next->samples[i] : 1);
+        if ((loads(o->load) && next->load_aspect[i]) || (loads(o->stencil_load) && next->stencil_aspect[i])) { n_loads++; bytes += size; }
+        if (prev->ops[i].store == VK_ATTACHMENT_STORE_OP_STORE || prev->ops[i].stencil_store == VK_ATTACHMENT_STORE_OP_STORE) { n_stores++; bytes += size; }
+    }
+    if (count) {
+        VkClearRect rect = { next->area, 0, next->view_mask ? 1 : (next->layers ? next->layers : 1) };
+        cb->pd->next_vkCmdClearAttachments(cb->handle, count, clears, 1, &rect);
+    }
+    cb->n[PM_MERGED]++; cb->n[PM_CLEARS_INSERTED] += count; cb->n[PM_LOADS_SAVED] += n_loads; cb->n[PM_STORES_SAVED] += n_stores;
+    cb->bytes += bytes;
+    pm_pair_t* s = pair_stats(cb->pd, prev, next);
+    if (s) {
+        atomic_fetch_add_explicit(&s->merges, 1, memory_order_relaxed);
+        if (count) atomic_fetch_add_explicit(&s->clears, count, memory_order_relaxed);
+        if (bytes) atomic_fetch_add_explicit(&s->bytes, bytes, memory_order_relaxed);
+    }
+    cb->last = cb->next;
+}
+
+static void emit_end(pm_cb_t* cb) {
+    xeno_passmerge_device_t* pd = cb->pd;
+    cb->state = PM_OUTSIDE;
+    if (cb->end_kind == PM_END_PASS2) pd->next_vkCmdEndRenderPass2(cb->handle, &cb->end_info);
+    else if (cb->end_kind == PM_END_RENDERING) pd->next_vkCmdEndRendering(cb->handle);
+    else pd->next_vkCmdEndRenderPass(cb->handle);
+}
+
+/* whether the begin described in cb->next (ok 0) went into the open instance; else the held end goes out */
+static int begin(pm_cb_t* cb, int ok) {
+    cb->n[PM_BEGINS]++;
+    if (ok == 0) cb->n[PM_MERGEABLE]++;
+    if (cb->state == PM_ENDED) {
+        if (ok == 0 && matches(&cb->cur, &cb->next)) { merge(cb); cb->state = PM_INSIDE; return 1; }
+        cb->n[PM_MISMATCHED]++;
+        emit_end(cb);
+    }
+    cb->state = ok == 0 ? PM_INSIDE : PM_OTHER;
+    if (ok == 0) { cb->cur = cb->next; cb->last = cb->next; }
+    return 0;
+}
+
+/* whether the end is held for the next begin to merge with */
+static int end(pm_cb_t* cb, int kind, const VkSubpassEndInfo* info) {
+    if (cb->state != PM_INSIDE || (info && info->pNext)) { cb->state = PM_OUTSIDE; return 0; }
+    cb->state = PM_ENDED; cb->end_kind = kind;
+    if (info) cb->end_info = *info;
+    cb->n[PM_ENDS_HELD]++;
+    return 1;
+}
+
+static inline pm_cb_t* pm_flush(VkCommandBuffer commandBuffer) {
+    pm_cb_t* cb = pm_cb(commandBuffer);
+    if (cb->state == PM_ENDED) { cb->n[PM_BROKEN]++; emit_end(cb); }
+    return cb;
+}
+
+/* --- intercepts --- */
+static VKAPI_ATTR void VKAPI_CALL pm_vkCmdBeginRenderPass(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo* pRenderPassBegin, VkSubpassContents contents) {
+    pm_cb_t* cb = pm_cb(commandBuffer);
+    if (!begin(cb, describe_pass(pRenderPassBegin, contents, NULL, &cb->next))) cb->pd->next_vkCmdBeginRenderPass(commandBuffer, pRenderPassBegin, contents);
+}
+static VKAPI_ATTR void VKAPI_CALL pm_vkCmdBeginRenderPass2(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo* pRenderPassBegin, const VkSubpassBeginInfo* pSubpassBeginInfo) {
+    pm_cb_t* cb = pm_cb(commandBuffer);
+    if (!begin(cb, describe_pass(pRenderPassBegin, pSubpassBeginInfo->contents, pSubpassBeginInfo, &cb->next)))
+        cb->pd->next_vkCmdBeginRenderPass2(commandBuffer, pRenderPassBegin, pSubpassBeginInfo);
+}
+static VKAPI_ATTR void VKAPI_CALL pm_vkCmdBeginRendering(VkCommandBuffer commandBuffer, const VkRenderingInfo* pRenderingInfo) {
+    pm_cb_t* cb = pm_cb(commandBuffer);
+    if (!begin(cb, describe_rendering(pRenderingInfo, &cb->next))) cb->pd->next_vkCmdBeginRendering(commandBuffer, pRenderingInfo);
+}
+static VKAPI_ATTR void VKAPI_CALL pm_vkCmdEndRenderPass(VkCommandBuffer commandBuffer) {
+    pm_cb_t* cb = pm_cb(commandBuffer);
+    if (!end(cb, PM_END_PASS, NULL)) cb->pd->next_vkCmdEndRenderPass(commandBuffer);
+}
+static VKAPI_ATTR void VKAPI_CALL pm_vkCmdEndRenderPass2(VkCommandBuffer commandBuffer, const VkSubpassEndInfo* pSubpassEndInfo) {
+    pm_cb_t* cb = pm_cb(commandBuffer);
+    if (!end(cb, PM_END_PASS2, pSubpassEndInfo)) cb->pd->next_vkCmdEndRenderPass2(commandBuffer, pSubpassEndInfo);
+}
+static VKAPI_ATTR void VKAPI_CALL pm_vkCmdEndRendering(VkCommandBuffer commandBuffer) {
+    pm_cb_t* cb = pm_cb(commandBuffer);
+    if (!end(cb, PM_END_RENDERING, NULL)) cb->pd->next_vkCmdEndRendering(commandBuffer);
+}
+
+#define PM_FLUSH(fn, params, args) \
+    static VKAPI_ATTR void VKAPI_CALL pm_##fn params { pm_flush(commandBuffer)->pd->next_##fn args; }
+PM_FLUSH(vkCmdExecuteCommands, (VkCommandBuffer commandBuffer, uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers), (commandBuffer, commandBufferCount, pCommandBuffers))
+PM_FLUSH(vkCmdClearAttachments, (VkCommandBuffer commandBuffer, uint32_t attachmentCount, const VkClearAttachment* pAttachments, uint32_t rectCount, const VkClearRect* pRects),
+         (commandBuffer, attachmentCount, pAttachments, rectCount, pRects))
+PM_FLUSH(vkCmdPipelineBarrier, (VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, VkDependencyFlags dependencyFlags,
+                                uint32_t memoryBarrierCount, const VkMemoryBarrier* pMemoryBarriers, uint32_t bufferMemoryBarrierCount, const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+                                uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* pImageMemoryBarriers),
+         (commandBuffer, srcStageMask, dstStageMask, dependencyFlags, memoryBarrierCount, pMemoryBarriers, bufferMemoryBarrierCount, pBufferMemoryBarriers,
+          imageMemoryBarrierCount, pImageMemoryBarriers))
+PM_FLUSH(vkCmdPipelineBarrier2, (VkCommandBuffer commandBuffer, const VkDependencyInfo* pDependencyInfo), (commandBuffer, pDependencyInfo))
+PM_FLUSH(vkCmdDispatch, (VkCommandBuffer commandBuffer, uint32_t x, uint32_t y, uint32_t z), (commandBuffer, x, y, z))
+PM_FLUSH(vkCmdDispatchIndirect, (VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset), (commandBuffer, buffer, offset))
+PM_FLUSH(vkCmdDispatchBase, (VkCommandBuffer commandBuffer, uint32_t baseX, uint32_t baseY, uint32_t baseZ, uint32_t x, uint32_t y, uint32_t z),
+         (commandBuffer, baseX, baseY, baseZ, x, y, z))
+PM_FLUSH(vkCmdCopyBuffer, (VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkBuffer dstBuffer, uint32_t regionCount, const VkBufferCopy* pRegions),
+         (commandBuffer, srcBuffer, dstBuffer, regionCount, pRegions))
+PM_FLUSH(vkCmdCopyImage, (VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcImageLayout, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkImageCopy* pRegions),
+         (commandBuffer, srcImage, srcImageLayout, dstImage, dstImageLayout, regionCount, pRegions))
+PM_FLUSH(vkCmdBlitImage, (VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcImageLayout, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkImageBlit* pRegions, VkFilter filter),
+         (commandBuffer, srcImage, srcImageLayout, dstImage, dstImageLayout, regionCount, pRegions, filter))
+PM_FLUSH(vkCmdCopyBufferToImage, (VkCommandBuffer commandBuffer, VkBuffer srcBuffer, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkBufferImageCopy* pRegions),
+         (commandBuffer, srcBuffer, dstImage, dstImageLayout, regionCount, pRegions))
+PM_FLUSH(vkCmdCopyImageToBuffer, (VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcImageLayout, VkBuffer dstBuffer, uint32_t regionCount, const VkBufferImageCopy* pRegions),
+         (commandBuffer, srcImage, srcImageLayout, dstBuffer, regionCount, pRegions))
+PM_FLUSH(vkCmdUpdateBuffer, (VkCommandBuffer commandBuffer, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize dataSize, const void* pData),
+         (commandBuffer, dstBuffer, dstOffset, dataSize, pData))
+PM_FLUSH(vkCmdFillBuffer, (VkCommandBuffer commandBuffer, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize size, uint32_t data),
+         (commandBuffer, dstBuffer, dstOffset, size, data))
+PM_FLUSH(vkCmdClearColorImage, (VkCommandBuffer commandBuffer, VkImage image, VkImageLayout imageLayout, const VkClearColorValue* pColor, uint32_t rangeCount, const VkImageSubresourceRange* pRanges),
+         (commandBuffer, image, imageLayout, pColor, rangeCount, pRanges))
+PM_FLUSH(vkCmdClearDepthStencilImage, (VkCommandBuffer commandBuffer, VkImage image, VkImageLayout imageLayout, const VkClearDepthStencilValue* pDepthStencil, uint32_t rangeCount, const VkImageSubresourceRange* pRanges),
+         (commandBuffer, image, imageLayout, pDepthStencil, rangeCount, pRanges))
+PM_FLUSH(vkCmdResolveImage, (VkCommandBuffer commandBuffer, VkImage srcImage, VkImageLayout srcImageLayout, VkImage dstImage, VkImageLayout dstImageLayout, uint32_t regionCount, const VkImageResolve* pRegions),
+         (commandBuffer, srcImage, srcImageLayout, dstImage, dstImageLayout, regionCount, pRegions))
+PM_FLUSH(vkCmdCopyBuffer2, (VkCommandBuffer commandBuffer, const VkCopyBufferInfo2* pInfo), (commandBuffer, pInfo))
+PM_FLUSH(vkCmdCopyImage2, (VkCommandBuffer commandBuffer, const VkCopyImageInfo2* pInfo), (commandBuffer, pInfo))
+PM_FLUSH(vkCmdBlitImage2, (VkCommandBuffer commandBuffer, const VkBlitImageInfo2* pInfo), (commandBuffer, pInfo))
+PM_FLUSH(vkCmdCopyBufferToImage2, (VkCommandBuffer commandBuffer, const VkCopyBufferToImageInfo2* pInfo), (commandBuffer, pInfo))
+PM_FLUSH(vkCmdCopyImageToBuffer2, (VkCommandBuffer commandBuffer, const VkCopyImageToBufferInfo2* pInfo), (commandBuffer, pInfo))
+PM_FLUSH(vkCmdResolveImage2, (VkCommandBuffer commandBuffer, const VkResolveImageInfo2* pInfo), (commandBuffer, pInfo))
+PM_FLUSH(vkCmdSetEvent, (VkCommandBuffer commandBuffer, VkEvent event, VkPipelineStageFlags stageMask), (commandBuffer, event, stageMask))
+PM_FLUSH(vkCmdResetEvent, (VkCommandBuffer commandBuffer, VkEvent event, VkPipelineStageFlags stageMask), (commandBuffer, event, stageMask))
+PM_FLUSH(vkCmdWaitEvents, (VkCommandBuffer commandBuffer, uint32_t eventCount, const VkEvent* pEvents, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask,
+                           uint32_t memoryBarrierCount, const VkMemoryBarrier* pMemoryBarriers, uint32_t bufferMemoryBarrierCount, const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+                           uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* pImageMemoryBarriers),
+         (commandBuffer, eventCount, pEvents, srcStageMask, dstStageMask, memoryBarrierCount, pMemoryBarriers, bufferMemoryBarrierCount, pBufferMemoryBarriers,
+          imageMemoryBarrierCount, pImageMemoryBarriers))
+PM_FLUSH(vkCmdSetEvent2, (VkCommandBuffer commandBuffer, VkEvent event, const VkDependencyInfo* pDependencyInfo), (commandBuffer, event, pDependencyInfo))
+PM_FLUSH(vkCmdResetEvent2, (VkCommandBuffer commandBuffer, VkEvent event, VkPipelineStageFlags2 stageMask), (commandBuffer, event, stageMask))
+PM_FLUSH(vkCmdWaitEvents2, (VkCommandBuffer commandBuffer, uint32_t eventCount, const VkEvent* pEvents, const VkDependencyInfo* pDependencyInfos),
+         (commandBuffer, eventCount, pEvents, pDependencyInfos))
+PM_FLUSH(vkCmdBeginQuery, (VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t query, VkQueryControlFlags flags), (commandBuffer, queryPool, query, flags))
+PM_FLUSH(vkCmdEndQuery, (VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t query), (commandBuffer, queryPool, query))
+PM_FLUSH(vkCmdResetQueryPool, (VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t firstQuery, uint32_t queryCount), (commandBuffer, queryPool, firstQuery, queryCount))
+PM_FLUSH(vkCmdWriteTimestamp, (VkCommandBuffer commandBuffer, VkPipelineStageFlagBits pipelineStage, VkQueryPool queryPool, uint32_t query),
+         (commandBuffer, pipelineStage, queryPool, query))
+PM_FLUSH(vkCmdWriteTimestamp2, (VkCommandBuffer commandBuffer, VkPipelineStageFlags2 stage, VkQueryPool queryPool, uint32_t query), (commandBuffer, stage, queryPool, query))
+PM_FLUSH(vkCmdCopyQueryPoolResults, (VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t firstQuery, uint32_t queryCount, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize stride, VkQueryResultFlags flags),
+         (commandBuffer, queryPool, firstQuery, queryCount, dstBuffer, dstOffset, stride, flags))
+PM_FLUSH(vkCmdBeginQueryIndexedEXT, (VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t query, VkQueryControlFlags flags, uint32_t index),
+         (commandBuffer, queryPool, query, flags, index))
+PM_FLUSH(vkCmdEndQueryIndexedEXT, (VkCommandBuffer commandBuffer, VkQueryPool queryPool, uint32_t query, uint32_t index), (commandBuffer, queryPool, query, index))
+PM_FLUSH(vkCmdWriteBufferMarkerAMD, (VkCommandBuffer commandBuffer, VkPipelineStageFlagBits pipelineStage, VkBuffer dstBuffer, VkDeviceSize dstOffset, uint32_t marker),
+         (commandBuffer, pipelineStage, dstBuffer, dstOffset, marker))
+PM_FLUSH(vkCmdWriteBufferMarker2AMD, (VkCommandBuffer commandBuffer, VkPipelineStageFlags2 stage, VkBuffer dstBuffer, VkDeviceSize dstOffset, uint32_t marker),
+         (commandBuffer, stage, dstBuffer, dstOffset, marker))
+PM_FLUSH(vkCmdBeginConditionalRenderingEXT, (VkCommandBuffer commandBuffer, const VkConditionalRenderingBeginInfoEXT* pConditionalRenderingBegin), (commandBuffer, pConditionalRenderingBegin))
+PM_FLUSH(vkCmdEndConditionalRenderingEXT, (VkCommandBuffer commandBuffer), (commandBuffer))
+PM_FLUSH(vkCmdTraceRaysKHR, (VkCommandBuffer commandBuffer, const VkStridedDeviceAddressRegionKHR* pRaygen, const VkStridedDeviceAddressRegionKHR* pMiss,
+                             const VkStridedDeviceAddressRegionKHR* pHit, const VkStridedDeviceAddressRegionKHR* pCallable, uint32_t width, uint32_t height, uint32_t depth),
+         (commandBuffer, pRaygen, pMiss, pHit, pCallable, width, height, depth))
+PM_FLUSH(vkCmdTraceRaysIndirectKHR, (VkCommandBuffer commandBuffer, const VkStridedDeviceAddressRegionKHR* pRaygen, const VkStridedDeviceAddressRegionKHR* pMiss,
+                                     const VkStridedDeviceAddressRegionKHR* pHit, const VkStridedDeviceAddressRegionKHR* pCallable, VkDeviceAddress indirectDeviceAddress),
+         (commandBuffer, pRaygen, pMiss, pHit, pCallable, indirectDeviceAddress))
+PM_FLUSH(vkCmdTraceRaysIndirect2KHR, (VkCommandBuffer commandBuffer, VkDeviceAddress indirectDeviceAddress), (commandBuffer, indirectDeviceAddress))
+PM_FLUSH(vkCmdBuildAccelerationStructuresKHR, (VkCommandBuffer commandBuffer, uint32_t infoCount, const VkAccelerationStructureBuildGeometryInfoKHR* pInfos,
+                                               const VkAccelerationStructureBuildRangeInfoKHR* const* ppBuildRangeInfos),
+         (commandBuffer, infoCount, pInfos, ppBuildRangeInfos))
+PM_FLUSH(vkCmdBuildAccelerationStructuresIndirectKHR, (VkCommandBuffer commandBuffer, uint32_t infoCount, const VkAccelerationStructureBuildGeometryInfoKHR* pInfos,
+                                                       const VkDeviceAddress* pIndirectDeviceAddresses, const uint32_t* pIndirectStrides, const uint32_t* const* ppMaxPrimitiveCounts),
+         (commandBuffer, infoCount, pInfos, pIndirectDeviceAddresses, pIndirectStrides, ppMaxPrimitiveCounts))
+PM_FLUSH(vkCmdCopyAccelerationStructureKHR, (VkCommandBuffer commandBuffer, const VkCopyAccelerationStructureInfoKHR* pInfo), (commandBuffer, pInfo))
+PM_FLUSH(vkCmdCopyAccelerationStructureToMemoryKHR, (VkCommandBuffer commandBuffer, const VkCopyAccelerationStructureToMemoryInfoKHR* pInfo), (commandBuffer, pInfo))
+PM_FLUSH(vkCmdCopyMemoryToAccelerationStructureKHR, (VkCommandBuffer commandBuffer, const VkCopyMemoryToAccelerationStructureInfoKHR* pInfo), (commandBuffer, pInfo))
+PM_FLUSH(vkCmdWriteAccelerationStructuresPropertiesKHR, (VkCommandBuffer commandBuffer, uint32_t accelerationStructureCount, const VkAccelerationStructureKHR* pAccelerationStructures,
+                                                         VkQueryType queryType, VkQueryPool queryPool, uint32_t firstQuery),
+         (commandBuffer, accelerationStructureCount, pAccelerationStructures, queryType, queryPool, firstQuery))
+PM_FLUSH(vkCmdBeginDebugUtilsLabelEXT, (VkCommandBuffer commandBuffer, const VkDebugUtilsLabelEXT* pLabelInfo), (commandBuffer, pLabelInfo))
+PM_FLUSH(vkCmdEndDebugUtilsLabelEXT, (VkCommandBuffer commandBuffer), (commandBuffer))
+PM_FLUSH(vkCmdInsertDebugUtilsLabelEXT, (VkCommandBuffer commandBuffer, const VkDebugUtilsLabelEXT* pLabelInfo), (commandBuffer, pLabelInfo))
+PM_FLUSH(vkCmdDebugMarkerBeginEXT, (VkCommandBuffer commandBuffer, const VkDebugMarkerMarkerInfoEXT* pMarkerInfo), (commandBuffer, pMarkerInfo))
+PM_FLUSH(vkCmdDebugMarkerEndEXT, (VkCommandBuffer commandBuffer), (commandBuffer))
+PM_FLUSH(vkCmdDebugMarkerInsertEXT, (VkCommandBuffer commandBuffer, const VkDebugMarkerMarkerInfoEXT* pMarkerInfo), (commandBuffer, pMarkerInfo))
+#undef PM_FLUSH
+
+/* --- command buffer lifetime --- */
+static VKAPI_ATTR VkResult VKAPI_CALL pm_vkAllocateCommandBuffers(VkDevice device, const VkCommandBufferAllocateInfo* pAllocateInfo, VkCommandBuffer* pCommandBuffers) {
+    xeno_passmerge_device_t* pd = xeno_device_get(device)->passmerge;
+    VkResult r = pd->next_vkAllocateCommandBuffers(device, pAllocateInfo, pCommandBuffers);
+    if (r != VK_SUCCESS) return r;
+    for (uint32_t i = 0; i < pAllocateInfo->commandBufferCount; ++i) {
+        pm_cb_t* cb = calloc(1, sizeof(*cb));
+        if (!cb) {
+            while (i--) free(xeno_map_remove(&pm_cbs, XENO_HANDLE_KEY(pCommandBuffers[i])));
+            pd->next_vkFreeCommandBuffers(device, pAllocateInfo->commandPool, pAllocateInfo->commandBufferCount, pCommandBuffers);
+            for (uint32_t k = 0; k < pAllocateInfo->commandBufferCount; ++k) pCommandBuffers[k] = VK_NULL_HANDLE;
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        cb->pd = pd; cb->handle = pCommandBuffers[i]; cb->pool = pAllocateInfo->commandPool;
+        xeno_map_put(&pm_cbs, XENO_HANDLE_KEY(cb->handle), cb);
+    }
+    return r;
+}
+static VKAPI_ATTR void VKAPI_CALL pm_vkFreeCommandBuffers(VkDevice device, VkCommandPool commandPool, uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers) {
+    xeno_passmerge_device_t* pd = xeno_device_get(device)->passmerge;
+    for (uint32_t i = 0; i < commandBufferCount; ++i)
+        if (pCommandBuffers[i]) free(xeno_map_remove(&pm_cbs, XENO_HANDLE_KEY(pCommandBuffers[i])));
+    pd->next_vkFreeCommandBuffers(device, commandPool, commandBufferCount, pCommandBuffers);
+}
+typedef struct pm_walk { xeno_passmerge_device_t* pd; VkCommandPool pool; } pm_walk_t;
+static int free_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; pm_cb_t* cb = val; pm_walk_t* w = ctx;
+    if (cb->pd != w->pd || (w->pool && cb->pool != w->pool)) return 0;
+    free(cb); return 1;
+}
+static VKAPI_ATTR void VKAPI_CALL pm_vkDestroyCommandPool(VkDevice device, VkCommandPool commandPool, const VkAllocationCallbacks* pAllocator) {
+    xeno_passmerge_device_t* pd = xeno_device_get(device)->passmerge;
+    if (commandPool) { pm_walk_t w = { pd, commandPool }; xeno_map_foreach(&pm_cbs, free_walk_fn, &w); }
+    pd->next_vkDestroyCommandPool(device, commandPool, pAllocator);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL pm_vkBeginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeginInfo* pBeginInfo) {
+    pm_cb_t* cb = pm_cb(commandBuffer);
+    cb->state = PM_OUTSIDE;     /* a recording abandoned by a reset leaves nothing behind */
+    memset(cb->n, 0, sizeof(cb->n)); cb->bytes = 0;
+    return cb->pd->next_vkBeginCommandBuffer(commandBuffer, pBeginInfo);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL pm_vkEndCommandBuffer(VkCommandBuffer commandBuffer) {
+    pm_cb_t* cb = pm_cb(commandBuffer);
+    xeno_passmerge_device_t* pd = cb->pd;
+    if (cb->state == PM_ENDED) emit_end(cb);
+    for (int k = 0; k < PM_COUNTERS; ++k)
+        if (cb->n[k]) atomic_fetch_add_explicit(&pd->n[k], cb->n[k], memory_order_relaxed);
+    if (cb->bytes) atomic_fetch_add_explicit(&pd->bytes, cb->bytes, memory_order_relaxed);
+    memset(cb->n, 0, sizeof(cb->n)); cb->bytes = 0;
+    atomic_fetch_add_explicit(&pd->recorded, 1, memory_order_relaxed);
+    return pd->next_vkEndCommandBuffer(commandBuffer);
+}
+
+/* --- device lifetime / routing --- */
+static PFN_vkVoidFunction resolve(xeno_device_t* dev, const char* name) {
+    PFN_vkVoidFunction fn = xeno_device_loadstore_proc(dev, name);
+    for (size_t i = 0; !fn && i < PM_ALIAS_COUNT; ++i)
+        if (strcmp(pm_aliases[i].name, name) == 0) fn = xeno_device_loadstore_proc(dev, pm_aliases[i].alias);
+    return fn;
+}
+
+/* --- per-title knobs --- */
+/* the title-specific variable when it is set, the global one otherwise */
+static const char* title_knob(const char* title, const char* name, char* key, size_t n) {
+    snprintf(key, n, "%s_%s", name, title);
+    return title[0] && getenv(key) ? key : name;
+}
+
+int xeno_passmerge_init(xeno_device_t* dev) {
+    char title[96], key[160];
+    xeno_process_title(title, sizeof(title));
+    if (!xeno_env_bool(title_knob(title, "XCLIPSE_PASSMERGE", key, sizeof(key)), 0)) return 0;
+    for (size_t i = 0; i < sizeof(pm_unseen) / sizeof(pm_unseen[0]); ++i) {
+        if (!xeno_device_loadstore_proc(dev, pm_unseen[i])) continue;
+        xlog("passmerge: %s bypasses the layer, render pass instances are not merged", pm_unseen[i]);
+        return 0;
+    }
+    pthread_once(&pm_cbs_once, pm_cbs_init);
+    xeno_passmerge_device_t* pd = calloc(1, sizeof(*pd)); if (!pd) return -1;
+    pd->dev = dev;
+    memcpy(pd->title, title, sizeof(pd->title));
+#define PM_RESOLVE(fn) pd->next_##fn = (PFN_##fn)resolve(dev, #fn);
+    PM_HOOKS(PM_RESOLVE)
+#undef PM_RESOLVE
+    if (!pd->next_vkAllocateCommandBuffers || !pd->next_vkFreeCommandBuffers || !pd->next_vkDestroyCommandPool || !pd->next_vkBeginCommandBuffer ||
+        !pd->next_vkEndCommandBuffer || !pd->next_vkCmdBeginRenderPass || !pd->next_vkCmdEndRenderPass || !pd->next_vkCmdClearAttachments) { free(pd); return -1; }
+    xeno_map_init(&pd->pairs, 64);
+    pthread_mutex_init(&pd->pair_lock, NULL);
+    dev->passmerge = pd;
+    xlog("passmerge: merging consecutive render pass instances title=%s", title[0] ? title : "?");
+    return 0;
+}
+
+static int device_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; pm_cb_t* cb = val;
+    if (cb->pd != ctx) return 0;
+    free(cb); return 1;
+}
+static int free_fn(uint64_t key, void* val, void* ctx) { (void)key; (void)ctx; free(val); return 1; }
+
+void xeno_passmerge_destroy(xeno_device_t* dev) {
+    xeno_passmerge_device_t* pd = dev->passmerge;
+    if (!pd) return;
+    xeno_map_foreach(&pm_cbs, device_walk_fn, pd);   /* command buffers of pools the app leaked */
+    xeno_map_foreach(&pd->pairs, free_fn, NULL);
+    xeno_map_destroy(&pd->pairs);
+    pthread_mutex_destroy(&pd->pair_lock);
+    dev->passmerge = NULL;
+    free(pd);
+}
+
+PFN_vkVoidFunction xeno_passmerge_proc(xeno_device_t* dev, const char* name) {
+    xeno_passmerge_device_t* pd = dev->passmerge;
+    if (!pd || strncmp(name, "vk", 2) != 0) return NULL;
+    for (size_t i = 0; i < PM_ALIAS_COUNT; ++i)
+        if (strcmp(name, pm_aliases[i].alias) == 0) { name = pm_aliases[i].name; break; }
+#define PM_PROC(fn) if (pd->next_##fn && strcmp(name, #fn) == 0) return (PFN_vkVoidFunction)pm_##fn;
+    PM_HOOKS(PM_PROC)
+#undef PM_PROC
+    return NULL;
+}
+
+/* --- reporting --- */
+typedef struct pm_top { uint32_t count; pm_pair_t* s[PM_MAX_REPORTED]; uint64_t bytes[PM_MAX_REPORTED]; } pm_top_t;
+static int top_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; pm_top_t* t = ctx; pm_pair_t* s = val;
+    uint64_t bytes = atomic_load_explicit(&s->bytes, memory_order_relaxed);
+    uint32_t at = t->count;
+    while (at && t->bytes[at - 1] < bytes) --at;
+    if (at >= PM_MAX_REPORTED) return 0;
+    uint32_t last = t->count < PM_MAX_REPORTED ? t->count++ : PM_MAX_REPORTED - 1;
+    memmove(&t->s[at + 1], &t->s[at], (last - at) * sizeof(t->s[0]));
+    memmove(&t->bytes[at + 1], &t->bytes[at], (last - at) * sizeof(t->bytes[0]));
+    t->s[at] = s; t->bytes[at] = bytes;
+    return 0;
+}
+
+void xeno_passmerge_report(FILE* f, xeno_device_t* dev) {
+    xeno_passmerge_device_t* pd = dev->passmerge;
+    fprintf(f, "  \"passmerge\": {\"enabled\": %s", pd ? "true" : "false");
+    if (pd) {
+        uint64_t frames = atomic_load(&dev->frames), bytes = atomic_load(&pd->bytes), merged = atomic_load(&pd->n[PM_MERGED]);
+        fprintf(f, ", \"title\": \"%s\"", pd->title);
+        for (int k = 0; k < PM_COUNTERS; ++k) fprintf(f, ", \"%s\": %" PRIu64, pm_counter_names[k], atomic_load(&pd->n[k]));
+        fprintf(f, ", \"command_buffers\": %" PRIu64 ", \"frames\": %" PRIu64 ", \"merged_per_frame\": %.1f, \"mb_saved\": %.1f, \"mb_saved_per_frame\": %.2f",
+                atomic_load(&pd->recorded), frames, frames ? (double)merged / (double)frames : 0.0, (double)bytes / 1048576.0,
+                frames ? (double)bytes / 1048576.0 / (double)frames : 0.0);
+        /* the pairs are only freed with the device: their counters can be read outside the map */
+        pm_top_t top = { 0 };
+        xeno_map_foreach(&pd->pairs, top_fn, &top);
+        fprintf(f, ", \"pairs\": [");
+        for (uint32_t i = 0; i < top.count; ++i) {
+            const pm_pair_t* s = top.s[i];
+            fprintf(f, "%s{\"kind\": \"%s\", \"first\": \"0x%" PRIx64 "\", \"second\": \"0x%" PRIx64 "\", \"merges\": %" PRIu64 ", \"clears\": %" PRIu64 ", \"mb_saved\": %.1f}",
+                    i ? ", " : "", s->rendering ? "rendering" : "render_pass", s->first, s->second, (uint64_t)atomic_load(&s->merges),
+                    (uint64_t)atomic_load(&s->clears), (double)top.bytes[i] / 1048576.0);
+        }
+        fprintf(f, "]");
+    }
+    fprintf(f, "}");
+}
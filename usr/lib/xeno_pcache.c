@@ -0,0 +1,306 @@
+/* xeno_pcache.c - always-on persistent pipeline cache
+ *
+ * Every graphics/compute pipeline the device creates (app pipelines and the variants derived by the
+ * emulation modules) is compiled against a throw-away VkPipelineCache seeded from the on-disk store
+ * (xeno_pcache_store.c). Entries are keyed by the pipeline's shader combination: SPIR-V content
+ * hashes, entry points and specialization constants. Pipelines that differ only in fixed-function
+ * state share an entry, which grows as the driver adds them. When compiling added data the entry is
+ * rewritten; an app-provided cache still receives the result through vkMergePipelineCaches.
+ *
+ * The module interposes below the other modules by swapping the shader module / pipeline creation
+ * entrypoints in the device dispatch table, so their internal compiles are cached too. At device
+ * destruction the store is trimmed to its size budget (least recently used entries first),
+ * compacted when dead records outweigh live ones, and its index saved.
+ *
+ * The store may be open in several processes (e.g. a game and its launcher, or two sessions of the
+ * same app): a pipeline one of them compiles becomes a hit for the others on their next miss.
+ *
+ * Knobs:
+ *   XCLIPSE_PIPELINE_CACHE=0              disable
+ *   XCLIPSE_PIPELINE_CACHE_DIR=path       cache directory (default /data/local/tmp/xeno_pipeline_cache)
+ *   XCLIPSE_PIPELINE_CACHE_BUDGET_MB=N    live data kept on disk (default 256)
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+#define DEFAULT_CACHE_DIR "/data/local/tmp/xeno_pipeline_cache"
+#define PC_KEY_WORDS (2 + XENO_SO_STAGES * 8)
+#define COMPACT_MIN_DEAD (1ull << 20)
+
+typedef struct xeno_pcache_device {
+    xeno_pcache_store_t store;
+    uint64_t budget;
+    PFN_vkCreateShaderModule next_create_module;
+    PFN_vkDestroyShaderModule next_destroy_module;
+    PFN_vkCreateGraphicsPipelines next_create_graphics;
+    PFN_vkCreateComputePipelines next_create_compute;
+    xeno_map_t modules;             /* VkShaderModule -> xeno_variant_key_t of its SPIR-V */
+    pthread_mutex_t merge_lock;     /* app caches are externally synchronized merge targets */
+    _Atomic uint64_t hits, partial_hits, misses, bypassed, stores, store_failures;
+} xeno_pcache_device_t;
+
+static xeno_variant_key_t code_key(const uint32_t* code, size_t size) {
+    return xeno_variant_key(code, (uint32_t)(size / sizeof(uint32_t)));
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL pc_vkCreateShaderModule(VkDevice device, const VkShaderModuleCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkShaderModule* pShaderModule) {
+    xeno_pcache_device_t* pc = xeno_device_get(device)->pcache;
+    VkResult r = pc->next_create_module(device, pCreateInfo, pAllocator, pShaderModule);
+    if (r == VK_SUCCESS) {
+        xeno_variant_key_t* k = malloc(sizeof(*k));
+        if (k) { *k = code_key(pCreateInfo->pCode, pCreateInfo->codeSize); xeno_map_put(&pc->modules, XENO_HANDLE_KEY(*pShaderModule), k); }
+    }
+    return r;
+}
+
+static VKAPI_ATTR void VKAPI_CALL pc_vkDestroyShaderModule(VkDevice device, VkShaderModule module, const VkAllocationCallbacks* pAllocator) {
+    xeno_pcache_device_t* pc = xeno_device_get(device)->pcache;
+    if (module) free(xeno_map_remove(&pc->modules, XENO_HANDLE_KEY(module)));
+    pc->next_destroy_module(device, module, pAllocator);
+}
+
+/* Key of a shader combination; -1 when a stage's code cannot be identified */
+static int stages_key(xeno_pcache_device_t* pc, uint32_t type, uint32_t count, const VkPipelineShaderStageCreateInfo* stages, xeno_variant_key_t* out) {
+    uint32_t words[PC_KEY_WORDS]; uint32_t n = 0;
+    if (!count || count > XENO_SO_STAGES) return -1;
+    words[n++] = type; words[n++] = count;
+    for (uint32_t i = 0; i < count; ++i) {
+        const VkPipelineShaderStageCreateInfo* st = &stages[i];
+        xeno_variant_key_t code = { 0, 0 };
+        if (st->module) {
+            const xeno_variant_key_t* k = xeno_map_get(&pc->modules, XENO_HANDLE_KEY(st->module));
+            if (!k) return -1;
+            code = *k;
+        } else {
+            for (const VkBaseInStructure* p = st->pNext; p; p = p->pNext)
+                if (p->sType == VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO) {
+                    const VkShaderModuleCreateInfo* mi = (const VkShaderModuleCreateInfo*)p;
+                    code = code_key(mi->pCode, mi->codeSize);
+                }
+            if (!code.h1) return -1;
+        }
+        const char* name = st->pName ? st->pName : "main";
+        uint64_t spec = 0;
+        if (st->pSpecializationInfo) {
+            const VkSpecializationInfo* si = st->pSpecializationInfo;
+            spec = xeno_hash64(si->pMapEntries, si->mapEntryCount * sizeof(VkSpecializationMapEntry), 0x5bec);
+            spec = xeno_hash64(si->pData, si->dataSize, spec);
+        }
+        uint64_t nh = xeno_hash64(name, strlen(name), 0x6e61);
+        words[n++] = (uint32_t)st->stage;
+        words[n++] = (uint32_t)code.h1; words[n++] = (uint32_t)(code.h1 >> 32);
+        words[n++] = (uint32_t)code.h2; words[n++] = (uint32_t)(code.h2 >> 32);
+        words[n++] = (uint32_t)nh;
+        words[n++] = (uint32_t)spec; words[n++] = (uint32_t)(spec >> 32);
+    }
+    *out = xeno_variant_key(words, n);
+    return 0;
+}
+
+static int links_libraries(const void* pNext) {
+    for (const VkBaseInStructure* p = pNext; p; p = p->pNext)
+        if (p->sType == VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR) return 1;
+    return 0;
+}
+
+typedef struct pc_request {
+    const VkGraphicsPipelineCreateInfo* graphics;
+    const VkComputePipelineCreateInfo* compute;
+} pc_request_t;
+
+static VkResult call_next(xeno_device_t* dev, const pc_request_t* rq, VkPipelineCache cache, const VkAllocationCallbacks* pAllocator, VkPipeline* out) {
+    xeno_pcache_device_t* pc = dev->pcache;
+    if (rq->graphics) return pc->next_create_graphics(dev->handle, cache, 1, rq->graphics, pAllocator, out);
+    return pc->next_create_compute(dev->handle, cache, 1, rq->compute, pAllocator, out);
+}
+
+static VkResult create_cached(xeno_device_t* dev, const pc_request_t* rq, VkPipelineCache app_cache, const VkAllocationCallbacks* pAllocator, VkPipeline* out) {
+    xeno_pcache_device_t* pc = dev->pcache;
+    xeno_variant_key_t k; int keyed;
+    if (rq->graphics) {
+        const VkGraphicsPipelineCreateInfo* ci = rq->graphics;
+        keyed = !(ci->flags & VK_PIPELINE_CREATE_LIBRARY_BIT_KHR) && !links_libraries(ci->pNext) &&
+                stages_key(pc, 1, ci->stageCount, ci->pStages, &k) == 0;
+    } else {
+        keyed = stages_key(pc, 2, 1, &rq->compute->stage, &k) == 0;
+    }
+    if (!keyed) { atomic_fetch_add(&pc->bypassed, 1); return call_next(dev, rq, app_cache, pAllocator, out); }
+
+    void* blob = NULL; uint32_t blob_size = 0;
+    int found = xeno_pcache_get(&pc->store, k.h1, k.h2, &blob, &blob_size) == 0;
+    VkPipelineCacheCreateInfo pci; memset(&pci, 0, sizeof(pci));
+    pci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    pci.initialDataSize = blob_size; pci.pInitialData = blob;
+    VkPipelineCache tmp = VK_NULL_HANDLE;
+    VkResult r = dev->vk.vkCreatePipelineCache(dev->handle, &pci, NULL, &tmp);
+    if (r != VK_SUCCESS && found) {
+        pci.initialDataSize = 0; pci.pInitialData = NULL; found = 0; blob_size = 0;
+        r = dev->vk.vkCreatePipelineCache(dev->handle, &pci, NULL, &tmp);
+    }
+    free(blob);
+    if (r != VK_SUCCESS) { atomic_fetch_add(&pc->bypassed, 1); return call_next(dev, rq, app_cache, pAllocator, out); }
+
+    r = call_next(dev, rq, tmp, pAllocator, out);
+    if (r == VK_SUCCESS) {
+        size_t n = 0;
+        if (dev->vk.vkGetPipelineCacheData(dev->handle, tmp, &n, NULL) == VK_SUCCESS && n > blob_size) {
+            /* the driver compiled something it did not have: persist the grown blob */
+            void* data = n <= pc->budget / 4 && n < UINT32_MAX ? malloc(n) : NULL;
+            if (data && dev->vk.vkGetPipelineCacheData(dev->handle, tmp, &n, data) == VK_SUCCESS &&
+                xeno_pcache_put(&pc->store, k.h1, k.h2, data, (uint32_t)n) == 0) atomic_fetch_add(&pc->stores, 1);
+            else atomic_fetch_add(&pc->store_failures, 1);
+            free(data);
+            atomic_fetch_add(found ? &pc->partial_hits : &pc->misses, 1);
+        } else {
+            atomic_fetch_add(found ? &pc->hits : &pc->misses, 1);
+        }
+        if (app_cache) {
+            pthread_mutex_lock(&pc->merge_lock);
+            dev->vk.vkMergePipelineCaches(dev->handle, app_cache, 1, &tmp);
+            pthread_mutex_unlock(&pc->merge_lock);
+        }
+    }
+    dev->vk.vkDestroyPipelineCache(dev->handle, tmp, NULL);
+    return r;
+}
+
+/* Per-element results: errors take precedence over VK_PIPELINE_COMPILE_REQUIRED */
+static VkResult merge_result(VkResult total, VkResult r) {
+    if (r == VK_SUCCESS || total < 0) return total;
+    if (r < 0 || total == VK_SUCCESS) return r;
+    return total;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL pc_vkCreateGraphicsPipelines(VkDevice device, VkPipelineCache pipelineCache, uint32_t createInfoCount,
+                                                                   const VkGraphicsPipelineCreateInfo* pCreateInfos, const VkAllocationCallbacks* pAllocator, VkPipeline* pPipelines) {
+    xeno_device_t* dev = xeno_device_get(device);
+    VkResult result = VK_SUCCESS;
+    for (uint32_t i = 0; i < createInfoCount; ++i) {
+        pc_request_t rq = { &pCreateInfos[i], NULL };
+        VkResult r = create_cached(dev, &rq, pipelineCache, pAllocator, &pPipelines[i]);
+        if (r != VK_SUCCESS) pPipelines[i] = VK_NULL_HANDLE;
+        result = merge_result(result, r);
+        if (r != VK_SUCCESS && (pCreateInfos[i].flags & VK_PIPELINE_CREATE_EARLY_RETURN_ON_FAILURE_BIT)) {
+            for (uint32_t j = i + 1; j < createInfoCount; ++j) pPipelines[j] = VK_NULL_HANDLE;
+            break;
+        }
+    }
+    return result;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL pc_vkCreateComputePipelines(VkDevice device, VkPipelineCache pipelineCache, uint32_t createInfoCount,
+                                                                  const VkComputePipelineCreateInfo* pCreateInfos, const VkAllocationCallbacks* pAllocator, VkPipeline* pPipelines) {
+    xeno_device_t* dev = xeno_device_get(device);
+    VkResult result = VK_SUCCESS;
+    for (uint32_t i = 0; i < createInfoCount; ++i) {
+        pc_request_t rq = { NULL, &pCreateInfos[i] };
+        VkResult r = create_cached(dev, &rq, pipelineCache, pAllocator, &pPipelines[i]);
+        if (r != VK_SUCCESS) pPipelines[i] = VK_NULL_HANDLE;
+        result = merge_result(result, r);
+        if (r != VK_SUCCESS && (pCreateInfos[i].flags & VK_PIPELINE_CREATE_EARLY_RETURN_ON_FAILURE_BIT)) {
+            for (uint32_t j = i + 1; j < createInfoCount; ++j) pPipelines[j] = VK_NULL_HANDLE;
+            break;
+        }
+    }
+    return result;
+}
+
+/* driver identity from the header of an empty pipeline cache */
+static int driver_id(xeno_device_t* dev, xeno_pcache_id_t* id) {
+    VkPipelineCacheCreateInfo pci; memset(&pci, 0, sizeof(pci));
+    pci.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    VkPipelineCache c;
+    if (dev->vk.vkCreatePipelineCache(dev->handle, &pci, NULL, &c) != VK_SUCCESS) return -1;
+    VkPipelineCacheHeaderVersionOne h[4]; size_t n = sizeof(h); /* generous: some drivers append to an empty cache */
+    memset(h, 0, sizeof(h));
+    VkResult r = dev->vk.vkGetPipelineCacheData(dev->handle, c, &n, h);
+    dev->vk.vkDestroyPipelineCache(dev->handle, c, NULL);
+    if ((r != VK_SUCCESS && r != VK_INCOMPLETE) || n < sizeof(h[0])) return -1;
+    memset(id, 0, sizeof(*id));
+    id->vendor = h[0].vendorID; id->device = h[0].deviceID;
+    memcpy(id->uuid, h[0].pipelineCacheUUID, VK_UUID_SIZE);
+    return 0;
+}
+
+int xeno_pcache_device_init(xeno_device_t* dev) {
+    if (!xeno_env_bool("XCLIPSE_PIPELINE_CACHE", 1)) return 0;
+    const xeno_dispatch_t* vk = &dev->vk;
+    if (!vk->vkCreatePipelineCache || !vk->vkDestroyPipelineCache || !vk->vkGetPipelineCacheData || !vk->vkMergePipelineCaches ||
+        !vk->vkCreateShaderModule || !vk->vkDestroyShaderModule || !vk->vkCreateGraphicsPipelines || !vk->vkCreateComputePipelines) return -1;
+    xeno_pcache_id_t id;
+    if (driver_id(dev, &id) != 0) return -1;
+    xeno_pcache_device_t* pc = calloc(1, sizeof(*pc)); if (!pc) return -1;
+    const char* dir = getenv("XCLIPSE_PIPELINE_CACHE_DIR");
+    char uuid[2 * VK_UUID_SIZE + 1], base[512];
+    for (int i = 0; i < VK_UUID_SIZE; ++i) snprintf(uuid + 2 * i, 3, "%02x", id.uuid[i]);
+    snprintf(base, sizeof(base), "%s/%04x_%04x_%s", dir && dir[0] ? dir : DEFAULT_CACHE_DIR, id.vendor, id.device, uuid);
+    int r = xeno_pcache_open(&pc->store, base, &id, XENO_PCACHE_CREATE);
+    if (r != 0) { xlog("pcache: cannot open %s (%d)", base, r); xeno_pcache_close(&pc->store); free(pc); return -1; }
+    if (pc->store.reset) xlog("pcache: discarded %s built by another driver", base);
+    long mb = xeno_env_long("XCLIPSE_PIPELINE_CACHE_BUDGET_MB", 256);
+    pc->budget = (uint64_t)(mb > 1 ? mb : 1) << 20;
+    xeno_map_init(&pc->modules, 1024);
+    pthread_mutex_init(&pc->merge_lock, NULL);
+    /* interpose below every other module */
+    pc->next_create_module = dev->vk.vkCreateShaderModule; dev->vk.vkCreateShaderModule = pc_vkCreateShaderModule;
+    pc->next_destroy_module = dev->vk.vkDestroyShaderModule; dev->vk.vkDestroyShaderModule = pc_vkDestroyShaderModule;
+    pc->next_create_graphics = dev->vk.vkCreateGraphicsPipelines; dev->vk.vkCreateGraphicsPipelines = pc_vkCreateGraphicsPipelines;
+    pc->next_create_compute = dev->vk.vkCreateComputePipelines; dev->vk.vkCreateComputePipelines = pc_vkCreateComputePipelines;
+    dev->pcache = pc;
+    xlog("pcache: %s entries=%u live=%" PRIu64 " dead=%" PRIu64 " budget=%" PRIu64 " recovered=%" PRIu64,
+         base, pc->store.count, pc->store.live_bytes, xeno_pcache_dead_bytes(&pc->store), pc->budget, pc->store.recovered);
+    return 0;
+}
+
+static int module_free_fn(uint64_t key, void* val, void* ctx) { (void)key; (void)ctx; free(val); return 1; }
+
+void xeno_pcache_device_destroy(xeno_device_t* dev) {
+    xeno_pcache_device_t* pc = dev->pcache;
+    if (!pc) return;
+    dev->vk.vkCreateShaderModule = pc->next_create_module; dev->vk.vkDestroyShaderModule = pc->next_destroy_module;
+    dev->vk.vkCreateGraphicsPipelines = pc->next_create_graphics; dev->vk.vkCreateComputePipelines = pc->next_create_compute;
+    dev->pcache = NULL;
+    xeno_pcache_store_t* s = &pc->store;
+    uint32_t evicted = xeno_pcache_evict(s, pc->budget, 0);
+    uint64_t dead = xeno_pcache_dead_bytes(s);
+    if (dead > COMPACT_MIN_DEAD && dead > s->live_bytes && xeno_pcache_compact(s) != 0) xlog("pcache: compaction of %s failed", s->base);
+    if (xeno_pcache_save(s) != 0) xlog("pcache: saving index of %s failed", s->base);
+    xlog("pcache: closed entries=%u live=%" PRIu64 " evicted=%u compacted=%" PRIu64, s->count, s->live_bytes, evicted, dead - xeno_pcache_dead_bytes(s));
+    xeno_pcache_close(s);
+    xeno_map_foreach(&pc->modules, module_free_fn, NULL);
+    xeno_map_destroy(&pc->modules);
+    pthread_mutex_destroy(&pc->merge_lock);
+    free(pc);
+}
+
+PFN_vkVoidFunction xeno_pcache_proc(xeno_device_t* dev, const char* name) {
+    if (!dev->pcache) return NULL;
+    if (strcmp(name, "vkCreateShaderModule") == 0) return (PFN_vkVoidFunction)pc_vkCreateShaderModule;
+    if (strcmp(name, "vkDestroyShaderModule") == 0) return (PFN_vkVoidFunction)pc_vkDestroyShaderModule;
+    if (strcmp(name, "vkCreateGraphicsPipelines") == 0) return (PFN_vkVoidFunction)pc_vkCreateGraphicsPipelines;
+    if (strcmp(name, "vkCreateComputePipelines") == 0) return (PFN_vkVoidFunction)pc_vkCreateComputePipelines;
+    return NULL;
+}
+
+void xeno_pcache_report(FILE* f, xeno_device_t* dev) {
+    xeno_pcache_device_t* pc = dev->pcache;
+    fprintf(f, "  \"pipeline_cache\": {\"enabled\": %s", pc ? "true" : "false");
+    if (pc) {
+        xeno_pcache_store_t* s = &pc->store;
+        pthread_mutex_lock(&s->lock);
+        fprintf(f, ", \"entries\": %u, \"live_bytes\": %" PRIu64 ", \"dead_bytes\": %" PRIu64 ", \"budget_bytes\": %" PRIu64,
+                s->count, s->live_bytes, xeno_pcache_dead_bytes(s), pc->budget);
+        fprintf(f, ", \"recovered\": %" PRIu64 ", \"corrupt\": %" PRIu64 ", \"shared_records\": %" PRIu64 ", \"reopens\": %" PRIu64,
+                s->recovered, s->corrupt, s->refreshed, s->reopens);
+        pthread_mutex_unlock(&s->lock);
+        fprintf(f, ", \"hits\": %" PRIu64 ", \"partial_hits\": %" PRIu64 ", \"misses\": %" PRIu64 ", \"bypassed\": %" PRIu64
+                   ", \"stores\": %" PRIu64 ", \"store_failures\": %" PRIu64,
+                atomic_load(&pc->hits), atomic_load(&pc->partial_hits), atomic_load(&pc->misses), atomic_load(&pc->bypassed),
+                atomic_load(&pc->stores), atomic_load(&pc->store_failures));
+    }
+    fprintf(f, "}");
+}
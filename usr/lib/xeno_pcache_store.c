@@ -0,0 +1,535 @@
+/* xeno_pcache_store.c - on-disk pipeline cache: append-only pack file + index, shared between processes
+ *
+ * <base>.xpc (pack): a header identifying the driver (vendor, device, pipelineCacheUUID) followed by
+ * self-describing records { magic, size, key, checksum, data } padded to 8 bytes. Records are only
+ * ever appended; replacing or evicting an entry leaves a dead record behind until compaction.
+ * <base>.xpi (index): one fixed-size entry per live record with its pack offset and last-use stamp
+ * (wall clock seconds, so LRU order survives restarts). It is rewritten atomically (tmp + rename).
+ *
+ * Several processes may use the same cache at once:
+ * - readers mmap the pack and never take a file lock; the header's `committed` offset, stored with
+ *   release semantics through a shared mapping, is the end of the last complete record
+ * - writers append under an exclusive flock() on the pack, then publish the new `committed`; a
+ *   writer that died mid-record leaves bytes past `committed` that the next append overwrites
+ * - a lookup that misses first picks up records other processes committed since the last look, so
+ *   a pipeline compiled by one process is a hit in the others without restarting them
+ * - the pack is never truncated or rewritten in place (that would fault other processes' mappings):
+ *   compaction and driver changes build a new file, rename it over the old one and mark the old
+ *   header `retired`, which makes every other user reopen by name
+ *
+ * The pack carries a generation stamped at creation/compaction; an index whose generation does not
+ * match is ignored and rebuilt by scanning the pack, and records committed after the index was last
+ * written are picked up the same way. Index writers merge last-use stamps with the index on disk.
+ *
+ * Used by the wrapper (xeno_pcache.c) and by the xeno_pcache_tool CLI; file layout is little-endian.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "xeno_internal.h"
+
+#define PACK_MAGIC 0x4b435058u      /* "XPCK" */
+#define INDEX_MAGIC 0x49435058u     /* "XPCI" */
+#define RECORD_MAGIC 0x43455258u    /* "XREC" */
+#define STORE_VERSION 2
+#define CHECKSUM_SEED 0x7063616368ull
+#define HEADER_MAP_LEN 4096
+#define MIN_MAP_LEN (16ull << 20)
+
+typedef struct pack_header {
+    uint32_t magic, version;
+    xeno_pcache_id_t id;
+    uint64_t generation;
+    _Atomic uint64_t committed;     /* end of the last complete record */
+    _Atomic uint32_t retired;       /* the file was replaced; reopen by name */
+    uint32_t reserved;
+} pack_header_t;
+typedef struct record_header { uint32_t magic, size; uint64_t h1, h2, checksum; } record_header_t;
+typedef struct index_header { uint32_t magic, version; xeno_pcache_id_t id; uint32_t count, reserved; uint64_t generation, pack_size; } index_header_t;
+_Static_assert(sizeof(pack_header_t) == 56, "pack header layout");
+
+#define HDR(s) ((pack_header_t*)(s)->hdr)
+
+static uint64_t record_bytes(uint32_t size) { return sizeof(record_header_t) + (((uint64_t)size + 7) & ~7ull); }
+static uint64_t now_s(void) { return (uint64_t)time(NULL); }
+
+static void store_path(char* out, size_t n, const xeno_pcache_store_t* s, const char* ext) { snprintf(out, n, "%s%s", s->base, ext); }
+
+static int mkdirs(const char* path) {
+    char b[600]; snprintf(b, sizeof(b), "%s", path);
+    for (char* p = b + 1; *p; ++p) if (*p == '/') { *p = 0; if (mkdir(b, 0755) != 0 && errno != EEXIST) return -1; *p = '/'; }
+    return 0;
+}
+
+static int write_all(int fd, const void* buf, size_t n, uint64_t off) {
+    const char* p = buf;
+    while (n) {
+        ssize_t w = pwrite(fd, p, n, (off_t)off);
+        if (w < 0) { if (errno == EINTR) continue; return -1; }
+        p += w; n -= (size_t)w; off += (uint64_t)w;
+    }
+    return 0;
+}
+static int read_all(int fd, void* buf, size_t n, uint64_t off) {
+    char* p = buf;
+    while (n) {
+        ssize_t r = pread(fd, p, n, (off_t)off);
+        if (r < 0) { if (errno == EINTR) continue; return -1; }
+        if (r == 0) return -1;
+        p += r; n -= (size_t)r; off += (uint64_t)r;
+    }
+    return 0;
+}
+static void file_lock(int fd) { while (flock(fd, LOCK_EX) != 0 && errno == EINTR) {} }
+static void file_unlock(int fd) { flock(fd, LOCK_UN); }
+
+/* --- in-memory index: entry array + open-addressing table of (entry index + 1) --- */
+static int table_find(const xeno_pcache_store_t* s, uint64_t h1, uint64_t h2) {
+    if (!s->table) return -1;
+    for (uint32_t i = (uint32_t)h1 & s->table_mask;; i = (i + 1) & s->table_mask) {
+        uint32_t e = s->table[i];
+        if (!e) return -1;
+        if (s->entries[e - 1].h1 == h1 && s->entries[e - 1].h2 == h2) return (int)(e - 1);
+    }
+}
+static int table_rebuild(xeno_pcache_store_t* s, uint32_t min_entries) {
+    uint32_t n = 256; while (n < min_entries * 2) n <<= 1;
+    uint32_t* t = calloc(n, sizeof(uint32_t)); if (!t) return -1;
+    free(s->table); s->table = t; s->table_mask = n - 1;
+    for (uint32_t e = 0; e < s->count; ++e) {
+        uint32_t i = (uint32_t)s->entries[e].h1 & s->table_mask;
+        while (s->table[i]) i = (i + 1) & s->table_mask;
+        s->table[i] = e + 1;
+    }
+    return 0;
+}
+/* adds or replaces the entry for e->h1/h2; the replaced record becomes dead pack space */
+static int entry_set(xeno_pcache_store_t* s, const xeno_pcache_entry_t* e) {
+    int idx = table_find(s, e->h1, e->h2);
+    if (idx >= 0) {
+        s->live_bytes -= record_bytes(s->entries[idx].size);
+        s->entries[idx] = *e; s->live_bytes += record_bytes(e->size);
+        return 0;
+    }
+    if (s->count == s->cap) {
+        uint32_t cap = s->cap ? s->cap * 2 : 256;
+        xeno_pcache_entry_t* n = realloc(s->entries, cap * sizeof(*n)); if (!n) return -1;
+        s->entries = n; s->cap = cap;
+    }
+    s->entries[s->count++] = *e; s->live_bytes += record_bytes(e->size);
+    if (s->count * 2 > s->table_mask + 1) return table_rebuild(s, s->count);
+    uint32_t i = (uint32_t)e->h1 & s->table_mask;
+    while (s->table[i]) i = (i + 1) & s->table_mask;
+    s->table[i] = s->count;
+    return 0;
+}
+/* drops entries flagged XENO_PCACHE_ENTRY_DROP */
+static void entries_sweep(xeno_pcache_store_t* s) {
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < s->count; ++i) {
+        if (s->entries[i].flags & XENO_PCACHE_ENTRY_DROP) { s->live_bytes -= record_bytes(s->entries[i].size); continue; }
+        s->entries[kept++] = s->entries[i];
+    }
+    s->count = kept;
+    table_rebuild(s, s->count);
+    s->dirty = 1;
+}
+
+/* --- mappings: the data mapping only grows; superseded mappings stay valid until close because
+ * lookups copy records out of them without holding the store lock --- */
+static int map_data(xeno_pcache_store_t* s, uint64_t need) {
+    if (need <= s->map_len) return 0;
+    uint64_t len = MIN_MAP_LEN; while (len < need) len <<= 1;
+    void* m = mmap(NULL, (size_t)len, PROT_READ, MAP_SHARED, s->fd, 0);
+    if (m == MAP_FAILED) return -1;
+    if (s->map) {
+        if (s->old_count == XENO_PCACHE_OLD_MAPS) { munmap(m, (size_t)len); return -1; }
+        s->old_maps[s->old_count].addr = (void*)s->map; s->old_maps[s->old_count++].len = s->map_len;
+    }
+    s->map = m; s->map_len = len;
+    return 0;
+}
+
+static void scan_pack(xeno_pcache_store_t* s, uint64_t end) {
+    if (map_data(s, end) != 0) return;
+    uint64_t off = s->pack_size;
+    while (off + sizeof(record_header_t) <= end) {
+        record_header_t rh; memcpy(&rh, s->map + off, sizeof(rh));
+        if (rh.magic != RECORD_MAGIC || off + record_bytes(rh.size) > end) { s->corrupt++; off = end; break; }
+        xeno_pcache_entry_t e = { rh.h1, rh.h2, off, now_s(), rh.checksum, rh.size, 0 };
+        entry_set(s, &e);
+        s->recovered++;
+        off += record_bytes(rh.size);
+    }
+    s->pack_size = off;
+    s->dirty = 1;
+}
+
+static int load_index(xeno_pcache_store_t* s, uint64_t committed) {
+    char path[600]; store_path(path, sizeof(path), s, ".xpi");
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    index_header_t ih; int ok = -1;
+    if (read_all(fd, &ih, sizeof(ih), 0) == 0 && ih.magic == INDEX_MAGIC && ih.version == STORE_VERSION &&
+        memcmp(&ih.id, &s->id, sizeof(ih.id)) == 0 && ih.generation == s->generation && ih.pack_size <= committed) {
+        xeno_pcache_entry_t* e = malloc((ih.count ? ih.count : 1) * sizeof(*e));
+        if (e && read_all(fd, e, ih.count * sizeof(*e), sizeof(ih)) == 0) {
+            for (uint32_t i = 0; i < ih.count; ++i) {
+                if (e[i].offset < sizeof(pack_header_t) || e[i].offset + record_bytes(e[i].size) > ih.pack_size) continue;
+                e[i].flags = 0; entry_set(s, &e[i]);
+            }
+            s->pack_size = ih.pack_size; ok = 0;
+        }
+        free(e);
+    }
+    close(fd);
+    return ok;
+}
+
+static int write_pack_header(int fd, const xeno_pcache_id_t* id, uint64_t generation, uint64_t committed) {
+    pack_header_t ph; memset(&ph, 0, sizeof(ph));
+    ph.magic = PACK_MAGIC; ph.version = STORE_VERSION; ph.id = *id; ph.generation = generation;
+    atomic_init(&ph.committed, committed); atomic_init(&ph.retired, 0);
+    return write_all(fd, &ph, sizeof(ph), 0);
+}
+
+/* 0: valid and (when id is given) for that driver; -2 otherwise */
+static int check_header(int fd, const xeno_pcache_id_t* id) {
+    pack_header_t ph;
+    if (read_all(fd, &ph, sizeof(ph), 0) != 0 || ph.magic != PACK_MAGIC || ph.version != STORE_VERSION) return -2;
+    if (atomic_load(&ph.retired)) return -2;
+    if (id && memcmp(&ph.id, id, sizeof(*id)) != 0) return -2;
+    return 0;
+}
+
+/* Replace the pack at `path` with an empty one for `id`. Called with the old file locked; returns
+ * the new, locked descriptor. A zero-length file nobody can have mapped is initialized in place. */
+static int replace_pack(xeno_pcache_store_t* s, int fd, const char* path, const xeno_pcache_id_t* id) {
+    uint64_t generation = xeno_now_ns() ^ ((uint64_t)getpid() << 32);
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size == 0) return write_pack_header(fd, id, generation, sizeof(pack_header_t)) == 0 ? fd : -1;
+    char tmp[610]; snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+    int nfd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (nfd < 0) return -1;
+    file_lock(nfd);
+    if (write_pack_header(nfd, id, generation, sizeof(pack_header_t)) != 0 || rename(tmp, path) != 0) { close(nfd); unlink(tmp); return -1; }
+    /* tell the processes still using the old file to move over */
+    pack_header_t* old = mmap(NULL, HEADER_MAP_LEN, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (old != MAP_FAILED) {
+        if (old->magic == PACK_MAGIC && old->version == STORE_VERSION) atomic_store(&old->retired, 1);
+        munmap(old, HEADER_MAP_LEN);
+    }
+    char idx[600]; store_path(idx, sizeof(idx), s, ".xpi"); unlink(idx);
+    s->reset = 1;
+    close(fd); /* drops the lock on the old file */
+    return nfd;
+}
+
+static void unmap_all(xeno_pcache_store_t* s) {
+    if (s->hdr) munmap(s->hdr, HEADER_MAP_LEN);
+    if (s->map) munmap((void*)s->map, (size_t)s->map_len);
+    for (uint32_t i = 0; i < s->old_count; ++i) munmap(s->old_maps[i].addr, (size_t)s->old_maps[i].len);
+    s->hdr = NULL; s->map = NULL; s->map_len = 0; s->old_count = 0;
+}
+
+static int open_files(xeno_pcache_store_t* s, const xeno_pcache_id_t* id, int flags) {
+    char path[600]; store_path(path, sizeof(path), s, ".xpc");
+    if (flags & XENO_PCACHE_CREATE) mkdirs(path);
+    int fd = open(path, (s->readonly ? O_RDONLY : O_RDWR) | ((flags & XENO_PCACHE_CREATE) ? O_CREAT : 0) | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    if (check_header(fd, id) != 0) {
+        if (!id || s->readonly || !(flags & XENO_PCACHE_CREATE)) { close(fd); return -2; }
+        file_lock(fd);
+        if (check_header(fd, id) != 0) {
+            /* another process may have initialized or replaced it while we waited: reopen by name */
+            int cur = open(path, O_RDWR | O_CLOEXEC);
+            if (cur >= 0 && check_header(cur, id) == 0) { close(fd); fd = cur; }
+            else {
+                if (cur >= 0) close(cur);
+                if ((fd = replace_pack(s, fd, path, id)) < 0) return -1;
+            }
+        }
+        file_unlock(fd);
+    }
+    s->fd = fd;
+    s->hdr = mmap(NULL, HEADER_MAP_LEN, PROT_READ | (s->readonly ? 0 : PROT_WRITE), MAP_SHARED, fd, 0);
+    if (s->hdr == MAP_FAILED) { s->hdr = NULL; return -1; }
+    s->id = HDR(s)->id; s->generation = HDR(s)->generation;
+    uint64_t committed = atomic_load_explicit(&HDR(s)->committed, memory_order_acquire);
+    s->count = 0; s->live_bytes = 0; s->pack_size = sizeof(pack_header_t);
+    table_rebuild(s, 0);
+    if (map_data(s, committed) != 0) return -1;
+    if (load_index(s, committed) != 0) { s->count = 0; s->live_bytes = 0; s->pack_size = sizeof(pack_header_t); table_rebuild(s, 0); s->dirty = 1; }
+    if (s->pack_size < committed) scan_pack(s, committed);
+    return 0;
+}
+
+int xeno_pcache_open(xeno_pcache_store_t* s, const char* base, const xeno_pcache_id_t* id, int flags) {
+    memset(s, 0, sizeof(*s));
+    pthread_mutex_init(&s->lock, NULL);
+    snprintf(s->base, sizeof(s->base), "%s", base);
+    s->readonly = (flags & XENO_PCACHE_READONLY) != 0;
+    s->fd = -1;
+    return open_files(s, id, flags);
+}
+
+void xeno_pcache_close(xeno_pcache_store_t* s) {
+    unmap_all(s);
+    if (s->fd >= 0) close(s->fd);
+    free(s->entries); free(s->table);
+    s->fd = -1; s->entries = NULL; s->table = NULL; s->count = s->cap = 0;
+    pthread_mutex_destroy(&s->lock);
+}
+
+/* Follow other processes (caller holds s->lock): reopen a retired pack, index newly committed records */
+static void refresh(xeno_pcache_store_t* s) {
+    if (!s->hdr) return;
+    if (atomic_load(&HDR(s)->retired)) {
+        /* in-flight lookups may still copy from the old mappings: keep them until close */
+        if (s->map && s->old_count < XENO_PCACHE_OLD_MAPS) { s->old_maps[s->old_count].addr = (void*)s->map; s->old_maps[s->old_count++].len = s->map_len; s->map = NULL; s->map_len = 0; }
+        munmap(s->hdr, HEADER_MAP_LEN); s->hdr = NULL;
+        close(s->fd); s->fd = -1;
+        xeno_pcache_id_t id = s->id;
+        s->reopens++;
+        if (open_files(s, &id, 0) != 0) { s->count = 0; s->live_bytes = 0; table_rebuild(s, 0); return; }
+    }
+    uint64_t committed = atomic_load_explicit(&HDR(s)->committed, memory_order_acquire);
+    if (committed > s->pack_size) {
+        uint64_t before = s->recovered;
+        scan_pack(s, committed);
+        s->refreshed += s->recovered - before;
+    }
+}
+
+/* takes the file lock on the current pack and catches up with it (caller holds s->lock); -1 when
+ * the pack could not be reopened */
+static int lock_writer(xeno_pcache_store_t* s) {
+    for (;;) {
+        int fd = s->fd;
+        if (fd < 0) return -1;
+        file_lock(fd);
+        refresh(s);
+        if (s->fd == fd) return fd;
+        /* refresh() moved to a replacement pack; closing the old descriptor dropped its lock */
+    }
+}
+
+int xeno_pcache_get(xeno_pcache_store_t* s, uint64_t h1, uint64_t h2, void** data, uint32_t* size) {
+    pthread_mutex_lock(&s->lock);
+    int idx = table_find(s, h1, h2);
+    if (idx < 0) { refresh(s); idx = table_find(s, h1, h2); }
+    if (idx < 0 || !s->map) { pthread_mutex_unlock(&s->lock); return -1; }
+    xeno_pcache_entry_t e = s->entries[idx];
+    const unsigned char* rec = s->map + e.offset;
+    s->entries[idx].last_use = now_s(); s->dirty = 1;
+    pthread_mutex_unlock(&s->lock);
+
+    /* copy and verify without the lock: the mapping outlives any remap or reopen */
+    record_header_t rh; memcpy(&rh, rec, sizeof(rh));
+    void* d = NULL;
+    if (rh.magic == RECORD_MAGIC && rh.h1 == h1 && rh.h2 == h2 && rh.size == e.size && (d = malloc(e.size ? e.size : 1))) {
+        memcpy(d, rec + sizeof(rh), e.size);
+        if (xeno_hash64(d, e.size, CHECKSUM_SEED) != rh.checksum) { free(d); d = NULL; }
+    }
+    if (!d) {
+        pthread_mutex_lock(&s->lock);
+        idx = table_find(s, h1, h2);
+        if (idx >= 0 && s->entries[idx].offset == e.offset) { s->entries[idx].flags |= XENO_PCACHE_ENTRY_DROP; entries_sweep(s); }
+        s->corrupt++;
+        pthread_mutex_unlock(&s->lock);
+        return -1;
+    }
+    *data = d; *size = e.size;
+    return 0;
+}
+
+/* caller holds s->lock and the file lock, after refresh() */
+static int append_locked(xeno_pcache_store_t* s, uint64_t h1, uint64_t h2, const void* data, uint32_t size, uint64_t last_use) {
+    if (!s->hdr) return -1;
+    uint64_t off = atomic_load_explicit(&HDR(s)->committed, memory_order_acquire);
+    size_t n = (size_t)record_bytes(size);
+    char* buf = calloc(1, n); if (!buf) return -1;
+    record_header_t rh = { RECORD_MAGIC, size, h1, h2, xeno_hash64(data, size, CHECKSUM_SEED) };
+    memcpy(buf, &rh, sizeof(rh)); memcpy(buf + sizeof(rh), data, size);
+    int r = write_all(s->fd, buf, n, off);
+    free(buf);
+    if (r != 0 || map_data(s, off + n) != 0) return -1;
+    atomic_store_explicit(&HDR(s)->committed, off + n, memory_order_release);
+    xeno_pcache_entry_t e = { h1, h2, off, last_use, rh.checksum, size, 0 };
+    s->pack_size = off + n;
+    s->dirty = 1;
+    return entry_set(s, &e);
+}
+
+int xeno_pcache_put(xeno_pcache_store_t* s, uint64_t h1, uint64_t h2, const void* data, uint32_t size) {
+    if (s->readonly) return -1;
+    pthread_mutex_lock(&s->lock);
+    int fd = lock_writer(s), r = -1;
+    if (fd >= 0) {
+        /* another process may have stored the identical blob meanwhile */
+        int idx = table_find(s, h1, h2);
+        if (idx >= 0 && s->entries[idx].size == size && s->entries[idx].checksum == xeno_hash64(data, size, CHECKSUM_SEED)) { s->entries[idx].last_use = now_s(); r = 0; }
+        else r = append_locked(s, h1, h2, data, size, now_s());
+        file_unlock(fd);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return r;
+}
+
+static int cmp_last_use(const void* a, const void* b) {
+    const xeno_pcache_entry_t* x = *(xeno_pcache_entry_t* const*)a; const xeno_pcache_entry_t* y = *(xeno_pcache_entry_t* const*)b;
+    return x->last_use < y->last_use ? -1 : x->last_use > y->last_use;
+}
+
+uint32_t xeno_pcache_evict(xeno_pcache_store_t* s, uint64_t budget, uint64_t older_than) {
+    pthread_mutex_lock(&s->lock);
+    uint32_t dropped = 0;
+    for (uint32_t i = 0; older_than && i < s->count; ++i)
+        if (s->entries[i].last_use < older_than) { s->entries[i].flags |= XENO_PCACHE_ENTRY_DROP; dropped++; }
+    if (dropped) entries_sweep(s);
+    if (budget && s->live_bytes > budget) {
+        /* evict down to 7/8 of the budget so the next few stores do not each trigger another pass */
+        uint64_t target = budget - budget / 8;
+        xeno_pcache_entry_t** order = malloc(s->count * sizeof(*order));
+        if (order) {
+            for (uint32_t i = 0; i < s->count; ++i) order[i] = &s->entries[i];
+            qsort(order, s->count, sizeof(*order), cmp_last_use);
+            uint64_t live = s->live_bytes;
+            for (uint32_t i = 0; i < s->count && live > target; ++i) {
+                order[i]->flags |= XENO_PCACHE_ENTRY_DROP; live -= record_bytes(order[i]->size); dropped++;
+            }
+            free(order);
+            entries_sweep(s);
+        }
+    }
+    s->evicted += dropped;
+    pthread_mutex_unlock(&s->lock);
+    return dropped;
+}
+
+uint64_t xeno_pcache_dead_bytes(const xeno_pcache_store_t* s) {
+    uint64_t used = sizeof(pack_header_t) + s->live_bytes;
+    return s->pack_size > used ? s->pack_size - used : 0;
+}
+
+/* caller holds s->lock and the file lock; keeps the newer stamps other processes saved */
+static int write_index(xeno_pcache_store_t* s) {
+    char path[600], tmp[620];
+    store_path(path, sizeof(path), s, ".xpi"); snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        index_header_t ih; xeno_pcache_entry_t e;
+        if (read_all(fd, &ih, sizeof(ih), 0) == 0 && ih.magic == INDEX_MAGIC && ih.generation == s->generation)
+            for (uint32_t i = 0; i < ih.count && read_all(fd, &e, sizeof(e), sizeof(ih) + (uint64_t)i * sizeof(e)) == 0; ++i) {
+                int idx = table_find(s, e.h1, e.h2);
+                if (idx >= 0 && s->entries[idx].offset == e.offset && e.last_use > s->entries[idx].last_use) s->entries[idx].last_use = e.last_use;
+            }
+        close(fd);
+    }
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    index_header_t ih; memset(&ih, 0, sizeof(ih));
+    ih.magic = INDEX_MAGIC; ih.version = STORE_VERSION; ih.id = s->id; ih.count = s->count;
+    ih.generation = s->generation; ih.pack_size = s->pack_size;
+    int r = write_all(fd, &ih, sizeof(ih), 0);
+    if (r == 0 && s->count) r = write_all(fd, s->entries, s->count * sizeof(xeno_pcache_entry_t), sizeof(ih));
+    if (r == 0) r = fsync(fd);
+    close(fd);
+    if (r == 0) r = rename(tmp, path);
+    if (r != 0) { unlink(tmp); return -1; }
+    s->dirty = 0;
+    return 0;
+}
+
+int xeno_pcache_save(xeno_pcache_store_t* s) {
+    if (s->readonly) return -1;
+    pthread_mutex_lock(&s->lock);
+    int fd = lock_writer(s), r = -1;
+    if (fd >= 0) {
+        r = s->dirty ? write_index(s) : 0;
+        if (r == 0) fdatasync(fd);
+        file_unlock(fd);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return r;
+}
+
+int xeno_pcache_compact(xeno_pcache_store_t* s) {
+    if (s->readonly) return -1;
+    char path[600], tmp[620];
+    store_path(path, sizeof(path), s, ".xpc"); snprintf(tmp, sizeof(tmp), "%s.tmp.%d", path, (int)getpid());
+    pthread_mutex_lock(&s->lock);
+    int old = lock_writer(s);
+    if (old < 0) { pthread_mutex_unlock(&s->lock); return -1; }
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    uint64_t* offsets = malloc((s->count ? s->count : 1) * sizeof(uint64_t));
+    if (fd < 0 || !offsets) { if (fd >= 0) { close(fd); unlink(tmp); } free(offsets); file_unlock(old); pthread_mutex_unlock(&s->lock); return -1; }
+    file_lock(fd); /* held across the rename so nobody appends before the index is written */
+    uint64_t generation = xeno_now_ns() ^ ((uint64_t)getpid() << 32);
+    uint64_t off = sizeof(pack_header_t);
+    int r = 0;
+    for (uint32_t i = 0; r == 0 && i < s->count; ++i) {
+        const xeno_pcache_entry_t* e = &s->entries[i];
+        const unsigned char* rec = s->map + e->offset;
+        record_header_t rh; memcpy(&rh, rec, sizeof(rh));
+        offsets[i] = 0;
+        if (rh.magic != RECORD_MAGIC || rh.h1 != e->h1 || rh.h2 != e->h2 || rh.size != e->size ||
+            xeno_hash64(rec + sizeof(rh), e->size, CHECKSUM_SEED) != rh.checksum) continue;
+        r = write_all(fd, rec, (size_t)record_bytes(e->size), off);
+        offsets[i] = off; off += record_bytes(e->size);
+    }
+    if (r == 0) r = write_pack_header(fd, &s->id, generation, off);
+    if (r == 0) r = fsync(fd);
+    if (r == 0) r = rename(tmp, path);
+    if (r != 0) {
+        /* the old pack and the in-memory offsets into it stay valid */
+        close(fd); unlink(tmp); free(offsets);
+        file_unlock(old); pthread_mutex_unlock(&s->lock);
+        return -1;
+    }
+    atomic_store(&HDR(s)->retired, 1);
+    for (uint32_t i = 0; i < s->count; ++i) {
+        if (offsets[i]) s->entries[i].offset = offsets[i];
+        else { s->entries[i].flags |= XENO_PCACHE_ENTRY_DROP; s->corrupt++; } /* unreadable: not carried over */
+    }
+    free(offsets);
+    /* switch over; old data mappings stay alive for lookups in flight */
+    if (s->old_count < XENO_PCACHE_OLD_MAPS) { s->old_maps[s->old_count].addr = (void*)s->map; s->old_maps[s->old_count++].len = s->map_len; s->map = NULL; s->map_len = 0; }
+    munmap(s->hdr, HEADER_MAP_LEN);
+    close(old);
+    s->fd = fd; s->generation = generation; s->pack_size = off;
+    s->hdr = mmap(NULL, HEADER_MAP_LEN, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (s->hdr == MAP_FAILED) s->hdr = NULL;
+    entries_sweep(s);
+    r = (s->hdr && map_data(s, off) == 0) ? write_index(s) : -1;
+    file_unlock(fd);
+    pthread_mutex_unlock(&s->lock);
+    return r;
+}
+
+int xeno_pcache_merge(xeno_pcache_store_t* dst, xeno_pcache_store_t* src) {
+    if (dst->readonly || memcmp(&dst->id, &src->id, sizeof(dst->id)) != 0) return -1;
+    int merged = 0;
+    pthread_mutex_lock(&src->lock); pthread_mutex_lock(&dst->lock);
+    int fd = lock_writer(dst);
+    for (uint32_t i = 0; fd >= 0 && src->map && i < src->count; ++i) {
+        const xeno_pcache_entry_t* e = &src->entries[i];
+        int idx = table_find(dst, e->h1, e->h2);
+        if (idx >= 0 && dst->entries[idx].last_use >= e->last_use) continue; /* newest blob wins */
+        const unsigned char* rec = src->map + e->offset;
+        record_header_t rh; memcpy(&rh, rec, sizeof(rh));
+        if (rh.magic != RECORD_MAGIC || rh.size != e->size || xeno_hash64(rec + sizeof(rh), e->size, CHECKSUM_SEED) != rh.checksum) { src->corrupt++; continue; }
+        if (append_locked(dst, e->h1, e->h2, rec + sizeof(rh), e->size, e->last_use) == 0) merged++;
+    }
+    if (fd >= 0) file_unlock(fd);
+    pthread_mutex_unlock(&dst->lock); pthread_mutex_unlock(&src->lock);
+    return merged;
+}
@@ -0,0 +1,553 @@
+/* xeno_pipeline_dedup.c - share one VkPipeline between identical pipeline create infos
+ *
+ * Some engines create a pipeline per material instance with byte-for-byte identical create infos.
+ * Every graphics/compute create info the app passes is serialized into a canonical, pointer-free
+ * byte string: all fixed-function state, the pNext chains, specialization constants, shader code by
+ * content hash (so re-created modules still match), the pipeline layout / render pass identity and
+ * the allocation callbacks. Its hash selects a bucket and a full compare of the serialized bytes
+ * decides a match, so hash collisions never alias pipelines. A match returns the existing pipeline
+ * with its reference count raised; vkDestroyPipeline only reaches the driver for the last one.
+ *
+ * Create infos with anything the serializer does not understand (unknown pNext structs, pipeline
+ * libraries, creation feedback the app wants filled in) are passed through untouched. Destroying a
+ * pipeline layout or render pass unlists the entries that reference it, because a new object may
+ * reuse the handle value; pipelines already handed out keep their references.
+ *
+ * This layer sits in front of every other module: it is routed first in vkGetDeviceProcAddr and
+ * forwards through xeno_device_next_proc(), so dynamic state emulation sees one pipeline per
+ * unique create info.
+ *
+ * Knobs:
+ *   XCLIPSE_PIPELINE_DEDUP=0      disable
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+#define DD_HASH_SEED 0x64656475ull
+
+typedef struct dd_entry {
+    struct dd_entry* next;          /* bucket chain (entries sharing the hash's map slot) */
+    uint64_t hash;
+    VkPipeline pipeline;
+    uint64_t layout, render_pass;
+    uint32_t refs;
+    int listed;                     /* reachable through the bucket table */
+    size_t size;
+    unsigned char data[];           /* the serialized create info */
+} dd_entry_t;
+
+typedef struct xeno_dedup_device {
+    pthread_mutex_t lock;
+    xeno_map_t buckets;             /* hash -> dd_entry_t chain */
+    xeno_map_t pipelines;           /* VkPipeline -> dd_entry_t */
+    xeno_map_t modules;             /* VkShaderModule -> xeno_variant_key_t of its SPIR-V */
+    PFN_vkCreateShaderModule next_create_module;
+    PFN_vkDestroyShaderModule next_destroy_module;
+    PFN_vkCreateGraphicsPipelines next_create_graphics;
+    PFN_vkCreateComputePipelines next_create_compute;
+    PFN_vkDestroyPipeline next_destroy_pipeline;
+    PFN_vkDestroyPipelineLayout next_destroy_layout;
+    PFN_vkDestroyRenderPass next_destroy_render_pass;
+    uint64_t unique, shared;        /* under lock: live entries, references beyond the first */
+    _Atomic uint64_t requests, hits, batch_hits, misses, bypassed, collisions, unlisted;
+} xeno_dedup_device_t;
+
+/* --- canonical serialization --- */
+typedef struct dd_buf { unsigned char* p; size_t n, cap; int bad; } dd_buf_t;
+
+static void put(dd_buf_t* b, const void* d, size_t n) {
+    if (b->bad || !n) return;
+    if (b->n + n > b->cap) {
+        size_t cap = b->cap ? b->cap : 512;
+        while (cap < b->n + n) cap *= 2;
+        unsigned char* p = realloc(b->p, cap);
+        if (!p) { b->bad = 1; return; }
+        b->p = p; b->cap = cap;
+    }
+    memcpy(b->p + b->n, d, n); b->n += n;
+}
+static void put_u32(dd_buf_t* b, uint32_t v) { put(b, &v, sizeof(v)); }
+static void put_u64(dd_buf_t* b, uint64_t v) { put(b, &v, sizeof(v)); }
+/* arrays of padding-free, pointer-free structs are copied as they are */
+static void put_array(dd_buf_t* b, const void* a, uint32_t count, size_t elem) {
+    put_u32(b, a ? count : 0);
+    if (a) put(b, a, count * elem);
+}
+/* absent optional structs must not serialize like present ones */
+static int put_present(dd_buf_t* b, const void* p) { put_u32(b, p != NULL); return p != NULL; }
+
+/* pNext structs made of scalars only: serialized from the first member after pNext up to the last
+ * member's end, which skips trailing padding */
+#define DD_FLAT(st, T, last) { st, offsetof(T, pNext) + sizeof(void*), offsetof(T, last) + sizeof(((T*)0)->last) }
+typedef struct dd_flat { VkStructureType sType; size_t begin, end; } dd_flat_t;
+static const dd_flat_t flat_raster[] = {
+    DD_FLAT(VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_DEPTH_CLIP_STATE_CREATE_INFO_EXT, VkPipelineRasterizationDepthClipStateCreateInfoEXT, depthClipEnable),
+    DD_FLAT(VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_PROVOKING_VERTEX_STATE_CREATE_INFO_EXT, VkPipelineRasterizationProvokingVertexStateCreateInfoEXT, provokingVertexMode),
+    DD_FLAT(VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_LINE_STATE_CREATE_INFO_EXT, VkPipelineRasterizationLineStateCreateInfoEXT, lineStipplePattern),
+    DD_FLAT(VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_CONSERVATIVE_STATE_CREATE_INFO_EXT, VkPipelineRasterizationConservativeStateCreateInfoEXT, extraPrimitiveOverestimationSize),
+    DD_FLAT(VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_STREAM_CREATE_INFO_EXT, VkPipelineRasterizationStateStreamCreateInfoEXT, rasterizationStream),
+};
+static const dd_flat_t flat_viewport[] = {
+    DD_FLAT(VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_DEPTH_CLIP_CONTROL_CREATE_INFO_EXT, VkPipelineViewportDepthClipControlCreateInfoEXT, negativeOneToOne),
+};
+static const dd_flat_t flat_stage[] = {
+    DD_FLAT(VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO, VkPipelineShaderStageRequiredSubgroupSizeCreateInfo, requiredSubgroupSize),
+};
+static const dd_flat_t flat_pipeline[] = {
+    DD_FLAT(VK_STRUCTURE_TYPE_PIPELINE_ROBUSTNESS_CREATE_INFO_EXT, VkPipelineRobustnessCreateInfoEXT, images),
+};
+#define DD_COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+/* returns 1 when s was serialized as a flat struct from the table */
+static int put_flat(dd_buf_t* b, const VkBaseInStructure* s, const dd_flat_t* table, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        if (table[i].sType == s->sType) {
+            put_u32(b, (uint32_t)s->sType);
+            put(b, (const unsigned char*)s + table[i].begin, table[i].end - table[i].begin);
+            return 1;
+        }
+    return 0;
+}
+/* pNext chain made of flat structs only; anything else makes the create info unshareable */
+static void put_chain(dd_buf_t* b, const void* pNext, const dd_flat_t* table, size_t n) {
+    for (const VkBaseInStructure* s = pNext; s && !b->bad; s = s->pNext)
+        if (!put_flat(b, s, table, n)) b->bad = 1;
+    put_u32(b, 0);
+}
+
+static void put_code(dd_buf_t* b, const uint32_t* code, size_t size) {
+    xeno_variant_key_t k = xeno_variant_key(code, (uint32_t)(size / sizeof(uint32_t)));
+    put_u64(b, k.h1); put_u64(b, k.h2);
+}
+
+static void put_stage(xeno_dedup_device_t* dd, dd_buf_t* b, const VkPipelineShaderStageCreateInfo* st) {
+    put_u32(b, st->flags); put_u32(b, (uint32_t)st->stage);
+    if (st->module) {
+        const xeno_variant_key_t* k = xeno_map_get(&dd->modules, XENO_HANDLE_KEY(st->module));
+        if (!k) { b->bad = 1; return; } /* created before the layer was active */
+        put_u64(b, k->h1); put_u64(b, k->h2);
+    }
+    for (const VkBaseInStructure* s = st->pNext; s && !b->bad; s = s->pNext) {
+        if (s->sType == VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO && !st->module) {
+            const VkShaderModuleCreateInfo* mi = (const VkShaderModuleCreateInfo*)s;
+            put_u32(b, (uint32_t)s->sType); put_code(b, mi->pCode, mi->codeSize);
+        } else if (!put_flat(b, s, flat_stage, DD_COUNT(flat_stage))) {
+            b->bad = 1;
+        }
+    }
+    put_u32(b, 0);
+    const char* name = st->pName ? st->pName : "main";
+    put(b, name, strlen(name) + 1);
+    const VkSpecializationInfo* si = st->pSpecializationInfo;
+    if (put_present(b, si)) {
+        put_array(b, si->pMapEntries, si->mapEntryCount, sizeof(VkSpecializationMapEntry));
+        put_u64(b, si->dataSize); put(b, si->pData, si->pData ? si->dataSize : 0);
+    }
+}
+
+static void put_allocator(dd_buf_t* b, const VkAllocationCallbacks* a) {
+    /* the last reference is destroyed with the callbacks of the first create: they must match */
+    if (!put_present(b, a)) return;
+    put_u64(b, (uint64_t)(uintptr_t)a->pUserData); put_u64(b, (uint64_t)(uintptr_t)a->pfnAllocation);
+    put_u64(b, (uint64_t)(uintptr_t)a->pfnReallocation); put_u64(b, (uint64_t)(uintptr_t)a->pfnFree);
+}
+
+static int has_dynamic(const VkPipelineDynamicStateCreateInfo* d, VkDynamicState s) {
+    for (uint32_t i = 0; d && i < d->dynamicStateCount; ++i) if (d->pDynamicStates[i] == s) return 1;
+    return 0;
+}
+
+/* Only reads what the spec says is valid for this create info: state the pipeline makes dynamic
+ * or that rasterizer discard disables may point at garbage. */
+static void put_graphics(xeno_dedup_device_t* dd, dd_buf_t* b, const VkGraphicsPipelineCreateInfo* ci, const VkAllocationCallbacks* pAllocator) {
+    if (ci->flags & VK_PIPELINE_CREATE_LIBRARY_BIT_KHR) { b->bad = 1; return; }
+    const VkPipelineDynamicStateCreateInfo* dyn = ci->pDynamicState;
+    put_u32(b, 1); put_u32(b, ci->flags);
+    for (const VkBaseInStructure* s = ci->pNext; s && !b->bad; s = s->pNext) {
+        if (s->sType == VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO) {
+            const VkPipelineRenderingCreateInfo* ri = (const VkPipelineRenderingCreateInfo*)s;
+            put_u32(b, (uint32_t)s->sType);
+            if (ci->renderPass) continue; /* ignored with a render pass */
+            put_u32(b, ri->viewMask);
+            put_array(b, ri->pColorAttachmentFormats, ri->colorAttachmentCount, sizeof(VkFormat));
+            put_u32(b, (uint32_t)ri->depthAttachmentFormat); put_u32(b, (uint32_t)ri->stencilAttachmentFormat);
+        } else if (!put_flat(b, s, flat_pipeline, DD_COUNT(flat_pipeline))) {
+            b->bad = 1; /* creation feedback, library state, anything unknown */
+        }
+    }
+    put_u32(b, 0);
+    put_u32(b, ci->stageCount);
+    for (uint32_t i = 0; i < ci->stageCount && !b->bad; ++i) put_stage(dd, b, &ci->pStages[i]);
+
+    const VkPipelineVertexInputStateCreateInfo* vi = has_dynamic(dyn, VK_DYNAMIC_STATE_VERTEX_INPUT_EXT) ? NULL : ci->pVertexInputState;
+    if (put_present(b, vi)) {
+        if (vi->pNext) b->bad = 1;
+        put_u32(b, vi->flags);
+        put_array(b, vi->pVertexBindingDescriptions, vi->vertexBindingDescriptionCount, sizeof(VkVertexInputBindingDescription));
+        put_array(b, vi->pVertexAttributeDescriptions, vi->vertexAttributeDescriptionCount, sizeof(VkVertexInputAttributeDescription));
+    }
+    const VkPipelineInputAssemblyStateCreateInfo* ia = ci->pInputAssemblyState;
+    if (put_present(b, ia)) {
+        if (ia->pNext) b->bad = 1;
+        put_u32(b, ia->flags); put_u32(b, (uint32_t)ia->topology); put_u32(b, ia->primitiveRestartEnable);
+    }
+    const VkPipelineTessellationStateCreateInfo* ts = ci->pTessellationState;
+    if (put_present(b, ts)) {
+        if (ts->pNext) b->bad = 1;
+        put_u32(b, ts->flags); put_u32(b, ts->patchControlPoints);
+    }
+    const VkPipelineRasterizationStateCreateInfo* rs = ci->pRasterizationState;
+    int discard = 0;
+    if (put_present(b, rs)) {
+        put_u32(b, rs->flags); put_u32(b, rs->depthClampEnable); put_u32(b, rs->rasterizerDiscardEnable);
+        put_u32(b, (uint32_t)rs->polygonMode); put_u32(b, rs->cullMode); put_u32(b, (uint32_t)rs->frontFace);
+        put_u32(b, rs->depthBiasEnable);
+        put(b, &rs->depthBiasConstantFactor, 4 * sizeof(float)); /* constant, clamp, slope, line width */
+        put_chain(b, rs->pNext, flat_raster, DD_COUNT(flat_raster));
+        discard = rs->rasterizerDiscardEnable && !has_dynamic(dyn, VK_DYNAMIC_STATE_RASTERIZER_DISCARD_ENABLE);
+    }
+    const VkPipelineViewportStateCreateInfo* vp = discard ? NULL : ci->pViewportState;
+    if (put_present(b, vp)) {
+        int dyn_vp = has_dynamic(dyn, VK_DYNAMIC_STATE_VIEWPORT) || has_dynamic(dyn, VK_DYNAMIC_STATE_VIEWPORT_WITH_COUNT);
+        int dyn_sc = has_dynamic(dyn, VK_DYNAMIC_STATE_SCISSOR) || has_dynamic(dyn, VK_DYNAMIC_STATE_SCISSOR_WITH_COUNT);
+        put_u32(b, vp->flags);
+        put_u32(b, vp->viewportCount); put_array(b, dyn_vp ? NULL : vp->pViewports, vp->viewportCount, sizeof(VkViewport));
+        put_u32(b, vp->scissorCount); put_array(b, dyn_sc ? NULL : vp->pScissors, vp->scissorCount, sizeof(VkRect2D));
+        put_chain(b, vp->pNext, flat_viewport, DD_COUNT(flat_viewport));
+    }
+    const VkPipelineMultisampleStateCreateInfo* ms = discard ? NULL : ci->pMultisampleState;
+    if (put_present(b, ms)) {
+        if (ms->pNext) b->bad = 1;
+        put_u32(b, ms->flags); put_u32(b, (uint32_t)ms->rasterizationSamples); put_u32(b, ms->sampleShadingEnable);
+        put(b, &ms->minSampleShading, sizeof(float));
+        const VkSampleMask* mask = has_dynamic(dyn, VK_DYNAMIC_STATE_SAMPLE_MASK_EXT) ? NULL : ms->pSampleMask;
+        put_array(b, mask, ((uint32_t)ms->rasterizationSamples + 31) / 32, sizeof(VkSampleMask));
+        put_u32(b, ms->alphaToCoverageEnable); put_u32(b, ms->alphaToOneEnable);
+    }
+    const VkPipelineDepthStencilStateCreateInfo* ds = discard ? NULL : ci->pDepthStencilState;
+    if (put_present(b, ds)) {
+        if (ds->pNext) b->bad = 1;
+        put_u32(b, ds->flags); put_u32(b, ds->depthTestEnable); put_u32(b, ds->depthWriteEnable);
+        put_u32(b, (uint32_t)ds->depthCompareOp); put_u32(b, ds->depthBoundsTestEnable); put_u32(b, ds->stencilTestEnable);
+        put(b, &ds->front, sizeof(VkStencilOpState)); put(b, &ds->back, sizeof(VkStencilOpState));
+        put(b, &ds->minDepthBounds, 2 * sizeof(float));
+    }
+    const VkPipelineColorBlendStateCreateInfo* cb = discard ? NULL : ci->pColorBlendState;
+    if (put_present(b, cb)) {
+        int dyn_att = has_dynamic(dyn, VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT) && has_dynamic(dyn, VK_DYNAMIC_STATE_COLOR_BLEND_EQUATION_EXT) &&
+                      has_dynamic(dyn, VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT);
+        if (cb->pNext) b->bad = 1;
+        put_u32(b, cb->flags); put_u32(b, cb->logicOpEnable); put_u32(b, (uint32_t)cb->logicOp);
+        put_u32(b, cb->attachmentCount);
+        put_array(b, dyn_att ? NULL : cb->pAttachments, cb->attachmentCount, sizeof(VkPipelineColorBlendAttachmentState));
+        put(b, cb->blendConstants, sizeof(cb->blendConstants));
+    }
+    if (put_present(b, dyn)) {
+        if (dyn->pNext) b->bad = 1;
+        put_u32(b, dyn->flags); put_array(b, dyn->pDynamicStates, dyn->dynamicStateCount, sizeof(VkDynamicState));
+    }
+    put_u64(b, XENO_HANDLE_KEY(ci->layout)); put_u64(b, XENO_HANDLE_KEY(ci->renderPass)); put_u32(b, ci->subpass);
+    put_allocator(b, pAllocator);
+}
+
+static void put_compute(xeno_dedup_device_t* dd, dd_buf_t* b, const VkComputePipelineCreateInfo* ci, const VkAllocationCallbacks* pAllocator) {
+    put_u32(b, 2); put_u32(b, ci->flags);
+    put_chain(b, ci->pNext, flat_pipeline, DD_COUNT(flat_pipeline));
+    put_stage(dd, b, &ci->stage);
+    put_u64(b, XENO_HANDLE_KEY(ci->layout));
+    put_allocator(b, pAllocator);
+}
+
+/* --- entry table (caller holds dd->lock) --- */
+static dd_entry_t* find_entry(xeno_dedup_device_t* dd, uint64_t hash, const dd_buf_t* b) {
+    for (dd_entry_t* e = xeno_map_get(&dd->buckets, hash); e; e = e->next) {
+        if (e->hash != hash) continue;
+        if (e->size == b->n && memcmp(e->data, b->p, b->n) == 0) return e;
+        atomic_fetch_add(&dd->collisions, 1);
+    }
+    return NULL;
+}
+static void unlist(xeno_dedup_device_t* dd, dd_entry_t* e) {
+    if (!e->listed) return;
+    dd_entry_t* head = xeno_map_get(&dd->buckets, e->hash);
+    if (head == e) {
+        xeno_map_remove(&dd->buckets, e->hash);
+        if (e->next) xeno_map_put(&dd->buckets, e->hash, e->next);
+    } else {
+        for (dd_entry_t* p = head; p; p = p->next) if (p->next == e) { p->next = e->next; break; }
+    }
+    e->next = NULL; e->listed = 0;
+}
+
+/* --- batch creation --- */
+typedef struct dd_item {
+    uint64_t hash;
+    dd_buf_t key;
+    dd_entry_t* hit;                /* existing entry, reference already taken */
+    int32_t alias;                  /* earlier miss in the same batch with the same key, or -1 */
+    int32_t slot;                   /* index in the forwarded sub-batch, or -1 */
+} dd_item_t;
+
+static dd_entry_t* entry_new(const dd_item_t* it, VkPipeline p, uint64_t layout, uint64_t render_pass) {
+    dd_entry_t* e = malloc(sizeof(*e) + it->key.n);
+    if (!e) return NULL;
+    e->next = NULL; e->hash = it->hash; e->pipeline = p; e->layout = layout; e->render_pass = render_pass;
+    e->refs = 1; e->listed = 0; e->size = it->key.n;
+    memcpy(e->data, it->key.p, it->key.n);
+    return e;
+}
+
+/* Releases one reference; returns 1 when it was the last and the pipeline must be destroyed */
+static int release_locked(xeno_dedup_device_t* dd, dd_entry_t* e) {
+    if (--e->refs) { dd->shared--; return 0; }
+    unlist(dd, e);
+    xeno_map_remove(&dd->pipelines, XENO_HANDLE_KEY(e->pipeline));
+    dd->unique--;
+    free(e);
+    return 1;
+}
+
+/* Shared by both pipeline types: `infos` is the app's array, `forward` compacts the misses and calls
+ * the next layer once for all of them, keeping the batch intact for the layers below. */
+typedef VkResult (*dd_forward_fn)(xeno_device_t* dev, VkPipelineCache cache, const void* infos, uint32_t count, const uint32_t* idx, uint32_t n,
+                                  const VkAllocationCallbacks* pAllocator, VkPipeline* out);
+
+static VkResult dd_create(xeno_device_t* dev, int graphics, VkPipelineCache cache, uint32_t count, const void* infos,
+                          const VkAllocationCallbacks* pAllocator, VkPipeline* pPipelines, dd_forward_fn forward) {
+    xeno_dedup_device_t* dd = dev->dedup;
+    dd_item_t* items = calloc(count, sizeof(*items));
+    uint32_t* idx = malloc(count * sizeof(*idx));
+    VkPipeline* out = malloc(count * sizeof(*out));
+    if (!items || !idx || !out) { free(items); free(idx); free(out); return VK_ERROR_OUT_OF_HOST_MEMORY; }
+    const VkGraphicsPipelineCreateInfo* gci = infos; const VkComputePipelineCreateInfo* cci = infos;
+    atomic_fetch_add(&dd->requests, count);
+
+    for (uint32_t i = 0; i < count; ++i) {
+        dd_item_t* it = &items[i];
+        it->alias = it->slot = -1;
+        if (graphics) put_graphics(dd, &it->key, &gci[i], pAllocator); else put_compute(dd, &it->key, &cci[i], pAllocator);
+        if (!it->key.bad) it->hash = xeno_hash64(it->key.p, it->key.n, DD_HASH_SEED);
+    }
+    uint32_t n = 0;
+    pthread_mutex_lock(&dd->lock);
+    for (uint32_t i = 0; i < count; ++i) {
+        dd_item_t* it = &items[i];
+        if (!it->key.bad) {
+            if ((it->hit = find_entry(dd, it->hash, &it->key))) { it->hit->refs++; dd->shared++; continue; }
+            for (uint32_t j = 0; j < i && it->alias < 0; ++j)
+                if (items[j].slot >= 0 && !items[j].key.bad && items[j].hash == it->hash && items[j].key.n == it->key.n &&
+                    memcmp(items[j].key.p, it->key.p, it->key.n) == 0) it->alias = (int32_t)j;
+            if (it->alias >= 0) continue;
+        }
+        it->slot = (int32_t)n; idx[n++] = i;
+    }
+    pthread_mutex_unlock(&dd->lock);
+
+    VkResult result = n ? forward(dev, cache, infos, count, idx, n, pAllocator, out) : VK_SUCCESS;
+
+    /* with early return the driver stops at the first failure: later elements must come back null */
+    uint32_t stop = count;
+    for (uint32_t s = 0; result != VK_SUCCESS && s < n; ++s) {
+        VkPipelineCreateFlags flags = graphics ? gci[idx[s]].flags : cci[idx[s]].flags;
+        if (!out[s] && (flags & VK_PIPELINE_CREATE_EARLY_RETURN_ON_FAILURE_BIT)) { stop = idx[s]; break; }
+    }
+    VkPipeline* discard = calloc(count, sizeof(*discard)); /* lost insertion races, destroyed below */
+    uint32_t ndiscard = 0;
+    pthread_mutex_lock(&dd->lock);
+    for (uint32_t i = 0; i < count; ++i) {
+        dd_item_t* it = &items[i];
+        if (it->hit) {
+            if (i > stop) { release_locked(dd, it->hit); pPipelines[i] = VK_NULL_HANDLE; continue; }
+            pPipelines[i] = it->hit->pipeline; atomic_fetch_add(&dd->hits, 1);
+        } else if (it->alias >= 0) {
+            VkPipeline p = i > stop ? VK_NULL_HANDLE : pPipelines[it->alias];
+            dd_entry_t* e = p ? xeno_map_get(&dd->pipelines, XENO_HANDLE_KEY(p)) : NULL;
+            if (e) { e->refs++; dd->shared++; atomic_fetch_add(&dd->batch_hits, 1); }
+            else if (p) result = VK_ERROR_OUT_OF_HOST_MEMORY; /* the first copy could not be tracked, so it cannot be shared */
+            pPipelines[i] = e ? p : VK_NULL_HANDLE;
+        } else {
+            VkPipeline p = pPipelines[i] = out[it->slot];
+            if (it->key.bad) { atomic_fetch_add(&dd->bypassed, 1); continue; }
+            if (!p) continue;
+            atomic_fetch_add(&dd->misses, 1);
+            dd_entry_t* won = find_entry(dd, it->hash, &it->key);
+            if (won && discard) {
+                /* an identical create on another thread finished first: share its pipeline */
+                won->refs++; dd->shared++; pPipelines[i] = won->pipeline;
+                discard[ndiscard++] = p;
+                continue;
+            }
+            uint64_t layout = graphics ? XENO_HANDLE_KEY(gci[i].layout) : XENO_HANDLE_KEY(cci[i].layout);
+            uint64_t rp = graphics ? XENO_HANDLE_KEY(gci[i].renderPass) : 0;
+            dd_entry_t* e = entry_new(it, p, layout, rp);
+            if (!e) continue; /* stays an ordinary, unshared pipeline */
+            e->next = xeno_map_get(&dd->buckets, it->hash);
+            if (e->next) xeno_map_remove(&dd->buckets, it->hash);
+            xeno_map_put(&dd->buckets, it->hash, e); e->listed = 1;
+            xeno_map_put(&dd->pipelines, XENO_HANDLE_KEY(p), e);
+            dd->unique++;
+        }
+    }
+    pthread_mutex_unlock(&dd->lock);
+    for (uint32_t i = 0; i < ndiscard; ++i) dd->next_destroy_pipeline(dev->handle, discard[i], pAllocator);
+    for (uint32_t i = 0; i < count; ++i) free(items[i].key.p);
+    free(discard); free(items); free(idx); free(out);
+    return result;
+}
+
+static VkResult forward_graphics(xeno_device_t* dev, VkPipelineCache cache, const void* infos, uint32_t count, const uint32_t* idx, uint32_t n,
+                                 const VkAllocationCallbacks* pAllocator, VkPipeline* out) {
+    const VkGraphicsPipelineCreateInfo* ci = infos;
+    /* nothing matched: the batch goes down unchanged */
+    if (n == count) return dev->dedup->next_create_graphics(dev->handle, cache, n, ci, pAllocator, out);
+    VkGraphicsPipelineCreateInfo* sub = malloc(n * sizeof(*sub));
+    if (!sub) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    for (uint32_t s = 0; s < n; ++s) {
+        sub[s] = ci[idx[s]];
+        /* batch-relative base indices no longer line up; derivatives are only a hint */
+        if (sub[s].flags & VK_PIPELINE_CREATE_DERIVATIVE_BIT && sub[s].basePipelineIndex >= 0) { sub[s].flags &= ~VK_PIPELINE_CREATE_DERIVATIVE_BIT; sub[s].basePipelineIndex = -1; }
+    }
+    VkResult r = dev->dedup->next_create_graphics(dev->handle, cache, n, sub, pAllocator, out);
+    free(sub);
+    return r;
+}
+static VkResult forward_compute(xeno_device_t* dev, VkPipelineCache cache, const void* infos, uint32_t count, const uint32_t* idx, uint32_t n,
+                                const VkAllocationCallbacks* pAllocator, VkPipeline* out) {
+    const VkComputePipelineCreateInfo* ci = infos;
+    if (n == count) return dev->dedup->next_create_compute(dev->handle, cache, n, ci, pAllocator, out);
+    VkComputePipelineCreateInfo* sub = malloc(n * sizeof(*sub));
+    if (!sub) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    for (uint32_t s = 0; s < n; ++s) {
+        sub[s] = ci[idx[s]];
+        if (sub[s].flags & VK_PIPELINE_CREATE_DERIVATIVE_BIT && sub[s].basePipelineIndex >= 0) { sub[s].flags &= ~VK_PIPELINE_CREATE_DERIVATIVE_BIT; sub[s].basePipelineIndex = -1; }
+    }
+    VkResult r = dev->dedup->next_create_compute(dev->handle, cache, n, sub, pAllocator, out);
+    free(sub);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL dd_vkCreateGraphicsPipelines(VkDevice device, VkPipelineCache pipelineCache, uint32_t createInfoCount,
+                                                                   const VkGraphicsPipelineCreateInfo* pCreateInfos, const VkAllocationCallbacks* pAllocator, VkPipeline* pPipelines) {
+    xeno_device_t* dev = xeno_device_get(device);
+    return dd_create(dev, 1, pipelineCache, createInfoCount, pCreateInfos, pAllocator, pPipelines, forward_graphics);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL dd_vkCreateComputePipelines(VkDevice device, VkPipelineCache pipelineCache, uint32_t createInfoCount,
+                                                                  const VkComputePipelineCreateInfo* pCreateInfos, const VkAllocationCallbacks* pAllocator, VkPipeline* pPipelines) {
+    xeno_device_t* dev = xeno_device_get(device);
+    return dd_create(dev, 0, pipelineCache, createInfoCount, pCreateInfos, pAllocator, pPipelines, forward_compute);
+}
+
+static VKAPI_ATTR void VKAPI_CALL dd_vkDestroyPipeline(VkDevice device, VkPipeline pipeline, const VkAllocationCallbacks* pAllocator) {
+    xeno_dedup_device_t* dd = xeno_device_get(device)->dedup;
+    if (pipeline) {
+        pthread_mutex_lock(&dd->lock);
+        dd_entry_t* e = xeno_map_get(&dd->pipelines, XENO_HANDLE_KEY(pipeline));
+        int last = !e || release_locked(dd, e);
+        pthread_mutex_unlock(&dd->lock);
+        if (!last) return;
+    }
+    dd->next_destroy_pipeline(device, pipeline, pAllocator);
+}
+
+/* --- handles the serialized create infos refer to --- */
+static VKAPI_ATTR VkResult VKAPI_CALL dd_vkCreateShaderModule(VkDevice device, const VkShaderModuleCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkShaderModule* pShaderModule) {
+    xeno_dedup_device_t* dd = xeno_device_get(device)->dedup;
+    VkResult r = dd->next_create_module(device, pCreateInfo, pAllocator, pShaderModule);
+    if (r == VK_SUCCESS) {
+        xeno_variant_key_t* k = malloc(sizeof(*k));
+        if (k) { *k = xeno_variant_key(pCreateInfo->pCode, (uint32_t)(pCreateInfo->codeSize / sizeof(uint32_t))); xeno_map_put(&dd->modules, XENO_HANDLE_KEY(*pShaderModule), k); }
+    }
+    return r;
+}
+static VKAPI_ATTR void VKAPI_CALL dd_vkDestroyShaderModule(VkDevice device, VkShaderModule module, const VkAllocationCallbacks* pAllocator) {
+    xeno_dedup_device_t* dd = xeno_device_get(device)->dedup;
+    if (module) free(xeno_map_remove(&dd->modules, XENO_HANDLE_KEY(module)));
+    dd->next_destroy_module(device, module, pAllocator);
+}
+
+typedef struct dd_unlist_ctx { xeno_dedup_device_t* dd; uint64_t handle; } dd_unlist_ctx_t;
+static int unlist_fn(uint64_t key, void* val, void* ctx) {
+    dd_unlist_ctx_t* c = ctx; dd_entry_t* e = val; (void)key;
+    if (e->listed && (e->layout == c->handle || e->render_pass == c->handle)) { unlist(c->dd, e); atomic_fetch_add(&c->dd->unlisted, 1); }
+    return 0;
+}
+static void unlist_handle(xeno_dedup_device_t* dd, uint64_t handle) {
+    if (!handle) return;
+    dd_unlist_ctx_t ctx = { dd, handle };
+    pthread_mutex_lock(&dd->lock);
+    xeno_map_foreach(&dd->pipelines, unlist_fn, &ctx);
+    pthread_mutex_unlock(&dd->lock);
+}
+static VKAPI_ATTR void VKAPI_CALL dd_vkDestroyPipelineLayout(VkDevice device, VkPipelineLayout layout, const VkAllocationCallbacks* pAllocator) {
+    xeno_dedup_device_t* dd = xeno_device_get(device)->dedup;
+    unlist_handle(dd, XENO_HANDLE_KEY(layout));
+    dd->next_destroy_layout(device, layout, pAllocator);
+}
+static VKAPI_ATTR void VKAPI_CALL dd_vkDestroyRenderPass(VkDevice device, VkRenderPass renderPass, const VkAllocationCallbacks* pAllocator) {
+    xeno_dedup_device_t* dd = xeno_device_get(device)->dedup;
+    unlist_handle(dd, XENO_HANDLE_KEY(renderPass));
+    dd->next_destroy_render_pass(device, renderPass, pAllocator);
+}
+
+/* --- device lifetime / routing --- */
+int xeno_dedup_init(xeno_device_t* dev) {
+    if (!xeno_env_bool("XCLIPSE_PIPELINE_DEDUP", 1)) return 0;
+    xeno_dedup_device_t* dd = calloc(1, sizeof(*dd)); if (!dd) return -1;
+#define DD_NEXT(field, fn) dd->field = (PFN_##fn)xeno_device_next_proc(dev, #fn);
+    DD_NEXT(next_create_module, vkCreateShaderModule) DD_NEXT(next_destroy_module, vkDestroyShaderModule)
+    DD_NEXT(next_create_graphics, vkCreateGraphicsPipelines) DD_NEXT(next_create_compute, vkCreateComputePipelines)
+    DD_NEXT(next_destroy_pipeline, vkDestroyPipeline) DD_NEXT(next_destroy_layout, vkDestroyPipelineLayout)
+    DD_NEXT(next_destroy_render_pass, vkDestroyRenderPass)
+#undef DD_NEXT
+    if (!dd->next_create_module || !dd->next_destroy_module || !dd->next_create_graphics || !dd->next_create_compute ||
+        !dd->next_destroy_pipeline || !dd->next_destroy_layout || !dd->next_destroy_render_pass) { free(dd); return -1; }
+    pthread_mutex_init(&dd->lock, NULL);
+    xeno_map_init(&dd->buckets, 1024); xeno_map_init(&dd->pipelines, 1024); xeno_map_init(&dd->modules, 1024);
+    dev->dedup = dd;
+    return 0;
+}
+
+static int free_fn(uint64_t key, void* val, void* ctx) { (void)key; (void)ctx; free(val); return 1; }
+
+void xeno_dedup_destroy(xeno_device_t* dev) {
+    xeno_dedup_device_t* dd = dev->dedup;
+    if (!dd) return;
+    /* pipelines the app leaked stay with the driver; only the bookkeeping goes */
+    xeno_map_foreach(&dd->pipelines, free_fn, NULL);
+    xeno_map_foreach(&dd->modules, free_fn, NULL);
+    xeno_map_destroy(&dd->buckets); xeno_map_destroy(&dd->pipelines); xeno_map_destroy(&dd->modules);
+    pthread_mutex_destroy(&dd->lock);
+    free(dd); dev->dedup = NULL;
+}
+
+PFN_vkVoidFunction xeno_dedup_proc(xeno_device_t* dev, const char* name) {
+    if (!dev->dedup) return NULL;
+    if (strcmp(name, "vkCreateGraphicsPipelines") == 0) return (PFN_vkVoidFunction)dd_vkCreateGraphicsPipelines;
+    if (strcmp(name, "vkCreateComputePipelines") == 0) return (PFN_vkVoidFunction)dd_vkCreateComputePipelines;
+    if (strcmp(name, "vkDestroyPipeline") == 0) return (PFN_vkVoidFunction)dd_vkDestroyPipeline;
+    if (strcmp(name, "vkCreateShaderModule") == 0) return (PFN_vkVoidFunction)dd_vkCreateShaderModule;
+    if (strcmp(name, "vkDestroyShaderModule") == 0) return (PFN_vkVoidFunction)dd_vkDestroyShaderModule;
+    if (strcmp(name, "vkDestroyPipelineLayout") == 0) return (PFN_vkVoidFunction)dd_vkDestroyPipelineLayout;
+    if (strcmp(name, "vkDestroyRenderPass") == 0) return (PFN_vkVoidFunction)dd_vkDestroyRenderPass;
+    return NULL;
+}
+
+void xeno_dedup_report(FILE* f, xeno_device_t* dev) {
+    xeno_dedup_device_t* dd = dev->dedup;
+    fprintf(f, "  \"pipeline_dedup\": {\"enabled\": %s", dd ? "true" : "false");
+    if (dd) {
+        uint64_t requests = atomic_load(&dd->requests), hits = atomic_load(&dd->hits) + atomic_load(&dd->batch_hits);
+        pthread_mutex_lock(&dd->lock);
+        uint64_t unique = dd->unique, shared = dd->shared;
+        pthread_mutex_unlock(&dd->lock);
+        fprintf(f, ", \"requests\": %" PRIu64 ", \"hits\": %" PRIu64 ", \"batch_hits\": %" PRIu64 ", \"misses\": %" PRIu64 ", \"bypassed\": %" PRIu64,
+                requests, atomic_load(&dd->hits), atomic_load(&dd->batch_hits), atomic_load(&dd->misses), atomic_load(&dd->bypassed));
+        fprintf(f, ", \"hit_rate\": %.4f, \"hash_collisions\": %" PRIu64 ", \"unlisted\": %" PRIu64 ", \"live_unique\": %" PRIu64 ", \"live_shared_refs\": %" PRIu64,
+                requests ? (double)hits / (double)requests : 0.0, atomic_load(&dd->collisions), atomic_load(&dd->unlisted), unique, shared);
+    }
+    fprintf(f, "}");
+}
@@ -0,0 +1,205 @@
+/* xeno_pipeline_split.c - compile large vkCreate*Pipelines batches on the worker pool
+ *
+ * Loading screens often create a hundred pipelines or more in one call on one thread. Batches of at
+ * least XCLIPSE_PIPELINE_SPLIT_MIN create infos are cut into contiguous chunks that the calling
+ * thread and the worker pool compile concurrently (xeno_workers_parallel), all against the app's
+ * pipeline cache, and joined before returning. The result follows the batch rules: every element
+ * gets its pipeline or VK_NULL_HANDLE, errors take precedence over VK_PIPELINE_COMPILE_REQUIRED,
+ * and after an element with VK_PIPELINE_CREATE_EARLY_RETURN_ON_FAILURE_BIT fails, the pipelines
+ * later chunks created for the elements behind it are destroyed again.
+ *
+ * Batches stay whole when an element derives from another by batch index, or when the cache was
+ * created externally synchronized (concurrent use would be invalid).
+ *
+ * The module interposes in the dispatch table right above the persistent pipeline cache, so app
+ * batches and the batches of the modules above are split, and each chunk is looked up in the disk
+ * cache on its own thread.
+ *
+ * Knobs:
+ *   XCLIPSE_PIPELINE_SPLIT=0         disable
+ *   XCLIPSE_PIPELINE_SPLIT_MIN=N     smallest batch that is split (default 4)
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+#define CHUNKS_PER_THREAD 4
+
+typedef struct xeno_split_device {
+    uint32_t min_batch;
+    PFN_vkCreateGraphicsPipelines next_create_graphics;
+    PFN_vkCreateComputePipelines next_create_compute;
+    PFN_vkCreatePipelineCache next_create_cache;
+    PFN_vkDestroyPipelineCache next_destroy_cache;
+    xeno_map_t exclusive_caches;    /* VkPipelineCache created externally synchronized -> (void*)1 */
+    _Atomic uint64_t batches, split_batches, split_pipelines, chunks, threads, early_return_drops;
+    _Atomic uint64_t busy_ns, wall_ns;  /* summed chunk compile time / time the split calls took */
+} xeno_split_device_t;
+
+typedef struct split_job {
+    xeno_device_t* dev;
+    int graphics;
+    VkPipelineCache cache;
+    const void* infos;
+    const VkAllocationCallbacks* allocator;
+    VkPipeline* out;
+    uint32_t count, chunk;
+    VkResult* results;              /* per chunk */
+} split_job_t;
+
+static VkResult merge_result(VkResult total, VkResult r) {
+    if (r == VK_SUCCESS || total < 0) return total;
+    if (r < 0 || total == VK_SUCCESS) return r;
+    return total;
+}
+
+static void split_run(void* ctx, uint32_t c) {
+    split_job_t* j = ctx; xeno_split_device_t* sp = j->dev->split;
+    uint32_t first = c * j->chunk, n = j->count - first < j->chunk ? j->count - first : j->chunk;
+    uint64_t t0 = xeno_now_ns();
+    if (j->graphics)
+        j->results[c] = sp->next_create_graphics(j->dev->handle, j->cache, n, (const VkGraphicsPipelineCreateInfo*)j->infos + first, j->allocator, j->out + first);
+    else
+        j->results[c] = sp->next_create_compute(j->dev->handle, j->cache, n, (const VkComputePipelineCreateInfo*)j->infos + first, j->allocator, j->out + first);
+    atomic_fetch_add(&sp->busy_ns, xeno_now_ns() - t0);
+}
+
+static VkPipelineCreateFlags elem_flags(const split_job_t* j, uint32_t i) {
+    return j->graphics ? ((const VkGraphicsPipelineCreateInfo*)j->infos)[i].flags : ((const VkComputePipelineCreateInfo*)j->infos)[i].flags;
+}
+static int32_t elem_base_index(const split_job_t* j, uint32_t i) {
+    return j->graphics ? ((const VkGraphicsPipelineCreateInfo*)j->infos)[i].basePipelineIndex : ((const VkComputePipelineCreateInfo*)j->infos)[i].basePipelineIndex;
+}
+
+/* 0 when the batch has to go down in one piece */
+static int splittable(xeno_split_device_t* sp, const split_job_t* j) {
+    if (j->count < sp->min_batch || xeno_workers_count() == 0) return 0;
+    if (j->cache && xeno_map_get(&sp->exclusive_caches, XENO_HANDLE_KEY(j->cache))) return 0;
+    for (uint32_t i = 0; i < j->count; ++i)
+        if ((elem_flags(j, i) & VK_PIPELINE_CREATE_DERIVATIVE_BIT) && elem_base_index(j, i) >= 0) return 0;
+    return 1;
+}
+
+static VkResult split_create(split_job_t* j) {
+    xeno_split_device_t* sp = j->dev->split;
+    atomic_fetch_add(&sp->batches, 1);
+    if (!splittable(sp, j)) {
+        if (j->graphics) return sp->next_create_graphics(j->dev->handle, j->cache, j->count, j->infos, j->allocator, j->out);
+        return sp->next_create_compute(j->dev->handle, j->cache, j->count, j->infos, j->allocator, j->out);
+    }
+    uint32_t threads = (uint32_t)xeno_workers_count() + 1;
+    uint32_t chunks = threads * CHUNKS_PER_THREAD;
+    if (chunks > j->count) chunks = j->count;
+    j->chunk = (j->count + chunks - 1) / chunks;
+    chunks = (j->count + j->chunk - 1) / j->chunk;
+    VkResult* results = calloc(chunks, sizeof(VkResult));
+    if (!results) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    j->results = results;
+    uint64_t t0 = xeno_now_ns();
+    uint32_t used = xeno_workers_parallel(chunks, split_run, j);
+    atomic_fetch_add(&sp->wall_ns, xeno_now_ns() - t0);
+    atomic_fetch_add(&sp->split_batches, 1); atomic_fetch_add(&sp->split_pipelines, j->count);
+    atomic_fetch_add(&sp->chunks, chunks); atomic_fetch_add(&sp->threads, used);
+
+    VkResult result = VK_SUCCESS;
+    uint32_t stop = j->count;
+    for (uint32_t c = 0; c < chunks; ++c) {
+        result = merge_result(result, results[c]);
+        if (results[c] == VK_SUCCESS) continue;
+        /* the first failed element of this chunk that asked for early return ends the batch */
+        uint32_t first = c * j->chunk, end = first + j->chunk < j->count ? first + j->chunk : j->count;
+        for (uint32_t i = first; i < end; ++i)
+            if (!j->out[i] && (elem_flags(j, i) & VK_PIPELINE_CREATE_EARLY_RETURN_ON_FAILURE_BIT)) { stop = i; break; }
+        if (stop < j->count) break;
+    }
+    for (uint32_t i = stop + 1; i < j->count; ++i) {
+        if (!j->out[i]) continue;
+        j->dev->vk.vkDestroyPipeline(j->dev->handle, j->out[i], j->allocator);
+        j->out[i] = VK_NULL_HANDLE;
+        atomic_fetch_add(&sp->early_return_drops, 1);
+    }
+    free(results);
+    return result;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL split_vkCreateGraphicsPipelines(VkDevice device, VkPipelineCache pipelineCache, uint32_t createInfoCount,
+                                                                      const VkGraphicsPipelineCreateInfo* pCreateInfos, const VkAllocationCallbacks* pAllocator, VkPipeline* pPipelines) {
+    split_job_t j = { xeno_device_get(device), 1, pipelineCache, pCreateInfos, pAllocator, pPipelines, createInfoCount, 0, NULL };
+    return split_create(&j);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL split_vkCreateComputePipelines(VkDevice device, VkPipelineCache pipelineCache, uint32_t createInfoCount,
+                                                                     const VkComputePipelineCreateInfo* pCreateInfos, const VkAllocationCallbacks* pAllocator, VkPipeline* pPipelines) {
+    split_job_t j = { xeno_device_get(device), 0, pipelineCache, pCreateInfos, pAllocator, pPipelines, createInfoCount, 0, NULL };
+    return split_create(&j);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL split_vkCreatePipelineCache(VkDevice device, const VkPipelineCacheCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkPipelineCache* pPipelineCache) {
+    xeno_split_device_t* sp = xeno_device_get(device)->split;
+    VkResult r = sp->next_create_cache(device, pCreateInfo, pAllocator, pPipelineCache);
+    if (r == VK_SUCCESS && (pCreateInfo->flags & VK_PIPELINE_CACHE_CREATE_EXTERNALLY_SYNCHRONIZED_BIT))
+        xeno_map_put(&sp->exclusive_caches, XENO_HANDLE_KEY(*pPipelineCache), (void*)1);
+    return r;
+}
+static VKAPI_ATTR void VKAPI_CALL split_vkDestroyPipelineCache(VkDevice device, VkPipelineCache pipelineCache, const VkAllocationCallbacks* pAllocator) {
+    xeno_split_device_t* sp = xeno_device_get(device)->split;
+    if (pipelineCache) xeno_map_remove(&sp->exclusive_caches, XENO_HANDLE_KEY(pipelineCache));
+    sp->next_destroy_cache(device, pipelineCache, pAllocator);
+}
+
+/* 1 when concurrent use of cache would be invalid, or unknown because the module is off */
+int xeno_split_cache_exclusive(xeno_device_t* dev, VkPipelineCache cache) {
+    return !dev->split || xeno_map_get(&dev->split->exclusive_caches, XENO_HANDLE_KEY(cache)) != NULL;
+}
+
+/* --- device lifetime / routing --- */
+int xeno_split_init(xeno_device_t* dev) {
+    if (!xeno_env_bool("XCLIPSE_PIPELINE_SPLIT", 1)) return 0;
+    if (!dev->vk.vkCreateGraphicsPipelines || !dev->vk.vkCreateComputePipelines || !dev->vk.vkCreatePipelineCache ||
+        !dev->vk.vkDestroyPipelineCache || !dev->vk.vkDestroyPipeline) return -1;
+    xeno_split_device_t* sp = calloc(1, sizeof(*sp)); if (!sp) return -1;
+    long min = xeno_env_long("XCLIPSE_PIPELINE_SPLIT_MIN", 4);
+    sp->min_batch = (uint32_t)(min > 2 ? min : 2);
+    xeno_map_init(&sp->exclusive_caches, 64);
+    /* interpose above the persistent cache and below every other module */
+    sp->next_create_graphics = dev->vk.vkCreateGraphicsPipelines; dev->vk.vkCreateGraphicsPipelines = split_vkCreateGraphicsPipelines;
+    sp->next_create_compute = dev->vk.vkCreateComputePipelines; dev->vk.vkCreateComputePipelines = split_vkCreateComputePipelines;
+    sp->next_create_cache = dev->vk.vkCreatePipelineCache; sp->next_destroy_cache = dev->vk.vkDestroyPipelineCache;
+    dev->split = sp;
+    return 0;
+}
+
+void xeno_split_destroy(xeno_device_t* dev) {
+    xeno_split_device_t* sp = dev->split;
+    if (!sp) return;
+    dev->vk.vkCreateGraphicsPipelines = sp->next_create_graphics; dev->vk.vkCreateComputePipelines = sp->next_create_compute;
+    dev->split = NULL;
+    xeno_map_destroy(&sp->exclusive_caches);
+    free(sp);
+}
+
+PFN_vkVoidFunction xeno_split_proc(xeno_device_t* dev, const char* name) {
+    if (!dev->split) return NULL;
+    if (strcmp(name, "vkCreateGraphicsPipelines") == 0) return (PFN_vkVoidFunction)split_vkCreateGraphicsPipelines;
+    if (strcmp(name, "vkCreateComputePipelines") == 0) return (PFN_vkVoidFunction)split_vkCreateComputePipelines;
+    if (strcmp(name, "vkCreatePipelineCache") == 0) return (PFN_vkVoidFunction)split_vkCreatePipelineCache;
+    if (strcmp(name, "vkDestroyPipelineCache") == 0) return (PFN_vkVoidFunction)split_vkDestroyPipelineCache;
+    return NULL;
+}
+
+void xeno_split_report(FILE* f, xeno_device_t* dev) {
+    xeno_split_device_t* sp = dev->split;
+    fprintf(f, "  \"pipeline_split\": {\"enabled\": %s", sp ? "true" : "false");
+    if (sp) {
+        uint64_t split = atomic_load(&sp->split_batches), wall = atomic_load(&sp->wall_ns);
+        fprintf(f, ", \"min_batch\": %u, \"batches\": %" PRIu64 ", \"split_batches\": %" PRIu64 ", \"split_pipelines\": %" PRIu64 ", \"chunks\": %" PRIu64,
+                sp->min_batch, atomic_load(&sp->batches), split, atomic_load(&sp->split_pipelines), atomic_load(&sp->chunks));
+        /* speedup: compile time summed over the chunks of split batches against their wall time */
+        fprintf(f, ", \"avg_threads\": %.2f, \"speedup\": %.2f, \"early_return_drops\": %" PRIu64,
+                split ? (double)atomic_load(&sp->threads) / (double)split : 0.0,
+                wall ? (double)atomic_load(&sp->busy_ns) / (double)wall : 0.0, atomic_load(&sp->early_return_drops));
+    }
+    fprintf(f, "}");
+}
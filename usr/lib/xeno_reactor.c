@@ -0,0 +1,240 @@
+/* xeno_reactor.c - fence completions delivered from one epoll thread instead of polling
+ *
+ * Code that has to learn when the GPU is done with something either blocks in vkWaitForFences or
+ * polls vkGetFenceStatus, and middleware threads polling in a loop keep a core awake for nothing.
+ * With XCLIPSE_REACTOR=1 vkCreateDevice enables VK_KHR_external_fence_fd when the driver can export
+ * and import fences as sync_files, and every fence is created exportable. Watching a fence exports
+ * its pending signal as a sync_file and adds it to the device's epoll set; one reactor thread per
+ * device (started by the first watch) sleeps in epoll_wait and, once a sync_file turns readable,
+ * closes it and delivers the completion: the watch's callback runs, then its futex word is set to 1
+ * and woken. A fence that has already signalled exports no file and completes on the calling thread.
+ *
+ * Exporting a sync_file resets the fence, so the same sync_file is imported back into it as a
+ * temporary payload: the fence reads signalled when the watch completes and the app's own status
+ * checks, waits and resets behave as before. The fence may be reset, reused or destroyed while
+ * its watch is pending.
+ *
+ * The staging ring's fences are watched, so reclaiming ring space reads a flag instead of calling
+ * vkGetFenceStatus for the oldest span. Apps get the same through an extension-like entrypoint
+ * from vkGetDeviceProcAddr(device, "vkWatchFenceXCLIPSE"):
+ *   typedef void (VKAPI_PTR *PFN_vkFenceCompleteXCLIPSE)(void* pUserData, VkResult result);
+ *   VkResult vkWatchFenceXCLIPSE(VkDevice device, VkFence fence, PFN_vkFenceCompleteXCLIPSE pfnCallback,
+ *                                void* pUserData, uint32_t* pFutexWord);
+ * called once the submit signalling fence was made; pfnCallback and pFutexWord may each be NULL.
+ * The callback gets VK_SUCCESS once the fence signalled (VK_ERROR_DEVICE_LOST if it never will),
+ * runs on the reactor thread and must not block; *pFutexWord is then set to 1 and woken
+ * (FUTEX_WAKE_PRIVATE), so a thread can sleep in FUTEX_WAIT while it reads 0.
+ * VK_ERROR_FEATURE_NOT_PRESENT: the fence cannot be watched (created exportable as another handle
+ * type, or no sync_file export), poll it as before.
+ *
+ * Semaphores are not watched: exporting a binary semaphore's sync_file takes its signal away from
+ * the wait the app submitted for it, and timeline semaphores have no sync_file export.
+ *
+ * Knobs:
+ *   XCLIPSE_REACTOR=1    fences exportable as sync_files, completions delivered by the reactor thread
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "xeno_internal.h"
+
+#define XR_EVENTS 32
+
+typedef struct xr_watch {
+    struct xr_watch *prev, *next;   /* pending watches */
+    int fd;                         /* the exported sync_file */
+    xeno_reactor_fn fn; void* ctx;
+    uint32_t* futex;
+} xr_watch_t;
+
+typedef struct xeno_reactor_device {
+    xeno_device_t* dev;
+    PFN_vkCreateFence next_vkCreateFence;
+    int epoll, stop;                /* stop: eventfd in the epoll set, data.ptr NULL */
+    pthread_t thread; int started;
+    pthread_mutex_t lock;           /* pending list, thread start */
+    xr_watch_t pending;             /* list head */
+    _Atomic int restore_logged;
+    _Atomic uint64_t watches, app_watches, immediate, delivered, lost, wakeups, failures, restore_failures;
+} xeno_reactor_device_t;
+
+typedef void (VKAPI_PTR *PFN_vkFenceCompleteXCLIPSE)(void* pUserData, VkResult result);
+
+static void count(_Atomic uint64_t* c) { atomic_fetch_add_explicit(c, 1, memory_order_relaxed); }
+
+static void complete(xeno_reactor_device_t* rd, xr_watch_t* w, VkResult result) {
+    if (w->fn) w->fn(w->ctx, result);
+    if (w->futex) {
+        __atomic_store_n(w->futex, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, w->futex, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+    count(result == VK_SUCCESS ? &rd->delivered : &rd->lost);
+}
+
+static void unlink_watch(xr_watch_t* w) { w->prev->next = w->next; w->next->prev = w->prev; }
+
+/* --- reactor thread --- */
+static void* reactor_main(void* arg) {
+    xeno_reactor_device_t* rd = arg;
+    struct epoll_event ev[XR_EVENTS];
+    for (int stop = 0; !stop;) {
+        int n = epoll_wait(rd->epoll, ev, XR_EVENTS, -1);
+        if (n < 0) { if (errno == EINTR) continue; xlog("reactor: epoll_wait failed (%d), watches complete at device destroy", errno); break; }
+        count(&rd->wakeups);
+        for (int i = 0; i < n; ++i) {
+            xr_watch_t* w = ev[i].data.ptr;
+            if (!w) { stop = 1; continue; }
+            pthread_mutex_lock(&rd->lock);
+            unlink_watch(w);
+            pthread_mutex_unlock(&rd->lock);
+            epoll_ctl(rd->epoll, EPOLL_CTL_DEL, w->fd, NULL);  /* the fence may still hold the file */
+            close(w->fd);
+            complete(rd, w, ev[i].events & EPOLLIN ? VK_SUCCESS : VK_ERROR_DEVICE_LOST);
+            free(w);
+        }
+    }
+    return NULL;
+}
+
+/* --- watches --- */
+int xeno_reactor_watch(xeno_device_t* dev, VkFence fence, xeno_reactor_fn fn, void* ctx, uint32_t* futex_word) {
+    xeno_reactor_device_t* rd = dev->reactor;
+    if (!rd || !fence) return -1;
+    VkFenceGetFdInfoKHR gi = { .sType = VK_STRUCTURE_TYPE_FENCE_GET_FD_INFO_KHR, .fence = fence, .handleType = VK_EXTERNAL_FENCE_HANDLE_TYPE_SYNC_FD_BIT };
+    int fd = -1;
+    if (dev->vk.vkGetFenceFdKHR(dev->handle, &gi, &fd) != VK_SUCCESS) { count(&rd->failures); return -1; }
+    count(&rd->watches);
+    xr_watch_t now = { .fn = fn, .ctx = ctx, .futex = futex_word };
+    if (fd < 0) { count(&rd->immediate); complete(rd, &now, VK_SUCCESS); return 0; }   /* already signalled */
+    /* the export reset the fence: it gets the same payload back until it is reset */
+    int copy = dup(fd);
+    VkImportFenceFdInfoKHR ii = { .sType = VK_STRUCTURE_TYPE_IMPORT_FENCE_FD_INFO_KHR, .fence = fence, .flags = VK_FENCE_IMPORT_TEMPORARY_BIT,
+                                  .handleType = VK_EXTERNAL_FENCE_HANDLE_TYPE_SYNC_FD_BIT, .fd = copy };
+    if (copy < 0 || dev->vk.vkImportFenceFdKHR(dev->handle, &ii) != VK_SUCCESS) {
+        if (copy >= 0) close(copy);
+        count(&rd->restore_failures);
+        if (!atomic_exchange(&rd->restore_logged, 1)) xlog("reactor: a watched fence could not take its sync_file back and stays unsignalled until reset");
+    }
+    xr_watch_t* w = malloc(sizeof(*w));
+    pthread_mutex_lock(&rd->lock);
+    if (w && !rd->started) {
+        rd->started = pthread_create(&rd->thread, NULL, reactor_main, rd) == 0 ? 1 : -1;
+        if (rd->started > 0) pthread_setname_np(rd->thread, "xeno-reactor");
+        else xlog("reactor: thread creation failed, fences are polled");
+    }
+    if (!w || rd->started < 0) {
+        /* the fence has its payload back: the caller polls it */
+        pthread_mutex_unlock(&rd->lock);
+        free(w); close(fd);
+        count(&rd->failures);
+        return -1;
+    }
+    *w = now; w->fd = fd;
+    w->next = rd->pending.next; w->prev = &rd->pending; rd->pending.next->prev = w; rd->pending.next = w;
+    struct epoll_event ev = { .events = EPOLLIN | EPOLLONESHOT, .data.ptr = w };
+    int added = epoll_ctl(rd->epoll, EPOLL_CTL_ADD, fd, &ev) == 0;
+    if (!added) unlink_watch(w);
+    pthread_mutex_unlock(&rd->lock);
+    if (!added) { close(fd); free(w); count(&rd->failures); return -1; }
+    return 0;
+}
+
+/* --- entrypoints --- */
+static VKAPI_ATTR VkResult VKAPI_CALL xr_vkCreateFence(VkDevice device, const VkFenceCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkFence* pFence) {
+    xeno_reactor_device_t* rd = xeno_device_get(device)->reactor;
+    for (const VkBaseInStructure* s = pCreateInfo->pNext; s; s = s->pNext)
+        if (s->sType == VK_STRUCTURE_TYPE_EXPORT_FENCE_CREATE_INFO) return rd->next_vkCreateFence(device, pCreateInfo, pAllocator, pFence);
+    VkExportFenceCreateInfo ex = { .sType = VK_STRUCTURE_TYPE_EXPORT_FENCE_CREATE_INFO, .pNext = pCreateInfo->pNext,
+                                   .handleTypes = VK_EXTERNAL_FENCE_HANDLE_TYPE_SYNC_FD_BIT };
+    VkFenceCreateInfo ci = *pCreateInfo;
+    ci.pNext = &ex;
+    return rd->next_vkCreateFence(device, &ci, pAllocator, pFence);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xr_vkWatchFenceXCLIPSE(VkDevice device, VkFence fence, PFN_vkFenceCompleteXCLIPSE pfnCallback, void* pUserData, uint32_t* pFutexWord) {
+    xeno_device_t* dev = xeno_device_get(device);
+    count(&dev->reactor->app_watches);
+    xeno_vqueue_flush(dev); /* the submit signalling fence may still be in a virtual queue's ring */
+    return xeno_reactor_watch(dev, fence, (xeno_reactor_fn)pfnCallback, pUserData, pFutexWord) == 0 ? VK_SUCCESS : VK_ERROR_FEATURE_NOT_PRESENT;
+}
+
+/* --- device lifetime / routing --- */
+int xeno_reactor_init(xeno_device_t* dev) {
+    if (!xeno_env_bool("XCLIPSE_REACTOR", 0)) return 0;
+    if (!dev->sync_fd) { xlog("reactor: the driver cannot export fences as sync_files, fences are polled"); return 0; }
+    if (!dev->vk.vkCreateFence || !dev->vk.vkGetFenceFdKHR || !dev->vk.vkImportFenceFdKHR) return -1;
+    xeno_reactor_device_t* rd = calloc(1, sizeof(*rd)); if (!rd) return -1;
+    rd->dev = dev;
+    rd->epoll = epoll_create1(EPOLL_CLOEXEC);
+    rd->stop = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (rd->epoll < 0 || rd->stop < 0 || epoll_ctl(rd->epoll, EPOLL_CTL_ADD, rd->stop, &ev) != 0) {
+        if (rd->epoll >= 0) close(rd->epoll);
+        if (rd->stop >= 0) close(rd->stop);
+        free(rd);
+        return -1;
+    }
+    rd->pending.next = rd->pending.prev = &rd->pending;
+    pthread_mutex_init(&rd->lock, NULL);
+    /* interposed: the modules' own fences are exportable too */
+    rd->next_vkCreateFence = dev->vk.vkCreateFence; dev->vk.vkCreateFence = xr_vkCreateFence;
+    dev->reactor = rd;
+    xlog("reactor: fences exportable as sync_files, completions delivered from an epoll thread");
+    return 0;
+}
+
+void xeno_reactor_destroy(xeno_device_t* dev) {
+    xeno_reactor_device_t* rd = dev->reactor;
+    if (!rd) return;
+    dev->vk.vkCreateFence = rd->next_vkCreateFence;
+    if (rd->started > 0) {
+        uint64_t one = 1;
+        ssize_t n = write(rd->stop, &one, sizeof(one)); (void)n;   /* cannot fail: the counter is far from overflowing */
+        pthread_join(rd->thread, NULL);
+    }
+    /* the device is idle: what is still pending has signalled, or never will */
+    while (rd->pending.next != &rd->pending) {
+        xr_watch_t* w = rd->pending.next;
+        unlink_watch(w);
+        struct pollfd p = { .fd = w->fd, .events = POLLIN };
+        int ready = poll(&p, 1, 0) == 1 && (p.revents & POLLIN);
+        close(w->fd);
+        complete(rd, w, ready ? VK_SUCCESS : VK_ERROR_DEVICE_LOST);
+        free(w);
+    }
+    close(rd->epoll); close(rd->stop);
+    pthread_mutex_destroy(&rd->lock);
+    dev->reactor = NULL;
+    free(rd);
+}
+
+PFN_vkVoidFunction xeno_reactor_proc(xeno_device_t* dev, const char* name) {
+    if (!dev->reactor) return NULL;
+    if (strcmp(name, "vkCreateFence") == 0) return (PFN_vkVoidFunction)xr_vkCreateFence;
+    if (strcmp(name, "vkWatchFenceXCLIPSE") == 0) return (PFN_vkVoidFunction)xr_vkWatchFenceXCLIPSE;
+    return NULL;
+}
+
+void xeno_reactor_report(FILE* f, xeno_device_t* dev) {
+    xeno_reactor_device_t* rd = dev->reactor;
+    fprintf(f, "  \"reactor\": {\"enabled\": %s", rd ? "true" : "false");
+    if (rd) {
+        uint64_t wakeups = atomic_load(&rd->wakeups), delivered = atomic_load(&rd->delivered);
+        fprintf(f, ", \"watches\": %" PRIu64 ", \"app_watches\": %" PRIu64 ", \"immediate\": %" PRIu64 ", \"delivered\": %" PRIu64 ", \"lost\": %" PRIu64
+                   ", \"wakeups\": %" PRIu64 ", \"completions_per_wakeup\": %.2f, \"failures\": %" PRIu64 ", \"restore_failures\": %" PRIu64,
+                atomic_load(&rd->watches), atomic_load(&rd->app_watches), atomic_load(&rd->immediate), delivered, atomic_load(&rd->lost),
+                wakeups, wakeups ? (double)(delivered - atomic_load(&rd->immediate)) / (double)wakeups : 0.0,
+                atomic_load(&rd->failures), atomic_load(&rd->restore_failures));
+    }
+    fprintf(f, "}");
+}
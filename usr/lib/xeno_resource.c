@@ -0,0 +1,290 @@
+/* xeno_resource.c - image / view / render pass / framebuffer tracking for the device-level modules
+ *
+ * Keeps a shallow copy of image create info, the format/subresource range of every view, a copy
+ * of every render pass create info and the views and layers of every framebuffer, so command
+ * buffer intercepts can resolve attachment formats, extents and ops without driver queries. The
+ * modules reading them (shader objects, transient attachments, load/store ops, pass merging) hang
+ * their per-object state off the image and render pass records; it is released with the object.
+ *
+ * Render pass copies leave out extension structs, except the depth/stencil resolve of a subpass;
+ * a pass that had others is marked extended.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include "xeno_internal.h"
+
+#define ATTACHMENT_USAGE (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT)
+
+static xeno_map_t images, views, passes, framebuffers;
+static pthread_once_t maps_once = PTHREAD_ONCE_INIT;
+static void maps_init(void) {
+    xeno_map_init(&images, 4096); xeno_map_init(&views, 4096);
+    xeno_map_init(&passes, 256); xeno_map_init(&framebuffers, 256);
+}
+
+xeno_image_t* xeno_image_get(VkImage image) { pthread_once(&maps_once, maps_init); return xeno_map_get(&images, XENO_HANDLE_KEY(image)); }
+xeno_view_t* xeno_view_get(VkImageView view) { pthread_once(&maps_once, maps_init); return xeno_map_get(&views, XENO_HANDLE_KEY(view)); }
+xeno_render_pass_t* xeno_render_pass_get(VkRenderPass pass) { pthread_once(&maps_once, maps_init); return xeno_map_get(&passes, XENO_HANDLE_KEY(pass)); }
+xeno_framebuffer_t* xeno_framebuffer_get(VkFramebuffer framebuffer) { pthread_once(&maps_once, maps_init); return xeno_map_get(&framebuffers, XENO_HANDLE_KEY(framebuffer)); }
+
+xeno_image_t* xeno_view_image(VkImageView view) {
+    xeno_view_t* v = view ? xeno_view_get(view) : NULL;
+    return v ? xeno_image_get(v->image) : NULL;
+}
+
+int xeno_attachment_usage_only(const VkImageCreateInfo* ci) {
+    VkImageUsageFlags usage = ci->usage & ~VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    return usage && !(usage & ~ATTACHMENT_USAGE) && ci->tiling == VK_IMAGE_TILING_OPTIMAL;
+}
+
+xeno_resource_user_t* xeno_resource_attach(_Atomic(xeno_resource_user_t*)* slot, xeno_resource_user_t* u) {
+    xeno_resource_user_t* cur = NULL;
+    if (atomic_compare_exchange_strong(slot, &cur, u)) return u;
+    u->release(u);
+    return cur;
+}
+
+static void release_users(_Atomic(xeno_resource_user_t*)* user) {
+    for (int i = 0; i < XENO_RESOURCE_USERS; ++i) {
+        xeno_resource_user_t* u = atomic_exchange(&user[i], NULL);
+        if (u) u->release(u);
+    }
+}
+
+/* --- images and views --- */
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkCreateImage(VkDevice device, const VkImageCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkImage* pImage) {
+    xeno_device_t* dev = xeno_device_get(device);
+    VkResult r = dev->vk.vkCreateImage(device, pCreateInfo, pAllocator, pImage);
+    if (r != VK_SUCCESS) return r;
+    xeno_image_t* img = calloc(1, sizeof(*img));
+    if (img) {
+        img->handle = *pImage; img->dev = dev; img->info = *pCreateInfo;
+        img->info.pNext = NULL; img->info.pQueueFamilyIndices = NULL; img->info.queueFamilyIndexCount = 0;
+        /* extension structs (external memory, ...) and aliasing let the contents out some other way */
+        img->attachment_only = xeno_attachment_usage_only(pCreateInfo) && !pCreateInfo->pNext && !(pCreateInfo->flags & VK_IMAGE_CREATE_ALIAS_BIT);
+        pthread_once(&maps_once, maps_init);
+        xeno_map_put(&images, XENO_HANDLE_KEY(*pImage), img);
+    }
+    return r;
+}
+static void image_free(xeno_image_t* img) { release_users(img->user); free(img); }
+static VKAPI_ATTR void VKAPI_CALL xeno_vkDestroyImage(VkDevice device, VkImage image, const VkAllocationCallbacks* pAllocator) {
+    xeno_device_t* dev = xeno_device_get(device);
+    xeno_image_t* img = NULL;
+    if (image) { pthread_once(&maps_once, maps_init); img = xeno_map_remove(&images, XENO_HANDLE_KEY(image)); }
+    if (img) image_free(img);
+    dev->vk.vkDestroyImage(device, image, pAllocator);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkCreateImageView(VkDevice device, const VkImageViewCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkImageView* pView) {
+    xeno_device_t* dev = xeno_device_get(device);
+    VkResult r = dev->vk.vkCreateImageView(device, pCreateInfo, pAllocator, pView);
+    if (r != VK_SUCCESS) return r;
+    xeno_view_t* v = calloc(1, sizeof(*v));
+    if (v) {
+        v->handle = *pView; v->dev = dev; v->image = pCreateInfo->image; v->format = pCreateInfo->format; v->range = pCreateInfo->subresourceRange;
+        pthread_once(&maps_once, maps_init);
+        xeno_map_put(&views, XENO_HANDLE_KEY(*pView), v);
+    }
+    return r;
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkDestroyImageView(VkDevice device, VkImageView imageView, const VkAllocationCallbacks* pAllocator) {
+    xeno_device_t* dev = xeno_device_get(device);
+    if (imageView) { pthread_once(&maps_once, maps_init); free(xeno_map_remove(&views, XENO_HANDLE_KEY(imageView))); }
+    dev->vk.vkDestroyImageView(device, imageView, pAllocator);
+}
+
+/* --- render passes: one allocation holding the create info and the arrays it points to --- */
+static size_t arr(size_t n, size_t size) { return (n * size + 7) & ~(size_t)7; }
+static void* put(char** cur, const void* src, size_t n, size_t size) {
+    void* d = *cur;
+    if (!n || !src) return NULL;
+    memcpy(d, src, n * size);
+    *cur += arr(n, size);
+    return d;
+}
+
+static VkRenderPassCreateInfo* pass_copy(const VkRenderPassCreateInfo* ci, int* extended) {
+    size_t size = arr(1, sizeof(*ci)) + arr(ci->attachmentCount, sizeof(VkAttachmentDescription)) +
+                  arr(ci->subpassCount, sizeof(VkSubpassDescription)) + arr(ci->dependencyCount, sizeof(VkSubpassDependency));
+    for (uint32_t s = 0; s < ci->subpassCount; ++s) {
+        const VkSubpassDescription* sp = &ci->pSubpasses[s];
+        size += arr(sp->inputAttachmentCount, sizeof(VkAttachmentReference)) + arr(sp->colorAttachmentCount, sizeof(VkAttachmentReference)) * 2 +
+                arr(1, sizeof(VkAttachmentReference)) + arr(sp->preserveAttachmentCount, sizeof(uint32_t));
+    }
+    char* cur = malloc(size);
+    if (!cur) return NULL;
+    *extended = ci->pNext != NULL;
+    VkRenderPassCreateInfo* c = put(&cur, ci, 1, sizeof(*ci));
+    c->pNext = NULL;
+    c->pAttachments = put(&cur, ci->pAttachments, ci->attachmentCount, sizeof(VkAttachmentDescription));
+    VkSubpassDescription* sps = put(&cur, ci->pSubpasses, ci->subpassCount, sizeof(VkSubpassDescription));
+    c->pSubpasses = sps;
+    for (uint32_t s = 0; s < ci->subpassCount; ++s) {
+        VkSubpassDescription* sp = &sps[s];
+        sp->pInputAttachments = put(&cur, sp->pInputAttachments, sp->inputAttachmentCount, sizeof(VkAttachmentReference));
+        sp->pResolveAttachments = put(&cur, sp->pResolveAttachments, sp->colorAttachmentCount, sizeof(VkAttachmentReference));
+        sp->pColorAttachments = put(&cur, sp->pColorAttachments, sp->colorAttachmentCount, sizeof(VkAttachmentReference));
+        sp->pDepthStencilAttachment = put(&cur, sp->pDepthStencilAttachment, 1, sizeof(VkAttachmentReference));
+        sp->pPreserveAttachments = put(&cur, sp->pPreserveAttachments, sp->preserveAttachmentCount, sizeof(uint32_t));
+    }
+    c->pDependencies = put(&cur, ci->pDependencies, ci->dependencyCount, sizeof(VkSubpassDependency));
+    return c;
+}
+
+static const VkSubpassDescriptionDepthStencilResolve* ds_resolve(const VkSubpassDescription2* sp, int* extended) {
+    const VkSubpassDescriptionDepthStencilResolve* ds = NULL;
+    for (const VkBaseInStructure* s = sp->pNext; s; s = s->pNext) {
+        if (s->sType == VK_STRUCTURE_TYPE_SUBPASS_DESCRIPTION_DEPTH_STENCIL_RESOLVE) ds = (const VkSubpassDescriptionDepthStencilResolve*)s;
+        else *extended = 1;
+    }
+    return ds;
+}
+
+/* the copied structs of an array lose their extension structs */
+#define PLAIN(p, n, extended) do { \
+        for (uint32_t i_ = 0; (p) && i_ < (n); ++i_) { if ((p)[i_].pNext) *(extended) = 1; (p)[i_].pNext = NULL; } } while (0)
+
+static VkRenderPassCreateInfo2* pass_copy2(const VkRenderPassCreateInfo2* ci, int* extended) {
+    int ignored = 0;
+    size_t size = arr(1, sizeof(*ci)) + arr(ci->attachmentCount, sizeof(VkAttachmentDescription2)) + arr(ci->subpassCount, sizeof(VkSubpassDescription2)) +
+                  arr(ci->dependencyCount, sizeof(VkSubpassDependency2)) + arr(ci->correlatedViewMaskCount, sizeof(uint32_t));
+    for (uint32_t s = 0; s < ci->subpassCount; ++s) {
+        const VkSubpassDescription2* sp = &ci->pSubpasses[s];
+        size += arr(sp->inputAttachmentCount, sizeof(VkAttachmentReference2)) + arr(sp->colorAttachmentCount, sizeof(VkAttachmentReference2)) * 2 +
+                arr(1, sizeof(VkAttachmentReference2)) + arr(sp->preserveAttachmentCount, sizeof(uint32_t));
+        if (ds_resolve(sp, &ignored)) size += arr(1, sizeof(VkSubpassDescriptionDepthStencilResolve)) + arr(1, sizeof(VkAttachmentReference2));
+    }
+    char* cur = malloc(size);
+    if (!cur) return NULL;
+    *extended = ci->pNext != NULL;
+    VkRenderPassCreateInfo2* c = put(&cur, ci, 1, sizeof(*ci));
+    c->pNext = NULL;
+    VkAttachmentDescription2* atts = put(&cur, ci->pAttachments, ci->attachmentCount, sizeof(VkAttachmentDescription2));
+    PLAIN(atts, ci->attachmentCount, extended);
+    c->pAttachments = atts;
+    VkSubpassDescription2* sps = put(&cur, ci->pSubpasses, ci->subpassCount, sizeof(VkSubpassDescription2));
+    c->pSubpasses = sps;
+    for (uint32_t s = 0; s < ci->subpassCount; ++s) {
+        VkSubpassDescription2* sp = &sps[s];
+        const VkSubpassDescriptionDepthStencilResolve* ds = ds_resolve(&ci->pSubpasses[s], extended);
+        VkAttachmentReference2* in = put(&cur, sp->pInputAttachments, sp->inputAttachmentCount, sizeof(VkAttachmentReference2));
+        VkAttachmentReference2* resolve = put(&cur, sp->pResolveAttachments, sp->colorAttachmentCount, sizeof(VkAttachmentReference2));
+        VkAttachmentReference2* color = put(&cur, sp->pColorAttachments, sp->colorAttachmentCount, sizeof(VkAttachmentReference2));
+        VkAttachmentReference2* depth = put(&cur, sp->pDepthStencilAttachment, 1, sizeof(VkAttachmentReference2));
+        PLAIN(in, sp->inputAttachmentCount, extended); PLAIN(resolve, sp->colorAttachmentCount, extended);
+        PLAIN(color, sp->colorAttachmentCount, extended); PLAIN(depth, 1, extended);
+        sp->pInputAttachments = in; sp->pResolveAttachments = resolve; sp->pColorAttachments = color; sp->pDepthStencilAttachment = depth;
+        sp->pPreserveAttachments = put(&cur, sp->pPreserveAttachments, sp->preserveAttachmentCount, sizeof(uint32_t));
+        sp->pNext = NULL;
+        if (!ds) continue;
+        VkSubpassDescriptionDepthStencilResolve* d = put(&cur, ds, 1, sizeof(*ds));
+        VkAttachmentReference2* target = put(&cur, ds->pDepthStencilResolveAttachment, 1, sizeof(VkAttachmentReference2));
+        PLAIN(target, 1, extended);
+        d->pNext = NULL; d->pDepthStencilResolveAttachment = target;
+        sp->pNext = d;
+    }
+    VkSubpassDependency2* deps = put(&cur, ci->pDependencies, ci->dependencyCount, sizeof(VkSubpassDependency2));
+    PLAIN(deps, ci->dependencyCount, extended);
+    c->pDependencies = deps;
+    c->pCorrelatedViewMasks = put(&cur, ci->pCorrelatedViewMasks, ci->correlatedViewMaskCount, sizeof(uint32_t));
+    return c;
+}
+#undef PLAIN
+
+static void pass_put(xeno_device_t* dev, VkRenderPass handle, int v2, void* info, int extended) {
+    xeno_render_pass_t* rp = calloc(1, sizeof(*rp));
+    if (!rp) { free(info); return; }
+    rp->handle = handle; rp->dev = dev; rp->v2 = v2; rp->info = info; rp->extended = extended;
+    pthread_once(&maps_once, maps_init);
+    xeno_map_put(&passes, XENO_HANDLE_KEY(handle), rp);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkCreateRenderPass(VkDevice device, const VkRenderPassCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkRenderPass* pRenderPass) {
+    xeno_device_t* dev = xeno_device_get(device);
+    VkResult r = dev->vk.vkCreateRenderPass(device, pCreateInfo, pAllocator, pRenderPass);
+    int extended = 0;
+    void* info = r == VK_SUCCESS ? pass_copy(pCreateInfo, &extended) : NULL;
+    if (info) pass_put(dev, *pRenderPass, 0, info, extended);
+    return r;
+}
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkCreateRenderPass2(VkDevice device, const VkRenderPassCreateInfo2* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkRenderPass* pRenderPass) {
+    xeno_device_t* dev = xeno_device_get(device);
+    VkResult r = dev->vk.vkCreateRenderPass2(device, pCreateInfo, pAllocator, pRenderPass);
+    int extended = 0;
+    void* info = r == VK_SUCCESS ? pass_copy2(pCreateInfo, &extended) : NULL;
+    if (info) pass_put(dev, *pRenderPass, 1, info, extended);
+    return r;
+}
+static void pass_free(xeno_render_pass_t* rp) { release_users(rp->user); free(rp->info); free(rp); }
+static VKAPI_ATTR void VKAPI_CALL xeno_vkDestroyRenderPass(VkDevice device, VkRenderPass renderPass, const VkAllocationCallbacks* pAllocator) {
+    xeno_device_t* dev = xeno_device_get(device);
+    xeno_render_pass_t* rp = NULL;
+    if (renderPass) { pthread_once(&maps_once, maps_init); rp = xeno_map_remove(&passes, XENO_HANDLE_KEY(renderPass)); }
+    if (rp) pass_free(rp);
+    dev->vk.vkDestroyRenderPass(device, renderPass, pAllocator);
+}
+
+/* --- framebuffers --- */
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkCreateFramebuffer(VkDevice device, const VkFramebufferCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkFramebuffer* pFramebuffer) {
+    xeno_device_t* dev = xeno_device_get(device);
+    VkResult r = dev->vk.vkCreateFramebuffer(device, pCreateInfo, pAllocator, pFramebuffer);
+    if (r != VK_SUCCESS) return r;
+    uint32_t count = (pCreateInfo->flags & VK_FRAMEBUFFER_CREATE_IMAGELESS_BIT) ? 0 : pCreateInfo->attachmentCount;
+    xeno_framebuffer_t* fb = malloc(sizeof(*fb) + count * sizeof(VkImageView));
+    if (fb) {
+        fb->handle = *pFramebuffer; fb->dev = dev; fb->layers = pCreateInfo->layers; fb->count = count;
+        if (count) memcpy(fb->views, pCreateInfo->pAttachments, count * sizeof(VkImageView));
+        pthread_once(&maps_once, maps_init);
+        xeno_map_put(&framebuffers, XENO_HANDLE_KEY(*pFramebuffer), fb);
+    }
+    return r;
+}
+static VKAPI_ATTR void VKAPI_CALL xeno_vkDestroyFramebuffer(VkDevice device, VkFramebuffer framebuffer, const VkAllocationCallbacks* pAllocator) {
+    xeno_device_t* dev = xeno_device_get(device);
+    if (framebuffer) { pthread_once(&maps_once, maps_init); free(xeno_map_remove(&framebuffers, XENO_HANDLE_KEY(framebuffer))); }
+    dev->vk.vkDestroyFramebuffer(device, framebuffer, pAllocator);
+}
+
+PFN_vkVoidFunction xeno_resource_proc(xeno_device_t* dev, const char* name) {
+    /* only needed while a module consumes attachments */
+    if (!dev->so && !dev->transient && !dev->loadstore && !dev->passmerge) return NULL;
+    if (strcmp(name, "vkCreateImage") == 0) return (PFN_vkVoidFunction)xeno_vkCreateImage;
+    if (strcmp(name, "vkDestroyImage") == 0) return (PFN_vkVoidFunction)xeno_vkDestroyImage;
+    if (strcmp(name, "vkCreateImageView") == 0) return (PFN_vkVoidFunction)xeno_vkCreateImageView;
+    if (strcmp(name, "vkDestroyImageView") == 0) return (PFN_vkVoidFunction)xeno_vkDestroyImageView;
+    if (strcmp(name, "vkCreateRenderPass") == 0) return (PFN_vkVoidFunction)xeno_vkCreateRenderPass;
+    if (dev->vk.vkCreateRenderPass2 && (strcmp(name, "vkCreateRenderPass2") == 0 || strcmp(name, "vkCreateRenderPass2KHR") == 0))
+        return (PFN_vkVoidFunction)xeno_vkCreateRenderPass2;
+    if (strcmp(name, "vkDestroyRenderPass") == 0) return (PFN_vkVoidFunction)xeno_vkDestroyRenderPass;
+    if (strcmp(name, "vkCreateFramebuffer") == 0) return (PFN_vkVoidFunction)xeno_vkCreateFramebuffer;
+    if (strcmp(name, "vkDestroyFramebuffer") == 0) return (PFN_vkVoidFunction)xeno_vkDestroyFramebuffer;
+    return NULL;
+}
+
+typedef struct user_walk { xeno_device_t* dev; int slot; void (*fn)(xeno_resource_user_t* u, void* ctx); void* ctx; } user_walk_t;
+static int pass_user_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; xeno_render_pass_t* rp = val; user_walk_t* w = ctx;
+    xeno_resource_user_t* u = rp->dev == w->dev ? atomic_load(&rp->user[w->slot]) : NULL;
+    if (u) w->fn(u, w->ctx);
+    return 0;
+}
+void xeno_render_pass_foreach(xeno_device_t* dev, int slot, void (*fn)(xeno_resource_user_t* u, void* ctx), void* ctx) {
+    user_walk_t w = { dev, slot, fn, ctx };
+    pthread_once(&maps_once, maps_init);
+    xeno_map_foreach(&passes, pass_user_fn, &w);
+}
+
+/* objects the app leaked, with the module state hanging off them */
+static int image_walk_fn(uint64_t key, void* val, void* ctx) { (void)key; xeno_image_t* img = val; if (img->dev != ctx) return 0; image_free(img); return 1; }
+static int view_walk_fn(uint64_t key, void* val, void* ctx) { (void)key; xeno_view_t* v = val; if (v->dev != ctx) return 0; free(v); return 1; }
+static int pass_walk_fn(uint64_t key, void* val, void* ctx) { (void)key; xeno_render_pass_t* rp = val; if (rp->dev != ctx) return 0; pass_free(rp); return 1; }
+static int framebuffer_walk_fn(uint64_t key, void* val, void* ctx) { (void)key; xeno_framebuffer_t* fb = val; if (fb->dev != ctx) return 0; free(fb); return 1; }
+
+void xeno_resource_destroy(xeno_device_t* dev) {
+    pthread_once(&maps_once, maps_init);
+    xeno_map_foreach(&framebuffers, framebuffer_walk_fn, dev);
+    xeno_map_foreach(&passes, pass_walk_fn, dev);
+    xeno_map_foreach(&views, view_walk_fn, dev);
+    xeno_map_foreach(&images, image_walk_fn, dev);
+}
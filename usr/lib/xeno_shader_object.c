@@ -0,0 +1,379 @@
+/* xeno_shader_object.c - VK_EXT_shader_object emulation on top of pipelines
+ *
+ * Used when the downstream driver rejects VK_EXT_shader_object at vkCreateDevice. Each shader
+ * object keeps a VkShaderModule plus its own pipeline layout; compute objects get their pipeline
+ * eagerly. Graphics pipelines are derived at draw time from the bound stages, the dynamic
+ * rendering formats and whatever dynamic state the driver cannot set itself, and are kept in a
+ * lock-free variant cache. Binding shaders into a command buffer that already has state starts a
+ * speculative compile on the worker pool so the draw usually finds the variant ready.
+ *
+ * Knobs:
+ *   XCLIPSE_SHADER_OBJECT_EMULATION=0  disable (the extension is then passed through untouched)
+ *   XCLIPSE_SO_VARIANT_CAPACITY=N      variant cache slots (default 4096)
+ *   XCLIPSE_SO_ASYNC=0                 disable speculative compiles at bind time
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+/* Binary format returned by vkGetShaderBinaryDataEXT: header followed by the SPIR-V */
+#define XSO_MAGIC "XSO1"
+#define XSO_VERSION 1u
+typedef struct xso_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t stage;
+    uint32_t code_size;
+    uint64_t code_hash;
+} xso_header_t;
+
+#define SO_KEY_WORDS (XENO_DYN_MAX_WORDS + 2 * XENO_SO_STAGES + 4 + XENO_MAX_COLOR_ATTACHMENTS)
+
+typedef struct xeno_shader {
+    uint64_t id;                    /* never reused, unlike the handle address */
+    _Atomic uint32_t refs;          /* app handle + in-flight speculative compiles */
+    xeno_device_t* dev;
+    VkShaderStageFlagBits stage;
+    VkShaderModule module;
+    VkPipelineLayout layout;
+    char* entry;
+    VkSpecializationInfo spec;
+    VkSpecializationMapEntry* spec_entries;
+    void* spec_data;
+    uint32_t* code; size_t code_size;
+    VkPipeline compute;
+} xeno_shader_t;
+
+typedef struct xeno_so_device {
+    xeno_variant_cache_t cache;
+    int async;
+    _Atomic uint64_t next_id;
+    _Atomic uint32_t pending;       /* speculative compiles not yet finished */
+    _Atomic uint64_t shaders, binds, speculative;
+} xeno_so_device_t;
+
+#define SHADER_FROM_HANDLE(h) ((xeno_shader_t*)(uintptr_t)(h))
+
+static int stage_index(VkShaderStageFlagBits stage) {
+    switch (stage) {
+        case VK_SHADER_STAGE_VERTEX_BIT: return 0;
+        case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT: return 1;
+        case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT: return 2;
+        case VK_SHADER_STAGE_GEOMETRY_BIT: return 3;
+        case VK_SHADER_STAGE_FRAGMENT_BIT: return 4;
+        case VK_SHADER_STAGE_TASK_BIT_EXT: return 5;
+        case VK_SHADER_STAGE_MESH_BIT_EXT: return 6;
+        default: return -1;
+    }
+}
+
+static void shader_unref(xeno_shader_t* sh) {
+    if (atomic_fetch_sub(&sh->refs, 1) != 1) return;
+    const xeno_dispatch_t* vk = &sh->dev->vk;
+    if (sh->compute) vk->vkDestroyPipeline(sh->dev->handle, sh->compute, NULL);
+    if (sh->layout) vk->vkDestroyPipelineLayout(sh->dev->handle, sh->layout, NULL);
+    if (sh->module) vk->vkDestroyShaderModule(sh->dev->handle, sh->module, NULL);
+    free(sh->entry); free(sh->spec_entries); free(sh->spec_data); free(sh->code); free(sh);
+}
+
+static void fill_stage(VkPipelineShaderStageCreateInfo* st, const xeno_shader_t* sh) {
+    memset(st, 0, sizeof(*st));
+    st->sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    st->stage = sh->stage; st->module = sh->module; st->pName = sh->entry;
+    st->pSpecializationInfo = sh->spec.mapEntryCount ? &sh->spec : NULL;
+}
+
+/* --- shader creation --- */
+static VkResult shader_load_code(xeno_shader_t* sh, const VkShaderCreateInfoEXT* ci) {
+    const unsigned char* code = ci->pCode; size_t size = ci->codeSize;
+    if (ci->codeType == VK_SHADER_CODE_TYPE_BINARY_EXT) {
+        xso_header_t h;
+        if (size < sizeof(h)) return VK_ERROR_INCOMPATIBLE_SHADER_BINARY_EXT;
+        memcpy(&h, code, sizeof(h));
+        if (memcmp(h.magic, XSO_MAGIC, 4) != 0 || h.version != XSO_VERSION || h.stage != (uint32_t)ci->stage ||
+            h.code_size != size - sizeof(h) || (h.code_size & 3)) return VK_ERROR_INCOMPATIBLE_SHADER_BINARY_EXT;
+        code += sizeof(h); size = h.code_size;
+        if (xeno_hash64(code, size, 0) != h.code_hash) return VK_ERROR_INCOMPATIBLE_SHADER_BINARY_EXT;
+    } else if (ci->codeType != VK_SHADER_CODE_TYPE_SPIRV_EXT || (size & 3)) {
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+    sh->code = malloc(size ? size : 4); if (!sh->code) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    memcpy(sh->code, code, size); sh->code_size = size;
+    return VK_SUCCESS;
+}
+
+static VkResult shader_create(xeno_device_t* dev, const VkShaderCreateInfoEXT* ci, xeno_shader_t** out) {
+    const xeno_dispatch_t* vk = &dev->vk;
+    xeno_shader_t* sh = calloc(1, sizeof(*sh)); if (!sh) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    sh->dev = dev; sh->stage = ci->stage; atomic_init(&sh->refs, 1);
+    sh->id = atomic_fetch_add(&dev->so->next_id, 1) + 1;
+    VkResult r = shader_load_code(sh, ci);
+    if (r == VK_SUCCESS) {
+        sh->entry = strdup(ci->pName ? ci->pName : "main");
+        if (ci->pSpecializationInfo && ci->pSpecializationInfo->mapEntryCount) {
+            const VkSpecializationInfo* si = ci->pSpecializationInfo;
+            sh->spec_entries = malloc(si->mapEntryCount * sizeof(VkSpecializationMapEntry));
+            sh->spec_data = malloc(si->dataSize ? si->dataSize : 1);
+            if (!sh->entry || !sh->spec_entries || !sh->spec_data) r = VK_ERROR_OUT_OF_HOST_MEMORY;
+            else {
+                memcpy(sh->spec_entries, si->pMapEntries, si->mapEntryCount * sizeof(VkSpecializationMapEntry));
+                memcpy(sh->spec_data, si->pData, si->dataSize);
+                sh->spec.mapEntryCount = si->mapEntryCount; sh->spec.pMapEntries = sh->spec_entries;
+                sh->spec.dataSize = si->dataSize; sh->spec.pData = sh->spec_data;
+            }
+        } else if (!sh->entry) r = VK_ERROR_OUT_OF_HOST_MEMORY;
+    }
+    if (r == VK_SUCCESS) {
+        VkShaderModuleCreateInfo mi; memset(&mi, 0, sizeof(mi));
+        mi.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO; mi.codeSize = sh->code_size; mi.pCode = sh->code;
+        r = vk->vkCreateShaderModule(dev->handle, &mi, NULL, &sh->module);
+    }
+    if (r == VK_SUCCESS) {
+        VkPipelineLayoutCreateInfo li; memset(&li, 0, sizeof(li));
+        li.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        li.setLayoutCount = ci->setLayoutCount; li.pSetLayouts = ci->pSetLayouts;
+        li.pushConstantRangeCount = ci->pushConstantRangeCount; li.pPushConstantRanges = ci->pPushConstantRanges;
+        r = vk->vkCreatePipelineLayout(dev->handle, &li, NULL, &sh->layout);
+    }
+    if (r == VK_SUCCESS && sh->stage == VK_SHADER_STAGE_COMPUTE_BIT) {
+        VkComputePipelineCreateInfo cp; memset(&cp, 0, sizeof(cp));
+        cp.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        fill_stage(&cp.stage, sh); cp.layout = sh->layout; cp.basePipelineIndex = -1;
+        r = vk->vkCreateComputePipelines(dev->handle, VK_NULL_HANDLE, 1, &cp, NULL, &sh->compute);
+    }
+    if (r != VK_SUCCESS) { shader_unref(sh); return r; }
+    atomic_fetch_add(&dev->so->shaders, 1);
+    *out = sh;
+    return VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkCreateShadersEXT(VkDevice device, uint32_t createInfoCount, const VkShaderCreateInfoEXT* pCreateInfos,
+                                                              const VkAllocationCallbacks* pAllocator, VkShaderEXT* pShaders) {
+    (void)pAllocator;
+    xeno_device_t* dev = xeno_device_get(device);
+    VkResult result = VK_SUCCESS;
+    for (uint32_t i = 0; i < createInfoCount; ++i) {
+        xeno_shader_t* sh = NULL;
+        VkResult r = shader_create(dev, &pCreateInfos[i], &sh);
+        pShaders[i] = r == VK_SUCCESS ? (VkShaderEXT)(uintptr_t)sh : VK_NULL_HANDLE;
+        if (r != VK_SUCCESS) {
+            xlog("shader_object: create failed stage=0x%x result=%d", (unsigned)pCreateInfos[i].stage, (int)r);
+            if (result == VK_SUCCESS) result = r;
+        }
+    }
+    return result;
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_vkDestroyShaderEXT(VkDevice device, VkShaderEXT shader, const VkAllocationCallbacks* pAllocator) {
+    (void)device; (void)pAllocator;
+    if (shader) shader_unref(SHADER_FROM_HANDLE(shader));
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL xeno_vkGetShaderBinaryDataEXT(VkDevice device, VkShaderEXT shader, size_t* pDataSize, void* pData) {
+    (void)device;
+    xeno_shader_t* sh = SHADER_FROM_HANDLE(shader);
+    size_t need = sizeof(xso_header_t) + sh->code_size;
+    if (!pData) { *pDataSize = need; return VK_SUCCESS; }
+    if (*pDataSize < need) { *pDataSize = 0; return VK_INCOMPLETE; }
+    xso_header_t h; memset(&h, 0, sizeof(h));
+    memcpy(h.magic, XSO_MAGIC, 4); h.version = XSO_VERSION; h.stage = (uint32_t)sh->stage;
+    h.code_size = (uint32_t)sh->code_size; h.code_hash = xeno_hash64(sh->code, sh->code_size, 0);
+    memcpy(pData, &h, sizeof(h)); memcpy((unsigned char*)pData + sizeof(h), sh->code, sh->code_size);
+    *pDataSize = need;
+    return VK_SUCCESS;
+}
+
+/* --- graphics variants --- */
+static VkShaderStageFlags stage_mask(xeno_shader_t* const st[XENO_SO_STAGES]) {
+    VkShaderStageFlags m = 0;
+    for (int i = 0; i < XENO_SO_STAGES; ++i) if (st[i]) m |= st[i]->stage;
+    return m;
+}
+
+static uint64_t baked_mask(const xeno_device_t* dev, VkShaderStageFlags stages) {
+    uint64_t m = ((1ull << XENO_DYN_COUNT) - 1) & ~dev->dyn_native;
+    if (stages & VK_SHADER_STAGE_MESH_BIT_EXT) m &= ~(XENO_DYN_BIT(VERTEX_INPUT) | XENO_DYN_BIT(PRIMITIVE_TOPOLOGY) | XENO_DYN_BIT(PRIMITIVE_RESTART_ENABLE));
+    if (!(stages & VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT)) m &= ~XENO_DYN_BIT(PATCH_CONTROL_POINTS);
+    return m;
+}
+
+static uint32_t build_key(const xeno_device_t* dev, xeno_shader_t* const st[XENO_SO_STAGES], const xeno_dyn_state_t* s,
+                          const xeno_render_formats_t* rf, uint32_t* out) {
+    uint32_t n = 0;
+    for (int i = 0; i < XENO_SO_STAGES; ++i) {
+        uint64_t id = st[i] ? st[i]->id : 0;
+        out[n++] = (uint32_t)id; out[n++] = (uint32_t)(id >> 32);
+    }
+    uint32_t colors = rf->color_count < XENO_MAX_COLOR_ATTACHMENTS ? rf->color_count : XENO_MAX_COLOR_ATTACHMENTS;
+    out[n++] = rf->view_mask; out[n++] = colors;
+    for (uint32_t i = 0; i < colors; ++i) out[n++] = (uint32_t)rf->color[i];
+    out[n++] = (uint32_t)rf->depth; out[n++] = (uint32_t)rf->stencil;
+    n += xeno_dyn_pack(s, baked_mask(dev, stage_mask(st)), colors, &out[n]);
+    return n;
+}
+
+static VkPipeline compile_graphics(xeno_device_t* dev, xeno_shader_t* const st[XENO_SO_STAGES], const xeno_dyn_state_t* s,
+                                   const xeno_render_formats_t* rf) {
+    VkPipelineShaderStageCreateInfo stages[XENO_SO_STAGES]; uint32_t count = 0;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    for (int i = 0; i < XENO_SO_STAGES; ++i) {
+        if (!st[i]) continue;
+        fill_stage(&stages[count++], st[i]);
+        if (!layout) layout = st[i]->layout;
+    }
+    xeno_dyn_pipeline_t p; VkGraphicsPipelineCreateInfo ci; memset(&ci, 0, sizeof(ci));
+    xeno_dyn_fill_pipeline(&p, s, dev->dyn_native, stage_mask(st), rf, &ci);
+    ci.stageCount = count; ci.pStages = stages; ci.layout = layout; ci.basePipelineIndex = -1;
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkResult r = dev->vk.vkCreateGraphicsPipelines(dev->handle, VK_NULL_HANDLE, 1, &ci, NULL, &pipeline);
+    if (r != VK_SUCCESS) { xlog("shader_object: variant compile failed result=%d stages=0x%x", (int)r, (unsigned)stage_mask(st)); pipeline = VK_NULL_HANDLE; }
+    return pipeline;
+}
+
+typedef struct so_compile_ctx { xeno_cb_t* cb; } so_compile_ctx_t;
+static VkPipeline so_compile_cb(void* ctx) {
+    xeno_cb_t* cb = ((so_compile_ctx_t*)ctx)->cb;
+    return compile_graphics(cb->dev, cb->so_stage, &cb->dyn, &cb->rf);
+}
+
+typedef struct so_job {
+    xeno_device_t* dev;
+    xeno_variant_t* variant;
+    xeno_shader_t* stages[XENO_SO_STAGES];
+    xeno_dyn_state_t dyn;
+    xeno_render_formats_t rf;
+} so_job_t;
+
+static void so_job_run(void* ctx) {
+    so_job_t* j = ctx; xeno_so_device_t* so = j->dev->so;
+    uint64_t t0 = xeno_now_ns();
+    VkPipeline p = compile_graphics(j->dev, j->stages, &j->dyn, &j->rf);
+    atomic_fetch_add(&so->cache.async_compiles, 1);
+    xeno_variant_publish(&so->cache, j->variant, p, xeno_now_ns() - t0);
+    for (int i = 0; i < XENO_SO_STAGES; ++i) if (j->stages[i]) shader_unref(j->stages[i]);
+    free(j);
+    atomic_fetch_sub(&so->pending, 1);
+}
+
+/* start compiling the variant the next draw will most likely need; the cache dedups repeats */
+static void speculate(xeno_cb_t* cb) {
+    xeno_device_t* dev = cb->dev; xeno_so_device_t* so = dev->so;
+    if (!so->async || !cb->dyn_set || !cb->in_rendering || xeno_workers_count() == 0) return;
+    uint32_t key[SO_KEY_WORDS];
+    xeno_variant_key_t k = xeno_variant_key(key, build_key(dev, cb->so_stage, &cb->dyn, &cb->rf, key));
+    int claimed = 0;
+    xeno_variant_t* v = xeno_variant_acquire(&so->cache, &k, &claimed);
+    if (!v || !claimed) return;
+    so_job_t* j = malloc(sizeof(*j));
+    if (j) {
+        j->dev = dev; j->variant = v; j->dyn = cb->dyn; j->rf = cb->rf;
+        for (int i = 0; i < XENO_SO_STAGES; ++i) { j->stages[i] = cb->so_stage[i]; if (j->stages[i]) atomic_fetch_add(&j->stages[i]->refs, 1); }
+        atomic_fetch_add(&so->pending, 1);
+        if (xeno_workers_submit(so_job_run, j) == 0) { atomic_fetch_add(&so->speculative, 1); return; }
+        atomic_fetch_sub(&so->pending, 1);
+        for (int i = 0; i < XENO_SO_STAGES; ++i) if (j->stages[i]) shader_unref(j->stages[i]);
+        free(j);
+    }
+    /* claimed but could not hand off: compile here so waiters are released */
+    uint64_t t0 = xeno_now_ns();
+    VkPipeline p = compile_graphics(dev, cb->so_stage, &cb->dyn, &cb->rf);
+    atomic_fetch_add(&so->cache.misses, 1);
+    xeno_variant_publish(&so->cache, v, p, xeno_now_ns() - t0);
+}
+
+void xeno_shader_object_prepare_draw(xeno_cb_t* cb) {
+    xeno_device_t* dev = cb->dev; xeno_so_device_t* so = dev->so;
+    if (!cb->so_dirty && !(cb->dyn_dirty & ~dev->dyn_native) && cb->so_pipeline && !cb->state_clobbered) return;
+    uint32_t key[SO_KEY_WORDS];
+    xeno_variant_key_t k = xeno_variant_key(key, build_key(dev, cb->so_stage, &cb->dyn, &cb->rf, key));
+    so_compile_ctx_t ctx = { cb };
+    int uncached = 0;
+    VkPipeline pipeline = xeno_variant_get(&so->cache, &k, so_compile_cb, &ctx, &uncached);
+    /* cache full: the command buffer owns the private pipeline */
+    if (pipeline && uncached) xeno_cb_own_pipeline(cb, pipeline);
+    cb->so_dirty = 0; cb->dyn_dirty &= dev->dyn_native;
+    if (!pipeline) return;
+    if (pipeline != cb->so_pipeline) {
+        dev->vk.vkCmdBindPipeline(cb->handle, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        cb->so_pipeline = pipeline;
+    }
+    if (cb->state_clobbered) {
+        xeno_dyn_replay(dev, cb->handle, &cb->dyn, cb->dyn_set);
+        cb->state_clobbered = 0;
+    }
+}
+
+static VKAPI_ATTR void VKAPI_CALL xeno_vkCmdBindShadersEXT(VkCommandBuffer commandBuffer, uint32_t stageCount, const VkShaderStageFlagBits* pStages, const VkShaderEXT* pShaders) {
+    xeno_cb_t* cb = xeno_cb_get(commandBuffer);
+    xeno_device_t* dev = cb->dev;
+    atomic_fetch_add(&dev->so->binds, 1);
+    int graphics = 0;
+    for (uint32_t i = 0; i < stageCount; ++i) {
+        xeno_shader_t* sh = pShaders ? SHADER_FROM_HANDLE(pShaders[i]) : NULL;
+        if (pStages[i] == VK_SHADER_STAGE_COMPUTE_BIT) {
+            if (sh) dev->vk.vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, sh->compute);
+            cb->app_pipeline[1] = VK_NULL_HANDLE;
+            continue;
+        }
+        int idx = stage_index(pStages[i]);
+        if (idx < 0) continue;
+        if (cb->so_stage[idx] != sh) { cb->so_stage[idx] = sh; cb->so_dirty = 1; }
+        graphics = 1;
+    }
+    if (!graphics) return;
+    cb->so_active = 0;
+    for (int i = 0; i < XENO_SO_STAGES; ++i) if (cb->so_stage[i]) cb->so_active = 1;
+    if (cb->app_pipeline[0]) { cb->app_pipeline[0] = VK_NULL_HANDLE; cb->so_pipeline = VK_NULL_HANDLE; }
+    if (cb->so_active && cb->so_dirty) speculate(cb);
+}
+
+/* --- device lifetime / routing --- */
+int xeno_shader_object_init(xeno_device_t* dev) {
+    if (!(dev->emulate & XENO_EMULATE_SHADER_OBJECT)) return 0;
+    xeno_so_device_t* so = calloc(1, sizeof(*so)); if (!so) return -1;
+    long cap = xeno_env_long("XCLIPSE_SO_VARIANT_CAPACITY", 4096);
+    if (cap < 64) cap = 64;
+    if (cap > (1l << 20)) cap = 1l << 20;
+    if (xeno_variant_cache_init(&so->cache, dev, (uint32_t)cap) != 0) { free(so); return -1; }
+    so->async = xeno_env_bool("XCLIPSE_SO_ASYNC", 1);
+    dev->so = so;
+    xlog("shader_object: emulating VK_EXT_shader_object capacity=%u async=%d native_dyn=0x%" PRIx64,
+         so->cache.capacity, so->async, dev->dyn_native);
+    return 0;
+}
+
+void xeno_shader_object_destroy(xeno_device_t* dev) {
+    xeno_so_device_t* so = dev->so;
+    if (!so) return;
+    while (atomic_load(&so->pending)) sched_yield();
+    xeno_variant_cache_destroy(&so->cache);
+    free(so); dev->so = NULL;
+}
+
+uint32_t xeno_shader_object_trim(xeno_device_t* dev) {
+    return dev->so ? xeno_variant_trim(&dev->so->cache, dev->so->cache.capacity / 4) : 0;
+}
+
+PFN_vkVoidFunction xeno_shader_object_proc(xeno_device_t* dev, const char* name) {
+    if (!dev->so) return NULL;
+    if (strcmp(name, "vkCreateShadersEXT") == 0) return (PFN_vkVoidFunction)xeno_vkCreateShadersEXT;
+    if (strcmp(name, "vkDestroyShaderEXT") == 0) return (PFN_vkVoidFunction)xeno_vkDestroyShaderEXT;
+    if (strcmp(name, "vkGetShaderBinaryDataEXT") == 0) return (PFN_vkVoidFunction)xeno_vkGetShaderBinaryDataEXT;
+    if (strcmp(name, "vkCmdBindShadersEXT") == 0) return (PFN_vkVoidFunction)xeno_vkCmdBindShadersEXT;
+    return NULL;
+}
+
+void xeno_shader_object_report(FILE* f, xeno_device_t* dev) {
+    xeno_so_device_t* so = dev->so;
+    fprintf(f, "  \"shader_object\": {\"emulated\": %s", so ? "true" : "false");
+    if (so) {
+        fprintf(f, ", \"shaders\": %" PRIu64 ", \"binds\": %" PRIu64 ", \"speculative\": %" PRIu64 ", ",
+                atomic_load(&so->shaders), atomic_load(&so->binds), atomic_load(&so->speculative));
+        xeno_variant_report(f, &so->cache);
+    }
+    fprintf(f, "}");
+}
@@ -0,0 +1,570 @@
+/* xeno_staging.c - persistently mapped staging ring for uploads
+ *
+ * Uploads through a fresh host-visible allocation cost an allocation, a map and an unmap each.
+ * Every device instead gets one host-visible, coherent ring (XCLIPSE_STAGING_MB, created on first
+ * use) that stays mapped for the device's lifetime. Callers reserve spans of it for a command
+ * buffer, write their data and record copies out of the ring buffer; spans are reclaimed in ring
+ * order once the commands reading them have completed:
+ *  - at submit, the spans of the submitted command buffers are tagged with a wrapper fence that an
+ *    empty submission right behind the app's signals on the same queue;
+ *  - spans of command buffers reset or freed without being submitted are dropped.
+ * When the ring is full the oldest submitted span's fence is waited on (a stall); if the oldest
+ * span is still being recorded the reservation fails (an overflow) and the caller falls back.
+ * With XCLIPSE_REACTOR=1 the wrapper fences are watched (xeno_reactor.c) and reclaiming reads the
+ * flag their completion sets instead of calling vkGetFenceStatus.
+ *
+ * xeno_staging_upload_buffer/_image split uploads into chunks of at most a quarter of the ring and
+ * report how far they got, so a caller whose upload outgrows the ring submits and resumes; they
+ * are meant for wrapper-internal uploads such as BCn fallback decode data.
+ *
+ * With XCLIPSE_STAGING_REDIRECT=1 app vkCmdUpdateBuffer calls in one-time-submit command buffers go
+ * through the ring as well, recorded as vkCmdCopyBuffer: same transfer stage, but synchronization2
+ * barriers that name only the CLEAR stage for the update would no longer cover it, hence off by
+ * default. Apps that map/unmap a fresh allocation per upload are served by XCLIPSE_SUBALLOC, whose
+ * host-visible blocks stay mapped.
+ *
+ * With XCLIPSE_STAGING_HUGEPAGES=1 the ring is host memory backed by huge pages (hugetlbfs, else
+ * transparent huge pages) imported through VK_EXT_external_memory_host, which vkCreateDevice
+ * enables when the driver has it; otherwise the driver allocates the ring.
+ *
+ * Knobs:
+ *   XCLIPSE_STAGING=0                  no staging ring (uploads fall back to the caller's path)
+ *   XCLIPSE_STAGING_MB=N               ring size (default 32)
+ *   XCLIPSE_STAGING_HUGEPAGES=1        back the ring with imported huge pages
+ *   XCLIPSE_STAGING_REDIRECT=1         stage app vkCmdUpdateBuffer data through the ring
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "xeno_internal.h"
+
+#define MAX_SPANS 1024
+#define HUGE_PAGE_SIZE (2ull << 20)
+#define STALL_TIMEOUT_NS 1000000000ull
+
+enum { SPAN_RECORDED, SPAN_SUBMITTED, SPAN_RETIRED };
+
+typedef struct st_fence {
+    struct st_fence *next_all, *next_free;
+    VkFence fence;
+    uint32_t refs;                  /* spans waiting on it */
+    _Atomic int signaled;           /* set by the reactor thread for watched fences */
+    _Atomic int watched;            /* a reactor watch has yet to complete */
+} st_fence_t;
+
+typedef struct st_span {            /* ring bytes up to end, read by the commands of cb */
+    uint64_t end;
+    VkCommandBuffer cb;
+    st_fence_t* fence;              /* set at submit */
+    int state;
+} st_span_t;
+
+typedef struct st_cb {              /* command buffers of redirecting devices */
+    xeno_device_t* dev;
+    VkCommandPool pool;
+    int one_time;                   /* begun with ONE_TIME_SUBMIT */
+    int staged;                     /* may own spans; guarded by the device's ring lock */
+} st_cb_t;
+
+typedef struct xeno_staging_device {
+    uint64_t size, chunk;
+    int hugepages, redirect;
+    int ready;                      /* 1 ring created, -1 creation failed */
+    VkDeviceMemory memory;
+    VkBuffer buffer;
+    unsigned char* ptr;
+    void* host; size_t host_len;    /* imported host allocation, NULL when the driver allocated the ring */
+    const char* backing;
+    pthread_mutex_t lock;
+    uint64_t head, tail;            /* ring positions, only growing; position p is ptr[p % size] */
+    st_span_t spans[MAX_SPANS];
+    uint32_t span_first, span_count;
+    _Atomic uint32_t recorded;      /* spans in SPAN_RECORDED */
+    st_fence_t *fences, *free_fences;
+    PFN_vkAllocateCommandBuffers next_alloc_cbs;
+    PFN_vkFreeCommandBuffers next_free_cbs;
+    PFN_vkDestroyCommandPool next_destroy_pool;
+    PFN_vkResetCommandPool next_reset_pool;
+    PFN_vkBeginCommandBuffer next_begin;
+    PFN_vkResetCommandBuffer next_reset;
+    _Atomic uint64_t uploads, bytes, chunks, redirected, redirect_misses;
+    _Atomic uint64_t stalls, stall_ns, stall_ns_max, overflows, wraps, fence_submits, watched, peak_used;
+} xeno_staging_device_t;
+
+static xeno_map_t cbs;              /* VkCommandBuffer -> st_cb_t */
+static pthread_once_t cbs_once = PTHREAD_ONCE_INIT;
+static void cbs_init(void) { xeno_map_init(&cbs, 1024); }
+static st_cb_t* cb_get(VkCommandBuffer cb) { pthread_once(&cbs_once, cbs_init); return xeno_map_get(&cbs, XENO_HANDLE_KEY(cb)); }
+
+static inline uint64_t align_up(uint64_t v, uint64_t a) { return (v + a - 1) / a * a; }
+
+static void atomic_max(_Atomic uint64_t* v, uint64_t x) {
+    uint64_t cur = atomic_load(v);
+    while (x > cur && !atomic_compare_exchange_weak(v, &cur, x)) {}
+}
+
+/* --- ring backing --- */
+static int pick_type(xeno_device_t* dev, uint32_t bits) {
+    VkMemoryPropertyFlags want = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    for (uint32_t t = 0; t < dev->memory.memoryTypeCount; ++t)
+        if ((bits & (1u << t)) && (dev->memory.memoryTypes[t].propertyFlags & want) == want) return (int)t;
+    return -1;
+}
+
+/* huge-page host memory imported as the ring's memory; 0 on success */
+static int import_host(xeno_device_t* dev, xeno_staging_device_t* sd, uint32_t buffer_bits) {
+    if (!dev->host_import || !dev->vk.vkGetMemoryHostPointerPropertiesEXT) return -1;
+    size_t len = (size_t)align_up(sd->size, HUGE_PAGE_SIZE);
+    const char* backing = "hugetlbfs";
+    void* p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p == MAP_FAILED) {
+        /* no reserved huge pages: over-map so the range can start on a huge page boundary, then ask for THP */
+        unsigned char* raw = mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) return -1;
+        unsigned char* start = (unsigned char*)(uintptr_t)align_up((uintptr_t)raw, HUGE_PAGE_SIZE);
+        if (start > raw) munmap(raw, (size_t)(start - raw));
+        if (start + len < raw + len + HUGE_PAGE_SIZE) munmap(start + len, (size_t)(raw + len + HUGE_PAGE_SIZE - (start + len)));
+        p = start; backing = "thp";
+        madvise(p, len, MADV_HUGEPAGE);
+    }
+    VkMemoryHostPointerPropertiesEXT hp = { .sType = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT };
+    int type = -1;
+    if (dev->vk.vkGetMemoryHostPointerPropertiesEXT(dev->handle, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, p, &hp) == VK_SUCCESS)
+        type = pick_type(dev, hp.memoryTypeBits & buffer_bits);
+    VkImportMemoryHostPointerInfoEXT imp = { .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+                                             .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT, .pHostPointer = p };
+    VkMemoryAllocateInfo ai = { .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, .pNext = &imp, .allocationSize = len, .memoryTypeIndex = (uint32_t)type };
+    if (type < 0 || dev->vk.vkAllocateMemory(dev->handle, &ai, NULL, &sd->memory) != VK_SUCCESS) { sd->memory = VK_NULL_HANDLE; munmap(p, len); return -1; }
+    sd->host = p; sd->host_len = len; sd->ptr = p; sd->backing = backing;
+    return 0;
+}
+
+static int create_ring(xeno_device_t* dev, xeno_staging_device_t* sd) {
+    VkExternalMemoryBufferCreateInfo ext = { .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+                                             .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT };
+    int import = sd->hugepages && dev->host_import;
+    VkBufferCreateInfo bi = { .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, .pNext = import ? &ext : NULL, .size = sd->size,
+                              .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT, .sharingMode = VK_SHARING_MODE_EXCLUSIVE };
+    if (dev->vk.vkCreateBuffer(dev->handle, &bi, NULL, &sd->buffer) != VK_SUCCESS) return -1;
+    VkMemoryRequirements req;
+    dev->vk.vkGetBufferMemoryRequirements(dev->handle, sd->buffer, &req);
+    if (!import || import_host(dev, sd, req.memoryTypeBits) != 0) {
+        if (import) {
+            /* the buffer was created for imported memory only */
+            dev->vk.vkDestroyBuffer(dev->handle, sd->buffer, NULL);
+            bi.pNext = NULL;
+            if (dev->vk.vkCreateBuffer(dev->handle, &bi, NULL, &sd->buffer) != VK_SUCCESS) { sd->buffer = VK_NULL_HANDLE; return -1; }
+            dev->vk.vkGetBufferMemoryRequirements(dev->handle, sd->buffer, &req);
+        }
+        int type = pick_type(dev, req.memoryTypeBits);
+        VkMemoryAllocateInfo ai = { .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, .allocationSize = req.size, .memoryTypeIndex = (uint32_t)type };
+        void* p = NULL;
+        if (type < 0 || dev->vk.vkAllocateMemory(dev->handle, &ai, NULL, &sd->memory) != VK_SUCCESS) { sd->memory = VK_NULL_HANDLE; return -1; }
+        if (dev->vk.vkMapMemory(dev->handle, sd->memory, 0, VK_WHOLE_SIZE, 0, &p) != VK_SUCCESS) return -1;
+        sd->ptr = p; sd->backing = "driver";
+    }
+    if (dev->vk.vkBindBufferMemory(dev->handle, sd->buffer, sd->memory, 0) != VK_SUCCESS) return -1;
+    xlog("staging: ring %" PRIu64 "MB backing=%s", sd->size >> 20, sd->backing);
+    return 0;
+}
+
+static void destroy_ring(xeno_device_t* dev, xeno_staging_device_t* sd) {
+    if (sd->buffer) dev->vk.vkDestroyBuffer(dev->handle, sd->buffer, NULL);
+    if (sd->memory) dev->vk.vkFreeMemory(dev->handle, sd->memory, NULL);
+    if (sd->host) munmap(sd->host, sd->host_len);
+    sd->buffer = VK_NULL_HANDLE; sd->memory = VK_NULL_HANDLE; sd->host = NULL; sd->ptr = NULL;
+}
+
+/* --- fences (ring lock held) --- */
+static st_fence_t* fence_get(xeno_device_t* dev, xeno_staging_device_t* sd) {
+    st_fence_t* f = sd->free_fences;
+    if (f) { sd->free_fences = f->next_free; return f; }
+    if (!(f = calloc(1, sizeof(*f)))) return NULL;
+    VkFenceCreateInfo fi = { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    if (dev->vk.vkCreateFence(dev->handle, &fi, NULL, &f->fence) != VK_SUCCESS) { free(f); return NULL; }
+    f->next_all = sd->fences; sd->fences = f;
+    return f;
+}
+
+static void fence_unref(xeno_device_t* dev, xeno_staging_device_t* sd, st_fence_t* f) {
+    if (--f->refs) return;
+    /* signalled: its watch completes any moment, and must not mark the fence's next use */
+    while (atomic_load(&f->watched)) sched_yield();
+    dev->vk.vkResetFences(dev->handle, 1, &f->fence);
+    atomic_store(&f->signaled, 0); f->next_free = sd->free_fences; sd->free_fences = f;
+}
+
+/* reactor thread */
+static void fence_complete(void* ctx, VkResult result) {
+    st_fence_t* f = ctx;
+    if (result == VK_SUCCESS) atomic_store(&f->signaled, 1);
+    atomic_store(&f->watched, 0);
+}
+
+/* --- ring (lock held) --- */
+static void reclaim(xeno_device_t* dev, xeno_staging_device_t* sd) {
+    while (sd->span_count) {
+        st_span_t* s = &sd->spans[sd->span_first];
+        if (s->state == SPAN_RECORDED) break;
+        if (s->state == SPAN_SUBMITTED) {
+            if (!atomic_load(&s->fence->signaled) &&
+                (atomic_load(&s->fence->watched) || dev->vk.vkGetFenceStatus(dev->handle, s->fence->fence) != VK_SUCCESS)) break;
+            atomic_store(&s->fence->signaled, 1);
+            fence_unref(dev, sd, s->fence);
+        }
+        sd->tail = s->end;
+        sd->span_first = (sd->span_first + 1) % MAX_SPANS; sd->span_count--;
+    }
+    if (!sd->span_count) sd->tail = sd->head;
+}
+
+static void retire_cb(xeno_staging_device_t* sd, VkCommandBuffer cb) {
+    for (uint32_t i = 0; i < sd->span_count; ++i) {
+        st_span_t* s = &sd->spans[(sd->span_first + i) % MAX_SPANS];
+        if (s->cb == cb && s->state == SPAN_RECORDED) { s->state = SPAN_RETIRED; atomic_fetch_sub(&sd->recorded, 1); }
+    }
+}
+
+int xeno_staging_alloc(xeno_device_t* dev, VkCommandBuffer cb, VkDeviceSize size, VkDeviceSize align, xeno_staging_span_t* span) {
+    xeno_staging_device_t* sd = dev->staging;
+    if (!sd || !size || !cb) return -1;
+    if (!align) align = 1;
+    st_cb_t* c = sd->redirect ? cb_get(cb) : NULL;   /* before the ring lock: map walks take them the other way round */
+    pthread_mutex_lock(&sd->lock);
+    if (!sd->ready) {
+        sd->ready = create_ring(dev, sd) == 0 ? 1 : -1;
+        if (sd->ready < 0) { destroy_ring(dev, sd); xlog("staging: ring creation failed, uploads use their fallback path"); }
+    }
+    if (sd->ready < 0 || size > sd->size) { pthread_mutex_unlock(&sd->lock); return -1; }
+    for (;;) {
+        reclaim(dev, sd);
+        uint64_t pos = align_up(sd->head, align), phys = pos % sd->size;
+        int wrap = phys + size > sd->size;
+        if (wrap) pos += sd->size - phys;
+        if (pos + size - sd->tail <= sd->size && sd->span_count < MAX_SPANS) {
+            st_span_t* last = sd->span_count ? &sd->spans[(sd->span_first + sd->span_count - 1) % MAX_SPANS] : NULL;
+            if (last && last->cb == cb && last->state == SPAN_RECORDED) last->end = pos + size;
+            else {
+                sd->spans[(sd->span_first + sd->span_count) % MAX_SPANS] = (st_span_t){ .end = pos + size, .cb = cb, .state = SPAN_RECORDED };
+                sd->span_count++; atomic_fetch_add(&sd->recorded, 1);
+            }
+            if (c) c->staged = 1;
+            sd->head = pos + size;
+            if (wrap) atomic_fetch_add(&sd->wraps, 1);
+            atomic_max(&sd->peak_used, sd->head - sd->tail);
+            span->buffer = sd->buffer; span->offset = pos % sd->size; span->size = size; span->ptr = sd->ptr + span->offset;
+            pthread_mutex_unlock(&sd->lock);
+            return 0;
+        }
+        /* full: wait for the oldest span, unless it is still being recorded and so can never complete */
+        st_span_t* oldest = &sd->spans[sd->span_first];
+        if (!sd->span_count || oldest->state != SPAN_SUBMITTED) break;
+        st_fence_t* f = oldest->fence;
+        f->refs++;
+        pthread_mutex_unlock(&sd->lock);
+        uint64_t t0 = xeno_now_ns();
+        VkResult r = dev->vk.vkWaitForFences(dev->handle, 1, &f->fence, VK_TRUE, STALL_TIMEOUT_NS);
+        uint64_t dt = xeno_now_ns() - t0;
+        atomic_fetch_add(&sd->stalls, 1); atomic_fetch_add(&sd->stall_ns, dt); atomic_max(&sd->stall_ns_max, dt);
+        pthread_mutex_lock(&sd->lock);
+        if (r == VK_SUCCESS) atomic_store(&f->signaled, 1);
+        fence_unref(dev, sd, f);
+        if (r != VK_SUCCESS) break;
+    }
+    atomic_fetch_add(&sd->overflows, 1);
+    pthread_mutex_unlock(&sd->lock);
+    return -1;
+}
+
+void xeno_staging_submitted(xeno_device_t* dev, VkQueue queue, const VkCommandBuffer* cbs_in, uint32_t count) {
+    xeno_staging_device_t* sd = dev->staging;
+    if (!sd || !count || !atomic_load(&sd->recorded)) return;
+    pthread_mutex_lock(&sd->lock);
+    st_fence_t* f = NULL;
+    for (uint32_t i = 0; i < sd->span_count; ++i) {
+        st_span_t* s = &sd->spans[(sd->span_first + i) % MAX_SPANS];
+        if (s->state != SPAN_RECORDED) continue;
+        uint32_t k = 0;
+        while (k < count && cbs_in[k] != s->cb) ++k;
+        if (k == count || (!f && !(f = fence_get(dev, sd)))) continue;
+        s->state = SPAN_SUBMITTED; s->fence = f; f->refs++;
+        atomic_fetch_sub(&sd->recorded, 1);
+    }
+    pthread_mutex_unlock(&sd->lock);
+    if (!f) return;
+    /* signals once everything submitted to the queue so far has completed */
+    atomic_fetch_add(&sd->fence_submits, 1);
+    int watch = dev->reactor != NULL;
+    if (watch) atomic_store(&f->watched, 1);    /* before the submit: no status poll may recycle the fence meanwhile */
+    if (dev->vk.vkQueueSubmit(queue, 0, NULL, f->fence) != VK_SUCCESS) {
+        if (watch) atomic_store(&f->watched, 0);
+        if (dev->vk.vkQueueWaitIdle(queue) == VK_SUCCESS) atomic_store(&f->signaled, 1);
+    } else if (watch) {
+        if (xeno_reactor_watch(dev, f->fence, fence_complete, f, NULL) == 0) atomic_fetch_add(&sd->watched, 1);
+        else atomic_store(&f->watched, 0);
+    }
+}
+
+void xeno_staging_release(xeno_device_t* dev, VkCommandBuffer cb) {
+    xeno_staging_device_t* sd = dev->staging;
+    if (!sd || !atomic_load(&sd->recorded)) return;
+    pthread_mutex_lock(&sd->lock);
+    retire_cb(sd, cb);
+    pthread_mutex_unlock(&sd->lock);
+}
+
+/* --- uploads --- */
+int xeno_staging_upload_buffer(xeno_device_t* dev, VkCommandBuffer cb, const void* data, VkDeviceSize size, VkBuffer dst, VkDeviceSize dst_offset, VkDeviceSize* done) {
+    xeno_staging_device_t* sd = dev->staging;
+    if (!sd) return -1;
+    xeno_barrier_flush(dev, cb);   /* the app's held barriers come before the copies */
+    uint64_t align = dev->limits.optimalBufferCopyOffsetAlignment ? dev->limits.optimalBufferCopyOffsetAlignment : 16;
+    while (*done < size) {
+        xeno_staging_span_t span;
+        VkDeviceSize n = size - *done < sd->chunk ? size - *done : sd->chunk;
+        if (xeno_staging_alloc(dev, cb, n, align, &span) != 0) return -1;
+        memcpy(span.ptr, (const unsigned char*)data + *done, n);
+        VkBufferCopy region = { span.offset, dst_offset + *done, n };
+        dev->vk.vkCmdCopyBuffer(cb, span.buffer, dst, 1, &region);
+        *done += n;
+        atomic_fetch_add(&sd->chunks, 1); atomic_fetch_add(&sd->bytes, n);
+    }
+    atomic_fetch_add(&sd->uploads, 1);
+    return 0;
+}
+
+int xeno_staging_upload_image(xeno_device_t* dev, VkCommandBuffer cb, const void* data, const xeno_staging_image_t* dst, uint32_t* rows_done) {
+    xeno_staging_device_t* sd = dev->staging;
+    if (!sd || !dst->block_bytes || !dst->block_w || !dst->block_h) return -1;
+    xeno_barrier_flush(dev, cb);
+    uint64_t row_bytes = (uint64_t)(dst->extent.width + dst->block_w - 1) / dst->block_w * dst->block_bytes;
+    uint32_t rows = (dst->extent.height + dst->block_h - 1) / dst->block_h, depth = dst->extent.depth ? dst->extent.depth : 1;
+    uint32_t total = dst->subresource.layerCount * depth * rows;
+    /* bufferOffset must be a multiple of the block size and of 4 */
+    uint64_t align = dst->block_bytes % 4 == 0 ? dst->block_bytes : dst->block_bytes % 2 == 0 ? dst->block_bytes * 2 : dst->block_bytes * 4;
+    uint64_t per_chunk = sd->chunk / row_bytes ? sd->chunk / row_bytes : 1;
+    while (*rows_done < total) {
+        uint32_t r = *rows_done % rows, slice = *rows_done / rows;
+        uint32_t n = (uint32_t)(rows - r < per_chunk ? rows - r : per_chunk);    /* a chunk never crosses a slice */
+        xeno_staging_span_t span;
+        if (xeno_staging_alloc(dev, cb, n * row_bytes, align, &span) != 0) return -1;
+        memcpy(span.ptr, (const unsigned char*)data + (uint64_t)*rows_done * row_bytes, n * row_bytes);
+        uint32_t y = r * dst->block_h, h = n * dst->block_h;
+        if (y + h > dst->extent.height) h = dst->extent.height - y;
+        VkBufferImageCopy region = { .bufferOffset = span.offset,
+            .imageSubresource = { dst->subresource.aspectMask, dst->subresource.mipLevel, dst->subresource.baseArrayLayer + slice / depth, 1 },
+            .imageOffset = { dst->offset.x, dst->offset.y + (int32_t)y, dst->offset.z + (int32_t)(slice % depth) },
+            .imageExtent = { dst->extent.width, h, 1 } };
+        dev->vk.vkCmdCopyBufferToImage(cb, span.buffer, dst->image, dst->layout, 1, &region);
+        *rows_done += n;
+        atomic_fetch_add(&sd->chunks, 1); atomic_fetch_add(&sd->bytes, n * row_bytes);
+    }
+    atomic_fetch_add(&sd->uploads, 1);
+    return 0;
+}
+
+/* --- redirect intercepts, interposed in the dispatch table below every module --- */
+static VKAPI_ATTR VkResult VKAPI_CALL st_vkAllocateCommandBuffers(VkDevice device, const VkCommandBufferAllocateInfo* pAllocateInfo, VkCommandBuffer* pCommandBuffers) {
+    xeno_device_t* dev = xeno_device_get(device);
+    VkResult r = dev->staging->next_alloc_cbs(device, pAllocateInfo, pCommandBuffers);
+    if (r != VK_SUCCESS) return r;
+    pthread_once(&cbs_once, cbs_init);
+    for (uint32_t i = 0; i < pAllocateInfo->commandBufferCount; ++i) {
+        st_cb_t* c = calloc(1, sizeof(*c));
+        if (!c) {
+            /* begin/reset find their device through the entry, so the batch cannot be handed out without one */
+            while (i--) free(xeno_map_remove(&cbs, XENO_HANDLE_KEY(pCommandBuffers[i])));
+            dev->staging->next_free_cbs(device, pAllocateInfo->commandPool, pAllocateInfo->commandBufferCount, pCommandBuffers);
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        c->dev = dev; c->pool = pAllocateInfo->commandPool;
+        xeno_map_put(&cbs, XENO_HANDLE_KEY(pCommandBuffers[i]), c);
+    }
+    return r;
+}
+
+static void forget_cb(xeno_device_t* dev, VkCommandBuffer cb) {
+    st_cb_t* c = xeno_map_remove(&cbs, XENO_HANDLE_KEY(cb));
+    if (c && c->staged) xeno_staging_release(dev, cb);
+    free(c);
+}
+
+static VKAPI_ATTR void VKAPI_CALL st_vkFreeCommandBuffers(VkDevice device, VkCommandPool commandPool, uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers) {
+    xeno_device_t* dev = xeno_device_get(device);
+    pthread_once(&cbs_once, cbs_init);
+    for (uint32_t i = 0; i < commandBufferCount; ++i) if (pCommandBuffers[i]) forget_cb(dev, pCommandBuffers[i]);
+    dev->staging->next_free_cbs(device, commandPool, commandBufferCount, pCommandBuffers);
+}
+
+typedef struct { xeno_device_t* dev; VkCommandPool pool; int destroy; } pool_walk_t;
+static int pool_cb(uint64_t key, void* val, void* ctx) {
+    st_cb_t* c = val; pool_walk_t* w = ctx;
+    if (c->dev != w->dev || (w->pool && c->pool != w->pool)) return 0;
+    if (c->staged) xeno_staging_release(c->dev, (VkCommandBuffer)(uintptr_t)key);
+    c->staged = 0; c->one_time = 0;
+    if (w->destroy) free(c);
+    return w->destroy;
+}
+
+static VKAPI_ATTR void VKAPI_CALL st_vkDestroyCommandPool(VkDevice device, VkCommandPool commandPool, const VkAllocationCallbacks* pAllocator) {
+    xeno_device_t* dev = xeno_device_get(device);
+    pool_walk_t w = { dev, commandPool, 1 };
+    if (commandPool) { pthread_once(&cbs_once, cbs_init); xeno_map_foreach(&cbs, pool_cb, &w); }
+    dev->staging->next_destroy_pool(device, commandPool, pAllocator);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL st_vkResetCommandPool(VkDevice device, VkCommandPool commandPool, VkCommandPoolResetFlags flags) {
+    xeno_device_t* dev = xeno_device_get(device);
+    pool_walk_t w = { dev, commandPool, 0 };
+    pthread_once(&cbs_once, cbs_init);
+    xeno_map_foreach(&cbs, pool_cb, &w);
+    return dev->staging->next_reset_pool(device, commandPool, flags);
+}
+
+/* beginning and resetting imply the command buffer is not pending, so whatever it still holds is unread */
+static VKAPI_ATTR VkResult VKAPI_CALL st_vkBeginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeginInfo* pBeginInfo) {
+    st_cb_t* c = cb_get(commandBuffer);
+    if (c->staged) { xeno_staging_release(c->dev, commandBuffer); c->staged = 0; }
+    c->one_time = (pBeginInfo->flags & VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != 0;
+    return c->dev->staging->next_begin(commandBuffer, pBeginInfo);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL st_vkResetCommandBuffer(VkCommandBuffer commandBuffer, VkCommandBufferResetFlags flags) {
+    st_cb_t* c = cb_get(commandBuffer);
+    if (c->staged) { xeno_staging_release(c->dev, commandBuffer); c->staged = 0; }
+    c->one_time = 0;
+    return c->dev->staging->next_reset(commandBuffer, flags);
+}
+
+static VKAPI_ATTR void VKAPI_CALL st_vkCmdUpdateBuffer(VkCommandBuffer commandBuffer, VkBuffer dstBuffer, VkDeviceSize dstOffset, VkDeviceSize dataSize, const void* pData) {
+    st_cb_t* c = cb_get(commandBuffer);
+    xeno_device_t* dev = c->dev;
+    xeno_staging_span_t span;
+    /* reusable command buffers could be resubmitted after the span is reclaimed */
+    if (c->one_time && xeno_staging_alloc(dev, commandBuffer, dataSize, 4, &span) == 0) {
+        memcpy(span.ptr, pData, dataSize);
+        VkBufferCopy region = { span.offset, dstOffset, dataSize };
+        dev->vk.vkCmdCopyBuffer(commandBuffer, span.buffer, dstBuffer, 1, &region);
+        atomic_fetch_add(&dev->staging->redirected, 1); atomic_fetch_add(&dev->staging->bytes, dataSize);
+        return;
+    }
+    atomic_fetch_add(&dev->staging->redirect_misses, 1);
+    dev->vk.vkCmdUpdateBuffer(commandBuffer, dstBuffer, dstOffset, dataSize, pData);
+}
+
+/* one wrapper fence per app submit call, covering the command buffers of all its batches */
+#define SUBMIT_STACK_CBS 64
+static VKAPI_ATTR VkResult VKAPI_CALL st_vkQueueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo* pSubmits, VkFence fence) {
+    xeno_device_t* dev = xeno_queue_device(queue);
+    VkResult r = dev->vk.vkQueueSubmit(queue, submitCount, pSubmits, fence);
+    if (r != VK_SUCCESS || !atomic_load(&dev->staging->recorded)) return r;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < submitCount; ++i) n += pSubmits[i].commandBufferCount;
+    VkCommandBuffer stack[SUBMIT_STACK_CBS], *list = n <= SUBMIT_STACK_CBS ? stack : malloc(n * sizeof(*list));
+    if (!list) return r;            /* the spans stay until their command buffers are reset */
+    n = 0;
+    for (uint32_t i = 0; i < submitCount; ++i)
+        for (uint32_t j = 0; j < pSubmits[i].commandBufferCount; ++j) list[n++] = pSubmits[i].pCommandBuffers[j];
+    xeno_staging_submitted(dev, queue, list, n);
+    if (list != stack) free(list);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL st_vkQueueSubmit2(VkQueue queue, uint32_t submitCount, const VkSubmitInfo2* pSubmits, VkFence fence) {
+    xeno_device_t* dev = xeno_queue_device(queue);
+    VkResult r = dev->vk.vkQueueSubmit2(queue, submitCount, pSubmits, fence);
+    if (r != VK_SUCCESS || !atomic_load(&dev->staging->recorded)) return r;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < submitCount; ++i) n += pSubmits[i].commandBufferInfoCount;
+    VkCommandBuffer stack[SUBMIT_STACK_CBS], *list = n <= SUBMIT_STACK_CBS ? stack : malloc(n * sizeof(*list));
+    if (!list) return r;
+    n = 0;
+    for (uint32_t i = 0; i < submitCount; ++i)
+        for (uint32_t j = 0; j < pSubmits[i].commandBufferInfoCount; ++j) list[n++] = pSubmits[i].pCommandBufferInfos[j].commandBuffer;
+    xeno_staging_submitted(dev, queue, list, n);
+    if (list != stack) free(list);
+    return r;
+}
+
+/* --- device lifetime / routing --- */
+int xeno_staging_init(xeno_device_t* dev) {
+    if (!xeno_env_bool("XCLIPSE_STAGING", 1)) return 0;
+    if (!dev->vk.vkCreateBuffer || !dev->vk.vkDestroyBuffer || !dev->vk.vkCmdCopyBuffer || !dev->vk.vkCmdCopyBufferToImage ||
+        !dev->vk.vkCreateFence || !dev->vk.vkDestroyFence || !dev->vk.vkResetFences || !dev->vk.vkGetFenceStatus ||
+        !dev->vk.vkWaitForFences || !dev->vk.vkQueueSubmit || !dev->vk.vkQueueWaitIdle) return -1;
+    xeno_staging_device_t* sd = calloc(1, sizeof(*sd)); if (!sd) return -1;
+    long mb = xeno_env_long("XCLIPSE_STAGING_MB", 32);
+    sd->size = (uint64_t)(mb < 1 ? 1 : mb > 1024 ? 1024 : mb) << 20;
+    sd->chunk = sd->size / 4;
+    sd->hugepages = xeno_env_bool("XCLIPSE_STAGING_HUGEPAGES", 0);
+    sd->redirect = xeno_env_bool("XCLIPSE_STAGING_REDIRECT", 0) && dev->vk.vkCmdUpdateBuffer;
+    pthread_mutex_init(&sd->lock, NULL);
+    if (sd->redirect) {
+        /* interposed so the command buffer modules above still see every call */
+        sd->next_alloc_cbs = dev->vk.vkAllocateCommandBuffers; dev->vk.vkAllocateCommandBuffers = st_vkAllocateCommandBuffers;
+        sd->next_free_cbs = dev->vk.vkFreeCommandBuffers; dev->vk.vkFreeCommandBuffers = st_vkFreeCommandBuffers;
+        sd->next_destroy_pool = dev->vk.vkDestroyCommandPool; dev->vk.vkDestroyCommandPool = st_vkDestroyCommandPool;
+        sd->next_reset_pool = dev->vk.vkResetCommandPool; dev->vk.vkResetCommandPool = st_vkResetCommandPool;
+        sd->next_begin = dev->vk.vkBeginCommandBuffer; dev->vk.vkBeginCommandBuffer = st_vkBeginCommandBuffer;
+        sd->next_reset = dev->vk.vkResetCommandBuffer; dev->vk.vkResetCommandBuffer = st_vkResetCommandBuffer;
+    }
+    dev->staging = sd;
+    xlog("staging: enabled ring=%" PRIu64 "MB hugepages=%d%s redirect=%d", sd->size >> 20, sd->hugepages,
+         sd->hugepages && !dev->host_import ? " (no VK_EXT_external_memory_host)" : "", sd->redirect);
+    return 0;
+}
+
+void xeno_staging_destroy(xeno_device_t* dev) {
+    xeno_staging_device_t* sd = dev->staging;
+    if (!sd) return;
+    if (sd->redirect) {
+        dev->vk.vkAllocateCommandBuffers = sd->next_alloc_cbs; dev->vk.vkFreeCommandBuffers = sd->next_free_cbs;
+        dev->vk.vkDestroyCommandPool = sd->next_destroy_pool; dev->vk.vkResetCommandPool = sd->next_reset_pool;
+        dev->vk.vkBeginCommandBuffer = sd->next_begin; dev->vk.vkResetCommandBuffer = sd->next_reset;
+        pool_walk_t w = { dev, VK_NULL_HANDLE, 1 };
+        pthread_once(&cbs_once, cbs_init);
+        xeno_map_foreach(&cbs, pool_cb, &w);
+    }
+    /* the device is idle by now: outstanding wrapper fences have signaled or never will */
+    for (st_fence_t* f = sd->fences; f;) { st_fence_t* n = f->next_all; dev->vk.vkDestroyFence(dev->handle, f->fence, NULL); free(f); f = n; }
+    destroy_ring(dev, sd);
+    pthread_mutex_destroy(&sd->lock);
+    dev->staging = NULL;
+    free(sd);
+}
+
+PFN_vkVoidFunction xeno_staging_proc(xeno_device_t* dev, const char* name) {
+    xeno_staging_device_t* sd = dev->staging;
+    if (!sd || !sd->redirect) return NULL;
+    if (strcmp(name, "vkAllocateCommandBuffers") == 0) return (PFN_vkVoidFunction)st_vkAllocateCommandBuffers;
+    if (strcmp(name, "vkFreeCommandBuffers") == 0) return (PFN_vkVoidFunction)st_vkFreeCommandBuffers;
+    if (strcmp(name, "vkDestroyCommandPool") == 0) return (PFN_vkVoidFunction)st_vkDestroyCommandPool;
+    if (strcmp(name, "vkResetCommandPool") == 0) return (PFN_vkVoidFunction)st_vkResetCommandPool;
+    if (strcmp(name, "vkBeginCommandBuffer") == 0) return (PFN_vkVoidFunction)st_vkBeginCommandBuffer;
+    if (strcmp(name, "vkResetCommandBuffer") == 0) return (PFN_vkVoidFunction)st_vkResetCommandBuffer;
+    if (strcmp(name, "vkCmdUpdateBuffer") == 0) return (PFN_vkVoidFunction)st_vkCmdUpdateBuffer;
+    if (strcmp(name, "vkQueueSubmit") == 0) return (PFN_vkVoidFunction)st_vkQueueSubmit;
+    if (dev->vk.vkQueueSubmit2 && (strcmp(name, "vkQueueSubmit2") == 0 || strcmp(name, "vkQueueSubmit2KHR") == 0))
+        return (PFN_vkVoidFunction)st_vkQueueSubmit2;
+    return NULL;
+}
+
+void xeno_staging_report(FILE* f, xeno_device_t* dev) {
+    xeno_staging_device_t* sd = dev->staging;
+    fprintf(f, "  \"staging\": {\"enabled\": %s", sd ? "true" : "false");
+    if (sd) {
+        uint64_t stalls = atomic_load(&sd->stalls);
+        fprintf(f, ", \"ring_bytes\": %" PRIu64 ", \"backing\": \"%s\", \"redirect\": %s, \"peak_used\": %" PRIu64,
+                sd->size, sd->ready > 0 ? sd->backing : sd->ready < 0 ? "failed" : "none", sd->redirect ? "true" : "false", atomic_load(&sd->peak_used));
+        fprintf(f, ", \"uploads\": %" PRIu64 ", \"chunks\": %" PRIu64 ", \"bytes\": %" PRIu64 ", \"redirected\": %" PRIu64 ", \"redirect_misses\": %" PRIu64,
+                atomic_load(&sd->uploads), atomic_load(&sd->chunks), atomic_load(&sd->bytes), atomic_load(&sd->redirected), atomic_load(&sd->redirect_misses));
+        fprintf(f, ", \"stalls\": %" PRIu64 ", \"avg_stall_ns\": %" PRIu64 ", \"max_stall_ns\": %" PRIu64 ", \"overflows\": %" PRIu64 ", \"wraps\": %" PRIu64 ", \"fence_submits\": %" PRIu64 ", \"watched_fences\": %" PRIu64,
+                stalls, stalls ? atomic_load(&sd->stall_ns) / stalls : 0, atomic_load(&sd->stall_ns_max), atomic_load(&sd->overflows),
+                atomic_load(&sd->wraps), atomic_load(&sd->fence_submits), atomic_load(&sd->watched));
+    }
+    fprintf(f, "}");
+}
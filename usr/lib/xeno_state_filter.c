@@ -0,0 +1,663 @@
+/* xeno_state_filter.c - redundant state filtering in command buffer recording
+ *
+ * Engines ported from GL re-bind the same pipeline, descriptor sets and vertex buffers and re-set
+ * the same dynamic state before every draw; each of those is a driver call that validates and
+ * re-emits state the GPU already has. Every command buffer the app records gets a shadow of what
+ * it bound and set through the wrapper since vkBeginCommandBuffer, and a bind or set that changes
+ * nothing is dropped before it reaches the modules below and the driver:
+ *  - the pipeline of each bind point;
+ *  - descriptor sets per bind point and set number while the pipeline layout stays the same (a
+ *    bind with another layout forgets the other sets); a bind with dynamic offsets only matches
+ *    a repeat of the same call;
+ *  - vertex buffers per binding and the index buffer;
+ *  - each dynamic state's last setter call, compared argument for argument.
+ * State is forgotten where Vulkan leaves it undefined or a command may have replaced it: a graphics
+ * pipeline bind reaching the driver forgets the dynamic state (its static state overwrote some), a
+ * dynamic state set the graphics pipeline (rebinding it restores its static state),
+ * vkCmdBindShadersEXT the pipelines, vkCmdExecuteCommands everything, vkCmdBindVertexBuffers2 its
+ * bindings and the vertex input state.
+ *
+ * vkCmdPushConstants calls are held, and a following one with the same layout and stages whose
+ * range touches or overlaps the held range is merged into it: one call reaches the driver. Any
+ * other command through the layer pushes the held range first. A device exposing commands that
+ * read push constants or change filtered state without passing through here (ray tracing,
+ * multi-draw, descriptor buffers, ...) has the affected kind of state passed through unfiltered.
+ *
+ * The layer sits in front of the modules like dedup: routed ahead of them in vkGetDeviceProcAddr,
+ * forwarding through xeno_device_next_proc(), so the dynamic state emulation below sees every
+ * change it needs. Counters are kept per command buffer and added up at vkEndCommandBuffer.
+ *
+ * Knobs:
+ *   XCLIPSE_STATE_FILTER=1        enable
+ *   XCLIPSE_STATE_FILTER_PUSH=0   pass push constants through one by one
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+#define SF_BIND_POINTS 3                /* graphics, compute, ray tracing */
+#define SF_MAX_SETS 32
+#define SF_MAX_BINDINGS 32
+#define SF_PUSH_BYTES 256
+
+enum { SF_PIPELINE, SF_DESCRIPTORS, SF_VERTEX, SF_INDEX, SF_DYNAMIC, SF_PUSH, SF_KINDS };
+#define SF_BIT(kind) (1u << SF_##kind)
+static const char* const sf_kind_names[SF_KINDS] = { "pipeline", "descriptor_sets", "vertex_buffers", "index_buffer", "dynamic_state", "push_constants" };
+
+#define SF_HOOKS(X) \
+    X(vkAllocateCommandBuffers) X(vkFreeCommandBuffers) X(vkDestroyCommandPool) \
+    X(vkBeginCommandBuffer) X(vkEndCommandBuffer) X(vkCmdExecuteCommands) \
+    X(vkCmdBindPipeline) X(vkCmdBindShadersEXT) X(vkCmdBindDescriptorSets) \
+    X(vkCmdPushDescriptorSetKHR) X(vkCmdPushDescriptorSetWithTemplateKHR) \
+    X(vkCmdBindVertexBuffers) X(vkCmdBindVertexBuffers2) X(vkCmdBindIndexBuffer) X(vkCmdPushConstants) \
+    X(vkCmdDraw) X(vkCmdDrawIndexed) X(vkCmdDrawIndirect) X(vkCmdDrawIndexedIndirect) \
+    X(vkCmdDrawIndirectCount) X(vkCmdDrawIndexedIndirectCount) X(vkCmdDrawMeshTasksEXT) \
+    X(vkCmdDispatch) X(vkCmdDispatchIndirect) X(vkCmdDispatchBase)
+
+/* other names of the hooked entrypoints; the driver may only know one of them */
+static const struct { const char* name; const char* alias; } sf_aliases[] = {
+    { "vkCmdSetCullMode", "vkCmdSetCullModeEXT" }, { "vkCmdSetFrontFace", "vkCmdSetFrontFaceEXT" },
+    { "vkCmdSetPrimitiveTopology", "vkCmdSetPrimitiveTopologyEXT" },
+    { "vkCmdSetViewportWithCount", "vkCmdSetViewportWithCountEXT" }, { "vkCmdSetScissorWithCount", "vkCmdSetScissorWithCountEXT" },
+    { "vkCmdSetDepthTestEnable", "vkCmdSetDepthTestEnableEXT" }, { "vkCmdSetDepthWriteEnable", "vkCmdSetDepthWriteEnableEXT" },
+    { "vkCmdSetDepthCompareOp", "vkCmdSetDepthCompareOpEXT" }, { "vkCmdSetDepthBoundsTestEnable", "vkCmdSetDepthBoundsTestEnableEXT" },
+    { "vkCmdSetStencilTestEnable", "vkCmdSetStencilTestEnableEXT" }, { "vkCmdSetStencilOp", "vkCmdSetStencilOpEXT" },
+    { "vkCmdSetRasterizerDiscardEnable", "vkCmdSetRasterizerDiscardEnableEXT" },
+    { "vkCmdSetDepthBiasEnable", "vkCmdSetDepthBiasEnableEXT" }, { "vkCmdSetPrimitiveRestartEnable", "vkCmdSetPrimitiveRestartEnableEXT" },
+    { "vkCmdBindVertexBuffers2", "vkCmdBindVertexBuffers2EXT" },
+    { "vkCmdDrawIndirectCount", "vkCmdDrawIndirectCountKHR" }, { "vkCmdDrawIndirectCount", "vkCmdDrawIndirectCountAMD" },
+    { "vkCmdDrawIndexedIndirectCount", "vkCmdDrawIndexedIndirectCountKHR" }, { "vkCmdDrawIndexedIndirectCount", "vkCmdDrawIndexedIndirectCountAMD" },
+    { "vkCmdDispatchBase", "vkCmdDispatchBaseKHR" },
+    { "vkCmdPushDescriptorSetKHR", "vkCmdPushDescriptorSet" },
+    { "vkCmdPushDescriptorSetWithTemplateKHR", "vkCmdPushDescriptorSetWithTemplate" },
+};
+#define SF_ALIAS_COUNT (sizeof(sf_aliases) / sizeof(sf_aliases[0]))
+
+/* commands that bypass the layer but read push constants or change filtered state */
+static const struct { const char* name; uint32_t kinds; uint64_t dyn; } sf_unseen[] = {
+    { "vkCmdBindPipelineShaderGroupNV", SF_BIT(PIPELINE), 0 },
+    { "vkCmdBindDescriptorSets2", SF_BIT(DESCRIPTORS), 0 }, { "vkCmdBindDescriptorSets2KHR", SF_BIT(DESCRIPTORS), 0 },
+    { "vkCmdPushDescriptorSet2", SF_BIT(DESCRIPTORS), 0 }, { "vkCmdPushDescriptorSet2KHR", SF_BIT(DESCRIPTORS), 0 },
+    { "vkCmdPushDescriptorSetWithTemplate2", SF_BIT(DESCRIPTORS), 0 }, { "vkCmdPushDescriptorSetWithTemplate2KHR", SF_BIT(DESCRIPTORS), 0 },
+    { "vkCmdBindDescriptorBuffersEXT", SF_BIT(DESCRIPTORS), 0 }, { "vkCmdSetDescriptorBufferOffsetsEXT", SF_BIT(DESCRIPTORS), 0 },
+    { "vkCmdSetDescriptorBufferOffsets2EXT", SF_BIT(DESCRIPTORS), 0 },
+    { "vkCmdBindDescriptorBufferEmbeddedSamplersEXT", SF_BIT(DESCRIPTORS), 0 },
+    { "vkCmdBindIndexBuffer2", SF_BIT(INDEX), 0 }, { "vkCmdBindIndexBuffer2KHR", SF_BIT(INDEX), 0 },
+    { "vkCmdSetDepthBias2EXT", 0, XENO_DYN_BIT(DEPTH_BIAS) },
+    { "vkCmdPushConstants2", SF_BIT(PUSH), 0 }, { "vkCmdPushConstants2KHR", SF_BIT(PUSH), 0 },
+    { "vkCmdTraceRaysKHR", SF_BIT(PUSH), 0 }, { "vkCmdTraceRaysIndirectKHR", SF_BIT(PUSH), 0 },
+    { "vkCmdTraceRaysIndirect2KHR", SF_BIT(PUSH), 0 }, { "vkCmdTraceRaysNV", SF_BIT(PUSH), 0 },
+    { "vkCmdDrawMultiEXT", SF_BIT(PUSH), 0 }, { "vkCmdDrawMultiIndexedEXT", SF_BIT(PUSH), 0 },
+    { "vkCmdDrawMeshTasksIndirectEXT", SF_BIT(PUSH), 0 }, { "vkCmdDrawMeshTasksIndirectCountEXT", SF_BIT(PUSH), 0 },
+    { "vkCmdDrawMeshTasksNV", SF_BIT(PUSH), 0 }, { "vkCmdDrawMeshTasksIndirectNV", SF_BIT(PUSH), 0 },
+    { "vkCmdDrawMeshTasksIndirectCountNV", SF_BIT(PUSH), 0 }, { "vkCmdDrawIndirectByteCountEXT", SF_BIT(PUSH), 0 },
+    { "vkCmdDrawClusterHUAWEI", SF_BIT(PUSH), 0 }, { "vkCmdDrawClusterIndirectHUAWEI", SF_BIT(PUSH), 0 },
+    { "vkCmdSubpassShadingHUAWEI", SF_BIT(PUSH), 0 }, { "vkCmdDispatchGraphAMDX", SF_BIT(PUSH), 0 },
+    { "vkCmdDispatchGraphIndirectAMDX", SF_BIT(PUSH), 0 }, { "vkCmdDispatchGraphIndirectCountAMDX", SF_BIT(PUSH), 0 },
+    { "vkCmdExecuteGeneratedCommandsNV", SF_BIT(PIPELINE) | SF_BIT(VERTEX) | SF_BIT(INDEX) | SF_BIT(PUSH), 0 },
+    { "vkCmdExecuteGeneratedCommandsEXT", SF_BIT(PIPELINE) | SF_BIT(VERTEX) | SF_BIT(INDEX) | SF_BIT(PUSH), 0 },
+};
+
+typedef struct xeno_state_filter_device {
+    xeno_device_t* dev;
+#define SF_NEXT(fn) PFN_##fn next_##fn;
+#define SF_NEXT_DYN(name, state, fn) PFN_##fn next_##fn;
+    SF_HOOKS(SF_NEXT)
+    XENO_DYN_STATES(SF_NEXT_DYN)
+#undef SF_NEXT_DYN
+#undef SF_NEXT
+    uint32_t kinds;                 /* SF_* bits filtered on this device */
+    uint64_t dyn_mask;              /* XENO_DYN_* states filtered */
+    _Atomic uint64_t calls[SF_KINDS], filtered[SF_KINDS], recorded;
+} xeno_state_filter_device_t;
+
+typedef struct sf_blob { unsigned char* data; uint32_t size, cap; } sf_blob_t;
+typedef struct sf_part { const void* p; size_t n; } sf_part_t;
+
+typedef struct sf_sets {
+    VkPipelineLayout layout;
+    VkDescriptorSet sets[SF_MAX_SETS];
+    uint32_t known;                 /* sets bound without dynamic offsets */
+    sf_blob_t call;                 /* the last bind with dynamic offsets, while nothing else was bound since */
+    int call_known;
+} sf_sets_t;
+
+typedef struct sf_cb {
+    xeno_state_filter_device_t* sd;
+    VkCommandBuffer handle;
+    VkCommandPool pool;
+    VkPipeline pipeline[SF_BIND_POINTS];
+    uint32_t pipeline_known;
+    sf_sets_t sets[SF_BIND_POINTS];
+    VkBuffer vb[SF_MAX_BINDINGS];
+    VkDeviceSize vb_offset[SF_MAX_BINDINGS];
+    uint32_t vb_known;
+    VkBuffer ib; VkDeviceSize ib_offset; VkIndexType ib_type;
+    int ib_known;
+    uint64_t dyn_known;             /* XENO_DYN_* states whose last setter call is in dyn[] */
+    sf_blob_t dyn[XENO_DYN_COUNT];
+    /* the held vkCmdPushConstants range */
+    int push_held;
+    VkPipelineLayout push_layout;
+    VkShaderStageFlags push_stages;
+    uint32_t push_lo, push_hi;
+    unsigned char push[SF_PUSH_BYTES];
+    uint64_t calls[SF_KINDS], filtered[SF_KINDS];
+} sf_cb_t;
+
+static xeno_map_t sf_cbs;
+static pthread_once_t sf_cbs_once = PTHREAD_ONCE_INIT;
+static void sf_cbs_init(void) { xeno_map_init(&sf_cbs, 4096); }
+
+/* --- shadow state --- */
+static int blob_equal(const sf_blob_t* b, const sf_part_t* parts, int n) {
+    size_t size = 0;
+    for (int i = 0; i < n; ++i) size += parts[i].n;
+    if (b->size != size) return 0;
+    for (size_t off = 0; n--; off += parts->n, ++parts)
+        if (parts->n && memcmp(b->data + off, parts->p, parts->n) != 0) return 0;
+    return 1;
+}
+static int blob_set(sf_blob_t* b, const sf_part_t* parts, int n) {
+    size_t size = 0;
+    for (int i = 0; i < n; ++i) size += parts[i].n;
+    if (size > b->cap) {
+        unsigned char* p = realloc(b->data, size);
+        if (!p) { b->size = 0; return -1; }
+        b->data = p; b->cap = (uint32_t)size;
+    }
+    b->size = (uint32_t)size;
+    for (size_t off = 0; n--; off += parts->n, ++parts)
+        if (parts->n) memcpy(b->data + off, parts->p, parts->n);
+    return 0;
+}
+
+static void forget_all(sf_cb_t* cb) {
+    cb->pipeline_known = 0;
+    for (int i = 0; i < SF_BIND_POINTS; ++i) { cb->sets[i].known = 0; cb->sets[i].call_known = 0; cb->sets[i].layout = VK_NULL_HANDLE; }
+    cb->vb_known = 0; cb->ib_known = 0; cb->dyn_known = 0;
+}
+
+static void push_flush(sf_cb_t* cb) {
+    if (!cb->push_held) return;
+    cb->push_held = 0;
+    cb->sd->next_vkCmdPushConstants(cb->handle, cb->push_layout, cb->push_stages, cb->push_lo, cb->push_hi - cb->push_lo, cb->push + cb->push_lo);
+}
+
+/* every command but vkCmdPushConstants comes after the held push constants */
+static inline sf_cb_t* sf_cb(VkCommandBuffer commandBuffer) {
+    sf_cb_t* cb = xeno_map_get(&sf_cbs, XENO_HANDLE_KEY(commandBuffer));
+    push_flush(cb);
+    return cb;
+}
+
+static int bind_index(VkPipelineBindPoint bp) {
+    switch (bp) {
+    case VK_PIPELINE_BIND_POINT_GRAPHICS: return 0;
+    case VK_PIPELINE_BIND_POINT_COMPUTE: return 1;
+    case VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR: return 2;
+    default: return -1;
+    }
+}
+
+/* 1 when the state's last setter call had these arguments; otherwise they are remembered */
+static int dyn_repeat(sf_cb_t* cb, int state, const sf_part_t* parts, int n) {
+    uint64_t bit = 1ull << state;
+    cb->calls[SF_DYNAMIC]++;
+    if ((cb->sd->dyn_mask & bit) && (cb->dyn_known & bit) && blob_equal(&cb->dyn[state], parts, n)) { cb->filtered[SF_DYNAMIC]++; return 1; }
+    cb->pipeline_known &= ~1u;  /* a rebind of the same pipeline now restores its static state */
+    if (!(cb->sd->dyn_mask & bit)) return 0;
+    if (blob_set(&cb->dyn[state], parts, n) == 0) cb->dyn_known |= bit;
+    else cb->dyn_known &= ~bit;
+    return 0;
+}
+#define DYN_REPEAT(cb, name, ...) \
+    dyn_repeat(cb, XENO_DYN_##name, (const sf_part_t[]){ __VA_ARGS__ }, (int)(sizeof((const sf_part_t[]){ __VA_ARGS__ }) / sizeof(sf_part_t)))
+#define PART(ptr, bytes) { (ptr), (bytes) }
+
+/* --- lifetime --- */
+static void cb_free(sf_cb_t* cb) {
+    for (int i = 0; i < XENO_DYN_COUNT; ++i) free(cb->dyn[i].data);
+    for (int i = 0; i < SF_BIND_POINTS; ++i) free(cb->sets[i].call.data);
+    free(cb);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL sf_vkAllocateCommandBuffers(VkDevice device, const VkCommandBufferAllocateInfo* pAllocateInfo, VkCommandBuffer* pCommandBuffers) {
+    xeno_state_filter_device_t* sd = xeno_device_get(device)->state_filter;
+    VkResult r = sd->next_vkAllocateCommandBuffers(device, pAllocateInfo, pCommandBuffers);
+    if (r != VK_SUCCESS) return r;
+    for (uint32_t i = 0; i < pAllocateInfo->commandBufferCount; ++i) {
+        sf_cb_t* cb = calloc(1, sizeof(*cb));
+        if (!cb) {
+            while (i--) cb_free(xeno_map_remove(&sf_cbs, XENO_HANDLE_KEY(pCommandBuffers[i])));
+            sd->next_vkFreeCommandBuffers(device, pAllocateInfo->commandPool, pAllocateInfo->commandBufferCount, pCommandBuffers);
+            for (uint32_t k = 0; k < pAllocateInfo->commandBufferCount; ++k) pCommandBuffers[k] = VK_NULL_HANDLE;
+            return VK_ERROR_OUT_OF_HOST_MEMORY;
+        }
+        cb->sd = sd; cb->handle = pCommandBuffers[i]; cb->pool = pAllocateInfo->commandPool;
+        xeno_map_put(&sf_cbs, XENO_HANDLE_KEY(cb->handle), cb);
+    }
+    return r;
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkFreeCommandBuffers(VkDevice device, VkCommandPool commandPool, uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers) {
+    xeno_state_filter_device_t* sd = xeno_device_get(device)->state_filter;
+    for (uint32_t i = 0; i < commandBufferCount; ++i) {
+        if (!pCommandBuffers[i]) continue;
+        sf_cb_t* cb = xeno_map_remove(&sf_cbs, XENO_HANDLE_KEY(pCommandBuffers[i]));
+        if (cb) cb_free(cb);
+    }
+    sd->next_vkFreeCommandBuffers(device, commandPool, commandBufferCount, pCommandBuffers);
+}
+typedef struct sf_walk { xeno_state_filter_device_t* sd; VkCommandPool pool; } sf_walk_t;
+static int free_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; sf_cb_t* cb = val; sf_walk_t* w = ctx;
+    if (cb->sd != w->sd || (w->pool && cb->pool != w->pool)) return 0;
+    cb_free(cb); return 1;
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkDestroyCommandPool(VkDevice device, VkCommandPool commandPool, const VkAllocationCallbacks* pAllocator) {
+    xeno_state_filter_device_t* sd = xeno_device_get(device)->state_filter;
+    if (commandPool) { sf_walk_t w = { sd, commandPool }; xeno_map_foreach(&sf_cbs, free_walk_fn, &w); }
+    sd->next_vkDestroyCommandPool(device, commandPool, pAllocator);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL sf_vkBeginCommandBuffer(VkCommandBuffer commandBuffer, const VkCommandBufferBeginInfo* pBeginInfo) {
+    sf_cb_t* cb = xeno_map_get(&sf_cbs, XENO_HANDLE_KEY(commandBuffer));
+    cb->push_held = 0;  /* a recording abandoned by a reset */
+    forget_all(cb);
+    memset(cb->calls, 0, sizeof(cb->calls)); memset(cb->filtered, 0, sizeof(cb->filtered));
+    return cb->sd->next_vkBeginCommandBuffer(commandBuffer, pBeginInfo);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL sf_vkEndCommandBuffer(VkCommandBuffer commandBuffer) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    xeno_state_filter_device_t* sd = cb->sd;
+    for (int k = 0; k < SF_KINDS; ++k) {
+        if (cb->calls[k]) atomic_fetch_add_explicit(&sd->calls[k], cb->calls[k], memory_order_relaxed);
+        if (cb->filtered[k]) atomic_fetch_add_explicit(&sd->filtered[k], cb->filtered[k], memory_order_relaxed);
+    }
+    memset(cb->calls, 0, sizeof(cb->calls)); memset(cb->filtered, 0, sizeof(cb->filtered));
+    atomic_fetch_add_explicit(&sd->recorded, 1, memory_order_relaxed);
+    return sd->next_vkEndCommandBuffer(commandBuffer);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdExecuteCommands(VkCommandBuffer commandBuffer, uint32_t commandBufferCount, const VkCommandBuffer* pCommandBuffers) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    cb->sd->next_vkCmdExecuteCommands(commandBuffer, commandBufferCount, pCommandBuffers);
+    forget_all(cb);   /* the secondaries leave the state undefined */
+}
+
+/* --- binds --- */
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdBindPipeline(VkCommandBuffer commandBuffer, VkPipelineBindPoint pipelineBindPoint, VkPipeline pipeline) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    int bp = bind_index(pipelineBindPoint);
+    cb->calls[SF_PIPELINE]++;
+    if (bp >= 0 && (cb->sd->kinds & SF_BIT(PIPELINE)) && (cb->pipeline_known & (1u << bp)) && cb->pipeline[bp] == pipeline) {
+        cb->filtered[SF_PIPELINE]++;
+        return;
+    }
+    cb->sd->next_vkCmdBindPipeline(commandBuffer, pipelineBindPoint, pipeline);
+    if (bp < 0) return;
+    cb->pipeline[bp] = pipeline; cb->pipeline_known |= 1u << bp;
+    if (bp == 0) cb->dyn_known = 0;
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdBindShadersEXT(VkCommandBuffer commandBuffer, uint32_t stageCount, const VkShaderStageFlagBits* pStages, const VkShaderEXT* pShaders) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    for (uint32_t i = 0; i < stageCount; ++i) cb->pipeline_known &= pStages[i] == VK_SHADER_STAGE_COMPUTE_BIT ? ~2u : ~1u;
+    cb->sd->next_vkCmdBindShadersEXT(commandBuffer, stageCount, pStages, pShaders);
+}
+
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdBindDescriptorSets(VkCommandBuffer commandBuffer, VkPipelineBindPoint pipelineBindPoint, VkPipelineLayout layout, uint32_t firstSet,
+                                                            uint32_t descriptorSetCount, const VkDescriptorSet* pDescriptorSets, uint32_t dynamicOffsetCount, const uint32_t* pDynamicOffsets) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    int bp = bind_index(pipelineBindPoint);
+    int tracked = bp >= 0 && (cb->sd->kinds & SF_BIT(DESCRIPTORS)) && descriptorSetCount && (uint64_t)firstSet + descriptorSetCount <= SF_MAX_SETS;
+    cb->calls[SF_DESCRIPTORS]++;
+    if (bp < 0) { cb->sd->next_vkCmdBindDescriptorSets(commandBuffer, pipelineBindPoint, layout, firstSet, descriptorSetCount, pDescriptorSets, dynamicOffsetCount, pDynamicOffsets); return; }
+    sf_sets_t* s = &cb->sets[bp];
+    uint32_t range = tracked ? (uint32_t)(((1ull << descriptorSetCount) - 1) << firstSet) : 0;
+    uint32_t head[3] = { firstSet, descriptorSetCount, dynamicOffsetCount };
+    sf_part_t call[3] = { PART(head, sizeof(head)), PART(pDescriptorSets, descriptorSetCount * sizeof(VkDescriptorSet)),
+                          PART(pDynamicOffsets, dynamicOffsetCount * sizeof(uint32_t)) };
+    if (tracked && s->layout == layout) {
+        int same;
+        if (dynamicOffsetCount) same = s->call_known && blob_equal(&s->call, call, 3);
+        else {
+            same = (s->known & range) == range;
+            for (uint32_t i = 0; same && i < descriptorSetCount; ++i) same = s->sets[firstSet + i] == pDescriptorSets[i];
+        }
+        if (same) { cb->filtered[SF_DESCRIPTORS]++; return; }
+    }
+    cb->sd->next_vkCmdBindDescriptorSets(commandBuffer, pipelineBindPoint, layout, firstSet, descriptorSetCount, pDescriptorSets, dynamicOffsetCount, pDynamicOffsets);
+    /* another layout may have disturbed every other set */
+    if (s->layout != layout) { s->known = 0; s->layout = layout; }
+    s->call_known = 0;
+    if (!tracked) { s->known = 0; return; }
+    for (uint32_t i = 0; i < descriptorSetCount; ++i) s->sets[firstSet + i] = pDescriptorSets[i];
+    if (!dynamicOffsetCount) { s->known |= range; return; }
+    /* which of the sets took the offsets is unknown: only a repeat of the whole call matches */
+    s->known &= ~range;
+    s->call_known = blob_set(&s->call, call, 3) == 0;
+}
+static void forget_set(sf_cb_t* cb, int bp, VkPipelineLayout layout, uint32_t set) {
+    sf_sets_t* s = &cb->sets[bp];
+    if (s->layout != layout) { s->known = 0; s->layout = layout; }
+    if (set < SF_MAX_SETS) s->known &= ~(1u << set);
+    s->call_known = 0;
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdPushDescriptorSetKHR(VkCommandBuffer commandBuffer, VkPipelineBindPoint pipelineBindPoint, VkPipelineLayout layout, uint32_t set,
+                                                              uint32_t descriptorWriteCount, const VkWriteDescriptorSet* pDescriptorWrites) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    int bp = bind_index(pipelineBindPoint);
+    if (bp >= 0) forget_set(cb, bp, layout, set);
+    cb->sd->next_vkCmdPushDescriptorSetKHR(commandBuffer, pipelineBindPoint, layout, set, descriptorWriteCount, pDescriptorWrites);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdPushDescriptorSetWithTemplateKHR(VkCommandBuffer commandBuffer, VkDescriptorUpdateTemplate descriptorUpdateTemplate,
+                                                                          VkPipelineLayout layout, uint32_t set, const void* pData) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    for (int bp = 0; bp < SF_BIND_POINTS; ++bp) forget_set(cb, bp, layout, set);   /* the bind point is the template's */
+    cb->sd->next_vkCmdPushDescriptorSetWithTemplateKHR(commandBuffer, descriptorUpdateTemplate, layout, set, pData);
+}
+
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdBindVertexBuffers(VkCommandBuffer commandBuffer, uint32_t firstBinding, uint32_t bindingCount, const VkBuffer* pBuffers, const VkDeviceSize* pOffsets) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    cb->calls[SF_VERTEX]++;
+    if ((cb->sd->kinds & SF_BIT(VERTEX)) && bindingCount && (uint64_t)firstBinding + bindingCount <= SF_MAX_BINDINGS) {
+        uint32_t range = (uint32_t)(((1ull << bindingCount) - 1) << firstBinding);
+        int same = (cb->vb_known & range) == range;
+        for (uint32_t i = 0; same && i < bindingCount; ++i) same = cb->vb[firstBinding + i] == pBuffers[i] && cb->vb_offset[firstBinding + i] == pOffsets[i];
+        if (same) { cb->filtered[SF_VERTEX]++; return; }
+    }
+    cb->sd->next_vkCmdBindVertexBuffers(commandBuffer, firstBinding, bindingCount, pBuffers, pOffsets);
+    for (uint32_t i = 0; i < bindingCount && firstBinding + i < SF_MAX_BINDINGS; ++i) {
+        cb->vb[firstBinding + i] = pBuffers[i]; cb->vb_offset[firstBinding + i] = pOffsets[i];
+        cb->vb_known |= 1u << (firstBinding + i);
+    }
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdBindVertexBuffers2(VkCommandBuffer commandBuffer, uint32_t firstBinding, uint32_t bindingCount, const VkBuffer* pBuffers,
+                                                            const VkDeviceSize* pOffsets, const VkDeviceSize* pSizes, const VkDeviceSize* pStrides) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    for (uint32_t i = 0; i < bindingCount && firstBinding + i < SF_MAX_BINDINGS; ++i) cb->vb_known &= ~(1u << (firstBinding + i));
+    if (pStrides) { cb->dyn_known &= ~XENO_DYN_BIT(VERTEX_INPUT); cb->pipeline_known &= ~1u; }
+    cb->sd->next_vkCmdBindVertexBuffers2(commandBuffer, firstBinding, bindingCount, pBuffers, pOffsets, pSizes, pStrides);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdBindIndexBuffer(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkIndexType indexType) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    cb->calls[SF_INDEX]++;
+    if ((cb->sd->kinds & SF_BIT(INDEX)) && cb->ib_known && cb->ib == buffer && cb->ib_offset == offset && cb->ib_type == indexType) {
+        cb->filtered[SF_INDEX]++;
+        return;
+    }
+    cb->sd->next_vkCmdBindIndexBuffer(commandBuffer, buffer, offset, indexType);
+    cb->ib = buffer; cb->ib_offset = offset; cb->ib_type = indexType; cb->ib_known = 1;
+}
+
+/* held until a command that is not a mergeable push */
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdPushConstants(VkCommandBuffer commandBuffer, VkPipelineLayout layout, VkShaderStageFlags stageFlags, uint32_t offset, uint32_t size, const void* pValues) {
+    sf_cb_t* cb = xeno_map_get(&sf_cbs, XENO_HANDLE_KEY(commandBuffer));
+    uint64_t end = (uint64_t)offset + size;
+    cb->calls[SF_PUSH]++;
+    if (!(cb->sd->kinds & SF_BIT(PUSH)) || end > SF_PUSH_BYTES) {
+        push_flush(cb);
+        cb->sd->next_vkCmdPushConstants(commandBuffer, layout, stageFlags, offset, size, pValues);
+        return;
+    }
+    if (cb->push_held && cb->push_layout == layout && cb->push_stages == stageFlags && offset <= cb->push_hi && end >= cb->push_lo) {
+        memcpy(cb->push + offset, pValues, size);
+        if (offset < cb->push_lo) cb->push_lo = offset;
+        if (end > cb->push_hi) cb->push_hi = (uint32_t)end;
+        cb->filtered[SF_PUSH]++;
+        return;
+    }
+    push_flush(cb);
+    memcpy(cb->push + offset, pValues, size);
+    cb->push_layout = layout; cb->push_stages = stageFlags; cb->push_lo = offset; cb->push_hi = (uint32_t)end;
+    cb->push_held = 1;
+}
+
+/* --- dynamic state setters --- */
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdSetViewport(VkCommandBuffer commandBuffer, uint32_t firstViewport, uint32_t viewportCount, const VkViewport* pViewports) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    uint32_t head[2] = { firstViewport, viewportCount };
+    if (DYN_REPEAT(cb, VIEWPORT, PART(head, sizeof(head)), PART(pViewports, viewportCount * sizeof(VkViewport)))) return;
+    cb->dyn_known &= ~XENO_DYN_BIT(VIEWPORT_WITH_COUNT);
+    cb->sd->next_vkCmdSetViewport(commandBuffer, firstViewport, viewportCount, pViewports);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdSetScissor(VkCommandBuffer commandBuffer, uint32_t firstScissor, uint32_t scissorCount, const VkRect2D* pScissors) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    uint32_t head[2] = { firstScissor, scissorCount };
+    if (DYN_REPEAT(cb, SCISSOR, PART(head, sizeof(head)), PART(pScissors, scissorCount * sizeof(VkRect2D)))) return;
+    cb->dyn_known &= ~XENO_DYN_BIT(SCISSOR_WITH_COUNT);
+    cb->sd->next_vkCmdSetScissor(commandBuffer, firstScissor, scissorCount, pScissors);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdSetViewportWithCount(VkCommandBuffer commandBuffer, uint32_t viewportCount, const VkViewport* pViewports) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    if (DYN_REPEAT(cb, VIEWPORT_WITH_COUNT, PART(&viewportCount, sizeof(viewportCount)), PART(pViewports, viewportCount * sizeof(VkViewport)))) return;
+    cb->dyn_known &= ~XENO_DYN_BIT(VIEWPORT);
+    cb->sd->next_vkCmdSetViewportWithCount(commandBuffer, viewportCount, pViewports);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdSetScissorWithCount(VkCommandBuffer commandBuffer, uint32_t scissorCount, const VkRect2D* pScissors) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    if (DYN_REPEAT(cb, SCISSOR_WITH_COUNT, PART(&scissorCount, sizeof(scissorCount)), PART(pScissors, scissorCount * sizeof(VkRect2D)))) return;
+    cb->dyn_known &= ~XENO_DYN_BIT(SCISSOR);
+    cb->sd->next_vkCmdSetScissorWithCount(commandBuffer, scissorCount, pScissors);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdSetDepthBias(VkCommandBuffer commandBuffer, float c, float clamp, float slope) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    float v[3] = { c, clamp, slope };
+    if (!DYN_REPEAT(cb, DEPTH_BIAS, PART(v, sizeof(v)))) cb->sd->next_vkCmdSetDepthBias(commandBuffer, c, clamp, slope);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdSetBlendConstants(VkCommandBuffer commandBuffer, const float blendConstants[4]) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    if (!DYN_REPEAT(cb, BLEND_CONSTANTS, PART(blendConstants, 4 * sizeof(float)))) cb->sd->next_vkCmdSetBlendConstants(commandBuffer, blendConstants);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdSetDepthBounds(VkCommandBuffer commandBuffer, float minDepthBounds, float maxDepthBounds) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    float v[2] = { minDepthBounds, maxDepthBounds };
+    if (!DYN_REPEAT(cb, DEPTH_BOUNDS, PART(v, sizeof(v)))) cb->sd->next_vkCmdSetDepthBounds(commandBuffer, minDepthBounds, maxDepthBounds);
+}
+#define SF_STENCIL(fn, name) \
+    static VKAPI_ATTR void VKAPI_CALL sf_##fn(VkCommandBuffer commandBuffer, VkStencilFaceFlags faceMask, uint32_t value) { \
+        sf_cb_t* cb = sf_cb(commandBuffer); uint32_t v[2] = { faceMask, value }; \
+        if (!DYN_REPEAT(cb, name, PART(v, sizeof(v)))) cb->sd->next_##fn(commandBuffer, faceMask, value); }
+SF_STENCIL(vkCmdSetStencilCompareMask, STENCIL_COMPARE_MASK)
+SF_STENCIL(vkCmdSetStencilWriteMask, STENCIL_WRITE_MASK)
+SF_STENCIL(vkCmdSetStencilReference, STENCIL_REFERENCE)
+#undef SF_STENCIL
+#define SF_SCALAR(fn, name, type) \
+    static VKAPI_ATTR void VKAPI_CALL sf_##fn(VkCommandBuffer commandBuffer, type value) { \
+        sf_cb_t* cb = sf_cb(commandBuffer); \
+        if (!DYN_REPEAT(cb, name, PART(&value, sizeof(value)))) cb->sd->next_##fn(commandBuffer, value); }
+SF_SCALAR(vkCmdSetLineWidth, LINE_WIDTH, float)
+SF_SCALAR(vkCmdSetCullMode, CULL_MODE, VkCullModeFlags)
+SF_SCALAR(vkCmdSetFrontFace, FRONT_FACE, VkFrontFace)
+SF_SCALAR(vkCmdSetPrimitiveTopology, PRIMITIVE_TOPOLOGY, VkPrimitiveTopology)
+SF_SCALAR(vkCmdSetDepthTestEnable, DEPTH_TEST_ENABLE, VkBool32)
+SF_SCALAR(vkCmdSetDepthWriteEnable, DEPTH_WRITE_ENABLE, VkBool32)
+SF_SCALAR(vkCmdSetDepthCompareOp, DEPTH_COMPARE_OP, VkCompareOp)
+SF_SCALAR(vkCmdSetDepthBoundsTestEnable, DEPTH_BOUNDS_TEST_ENABLE, VkBool32)
+SF_SCALAR(vkCmdSetStencilTestEnable, STENCIL_TEST_ENABLE, VkBool32)
+SF_SCALAR(vkCmdSetRasterizerDiscardEnable, RASTERIZER_DISCARD_ENABLE, VkBool32)
+SF_SCALAR(vkCmdSetDepthBiasEnable, DEPTH_BIAS_ENABLE, VkBool32)
+SF_SCALAR(vkCmdSetPrimitiveRestartEnable, PRIMITIVE_RESTART_ENABLE, VkBool32)
+SF_SCALAR(vkCmdSetPatchControlPointsEXT, PATCH_CONTROL_POINTS, uint32_t)
+SF_SCALAR(vkCmdSetLogicOpEXT, LOGIC_OP, VkLogicOp)
+SF_SCALAR(vkCmdSetDepthClampEnableEXT, DEPTH_CLAMP_ENABLE, VkBool32)
+SF_SCALAR(vkCmdSetPolygonModeEXT, POLYGON_MODE, VkPolygonMode)
+SF_SCALAR(vkCmdSetRasterizationSamplesEXT, RASTERIZATION_SAMPLES, VkSampleCountFlagBits)
+SF_SCALAR(vkCmdSetAlphaToCoverageEnableEXT, ALPHA_TO_COVERAGE_ENABLE, VkBool32)
+SF_SCALAR(vkCmdSetAlphaToOneEnableEXT, ALPHA_TO_ONE_ENABLE, VkBool32)
+SF_SCALAR(vkCmdSetLogicOpEnableEXT, LOGIC_OP_ENABLE, VkBool32)
+#undef SF_SCALAR
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdSetStencilOp(VkCommandBuffer commandBuffer, VkStencilFaceFlags faceMask, VkStencilOp failOp, VkStencilOp passOp, VkStencilOp depthFailOp, VkCompareOp compareOp) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    uint32_t v[5] = { faceMask, failOp, passOp, depthFailOp, compareOp };
+    if (!DYN_REPEAT(cb, STENCIL_OP, PART(v, sizeof(v)))) cb->sd->next_vkCmdSetStencilOp(commandBuffer, faceMask, failOp, passOp, depthFailOp, compareOp);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdSetSampleMaskEXT(VkCommandBuffer commandBuffer, VkSampleCountFlagBits samples, const VkSampleMask* pSampleMask) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    uint32_t words = pSampleMask ? ((uint32_t)samples + 31) / 32 : 0;
+    if (!DYN_REPEAT(cb, SAMPLE_MASK, PART(&samples, sizeof(samples)), PART(pSampleMask, words * sizeof(VkSampleMask))))
+        cb->sd->next_vkCmdSetSampleMaskEXT(commandBuffer, samples, pSampleMask);
+}
+#define SF_ATTACHMENTS(fn, name, type) \
+    static VKAPI_ATTR void VKAPI_CALL sf_##fn(VkCommandBuffer commandBuffer, uint32_t first, uint32_t count, const type* pValues) { \
+        sf_cb_t* cb = sf_cb(commandBuffer); uint32_t head[2] = { first, count }; \
+        if (!DYN_REPEAT(cb, name, PART(head, sizeof(head)), PART(pValues, count * sizeof(type)))) cb->sd->next_##fn(commandBuffer, first, count, pValues); }
+SF_ATTACHMENTS(vkCmdSetColorBlendEnableEXT, COLOR_BLEND_ENABLE, VkBool32)
+SF_ATTACHMENTS(vkCmdSetColorBlendEquationEXT, COLOR_BLEND_EQUATION, VkColorBlendEquationEXT)
+SF_ATTACHMENTS(vkCmdSetColorWriteMaskEXT, COLOR_WRITE_MASK, VkColorComponentFlags)
+#undef SF_ATTACHMENTS
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdSetVertexInputEXT(VkCommandBuffer commandBuffer, uint32_t bindingCount, const VkVertexInputBindingDescription2EXT* pBindings,
+                                                           uint32_t attributeCount, const VkVertexInputAttributeDescription2EXT* pAttributes) {
+    sf_cb_t* cb = sf_cb(commandBuffer);
+    /* compared field by field: the descriptions carry pNext pointers */
+    xeno_vertex_binding_t b[XENO_MAX_VERTEX_BINDINGS]; xeno_vertex_attribute_t a[XENO_MAX_VERTEX_ATTRIBUTES];
+    int packed = bindingCount <= XENO_MAX_VERTEX_BINDINGS && attributeCount <= XENO_MAX_VERTEX_ATTRIBUTES;
+    for (uint32_t i = 0; packed && i < bindingCount; ++i) {
+        xeno_vertex_binding_t v = { pBindings[i].binding, pBindings[i].stride, pBindings[i].inputRate, pBindings[i].divisor };
+        b[i] = v; packed = !pBindings[i].pNext;
+    }
+    for (uint32_t i = 0; packed && i < attributeCount; ++i) {
+        xeno_vertex_attribute_t v = { pAttributes[i].location, pAttributes[i].binding, pAttributes[i].format, pAttributes[i].offset };
+        a[i] = v; packed = !pAttributes[i].pNext;
+    }
+    uint32_t head[2] = { bindingCount, attributeCount };
+    if (packed && DYN_REPEAT(cb, VERTEX_INPUT, PART(head, sizeof(head)), PART(b, bindingCount * sizeof(*b)), PART(a, attributeCount * sizeof(*a)))) return;
+    if (!packed) { cb->calls[SF_DYNAMIC]++; cb->dyn_known &= ~XENO_DYN_BIT(VERTEX_INPUT); cb->pipeline_known &= ~1u; }
+    cb->sd->next_vkCmdSetVertexInputEXT(commandBuffer, bindingCount, pBindings, attributeCount, pAttributes);
+}
+
+/* --- commands reading push constants: the held range goes first --- */
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdDraw(VkCommandBuffer commandBuffer, uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) {
+    sf_cb(commandBuffer)->sd->next_vkCmdDraw(commandBuffer, vertexCount, instanceCount, firstVertex, firstInstance);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdDrawIndexed(VkCommandBuffer commandBuffer, uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance) {
+    sf_cb(commandBuffer)->sd->next_vkCmdDrawIndexed(commandBuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdDrawIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride) {
+    sf_cb(commandBuffer)->sd->next_vkCmdDrawIndirect(commandBuffer, buffer, offset, drawCount, stride);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdDrawIndexedIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount, uint32_t stride) {
+    sf_cb(commandBuffer)->sd->next_vkCmdDrawIndexedIndirect(commandBuffer, buffer, offset, drawCount, stride);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdDrawIndirectCount(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride) {
+    sf_cb(commandBuffer)->sd->next_vkCmdDrawIndirectCount(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdDrawIndexedIndirectCount(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset, VkBuffer countBuffer, VkDeviceSize countBufferOffset, uint32_t maxDrawCount, uint32_t stride) {
+    sf_cb(commandBuffer)->sd->next_vkCmdDrawIndexedIndirectCount(commandBuffer, buffer, offset, countBuffer, countBufferOffset, maxDrawCount, stride);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdDrawMeshTasksEXT(VkCommandBuffer commandBuffer, uint32_t x, uint32_t y, uint32_t z) {
+    sf_cb(commandBuffer)->sd->next_vkCmdDrawMeshTasksEXT(commandBuffer, x, y, z);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdDispatch(VkCommandBuffer commandBuffer, uint32_t x, uint32_t y, uint32_t z) {
+    sf_cb(commandBuffer)->sd->next_vkCmdDispatch(commandBuffer, x, y, z);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdDispatchIndirect(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset) {
+    sf_cb(commandBuffer)->sd->next_vkCmdDispatchIndirect(commandBuffer, buffer, offset);
+}
+static VKAPI_ATTR void VKAPI_CALL sf_vkCmdDispatchBase(VkCommandBuffer commandBuffer, uint32_t baseX, uint32_t baseY, uint32_t baseZ, uint32_t x, uint32_t y, uint32_t z) {
+    sf_cb(commandBuffer)->sd->next_vkCmdDispatchBase(commandBuffer, baseX, baseY, baseZ, x, y, z);
+}
+
+/* --- device lifetime / routing --- */
+static PFN_vkVoidFunction resolve(xeno_device_t* dev, const char* name) {
+    PFN_vkVoidFunction fn = xeno_device_next_proc(dev, name);
+    for (size_t i = 0; !fn && i < SF_ALIAS_COUNT; ++i)
+        if (strcmp(sf_aliases[i].name, name) == 0) fn = xeno_device_next_proc(dev, sf_aliases[i].alias);
+    return fn;
+}
+
+int xeno_state_filter_init(xeno_device_t* dev) {
+    if (!xeno_env_bool("XCLIPSE_STATE_FILTER", 0)) return 0;
+    pthread_once(&sf_cbs_once, sf_cbs_init);
+    xeno_state_filter_device_t* sd = calloc(1, sizeof(*sd)); if (!sd) return -1;
+    sd->dev = dev;
+#define SF_RESOLVE(fn) sd->next_##fn = (PFN_##fn)resolve(dev, #fn);
+#define SF_RESOLVE_DYN(name, state, fn) SF_RESOLVE(fn)
+    SF_HOOKS(SF_RESOLVE)
+    XENO_DYN_STATES(SF_RESOLVE_DYN)
+#undef SF_RESOLVE_DYN
+#undef SF_RESOLVE
+    if (!sd->next_vkAllocateCommandBuffers || !sd->next_vkFreeCommandBuffers || !sd->next_vkDestroyCommandPool ||
+        !sd->next_vkBeginCommandBuffer || !sd->next_vkEndCommandBuffer || !sd->next_vkCmdExecuteCommands) { free(sd); return -1; }
+    sd->kinds = (1u << SF_KINDS) - 1;
+    if (!xeno_env_bool("XCLIPSE_STATE_FILTER_PUSH", 1)) sd->kinds &= ~SF_BIT(PUSH);
+    sd->dyn_mask = (1ull << XENO_DYN_COUNT) - 1;
+    for (size_t i = 0; i < sizeof(sf_unseen) / sizeof(sf_unseen[0]); ++i) {
+        if (!((sd->kinds & sf_unseen[i].kinds) || (sd->dyn_mask & sf_unseen[i].dyn)) || !xeno_device_next_proc(dev, sf_unseen[i].name)) continue;
+        sd->kinds &= ~sf_unseen[i].kinds; sd->dyn_mask &= ~sf_unseen[i].dyn;
+        xlog("state_filter: %s bypasses the filter, its state passes through", sf_unseen[i].name);
+    }
+    dev->state_filter = sd;
+    char kinds[128] = "";
+    for (int k = 0; k < SF_KINDS; ++k)
+        if (sd->kinds & (1u << k)) { if (kinds[0]) strcat(kinds, ", "); strcat(kinds, sf_kind_names[k]); }
+    xlog("state_filter: dropping redundant %s", kinds[0] ? kinds : "nothing");
+    return 0;
+}
+
+static int device_walk_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; sf_cb_t* cb = val;
+    if (cb->sd != ctx) return 0;
+    cb_free(cb); return 1;
+}
+
+void xeno_state_filter_destroy(xeno_device_t* dev) {
+    xeno_state_filter_device_t* sd = dev->state_filter;
+    if (!sd) return;
+    xeno_map_foreach(&sf_cbs, device_walk_fn, sd);   /* command buffers of pools the app leaked */
+    dev->state_filter = NULL;
+    free(sd);
+}
+
+PFN_vkVoidFunction xeno_state_filter_proc(xeno_device_t* dev, const char* name) {
+    xeno_state_filter_device_t* sd = dev->state_filter;
+    if (!sd || strncmp(name, "vkCmd", 5) != 0) {
+        if (!sd || strncmp(name, "vk", 2) != 0) return NULL;
+#define SF_PROC(fn) if (strcmp(name, #fn) == 0) return (PFN_vkVoidFunction)sf_##fn;
+        SF_PROC(vkAllocateCommandBuffers) SF_PROC(vkFreeCommandBuffers) SF_PROC(vkDestroyCommandPool)
+        SF_PROC(vkBeginCommandBuffer) SF_PROC(vkEndCommandBuffer)
+#undef SF_PROC
+        return NULL;
+    }
+    for (size_t i = 0; i < SF_ALIAS_COUNT; ++i)
+        if (strcmp(name, sf_aliases[i].alias) == 0) { name = sf_aliases[i].name; break; }
+#define SF_PROC(fn) if (sd->next_##fn && strcmp(name, #fn) == 0) return (PFN_vkVoidFunction)sf_##fn;
+#define SF_PROC_DYN(n, state, fn) SF_PROC(fn)
+    SF_PROC(vkCmdExecuteCommands) SF_PROC(vkCmdBindShadersEXT) SF_PROC(vkCmdPushDescriptorSetKHR) SF_PROC(vkCmdPushDescriptorSetWithTemplateKHR)
+    SF_PROC(vkCmdBindVertexBuffers2)
+    if (sd->kinds & SF_BIT(PIPELINE)) SF_PROC(vkCmdBindPipeline)
+    if (sd->kinds & SF_BIT(DESCRIPTORS)) SF_PROC(vkCmdBindDescriptorSets)
+    if (sd->kinds & SF_BIT(VERTEX)) SF_PROC(vkCmdBindVertexBuffers)
+    if (sd->kinds & SF_BIT(INDEX)) SF_PROC(vkCmdBindIndexBuffer)
+    if (sd->kinds & SF_BIT(DYNAMIC)) { XENO_DYN_STATES(SF_PROC_DYN) }
+    if (sd->kinds & SF_BIT(PUSH)) {
+        SF_PROC(vkCmdPushConstants)
+        SF_PROC(vkCmdDraw) SF_PROC(vkCmdDrawIndexed) SF_PROC(vkCmdDrawIndirect) SF_PROC(vkCmdDrawIndexedIndirect)
+        SF_PROC(vkCmdDrawIndirectCount) SF_PROC(vkCmdDrawIndexedIndirectCount) SF_PROC(vkCmdDrawMeshTasksEXT)
+        SF_PROC(vkCmdDispatch) SF_PROC(vkCmdDispatchIndirect) SF_PROC(vkCmdDispatchBase)
+    }
+#undef SF_PROC_DYN
+#undef SF_PROC
+    return NULL;
+}
+
+void xeno_state_filter_report(FILE* f, xeno_device_t* dev) {
+    xeno_state_filter_device_t* sd = dev->state_filter;
+    fprintf(f, "  \"state_filter\": {\"enabled\": %s", sd ? "true" : "false");
+    if (sd) {
+        uint64_t frames = atomic_load(&dev->frames), calls = 0, filtered = 0;
+        for (int k = 0; k < SF_KINDS; ++k) {
+            uint64_t c = atomic_load(&sd->calls[k]), n = atomic_load(&sd->filtered[k]);
+            fprintf(f, ", \"%s\": {\"filtered\": %s, \"calls\": %" PRIu64 ", \"%s\": %" PRIu64 "}", sf_kind_names[k],
+                    sd->kinds & (1u << k) ? "true" : "false", c, k == SF_PUSH ? "merged" : "dropped", n);
+            calls += c; filtered += n;
+        }
+        fprintf(f, ", \"command_buffers\": %" PRIu64 ", \"frames\": %" PRIu64 ", \"calls\": %" PRIu64 ", \"filtered\": %" PRIu64
+                   ", \"filtered_pct\": %.1f, \"calls_per_frame\": %.1f, \"filtered_per_frame\": %.1f",
+                atomic_load(&sd->recorded), frames, calls, filtered, calls ? 100.0 * (double)filtered / (double)calls : 0.0,
+                frames ? (double)calls / (double)frames : 0.0, frames ? (double)filtered / (double)frames : 0.0);
+    }
+    fprintf(f, "}");
+}
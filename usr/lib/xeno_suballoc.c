@@ -0,0 +1,652 @@
+/* xeno_suballoc.c - device memory suballocation over vkAllocateMemory
+ *
+ * Titles that allocate once per buffer or image run into maxMemoryAllocationCount and pay a kernel
+ * round trip per vkAllocateMemory. With XCLIPSE_SUBALLOC=1 requests are carved out of large blocks
+ * instead: one pool per memory type (and per VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT), a TLSF
+ * allocator inside every block (xeno_tlsf.c). The app's VkDeviceMemory is then a wrapper handle for
+ * (block, offset), and every entrypoint taking device memory translates it: buffer/image binds,
+ * vkMapMemory(2), flush/invalidate, commitment, vkQueueBindSparse, video session and NV
+ * acceleration structure binds. A suballocation shares its block, so vkSetDeviceMemoryPriorityEXT
+ * leaves it at the block's priority, and it has no opaque capture address of its own:
+ * vkGetDeviceMemoryOpaqueCaptureAddress returns 0 for it, which replays at any address.
+ *
+ * Placement happens before the memory's use is known, so suballocations are aligned for any
+ * resource: to the largest alignment vkGet*MemoryRequirements reported for the type so far (apps
+ * query before they allocate), to bufferImageGranularity with sizes rounded up as well so linear
+ * and optimal resources never share a granularity page, and to nonCoherentAtomSize on
+ * non-coherent types so flushed ranges stay atom aligned. Host-visible blocks are mapped on the
+ * first vkMapMemory of any of their suballocations and stay mapped; vkUnmapMemory is a no-op.
+ *
+ * Left to the driver: requests over half a block, requests with a pNext other than
+ * VkMemoryAllocateFlagsInfo (dedicated, import/export, priority, ...), device masks and capture
+ * replay, device address requests once the app enabled bufferDeviceAddressCaptureReplay (a capture
+ * needs their opaque address), and lazily allocated or protected types. A pool keeps its last block
+ * when it empties.
+ *
+ * With XCLIPSE_SUBALLOC_DEFRAG=1 a defragmenter runs on the worker pool after every
+ * vkQueuePresentKHR. Per pool it picks the sparsest block under XCLIPSE_SUBALLOC_DEFRAG_PCT use and
+ * drains it: new suballocations go elsewhere (to a new block if need be; the draining block only
+ * when no block can be allocated), suballocations nothing is bound to and that were never mapped
+ * move out, and once empty the block is freed. Bound resources cannot be rebound in Vulkan, so
+ * they stay where they are until the app frees them; a block that does not empty within
+ * DRAIN_PATIENCE frames is given up on for a while. Moves and block frees together stay within
+ * XCLIPSE_SUBALLOC_DEFRAG_MB per frame (at least one block is freed per frame). Nothing it moves or
+ * frees can be in use by the GPU, so it waits on no fence.
+ *
+ * Knobs:
+ *   XCLIPSE_SUBALLOC=1                 enable
+ *   XCLIPSE_SUBALLOC_BLOCK_MB=N        block size (default 64, at most 1/8 of the type's heap)
+ *   XCLIPSE_SUBALLOC_DEFRAG=1          drain and free sparsely used blocks in the background
+ *   XCLIPSE_SUBALLOC_DEFRAG_PCT=N      blocks below N percent use are drained (default 25)
+ *   XCLIPSE_SUBALLOC_DEFRAG_MB=N       bytes moved and freed per frame (default 64)
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sched.h>
+#include "xeno_internal.h"
+
+#define POOL_COUNT (2 * VK_MAX_MEMORY_TYPES)
+#define MIN_ALIGN 256
+#define DRAIN_PATIENCE 600          /* frames a draining block gets to empty; as long again before it is picked again */
+
+typedef struct sa_block {
+    struct sa_block* next;
+    VkDeviceMemory memory;
+    xeno_tlsf_t* tlsf;
+    uint64_t size;
+    void* ptr;                      /* persistent mapping, NULL until the first map */
+    uint32_t movable;               /* suballocations that are not pinned */
+    int draining;                   /* the defragmenter is emptying it */
+    uint64_t drain_tick;            /* tick it was picked at */
+} sa_block_t;
+
+typedef struct sa_pool {
+    pthread_mutex_t lock;
+    sa_block_t* blocks;             /* newest first */
+    uint32_t type, count;
+    VkMemoryAllocateFlags flags;
+} sa_pool_t;
+
+typedef struct sa_alloc {           /* what an app VkDeviceMemory of a suballocation points to */
+    sa_pool_t* pool;
+    sa_block_t* block;
+    xeno_tlsf_range_t* range;
+    uint64_t offset, size;          /* size: the request rounded to the type's granularity */
+    int pinned;                     /* bound or mapped: stays at (block, offset) for good */
+} sa_alloc_t;
+
+typedef struct xeno_suballoc_device {
+    uint64_t block_size[VK_MAX_MEMORY_TYPES]; /* 0: type not suballocated */
+    uint64_t granularity[VK_MAX_MEMORY_TYPES];
+    _Atomic uint64_t align[VK_MAX_MEMORY_TYPES]; /* largest resource alignment reported per type */
+    sa_pool_t pools[POOL_COUNT];
+    xeno_map_t allocs;              /* app VkDeviceMemory -> sa_alloc_t */
+    _Atomic uint64_t requests, suballocated, passthrough, block_fallbacks;
+    _Atomic uint64_t driver_allocs, peak_driver_allocs, blocks, block_bytes;
+    _Atomic uint64_t sub_ns, sub_ns_max, pass_ns;
+    int defrag;
+    uint32_t defrag_pct;
+    uint64_t defrag_budget;         /* bytes per frame */
+    _Atomic int tick_queued;
+    _Atomic uint32_t pending;       /* defragmenter runs not yet finished */
+    _Atomic uint64_t ticks, drained_blocks, abandoned_blocks, moved, moved_bytes, retired_blocks, retired_bytes, retire_deferred;
+} xeno_suballoc_device_t;
+
+#define ALLOC_HANDLE(a) ((VkDeviceMemory)(uintptr_t)(a))
+
+static inline uint64_t align_up(uint64_t v, uint64_t a) { return (v + a - 1) / a * a; }
+
+static void atomic_max(_Atomic uint64_t* v, uint64_t x) {
+    uint64_t cur = atomic_load(v);
+    while (x > cur && !atomic_compare_exchange_weak(v, &cur, x)) {}
+}
+
+static sa_alloc_t* lookup(xeno_suballoc_device_t* sd, VkDeviceMemory memory) {
+    return memory ? xeno_map_get(&sd->allocs, XENO_HANDLE_KEY(memory)) : NULL;
+}
+
+static void driver_alloc_added(xeno_suballoc_device_t* sd) {
+    atomic_max(&sd->peak_driver_allocs, atomic_fetch_add(&sd->driver_allocs, 1) + 1);
+}
+
+/* NULL when the request goes to the driver as is */
+static sa_pool_t* pool_for(xeno_device_t* dev, const VkMemoryAllocateInfo* ai) {
+    xeno_suballoc_device_t* sd = dev->suballoc;
+    uint32_t type = ai->memoryTypeIndex;
+    if (type >= dev->memory.memoryTypeCount || !sd->block_size[type] || ai->allocationSize > sd->block_size[type] / 2) return NULL;
+    VkMemoryAllocateFlags flags = 0;
+    for (const VkBaseInStructure* s = ai->pNext; s; s = s->pNext) {
+        if (s->sType != VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO) return NULL;
+        flags = ((const VkMemoryAllocateFlagsInfo*)s)->flags;
+    }
+    if ((flags & ~(VkMemoryAllocateFlags)VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT) || (flags && dev->capture_replay)) return NULL;
+    return &sd->pools[type + (flags ? VK_MAX_MEMORY_TYPES : 0)];
+}
+
+static sa_block_t* new_block(xeno_device_t* dev, sa_pool_t* pool) {
+    xeno_suballoc_device_t* sd = dev->suballoc;
+    sa_block_t* b = calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    b->size = sd->block_size[pool->type];
+    VkMemoryAllocateFlagsInfo fi = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO, NULL, pool->flags, 0 };
+    VkMemoryAllocateInfo ai = { VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, pool->flags ? &fi : NULL, b->size, pool->type };
+    if (!(b->tlsf = xeno_tlsf_create(b->size)) || dev->vk.vkAllocateMemory(dev->handle, &ai, NULL, &b->memory) != VK_SUCCESS) {
+        xeno_tlsf_destroy(b->tlsf); free(b);
+        return NULL;
+    }
+    b->next = pool->blocks; pool->blocks = b; pool->count++;
+    driver_alloc_added(sd);
+    atomic_fetch_add(&sd->blocks, 1); atomic_fetch_add(&sd->block_bytes, b->size);
+    return b;
+}
+
+static void free_block(xeno_device_t* dev, sa_block_t* b) {
+    xeno_suballoc_device_t* sd = dev->suballoc;
+    dev->vk.vkFreeMemory(dev->handle, b->memory, NULL);
+    atomic_fetch_sub(&sd->driver_allocs, 1);
+    atomic_fetch_sub(&sd->blocks, 1); atomic_fetch_sub(&sd->block_bytes, b->size);
+    xeno_tlsf_destroy(b->tlsf); free(b);
+}
+
+static sa_alloc_t* suballocate(xeno_device_t* dev, sa_pool_t* pool, uint64_t request) {
+    xeno_suballoc_device_t* sd = dev->suballoc;
+    sa_alloc_t* a = calloc(1, sizeof(*a));
+    if (!a) return NULL;
+    uint64_t gran = sd->granularity[pool->type], align = atomic_load(&sd->align[pool->type]);
+    if (align < gran) align = gran;
+    a->pool = pool; a->size = align_up(request ? request : 1, gran);
+    pthread_mutex_lock(&pool->lock);
+    for (sa_block_t* b = pool->blocks; b && !a->range; b = b->next)
+        if (!b->draining && (a->range = xeno_tlsf_alloc(b->tlsf, a->size, align, &a->offset))) a->block = b;
+    if (!a->range && (a->block = new_block(dev, pool)) && !(a->range = xeno_tlsf_alloc(a->block->tlsf, a->size, align, &a->offset))) a->block = NULL;
+    /* no new block: a draining one still beats the exact-size fallback */
+    for (sa_block_t* b = pool->blocks; b && !a->range; b = b->next)
+        if (b->draining && (a->range = xeno_tlsf_alloc(b->tlsf, a->size, align, &a->offset))) a->block = b;
+    if (a->range) a->block->movable++;
+    pthread_mutex_unlock(&pool->lock);
+    if (!a->range) { free(a); return NULL; }
+    return a;
+}
+
+static void release(xeno_device_t* dev, sa_alloc_t* a) {
+    sa_pool_t* pool = a->pool; sa_block_t* b = a->block;
+    pthread_mutex_lock(&pool->lock);
+    xeno_tlsf_free(b->tlsf, a->range);
+    if (!a->pinned) b->movable--;
+    /* an emptied draining block is freed by the defragmenter, within its per-frame budget */
+    if (xeno_tlsf_ranges(b->tlsf) == 0 && pool->count > 1 && !b->draining) {
+        sa_block_t** p = &pool->blocks; while (*p != b) p = &(*p)->next;
+        *p = b->next; pool->count--;
+        free_block(dev, b);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    free(a);
+}
+
+/* A resource or mapping now depends on where the suballocation lives; without the defragmenter
+ * nothing moves, so no lock is needed */
+static sa_block_t* pin(xeno_suballoc_device_t* sd, sa_alloc_t* a, uint64_t* offset) {
+    if (!sd->defrag) { *offset = a->offset; return a->block; }
+    pthread_mutex_lock(&a->pool->lock);
+    if (!a->pinned) { a->pinned = 1; a->block->movable--; }
+    sa_block_t* b = a->block; *offset = a->offset;
+    pthread_mutex_unlock(&a->pool->lock);
+    return b;
+}
+
+/* --- allocation --- */
+static VKAPI_ATTR VkResult VKAPI_CALL sa_vkAllocateMemory(VkDevice device, const VkMemoryAllocateInfo* pAllocateInfo, const VkAllocationCallbacks* pAllocator, VkDeviceMemory* pMemory) {
+    xeno_device_t* dev = xeno_device_get(device); xeno_suballoc_device_t* sd = dev->suballoc;
+    uint64_t t0 = xeno_now_ns();
+    atomic_fetch_add(&sd->requests, 1);
+    sa_pool_t* pool = pool_for(dev, pAllocateInfo);
+    if (pool) {
+        sa_alloc_t* a = suballocate(dev, pool, pAllocateInfo->allocationSize);
+        if (a) {
+            xeno_map_put(&sd->allocs, XENO_HANDLE_KEY(ALLOC_HANDLE(a)), a);
+            *pMemory = ALLOC_HANDLE(a);
+            uint64_t ns = xeno_now_ns() - t0;
+            atomic_fetch_add(&sd->suballocated, 1); atomic_fetch_add(&sd->sub_ns, ns); atomic_max(&sd->sub_ns_max, ns);
+            return VK_SUCCESS;
+        }
+        atomic_fetch_add(&sd->block_fallbacks, 1); /* no block could be allocated: try the exact size */
+    }
+    VkResult r = dev->vk.vkAllocateMemory(device, pAllocateInfo, pAllocator, pMemory);
+    if (r == VK_SUCCESS) {
+        driver_alloc_added(sd);
+        atomic_fetch_add(&sd->passthrough, 1); atomic_fetch_add(&sd->pass_ns, xeno_now_ns() - t0);
+    }
+    return r;
+}
+
+static VKAPI_ATTR void VKAPI_CALL sa_vkFreeMemory(VkDevice device, VkDeviceMemory memory, const VkAllocationCallbacks* pAllocator) {
+    xeno_device_t* dev = xeno_device_get(device); xeno_suballoc_device_t* sd = dev->suballoc;
+    if (!memory) return;
+    sa_alloc_t* a = xeno_map_remove(&sd->allocs, XENO_HANDLE_KEY(memory));
+    if (a) { release(dev, a); return; }
+    dev->vk.vkFreeMemory(device, memory, pAllocator);
+    atomic_fetch_sub(&sd->driver_allocs, 1);
+}
+
+/* --- mapping --- */
+static VkResult map_alloc(xeno_device_t* dev, sa_alloc_t* a, VkDeviceSize offset, void** ppData) {
+    VkResult r = VK_SUCCESS;
+    pthread_mutex_lock(&a->pool->lock);
+    sa_block_t* b = a->block;
+    if (!a->pinned) { a->pinned = 1; b->movable--; }
+    if (!b->ptr) r = dev->vk.vkMapMemory(dev->handle, b->memory, 0, VK_WHOLE_SIZE, 0, &b->ptr);
+    void* base = b->ptr; uint64_t at = a->offset;
+    pthread_mutex_unlock(&a->pool->lock);
+    if (r == VK_SUCCESS) *ppData = (char*)base + at + offset;
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL sa_vkMapMemory(VkDevice device, VkDeviceMemory memory, VkDeviceSize offset, VkDeviceSize size, VkMemoryMapFlags flags, void** ppData) {
+    xeno_device_t* dev = xeno_device_get(device);
+    sa_alloc_t* a = lookup(dev->suballoc, memory);
+    return a ? map_alloc(dev, a, offset, ppData) : dev->vk.vkMapMemory(device, memory, offset, size, flags, ppData);
+}
+static VKAPI_ATTR void VKAPI_CALL sa_vkUnmapMemory(VkDevice device, VkDeviceMemory memory) {
+    xeno_device_t* dev = xeno_device_get(device);
+    if (!lookup(dev->suballoc, memory)) dev->vk.vkUnmapMemory(device, memory);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL sa_vkMapMemory2(VkDevice device, const VkMemoryMapInfo* pMemoryMapInfo, void** ppData) {
+    xeno_device_t* dev = xeno_device_get(device);
+    sa_alloc_t* a = lookup(dev->suballoc, pMemoryMapInfo->memory);
+    return a ? map_alloc(dev, a, pMemoryMapInfo->offset, ppData) : dev->vk.vkMapMemory2(device, pMemoryMapInfo, ppData);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL sa_vkUnmapMemory2(VkDevice device, const VkMemoryUnmapInfo* pMemoryUnmapInfo) {
+    xeno_device_t* dev = xeno_device_get(device);
+    return lookup(dev->suballoc, pMemoryUnmapInfo->memory) ? VK_SUCCESS : dev->vk.vkUnmapMemory2(device, pMemoryUnmapInfo);
+}
+
+typedef VkResult (VKAPI_PTR *ranges_fn)(VkDevice, uint32_t, const VkMappedMemoryRange*);
+static VkResult translate_ranges(xeno_device_t* dev, uint32_t count, const VkMappedMemoryRange* ranges, ranges_fn fn) {
+    VkMappedMemoryRange stack[16], *t = count <= 16 ? stack : malloc(count * sizeof(*t));
+    if (!t) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    for (uint32_t i = 0; i < count; ++i) {
+        t[i] = ranges[i];
+        sa_alloc_t* a = lookup(dev->suballoc, ranges[i].memory);
+        if (!a) continue;
+        t[i].memory = a->block->memory; t[i].offset += a->offset;
+        if (ranges[i].size == VK_WHOLE_SIZE) t[i].size = a->size - ranges[i].offset; /* a->size keeps the end atom aligned */
+    }
+    VkResult r = fn(dev->handle, count, t);
+    if (t != stack) free(t);
+    return r;
+}
+static VKAPI_ATTR VkResult VKAPI_CALL sa_vkFlushMappedMemoryRanges(VkDevice device, uint32_t memoryRangeCount, const VkMappedMemoryRange* pMemoryRanges) {
+    xeno_device_t* dev = xeno_device_get(device);
+    return translate_ranges(dev, memoryRangeCount, pMemoryRanges, dev->vk.vkFlushMappedMemoryRanges);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL sa_vkInvalidateMappedMemoryRanges(VkDevice device, uint32_t memoryRangeCount, const VkMappedMemoryRange* pMemoryRanges) {
+    xeno_device_t* dev = xeno_device_get(device);
+    return translate_ranges(dev, memoryRangeCount, pMemoryRanges, dev->vk.vkInvalidateMappedMemoryRanges);
+}
+
+static VKAPI_ATTR uint64_t VKAPI_CALL sa_vkGetDeviceMemoryOpaqueCaptureAddress(VkDevice device, const VkDeviceMemoryOpaqueCaptureAddressInfo* pInfo) {
+    xeno_device_t* dev = xeno_device_get(device);
+    return lookup(dev->suballoc, pInfo->memory) ? 0 : dev->vk.vkGetDeviceMemoryOpaqueCaptureAddress(device, pInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL sa_vkSetDeviceMemoryPriorityEXT(VkDevice device, VkDeviceMemory memory, float priority) {
+    xeno_device_t* dev = xeno_device_get(device);
+    if (!lookup(dev->suballoc, memory)) dev->vk.vkSetDeviceMemoryPriorityEXT(device, memory, priority);
+}
+
+static VKAPI_ATTR void VKAPI_CALL sa_vkGetDeviceMemoryCommitment(VkDevice device, VkDeviceMemory memory, VkDeviceSize* pCommittedMemoryInBytes) {
+    xeno_device_t* dev = xeno_device_get(device);
+    sa_alloc_t* a = lookup(dev->suballoc, memory);
+    if (a) *pCommittedMemoryInBytes = a->size; /* lazily allocated types are never suballocated */
+    else dev->vk.vkGetDeviceMemoryCommitment(device, memory, pCommittedMemoryInBytes);
+}
+
+/* --- binding --- */
+#define TRANSLATE(mem, off) do { sa_alloc_t* a = lookup(dev->suballoc, (mem)); \
+        if (a) { uint64_t at; (mem) = pin(dev->suballoc, a, &at)->memory; (off) += at; } } while (0)
+
+static VKAPI_ATTR VkResult VKAPI_CALL sa_vkBindBufferMemory(VkDevice device, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize memoryOffset) {
+    xeno_device_t* dev = xeno_device_get(device);
+    TRANSLATE(memory, memoryOffset);
+    return dev->vk.vkBindBufferMemory(device, buffer, memory, memoryOffset);
+}
+static VKAPI_ATTR VkResult VKAPI_CALL sa_vkBindImageMemory(VkDevice device, VkImage image, VkDeviceMemory memory, VkDeviceSize memoryOffset) {
+    xeno_device_t* dev = xeno_device_get(device);
+    TRANSLATE(memory, memoryOffset);
+    return dev->vk.vkBindImageMemory(device, image, memory, memoryOffset);
+}
+
+#define BIND2(name, info_type) \
+static VKAPI_ATTR VkResult VKAPI_CALL sa_##name(VkDevice device, uint32_t bindInfoCount, const info_type* pBindInfos) { \
+    xeno_device_t* dev = xeno_device_get(device); \
+    info_type stack[16], *t = bindInfoCount <= 16 ? stack : malloc(bindInfoCount * sizeof(*t)); \
+    if (!t) return VK_ERROR_OUT_OF_HOST_MEMORY; \
+    for (uint32_t i = 0; i < bindInfoCount; ++i) { \
+        t[i] = pBindInfos[i]; \
+        TRANSLATE(t[i].memory, t[i].memoryOffset); \
+    } \
+    VkResult r = dev->vk.name(device, bindInfoCount, t); \
+    if (t != stack) free(t); \
+    return r; \
+}
+BIND2(vkBindBufferMemory2, VkBindBufferMemoryInfo)
+BIND2(vkBindImageMemory2, VkBindImageMemoryInfo)
+BIND2(vkBindAccelerationStructureMemoryNV, VkBindAccelerationStructureMemoryInfoNV)
+#undef BIND2
+
+static VKAPI_ATTR VkResult VKAPI_CALL sa_vkBindVideoSessionMemoryKHR(VkDevice device, VkVideoSessionKHR videoSession, uint32_t bindSessionMemoryInfoCount,
+                                                                     const VkBindVideoSessionMemoryInfoKHR* pBindSessionMemoryInfos) {
+    xeno_device_t* dev = xeno_device_get(device);
+    VkBindVideoSessionMemoryInfoKHR stack[16], *t = bindSessionMemoryInfoCount <= 16 ? stack : malloc(bindSessionMemoryInfoCount * sizeof(*t));
+    if (!t) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    for (uint32_t i = 0; i < bindSessionMemoryInfoCount; ++i) {
+        t[i] = pBindSessionMemoryInfos[i];
+        TRANSLATE(t[i].memory, t[i].memoryOffset);
+    }
+    VkResult r = dev->vk.vkBindVideoSessionMemoryKHR(device, videoSession, bindSessionMemoryInfoCount, t);
+    if (t != stack) free(t);
+    return r;
+}
+
+/* Sparse binds: the bind lists are copied into one allocation with their memory translated */
+static void* take(char** cursor, const void* src, size_t size) {
+    void* p = *cursor; if (size) memcpy(p, src, size);
+    *cursor += (size + 7) & ~(size_t)7;
+    return p;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL sa_vkQueueBindSparse(VkQueue queue, uint32_t bindInfoCount, const VkBindSparseInfo* pBindInfo, VkFence fence) {
+    xeno_device_t* dev = xeno_queue_device(queue);
+    size_t bytes = bindInfoCount * sizeof(VkBindSparseInfo) + 8;
+    for (uint32_t i = 0; i < bindInfoCount; ++i) {
+        const VkBindSparseInfo* b = &pBindInfo[i];
+        bytes += b->bufferBindCount * sizeof(VkSparseBufferMemoryBindInfo) + b->imageOpaqueBindCount * sizeof(VkSparseImageOpaqueMemoryBindInfo) +
+                 b->imageBindCount * sizeof(VkSparseImageMemoryBindInfo) + 24;
+        for (uint32_t j = 0; j < b->bufferBindCount; ++j) bytes += b->pBufferBinds[j].bindCount * sizeof(VkSparseMemoryBind) + 8;
+        for (uint32_t j = 0; j < b->imageOpaqueBindCount; ++j) bytes += b->pImageOpaqueBinds[j].bindCount * sizeof(VkSparseMemoryBind) + 8;
+        for (uint32_t j = 0; j < b->imageBindCount; ++j) bytes += b->pImageBinds[j].bindCount * sizeof(VkSparseImageMemoryBind) + 8;
+    }
+    char* arena = malloc(bytes), *cur = arena;
+    if (!arena) return VK_ERROR_OUT_OF_HOST_MEMORY;
+    VkBindSparseInfo* infos = take(&cur, pBindInfo, bindInfoCount * sizeof(*infos));
+    for (uint32_t i = 0; i < bindInfoCount; ++i) {
+        VkBindSparseInfo* b = &infos[i];
+        VkSparseBufferMemoryBindInfo* bb = take(&cur, b->pBufferBinds, b->bufferBindCount * sizeof(*bb));
+        for (uint32_t j = 0; j < b->bufferBindCount; ++j) {
+            VkSparseMemoryBind* m = take(&cur, bb[j].pBinds, bb[j].bindCount * sizeof(*m));
+            for (uint32_t k = 0; k < bb[j].bindCount; ++k) TRANSLATE(m[k].memory, m[k].memoryOffset);
+            bb[j].pBinds = m;
+        }
+        VkSparseImageOpaqueMemoryBindInfo* ob = take(&cur, b->pImageOpaqueBinds, b->imageOpaqueBindCount * sizeof(*ob));
+        for (uint32_t j = 0; j < b->imageOpaqueBindCount; ++j) {
+            VkSparseMemoryBind* m = take(&cur, ob[j].pBinds, ob[j].bindCount * sizeof(*m));
+            for (uint32_t k = 0; k < ob[j].bindCount; ++k) TRANSLATE(m[k].memory, m[k].memoryOffset);
+            ob[j].pBinds = m;
+        }
+        VkSparseImageMemoryBindInfo* ib = take(&cur, b->pImageBinds, b->imageBindCount * sizeof(*ib));
+        for (uint32_t j = 0; j < b->imageBindCount; ++j) {
+            VkSparseImageMemoryBind* m = take(&cur, ib[j].pBinds, ib[j].bindCount * sizeof(*m));
+            for (uint32_t k = 0; k < ib[j].bindCount; ++k) TRANSLATE(m[k].memory, m[k].memoryOffset);
+            ib[j].pBinds = m;
+        }
+        b->pBufferBinds = bb; b->pImageOpaqueBinds = ob; b->pImageBinds = ib;
+    }
+    VkResult r = dev->vk.vkQueueBindSparse(queue, bindInfoCount, infos, fence);
+    free(arena);
+    return r;
+}
+#undef TRANSLATE
+
+/* --- alignment learning: placement has to satisfy whatever resource is bound later --- */
+static void learn(xeno_device_t* dev, const VkMemoryRequirements* req) {
+    xeno_suballoc_device_t* sd = dev->suballoc;
+    for (uint32_t t = 0; t < dev->memory.memoryTypeCount; ++t)
+        if (req->memoryTypeBits & (1u << t)) atomic_max(&sd->align[t], req->alignment);
+}
+static VKAPI_ATTR void VKAPI_CALL sa_vkGetBufferMemoryRequirements(VkDevice device, VkBuffer buffer, VkMemoryRequirements* pMemoryRequirements) {
+    xeno_device_t* dev = xeno_device_get(device);
+    dev->vk.vkGetBufferMemoryRequirements(device, buffer, pMemoryRequirements);
+    learn(dev, pMemoryRequirements);
+}
+static VKAPI_ATTR void VKAPI_CALL sa_vkGetImageMemoryRequirements(VkDevice device, VkImage image, VkMemoryRequirements* pMemoryRequirements) {
+    xeno_device_t* dev = xeno_device_get(device);
+    dev->vk.vkGetImageMemoryRequirements(device, image, pMemoryRequirements);
+    learn(dev, pMemoryRequirements);
+}
+static VKAPI_ATTR void VKAPI_CALL sa_vkGetBufferMemoryRequirements2(VkDevice device, const VkBufferMemoryRequirementsInfo2* pInfo, VkMemoryRequirements2* pMemoryRequirements) {
+    xeno_device_t* dev = xeno_device_get(device);
+    dev->vk.vkGetBufferMemoryRequirements2(device, pInfo, pMemoryRequirements);
+    learn(dev, &pMemoryRequirements->memoryRequirements);
+}
+static VKAPI_ATTR void VKAPI_CALL sa_vkGetImageMemoryRequirements2(VkDevice device, const VkImageMemoryRequirementsInfo2* pInfo, VkMemoryRequirements2* pMemoryRequirements) {
+    xeno_device_t* dev = xeno_device_get(device);
+    dev->vk.vkGetImageMemoryRequirements2(device, pInfo, pMemoryRequirements);
+    learn(dev, &pMemoryRequirements->memoryRequirements);
+}
+
+/* --- defragmentation, one run per presented frame --- */
+typedef struct { xeno_device_t* dev; uint64_t budget; } sa_move_ctx_t;
+
+/* frees emptied draining blocks; the first one regardless of the budget so progress is guaranteed */
+static uint64_t retire(xeno_device_t* dev, sa_pool_t* pool, uint64_t budget) {
+    xeno_suballoc_device_t* sd = dev->suballoc;
+    uint64_t spent = 0;
+    for (sa_block_t** b = &pool->blocks; *b;) {
+        sa_block_t* cur = *b;
+        if (cur->draining && pool->count == 1) cur->draining = 0;
+        if (!cur->draining || xeno_tlsf_ranges(cur->tlsf)) { b = &cur->next; continue; }
+        if (spent && spent + cur->size > budget) { atomic_fetch_add(&sd->retire_deferred, 1); break; }
+        *b = cur->next; pool->count--; spent += cur->size;
+        atomic_fetch_add(&sd->retired_blocks, 1); atomic_fetch_add(&sd->retired_bytes, cur->size);
+        free_block(dev, cur);
+    }
+    return spent;
+}
+
+/* at most one draining block per pool, so draining costs at most one extra block */
+static void pick(xeno_suballoc_device_t* sd, sa_pool_t* pool, uint64_t tick) {
+    sa_block_t* best = NULL; uint64_t best_used = 0;
+    for (sa_block_t* b = pool->blocks; b; b = b->next) {
+        if (!b->draining) continue;
+        if (tick - b->drain_tick < DRAIN_PATIENCE) return;
+        b->draining = 0; /* pinned suballocations keep it from emptying: try another block */
+        atomic_fetch_add(&sd->abandoned_blocks, 1);
+    }
+    if (pool->count < 2) return;
+    for (sa_block_t* b = pool->blocks; b; b = b->next) {
+        uint64_t used = xeno_tlsf_used(b->tlsf);
+        if (b->drain_tick && tick - b->drain_tick < 2 * DRAIN_PATIENCE) continue;
+        if (used * 100 < b->size * sd->defrag_pct && (!best || used < best_used)) { best = b; best_used = used; }
+    }
+    if (!best) return;
+    best->draining = 1; best->drain_tick = tick;
+    atomic_fetch_add(&sd->drained_blocks, 1);
+}
+
+/* moves an unpinned suballocation out of a draining block; nothing reads it, so no copy is needed */
+static int move_one(uint64_t key, void* val, void* ctx) {
+    sa_move_ctx_t* m = ctx; sa_alloc_t* a = val;
+    xeno_suballoc_device_t* sd = m->dev->suballoc; sa_pool_t* pool = a->pool;
+    if (!m->budget) return 0;
+    pthread_mutex_lock(&pool->lock);
+    sa_block_t* from = a->block;
+    if (from->draining && !a->pinned && a->size <= m->budget) {
+        uint64_t gran = sd->granularity[pool->type], align = atomic_load(&sd->align[pool->type]), offset;
+        if (align < gran) align = gran;
+        for (sa_block_t* b = pool->blocks; b; b = b->next) {
+            xeno_tlsf_range_t* r;
+            if (b->draining || !(r = xeno_tlsf_alloc(b->tlsf, a->size, align, &offset))) continue;
+            xeno_tlsf_free(from->tlsf, a->range); from->movable--;
+            a->block = b; a->range = r; a->offset = offset; b->movable++;
+            m->budget -= a->size;
+            atomic_fetch_add(&sd->moved, 1); atomic_fetch_add(&sd->moved_bytes, a->size);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+static void defrag_run(void* ctx) {
+    xeno_device_t* dev = ctx; xeno_suballoc_device_t* sd = dev->suballoc;
+    atomic_store(&sd->tick_queued, 0);
+    uint64_t tick = atomic_fetch_add(&sd->ticks, 1) + 1, budget = sd->defrag_budget;
+    int movable = 0;
+    for (uint32_t p = 0; p < POOL_COUNT; ++p) {
+        sa_pool_t* pool = &sd->pools[p];
+        pthread_mutex_lock(&pool->lock);
+        if (pool->blocks) {
+            uint64_t spent = retire(dev, pool, budget);
+            budget = spent < budget ? budget - spent : 0;
+            pick(sd, pool, tick);
+            for (sa_block_t* b = pool->blocks; b; b = b->next) if (b->draining && b->movable) movable = 1;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    if (movable && budget) {
+        sa_move_ctx_t m = { dev, budget };
+        xeno_map_foreach(&sd->allocs, move_one, &m);
+    }
+    atomic_fetch_sub(&sd->pending, 1);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL sa_vkQueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* pPresentInfo) {
+    xeno_device_t* dev = xeno_queue_device(queue); xeno_suballoc_device_t* sd = dev->suballoc;
+    VkResult r = dev->vk.vkQueuePresentKHR(queue, pPresentInfo);
+    int expected = 0;
+    if (atomic_compare_exchange_strong(&sd->tick_queued, &expected, 1)) { /* a run still queued covers this frame too */
+        atomic_fetch_add(&sd->pending, 1);
+        if (xeno_workers_submit(defrag_run, dev) != 0) defrag_run(dev);
+    }
+    return r;
+}
+
+/* --- device lifetime / routing --- */
+int xeno_suballoc_init(xeno_device_t* dev) {
+    if (!xeno_env_bool("XCLIPSE_SUBALLOC", 0)) return 0;
+    if (!dev->memory.memoryTypeCount || !dev->vk.vkAllocateMemory || !dev->vk.vkFreeMemory || !dev->vk.vkMapMemory ||
+        !dev->vk.vkBindBufferMemory || !dev->vk.vkBindImageMemory) return -1;
+    xeno_suballoc_device_t* sd = calloc(1, sizeof(*sd)); if (!sd) return -1;
+    uint64_t block = (uint64_t)xeno_env_long("XCLIPSE_SUBALLOC_BLOCK_MB", 64) << 20;
+    uint64_t atom = dev->limits.nonCoherentAtomSize ? dev->limits.nonCoherentAtomSize : 1;
+    uint64_t gran = dev->limits.bufferImageGranularity ? dev->limits.bufferImageGranularity : 1;
+    for (uint32_t t = 0; t < dev->memory.memoryTypeCount; ++t) {
+        const VkMemoryType* mt = &dev->memory.memoryTypes[t];
+        uint64_t heap = dev->memory.memoryHeaps[mt->heapIndex].size / 8, size = block < heap ? block : heap;
+        size &= ~((1ull << 20) - 1);
+        if (mt->propertyFlags & (VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT | VK_MEMORY_PROPERTY_PROTECTED_BIT)) size = 0;
+        sd->block_size[t] = size;
+        sd->granularity[t] = gran;
+        if ((mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) && !(mt->propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) && atom > gran)
+            sd->granularity[t] = align_up(atom, gran);
+        atomic_init(&sd->align[t], MIN_ALIGN);
+    }
+    for (uint32_t p = 0; p < POOL_COUNT; ++p) {
+        pthread_mutex_init(&sd->pools[p].lock, NULL);
+        sd->pools[p].type = p % VK_MAX_MEMORY_TYPES;
+        sd->pools[p].flags = p >= VK_MAX_MEMORY_TYPES ? VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT : 0;
+    }
+    xeno_map_init(&sd->allocs, 4096);
+    sd->defrag = xeno_env_bool("XCLIPSE_SUBALLOC_DEFRAG", 0) && dev->vk.vkQueuePresentKHR;
+    long pct = xeno_env_long("XCLIPSE_SUBALLOC_DEFRAG_PCT", 25), mb = xeno_env_long("XCLIPSE_SUBALLOC_DEFRAG_MB", 64);
+    sd->defrag_pct = pct < 1 ? 1 : pct > 90 ? 90 : (uint32_t)pct;
+    sd->defrag_budget = (uint64_t)(mb < 1 ? 1 : mb) << 20;
+    dev->suballoc = sd;
+    xlog("suballoc: enabled block=%" PRIu64 "MB defrag=%d", block >> 20, sd->defrag);
+    return 0;
+}
+
+static int free_alloc(uint64_t key, void* val, void* ctx) { free(val); return 1; }
+
+void xeno_suballoc_destroy(xeno_device_t* dev) {
+    xeno_suballoc_device_t* sd = dev->suballoc;
+    if (!sd) return;
+    while (atomic_load(&sd->pending)) sched_yield();
+    xeno_map_foreach(&sd->allocs, free_alloc, NULL); /* memory the app never freed dies with the device */
+    xeno_map_destroy(&sd->allocs);
+    for (uint32_t p = 0; p < POOL_COUNT; ++p) {
+        for (sa_block_t* b = sd->pools[p].blocks; b;) { sa_block_t* n = b->next; free_block(dev, b); b = n; }
+        pthread_mutex_destroy(&sd->pools[p].lock);
+    }
+    dev->suballoc = NULL;
+    free(sd);
+}
+
+uint64_t xeno_suballoc_trim(xeno_device_t* dev) {
+    xeno_suballoc_device_t* sd = dev->suballoc;
+    uint64_t released = 0;
+    if (!sd) return 0;
+    for (uint32_t p = 0; p < POOL_COUNT; ++p) {
+        sa_pool_t* pool = &sd->pools[p];
+        pthread_mutex_lock(&pool->lock);
+        for (sa_block_t** b = &pool->blocks; *b;) {
+            sa_block_t* cur = *b;
+            if (xeno_tlsf_ranges(cur->tlsf)) { b = &cur->next; continue; }
+            *b = cur->next; pool->count--; released += cur->size;
+            free_block(dev, cur);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return released;
+}
+
+PFN_vkVoidFunction xeno_suballoc_proc(xeno_device_t* dev, const char* name) {
+    if (!dev->suballoc) return NULL;
+#define HOOK(fn) if (strcmp(name, #fn) == 0) return (PFN_vkVoidFunction)sa_##fn;
+#define HOOK_OPT(fn, alias) if (dev->vk.fn && (strcmp(name, #fn) == 0 || strcmp(name, alias) == 0)) return (PFN_vkVoidFunction)sa_##fn;
+    HOOK(vkAllocateMemory) HOOK(vkFreeMemory) HOOK(vkMapMemory) HOOK(vkBindBufferMemory) HOOK(vkBindImageMemory)
+    if (dev->vk.vkUnmapMemory) HOOK(vkUnmapMemory)
+    if (dev->vk.vkFlushMappedMemoryRanges) HOOK(vkFlushMappedMemoryRanges)
+    if (dev->vk.vkInvalidateMappedMemoryRanges) HOOK(vkInvalidateMappedMemoryRanges)
+    if (dev->vk.vkGetDeviceMemoryCommitment) HOOK(vkGetDeviceMemoryCommitment)
+    if (dev->vk.vkGetBufferMemoryRequirements) HOOK(vkGetBufferMemoryRequirements)
+    if (dev->vk.vkGetImageMemoryRequirements) HOOK(vkGetImageMemoryRequirements)
+    if (dev->vk.vkQueueBindSparse) HOOK(vkQueueBindSparse)
+    if (dev->vk.vkSetDeviceMemoryPriorityEXT) HOOK(vkSetDeviceMemoryPriorityEXT)
+    if (dev->vk.vkBindVideoSessionMemoryKHR) HOOK(vkBindVideoSessionMemoryKHR)
+    if (dev->vk.vkBindAccelerationStructureMemoryNV) HOOK(vkBindAccelerationStructureMemoryNV)
+    HOOK_OPT(vkGetDeviceMemoryOpaqueCaptureAddress, "vkGetDeviceMemoryOpaqueCaptureAddressKHR")
+    HOOK_OPT(vkMapMemory2, "vkMapMemory2KHR") HOOK_OPT(vkUnmapMemory2, "vkUnmapMemory2KHR")
+    HOOK_OPT(vkBindBufferMemory2, "vkBindBufferMemory2KHR") HOOK_OPT(vkBindImageMemory2, "vkBindImageMemory2KHR")
+    HOOK_OPT(vkGetBufferMemoryRequirements2, "vkGetBufferMemoryRequirements2KHR")
+    HOOK_OPT(vkGetImageMemoryRequirements2, "vkGetImageMemoryRequirements2KHR")
+    if (dev->suballoc->defrag) HOOK(vkQueuePresentKHR)
+#undef HOOK_OPT
+#undef HOOK
+    return NULL;
+}
+
+void xeno_suballoc_report(FILE* f, xeno_device_t* dev) {
+    xeno_suballoc_device_t* sd = dev->suballoc;
+    fprintf(f, "  \"suballoc\": {\"enabled\": %s", sd ? "true" : "false");
+    if (sd) {
+        /* fragmentation: share of the free space that lies outside its block's largest free range */
+        uint64_t used = 0, free_bytes = 0, scattered = 0;
+        for (uint32_t p = 0; p < POOL_COUNT; ++p) {
+            pthread_mutex_lock(&sd->pools[p].lock);
+            for (sa_block_t* b = sd->pools[p].blocks; b; b = b->next) {
+                uint64_t u = xeno_tlsf_used(b->tlsf), l = xeno_tlsf_largest_free(b->tlsf);
+                used += u; free_bytes += b->size - u; scattered += b->size - u - l;
+            }
+            pthread_mutex_unlock(&sd->pools[p].lock);
+        }
+        uint64_t sub = atomic_load(&sd->suballocated), pass = atomic_load(&sd->passthrough);
+        fprintf(f, ", \"requests\": %" PRIu64 ", \"suballocated\": %" PRIu64 ", \"passthrough\": %" PRIu64 ", \"block_fallbacks\": %" PRIu64,
+                atomic_load(&sd->requests), sub, pass, atomic_load(&sd->block_fallbacks));
+        fprintf(f, ", \"driver_allocs\": %" PRIu64 ", \"peak_driver_allocs\": %" PRIu64 ", \"blocks\": %" PRIu64 ", \"block_bytes\": %" PRIu64 ", \"used_bytes\": %" PRIu64,
+                atomic_load(&sd->driver_allocs), atomic_load(&sd->peak_driver_allocs), atomic_load(&sd->blocks), atomic_load(&sd->block_bytes), used);
+        fprintf(f, ", \"fragmentation\": %.3f, \"avg_suballoc_ns\": %" PRIu64 ", \"max_suballoc_ns\": %" PRIu64 ", \"avg_passthrough_ns\": %" PRIu64,
+                free_bytes ? (double)scattered / (double)free_bytes : 0.0, sub ? atomic_load(&sd->sub_ns) / sub : 0,
+                atomic_load(&sd->sub_ns_max), pass ? atomic_load(&sd->pass_ns) / pass : 0);
+        fprintf(f, ", \"defrag\": %s", sd->defrag ? "true" : "false");
+        if (sd->defrag)
+            fprintf(f, ", \"defrag_runs\": %" PRIu64 ", \"drained_blocks\": %" PRIu64 ", \"abandoned_blocks\": %" PRIu64 ", \"moved\": %" PRIu64 ", \"moved_bytes\": %" PRIu64
+                       ", \"retired_blocks\": %" PRIu64 ", \"retired_bytes\": %" PRIu64 ", \"retire_deferred\": %" PRIu64,
+                    atomic_load(&sd->ticks), atomic_load(&sd->drained_blocks), atomic_load(&sd->abandoned_blocks), atomic_load(&sd->moved),
+                    atomic_load(&sd->moved_bytes), atomic_load(&sd->retired_blocks), atomic_load(&sd->retired_bytes), atomic_load(&sd->retire_deferred));
+    }
+    fprintf(f, "}");
+}
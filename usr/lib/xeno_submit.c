@@ -0,0 +1,546 @@
+/* xeno_submit.c - coalescing of a frame's queue submits
+ *
+ * Ports commonly submit 10-30 times per frame to the same queue, a kernel round trip each. With
+ * XCLIPSE_SUBMIT_BATCH=1 submits nothing outside the queue can observe yet are held back and go to
+ * the driver together, as the batches of a single vkQueueSubmit2 (of a single vkQueueSubmit when
+ * the app did not enable synchronization2). Every batch keeps its waits, command buffers, signals
+ * and position, so semaphores and fences behave as with the original calls.
+ *
+ * A queue's held batches are flushed:
+ *  - at vkQueuePresentKHR, on every queue of the device;
+ *  - by a submit carrying a fence, which goes out with them: fences are always submitted;
+ *  - before a submit to another queue waits for a semaphore one of them signals;
+ *  - before the host waits for or exports GPU progress: vkQueueWaitIdle, vkDeviceWaitIdle,
+ *    vkWaitSemaphores, vkGetSemaphoreFdKHR, vkGetQueryPoolResults with WAIT, and before
+ *    vkQueueBindSparse on the queue;
+ *  - once the oldest has been held for XCLIPSE_SUBMIT_BATCH_LATENCY_US, checked on every call the
+ *    module sees, polls of semaphore counters, events and query results included.
+ * Submits with extension structs the module does not translate (device groups, performance
+ * queries, ...) flush the queue and reach the driver as they are.
+ *
+ * A held submit returns VK_SUCCESS; an error of the driver call that carries it is returned by the
+ * call that flushed it. Held batches may be flushed from any thread reaching a flush point, under
+ * a per-queue lock every queue entrypoint takes: debug utils labels are hooked for it alone, the
+ * INTEL performance configuration and NV out-of-band calls flush the queue first. A driver
+ * exposing a queue entrypoint the module does not know keeps batching off.
+ *
+ * Knobs:
+ *   XCLIPSE_SUBMIT_BATCH=1               hold back and merge submits
+ *   XCLIPSE_SUBMIT_BATCH_LATENCY_US=N    longest a submit is held (default 2000)
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+enum { FLUSH_PRESENT, FLUSH_FENCE, FLUSH_CROSS_QUEUE, FLUSH_HOST, FLUSH_LATENCY, FLUSH_PASSTHROUGH, FLUSH_REASONS };
+static const char* flush_names[FLUSH_REASONS] = { "present", "fence", "cross_queue", "host", "latency", "passthrough" };
+
+typedef struct sb_batch {
+    VkSubmitFlags flags;
+    int timeline;                   /* values matter: a legacy submit carried VkTimelineSemaphoreSubmitInfo */
+    uint32_t wait_first, wait_count, cb_first, cb_count, signal_first, signal_count;
+} sb_batch_t;
+
+typedef struct sb_legacy { VkTimelineSemaphoreSubmitInfo timeline; VkProtectedSubmitInfo protect; } sb_legacy_t;
+
+typedef struct sb_queue {
+    VkQueue handle;
+    struct sb_queue* next;
+    pthread_mutex_t lock;           /* host access to the queue through the module */
+    _Atomic uint64_t since;         /* arrival of the oldest held batch, 0 when none is held */
+    sb_batch_t* batches; uint32_t count, batch_cap;
+    VkSemaphoreSubmitInfo* sems; uint32_t sem_count, sem_cap;
+    VkCommandBufferSubmitInfo* cbs; uint32_t cb_count, cb_cap;
+    /* flush scratch, sized with the arrays above */
+    VkSubmitInfo2* infos;
+    VkSubmitInfo* legacy_infos; sb_legacy_t* legacy;
+    VkSemaphore* sem_handles; VkPipelineStageFlags* sem_stages; uint64_t* sem_values;
+    VkCommandBuffer* cb_handles;
+} sb_queue_t;
+
+#define SB_HOOKS(X) \
+    X(vkQueueSubmit) X(vkQueueSubmit2) X(vkQueuePresentKHR) X(vkQueueWaitIdle) X(vkDeviceWaitIdle) X(vkQueueBindSparse) \
+    X(vkWaitSemaphores) X(vkGetSemaphoreCounterValue) X(vkGetSemaphoreFdKHR) X(vkGetEventStatus) X(vkGetQueryPoolResults) \
+    X(vkQueueBeginDebugUtilsLabelEXT) X(vkQueueEndDebugUtilsLabelEXT) X(vkQueueInsertDebugUtilsLabelEXT) \
+    X(vkQueueSetPerformanceConfigurationINTEL) X(vkQueueNotifyOutOfBandNV)
+
+/* queue entrypoints with no hook here: another thread flushing the queue could be in the driver with it */
+static const char* sb_unseen[] = { "vkQueueSignalReleaseImageANDROID" };
+
+typedef struct xeno_submit_device {
+#define SB_NEXT(fn) PFN_##fn next_##fn;
+    SB_HOOKS(SB_NEXT)
+#undef SB_NEXT
+    int sync2;
+    uint64_t latency_ns;
+    pthread_mutex_t lock;           /* queue list inserts */
+    _Atomic(sb_queue_t*) queues;
+    _Atomic uint64_t app_submits, driver_submits, held, frames, errors, flushes[FLUSH_REASONS];
+    _Atomic uint64_t frame_app, frame_driver, max_app, max_driver;  /* the current frame, the busiest one */
+} xeno_submit_device_t;
+
+static void atomic_max(_Atomic uint64_t* v, uint64_t x) {
+    uint64_t cur = atomic_load(v);
+    while (x > cur && !atomic_compare_exchange_weak(v, &cur, x)) {}
+}
+
+static sb_queue_t* queue_get(xeno_submit_device_t* sd, VkQueue queue) {
+    for (sb_queue_t* q = atomic_load_explicit(&sd->queues, memory_order_acquire); q; q = q->next) if (q->handle == queue) return q;
+    pthread_mutex_lock(&sd->lock);
+    sb_queue_t* q = atomic_load(&sd->queues);
+    while (q && q->handle != queue) q = q->next;
+    if (!q && (q = calloc(1, sizeof(*q)))) {
+        q->handle = queue;
+        pthread_mutex_init(&q->lock, NULL);
+        q->next = atomic_load(&sd->queues);
+        atomic_store_explicit(&sd->queues, q, memory_order_release);
+    }
+    pthread_mutex_unlock(&sd->lock);
+    return q;
+}
+
+static int grow(void** p, uint32_t cap, size_t elem) {
+    void* n = realloc(*p, cap * elem);
+    if (!n) return -1;
+    *p = n; return 0;
+}
+
+/* room for the batches, semaphores and command buffers of a call, so appending cannot fail half way */
+static int reserve(sb_queue_t* q, uint32_t batches, uint32_t sems, uint32_t cbs) {
+    if (q->count + batches > q->batch_cap) {
+        uint32_t cap = q->batch_cap ? q->batch_cap : 16;
+        while (cap < q->count + batches) cap *= 2;
+        if (grow((void**)&q->batches, cap, sizeof(*q->batches)) || grow((void**)&q->infos, cap, sizeof(*q->infos)) ||
+            grow((void**)&q->legacy_infos, cap, sizeof(*q->legacy_infos)) || grow((void**)&q->legacy, cap, sizeof(*q->legacy))) return -1;
+        q->batch_cap = cap;
+    }
+    if (q->sem_count + sems > q->sem_cap) {
+        uint32_t cap = q->sem_cap ? q->sem_cap : 32;
+        while (cap < q->sem_count + sems) cap *= 2;
+        if (grow((void**)&q->sems, cap, sizeof(*q->sems)) || grow((void**)&q->sem_handles, cap, sizeof(*q->sem_handles)) ||
+            grow((void**)&q->sem_stages, cap, sizeof(*q->sem_stages)) || grow((void**)&q->sem_values, cap, sizeof(*q->sem_values))) return -1;
+        q->sem_cap = cap;
+    }
+    if (q->cb_count + cbs > q->cb_cap) {
+        uint32_t cap = q->cb_cap ? q->cb_cap : 64;
+        while (cap < q->cb_count + cbs) cap *= 2;
+        if (grow((void**)&q->cbs, cap, sizeof(*q->cbs)) || grow((void**)&q->cb_handles, cap, sizeof(*q->cb_handles))) return -1;
+        q->cb_cap = cap;
+    }
+    return 0;
+}
+
+/* --- flushing --- */
+static void count_driver_submit(xeno_submit_device_t* sd) {
+    atomic_fetch_add_explicit(&sd->driver_submits, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sd->frame_driver, 1, memory_order_relaxed);
+}
+
+static VkResult submit_legacy(xeno_submit_device_t* sd, sb_queue_t* q, VkFence fence) {
+    for (uint32_t i = 0; i < q->sem_count; ++i) {
+        q->sem_handles[i] = q->sems[i].semaphore;
+        q->sem_stages[i] = (VkPipelineStageFlags)q->sems[i].stageMask;
+        q->sem_values[i] = q->sems[i].value;
+    }
+    for (uint32_t i = 0; i < q->cb_count; ++i) q->cb_handles[i] = q->cbs[i].commandBuffer;
+    for (uint32_t i = 0; i < q->count; ++i) {
+        const sb_batch_t* b = &q->batches[i]; sb_legacy_t* l = &q->legacy[i];
+        const void* chain = NULL;
+        if (b->timeline) {
+            l->timeline = (VkTimelineSemaphoreSubmitInfo){ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO, chain,
+                b->wait_count, q->sem_values + b->wait_first, b->signal_count, q->sem_values + b->signal_first };
+            chain = &l->timeline;
+        }
+        if (b->flags & VK_SUBMIT_PROTECTED_BIT) {
+            l->protect = (VkProtectedSubmitInfo){ VK_STRUCTURE_TYPE_PROTECTED_SUBMIT_INFO, chain, VK_TRUE };
+            chain = &l->protect;
+        }
+        q->legacy_infos[i] = (VkSubmitInfo){ VK_STRUCTURE_TYPE_SUBMIT_INFO, chain,
+            b->wait_count, q->sem_handles + b->wait_first, q->sem_stages + b->wait_first,
+            b->cb_count, q->cb_handles + b->cb_first, b->signal_count, q->sem_handles + b->signal_first };
+    }
+    return sd->next_vkQueueSubmit(q->handle, q->count, q->legacy_infos, fence);
+}
+
+/* q->lock held; the fence, if any, goes out with the held batches even when there are none */
+static VkResult flush_locked(xeno_submit_device_t* sd, sb_queue_t* q, VkFence fence, int reason) {
+    if (!q->count && !fence) return VK_SUCCESS;
+    VkResult r;
+    if (sd->sync2) {
+        for (uint32_t i = 0; i < q->count; ++i) {
+            const sb_batch_t* b = &q->batches[i];
+            q->infos[i] = (VkSubmitInfo2){ VK_STRUCTURE_TYPE_SUBMIT_INFO_2, NULL, b->flags,
+                b->wait_count, q->sems + b->wait_first, b->cb_count, q->cbs + b->cb_first, b->signal_count, q->sems + b->signal_first };
+        }
+        r = sd->next_vkQueueSubmit2(q->handle, q->count, q->infos, fence);
+    } else {
+        r = submit_legacy(sd, q, fence);
+    }
+    count_driver_submit(sd);
+    if (q->count) atomic_fetch_add_explicit(&sd->flushes[reason], 1, memory_order_relaxed);
+    if (r != VK_SUCCESS) {
+        atomic_fetch_add(&sd->errors, 1);
+        xlog("submit: %u held batches on queue %p failed (%d) at a %s flush", q->count, (void*)q->handle, (int)r, flush_names[reason]);
+    }
+    q->count = q->sem_count = q->cb_count = 0;
+    atomic_store_explicit(&q->since, 0, memory_order_relaxed);
+    return r;
+}
+
+static VkResult flush_all(xeno_submit_device_t* sd, int reason) {
+    VkResult first = VK_SUCCESS;
+    for (sb_queue_t* q = atomic_load_explicit(&sd->queues, memory_order_acquire); q; q = q->next) {
+        if (!atomic_load_explicit(&q->since, memory_order_relaxed)) continue;
+        pthread_mutex_lock(&q->lock);
+        VkResult r = flush_locked(sd, q, VK_NULL_HANDLE, reason);
+        pthread_mutex_unlock(&q->lock);
+        if (first == VK_SUCCESS) first = r;
+    }
+    return first;
+}
+
+/* the latency bound, checked on every call the module sees */
+static VkResult expire(xeno_submit_device_t* sd) {
+    VkResult first = VK_SUCCESS;
+    uint64_t now = 0;
+    for (sb_queue_t* q = atomic_load_explicit(&sd->queues, memory_order_acquire); q; q = q->next) {
+        uint64_t since = atomic_load_explicit(&q->since, memory_order_relaxed);
+        if (!since) continue;
+        if (!now) now = xeno_now_ns();
+        if (now - since < sd->latency_ns) continue;
+        pthread_mutex_lock(&q->lock);
+        since = atomic_load_explicit(&q->since, memory_order_relaxed);
+        VkResult r = since && now - since >= sd->latency_ns ? flush_locked(sd, q, VK_NULL_HANDLE, FLUSH_LATENCY) : VK_SUCCESS;
+        pthread_mutex_unlock(&q->lock);
+        if (first == VK_SUCCESS) first = r;
+    }
+    return first;
+}
+
+/* binary semaphores must be signaled by a submitted batch before a wait on them is submitted */
+static VkResult release_signal(xeno_submit_device_t* sd, sb_queue_t* self, VkSemaphore semaphore) {
+    VkResult first = VK_SUCCESS;
+    for (sb_queue_t* q = atomic_load_explicit(&sd->queues, memory_order_acquire); q; q = q->next) {
+        if (q == self || !atomic_load_explicit(&q->since, memory_order_relaxed)) continue;
+        pthread_mutex_lock(&q->lock);
+        int found = 0;
+        for (uint32_t i = 0; i < q->count && !found; ++i)
+            for (uint32_t k = 0; k < q->batches[i].signal_count && !found; ++k) found = q->sems[q->batches[i].signal_first + k].semaphore == semaphore;
+        VkResult r = found ? flush_locked(sd, q, VK_NULL_HANDLE, FLUSH_CROSS_QUEUE) : VK_SUCCESS;
+        pthread_mutex_unlock(&q->lock);
+        if (first == VK_SUCCESS) first = r;
+    }
+    return first;
+}
+
+static void begin_hold(sb_queue_t* q) {
+    if (!atomic_load_explicit(&q->since, memory_order_relaxed)) atomic_store_explicit(&q->since, xeno_now_ns(), memory_order_relaxed);
+}
+
+/* --- translation into held batches --- */
+static int legacy_translatable(const VkSubmitInfo* s) {
+    for (const VkBaseInStructure* e = s->pNext; e; e = e->pNext)
+        if (e->sType != VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO && e->sType != VK_STRUCTURE_TYPE_PROTECTED_SUBMIT_INFO) return 0;
+    return 1;
+}
+
+static void append_legacy(sb_queue_t* q, const VkSubmitInfo* s) {
+    const VkTimelineSemaphoreSubmitInfo* tl = NULL;
+    sb_batch_t* b = &q->batches[q->count++];
+    memset(b, 0, sizeof(*b));
+    for (const VkBaseInStructure* e = s->pNext; e; e = e->pNext) {
+        if (e->sType == VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO) tl = (const VkTimelineSemaphoreSubmitInfo*)e;
+        else if (e->sType == VK_STRUCTURE_TYPE_PROTECTED_SUBMIT_INFO && ((const VkProtectedSubmitInfo*)e)->protectedSubmit) b->flags |= VK_SUBMIT_PROTECTED_BIT;
+    }
+    b->timeline = tl != NULL;
+    b->wait_first = q->sem_count; b->wait_count = s->waitSemaphoreCount;
+    for (uint32_t i = 0; i < s->waitSemaphoreCount; ++i)
+        q->sems[q->sem_count++] = (VkSemaphoreSubmitInfo){ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, NULL, s->pWaitSemaphores[i],
+            tl && tl->pWaitSemaphoreValues && i < tl->waitSemaphoreValueCount ? tl->pWaitSemaphoreValues[i] : 0, s->pWaitDstStageMask[i], 0 };
+    b->cb_first = q->cb_count; b->cb_count = s->commandBufferCount;
+    for (uint32_t i = 0; i < s->commandBufferCount; ++i)
+        q->cbs[q->cb_count++] = (VkCommandBufferSubmitInfo){ VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO, NULL, s->pCommandBuffers[i], 0 };
+    b->signal_first = q->sem_count; b->signal_count = s->signalSemaphoreCount;
+    for (uint32_t i = 0; i < s->signalSemaphoreCount; ++i)
+        q->sems[q->sem_count++] = (VkSemaphoreSubmitInfo){ VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO, NULL, s->pSignalSemaphores[i],
+            tl && tl->pSignalSemaphoreValues && i < tl->signalSemaphoreValueCount ? tl->pSignalSemaphoreValues[i] : 0, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, 0 };
+}
+
+static int translatable2(const VkSubmitInfo2* s) {
+    if (s->pNext) return 0;
+    for (uint32_t i = 0; i < s->waitSemaphoreInfoCount; ++i) if (s->pWaitSemaphoreInfos[i].pNext) return 0;
+    for (uint32_t i = 0; i < s->commandBufferInfoCount; ++i) if (s->pCommandBufferInfos[i].pNext) return 0;
+    for (uint32_t i = 0; i < s->signalSemaphoreInfoCount; ++i) if (s->pSignalSemaphoreInfos[i].pNext) return 0;
+    return 1;
+}
+
+static void append2(sb_queue_t* q, const VkSubmitInfo2* s) {
+    sb_batch_t* b = &q->batches[q->count++];
+    *b = (sb_batch_t){ .flags = s->flags, .timeline = 1 };
+    b->wait_first = q->sem_count; b->wait_count = s->waitSemaphoreInfoCount;
+    if (b->wait_count) memcpy(q->sems + q->sem_count, s->pWaitSemaphoreInfos, b->wait_count * sizeof(*q->sems));
+    q->sem_count += b->wait_count;
+    b->cb_first = q->cb_count; b->cb_count = s->commandBufferInfoCount;
+    if (b->cb_count) memcpy(q->cbs + q->cb_count, s->pCommandBufferInfos, b->cb_count * sizeof(*q->cbs));
+    q->cb_count += b->cb_count;
+    b->signal_first = q->sem_count; b->signal_count = s->signalSemaphoreInfoCount;
+    if (b->signal_count) memcpy(q->sems + q->sem_count, s->pSignalSemaphoreInfos, b->signal_count * sizeof(*q->sems));
+    q->sem_count += b->signal_count;
+}
+
+/* --- intercepts --- */
+static VKAPI_ATTR VkResult VKAPI_CALL sb_vkQueueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo* pSubmits, VkFence fence) {
+    xeno_submit_device_t* sd = xeno_queue_device(queue)->submit;
+    atomic_fetch_add_explicit(&sd->app_submits, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sd->frame_app, 1, memory_order_relaxed);
+    VkResult r = expire(sd);
+    sb_queue_t* q = queue_get(sd, queue);
+    int hold = q != NULL; uint32_t sems = 0, cbs = 0;
+    for (uint32_t i = 0; i < submitCount; ++i) {
+        hold = hold && legacy_translatable(&pSubmits[i]);
+        sems += pSubmits[i].waitSemaphoreCount + pSubmits[i].signalSemaphoreCount; cbs += pSubmits[i].commandBufferCount;
+        for (uint32_t k = 0; k < pSubmits[i].waitSemaphoreCount && r == VK_SUCCESS; ++k) r = release_signal(sd, q, pSubmits[i].pWaitSemaphores[k]);
+    }
+    if (r != VK_SUCCESS) return r;
+    if (!q) { count_driver_submit(sd); return sd->next_vkQueueSubmit(queue, submitCount, pSubmits, fence); }
+    pthread_mutex_lock(&q->lock);
+    if (!hold || reserve(q, submitCount, sems, cbs) != 0) {
+        r = flush_locked(sd, q, VK_NULL_HANDLE, FLUSH_PASSTHROUGH);
+        if (r == VK_SUCCESS) { count_driver_submit(sd); r = sd->next_vkQueueSubmit(queue, submitCount, pSubmits, fence); }
+    } else {
+        if (submitCount) begin_hold(q);
+        for (uint32_t i = 0; i < submitCount; ++i) append_legacy(q, &pSubmits[i]);
+        atomic_fetch_add_explicit(&sd->held, submitCount, memory_order_relaxed);
+        if (fence) r = flush_locked(sd, q, fence, FLUSH_FENCE);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL sb_vkQueueSubmit2(VkQueue queue, uint32_t submitCount, const VkSubmitInfo2* pSubmits, VkFence fence) {
+    xeno_submit_device_t* sd = xeno_queue_device(queue)->submit;
+    atomic_fetch_add_explicit(&sd->app_submits, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&sd->frame_app, 1, memory_order_relaxed);
+    VkResult r = expire(sd);
+    sb_queue_t* q = queue_get(sd, queue);
+    int hold = q != NULL && sd->sync2; uint32_t sems = 0, cbs = 0;
+    for (uint32_t i = 0; i < submitCount; ++i) {
+        hold = hold && translatable2(&pSubmits[i]);
+        sems += pSubmits[i].waitSemaphoreInfoCount + pSubmits[i].signalSemaphoreInfoCount; cbs += pSubmits[i].commandBufferInfoCount;
+        for (uint32_t k = 0; k < pSubmits[i].waitSemaphoreInfoCount && r == VK_SUCCESS; ++k) r = release_signal(sd, q, pSubmits[i].pWaitSemaphoreInfos[k].semaphore);
+    }
+    if (r != VK_SUCCESS) return r;
+    if (!q) { count_driver_submit(sd); return sd->next_vkQueueSubmit2(queue, submitCount, pSubmits, fence); }
+    pthread_mutex_lock(&q->lock);
+    if (!hold || reserve(q, submitCount, sems, cbs) != 0) {
+        r = flush_locked(sd, q, VK_NULL_HANDLE, FLUSH_PASSTHROUGH);
+        if (r == VK_SUCCESS) { count_driver_submit(sd); r = sd->next_vkQueueSubmit2(queue, submitCount, pSubmits, fence); }
+    } else {
+        if (submitCount) begin_hold(q);
+        for (uint32_t i = 0; i < submitCount; ++i) append2(q, &pSubmits[i]);
+        atomic_fetch_add_explicit(&sd->held, submitCount, memory_order_relaxed);
+        if (fence) r = flush_locked(sd, q, fence, FLUSH_FENCE);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL sb_vkQueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* pPresentInfo) {
+    xeno_submit_device_t* sd = xeno_queue_device(queue)->submit;
+    VkResult r = flush_all(sd, FLUSH_PRESENT);
+    atomic_fetch_add(&sd->frames, 1);
+    atomic_max(&sd->max_app, atomic_exchange(&sd->frame_app, 0));
+    atomic_max(&sd->max_driver, atomic_exchange(&sd->frame_driver, 0));
+    if (r != VK_SUCCESS) return r;
+    sb_queue_t* q = queue_get(sd, queue);
+    if (!q) return sd->next_vkQueuePresentKHR(queue, pPresentInfo);
+    pthread_mutex_lock(&q->lock);
+    r = sd->next_vkQueuePresentKHR(queue, pPresentInfo);
+    pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL sb_vkQueueWaitIdle(VkQueue queue) {
+    xeno_submit_device_t* sd = xeno_queue_device(queue)->submit;
+    sb_queue_t* q = queue_get(sd, queue);
+    if (!q) return sd->next_vkQueueWaitIdle(queue);
+    pthread_mutex_lock(&q->lock);
+    VkResult r = flush_locked(sd, q, VK_NULL_HANDLE, FLUSH_HOST);
+    if (r == VK_SUCCESS) r = sd->next_vkQueueWaitIdle(queue);
+    pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
+/* host access to every queue of the device: all their locks, taken in list order */
+static VKAPI_ATTR VkResult VKAPI_CALL sb_vkDeviceWaitIdle(VkDevice device) {
+    xeno_submit_device_t* sd = xeno_device_get(device)->submit;
+    VkResult r = VK_SUCCESS;
+    sb_queue_t* head = atomic_load_explicit(&sd->queues, memory_order_acquire);
+    for (sb_queue_t* q = head; q; q = q->next) {
+        pthread_mutex_lock(&q->lock);
+        VkResult f = flush_locked(sd, q, VK_NULL_HANDLE, FLUSH_HOST);
+        if (r == VK_SUCCESS) r = f;
+    }
+    if (r == VK_SUCCESS) r = sd->next_vkDeviceWaitIdle(device);
+    for (sb_queue_t* q = head; q; q = q->next) pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL sb_vkQueueBindSparse(VkQueue queue, uint32_t bindInfoCount, const VkBindSparseInfo* pBindInfo, VkFence fence) {
+    xeno_submit_device_t* sd = xeno_queue_device(queue)->submit;
+    sb_queue_t* q = queue_get(sd, queue);
+    VkResult r = VK_SUCCESS;
+    for (uint32_t i = 0; i < bindInfoCount && r == VK_SUCCESS; ++i)
+        for (uint32_t k = 0; k < pBindInfo[i].waitSemaphoreCount && r == VK_SUCCESS; ++k) r = release_signal(sd, q, pBindInfo[i].pWaitSemaphores[k]);
+    if (r != VK_SUCCESS) return r;
+    if (!q) return sd->next_vkQueueBindSparse(queue, bindInfoCount, pBindInfo, fence);
+    pthread_mutex_lock(&q->lock);
+    r = flush_locked(sd, q, VK_NULL_HANDLE, FLUSH_PASSTHROUGH);
+    if (r == VK_SUCCESS) r = sd->next_vkQueueBindSparse(queue, bindInfoCount, pBindInfo, fence);
+    pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL sb_vkWaitSemaphores(VkDevice device, const VkSemaphoreWaitInfo* pWaitInfo, uint64_t timeout) {
+    xeno_submit_device_t* sd = xeno_device_get(device)->submit;
+    VkResult r = flush_all(sd, FLUSH_HOST);
+    return r == VK_SUCCESS ? sd->next_vkWaitSemaphores(device, pWaitInfo, timeout) : r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL sb_vkGetSemaphoreFdKHR(VkDevice device, const VkSemaphoreGetFdInfoKHR* pGetFdInfo, int* pFd) {
+    xeno_submit_device_t* sd = xeno_device_get(device)->submit;
+    VkResult r = flush_all(sd, FLUSH_HOST);
+    return r == VK_SUCCESS ? sd->next_vkGetSemaphoreFdKHR(device, pGetFdInfo, pFd) : r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL sb_vkGetSemaphoreCounterValue(VkDevice device, VkSemaphore semaphore, uint64_t* pValue) {
+    xeno_submit_device_t* sd = xeno_device_get(device)->submit;
+    VkResult r = expire(sd);
+    return r == VK_SUCCESS ? sd->next_vkGetSemaphoreCounterValue(device, semaphore, pValue) : r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL sb_vkGetEventStatus(VkDevice device, VkEvent event) {
+    xeno_submit_device_t* sd = xeno_device_get(device)->submit;
+    VkResult r = expire(sd);
+    return r == VK_SUCCESS ? sd->next_vkGetEventStatus(device, event) : r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL sb_vkGetQueryPoolResults(VkDevice device, VkQueryPool queryPool, uint32_t firstQuery, uint32_t queryCount,
+                                                              size_t dataSize, void* pData, VkDeviceSize stride, VkQueryResultFlags flags) {
+    xeno_submit_device_t* sd = xeno_device_get(device)->submit;
+    VkResult r = (flags & VK_QUERY_RESULT_WAIT_BIT) ? flush_all(sd, FLUSH_HOST) : expire(sd);
+    return r == VK_SUCCESS ? sd->next_vkGetQueryPoolResults(device, queryPool, firstQuery, queryCount, dataSize, pData, stride, flags) : r;
+}
+
+/* queue calls with nothing to order against the held batches still take the queue's lock */
+#define SB_LOCKED(fn, params, args) \
+static VKAPI_ATTR void VKAPI_CALL sb_##fn params { \
+    xeno_submit_device_t* sd = xeno_queue_device(queue)->submit; \
+    sb_queue_t* q = queue_get(sd, queue); \
+    if (q) pthread_mutex_lock(&q->lock); \
+    sd->next_##fn args; \
+    if (q) pthread_mutex_unlock(&q->lock); \
+}
+SB_LOCKED(vkQueueBeginDebugUtilsLabelEXT, (VkQueue queue, const VkDebugUtilsLabelEXT* pLabelInfo), (queue, pLabelInfo))
+SB_LOCKED(vkQueueEndDebugUtilsLabelEXT, (VkQueue queue), (queue))
+SB_LOCKED(vkQueueInsertDebugUtilsLabelEXT, (VkQueue queue, const VkDebugUtilsLabelEXT* pLabelInfo), (queue, pLabelInfo))
+#undef SB_LOCKED
+
+/* apply to the submits that follow: the held ones go out first */
+static VKAPI_ATTR VkResult VKAPI_CALL sb_vkQueueSetPerformanceConfigurationINTEL(VkQueue queue, VkPerformanceConfigurationINTEL configuration) {
+    xeno_submit_device_t* sd = xeno_queue_device(queue)->submit;
+    sb_queue_t* q = queue_get(sd, queue);
+    if (!q) return sd->next_vkQueueSetPerformanceConfigurationINTEL(queue, configuration);
+    pthread_mutex_lock(&q->lock);
+    VkResult r = flush_locked(sd, q, VK_NULL_HANDLE, FLUSH_PASSTHROUGH);
+    if (r == VK_SUCCESS) r = sd->next_vkQueueSetPerformanceConfigurationINTEL(queue, configuration);
+    pthread_mutex_unlock(&q->lock);
+    return r;
+}
+
+static VKAPI_ATTR void VKAPI_CALL sb_vkQueueNotifyOutOfBandNV(VkQueue queue, const VkOutOfBandQueueTypeInfoNV* pQueueTypeInfo) {
+    xeno_submit_device_t* sd = xeno_queue_device(queue)->submit;
+    sb_queue_t* q = queue_get(sd, queue);
+    if (!q) { sd->next_vkQueueNotifyOutOfBandNV(queue, pQueueTypeInfo); return; }
+    pthread_mutex_lock(&q->lock);
+    flush_locked(sd, q, VK_NULL_HANDLE, FLUSH_PASSTHROUGH);   /* no result to carry a failure: it is logged and counted */
+    sd->next_vkQueueNotifyOutOfBandNV(queue, pQueueTypeInfo);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* --- device lifetime / routing --- */
+int xeno_submit_init(xeno_device_t* dev) {
+    if (!xeno_env_bool("XCLIPSE_SUBMIT_BATCH", 0)) return 0;
+    if (!dev->vk.vkQueueSubmit || !dev->vk.vkQueueWaitIdle || !dev->vk.vkDeviceWaitIdle) return -1;
+    for (size_t i = 0; i < sizeof(sb_unseen) / sizeof(sb_unseen[0]); ++i) {
+        if (!xeno_device_module_proc(dev, sb_unseen[i])) continue;
+        xlog("submit: %s bypasses the queue locks, submits reach the driver one by one", sb_unseen[i]);
+        return 0;
+    }
+    xeno_submit_device_t* sd = calloc(1, sizeof(*sd)); if (!sd) return -1;
+    sd->sync2 = dev->sync2 && dev->vk.vkQueueSubmit2;
+    long us = xeno_env_long("XCLIPSE_SUBMIT_BATCH_LATENCY_US", 2000);
+    sd->latency_ns = (uint64_t)(us > 0 ? us : 0) * 1000;
+    pthread_mutex_init(&sd->lock, NULL);
+    atomic_init(&sd->queues, NULL);
+    /* interposed in the dispatch table: the modules' own queue calls are ordered with the held batches */
+#define SB_INSTALL(fn) if (dev->vk.fn) { sd->next_##fn = dev->vk.fn; dev->vk.fn = sb_##fn; }
+    SB_HOOKS(SB_INSTALL)
+#undef SB_INSTALL
+    dev->submit = sd;
+    xlog("submit: batching submits through %s, held at most %" PRIu64 " us", sd->sync2 ? "vkQueueSubmit2" : "vkQueueSubmit", sd->latency_ns / 1000);
+    return 0;
+}
+
+void xeno_submit_destroy(xeno_device_t* dev) {
+    xeno_submit_device_t* sd = dev->submit;
+    if (!sd) return;
+    flush_all(sd, FLUSH_HOST);
+#define SB_RESTORE(fn) if (sd->next_##fn) dev->vk.fn = sd->next_##fn;
+    SB_HOOKS(SB_RESTORE)
+#undef SB_RESTORE
+    for (sb_queue_t* q = atomic_load(&sd->queues), *next; q; q = next) {
+        next = q->next;
+        free(q->batches); free(q->sems); free(q->cbs); free(q->infos); free(q->legacy_infos); free(q->legacy);
+        free(q->sem_handles); free(q->sem_stages); free(q->sem_values); free(q->cb_handles);
+        pthread_mutex_destroy(&q->lock);
+        free(q);
+    }
+    pthread_mutex_destroy(&sd->lock);
+    dev->submit = NULL;
+    free(sd);
+}
+
+/* entrypoints no module intercepts would otherwise reach the driver directly */
+PFN_vkVoidFunction xeno_submit_proc(xeno_device_t* dev, const char* name) {
+    xeno_submit_device_t* sd = dev->submit;
+    if (!sd || strncmp(name, "vk", 2) != 0) return NULL;
+#define SB_PROC(fn) if (sd->next_##fn && strcmp(name, #fn) == 0) return (PFN_vkVoidFunction)sb_##fn;
+    SB_HOOKS(SB_PROC)
+#undef SB_PROC
+#define SB_ALIAS(fn, alias) if (sd->next_##fn && strcmp(name, alias) == 0) return (PFN_vkVoidFunction)sb_##fn;
+    SB_ALIAS(vkQueueSubmit2, "vkQueueSubmit2KHR") SB_ALIAS(vkWaitSemaphores, "vkWaitSemaphoresKHR")
+    SB_ALIAS(vkGetSemaphoreCounterValue, "vkGetSemaphoreCounterValueKHR")
+#undef SB_ALIAS
+    return NULL;
+}
+
+void xeno_submit_report(FILE* f, xeno_device_t* dev) {
+    xeno_submit_device_t* sd = dev->submit;
+    fprintf(f, "  \"submit_batch\": {\"enabled\": %s", sd ? "true" : "false");
+    if (sd) {
+        uint64_t frames = atomic_load(&sd->frames), app = atomic_load(&sd->app_submits), drv = atomic_load(&sd->driver_submits);
+        fprintf(f, ", \"api\": \"%s\", \"latency_us\": %" PRIu64 ", \"frames\": %" PRIu64 ", \"app_submits\": %" PRIu64 ", \"driver_submits\": %" PRIu64
+                   ", \"app_submits_per_frame\": %.2f, \"driver_submits_per_frame\": %.2f, \"max_app_submits_per_frame\": %" PRIu64 ", \"max_driver_submits_per_frame\": %" PRIu64
+                   ", \"held_batches\": %" PRIu64 ", \"errors\": %" PRIu64 ", \"flushes\": {",
+                sd->sync2 ? "vkQueueSubmit2" : "vkQueueSubmit", sd->latency_ns / 1000, frames, app, drv,
+                frames ? (double)app / (double)frames : 0.0, frames ? (double)drv / (double)frames : 0.0,
+                atomic_load(&sd->max_app), atomic_load(&sd->max_driver), atomic_load(&sd->held), atomic_load(&sd->errors));
+        for (int i = 0; i < FLUSH_REASONS; ++i) fprintf(f, "%s\"%s\": %" PRIu64, i ? ", " : "", flush_names[i], atomic_load(&sd->flushes[i]));
+        fprintf(f, "}");
+    }
+    fprintf(f, "}");
+}
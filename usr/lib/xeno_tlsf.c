@@ -0,0 +1,162 @@
+/* xeno_tlsf.c - two-level segregated fit allocator over an offset range
+ *
+ * Manages [0, size) of memory the allocator cannot write to (a VkDeviceMemory block), so range
+ * headers live in malloc'd nodes instead of inline. Free ranges sit in SL_COUNT lists per power of
+ * two, found through a first-level and per-level second-level bitmap; allocation and free are O(1)
+ * apart from the node malloc, and physical neighbours are merged on free.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include "xeno_internal.h"
+
+#define SL_LOG2 4
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_COUNT (64 - SL_LOG2 + 1)
+
+struct xeno_tlsf_range {
+    uint64_t offset, size;
+    struct xeno_tlsf_range *prev_phys, *next_phys;   /* address order */
+    struct xeno_tlsf_range *prev_free, *next_free;   /* free list of the size class */
+    int free;
+};
+
+struct xeno_tlsf {
+    uint64_t size, used;
+    uint32_t ranges;                /* allocated ranges */
+    uint64_t fl_bitmap;
+    uint32_t sl_bitmap[FL_COUNT];
+    xeno_tlsf_range_t* heads[FL_COUNT][SL_COUNT];
+    xeno_tlsf_range_t* first;       /* lowest offset */
+};
+
+static inline int log2_floor(uint64_t v) { return 63 - __builtin_clzll(v); }
+
+/* size class of a range: sizes below SL_COUNT get one list each, larger ones SL_COUNT per power of two */
+static void mapping(uint64_t size, int* fl, int* sl) {
+    if (size < SL_COUNT) { *fl = 0; *sl = (int)size; return; }
+    int f = log2_floor(size);
+    *sl = (int)((size >> (f - SL_LOG2)) ^ SL_COUNT);
+    *fl = f - SL_LOG2 + 1;
+}
+
+static void insert_free(xeno_tlsf_t* t, xeno_tlsf_range_t* r) {
+    int fl, sl; mapping(r->size, &fl, &sl);
+    r->free = 1; r->prev_free = NULL; r->next_free = t->heads[fl][sl];
+    if (r->next_free) r->next_free->prev_free = r;
+    t->heads[fl][sl] = r;
+    t->fl_bitmap |= 1ull << fl; t->sl_bitmap[fl] |= 1u << sl;
+}
+
+static void remove_free(xeno_tlsf_t* t, xeno_tlsf_range_t* r) {
+    int fl, sl; mapping(r->size, &fl, &sl);
+    if (r->prev_free) r->prev_free->next_free = r->next_free; else t->heads[fl][sl] = r->next_free;
+    if (r->next_free) r->next_free->prev_free = r->prev_free;
+    if (!t->heads[fl][sl]) {
+        t->sl_bitmap[fl] &= ~(1u << sl);
+        if (!t->sl_bitmap[fl]) t->fl_bitmap &= ~(1ull << fl);
+    }
+    r->free = 0;
+}
+
+/* head of the first non-empty list whose every range is at least size */
+static xeno_tlsf_range_t* find_free(xeno_tlsf_t* t, uint64_t size) {
+    if (size >= SL_COUNT) {
+        uint64_t round = (1ull << (log2_floor(size) - SL_LOG2)) - 1;
+        if (size + round < size) return NULL;
+        size += round;
+    }
+    int fl, sl; mapping(size, &fl, &sl);
+    if (fl >= FL_COUNT) return NULL;
+    uint32_t sl_map = t->sl_bitmap[fl] & (~0u << sl);
+    if (!sl_map) {
+        uint64_t fl_map = fl + 1 < FL_COUNT ? t->fl_bitmap & (~0ull << (fl + 1)) : 0;
+        if (!fl_map) return NULL;
+        fl = __builtin_ctzll(fl_map);
+        sl_map = t->sl_bitmap[fl];
+    }
+    return t->heads[fl][__builtin_ctz(sl_map)];
+}
+
+static xeno_tlsf_range_t* new_range(uint64_t offset, uint64_t size) {
+    xeno_tlsf_range_t* r = calloc(1, sizeof(*r));
+    if (r) { r->offset = offset; r->size = size; }
+    return r;
+}
+
+xeno_tlsf_t* xeno_tlsf_create(uint64_t size) {
+    xeno_tlsf_t* t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    t->size = size;
+    if (!(t->first = new_range(0, size))) { free(t); return NULL; }
+    insert_free(t, t->first);
+    return t;
+}
+
+void xeno_tlsf_destroy(xeno_tlsf_t* t) {
+    if (!t) return;
+    for (xeno_tlsf_range_t* r = t->first; r;) { xeno_tlsf_range_t* n = r->next_phys; free(r); r = n; }
+    free(t);
+}
+
+static inline uint64_t align_up(uint64_t v, uint64_t a) { return (v + a - 1) / a * a; }
+
+xeno_tlsf_range_t* xeno_tlsf_alloc(xeno_tlsf_t* t, uint64_t size, uint64_t align, uint64_t* offset) {
+    if (size == 0) size = 1;
+    if (align == 0) align = 1;
+    xeno_tlsf_range_t* r = find_free(t, size);
+    /* the class guarantees the size but not the alignment: retry with room for the worst-case padding */
+    if (r && align_up(r->offset, align) + size > r->offset + r->size) r = align > 1 ? find_free(t, size + align - 1) : NULL;
+    if (!r) return NULL;
+    uint64_t start = align_up(r->offset, align), gap = start - r->offset;
+    xeno_tlsf_range_t *front = NULL, *tail = NULL;
+    if (gap && !(front = new_range(r->offset, gap))) return NULL;
+    if (r->size - gap > size && !(tail = new_range(start + size, r->size - gap - size))) { free(front); return NULL; }
+    remove_free(t, r);
+    if (front) {
+        front->prev_phys = r->prev_phys; front->next_phys = r;
+        if (r->prev_phys) r->prev_phys->next_phys = front; else t->first = front;
+        r->prev_phys = front;
+        insert_free(t, front);
+    }
+    if (tail) {
+        tail->prev_phys = r; tail->next_phys = r->next_phys;
+        if (r->next_phys) r->next_phys->prev_phys = tail;
+        r->next_phys = tail;
+        insert_free(t, tail);
+    }
+    r->offset = start; r->size = size;
+    t->used += size; t->ranges++;
+    *offset = start;
+    return r;
+}
+
+void xeno_tlsf_free(xeno_tlsf_t* t, xeno_tlsf_range_t* r) {
+    t->used -= r->size; t->ranges--;
+    xeno_tlsf_range_t* p = r->prev_phys;
+    if (p && p->free) {
+        remove_free(t, p);
+        p->size += r->size; p->next_phys = r->next_phys;
+        if (r->next_phys) r->next_phys->prev_phys = p;
+        free(r); r = p;
+    }
+    xeno_tlsf_range_t* n = r->next_phys;
+    if (n && n->free) {
+        remove_free(t, n);
+        r->size += n->size; r->next_phys = n->next_phys;
+        if (n->next_phys) n->next_phys->prev_phys = r;
+        free(n);
+    }
+    insert_free(t, r);
+}
+
+uint64_t xeno_tlsf_used(const xeno_tlsf_t* t) { return t->used; }
+uint32_t xeno_tlsf_ranges(const xeno_tlsf_t* t) { return t->ranges; }
+
+uint64_t xeno_tlsf_largest_free(const xeno_tlsf_t* t) {
+    if (!t->fl_bitmap) return 0;
+    int fl = log2_floor(t->fl_bitmap), sl = log2_floor(t->sl_bitmap[fl]);
+    uint64_t best = 0;
+    for (const xeno_tlsf_range_t* r = t->heads[fl][sl]; r; r = r->next_free) if (r->size > best) best = r->size;
+    return best;
+}
@@ -0,0 +1,487 @@
+/* xeno_transient.c - transient attachments on lazily allocated memory
+ *
+ * Depth buffers, MSAA color targets and G-buffer channels are often cleared or discarded at the
+ * start of every pass and discarded at its end: their contents never leave the tile memory of the
+ * pass, yet the app backs them with real device memory. Created with
+ * VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT and bound to a VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT
+ * type they need no backing at all.
+ *
+ * The module learns which images qualify from the load/store ops of the passes they take part in,
+ * both render passes (vkCmdBeginRenderPass with the framebuffer's or the imageless begin info's
+ * views) and dynamic rendering (vkCmdBeginRendering). Images are grouped by a signature of their
+ * create info (format, extent, samples, usage, ...), so what is learned for one render target
+ * applies to the next one created alike, including in later runs: the signatures are kept in a
+ * per-title file. An attachment escapes its pass when it is loaded, stored or preserved
+ * (LOAD / STORE / NONE ops) or written as a resolve target; one escape rules its signature out for
+ * good. A signature seen in XCLIPSE_TRANSIENT_PASSES passes without an escape is transient.
+ *
+ * Only images whose usage is attachments alone are considered: any other usage (sampled, storage,
+ * transfer) would be a way for their contents to leave the pass the module cannot see. Such an
+ * image with a transient signature is created with TRANSIENT_ATTACHMENT added, and its memory
+ * requirements are narrowed to the lazily allocated types. Adding the usage is always valid; a
+ * signature that turns out to escape afterwards only costs the lazy memory being committed.
+ * Nothing is converted on devices without a lazily allocated type, the report then lists the
+ * bytes that would have been saved.
+ *
+ * The module interposes below the other modules in the device dispatch table and resolves the
+ * entrypoints no module intercepts through vkGetDeviceProcAddr, like the host allocator does. The
+ * views, render passes and framebuffers of a begin are looked up in xeno_resource.c.
+ *
+ * Knobs:
+ *   XCLIPSE_TRANSIENT=0                disable
+ *   XCLIPSE_TRANSIENT_PASSES=N         passes a signature takes part in without escaping before it is transient (default 8)
+ *   XCLIPSE_TRANSIENT_DIR=path         learned signatures, one file per title (default /data/local/tmp/xeno_transient)
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "xeno_internal.h"
+
+#define DEFAULT_DIR "/data/local/tmp/xeno_transient"
+#define FILE_MAGIC 0x31525458u      /* "XTR1" */
+
+enum { IMG_CONVERTED = 1u << 0, IMG_LAZY = 1u << 1, IMG_BOUND = 1u << 2, IMG_MISPREDICTED = 1u << 3 };
+
+typedef struct tr_sig {
+    _Atomic uint32_t uses;          /* passes taken part in without escaping */
+    _Atomic uint32_t escaped;       /* sticky */
+} tr_sig_t;
+
+typedef struct tr_sig_record { uint64_t key; uint32_t uses, escaped; } tr_sig_record_t;  /* on disk */
+
+#define TR_HOOKS(X) \
+    X(vkCreateImage) X(vkDestroyImage) \
+    X(vkGetImageMemoryRequirements) X(vkGetImageMemoryRequirements2) X(vkBindImageMemory) X(vkBindImageMemory2)
+
+typedef struct xeno_transient_device {
+#define TR_NEXT(fn) PFN_##fn next_##fn;
+    TR_HOOKS(TR_NEXT)
+#undef TR_NEXT
+    uint32_t lazy_types;            /* memory types with LAZILY_ALLOCATED */
+    uint32_t learn_passes;
+    char path[512];                 /* signature file, empty when not persisted */
+    xeno_map_t sigs;                /* signature -> tr_sig_t */
+    pthread_mutex_t sig_lock;       /* inserts into sigs */
+    uint32_t loaded;
+    _Atomic uint64_t passes, converted, mispredicted;
+} xeno_transient_device_t;
+
+typedef struct tr_image {           /* images with attachment-only usage */
+    xeno_transient_device_t* td;
+    tr_sig_t* sig;
+    _Atomic uint64_t size;          /* from the memory requirements, 0 until queried */
+    _Atomic uint32_t flags;         /* IMG_* */
+} tr_image_t;
+
+typedef struct tr_pass {            /* render pass attachments whose contents outlive the pass, on the xeno_render_pass_t */
+    xeno_resource_user_t user;
+    uint32_t count;
+    uint8_t escapes[];
+} tr_pass_t;
+
+/* Handle maps are shared by the devices, as in xeno_resource.c: command intercepts receive no
+ * device, the image behind an attachment leads back to it. */
+static xeno_map_t tr_devices;       /* VkDevice -> xeno_transient_device_t, kept apart from the registry for teardown */
+static xeno_map_t tr_images;        /* VkImage -> tr_image_t */
+static pthread_once_t tr_once = PTHREAD_ONCE_INIT;
+static void tr_maps_init(void) { xeno_map_init(&tr_devices, 8); xeno_map_init(&tr_images, 1024); }
+
+/* The command entrypoints below the module are the driver's, the same for each of its devices. */
+static struct {
+    pthread_mutex_t lock;
+    uint32_t devices;
+    PFN_vkCmdBeginRendering begin_rendering;
+    PFN_vkCmdBeginRenderPass begin_pass;
+    PFN_vkCmdBeginRenderPass2 begin_pass2;
+} tr_cmd = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static xeno_transient_device_t* tr_device(VkDevice device) { return xeno_map_get(&tr_devices, XENO_HANDLE_KEY(device)); }
+
+/* --- signatures --- */
+static uint64_t sig_key(const VkImageCreateInfo* ci) {
+    uint32_t k[12] = { (uint32_t)ci->imageType, (uint32_t)ci->format, ci->extent.width, ci->extent.height, ci->extent.depth,
+                       ci->mipLevels, ci->arrayLayers, (uint32_t)ci->samples, (uint32_t)ci->tiling,
+                       ci->usage & ~VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, ci->flags, (uint32_t)ci->sharingMode };
+    return xeno_hash64(k, sizeof(k), 0x7472616e7369656eull);
+}
+
+static tr_sig_t* sig_get(xeno_transient_device_t* td, uint64_t key) {
+    tr_sig_t* s = xeno_map_get(&td->sigs, key);
+    if (s) return s;
+    pthread_mutex_lock(&td->sig_lock);
+    if (!(s = xeno_map_get(&td->sigs, key)) && (s = calloc(1, sizeof(*s)))) xeno_map_put(&td->sigs, key, s);
+    pthread_mutex_unlock(&td->sig_lock);
+    return s;
+}
+
+static int sig_transient(const xeno_transient_device_t* td, tr_sig_t* s) {
+    return !atomic_load_explicit(&s->escaped, memory_order_relaxed) && atomic_load_explicit(&s->uses, memory_order_relaxed) >= td->learn_passes;
+}
+
+static void sigs_load(xeno_transient_device_t* td) {
+    FILE* f = td->path[0] ? fopen(td->path, "rb") : NULL;
+    if (!f) return;
+    uint32_t hdr[2];
+    if (fread(hdr, sizeof(hdr), 1, f) == 1 && hdr[0] == FILE_MAGIC) {
+        tr_sig_record_t r;
+        for (uint32_t i = 0; i < hdr[1] && fread(&r, sizeof(r), 1, f) == 1; ++i) {
+            tr_sig_t* s = sig_get(td, r.key);
+            if (!s) break;
+            atomic_store(&s->uses, r.uses); atomic_store(&s->escaped, r.escaped != 0);
+            td->loaded++;
+        }
+    }
+    fclose(f);
+}
+
+typedef struct sig_save { FILE* f; uint32_t count; } sig_save_t;
+static int sig_save_fn(uint64_t key, void* val, void* ctx) {
+    sig_save_t* w = ctx; tr_sig_t* s = val;
+    tr_sig_record_t r = { key, atomic_load(&s->uses), atomic_load(&s->escaped) };
+    if ((r.uses || r.escaped) && fwrite(&r, sizeof(r), 1, w->f) == 1) w->count++;
+    return 0;
+}
+
+/* written next to the file and renamed over it, another process may be reading it */
+static void sigs_save(xeno_transient_device_t* td) {
+    if (!td->path[0]) return;
+    char tmp[sizeof(td->path) + 16];
+    snprintf(tmp, sizeof(tmp), "%s.%d", td->path, (int)getpid());
+    FILE* f = fopen(tmp, "wb");
+    if (!f) { xlog("transient: cannot write %s (%d)", tmp, errno); return; }
+    sig_save_t w = { f, 0 };
+    uint32_t hdr[2] = { FILE_MAGIC, 0 };
+    fwrite(hdr, sizeof(hdr), 1, f);
+    xeno_map_foreach(&td->sigs, sig_save_fn, &w);
+    hdr[1] = w.count;
+    int ok = fseek(f, 0, SEEK_SET) == 0 && fwrite(hdr, sizeof(hdr), 1, f) == 1;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, td->path) != 0) { xlog("transient: cannot save %s", td->path); unlink(tmp); }
+}
+
+/* --- learning --- */
+static int ops_escape(VkAttachmentLoadOp load, VkAttachmentStoreOp store) {
+    return (load != VK_ATTACHMENT_LOAD_OP_CLEAR && load != VK_ATTACHMENT_LOAD_OP_DONT_CARE) || store != VK_ATTACHMENT_STORE_OP_DONT_CARE;
+}
+
+static int has_stencil(VkFormat format) {
+    return format == VK_FORMAT_S8_UINT || format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+static tr_image_t* view_image(VkImageView view, VkImage* image) {
+    xeno_view_t* v = view ? xeno_view_get(view) : NULL;
+    *image = v ? v->image : VK_NULL_HANDLE;
+    return *image ? xeno_map_get(&tr_images, XENO_HANDLE_KEY(*image)) : NULL;
+}
+
+static void observe(VkImageView view, int escapes) {
+    VkImage image;
+    tr_image_t* img = view_image(view, &image);
+    if (!img) return;
+    if (!escapes) { atomic_fetch_add_explicit(&img->sig->uses, 1, memory_order_relaxed); return; }
+    atomic_store_explicit(&img->sig->escaped, 1, memory_order_relaxed);
+    if ((atomic_load(&img->flags) & (IMG_CONVERTED | IMG_MISPREDICTED)) == IMG_CONVERTED &&
+        !(atomic_fetch_or(&img->flags, IMG_MISPREDICTED) & IMG_MISPREDICTED)) {
+        atomic_fetch_add(&img->td->mispredicted, 1);
+        xlog("transient: image %p created transient escapes a pass, its signature is ruled out", (void*)image);
+    }
+}
+
+static void observe_attachment(const VkRenderingAttachmentInfo* a) {
+    if (!a || !a->imageView) return;
+    observe(a->imageView, ops_escape(a->loadOp, a->storeOp));
+    if (a->resolveMode != VK_RESOLVE_MODE_NONE) observe(a->resolveImageView, 1);
+}
+
+static void count_pass(VkImageView view) {
+    VkImage image;
+    tr_image_t* img = view_image(view, &image);
+    if (img) atomic_fetch_add_explicit(&img->td->passes, 1, memory_order_relaxed);
+}
+
+static void pass_release(xeno_resource_user_t* u) { free(u); }
+
+static void pass_mark(tr_pass_t* p, uint32_t attachment) {
+    if (attachment != VK_ATTACHMENT_UNUSED && attachment < p->count) p->escapes[attachment] = 1;
+}
+
+static tr_pass_t* pass_new(const xeno_render_pass_t* rp) {
+    uint32_t count = rp->v2 ? rp->info2->attachmentCount : rp->info1->attachmentCount;
+    tr_pass_t* p = calloc(1, sizeof(*p) + count);
+    if (!p) return NULL;
+    p->user.release = pass_release; p->count = count;
+    if (!rp->v2) {
+        const VkRenderPassCreateInfo* ci = rp->info1;
+        for (uint32_t i = 0; i < count; ++i) {
+            const VkAttachmentDescription* a = &ci->pAttachments[i];
+            p->escapes[i] = ops_escape(a->loadOp, a->storeOp) || (has_stencil(a->format) && ops_escape(a->stencilLoadOp, a->stencilStoreOp));
+        }
+        for (uint32_t s = 0; s < ci->subpassCount; ++s) {
+            const VkSubpassDescription* sp = &ci->pSubpasses[s];
+            if (sp->pResolveAttachments) for (uint32_t i = 0; i < sp->colorAttachmentCount; ++i) pass_mark(p, sp->pResolveAttachments[i].attachment);
+        }
+        return p;
+    }
+    const VkRenderPassCreateInfo2* ci = rp->info2;
+    for (uint32_t i = 0; i < count; ++i) {
+        const VkAttachmentDescription2* a = &ci->pAttachments[i];
+        p->escapes[i] = ops_escape(a->loadOp, a->storeOp) || (has_stencil(a->format) && ops_escape(a->stencilLoadOp, a->stencilStoreOp));
+    }
+    for (uint32_t s = 0; s < ci->subpassCount; ++s) {
+        const VkSubpassDescription2* sp = &ci->pSubpasses[s];
+        if (sp->pResolveAttachments) for (uint32_t i = 0; i < sp->colorAttachmentCount; ++i) pass_mark(p, sp->pResolveAttachments[i].attachment);
+        const VkSubpassDescriptionDepthStencilResolve* ds = sp->pNext;    /* the only struct the copy keeps */
+        if (ds && ds->pDepthStencilResolveAttachment) pass_mark(p, ds->pDepthStencilResolveAttachment->attachment);
+    }
+    return p;
+}
+
+/* derived on the first begin and kept with the pass */
+static const tr_pass_t* pass_get(VkRenderPass renderPass) {
+    xeno_render_pass_t* rp = xeno_render_pass_get(renderPass);
+    if (!rp) return NULL;
+    tr_pass_t* p = (tr_pass_t*)atomic_load_explicit(&rp->user[XENO_RESOURCE_TRANSIENT], memory_order_acquire);
+    if (p || !(p = pass_new(rp))) return p;
+    return (const tr_pass_t*)xeno_resource_attach(&rp->user[XENO_RESOURCE_TRANSIENT], &p->user);
+}
+
+static void observe_render_pass(const VkRenderPassBeginInfo* info) {
+    const tr_pass_t* p = pass_get(info->renderPass);
+    const xeno_framebuffer_t* fb = xeno_framebuffer_get(info->framebuffer);
+    if (!p || !fb) return;
+    uint32_t count = fb->count; const VkImageView* views = fb->views;
+    if (!count) {
+        for (const VkBaseInStructure* s = info->pNext; s; s = s->pNext)
+            if (s->sType == VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO) {
+                const VkRenderPassAttachmentBeginInfo* b = (const VkRenderPassAttachmentBeginInfo*)s;
+                count = b->attachmentCount; views = b->pAttachments;
+            }
+    }
+    if (count > p->count) count = p->count;
+    for (uint32_t i = 0; i < count; ++i) observe(views[i], p->escapes[i]);
+    if (count) count_pass(views[0]);
+}
+
+/* --- intercepts --- */
+static VKAPI_ATTR VkResult VKAPI_CALL tr_vkCreateImage(VkDevice device, const VkImageCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkImage* pImage) {
+    xeno_transient_device_t* td = tr_device(device);
+    if (!xeno_attachment_usage_only(pCreateInfo)) return td->next_vkCreateImage(device, pCreateInfo, pAllocator, pImage);
+    tr_sig_t* s = sig_get(td, sig_key(pCreateInfo));
+    if (!s) return td->next_vkCreateImage(device, pCreateInfo, pAllocator, pImage);
+    /* extension structs (external memory, DRM modifiers, ...) and aliasing leave the image as it is */
+    VkImageCreateInfo ci = *pCreateInfo;
+    int convert = td->lazy_types && !ci.pNext && !(ci.flags & (VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_ALIAS_BIT)) &&
+                  !(ci.usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) && sig_transient(td, s);
+    if (convert) ci.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    VkResult r = td->next_vkCreateImage(device, &ci, pAllocator, pImage);
+    if (r != VK_SUCCESS) return r;
+    tr_image_t* img = calloc(1, sizeof(*img));
+    if (img) {
+        img->td = td; img->sig = s;
+        atomic_init(&img->size, 0); atomic_init(&img->flags, convert ? IMG_CONVERTED : 0);
+        xeno_map_put(&tr_images, XENO_HANDLE_KEY(*pImage), img);
+        if (convert) atomic_fetch_add(&td->converted, 1);
+    }
+    return r;
+}
+
+static VKAPI_ATTR void VKAPI_CALL tr_vkDestroyImage(VkDevice device, VkImage image, const VkAllocationCallbacks* pAllocator) {
+    xeno_transient_device_t* td = tr_device(device);
+    if (image) free(xeno_map_remove(&tr_images, XENO_HANDLE_KEY(image)));
+    td->next_vkDestroyImage(device, image, pAllocator);
+}
+
+/* converted images may only be bound to lazily allocated memory when the driver offers it for them */
+static void narrow(VkImage image, VkMemoryRequirements* req) {
+    tr_image_t* img = xeno_map_get(&tr_images, XENO_HANDLE_KEY(image));
+    if (!img) return;
+    atomic_store(&img->size, req->size);
+    if (!(atomic_load(&img->flags) & IMG_CONVERTED)) return;
+    uint32_t lazy = req->memoryTypeBits & img->td->lazy_types;
+    if (lazy) { req->memoryTypeBits = lazy; atomic_fetch_or(&img->flags, IMG_LAZY); }
+}
+
+static VKAPI_ATTR void VKAPI_CALL tr_vkGetImageMemoryRequirements(VkDevice device, VkImage image, VkMemoryRequirements* pMemoryRequirements) {
+    tr_device(device)->next_vkGetImageMemoryRequirements(device, image, pMemoryRequirements);
+    narrow(image, pMemoryRequirements);
+}
+
+static VKAPI_ATTR void VKAPI_CALL tr_vkGetImageMemoryRequirements2(VkDevice device, const VkImageMemoryRequirementsInfo2* pInfo, VkMemoryRequirements2* pMemoryRequirements) {
+    tr_device(device)->next_vkGetImageMemoryRequirements2(device, pInfo, pMemoryRequirements);
+    narrow(pInfo->image, &pMemoryRequirements->memoryRequirements);
+}
+
+static void bound(VkImage image) {
+    tr_image_t* img = xeno_map_get(&tr_images, XENO_HANDLE_KEY(image));
+    if (img) atomic_fetch_or(&img->flags, IMG_BOUND);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL tr_vkBindImageMemory(VkDevice device, VkImage image, VkDeviceMemory memory, VkDeviceSize memoryOffset) {
+    VkResult r = tr_device(device)->next_vkBindImageMemory(device, image, memory, memoryOffset);
+    if (r == VK_SUCCESS) bound(image);
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL tr_vkBindImageMemory2(VkDevice device, uint32_t bindInfoCount, const VkBindImageMemoryInfo* pBindInfos) {
+    VkResult r = tr_device(device)->next_vkBindImageMemory2(device, bindInfoCount, pBindInfos);
+    if (r == VK_SUCCESS) for (uint32_t i = 0; i < bindInfoCount; ++i) bound(pBindInfos[i].image);
+    return r;
+}
+
+static VKAPI_ATTR void VKAPI_CALL tr_vkCmdBeginRendering(VkCommandBuffer commandBuffer, const VkRenderingInfo* pRenderingInfo) {
+    for (uint32_t i = 0; i < pRenderingInfo->colorAttachmentCount; ++i) observe_attachment(&pRenderingInfo->pColorAttachments[i]);
+    observe_attachment(pRenderingInfo->pDepthAttachment);
+    observe_attachment(pRenderingInfo->pStencilAttachment);
+    const VkRenderingAttachmentInfo* first = pRenderingInfo->colorAttachmentCount ? &pRenderingInfo->pColorAttachments[0] : pRenderingInfo->pDepthAttachment;
+    if (first) count_pass(first->imageView);
+    tr_cmd.begin_rendering(commandBuffer, pRenderingInfo);
+}
+
+static VKAPI_ATTR void VKAPI_CALL tr_vkCmdBeginRenderPass(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo* pRenderPassBegin, VkSubpassContents contents) {
+    observe_render_pass(pRenderPassBegin);
+    tr_cmd.begin_pass(commandBuffer, pRenderPassBegin, contents);
+}
+
+static VKAPI_ATTR void VKAPI_CALL tr_vkCmdBeginRenderPass2(VkCommandBuffer commandBuffer, const VkRenderPassBeginInfo* pRenderPassBegin, const VkSubpassBeginInfo* pSubpassBeginInfo) {
+    observe_render_pass(pRenderPassBegin);
+    tr_cmd.begin_pass2(commandBuffer, pRenderPassBegin, pSubpassBeginInfo);
+}
+
+/* --- device lifetime / routing --- */
+static int cmd_install(xeno_device_t* dev) {
+    pthread_mutex_lock(&tr_cmd.lock);
+    int ok = !tr_cmd.devices || (tr_cmd.begin_rendering == dev->vk.vkCmdBeginRendering && tr_cmd.begin_pass == dev->vk.vkCmdBeginRenderPass &&
+                                 tr_cmd.begin_pass2 == dev->vk.vkCmdBeginRenderPass2);
+    if (ok) {
+        tr_cmd.begin_rendering = dev->vk.vkCmdBeginRendering; tr_cmd.begin_pass = dev->vk.vkCmdBeginRenderPass; tr_cmd.begin_pass2 = dev->vk.vkCmdBeginRenderPass2;
+        tr_cmd.devices++;
+        if (dev->vk.vkCmdBeginRendering) dev->vk.vkCmdBeginRendering = tr_vkCmdBeginRendering;
+        dev->vk.vkCmdBeginRenderPass = tr_vkCmdBeginRenderPass;
+        if (dev->vk.vkCmdBeginRenderPass2) dev->vk.vkCmdBeginRenderPass2 = tr_vkCmdBeginRenderPass2;
+    }
+    pthread_mutex_unlock(&tr_cmd.lock);
+    return ok ? 0 : -1;
+}
+
+int xeno_transient_init(xeno_device_t* dev) {
+    if (!xeno_env_bool("XCLIPSE_TRANSIENT", 1)) return 0;
+    const xeno_dispatch_t* vk = &dev->vk;
+    if (!vk->vkCreateImage || !vk->vkDestroyImage || !vk->vkGetImageMemoryRequirements || !vk->vkBindImageMemory ||
+        !vk->vkCmdBeginRenderPass || !dev->memory.memoryTypeCount) return -1;
+    xeno_transient_device_t* td = calloc(1, sizeof(*td)); if (!td) return -1;
+    if (cmd_install(dev) != 0) { free(td); return -1; }
+    for (uint32_t t = 0; t < dev->memory.memoryTypeCount; ++t)
+        if (dev->memory.memoryTypes[t].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) td->lazy_types |= 1u << t;
+    long passes = xeno_env_long("XCLIPSE_TRANSIENT_PASSES", 8);
+    td->learn_passes = (uint32_t)(passes < 1 ? 1 : passes);
+    xeno_map_init(&td->sigs, 256);
+    pthread_mutex_init(&td->sig_lock, NULL);
+    const char* dir = getenv("XCLIPSE_TRANSIENT_DIR");
+    char title[96];
+    xeno_process_title(title, sizeof(title));
+    if (!dir || !dir[0]) dir = DEFAULT_DIR;
+    if (mkdir(dir, 0755) == 0 || errno == EEXIST) snprintf(td->path, sizeof(td->path), "%s/%s.sig", dir, title[0] ? title : "DEFAULT");
+    sigs_load(td);
+    /* interpose below every other module */
+#define TR_INSTALL(fn) if (dev->vk.fn) { td->next_##fn = dev->vk.fn; dev->vk.fn = tr_##fn; }
+    TR_HOOKS(TR_INSTALL)
+#undef TR_INSTALL
+    pthread_once(&tr_once, tr_maps_init);
+    xeno_map_put(&tr_devices, XENO_HANDLE_KEY(dev->handle), td);
+    dev->transient = td;
+    xlog("transient: lazy types 0x%x, %u signatures learned from %s", td->lazy_types, td->loaded, td->path[0] ? td->path : "(none)");
+    return 0;
+}
+
+static int device_entry_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; tr_image_t* img = val;
+    if (img->td != ctx) return 0;
+    free(img); return 1;
+}
+static int sig_free_fn(uint64_t key, void* val, void* ctx) { (void)key; (void)ctx; free(val); return 1; }
+
+void xeno_transient_destroy(xeno_device_t* dev) {
+    xeno_transient_device_t* td = dev->transient;
+    if (!td) return;
+    sigs_save(td);
+#define TR_RESTORE(fn) if (td->next_##fn) dev->vk.fn = td->next_##fn;
+    TR_HOOKS(TR_RESTORE)
+#undef TR_RESTORE
+    pthread_mutex_lock(&tr_cmd.lock);
+    if (dev->vk.vkCmdBeginRendering) dev->vk.vkCmdBeginRendering = tr_cmd.begin_rendering;
+    dev->vk.vkCmdBeginRenderPass = tr_cmd.begin_pass;
+    if (dev->vk.vkCmdBeginRenderPass2) dev->vk.vkCmdBeginRenderPass2 = tr_cmd.begin_pass2;
+    tr_cmd.devices--;
+    pthread_mutex_unlock(&tr_cmd.lock);
+    /* images the app leaked point at the signatures */
+    xeno_map_foreach(&tr_images, device_entry_fn, td);
+    xeno_map_remove(&tr_devices, XENO_HANDLE_KEY(dev->handle));
+    xeno_map_foreach(&td->sigs, sig_free_fn, NULL);
+    xeno_map_destroy(&td->sigs);
+    pthread_mutex_destroy(&td->sig_lock);
+    dev->transient = NULL;
+    free(td);
+}
+
+/* entrypoints no module intercepts would otherwise reach the driver directly */
+PFN_vkVoidFunction xeno_transient_proc(xeno_device_t* dev, const char* name) {
+    xeno_transient_device_t* td = dev->transient;
+    if (!td || strncmp(name, "vk", 2) != 0) return NULL;
+#define TR_PROC(fn) if (td->next_##fn && strcmp(name, #fn) == 0) return (PFN_vkVoidFunction)tr_##fn;
+    TR_HOOKS(TR_PROC)
+#undef TR_PROC
+#define TR_ALIAS(fn, alias) if (td->next_##fn && strcmp(name, alias) == 0) return (PFN_vkVoidFunction)tr_##fn;
+    TR_ALIAS(vkGetImageMemoryRequirements2, "vkGetImageMemoryRequirements2KHR") TR_ALIAS(vkBindImageMemory2, "vkBindImageMemory2KHR")
+#undef TR_ALIAS
+    if (strcmp(name, "vkCmdBeginRenderPass") == 0) return (PFN_vkVoidFunction)tr_vkCmdBeginRenderPass;
+    if (tr_cmd.begin_pass2 && (strcmp(name, "vkCmdBeginRenderPass2") == 0 || strcmp(name, "vkCmdBeginRenderPass2KHR") == 0))
+        return (PFN_vkVoidFunction)tr_vkCmdBeginRenderPass2;
+    if (tr_cmd.begin_rendering && (strcmp(name, "vkCmdBeginRendering") == 0 || strcmp(name, "vkCmdBeginRenderingKHR") == 0))
+        return (PFN_vkVoidFunction)tr_vkCmdBeginRendering;
+    return NULL;
+}
+
+typedef struct tr_totals {
+    xeno_transient_device_t* td;
+    uint64_t images, converted, saved_bytes, candidate_bytes;
+    uint32_t sigs, transient, escaped;
+} tr_totals_t;
+
+static int image_total_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; tr_image_t* img = val; tr_totals_t* t = ctx;
+    if (img->td != t->td) return 0;
+    uint32_t flags = atomic_load(&img->flags); uint64_t size = atomic_load(&img->size);
+    t->images++;
+    if (flags & IMG_CONVERTED) t->converted++;
+    if ((flags & (IMG_LAZY | IMG_BOUND)) == (IMG_LAZY | IMG_BOUND)) t->saved_bytes += size;
+    else if (!(flags & IMG_CONVERTED) && sig_transient(t->td, img->sig)) t->candidate_bytes += size;
+    return 0;
+}
+
+static int sig_total_fn(uint64_t key, void* val, void* ctx) {
+    (void)key; tr_sig_t* s = val; tr_totals_t* t = ctx;
+    t->sigs++;
+    if (atomic_load(&s->escaped)) t->escaped++;
+    else if (sig_transient(t->td, s)) t->transient++;
+    return 0;
+}
+
+void xeno_transient_report(FILE* f, xeno_device_t* dev) {
+    xeno_transient_device_t* td = dev->transient;
+    fprintf(f, "  \"transient\": {\"enabled\": %s", td ? "true" : "false");
+    if (td) {
+        tr_totals_t t = { .td = td };
+        xeno_map_foreach(&tr_images, image_total_fn, &t);
+        xeno_map_foreach(&td->sigs, sig_total_fn, &t);
+        fprintf(f, ", \"lazy_types\": %u, \"learn_passes\": %u, \"passes\": %" PRIu64 ", \"signatures\": %u, \"transient_signatures\": %u, \"escaped_signatures\": %u, "
+                   "\"images\": %" PRIu64 ", \"converted_live\": %" PRIu64 ", \"converted\": %" PRIu64 ", \"mispredicted\": %" PRIu64 ", \"bytes_saved\": %" PRIu64 ", \"candidate_bytes\": %" PRIu64,
+                td->lazy_types, td->learn_passes, atomic_load(&td->passes), t.sigs, t.transient, t.escaped,
+                t.images, t.converted, atomic_load(&td->converted), atomic_load(&td->mispredicted), t.saved_bytes, t.candidate_bytes);
+    }
+    fprintf(f, "}");
+}
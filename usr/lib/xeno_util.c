@@ -0,0 +1,125 @@
+/* xeno_util.c - small shared utilities for the wrapper modules
+ *
+ * Provides:
+ * - monotonic nanosecond clock
+ * - process title for per-title knobs and files
+ * - bytes per texel of uncompressed color and depth/stencil formats
+ * - stable 64-bit hashing (identical across runs, usable for on-disk keys)
+ * - striped-lock handle maps used to attach wrapper state to Vulkan handles
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "xeno_internal.h"
+
+uint64_t xeno_now_ns(void) {
+    struct timespec ts; clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void xeno_process_title(char* out, size_t n) {
+    char buf[256] = "";
+    FILE* f = fopen("/proc/self/cmdline", "r");
+    if (f) { size_t r = fread(buf, 1, sizeof(buf) - 1, f); buf[r] = 0; fclose(f); }
+    const char* base = strrchr(buf, '/'); base = base ? base + 1 : buf;
+    size_t i = 0;
+    for (; base[i] && i + 1 < n; ++i) out[i] = isalnum((unsigned char)base[i]) ? (char)toupper((unsigned char)base[i]) : '_';
+    out[i] = 0;
+}
+
+uint32_t xeno_format_texel_bytes(VkFormat f) {
+    if (f == VK_FORMAT_R4G4_UNORM_PACK8 || f == VK_FORMAT_S8_UINT || (f >= VK_FORMAT_R8_UNORM && f <= VK_FORMAT_R8_SRGB)) return 1;
+    if ((f >= VK_FORMAT_R4G4B4A4_UNORM_PACK16 && f <= VK_FORMAT_A1R5G5B5_UNORM_PACK16) || (f >= VK_FORMAT_R8G8_UNORM && f <= VK_FORMAT_R8G8_SRGB) ||
+        (f >= VK_FORMAT_R16_UNORM && f <= VK_FORMAT_R16_SFLOAT) || f == VK_FORMAT_D16_UNORM) return 2;
+    if ((f >= VK_FORMAT_R8G8B8_UNORM && f <= VK_FORMAT_B8G8R8_SRGB) || f == VK_FORMAT_D16_UNORM_S8_UINT) return 3;
+    if (f >= VK_FORMAT_R16G16B16_UNORM && f <= VK_FORMAT_R16G16B16_SFLOAT) return 6;
+    if ((f >= VK_FORMAT_R16G16B16A16_UNORM && f <= VK_FORMAT_R16G16B16A16_SFLOAT) || (f >= VK_FORMAT_R32G32_UINT && f <= VK_FORMAT_R32G32_SFLOAT) ||
+        f == VK_FORMAT_D32_SFLOAT_S8_UINT) return 8;
+    if (f >= VK_FORMAT_R32G32B32_UINT && f <= VK_FORMAT_R32G32B32_SFLOAT) return 12;
+    if (f >= VK_FORMAT_R32G32B32A32_UINT && f <= VK_FORMAT_R32G32B32A32_SFLOAT) return 16;
+    return 4;
+}
+
+/* Hashing: 8 bytes per step with a splitmix finalizer; byte order is fixed little-endian */
+static inline uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ull; x ^= x >> 27; x *= 0x94d049bb133111ebull; x ^= x >> 31; return x;
+}
+uint64_t xeno_hash64(const void* data, size_t len, uint64_t seed) {
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t h = seed ^ (0x9e3779b97f4a7c15ull * (len + 1));
+    while (len >= 8) {
+        uint64_t w; memcpy(&w, p, 8);
+        h = rotl64(h ^ mix64(w), 27) * 0x9e3779b97f4a7c15ull;
+        p += 8; len -= 8;
+    }
+    uint64_t tail = 0;
+    for (size_t i = 0; i < len; ++i) tail |= (uint64_t)p[i] << (8 * i);
+    h ^= mix64(tail + len);
+    h = mix64(h);
+    return h ? h : 1; /* 0 is reserved as "empty" by the caches */
+}
+
+/* Handle maps */
+static inline uint32_t map_bucket(const xeno_map_t* m, uint64_t key) { return (uint32_t)(mix64(key) & m->mask); }
+static inline pthread_mutex_t* map_lock(xeno_map_t* m, uint32_t b) { return &m->locks[b & (XENO_MAP_STRIPES - 1)]; }
+
+void xeno_map_init(xeno_map_t* m, uint32_t buckets) {
+    uint32_t n = 64; while (n < buckets) n <<= 1;
+    m->buckets = calloc(n, sizeof(*m->buckets)); m->mask = n - 1;
+    for (int i = 0; i < XENO_MAP_STRIPES; ++i) pthread_mutex_init(&m->locks[i], NULL);
+    atomic_store(&m->count, 0);
+}
+void xeno_map_destroy(xeno_map_t* m) {
+    if (!m->buckets) return;
+    for (uint32_t b = 0; b <= m->mask; ++b) {
+        xeno_map_node_t* n = m->buckets[b];
+        while (n) { xeno_map_node_t* next = n->next; free(n); n = next; }
+    }
+    free(m->buckets); m->buckets = NULL;
+    for (int i = 0; i < XENO_MAP_STRIPES; ++i) pthread_mutex_destroy(&m->locks[i]);
+}
+void* xeno_map_get(xeno_map_t* m, uint64_t key) {
+    if (!m->buckets) return NULL;
+    uint32_t b = map_bucket(m, key); void* val = NULL;
+    pthread_mutex_lock(map_lock(m, b));
+    for (xeno_map_node_t* n = m->buckets[b]; n; n = n->next) if (n->key == key) { val = n->val; break; }
+    pthread_mutex_unlock(map_lock(m, b));
+    return val;
+}
+void xeno_map_put(xeno_map_t* m, uint64_t key, void* val) {
+    if (!m->buckets) return;
+    uint32_t b = map_bucket(m, key);
+    pthread_mutex_lock(map_lock(m, b));
+    for (xeno_map_node_t* n = m->buckets[b]; n; n = n->next) if (n->key == key) { n->val = val; pthread_mutex_unlock(map_lock(m, b)); return; }
+    xeno_map_node_t* n = malloc(sizeof(*n));
+    if (n) { n->key = key; n->val = val; n->next = m->buckets[b]; m->buckets[b] = n; atomic_fetch_add(&m->count, 1); }
+    pthread_mutex_unlock(map_lock(m, b));
+}
+void* xeno_map_remove(xeno_map_t* m, uint64_t key) {
+    if (!m->buckets) return NULL;
+    uint32_t b = map_bucket(m, key); void* val = NULL;
+    pthread_mutex_lock(map_lock(m, b));
+    for (xeno_map_node_t** pp = &m->buckets[b]; *pp; pp = &(*pp)->next) {
+        if ((*pp)->key == key) { xeno_map_node_t* n = *pp; *pp = n->next; val = n->val; free(n); atomic_fetch_sub(&m->count, 1); break; }
+    }
+    pthread_mutex_unlock(map_lock(m, b));
+    return val;
+}
+void xeno_map_foreach(xeno_map_t* m, int (*fn)(uint64_t key, void* val, void* ctx), void* ctx) {
+    if (!m->buckets) return;
+    for (uint32_t b = 0; b <= m->mask; ++b) {
+        pthread_mutex_lock(map_lock(m, b));
+        xeno_map_node_t** pp = &m->buckets[b];
+        while (*pp) {
+            xeno_map_node_t* n = *pp;
+            if (fn(n->key, n->val, ctx)) { *pp = n->next; free(n); atomic_fetch_sub(&m->count, 1); }
+            else pp = &n->next;
+        }
+        pthread_mutex_unlock(map_lock(m, b));
+    }
+}
@@ -0,0 +1,236 @@
+/* xeno_variant_cache.c - bounded, lock-free cache of derived pipeline variants
+ *
+ * Open addressing over a fixed power-of-two slot array, identified by a 128-bit hash of the packed
+ * variant key (no key storage, so slots can be recycled without readers touching freed memory).
+ * Lookups never take a lock: a slot is claimed by CAS on its hash, the claimer compiles, then
+ * publishes the pipeline with a release store of XENO_VARIANT_READY. Only threads that hit a
+ * variant while another thread is still compiling it block, on a shared condvar.
+ *
+ * The cache holds at most `capacity` variants. When full, the least recently used batch is
+ * evicted; evicted pipelines may still be referenced by recorded command buffers, so they are
+ * parked in a graveyard and destroyed once every command buffer that began before the eviction
+ * has been reset or freed (see xeno_cmdbuf_min_epoch). xeno_variant_trim() sheds variants the same
+ * way on demand, e.g. under memory pressure.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+#define TOMBSTONE UINT64_MAX
+
+xeno_variant_key_t xeno_variant_key(const uint32_t* words, uint32_t count) {
+    xeno_variant_key_t k;
+    k.h1 = xeno_hash64(words, count * sizeof(uint32_t), 0x5eed);
+    k.h2 = xeno_hash64(words, count * sizeof(uint32_t), 0xc0ffee);
+    if (k.h1 == TOMBSTONE) k.h1 = 1;
+    return k;
+}
+
+int xeno_variant_cache_init(xeno_variant_cache_t* c, xeno_device_t* dev, uint32_t capacity) {
+    uint32_t n = 64; while (n < capacity + capacity / 3) n <<= 1; /* keep the load factor under 3/4 */
+    memset(c, 0, sizeof(*c));
+    c->slots = calloc(n, sizeof(xeno_variant_t)); if (!c->slots) return -1;
+    c->mask = n - 1; c->capacity = capacity; c->dev = dev;
+    pthread_mutex_init(&c->wait_lock, NULL); pthread_cond_init(&c->wait_cond, NULL);
+    pthread_mutex_init(&c->evict_lock, NULL);
+    return 0;
+}
+
+void xeno_variant_cache_destroy(xeno_variant_cache_t* c) {
+    if (!c->slots) return;
+    xeno_device_t* dev = c->dev;
+    for (uint32_t i = 0; i <= c->mask; ++i) {
+        xeno_variant_t* v = &c->slots[i];
+        if (atomic_load(&v->state) == XENO_VARIANT_READY && v->pipeline) dev->vk.vkDestroyPipeline(dev->handle, v->pipeline, NULL);
+    }
+    for (uint32_t i = 0; i < c->grave_count; ++i) dev->vk.vkDestroyPipeline(dev->handle, c->grave[i].pipeline, NULL);
+    free(c->grave); free(c->slots); c->slots = NULL;
+    pthread_mutex_destroy(&c->wait_lock); pthread_cond_destroy(&c->wait_cond); pthread_mutex_destroy(&c->evict_lock);
+}
+
+/* --- eviction (serialized by evict_lock) --- */
+static void grave_collect(xeno_variant_cache_t* c) {
+    if (!c->grave_count) return;
+    uint64_t min_epoch = xeno_cmdbuf_min_epoch(c->dev);
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < c->grave_count; ++i) {
+        if (c->grave[i].epoch < min_epoch) c->dev->vk.vkDestroyPipeline(c->dev->handle, c->grave[i].pipeline, NULL);
+        else c->grave[kept++] = c->grave[i];
+    }
+    c->grave_count = kept;
+}
+static void grave_push(xeno_variant_cache_t* c, VkPipeline p, uint64_t epoch) {
+    if (c->grave_count == c->grave_cap) {
+        uint32_t cap = c->grave_cap ? c->grave_cap * 2 : 64;
+        void* g = realloc(c->grave, cap * sizeof(*c->grave));
+        if (!g) { xlog("variant cache: graveyard full, leaking evicted pipeline"); return; }
+        c->grave = g; c->grave_cap = cap;
+    }
+    c->grave[c->grave_count].pipeline = p; c->grave[c->grave_count].epoch = epoch; c->grave_count++;
+}
+static int cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b; return x < y ? -1 : x > y;
+}
+/* evicts up to batch of the least recently used variants */
+static uint32_t evict_batch(xeno_variant_cache_t* c, uint32_t batch) {
+    uint32_t n = 0, evicted = 0;
+    uint64_t* stamps = malloc((c->mask + 1) * sizeof(uint64_t));
+    if (!stamps) return 0;
+    for (uint32_t i = 0; i <= c->mask; ++i)
+        if (atomic_load_explicit(&c->slots[i].state, memory_order_acquire) == XENO_VARIANT_READY)
+            stamps[n++] = atomic_load_explicit(&c->slots[i].last_use, memory_order_relaxed);
+    uint64_t cutoff = 0;
+    if (n) { qsort(stamps, n, sizeof(uint64_t), cmp_u64); cutoff = stamps[(batch < n ? batch : n) - 1]; }
+    free(stamps);
+    uint64_t epoch = atomic_load(&c->dev->cb_epoch);
+    for (uint32_t i = 0; i <= c->mask && n && evicted < batch; ++i) {
+        xeno_variant_t* v = &c->slots[i];
+        if (atomic_load_explicit(&v->last_use, memory_order_relaxed) > cutoff) continue;
+        uint32_t expected = XENO_VARIANT_READY;
+        if (!atomic_compare_exchange_strong(&v->state, &expected, XENO_VARIANT_EVICTING)) continue;
+        grave_push(c, v->pipeline, epoch);
+        v->pipeline = VK_NULL_HANDLE;
+        atomic_store_explicit(&v->state, XENO_VARIANT_EMPTY, memory_order_release);
+        atomic_store_explicit(&v->hash, TOMBSTONE, memory_order_release);
+        atomic_fetch_sub(&c->count, 1);
+        evicted++;
+    }
+    atomic_fetch_add(&c->evictions, evicted);
+    return evicted;
+}
+static void evict_lru(xeno_variant_cache_t* c) {
+    if (pthread_mutex_trylock(&c->evict_lock) != 0) return; /* someone else is already making room */
+    if (atomic_load(&c->count) >= c->capacity) evict_batch(c, c->capacity / 16 ? c->capacity / 16 : 1);
+    grave_collect(c);
+    pthread_mutex_unlock(&c->evict_lock);
+}
+
+uint32_t xeno_variant_trim(xeno_variant_cache_t* c, uint32_t keep) {
+    if (!c->slots) return 0;
+    pthread_mutex_lock(&c->evict_lock);
+    uint32_t count = atomic_load(&c->count), evicted = count > keep ? evict_batch(c, count - keep) : 0;
+    grave_collect(c);
+    pthread_mutex_unlock(&c->evict_lock);
+    return evicted;
+}
+
+/* --- lookup / claim --- */
+/* returns 1 when v holds k, 0 when the slot turned out to be something else */
+static int slot_matches(xeno_variant_t* v, const xeno_variant_key_t* k) {
+    while (atomic_load_explicit(&v->state, memory_order_acquire) < XENO_VARIANT_COMPILING) {
+        if (atomic_load_explicit(&v->hash, memory_order_acquire) != k->h1) return 0;
+        sched_yield();
+    }
+    return v->h2 == k->h2 && atomic_load_explicit(&v->hash, memory_order_acquire) == k->h1;
+}
+
+xeno_variant_t* xeno_variant_acquire(xeno_variant_cache_t* c, const xeno_variant_key_t* k, int* claimed) {
+    *claimed = 0;
+    /* pass 1: find an existing entry; chains end at the first never-used slot */
+    for (uint32_t probe = 0; probe <= c->mask; ++probe) {
+        xeno_variant_t* v = &c->slots[(k->h1 + probe) & c->mask];
+        uint64_t cur = atomic_load_explicit(&v->hash, memory_order_acquire);
+        if (cur == 0) break;
+        if (cur == k->h1 && slot_matches(v, k)) {
+            atomic_store_explicit(&v->last_use, atomic_load_explicit(&c->clock, memory_order_relaxed), memory_order_relaxed);
+            return v;
+        }
+    }
+    if (atomic_load(&c->count) >= c->capacity) evict_lru(c);
+    if (atomic_load(&c->count) >= c->capacity) { atomic_fetch_add(&c->overflows, 1); return NULL; }
+    /* pass 2: claim the first free or recycled slot. Two threads racing on the same key may both
+     * claim; the duplicate is harmless and ages out through LRU. */
+    for (uint32_t probe = 0; probe <= c->mask; ++probe) {
+        xeno_variant_t* v = &c->slots[(k->h1 + probe) & c->mask];
+        uint64_t cur = atomic_load_explicit(&v->hash, memory_order_acquire);
+        if (cur == 0 || cur == TOMBSTONE) {
+            if (atomic_compare_exchange_strong(&v->hash, &cur, k->h1)) {
+                v->h2 = k->h2; v->pipeline = VK_NULL_HANDLE;
+                atomic_store_explicit(&v->last_use, atomic_fetch_add(&c->clock, 1) + 1, memory_order_relaxed);
+                atomic_store_explicit(&v->state, XENO_VARIANT_COMPILING, memory_order_release);
+                atomic_fetch_add(&c->count, 1);
+                *claimed = 1;
+                return v;
+            }
+        }
+        if (cur == k->h1 && slot_matches(v, k)) return v;
+    }
+    atomic_fetch_add(&c->overflows, 1);
+    return NULL;
+}
+
+void xeno_variant_publish(xeno_variant_cache_t* c, xeno_variant_t* v, VkPipeline pipeline, uint64_t compile_ns) {
+    v->pipeline = pipeline; v->compile_ns = compile_ns;
+    atomic_fetch_add(&c->compile_ns_total, compile_ns);
+    uint64_t prev = atomic_load(&c->compile_ns_max);
+    while (compile_ns > prev && !atomic_compare_exchange_weak(&c->compile_ns_max, &prev, compile_ns)) {}
+    if (!pipeline) atomic_fetch_add(&c->failures, 1);
+    pthread_mutex_lock(&c->wait_lock);
+    atomic_store_explicit(&v->state, pipeline ? XENO_VARIANT_READY : XENO_VARIANT_FAILED, memory_order_release);
+    pthread_cond_broadcast(&c->wait_cond);
+    pthread_mutex_unlock(&c->wait_lock);
+}
+
+VkPipeline xeno_variant_wait(xeno_variant_cache_t* c, xeno_variant_t* v, const xeno_variant_key_t* k) {
+    uint32_t s = atomic_load_explicit(&v->state, memory_order_acquire);
+    if (s == XENO_VARIANT_COMPILING) {
+        atomic_fetch_add(&c->waits, 1);
+        pthread_mutex_lock(&c->wait_lock);
+        while ((s = atomic_load_explicit(&v->state, memory_order_acquire)) == XENO_VARIANT_COMPILING)
+            pthread_cond_wait(&c->wait_cond, &c->wait_lock);
+        pthread_mutex_unlock(&c->wait_lock);
+    } else if (s == XENO_VARIANT_READY) {
+        atomic_fetch_add(&c->hits, 1);
+    }
+    if (s != XENO_VARIANT_READY) return VK_NULL_HANDLE;
+    VkPipeline p = v->pipeline;
+    /* re-validate: the slot may have been evicted and recycled while we read it */
+    if (atomic_load_explicit(&v->state, memory_order_acquire) != XENO_VARIANT_READY ||
+        atomic_load_explicit(&v->hash, memory_order_acquire) != k->h1 || v->h2 != k->h2) return VK_NULL_HANDLE;
+    return p;
+}
+
+VkPipeline xeno_variant_get(xeno_variant_cache_t* c, const xeno_variant_key_t* k, xeno_variant_compile_fn compile, void* ctx, int* uncached) {
+    *uncached = 0;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        int claimed = 0;
+        xeno_variant_t* v = xeno_variant_acquire(c, k, &claimed);
+        if (!v) break;
+        if (claimed) {
+            uint64_t t0 = xeno_now_ns();
+            VkPipeline p = compile(ctx);
+            atomic_fetch_add(&c->misses, 1);
+            xeno_variant_publish(c, v, p, xeno_now_ns() - t0);
+            return p;
+        }
+        uint32_t s = atomic_load_explicit(&v->state, memory_order_acquire);
+        VkPipeline p = xeno_variant_wait(c, v, k);
+        if (p || s == XENO_VARIANT_FAILED) return p;
+        /* evicted under us: look it up (or claim it) once more */
+    }
+    /* cache full: compile privately, the caller owns the result */
+    uint64_t t0 = xeno_now_ns();
+    VkPipeline p = compile(ctx);
+    atomic_fetch_add(&c->misses, 1);
+    atomic_fetch_add(&c->compile_ns_total, xeno_now_ns() - t0);
+    *uncached = 1;
+    return p;
+}
+
+void xeno_variant_report(FILE* f, const xeno_variant_cache_t* c) {
+    uint64_t hits = atomic_load(&c->hits), misses = atomic_load(&c->misses), waits = atomic_load(&c->waits);
+    uint64_t lookups = hits + misses + waits;
+    uint64_t compiled = misses + atomic_load(&c->async_compiles);
+    fprintf(f, "\"variants\": %u, \"capacity\": %u, \"hits\": %" PRIu64 ", \"misses\": %" PRIu64 ", \"waits\": %" PRIu64 ", ",
+            atomic_load(&c->count), c->capacity, hits, misses, waits);
+    fprintf(f, "\"hit_rate\": %.4f, \"async_compiles\": %" PRIu64 ", \"evictions\": %" PRIu64 ", \"overflows\": %" PRIu64 ", \"failures\": %" PRIu64 ", ",
+            lookups ? (double)hits / (double)lookups : 0.0, atomic_load(&c->async_compiles), atomic_load(&c->evictions),
+            atomic_load(&c->overflows), atomic_load(&c->failures));
+    fprintf(f, "\"compile_ms_total\": %.3f, \"compile_ms_avg\": %.3f, \"compile_ms_max\": %.3f",
+            atomic_load(&c->compile_ns_total) / 1e6, compiled ? atomic_load(&c->compile_ns_total) / 1e6 / (double)compiled : 0.0,
+            atomic_load(&c->compile_ns_max) / 1e6);
+}
@@ -0,0 +1,1093 @@
+/* xeno_vqueue.c - virtual queues over the hardware's queues
+ *
+ * vkGetPhysicalDeviceQueueFamilyProperties advertises xeno_queue_families (8 graphics, 4 compute
+ * and 2 transfer queues) whatever the hardware has. VkDeviceQueueCreateInfos the driver's families
+ * can hold as they are reach it unchanged and nothing below runs. Otherwise every advertised family
+ * is mapped onto a real family with its capabilities (the same index when that one qualifies), the
+ * app's queues are spread round-robin over the real family's queues, and vkGetDeviceQueue returns
+ * virtual handles.
+ *
+ * A virtual queue is a single-producer ring: the app already serializes its calls on a VkQueue, so
+ * the submitting thread copies the submit into the next slot and returns without taking a lock.
+ * Every real queue has a dispatcher thread draining the rings of its virtual queues in order, which
+ * also gives the real queue the external synchronization the driver needs. A dispatcher sleeps only
+ * when its rings are empty and producers signal it only then.
+ *
+ * Ordering:
+ *  - a virtual queue's operations reach its real queue in the order they were made;
+ *  - an operation waiting for semaphores is held until everything enqueued before it on the other
+ *    virtual queues has been submitted, so a binary semaphore's signal always precedes its wait;
+ *  - where several virtual queues share a real queue, a submit waiting for a timeline value is also
+ *    held until a submit signalling that value has reached the driver or the semaphore has reached
+ *    it: wait-before-signal across those virtual queues would otherwise put the waiter ahead of its
+ *    signaller on one real queue. The other virtual queues go past a held submit unless it signals a
+ *    binary semaphore. Submits that run on the dispatcher while the app waits are not held;
+ *  - present, sparse binds, vkQueueWaitIdle, debug labels and submits with extension structs the
+ *    ring does not copy run on the dispatcher while the calling thread waits for their result;
+ *  - vkDeviceWaitIdle lets every ring drain first, vkGetFenceFdKHR waits until what was enqueued before
+ *    it has been submitted (a sync_file is exported from a signal operation already submitted).
+ * An error of a submit that already returned is returned by the next call on its virtual queue.
+ * Queue entrypoints the layer does not know are not exposed while queues are virtual: the driver
+ * cannot take a virtual handle.
+ *
+ * When an advertised family maps onto another index, family indices are translated where the app
+ * passes them: command pools, VK_SHARING_MODE_CONCURRENT buffers and images, and the queue family
+ * ownership transfers of barriers.
+ *
+ * Submission thread (XCLIPSE_SUBMIT_THREAD=1): queues are virtual even when the driver's families
+ * could hold the request, one virtual queue per real one, so vkQueueSubmit returns once the submit
+ * is copied and the kernel time of the driver's submit is spent on the dispatcher, which is pinned
+ * to one CPU. Presents without extension structs go through the ring as well; since the app has
+ * already been answered, a present's VK_SUBOPTIMAL_KHR or error (VK_ERROR_OUT_OF_DATE_KHR, surface
+ * lost, ...) is returned by the next present of that swapchain, in its own pResults entry, and
+ * vkDestroySwapchainKHR waits for the rings to drain and drops what the swapchain had pending. Fences and semaphores are signalled by the driver as before. The report compares
+ * the render thread's time in these calls with the dispatchers' time in the driver's.
+ *
+ * Knobs:
+ *   XCLIPSE_VQUEUE=0             pass queue requests to the driver unchanged (no submission thread either)
+ *   XCLIPSE_VQUEUE_RING=N        slots per virtual queue ring (default 64, rounded up to a power of two)
+ *   XCLIPSE_SUBMIT_THREAD=1      submits and presents always go through the rings
+ *   XCLIPSE_SUBMIT_THREAD_CPU=N  CPU the dispatchers are pinned to (default the last online one, -1: not pinned)
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include "xeno_internal.h"
+
+const VkQueueFamilyProperties xeno_queue_families[XENO_QUEUE_FAMILY_COUNT] = {
+    { VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT, 8, 0, { 1, 1, 1 } },
+    { VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT, 4, 0, { 1, 1, 1 } },
+    { VK_QUEUE_TRANSFER_BIT, 2, 0, { 1, 1, 1 } },
+};
+
+#define VQ_MAX_QUEUES 8             /* per advertised family */
+#define VQ_MAX_REAL 16              /* real queues used per real family */
+#define VQ_STACK_BARRIERS 16
+
+struct xeno_vqueue_plan {
+    uint32_t family_map[XENO_QUEUE_FAMILY_COUNT];           /* advertised family -> real family */
+    uint32_t requested[XENO_QUEUE_FAMILY_COUNT];
+    uint32_t real_index[XENO_QUEUE_FAMILY_COUNT][VQ_MAX_QUEUES];
+    VkDeviceQueueCreateInfo infos[XENO_QUEUE_FAMILY_COUNT];
+    float priorities[XENO_QUEUE_FAMILY_COUNT][VQ_MAX_REAL];
+    uint32_t info_count;
+    int offload;                                            /* XCLIPSE_SUBMIT_THREAD */
+};
+
+enum { VQ_SUBMIT, VQ_SUBMIT2, VQ_PRESENT, VQ_CALL };
+
+struct xeno_vqueue_device;
+typedef struct vq_call {
+    VkResult (*run)(struct xeno_vqueue_device* vd, VkQueue real, const struct vq_call* c);
+    uint32_t count; const void* info; VkFence fence;        /* the app's arguments, alive while it waits */
+    VkResult result;
+    _Atomic int done;
+} vq_call_t;
+
+typedef struct vq_point { VkSemaphore semaphore; uint64_t value; } vq_point_t;
+
+typedef struct vq_slot {
+    _Atomic uint64_t seq;
+    uint64_t after;                 /* entries of other rings up to this sequence go first, 0: none */
+    int kind;
+    uint32_t count; VkFence fence;
+    const void* submits;            /* VQ_SUBMIT/VQ_SUBMIT2/VQ_PRESENT: deep copy in buf */
+    vq_call_t* call;
+    void* buf; size_t buf_size;     /* owned by the slot, reused */
+    vq_point_t* points; uint32_t points_cap;                /* owned by the slot, reused */
+    uint32_t waits, signals;        /* timeline waits, then signals, in points */
+    int binary_signals;             /* also signals a binary semaphore */
+    _Atomic int held;               /* waiting for a timeline value nothing submitted signals yet */
+} vq_slot_t;
+
+typedef struct vq_timeline { _Atomic uint64_t submitted; } vq_timeline_t;   /* highest value a submitted signal or the host reached */
+
+struct vq_real;
+typedef struct vq_queue {
+    void* loader_data;              /* first word of a dispatchable handle, written by the loader */
+    struct xeno_vqueue_device* vd;
+    struct vq_real* real;
+    uint32_t family, index;
+    vq_slot_t* slots; uint64_t mask;
+    _Atomic uint64_t head, tail;    /* consumer (dispatcher) / producer (app) positions */
+    _Atomic int error;              /* first failure of a submit the app was already told succeeded */
+} vq_queue_t;
+
+typedef struct vq_swapchain { _Atomic int present; } vq_swapchain_t;    /* result of a present the app was already told succeeded */
+
+typedef struct vq_real {
+    VkQueue handle;
+    uint32_t family, index;
+    struct xeno_vqueue_device* vd;
+    vq_queue_t* queues[XENO_QUEUE_FAMILY_COUNT * VQ_MAX_QUEUES]; uint32_t queue_count;
+    pthread_t thread; int started;
+    pthread_mutex_t lock; pthread_cond_t wake;
+    _Atomic int sleeping, stop;
+} vq_real_t;
+
+#define VQ_HOOKS(X) \
+    X(vkQueueSubmit) X(vkQueueSubmit2) X(vkQueueBindSparse) X(vkQueueWaitIdle) X(vkQueuePresentKHR) X(vkDeviceWaitIdle) \
+    X(vkQueueBeginDebugUtilsLabelEXT) X(vkQueueEndDebugUtilsLabelEXT) X(vkQueueInsertDebugUtilsLabelEXT) \
+    X(vkCreateCommandPool) X(vkCreateBuffer) X(vkCreateImage) X(vkDestroySwapchainKHR) X(vkGetFenceFdKHR) \
+    X(vkCreateSemaphore) X(vkDestroySemaphore) X(vkGetSemaphoreCounterValue)
+
+typedef struct xeno_vqueue_device {
+    xeno_device_t* dev;
+#define VQ_NEXT(fn) PFN_##fn next_##fn;
+    VQ_HOOKS(VQ_NEXT)
+#undef VQ_NEXT
+    struct xeno_vqueue_plan plan;
+    int identity;                   /* every advertised family kept its index */
+    long cpu;                       /* dispatchers pinned here, -1: not pinned */
+    int cmd_hooks;                  /* barrier translation installed */
+    int ordered;                    /* a real queue carries several virtual ones and timelines exist: timeline waits held */
+    xeno_map_t timelines;           /* VkSemaphore -> vq_timeline_t, the app's timeline semaphores while ordered */
+    xeno_map_t swapchains;          /* VkSwapchainKHR -> vq_swapchain_t, swapchains presented through the rings */
+    pthread_mutex_t swapchain_lock; /* inserts into swapchains */
+    vq_queue_t* queues[XENO_QUEUE_FAMILY_COUNT][VQ_MAX_QUEUES];
+    vq_real_t* reals; uint32_t real_count;
+    _Atomic uint64_t seq;
+    pthread_mutex_t done_lock; pthread_cond_t done_cond;    /* synchronous calls */
+    _Atomic uint64_t submits, calls, stalls, timeline_stalls, ring_full, sleeps, errors;
+    _Atomic uint64_t presents, frames, app_ns, driver_ns;  /* async presents; render thread vs driver time of async work */
+} vq_device_t;
+
+/* barriers carry no device: their translation is shared by every device, like the entrypoints */
+static struct {
+    pthread_mutex_t lock;
+    uint32_t devices;
+    uint32_t family_map[XENO_QUEUE_FAMILY_COUNT];
+    PFN_vkCmdPipelineBarrier pipeline_barrier;
+    PFN_vkCmdPipelineBarrier2 pipeline_barrier2;
+    PFN_vkCmdWaitEvents wait_events;
+    PFN_vkCmdWaitEvents2 wait_events2;
+} vq_cmd = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* --- planning, before vkCreateDevice --- */
+static VkQueueFlags queue_caps(VkQueueFlags flags) {
+    /* graphics and compute queues support transfers whether or not they report it */
+    return flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT) ? flags | VK_QUEUE_TRANSFER_BIT : flags;
+}
+
+static int covers(const VkQueueFamilyProperties* real, uint32_t family) {
+    VkQueueFlags need = xeno_queue_families[family].queueFlags;
+    return real->queueCount && (queue_caps(real->queueFlags) & need) == need;
+}
+
+static int pick_family(const VkQueueFamilyProperties* real, uint32_t real_count, uint32_t family) {
+    if (family < real_count && covers(&real[family], family)) return (int)family;
+    int best = -1, best_extra = 0;
+    for (uint32_t r = 0; r < real_count; ++r) {
+        if (!covers(&real[r], family)) continue;
+        int extra = __builtin_popcount(queue_caps(real[r].queueFlags) & ~xeno_queue_families[family].queueFlags &
+                                       (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT));
+        if (best < 0 || extra < best_extra || (extra == best_extra && real[r].queueCount > real[best].queueCount)) { best = (int)r; best_extra = extra; }
+    }
+    return best;
+}
+
+struct xeno_vqueue_plan* xeno_vqueue_plan(const VkQueueFamilyProperties* real, uint32_t real_count, const VkDeviceCreateInfo* ci, VkDeviceCreateInfo* out) {
+    uint32_t requested[XENO_QUEUE_FAMILY_COUNT] = { 0 };
+    const float* priorities[XENO_QUEUE_FAMILY_COUNT] = { NULL };
+    int fits = 1;
+    for (uint32_t i = 0; i < ci->queueCreateInfoCount; ++i) {
+        const VkDeviceQueueCreateInfo* q = &ci->pQueueCreateInfos[i];
+        /* protected or prioritized queues are the driver's to refuse */
+        if (q->flags || q->pNext || q->queueFamilyIndex >= XENO_QUEUE_FAMILY_COUNT) return NULL;
+        uint32_t f = q->queueFamilyIndex;
+        requested[f] = q->queueCount < xeno_queue_families[f].queueCount ? q->queueCount : xeno_queue_families[f].queueCount;
+        priorities[f] = q->pQueuePriorities;
+        if (f >= real_count || !covers(&real[f], f) || real[f].queueCount < requested[f]) fits = 0;
+    }
+    int offload = xeno_env_bool("XCLIPSE_SUBMIT_THREAD", 0);
+    if (fits && !offload) return NULL;
+    struct xeno_vqueue_plan* plan = calloc(1, sizeof(*plan)); if (!plan) return NULL;
+    plan->offload = offload;
+    uint32_t handed[XENO_QUEUE_FAMILY_COUNT] = { 0 };       /* queues handed out per plan->infos entry */
+    for (uint32_t f = 0; f < XENO_QUEUE_FAMILY_COUNT; ++f) {
+        plan->requested[f] = requested[f];
+        int r = pick_family(real, real_count, f);
+        if (r < 0) {
+            if (requested[f]) { xlog("vqueue: no queue family can run family %u's work", f); free(plan); return NULL; }
+            plan->family_map[f] = f;
+            continue;
+        }
+        plan->family_map[f] = (uint32_t)r;
+        if (!requested[f]) continue;
+        uint32_t slot = 0;
+        while (slot < plan->info_count && plan->infos[slot].queueFamilyIndex != (uint32_t)r) ++slot;
+        if (slot == plan->info_count) plan->infos[plan->info_count++] = (VkDeviceQueueCreateInfo){ VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO, NULL, 0, (uint32_t)r, 0, plan->priorities[slot] };
+        uint32_t avail = real[r].queueCount < VQ_MAX_REAL ? real[r].queueCount : VQ_MAX_REAL;
+        for (uint32_t i = 0; i < requested[f]; ++i) {
+            uint32_t k = handed[slot]++ % avail;
+            float p = priorities[f] ? priorities[f][i] : 1.0f;
+            if (k >= plan->infos[slot].queueCount) { plan->infos[slot].queueCount = k + 1; plan->priorities[slot][k] = p; }
+            else if (p > plan->priorities[slot][k]) plan->priorities[slot][k] = p;
+            plan->real_index[f][i] = k;
+        }
+    }
+    *out = *ci;
+    out->queueCreateInfoCount = plan->info_count;
+    out->pQueueCreateInfos = plan->infos;
+    xlog("vqueue: %u/%u/%u queues requested, mapped onto families %u/%u/%u", requested[0], requested[1], requested[2],
+         plan->family_map[0], plan->family_map[1], plan->family_map[2]);
+    return plan;
+}
+
+void xeno_vqueue_plan_free(struct xeno_vqueue_plan* plan) { free(plan); }
+
+/* --- ring --- */
+static vq_slot_t* ring_reserve(vq_queue_t* q) {
+    uint64_t t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    if (t - atomic_load_explicit(&q->head, memory_order_acquire) > q->mask) {
+        atomic_fetch_add_explicit(&q->vd->ring_full, 1, memory_order_relaxed);
+        while (t - atomic_load_explicit(&q->head, memory_order_acquire) > q->mask) sched_yield();
+    }
+    return &q->slots[t & q->mask];
+}
+
+static void ring_publish(vq_queue_t* q, vq_slot_t* s, int waits) {
+    vq_device_t* vd = q->vd;
+    uint64_t seq = atomic_fetch_add(&vd->seq, 1) + 1;
+    s->after = waits ? seq - 1 : 0;
+    atomic_store_explicit(&s->held, 0, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, seq, memory_order_relaxed);
+    atomic_store(&q->tail, atomic_load_explicit(&q->tail, memory_order_relaxed) + 1);
+    vq_real_t* real = q->real;
+    if (atomic_load(&real->sleeping)) {
+        pthread_mutex_lock(&real->lock);
+        pthread_cond_signal(&real->wake);
+        pthread_mutex_unlock(&real->lock);
+    }
+}
+
+static void* slot_buffer(vq_slot_t* s, size_t size) {
+    if (size > s->buf_size) {
+        void* b = realloc(s->buf, size);
+        if (!b) return NULL;
+        s->buf = b; s->buf_size = size;
+    }
+    return s->buf;
+}
+
+static size_t al8(size_t n) { return (n + 7) & ~(size_t)7; }
+static void* carve(char** cur, size_t n) { void* p = *cur; *cur += al8(n); return p; }
+
+static VkResult take_error(vq_queue_t* q) { return (VkResult)atomic_exchange(&q->error, VK_SUCCESS); }
+
+/* errors win over VK_SUBOPTIMAL_KHR, the first of each kind is kept */
+static void keep_result(_Atomic int* kept, VkResult r) {
+    int prev = VK_SUCCESS;
+    if (!atomic_compare_exchange_strong(kept, &prev, (int)r) && r < 0 && prev > 0) atomic_compare_exchange_strong(kept, &prev, (int)r);
+}
+static VkResult worse(VkResult a, VkResult b) { return a < 0 ? a : b < 0 ? b : a != VK_SUCCESS ? a : b; }
+
+/* --- dispatcher --- */
+/* nothing enqueued on another ring up to `after` is still waiting there */
+static int released(vq_device_t* vd, const vq_queue_t* self, uint64_t after) {
+    for (uint32_t f = 0; f < XENO_QUEUE_FAMILY_COUNT; ++f)
+        for (uint32_t i = 0; i < vd->plan.requested[f]; ++i) {
+            vq_queue_t* q = vd->queues[f][i];
+            if (q == self) continue;
+            uint64_t h = atomic_load_explicit(&q->head, memory_order_acquire), t = atomic_load_explicit(&q->tail, memory_order_acquire);
+            /* a submit held for a timeline value may be waiting for this very one: only the binary signals
+             * of it and of what queued up behind it must go first */
+            for (uint64_t k = h; k < t; ++k) {
+                const vq_slot_t* s = &q->slots[k & q->mask];
+                if (atomic_load_explicit(&s->seq, memory_order_relaxed) > after) break;
+                if ((k == h && !atomic_load(&s->held)) || s->binary_signals) return 0;
+            }
+        }
+    return 1;
+}
+
+static void raise_to(_Atomic uint64_t* v, uint64_t to) {
+    uint64_t cur = atomic_load(v);
+    while (cur < to && !atomic_compare_exchange_weak(v, &cur, to)) {}
+}
+
+/* every timeline value the slot waits for is signalled by a submitted operation or already reached */
+static int timelines_ready(vq_device_t* vd, const vq_slot_t* s) {
+    for (uint32_t i = 0; i < s->waits; ++i) {
+        const vq_point_t* p = &s->points[i];
+        vq_timeline_t* t = xeno_map_get(&vd->timelines, XENO_HANDLE_KEY(p->semaphore));
+        if (!t || atomic_load(&t->submitted) >= p->value) continue;
+        uint64_t value = 0;   /* signalled from the host, another device or a submit the app waited for */
+        if (vd->next_vkGetSemaphoreCounterValue && vd->next_vkGetSemaphoreCounterValue(vd->dev->handle, p->semaphore, &value) == VK_SUCCESS && value >= p->value) {
+            raise_to(&t->submitted, value);
+            continue;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+static void run_slot(vq_device_t* vd, vq_real_t* real, vq_queue_t* q, vq_slot_t* s) {
+    VkResult r;
+    if (s->kind == VQ_CALL) {
+        vq_call_t* c = s->call;
+        c->result = c->run(vd, real->handle, c);
+        pthread_mutex_lock(&vd->done_lock);
+        atomic_store(&c->done, 1);                          /* the caller's frame may be gone after this */
+        pthread_cond_broadcast(&vd->done_cond);
+        pthread_mutex_unlock(&vd->done_lock);
+        return;
+    }
+    uint64_t t0 = xeno_now_ns();
+    if (s->kind == VQ_PRESENT) r = vd->next_vkQueuePresentKHR(real->handle, s->submits);
+    else if (s->kind == VQ_SUBMIT2) r = vd->next_vkQueueSubmit2(real->handle, s->count, s->submits, s->fence);
+    else r = vd->next_vkQueueSubmit(real->handle, s->count, s->submits, s->fence);
+    atomic_fetch_add_explicit(&vd->driver_ns, xeno_now_ns() - t0, memory_order_relaxed);
+    if (s->kind == VQ_PRESENT) {
+        if (r == VK_SUCCESS) return;
+        const VkPresentInfoKHR* info = s->submits;
+        for (uint32_t i = 0; i < info->swapchainCount; ++i) {
+            VkResult ri = info->pResults[i] == VK_RESULT_MAX_ENUM ? r : info->pResults[i];   /* not written: the call's result */
+            vq_swapchain_t* sc = ri != VK_SUCCESS ? xeno_map_get(&vd->swapchains, XENO_HANDLE_KEY(info->pSwapchains[i])) : NULL;
+            if (sc) keep_result(&sc->present, ri);
+        }
+        if (r < 0) { atomic_fetch_add(&vd->errors, 1); xlog("vqueue: present on queue %u/%u failed (%d), reported at the swapchain's next present", q->family, q->index, (int)r); }
+        return;
+    }
+    if (r == VK_SUCCESS)
+        for (uint32_t i = s->waits; i < s->waits + s->signals; ++i) {
+            vq_timeline_t* t = xeno_map_get(&vd->timelines, XENO_HANDLE_KEY(s->points[i].semaphore));
+            if (t) raise_to(&t->submitted, s->points[i].value);
+        }
+    if (r != VK_SUCCESS) {
+        int ok = VK_SUCCESS;
+        atomic_compare_exchange_strong(&q->error, &ok, (int)r);
+        atomic_fetch_add(&vd->errors, 1);
+        xlog("vqueue: submit on queue %u/%u failed (%d), reported at its next call", q->family, q->index, (int)r);
+    }
+}
+
+/* 1: ran something, 0: rings empty, -1: entries waiting for other rings */
+static int dispatch_round(vq_device_t* vd, vq_real_t* real) {
+    int ran = 0, blocked = 0;
+    for (uint32_t i = 0; i < real->queue_count; ++i) {
+        vq_queue_t* q = real->queues[i];
+        uint64_t h = atomic_load_explicit(&q->head, memory_order_relaxed);
+        while (h < atomic_load_explicit(&q->tail, memory_order_acquire)) {
+            vq_slot_t* s = &q->slots[h & q->mask];
+            if (s->after && !released(vd, q, s->after)) { blocked = 1; atomic_fetch_add_explicit(&vd->stalls, 1, memory_order_relaxed); break; }
+            if (s->waits && !timelines_ready(vd, s)) {
+                if (!atomic_exchange(&s->held, 1)) atomic_fetch_add_explicit(&vd->timeline_stalls, 1, memory_order_relaxed);
+                blocked = 1;
+                break;
+            }
+            atomic_store(&s->held, 0);
+            run_slot(vd, real, q, s);
+            atomic_store_explicit(&q->head, ++h, memory_order_release);
+            ran = 1;
+        }
+    }
+    return ran ? 1 : blocked ? -1 : 0;
+}
+
+static int rings_empty(const vq_real_t* real) {
+    for (uint32_t i = 0; i < real->queue_count; ++i)
+        if (atomic_load(&real->queues[i]->head) != atomic_load(&real->queues[i]->tail)) return 0;
+    return 1;
+}
+
+static void* dispatcher_main(void* arg) {
+    vq_real_t* real = arg;
+    vq_device_t* vd = real->vd;
+    for (;;) {
+        int state = dispatch_round(vd, real);
+        if (state > 0) continue;
+        pthread_mutex_lock(&real->lock);
+        atomic_store(&real->sleeping, 1);
+        if (state < 0) {
+            /* another dispatcher is submitting what this one waits for: check back shortly */
+            struct timespec ts; clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += 100000; if (ts.tv_nsec >= 1000000000) { ts.tv_sec++; ts.tv_nsec -= 1000000000; }
+            pthread_cond_timedwait(&real->wake, &real->lock, &ts);
+        } else if (rings_empty(real) && !atomic_load(&real->stop)) {
+            atomic_fetch_add_explicit(&vd->sleeps, 1, memory_order_relaxed);
+            pthread_cond_wait(&real->wake, &real->lock);
+        }
+        atomic_store(&real->sleeping, 0);
+        int stop = atomic_load(&real->stop) && rings_empty(real);
+        pthread_mutex_unlock(&real->lock);
+        if (stop) return NULL;
+    }
+}
+
+static VkResult call_sync(vq_queue_t* q, vq_call_t* c, int waits) {
+    vq_device_t* vd = q->vd;
+    atomic_init(&c->done, 0);
+    vq_slot_t* s = ring_reserve(q);
+    s->kind = VQ_CALL; s->call = c;
+    s->waits = s->signals = 0; s->binary_signals = 1;     /* never held, assumed to signal what later waits need */
+    ring_publish(q, s, waits);
+    atomic_fetch_add_explicit(&vd->calls, 1, memory_order_relaxed);
+    pthread_mutex_lock(&vd->done_lock);
+    while (!atomic_load(&c->done)) pthread_cond_wait(&vd->done_cond, &vd->done_lock);
+    pthread_mutex_unlock(&vd->done_lock);
+    return c->result;
+}
+
+static VkResult run_submit(vq_device_t* vd, VkQueue real, const vq_call_t* c) { return vd->next_vkQueueSubmit(real, c->count, c->info, c->fence); }
+static VkResult run_submit2(vq_device_t* vd, VkQueue real, const vq_call_t* c) { return vd->next_vkQueueSubmit2(real, c->count, c->info, c->fence); }
+static VkResult run_bind_sparse(vq_device_t* vd, VkQueue real, const vq_call_t* c) { return vd->next_vkQueueBindSparse(real, c->count, c->info, c->fence); }
+static VkResult run_present(vq_device_t* vd, VkQueue real, const vq_call_t* c) { return vd->next_vkQueuePresentKHR(real, c->info); }
+static VkResult run_wait_idle(vq_device_t* vd, VkQueue real, const vq_call_t* c) { return vd->next_vkQueueWaitIdle(real); }
+static VkResult run_label_begin(vq_device_t* vd, VkQueue real, const vq_call_t* c) { vd->next_vkQueueBeginDebugUtilsLabelEXT(real, c->info); return VK_SUCCESS; }
+static VkResult run_label_end(vq_device_t* vd, VkQueue real, const vq_call_t* c) { vd->next_vkQueueEndDebugUtilsLabelEXT(real); return VK_SUCCESS; }
+static VkResult run_label_insert(vq_device_t* vd, VkQueue real, const vq_call_t* c) { vd->next_vkQueueInsertDebugUtilsLabelEXT(real, c->info); return VK_SUCCESS; }
+
+/* --- submit copies --- */
+static int legacy_copyable(const VkSubmitInfo* s) {
+    for (const VkBaseInStructure* e = s->pNext; e; e = e->pNext)
+        if (e->sType != VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO && e->sType != VK_STRUCTURE_TYPE_PROTECTED_SUBMIT_INFO) return 0;
+    return 1;
+}
+
+static const VkTimelineSemaphoreSubmitInfo* timeline_of(const VkSubmitInfo* s) {
+    for (const VkBaseInStructure* e = s->pNext; e; e = e->pNext)
+        if (e->sType == VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO) return (const VkTimelineSemaphoreSubmitInfo*)e;
+    return NULL;
+}
+
+static int copy_legacy(vq_slot_t* slot, uint32_t count, const VkSubmitInfo* in) {
+    size_t size = al8(count * sizeof(VkSubmitInfo));
+    for (uint32_t i = 0; i < count; ++i) {
+        const VkTimelineSemaphoreSubmitInfo* tl = timeline_of(&in[i]);
+        size += al8(sizeof(VkTimelineSemaphoreSubmitInfo)) + al8(sizeof(VkProtectedSubmitInfo)) +
+                al8(in[i].waitSemaphoreCount * sizeof(VkSemaphore)) + al8(in[i].waitSemaphoreCount * sizeof(VkPipelineStageFlags)) +
+                al8(in[i].commandBufferCount * sizeof(VkCommandBuffer)) + al8(in[i].signalSemaphoreCount * sizeof(VkSemaphore));
+        if (tl) size += al8(tl->waitSemaphoreValueCount * sizeof(uint64_t)) + al8(tl->signalSemaphoreValueCount * sizeof(uint64_t));
+    }
+    char* cur = slot_buffer(slot, size); if (!cur) return -1;
+    VkSubmitInfo* out = carve(&cur, count * sizeof(VkSubmitInfo));
+    for (uint32_t i = 0; i < count; ++i) {
+        const VkSubmitInfo* s = &in[i]; VkSubmitInfo* d = &out[i];
+        *d = *s; d->pNext = NULL;
+        const void* chain = NULL;
+        for (const VkBaseInStructure* e = s->pNext; e; e = e->pNext) {
+            if (e->sType == VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO) {
+                const VkTimelineSemaphoreSubmitInfo* tl = (const VkTimelineSemaphoreSubmitInfo*)e;
+                VkTimelineSemaphoreSubmitInfo* t = carve(&cur, sizeof(*t));
+                uint64_t* waits = carve(&cur, tl->waitSemaphoreValueCount * sizeof(uint64_t));
+                uint64_t* signals = carve(&cur, tl->signalSemaphoreValueCount * sizeof(uint64_t));
+                if (tl->waitSemaphoreValueCount) memcpy(waits, tl->pWaitSemaphoreValues, tl->waitSemaphoreValueCount * sizeof(uint64_t));
+                if (tl->signalSemaphoreValueCount) memcpy(signals, tl->pSignalSemaphoreValues, tl->signalSemaphoreValueCount * sizeof(uint64_t));
+                *t = (VkTimelineSemaphoreSubmitInfo){ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO, chain,
+                    tl->waitSemaphoreValueCount, waits, tl->signalSemaphoreValueCount, signals };
+                chain = t;
+            } else {
+                VkProtectedSubmitInfo* p = carve(&cur, sizeof(*p));
+                *p = *(const VkProtectedSubmitInfo*)e; p->pNext = chain;
+                chain = p;
+            }
+        }
+        d->pNext = chain;
+#define VQ_COPY(field, count_field, type) do { type* a = carve(&cur, s->count_field * sizeof(type)); \
+        if (s->count_field) memcpy(a, s->field, s->count_field * sizeof(type)); d->field = a; } while (0)
+        VQ_COPY(pWaitSemaphores, waitSemaphoreCount, VkSemaphore);
+        VQ_COPY(pWaitDstStageMask, waitSemaphoreCount, VkPipelineStageFlags);
+        VQ_COPY(pCommandBuffers, commandBufferCount, VkCommandBuffer);
+        VQ_COPY(pSignalSemaphores, signalSemaphoreCount, VkSemaphore);
+#undef VQ_COPY
+    }
+    slot->submits = out;
+    return 0;
+}
+
+static int copyable2(const VkSubmitInfo2* s) {
+    if (s->pNext) return 0;
+    for (uint32_t i = 0; i < s->waitSemaphoreInfoCount; ++i) if (s->pWaitSemaphoreInfos[i].pNext) return 0;
+    for (uint32_t i = 0; i < s->commandBufferInfoCount; ++i) if (s->pCommandBufferInfos[i].pNext) return 0;
+    for (uint32_t i = 0; i < s->signalSemaphoreInfoCount; ++i) if (s->pSignalSemaphoreInfos[i].pNext) return 0;
+    return 1;
+}
+
+static int copy2(vq_slot_t* slot, uint32_t count, const VkSubmitInfo2* in) {
+    size_t size = al8(count * sizeof(VkSubmitInfo2));
+    for (uint32_t i = 0; i < count; ++i)
+        size += al8((in[i].waitSemaphoreInfoCount + in[i].signalSemaphoreInfoCount) * sizeof(VkSemaphoreSubmitInfo)) +
+                al8(in[i].commandBufferInfoCount * sizeof(VkCommandBufferSubmitInfo));
+    char* cur = slot_buffer(slot, size); if (!cur) return -1;
+    VkSubmitInfo2* out = carve(&cur, count * sizeof(VkSubmitInfo2));
+    for (uint32_t i = 0; i < count; ++i) {
+        const VkSubmitInfo2* s = &in[i]; VkSubmitInfo2* d = &out[i];
+        *d = *s;
+        VkSemaphoreSubmitInfo* sems = carve(&cur, (s->waitSemaphoreInfoCount + s->signalSemaphoreInfoCount) * sizeof(*sems));
+        VkCommandBufferSubmitInfo* cbs = carve(&cur, s->commandBufferInfoCount * sizeof(*cbs));
+        if (s->waitSemaphoreInfoCount) memcpy(sems, s->pWaitSemaphoreInfos, s->waitSemaphoreInfoCount * sizeof(*sems));
+        if (s->signalSemaphoreInfoCount) memcpy(sems + s->waitSemaphoreInfoCount, s->pSignalSemaphoreInfos, s->signalSemaphoreInfoCount * sizeof(*sems));
+        if (s->commandBufferInfoCount) memcpy(cbs, s->pCommandBufferInfos, s->commandBufferInfoCount * sizeof(*cbs));
+        d->pWaitSemaphoreInfos = sems; d->pSignalSemaphoreInfos = sems + s->waitSemaphoreInfoCount; d->pCommandBufferInfos = cbs;
+    }
+    slot->submits = out;
+    return 0;
+}
+
+static int copy_present(vq_slot_t* slot, const VkPresentInfoKHR* in) {
+    size_t size = al8(sizeof(VkPresentInfoKHR)) + al8(in->waitSemaphoreCount * sizeof(VkSemaphore)) +
+                  al8(in->swapchainCount * sizeof(VkSwapchainKHR)) + al8(in->swapchainCount * sizeof(uint32_t)) + al8(in->swapchainCount * sizeof(VkResult));
+    char* cur = slot_buffer(slot, size); if (!cur) return -1;
+    VkPresentInfoKHR* out = carve(&cur, sizeof(*out));
+    VkSemaphore* sems = carve(&cur, in->waitSemaphoreCount * sizeof(VkSemaphore));
+    VkSwapchainKHR* swapchains = carve(&cur, in->swapchainCount * sizeof(VkSwapchainKHR));
+    uint32_t* images = carve(&cur, in->swapchainCount * sizeof(uint32_t));
+    VkResult* results = carve(&cur, in->swapchainCount * sizeof(VkResult));
+    for (uint32_t i = 0; i < in->swapchainCount; ++i) results[i] = VK_RESULT_MAX_ENUM;
+    if (in->waitSemaphoreCount) memcpy(sems, in->pWaitSemaphores, in->waitSemaphoreCount * sizeof(VkSemaphore));
+    if (in->swapchainCount) { memcpy(swapchains, in->pSwapchains, in->swapchainCount * sizeof(VkSwapchainKHR)); memcpy(images, in->pImageIndices, in->swapchainCount * sizeof(uint32_t)); }
+    *out = *in;
+    out->pWaitSemaphores = sems; out->pSwapchains = swapchains; out->pImageIndices = images; out->pResults = results;
+    slot->submits = out;
+    return 0;
+}
+
+/* --- timeline points of a copied submit, for the dispatcher to hold it on --- */
+static int points_begin(vq_device_t* vd, vq_slot_t* slot, uint32_t n) {
+    slot->waits = slot->signals = 0; slot->binary_signals = 1;
+    if (!vd->ordered) return 0;
+    if (n > slot->points_cap) {
+        vq_point_t* p = realloc(slot->points, n * sizeof(*p));
+        if (!p) return 0;                                   /* not held: the driver sees the app's order */
+        slot->points = p; slot->points_cap = n;
+    }
+    slot->binary_signals = 0;
+    return 1;
+}
+
+static void point_add(vq_device_t* vd, vq_slot_t* slot, VkSemaphore semaphore, uint64_t value, int signal) {
+    if (!xeno_map_get(&vd->timelines, XENO_HANDLE_KEY(semaphore))) { slot->binary_signals |= signal; return; }
+    slot->points[slot->waits + slot->signals] = (vq_point_t){ semaphore, value };
+    if (signal) slot->signals++; else slot->waits++;
+}
+
+static void points_legacy(vq_device_t* vd, vq_slot_t* slot, uint32_t count, const VkSubmitInfo* in) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; ++i) n += in[i].waitSemaphoreCount + in[i].signalSemaphoreCount;
+    if (!points_begin(vd, slot, n)) return;
+    for (int signal = 0; signal < 2; ++signal)              /* waits first */
+        for (uint32_t i = 0; i < count; ++i) {
+            const VkTimelineSemaphoreSubmitInfo* tl = timeline_of(&in[i]);
+            uint32_t sems = signal ? in[i].signalSemaphoreCount : in[i].waitSemaphoreCount;
+            uint32_t values = !tl ? 0 : signal ? tl->signalSemaphoreValueCount : tl->waitSemaphoreValueCount;
+            for (uint32_t k = 0; k < sems; ++k)
+                point_add(vd, slot, signal ? in[i].pSignalSemaphores[k] : in[i].pWaitSemaphores[k],
+                          k < values ? (signal ? tl->pSignalSemaphoreValues[k] : tl->pWaitSemaphoreValues[k]) : 0, signal);
+        }
+}
+
+static void points2(vq_device_t* vd, vq_slot_t* slot, uint32_t count, const VkSubmitInfo2* in) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; ++i) n += in[i].waitSemaphoreInfoCount + in[i].signalSemaphoreInfoCount;
+    if (!points_begin(vd, slot, n)) return;
+    for (int signal = 0; signal < 2; ++signal)
+        for (uint32_t i = 0; i < count; ++i) {
+            uint32_t sems = signal ? in[i].signalSemaphoreInfoCount : in[i].waitSemaphoreInfoCount;
+            const VkSemaphoreSubmitInfo* infos = signal ? in[i].pSignalSemaphoreInfos : in[i].pWaitSemaphoreInfos;
+            for (uint32_t k = 0; k < sems; ++k) point_add(vd, slot, infos[k].semaphore, infos[k].value, signal);
+        }
+}
+
+/* --- queue intercepts --- */
+static VKAPI_ATTR VkResult VKAPI_CALL vq_vkQueueSubmit(VkQueue queue, uint32_t submitCount, const VkSubmitInfo* pSubmits, VkFence fence) {
+    vq_queue_t* q = (vq_queue_t*)queue;
+    uint64_t t0 = xeno_now_ns();
+    VkResult r = take_error(q);
+    if (r != VK_SUCCESS) return r;
+    int copyable = 1, waits = 0;
+    for (uint32_t i = 0; i < submitCount; ++i) { copyable = copyable && legacy_copyable(&pSubmits[i]); waits |= pSubmits[i].waitSemaphoreCount != 0; }
+    if (copyable) {
+        vq_slot_t* s = ring_reserve(q);
+        if (copy_legacy(s, submitCount, pSubmits) == 0) {
+            points_legacy(q->vd, s, submitCount, pSubmits);
+            s->kind = VQ_SUBMIT; s->count = submitCount; s->fence = fence;
+            ring_publish(q, s, waits);
+            atomic_fetch_add_explicit(&q->vd->submits, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&q->vd->app_ns, xeno_now_ns() - t0, memory_order_relaxed);
+            return VK_SUCCESS;
+        }
+    }
+    vq_call_t c = { .run = run_submit, .count = submitCount, .info = pSubmits, .fence = fence };
+    return call_sync(q, &c, waits);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL vq_vkQueueSubmit2(VkQueue queue, uint32_t submitCount, const VkSubmitInfo2* pSubmits, VkFence fence) {
+    vq_queue_t* q = (vq_queue_t*)queue;
+    uint64_t t0 = xeno_now_ns();
+    VkResult r = take_error(q);
+    if (r != VK_SUCCESS) return r;
+    int copyable = 1, waits = 0;
+    for (uint32_t i = 0; i < submitCount; ++i) { copyable = copyable && copyable2(&pSubmits[i]); waits |= pSubmits[i].waitSemaphoreInfoCount != 0; }
+    if (copyable) {
+        vq_slot_t* s = ring_reserve(q);
+        if (copy2(s, submitCount, pSubmits) == 0) {
+            points2(q->vd, s, submitCount, pSubmits);
+            s->kind = VQ_SUBMIT2; s->count = submitCount; s->fence = fence;
+            ring_publish(q, s, waits);
+            atomic_fetch_add_explicit(&q->vd->submits, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&q->vd->app_ns, xeno_now_ns() - t0, memory_order_relaxed);
+            return VK_SUCCESS;
+        }
+    }
+    vq_call_t c = { .run = run_submit2, .count = submitCount, .info = pSubmits, .fence = fence };
+    return call_sync(q, &c, waits);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL vq_vkQueueBindSparse(VkQueue queue, uint32_t bindInfoCount, const VkBindSparseInfo* pBindInfo, VkFence fence) {
+    vq_queue_t* q = (vq_queue_t*)queue;
+    VkResult r = take_error(q);
+    if (r != VK_SUCCESS) return r;
+    int waits = 0;
+    for (uint32_t i = 0; i < bindInfoCount; ++i) waits |= pBindInfo[i].waitSemaphoreCount != 0;
+    vq_call_t c = { .run = run_bind_sparse, .count = bindInfoCount, .info = pBindInfo, .fence = fence };
+    return call_sync(q, &c, waits);
+}
+
+/* the entry a present's deferred result is kept in until the swapchain's next present */
+static vq_swapchain_t* swapchain_get(vq_device_t* vd, VkSwapchainKHR swapchain) {
+    vq_swapchain_t* sc = xeno_map_get(&vd->swapchains, XENO_HANDLE_KEY(swapchain));
+    if (sc) return sc;
+    pthread_mutex_lock(&vd->swapchain_lock);
+    if (!(sc = xeno_map_get(&vd->swapchains, XENO_HANDLE_KEY(swapchain))) && (sc = calloc(1, sizeof(*sc))))
+        xeno_map_put(&vd->swapchains, XENO_HANDLE_KEY(swapchain), sc);
+    pthread_mutex_unlock(&vd->swapchain_lock);
+    return sc;
+}
+
+/* what an earlier present of the swapchain got, now that the app can be told */
+static VkResult take_present(vq_device_t* vd, VkSwapchainKHR swapchain) {
+    vq_swapchain_t* sc = xeno_map_get(&vd->swapchains, XENO_HANDLE_KEY(swapchain));
+    return sc ? (VkResult)atomic_exchange(&sc->present, VK_SUCCESS) : VK_SUCCESS;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL vq_vkQueuePresentKHR(VkQueue queue, const VkPresentInfoKHR* pPresentInfo) {
+    vq_queue_t* q = (vq_queue_t*)queue;
+    vq_device_t* vd = q->vd;
+    uint64_t t0 = xeno_now_ns();
+    VkResult r = take_error(q);
+    if (r != VK_SUCCESS) return r;
+    atomic_fetch_add_explicit(&vd->frames, 1, memory_order_relaxed);
+    int waits = pPresentInfo->waitSemaphoreCount != 0, known = 1;
+    for (uint32_t i = 0; vd->plan.offload && i < pPresentInfo->swapchainCount; ++i) known &= swapchain_get(vd, pPresentInfo->pSwapchains[i]) != NULL;
+    if (vd->plan.offload && !pPresentInfo->pNext && known) {
+        vq_slot_t* s = ring_reserve(q);
+        if (copy_present(s, pPresentInfo) == 0) {
+            s->kind = VQ_PRESENT; s->waits = s->signals = 0; s->binary_signals = 0;
+            ring_publish(q, s, waits);
+            atomic_fetch_add_explicit(&vd->presents, 1, memory_order_relaxed);
+            for (uint32_t i = 0; i < pPresentInfo->swapchainCount; ++i) {
+                VkResult ri = take_present(vd, pPresentInfo->pSwapchains[i]);
+                if (pPresentInfo->pResults) pPresentInfo->pResults[i] = ri;
+                r = worse(r, ri);
+            }
+            atomic_fetch_add_explicit(&vd->app_ns, xeno_now_ns() - t0, memory_order_relaxed);
+            return r;
+        }
+    }
+    vq_call_t c = { .run = run_present, .count = 1, .info = pPresentInfo };
+    r = call_sync(q, &c, waits);
+    for (uint32_t i = 0; i < pPresentInfo->swapchainCount; ++i) {
+        VkResult prev = take_present(vd, pPresentInfo->pSwapchains[i]);
+        if (prev == VK_SUCCESS) continue;
+        if (pPresentInfo->pResults) pPresentInfo->pResults[i] = worse(pPresentInfo->pResults[i], prev);
+        r = worse(r, prev);
+    }
+    return r;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL vq_vkQueueWaitIdle(VkQueue queue) {
+    vq_queue_t* q = (vq_queue_t*)queue;
+    vq_call_t c = { .run = run_wait_idle };
+    VkResult r = call_sync(q, &c, 0), e = take_error(q);
+    return e != VK_SUCCESS ? e : r;
+}
+
+static VKAPI_ATTR void VKAPI_CALL vq_vkQueueBeginDebugUtilsLabelEXT(VkQueue queue, const VkDebugUtilsLabelEXT* pLabelInfo) {
+    vq_call_t c = { .run = run_label_begin, .count = 1, .info = pLabelInfo };
+    call_sync((vq_queue_t*)queue, &c, 0);
+}
+static VKAPI_ATTR void VKAPI_CALL vq_vkQueueEndDebugUtilsLabelEXT(VkQueue queue) {
+    vq_call_t c = { .run = run_label_end };
+    call_sync((vq_queue_t*)queue, &c, 0);
+}
+static VKAPI_ATTR void VKAPI_CALL vq_vkQueueInsertDebugUtilsLabelEXT(VkQueue queue, const VkDebugUtilsLabelEXT* pLabelInfo) {
+    vq_call_t c = { .run = run_label_insert, .count = 1, .info = pLabelInfo };
+    call_sync((vq_queue_t*)queue, &c, 0);
+}
+
+static void drain(vq_device_t* vd) {
+    for (uint32_t r = 0; r < vd->real_count; ++r)
+        while (!rings_empty(&vd->reals[r])) sched_yield();
+}
+
+/* what was enqueued up to now has reached the driver; entries enqueued meanwhile are not waited for */
+static void flush(vq_device_t* vd) {
+    for (uint32_t r = 0; r < vd->real_count; ++r)
+        for (uint32_t i = 0; i < vd->reals[r].queue_count; ++i) {
+            vq_queue_t* q = vd->reals[r].queues[i];
+            uint64_t tail = atomic_load(&q->tail);
+            while (atomic_load(&q->head) < tail) sched_yield();
+        }
+}
+
+void xeno_vqueue_flush(xeno_device_t* dev) {
+    if (dev->vqueue) flush(dev->vqueue);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL vq_vkGetFenceFdKHR(VkDevice device, const VkFenceGetFdInfoKHR* pGetFdInfo, int* pFd) {
+    vq_device_t* vd = xeno_device_get(device)->vqueue;
+    flush(vd);
+    return vd->next_vkGetFenceFdKHR(device, pGetFdInfo, pFd);
+}
+
+/* the app synchronizes every queue for this call: once the rings are empty the dispatchers are idle */
+static VKAPI_ATTR VkResult VKAPI_CALL vq_vkDeviceWaitIdle(VkDevice device) {
+    vq_device_t* vd = xeno_device_get(device)->vqueue;
+    drain(vd);
+    VkResult r = vd->next_vkDeviceWaitIdle(device);
+    for (uint32_t f = 0; f < XENO_QUEUE_FAMILY_COUNT; ++f)
+        for (uint32_t i = 0; i < vd->plan.requested[f]; ++i) {
+            VkResult e = take_error(vd->queues[f][i]);
+            if (r == VK_SUCCESS) r = e;
+        }
+    return r;
+}
+
+/* the swapchain's pending presents reach the driver before it goes, and a result they left goes with it */
+static VKAPI_ATTR void VKAPI_CALL vq_vkDestroySwapchainKHR(VkDevice device, VkSwapchainKHR swapchain, const VkAllocationCallbacks* pAllocator) {
+    vq_device_t* vd = xeno_device_get(device)->vqueue;
+    drain(vd);
+    if (swapchain) free(xeno_map_remove(&vd->swapchains, XENO_HANDLE_KEY(swapchain)));
+    vd->next_vkDestroySwapchainKHR(device, swapchain, pAllocator);
+}
+
+/* timeline semaphores are known by handle so the dispatchers can hold waits on them */
+static VKAPI_ATTR VkResult VKAPI_CALL vq_vkCreateSemaphore(VkDevice device, const VkSemaphoreCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkSemaphore* pSemaphore) {
+    vq_device_t* vd = xeno_device_get(device)->vqueue;
+    VkResult r = vd->next_vkCreateSemaphore(device, pCreateInfo, pAllocator, pSemaphore);
+    if (r != VK_SUCCESS) return r;
+    for (const VkBaseInStructure* e = pCreateInfo->pNext; e; e = e->pNext) {
+        if (e->sType != VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO) continue;
+        const VkSemaphoreTypeCreateInfo* type = (const VkSemaphoreTypeCreateInfo*)e;
+        if (type->semaphoreType != VK_SEMAPHORE_TYPE_TIMELINE) break;
+        vq_timeline_t* t = malloc(sizeof(*t));
+        if (!t) { xlog("vqueue: out of memory, waits on timeline semaphore 0x%" PRIx64 " are not held", XENO_HANDLE_KEY(*pSemaphore)); break; }
+        atomic_init(&t->submitted, type->initialValue);
+        xeno_map_put(&vd->timelines, XENO_HANDLE_KEY(*pSemaphore), t);
+        break;
+    }
+    return r;
+}
+
+static VKAPI_ATTR void VKAPI_CALL vq_vkDestroySemaphore(VkDevice device, VkSemaphore semaphore, const VkAllocationCallbacks* pAllocator) {
+    vq_device_t* vd = xeno_device_get(device)->vqueue;
+    if (semaphore) free(xeno_map_remove(&vd->timelines, XENO_HANDLE_KEY(semaphore)));
+    vd->next_vkDestroySemaphore(device, semaphore, pAllocator);
+}
+
+/* --- queue family translation --- */
+static uint32_t map_family(const uint32_t* family_map, uint32_t family) {
+    return family < XENO_QUEUE_FAMILY_COUNT ? family_map[family] : family;
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL vq_vkCreateCommandPool(VkDevice device, const VkCommandPoolCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkCommandPool* pCommandPool) {
+    vq_device_t* vd = xeno_device_get(device)->vqueue;
+    VkCommandPoolCreateInfo ci = *pCreateInfo;
+    ci.queueFamilyIndex = map_family(vd->plan.family_map, ci.queueFamilyIndex);
+    return vd->next_vkCreateCommandPool(device, &ci, pAllocator, pCommandPool);
+}
+
+/* concurrent sharing lists each family once: families that now share a real one collapse */
+static void map_sharing(const vq_device_t* vd, VkSharingMode* mode, uint32_t* count, const uint32_t** indices, uint32_t* storage) {
+    if (*mode != VK_SHARING_MODE_CONCURRENT || *count > XENO_QUEUE_FAMILY_COUNT * 2) return;
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < *count; ++i) {
+        uint32_t f = map_family(vd->plan.family_map, (*indices)[i]), k = 0;
+        while (k < n && storage[k] != f) ++k;
+        if (k == n) storage[n++] = f;
+    }
+    if (n < 2) { *mode = VK_SHARING_MODE_EXCLUSIVE; *count = 0; *indices = NULL; }
+    else { *count = n; *indices = storage; }
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL vq_vkCreateBuffer(VkDevice device, const VkBufferCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkBuffer* pBuffer) {
+    vq_device_t* vd = xeno_device_get(device)->vqueue;
+    VkBufferCreateInfo ci = *pCreateInfo; uint32_t families[XENO_QUEUE_FAMILY_COUNT * 2];
+    map_sharing(vd, &ci.sharingMode, &ci.queueFamilyIndexCount, &ci.pQueueFamilyIndices, families);
+    return vd->next_vkCreateBuffer(device, &ci, pAllocator, pBuffer);
+}
+
+static VKAPI_ATTR VkResult VKAPI_CALL vq_vkCreateImage(VkDevice device, const VkImageCreateInfo* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkImage* pImage) {
+    vq_device_t* vd = xeno_device_get(device)->vqueue;
+    VkImageCreateInfo ci = *pCreateInfo; uint32_t families[XENO_QUEUE_FAMILY_COUNT * 2];
+    map_sharing(vd, &ci.sharingMode, &ci.queueFamilyIndexCount, &ci.pQueueFamilyIndices, families);
+    return vd->next_vkCreateImage(device, &ci, pAllocator, pImage);
+}
+
+static int transfers_moved(uint32_t family) { return family < XENO_QUEUE_FAMILY_COUNT && vq_cmd.family_map[family] != family; }
+
+/* the barrier array as the driver must see it: the app's own unless an ownership transfer moved */
+#define VQ_MAP_BARRIERS(name, type) \
+static const type* name(uint32_t count, const type* in, type* stack, type** heap) { \
+    uint32_t i = 0; \
+    while (i < count && !transfers_moved(in[i].srcQueueFamilyIndex) && !transfers_moved(in[i].dstQueueFamilyIndex)) ++i; \
+    if (i == count) return in; \
+    type* out = count <= VQ_STACK_BARRIERS ? stack : (*heap = malloc(count * sizeof(type))); \
+    if (!out) return in; \
+    memcpy(out, in, count * sizeof(type)); \
+    for (; i < count; ++i) { \
+        out[i].srcQueueFamilyIndex = map_family(vq_cmd.family_map, out[i].srcQueueFamilyIndex); \
+        out[i].dstQueueFamilyIndex = map_family(vq_cmd.family_map, out[i].dstQueueFamilyIndex); \
+    } \
+    return out; \
+}
+VQ_MAP_BARRIERS(map_buffer_barriers, VkBufferMemoryBarrier)
+VQ_MAP_BARRIERS(map_image_barriers, VkImageMemoryBarrier)
+VQ_MAP_BARRIERS(map_buffer_barriers2, VkBufferMemoryBarrier2)
+VQ_MAP_BARRIERS(map_image_barriers2, VkImageMemoryBarrier2)
+#undef VQ_MAP_BARRIERS
+
+static VKAPI_ATTR void VKAPI_CALL vq_vkCmdPipelineBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask,
+                                                          VkDependencyFlags dependencyFlags, uint32_t memoryBarrierCount, const VkMemoryBarrier* pMemoryBarriers,
+                                                          uint32_t bufferMemoryBarrierCount, const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+                                                          uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* pImageMemoryBarriers) {
+    VkBufferMemoryBarrier bs[VQ_STACK_BARRIERS]; VkImageMemoryBarrier is[VQ_STACK_BARRIERS];
+    VkBufferMemoryBarrier* bh = NULL; VkImageMemoryBarrier* ih = NULL;
+    vq_cmd.pipeline_barrier(commandBuffer, srcStageMask, dstStageMask, dependencyFlags, memoryBarrierCount, pMemoryBarriers,
+                            bufferMemoryBarrierCount, map_buffer_barriers(bufferMemoryBarrierCount, pBufferMemoryBarriers, bs, &bh),
+                            imageMemoryBarrierCount, map_image_barriers(imageMemoryBarrierCount, pImageMemoryBarriers, is, &ih));
+    free(bh); free(ih);
+}
+
+static VKAPI_ATTR void VKAPI_CALL vq_vkCmdWaitEvents(VkCommandBuffer commandBuffer, uint32_t eventCount, const VkEvent* pEvents, VkPipelineStageFlags srcStageMask,
+                                                     VkPipelineStageFlags dstStageMask, uint32_t memoryBarrierCount, const VkMemoryBarrier* pMemoryBarriers,
+                                                     uint32_t bufferMemoryBarrierCount, const VkBufferMemoryBarrier* pBufferMemoryBarriers,
+                                                     uint32_t imageMemoryBarrierCount, const VkImageMemoryBarrier* pImageMemoryBarriers) {
+    VkBufferMemoryBarrier bs[VQ_STACK_BARRIERS]; VkImageMemoryBarrier is[VQ_STACK_BARRIERS];
+    VkBufferMemoryBarrier* bh = NULL; VkImageMemoryBarrier* ih = NULL;
+    vq_cmd.wait_events(commandBuffer, eventCount, pEvents, srcStageMask, dstStageMask, memoryBarrierCount, pMemoryBarriers,
+                       bufferMemoryBarrierCount, map_buffer_barriers(bufferMemoryBarrierCount, pBufferMemoryBarriers, bs, &bh),
+                       imageMemoryBarrierCount, map_image_barriers(imageMemoryBarrierCount, pImageMemoryBarriers, is, &ih));
+    free(bh); free(ih);
+}
+
+typedef struct vq_dependency {
+    VkDependencyInfo info;
+    VkBufferMemoryBarrier2 bs[VQ_STACK_BARRIERS]; VkImageMemoryBarrier2 is[VQ_STACK_BARRIERS];
+    VkBufferMemoryBarrier2* bh; VkImageMemoryBarrier2* ih;
+} vq_dependency_t;
+
+static const VkDependencyInfo* map_dependency(const VkDependencyInfo* in, vq_dependency_t* d) {
+    d->bh = NULL; d->ih = NULL;
+    d->info = *in;
+    d->info.pBufferMemoryBarriers = map_buffer_barriers2(in->bufferMemoryBarrierCount, in->pBufferMemoryBarriers, d->bs, &d->bh);
+    d->info.pImageMemoryBarriers = map_image_barriers2(in->imageMemoryBarrierCount, in->pImageMemoryBarriers, d->is, &d->ih);
+    return d->info.pBufferMemoryBarriers == in->pBufferMemoryBarriers && d->info.pImageMemoryBarriers == in->pImageMemoryBarriers ? in : &d->info;
+}
+
+static VKAPI_ATTR void VKAPI_CALL vq_vkCmdPipelineBarrier2(VkCommandBuffer commandBuffer, const VkDependencyInfo* pDependencyInfo) {
+    vq_dependency_t d;
+    vq_cmd.pipeline_barrier2(commandBuffer, map_dependency(pDependencyInfo, &d));
+    free(d.bh); free(d.ih);
+}
+
+static VKAPI_ATTR void VKAPI_CALL vq_vkCmdWaitEvents2(VkCommandBuffer commandBuffer, uint32_t eventCount, const VkEvent* pEvents, const VkDependencyInfo* pDependencyInfos) {
+    vq_dependency_t* d = eventCount ? malloc(eventCount * sizeof(*d)) : NULL;
+    VkDependencyInfo* infos = eventCount ? malloc(eventCount * sizeof(*infos)) : NULL;
+    if (!d || !infos) { free(d); free(infos); vq_cmd.wait_events2(commandBuffer, eventCount, pEvents, pDependencyInfos); return; }
+    for (uint32_t i = 0; i < eventCount; ++i) infos[i] = *map_dependency(&pDependencyInfos[i], &d[i]);
+    vq_cmd.wait_events2(commandBuffer, eventCount, pEvents, infos);
+    for (uint32_t i = 0; i < eventCount; ++i) { free(d[i].bh); free(d[i].ih); }
+    free(d); free(infos);
+}
+
+static int cmd_install(vq_device_t* vd) {
+    xeno_device_t* dev = vd->dev;
+    PFN_vkCmdPipelineBarrier barrier = (PFN_vkCmdPipelineBarrier)xeno_device_next_proc(dev, "vkCmdPipelineBarrier");
+    PFN_vkCmdPipelineBarrier2 barrier2 = (PFN_vkCmdPipelineBarrier2)xeno_device_next_proc(dev, "vkCmdPipelineBarrier2");
+    PFN_vkCmdWaitEvents wait = (PFN_vkCmdWaitEvents)xeno_device_next_proc(dev, "vkCmdWaitEvents");
+    PFN_vkCmdWaitEvents2 wait2 = (PFN_vkCmdWaitEvents2)xeno_device_next_proc(dev, "vkCmdWaitEvents2");
+    if (!barrier || !wait) return -1;
+    pthread_mutex_lock(&vq_cmd.lock);
+    int ok = !vq_cmd.devices || (vq_cmd.pipeline_barrier == barrier && vq_cmd.pipeline_barrier2 == barrier2 && vq_cmd.wait_events == wait &&
+                                 vq_cmd.wait_events2 == wait2 && memcmp(vq_cmd.family_map, vd->plan.family_map, sizeof(vq_cmd.family_map)) == 0);
+    if (ok) {
+        vq_cmd.pipeline_barrier = barrier; vq_cmd.pipeline_barrier2 = barrier2; vq_cmd.wait_events = wait; vq_cmd.wait_events2 = wait2;
+        memcpy(vq_cmd.family_map, vd->plan.family_map, sizeof(vq_cmd.family_map));
+        vq_cmd.devices++;
+    }
+    pthread_mutex_unlock(&vq_cmd.lock);
+    return ok ? 0 : -1;
+}
+
+/* --- device lifetime / routing --- */
+int xeno_vqueue_init(xeno_device_t* dev, struct xeno_vqueue_plan* plan) {
+    vq_device_t* vd = calloc(1, sizeof(*vd));
+    if (!vd || !dev->vk.vkGetDeviceQueue) { free(vd); free(plan); return -1; }
+    vd->dev = dev;
+    vd->plan = *plan;
+    free(plan);
+#define VQ_RESOLVE(fn) vd->next_##fn = (PFN_##fn)xeno_device_next_proc(dev, #fn);
+    VQ_HOOKS(VQ_RESOLVE)
+#undef VQ_RESOLVE
+    if (!vd->next_vkQueueSubmit || !vd->next_vkQueueWaitIdle || !vd->next_vkDeviceWaitIdle) { free(vd); return -1; }
+    if (!vd->next_vkGetSemaphoreCounterValue) vd->next_vkGetSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValue)xeno_device_next_proc(dev, "vkGetSemaphoreCounterValueKHR");
+    xeno_map_init(&vd->timelines, 64);
+    xeno_map_init(&vd->swapchains, 8);
+    pthread_mutex_init(&vd->swapchain_lock, NULL);
+    vd->identity = 1;
+    for (uint32_t f = 0; f < XENO_QUEUE_FAMILY_COUNT; ++f) vd->identity &= vd->plan.family_map[f] == f;
+    long ring = xeno_env_long("XCLIPSE_VQUEUE_RING", 64);
+    vd->cpu = -1;
+    if (vd->plan.offload) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        vd->cpu = xeno_env_long("XCLIPSE_SUBMIT_THREAD_CPU", cpus - 1);    /* the last cores are the big ones */
+        if (vd->cpu >= cpus || vd->cpu >= CPU_SETSIZE) vd->cpu = -1;
+    }
+    uint64_t slots = 8;
+    while (slots < (uint64_t)ring && slots < 4096) slots <<= 1;
+    pthread_mutex_init(&vd->done_lock, NULL); pthread_cond_init(&vd->done_cond, NULL);
+    for (uint32_t i = 0; i < vd->plan.info_count; ++i) vd->real_count += vd->plan.infos[i].queueCount;
+    vd->reals = calloc(vd->real_count ? vd->real_count : 1, sizeof(*vd->reals));
+    if (!vd->reals) { xeno_map_destroy(&vd->timelines); xeno_map_destroy(&vd->swapchains); pthread_mutex_destroy(&vd->swapchain_lock); free(vd); return -1; }
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < vd->plan.info_count; ++i)
+        for (uint32_t k = 0; k < vd->plan.infos[i].queueCount; ++k) {
+            vq_real_t* real = &vd->reals[n++];
+            real->family = vd->plan.infos[i].queueFamilyIndex; real->index = k; real->vd = vd;
+            dev->vk.vkGetDeviceQueue(dev->handle, real->family, k, &real->handle);
+            xeno_queue_register(real->handle, dev);
+            pthread_mutex_init(&real->lock, NULL); pthread_cond_init(&real->wake, NULL);
+        }
+    int failed = 0;
+    for (uint32_t f = 0; f < XENO_QUEUE_FAMILY_COUNT; ++f)
+        for (uint32_t i = 0; i < vd->plan.requested[f]; ++i) {
+            vq_queue_t* q = calloc(1, sizeof(*q));
+            vq_slot_t* s = calloc(slots, sizeof(*s));
+            vq_real_t* real = NULL;
+            for (uint32_t r = 0; r < vd->real_count && !real; ++r)
+                if (vd->reals[r].family == vd->plan.family_map[f] && vd->reals[r].index == vd->plan.real_index[f][i]) real = &vd->reals[r];
+            if (!q || !s || !real || !real->handle) { free(q); free(s); failed = 1; continue; }
+            q->loader_data = *(void**)real->handle;              /* the loader's dispatch slot, as on the driver's handle */
+            q->vd = vd; q->real = real; q->family = f; q->index = i;
+            q->slots = s; q->mask = slots - 1;
+            real->queues[real->queue_count++] = q;
+            vd->queues[f][i] = q;
+        }
+    for (uint32_t r = 0; r < vd->real_count && !failed; ++r) {
+        vq_real_t* real = &vd->reals[r];
+        if (!real->queue_count) continue;
+        if (pthread_create(&real->thread, NULL, dispatcher_main, real) != 0) { failed = 1; break; }
+        pthread_setname_np(real->thread, vd->plan.offload ? "xeno-submit" : "xeno-vqueue");
+        real->started = 1;
+        if (vd->cpu >= 0) {
+            cpu_set_t set; CPU_ZERO(&set); CPU_SET((int)vd->cpu, &set);
+            if (pthread_setaffinity_np(real->thread, sizeof(set), &set) != 0) { xlog("vqueue: cannot pin the dispatcher to cpu %ld", vd->cpu); vd->cpu = -1; }
+        }
+    }
+    for (uint32_t r = 0; r < vd->real_count; ++r) vd->ordered |= vd->reals[r].queue_count > 1;
+    vd->ordered = vd->ordered && dev->timeline && vd->next_vkCreateSemaphore && vd->next_vkDestroySemaphore;
+    dev->vqueue = vd;
+    if (failed) { xeno_vqueue_destroy(dev); return -1; }
+    if (!vd->identity) {
+        vd->cmd_hooks = cmd_install(vd) == 0;
+        if (!vd->cmd_hooks) xlog("vqueue: another device maps queue families differently, ownership transfers are not translated");
+    }
+    xlog("vqueue: %u+%u+%u virtual queues on %u real queues, ring=%" PRIu64 "%s%s, cpu=%ld", vd->plan.requested[0], vd->plan.requested[1], vd->plan.requested[2],
+         vd->real_count, slots, vd->plan.offload ? ", submission thread" : "", vd->ordered ? ", timeline waits held for their signals" : "", vd->cpu);
+    return 0;
+}
+
+static int free_entry(uint64_t key, void* val, void* ctx) { free(val); return 1; }
+
+void xeno_vqueue_destroy(xeno_device_t* dev) {
+    vq_device_t* vd = dev->vqueue;
+    if (!vd) return;
+    for (uint32_t r = 0; r < vd->real_count; ++r) {
+        vq_real_t* real = &vd->reals[r];
+        if (!real->started) continue;
+        pthread_mutex_lock(&real->lock);
+        atomic_store(&real->stop, 1);
+        pthread_cond_signal(&real->wake);
+        pthread_mutex_unlock(&real->lock);
+        pthread_join(real->thread, NULL);   /* returns once its rings are drained */
+    }
+    if (vd->cmd_hooks) { pthread_mutex_lock(&vq_cmd.lock); vq_cmd.devices--; pthread_mutex_unlock(&vq_cmd.lock); }
+    for (uint32_t f = 0; f < XENO_QUEUE_FAMILY_COUNT; ++f)
+        for (uint32_t i = 0; i < vd->plan.requested[f]; ++i) {
+            vq_queue_t* q = vd->queues[f][i];
+            if (!q) continue;
+            for (uint64_t s = 0; s <= q->mask; ++s) { free(q->slots[s].buf); free(q->slots[s].points); }
+            free(q->slots); free(q);
+        }
+    for (uint32_t r = 0; r < vd->real_count; ++r) { pthread_mutex_destroy(&vd->reals[r].lock); pthread_cond_destroy(&vd->reals[r].wake); }
+    pthread_mutex_destroy(&vd->done_lock); pthread_cond_destroy(&vd->done_cond);
+    xeno_map_foreach(&vd->timelines, free_entry, NULL);
+    xeno_map_destroy(&vd->timelines);
+    xeno_map_foreach(&vd->swapchains, free_entry, NULL);
+    xeno_map_destroy(&vd->swapchains);
+    pthread_mutex_destroy(&vd->swapchain_lock);
+    free(vd->reals);
+    dev->vqueue = NULL;
+    free(vd);
+}
+
+int xeno_vqueue_get(xeno_device_t* dev, uint32_t family, uint32_t index, VkQueue* pQueue) {
+    vq_device_t* vd = dev->vqueue;
+    if (!vd) return 0;
+    *pQueue = family < XENO_QUEUE_FAMILY_COUNT && index < vd->plan.requested[family] ? (VkQueue)vd->queues[family][index] : VK_NULL_HANDLE;
+    if (*pQueue) xeno_queue_register(*pQueue, dev);
+    return 1;
+}
+
+PFN_vkVoidFunction xeno_vqueue_proc(xeno_device_t* dev, const char* name) {
+    vq_device_t* vd = dev->vqueue;
+    if (!vd || strncmp(name, "vk", 2) != 0) return NULL;
+#define VQ_PROC(fn) if (vd->next_##fn && strcmp(name, #fn) == 0) return (PFN_vkVoidFunction)vq_##fn;
+    VQ_PROC(vkQueueSubmit) VQ_PROC(vkQueueSubmit2) VQ_PROC(vkQueueBindSparse) VQ_PROC(vkQueueWaitIdle) VQ_PROC(vkQueuePresentKHR)
+    VQ_PROC(vkDeviceWaitIdle) VQ_PROC(vkQueueBeginDebugUtilsLabelEXT) VQ_PROC(vkQueueEndDebugUtilsLabelEXT) VQ_PROC(vkQueueInsertDebugUtilsLabelEXT)
+    VQ_PROC(vkGetFenceFdKHR)
+    if (vd->ordered) { VQ_PROC(vkCreateSemaphore) VQ_PROC(vkDestroySemaphore) }
+    if (vd->next_vkQueueSubmit2 && strcmp(name, "vkQueueSubmit2KHR") == 0) return (PFN_vkVoidFunction)vq_vkQueueSubmit2;
+    if (vd->plan.offload) VQ_PROC(vkDestroySwapchainKHR)
+    if (vd->identity) return NULL;
+    VQ_PROC(vkCreateCommandPool) VQ_PROC(vkCreateBuffer) VQ_PROC(vkCreateImage)
+#undef VQ_PROC
+    if (!vd->cmd_hooks) return NULL;
+    if (strcmp(name, "vkCmdPipelineBarrier") == 0) return (PFN_vkVoidFunction)vq_vkCmdPipelineBarrier;
+    if (strcmp(name, "vkCmdWaitEvents") == 0) return (PFN_vkVoidFunction)vq_vkCmdWaitEvents;
+    if (vq_cmd.pipeline_barrier2 && (strcmp(name, "vkCmdPipelineBarrier2") == 0 || strcmp(name, "vkCmdPipelineBarrier2KHR") == 0)) return (PFN_vkVoidFunction)vq_vkCmdPipelineBarrier2;
+    if (vq_cmd.wait_events2 && (strcmp(name, "vkCmdWaitEvents2") == 0 || strcmp(name, "vkCmdWaitEvents2KHR") == 0)) return (PFN_vkVoidFunction)vq_vkCmdWaitEvents2;
+    return NULL;
+}
+
+int xeno_vqueue_hidden(xeno_device_t* dev, const char* name) {
+    return dev->vqueue && (strncmp(name, "vkQueue", 7) == 0 || strncmp(name, "vkGetQueue", 10) == 0);
+}
+
+void xeno_vqueue_report(FILE* f, xeno_device_t* dev) {
+    vq_device_t* vd = dev->vqueue;
+    fprintf(f, "  \"vqueue\": {\"enabled\": %s", vd ? "true" : "false");
+    if (vd) {
+        fprintf(f, ", \"real_queues\": %u, \"families\": [", vd->real_count);
+        for (uint32_t fam = 0; fam < XENO_QUEUE_FAMILY_COUNT; ++fam)
+            fprintf(f, "%s{\"queues\": %u, \"real_family\": %u}", fam ? ", " : "", vd->plan.requested[fam], vd->plan.family_map[fam]);
+        fprintf(f, "], \"translated_families\": %s, \"async_submits\": %" PRIu64 ", \"sync_calls\": %" PRIu64 ", \"dependency_stalls\": %" PRIu64
+                   ", \"timeline_stalls\": %" PRIu64 ", \"ring_full\": %" PRIu64 ", \"dispatcher_sleeps\": %" PRIu64 ", \"errors\": %" PRIu64,
+                vd->identity ? "false" : "true", atomic_load(&vd->submits), atomic_load(&vd->calls), atomic_load(&vd->stalls), atomic_load(&vd->timeline_stalls),
+                atomic_load(&vd->ring_full), atomic_load(&vd->sleeps), atomic_load(&vd->errors));
+        /* driver time the render thread would have spent minus what enqueueing cost it */
+        uint64_t frames = atomic_load(&vd->frames), app = atomic_load(&vd->app_ns), driver = atomic_load(&vd->driver_ns);
+        double saved = ((double)driver - (double)app) / 1e3;
+        fprintf(f, ", \"submit_thread\": {\"enabled\": %s, \"cpu\": %ld, \"async_presents\": %" PRIu64 ", \"frames\": %" PRIu64
+                   ", \"render_thread_us\": %.0f, \"driver_us\": %.0f, \"saved_us\": %.0f, \"saved_us_per_frame\": %.1f}",
+                vd->plan.offload ? "true" : "false", vd->cpu, atomic_load(&vd->presents), frames, app / 1e3, driver / 1e3, saved, frames ? saved / frames : 0.0);
+    }
+    fprintf(f, "}");
+}
@@ -0,0 +1,112 @@
+/* xeno_workers.c - shared background worker pool
+ *
+ * Lazily started on first submit. Size defaults to (online cores - 1), clamped to [1,16],
+ * and can be overridden with XCLIPSE_WORKERS (0 disables the pool; callers then run inline).
+ *
+ * xeno_workers_parallel() fans a loop out over the pool with the calling thread taking part: items
+ * are claimed one at a time, so the caller finishes the loop alone when every worker is busy and
+ * it is safe to call from a worker.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <unistd.h>
+#include "xeno_internal.h"
+
+#define XENO_MAX_WORKERS 16
+
+typedef struct xeno_job { xeno_job_fn fn; void* ctx; struct xeno_job* next; } xeno_job_t;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+static xeno_job_t* pool_head = NULL;
+static xeno_job_t* pool_tail = NULL;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static int pool_size = 0;
+
+static void* worker_main(void* arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&pool_lock);
+        while (!pool_head) pthread_cond_wait(&pool_cond, &pool_lock);
+        xeno_job_t* j = pool_head; pool_head = j->next; if (!pool_head) pool_tail = NULL;
+        pthread_mutex_unlock(&pool_lock);
+        j->fn(j->ctx);
+        free(j);
+    }
+    return NULL;
+}
+
+static void pool_start(void) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    long n = xeno_env_long("XCLIPSE_WORKERS", cores > 1 ? cores - 1 : 1);
+    if (n < 0) n = 0;
+    if (n > XENO_MAX_WORKERS) n = XENO_MAX_WORKERS;
+    for (long i = 0; i < n; ++i) {
+        pthread_t t;
+        if (pthread_create(&t, NULL, worker_main, NULL) != 0) break;
+        pthread_setname_np(t, "xeno-worker");
+        pthread_detach(t); pool_size++;
+    }
+    xlog("worker pool started threads=%d", pool_size);
+}
+
+int xeno_workers_count(void) { pthread_once(&pool_once, pool_start); return pool_size; }
+
+int xeno_workers_submit(xeno_job_fn fn, void* ctx) {
+    if (xeno_workers_count() == 0) return -1;
+    xeno_job_t* j = malloc(sizeof(*j)); if (!j) return -1;
+    j->fn = fn; j->ctx = ctx; j->next = NULL;
+    pthread_mutex_lock(&pool_lock);
+    if (pool_tail) pool_tail->next = j; else pool_head = j;
+    pool_tail = j;
+    pthread_cond_signal(&pool_cond);
+    pthread_mutex_unlock(&pool_lock);
+    return 0;
+}
+
+typedef struct xeno_parallel {
+    xeno_range_fn fn; void* ctx; uint32_t n;
+    _Atomic uint32_t next, done;
+    _Atomic int refs;               /* caller + submitted helpers; the last one frees */
+    pthread_mutex_t lock; pthread_cond_t cond;
+} xeno_parallel_t;
+
+static void parallel_put(xeno_parallel_t* p) {
+    if (atomic_fetch_sub(&p->refs, 1) != 1) return;
+    pthread_mutex_destroy(&p->lock); pthread_cond_destroy(&p->cond);
+    free(p);
+}
+
+static void parallel_drain(xeno_parallel_t* p) {
+    uint32_t i;
+    while ((i = atomic_fetch_add(&p->next, 1)) < p->n) {
+        p->fn(p->ctx, i);
+        if (atomic_fetch_add(&p->done, 1) + 1 == p->n) {
+            pthread_mutex_lock(&p->lock); pthread_cond_signal(&p->cond); pthread_mutex_unlock(&p->lock);
+        }
+    }
+}
+
+static void parallel_job(void* ctx) { parallel_drain(ctx); parallel_put(ctx); }
+
+uint32_t xeno_workers_parallel(uint32_t n, xeno_range_fn fn, void* ctx) {
+    uint32_t helpers = (uint32_t)xeno_workers_count();
+    if (helpers > n - 1) helpers = n ? n - 1 : 0;
+    xeno_parallel_t* p = helpers ? calloc(1, sizeof(*p)) : NULL;
+    if (!p) { for (uint32_t i = 0; i < n; ++i) fn(ctx, i); return 1; }
+    p->fn = fn; p->ctx = ctx; p->n = n;
+    atomic_init(&p->refs, 1);
+    pthread_mutex_init(&p->lock, NULL); pthread_cond_init(&p->cond, NULL);
+    uint32_t started = 0;
+    for (; started < helpers; ++started) {
+        atomic_fetch_add(&p->refs, 1);
+        if (xeno_workers_submit(parallel_job, p) != 0) { atomic_fetch_sub(&p->refs, 1); break; }
+    }
+    parallel_drain(p);
+    pthread_mutex_lock(&p->lock);
+    while (atomic_load(&p->done) < n) pthread_cond_wait(&p->cond, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+    parallel_put(p);
+    return started + 1;
+}